@@ -0,0 +1,548 @@
+#!/usr/bin/env python
+"""
+macrobench.py - End-to-end benchmarks of MADlib workloads
+
+Usage:
+  macrobench.py run [options]         Generate data sets, run the scenarios,
+                                      and append the results to a file
+  macrobench.py report FILE [FILE...] Compare results of several runs, e.g.,
+                                      on clusters with different numbers of
+                                      segments or with different releases
+
+Every scenario is an end-to-end call of a MADlib function on a synthetic data
+set of the given number of rows, which is generated with madlib_datagen (see
+examples/datagen/README). For every run, the results contain:
+
+- the wall time of the call,
+- the number of sequential scans of the source table (from the statistics
+  collector),
+- the calls and estimated CPU time of all C++ functions (function_stats()),
+- the memory requested by MADlib (memory_stats()), whose largest request
+  bounds the size of a transition state,
+- one row per iteration of the functions driven by an IterationController
+  (set_iteration_stats()).
+
+Results are appended as JSON lines, one per run, together with the MADlib
+version and the number of segments (1 for PostgreSQL). See README for an
+example.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Data sets
+#
+# Columns of the tables written by madlib_datagen (see src/bench/datagen.cpp)
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+DATASETS = {
+    'linear': 'id BIGINT, y FLOAT8, x FLOAT8[]',
+    'logistic': 'id BIGINT, y BOOLEAN, x FLOAT8[]',
+    'kmeans': 'id BIGINT, coords FLOAT8[], cluster INTEGER',
+    'ratings': 'row_id INTEGER, col_id INTEGER, rating FLOAT8'
+}
+
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Scenarios
+#
+# - dataset: Data set the scenario runs on
+# - setup: Statements run before the measurement (e.g., to derive a table)
+# - run: The measured statement
+# - cleanup: Statements run after the measurement
+# - scan_table: Table whose sequential scans are counted (default: {table})
+#
+# The statements may use the replacement fields {schema} (the MADlib schema),
+# {table} (the data set), {out} (a prefix for output tables), {width}, and
+# {row_dim} and {col_dim} (dimensions of the rating matrix).
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+SCENARIOS = [
+    ('linregr', {
+        'dataset': 'linear',
+        'run': "SELECT ({schema}.linregr(y, x)).r2 FROM {table}"
+    }),
+    ('logregr_irls', {
+        'dataset': 'logistic',
+        'run': """
+            SELECT ({schema}.logregr('{table}', 'y', 'x', 20, 'irls',
+                0.0001)).num_iterations"""
+    }),
+    ('logregr_igd', {
+        'dataset': 'logistic',
+        'run': """
+            SELECT ({schema}.logregr('{table}', 'y', 'x', 20, 'igd',
+                0.0001)).num_iterations"""
+    }),
+    ('kmeans', {
+        'dataset': 'kmeans',
+        'setup': """
+            DROP TABLE IF EXISTS {out}_points;
+            DROP TABLE IF EXISTS {out}_centroids;""",
+        'run': """
+            SELECT * FROM {schema}.kmeans_random('{table}', 'coords', NULL,
+                '{out}_points', '{out}_centroids', 'l2norm', 20, 0.001, False,
+                False, 5)""",
+        'cleanup': """
+            DROP TABLE IF EXISTS {out}_points;
+            DROP TABLE IF EXISTS {out}_centroids;"""
+    }),
+    ('lmf', {
+        'dataset': 'ratings',
+        'setup': "DROP TABLE IF EXISTS {out};",
+        'run': """
+            SELECT {schema}.lmf_igd_run('{out}', '{table}', 'row_id', 'col_id',
+                'rating', {row_dim}, {col_dim}, 10, 0.01, 0.1, 10, 0.0001)""",
+        'cleanup': "DROP TABLE IF EXISTS {out};"
+    }),
+    ('cart', {
+        'dataset': 'logistic',
+        'setup': """
+            DROP TABLE IF EXISTS {out} CASCADE;
+            DROP TABLE IF EXISTS {out}_train;
+            CREATE TABLE {out}_train AS
+            SELECT id, {features_expr}, y::INTEGER AS class FROM {table};""",
+        'run': """
+            SELECT ({schema}.c45_train('infogain', '{out}_train', '{out}',
+                NULL, '{features}', '{features}', 'id', 'class', 100,
+                'ignore', 10, 0.001, 0.001, 0)).tree_nodes""",
+        'cleanup': """
+            SELECT {schema}.c45_clean('{out}');
+            DROP TABLE IF EXISTS {out}_train;""",
+        'scan_table': '{out}_train'
+    }),
+    ('sketches', {
+        'dataset': 'ratings',
+        'run': """
+            SELECT
+                {schema}.fmsketch_dcount(col_id),
+                {schema}.cmsketch(row_id::INT8) IS NOT NULL,
+                {schema}.mfvsketch_top_histogram(col_id, 10) IS NOT NULL
+            FROM {table}"""
+    }),
+    ('profile', {
+        'dataset': 'ratings',
+        'run': "SELECT count(*) FROM {schema}.profile('{table}')"
+    })
+]
+SCENARIO_NAMES = [name for (name, scenario) in SCENARIOS]
+
+# Prefix of the result rows in the output of psql
+TAG = 'macrobench'
+
+def error(message):
+    sys.stderr.write('macrobench: ERROR: ' + message + '\n')
+    sys.exit(1)
+
+def info(message):
+    sys.stderr.write('macrobench: ' + message + '\n')
+
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Connection to the database through psql
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+class Database:
+    def __init__(self, args):
+        self.psql = [args.psql, '-X', '-q', '-A', '-t', '-F', '\t',
+            '-v', 'ON_ERROR_STOP=1']
+        for (option, value) in [('-d', args.database), ('-h', args.host),
+                ('-p', args.port), ('-U', args.user)]:
+            if value is not None:
+                self.psql += [option, str(value)]
+
+    def runScript(self, sql, stdin = None):
+        """
+        Run SQL statements, each in its own transaction
+
+        @return The rows of the output that start with TAG, as lists of
+            strings (without the tag)
+        """
+        (fd, path) = tempfile.mkstemp(suffix = '.sql', prefix = 'macrobench')
+        try:
+            f = os.fdopen(fd, 'w')
+            f.write(sql)
+            f.close()
+            proc = subprocess.Popen(self.psql + ['-f', path],
+                stdin = stdin, stdout = subprocess.PIPE,
+                stderr = subprocess.PIPE, universal_newlines = True)
+            (out, err) = proc.communicate()
+        finally:
+            os.remove(path)
+        if proc.returncode != 0:
+            error('psql failed:\n' + err)
+        rows = []
+        for line in out.splitlines():
+            fields = line.split('\t')
+            if fields[0] == TAG:
+                rows.append(fields[1:])
+        return rows
+
+    def query(self, sql):
+        return self.runScript(sql)
+
+    def queryValue(self, expr):
+        return self.query("SELECT '%s', %s;\n" % (TAG, expr))[0][0]
+
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Data generation
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+def ratingDimensions(rows):
+    # About 100 ratings per row of the rating matrix
+    return (max(1000, rows // 100), 1000)
+
+def datagenCommand(args, dataset, rows):
+    cmd = [args.datagen, '--dataset', dataset, '--rows', str(rows),
+        '--seed', str(args.seed)]
+    if dataset in ('linear', 'logistic', 'kmeans'):
+        cmd += ['--width', str(args.width)]
+    elif dataset == 'ratings':
+        (rowDim, colDim) = ratingDimensions(rows)
+        cmd += ['--row-dim', str(rowDim), '--column-dim', str(colDim)]
+    return cmd
+
+def ensureDataset(db, args, env, dataset, rows):
+    """
+    Create the table of a data set unless it already has the right size
+
+    @return The qualified name of the table
+    """
+    table = '%s.%s_%d' % (args.work_schema, dataset, rows)
+    exists = db.queryValue("""
+        (SELECT count(*) FROM pg_class c JOIN pg_namespace n
+            ON (c.relnamespace = n.oid)
+        WHERE n.nspname = '%s' AND c.relname = '%s_%d')""" % (
+            args.work_schema, dataset, rows))
+    if exists != '0' and not args.regenerate and \
+            db.queryValue('(SELECT count(*) FROM %s)' % table) == str(rows):
+        return table
+
+    info('Generating %s (%d rows)' % (table, rows))
+    start = time.time()
+    cmd = datagenCommand(args, dataset, rows)
+    distribution = ' DISTRIBUTED RANDOMLY' if env['segments_gp'] else ''
+    create = 'DROP TABLE IF EXISTS %s;\nCREATE TABLE %s (%s)%s;\n' % (
+        table, table, DATASETS[dataset], distribution)
+    if args.load == 'stdin':
+        db.runScript(create)
+        datagen = subprocess.Popen(cmd, stdout = subprocess.PIPE)
+        db.runScript('COPY %s FROM STDIN;\n' % table, stdin = datagen.stdout)
+        datagen.stdout.close()
+        if datagen.wait() != 0:
+            error('%s failed' % ' '.join(cmd))
+    elif args.load == 'program':
+        db.runScript(create + "COPY %s FROM PROGRAM '%s';\n" % (
+            table, ' '.join(cmd)))
+    else:
+        # Every segment generates its slice, see examples/datagen/README
+        db.runScript(create + """
+            DROP EXTERNAL TABLE IF EXISTS {table}_ext;
+            CREATE EXTERNAL WEB TABLE {table}_ext ({columns})
+            EXECUTE '{cmd}' FORMAT 'TEXT';
+            INSERT INTO {table} SELECT * FROM {table}_ext;
+            DROP EXTERNAL TABLE {table}_ext;
+            """.format(table = table, columns = DATASETS[dataset],
+                cmd = ' '.join(cmd)))
+    db.runScript('ANALYZE %s;\n' % table)
+    info('Generated %s in %.1f s' % (table, time.time() - start))
+    return table
+
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Measurement
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+def scanCount(args, scanTable):
+    # The statistics collector receives the counters of a backend at most
+    # every 500 ms, once it is idle
+    return """
+        SELECT pg_sleep({delay});
+        SELECT pg_sleep(0);
+        SELECT '{tag}', coalesce(sum(seq_scan), 0) FROM pg_stat_user_tables
+        WHERE relid = '{scan_table}'::regclass;
+        """.format(delay = args.stats_delay, tag = TAG,
+            scan_table = scanTable)
+
+def runScenario(db, args, env, name, scenario, table, rows, repetition):
+    (rowDim, colDim) = ratingDimensions(rows)
+    features = ['f%d' % i for i in range(1, args.width)]
+    fields = dict(
+        schema = args.schema,
+        table = table,
+        out = '%s.out_%s' % (args.work_schema, name),
+        width = args.width,
+        row_dim = rowDim,
+        col_dim = colDim,
+        features = ','.join(features),
+        features_expr = ', '.join(['x[%d] AS %s' % (i + 2, f)
+            for (i, f) in enumerate(features)]))
+    scanTable = scenario.get('scan_table', '{table}').format(**fields)
+    iterationTable = '%s.iterations' % args.work_schema
+
+    sql = "SET client_min_messages = warning;\n"
+    sql += scenario.get('setup', '').format(**fields) + '\n'
+    sql += """
+        SELECT {schema}.reset_function_stats();
+        SELECT {schema}.set_iteration_stats('{iterations}');
+        """.format(schema = args.schema, iterations = iterationTable)
+    sql += scanCount(args, scanTable)
+    sql += """
+        SELECT '{tag}', extract(epoch FROM clock_timestamp());
+        {run};
+        SELECT '{tag}', extract(epoch FROM clock_timestamp());
+        SELECT {schema}.set_iteration_stats(NULL);
+        SELECT '{tag}', 'function', function, calls, estimated_cpu_time
+        FROM {schema}.function_stats();
+        SELECT '{tag}', 'memory', context, allocations, allocated_bytes,
+            max_allocation
+        FROM {schema}.memory_stats();
+        SELECT '{tag}', 'iteration', _iteration, elapsed_sec, num_rows,
+            rows_per_sec, state_bytes, metric
+        FROM {iterations};
+        """.format(tag = TAG, schema = args.schema,
+            run = scenario['run'].format(**fields).strip(),
+            iterations = iterationTable)
+    sql += scanCount(args, scanTable)
+    sql += scenario.get('cleanup', '').format(**fields) + '\n'
+    sql += "DROP TABLE IF EXISTS %s;\n" % iterationTable
+
+    info('Running %s on %d rows (repetition %d)' % (name, rows,
+        repetition + 1))
+    out = db.runScript(sql)
+
+    def number(value, convert = float):
+        return None if value == '' else convert(value)
+
+    # Rows without a record type are, in order: scans before, start time,
+    # end time, scans after
+    plain = [row[0] for row in out if len(row) == 1]
+    result = dict(env['result'],
+        scenario = name,
+        rows = rows,
+        repetition = repetition,
+        timestamp = time.strftime('%Y-%m-%d %H:%M:%S'),
+        wall_sec = float(plain[2]) - float(plain[1]),
+        seq_scans = int(plain[3]) - int(plain[0]),
+        functions = [],
+        memory = [],
+        iterations = [])
+    for row in out:
+        if len(row) > 1 and row[0] == 'function':
+            result['functions'].append(dict(function = row[1],
+                calls = int(row[2]), estimated_cpu_sec = number(row[3])))
+        elif len(row) > 1 and row[0] == 'memory':
+            result['memory'].append(dict(context = row[1],
+                allocations = int(row[2]), allocated_bytes = int(row[3]),
+                max_allocation = int(row[4])))
+        elif len(row) > 1 and row[0] == 'iteration':
+            result['iterations'].append(dict(iteration = int(row[1]),
+                elapsed_sec = number(row[2]), num_rows = number(row[3], int),
+                rows_per_sec = number(row[4]),
+                state_bytes = number(row[5], int), metric = number(row[6])))
+    result['iterations'].sort(key = lambda it: it['iteration'])
+    info('%s on %d rows: %.2f s, %d scans' % (name, rows,
+        result['wall_sec'], result['seq_scans']))
+    return result
+
+def runCommand(args):
+    rowCounts = [int(float(rows)) for rows in args.rows.split(',')]
+    names = SCENARIO_NAMES if args.scenarios == 'all' else \
+        [name.strip() for name in args.scenarios.split(',')]
+    for name in names:
+        if name not in SCENARIO_NAMES:
+            error('Unknown scenario %s (available: %s)' % (name,
+                ', '.join(SCENARIO_NAMES)))
+    if args.width < 2:
+        error('Width must be at least 2 (the intercept and a variable)')
+
+    db = Database(args)
+    serverVersion = db.queryValue('version()')
+    isGreenplum = 'Greenplum' in serverVersion
+    segments = int(db.queryValue("""
+        (SELECT count(*) FROM gp_segment_configuration
+        WHERE role = 'p' AND content >= 0)""")) if isGreenplum else 1
+    env = dict(
+        segments_gp = isGreenplum,
+        result = dict(
+            label = args.label,
+            madlib_version = db.queryValue('%s.version()' % args.schema),
+            server_version = serverVersion,
+            segments = segments))
+    if db.queryValue("""
+            (SELECT count(*) FROM pg_namespace WHERE nspname = '%s')""" %
+                args.work_schema) == '0':
+        db.runScript('CREATE SCHEMA %s;\n' % args.work_schema)
+
+    output = open(args.output, 'a')
+    for rows in rowCounts:
+        for (name, scenario) in SCENARIOS:
+            if name not in names:
+                continue
+            table = ensureDataset(db, args, env, scenario['dataset'], rows)
+            for repetition in range(args.repetitions):
+                result = runScenario(db, args, env, name, scenario, table,
+                    rows, repetition)
+                output.write(json.dumps(result, sort_keys = True) + '\n')
+                output.flush()
+        if args.drop_data:
+            for dataset in DATASETS:
+                db.runScript('DROP TABLE IF EXISTS %s.%s_%d;\n' % (
+                    args.work_schema, dataset, rows))
+    output.close()
+
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Report
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+def median(values):
+    values = sorted(values)
+    n = len(values)
+    return None if n == 0 else \
+        (values[(n - 1) // 2] + values[n // 2]) / 2.
+
+def formatBytes(value):
+    if value is None:
+        return '-'
+    for unit in ['B', 'kB', 'MB', 'GB']:
+        if value < 1024 or unit == 'GB':
+            return ('%d %s' if unit == 'B' else '%.1f %s') % (value, unit)
+        value /= 1024.
+
+def stateBytes(result):
+    sizes = [m['max_allocation'] for m in result['memory']] + \
+        [it['state_bytes'] for it in result['iterations']
+            if it['state_bytes'] is not None]
+    return max(sizes) if sizes else None
+
+def reportCommand(args):
+    results = []
+    for path in args.files:
+        for line in open(path):
+            if line.strip():
+                results.append(json.loads(line))
+    if not results:
+        error('No results in ' + ', '.join(args.files))
+
+    # A configuration is a release (or label) on a number of segments. The
+    # first release seen is the baseline of the "vs" column.
+    releases = []
+    for r in results:
+        release = r.get('label') or r['madlib_version']
+        r['release'] = release
+        if release not in releases:
+            releases.append(release)
+    keys = []
+    for r in results:
+        if (r['scenario'], r['rows']) not in keys:
+            keys.append((r['scenario'], r['rows']))
+    keys.sort(key = lambda key: (SCENARIO_NAMES.index(key[0])
+        if key[0] in SCENARIO_NAMES else len(SCENARIO_NAMES), key[1]))
+
+    header = '%-13s %11s  %-20s %9s %6s %9s %6s %10s %8s %6s %6s' % (
+        'scenario', 'rows', 'release/segments', 'wall [s]', 'scans',
+        's/scan', 'iter', 'state', 'speedup', 'eff', 'vs')
+    print(header)
+    print('-' * len(header))
+    for (scenario, rows) in keys:
+        runs = [r for r in results
+            if r['scenario'] == scenario and r['rows'] == rows]
+        configs = {}
+        for r in runs:
+            configs.setdefault((r['release'], r['segments']), []).append(r)
+        order = sorted(configs.keys(),
+            key = lambda c: (releases.index(c[0]), c[1]))
+        wall = dict((c, median([r['wall_sec'] for r in configs[c]]))
+            for c in order)
+        first = True
+        for config in order:
+            (release, segments) = config
+            rs = configs[config]
+            scans = median([r['seq_scans'] for r in rs])
+            iterations = median([len(r['iterations']) for r in rs])
+            state = max([stateBytes(r) or 0 for r in rs]) or None
+
+            # Scaling relative to the fewest segments of the same release
+            base = min(c for c in order if c[0] == release)
+            speedup = wall[base] / wall[config] if wall[config] > 0 else None
+            efficiency = None if speedup is None else \
+                speedup * base[1] / segments
+            # Change relative to the first release on as many segments
+            baseline = (releases[0], segments)
+            change = wall[config] / wall[baseline] \
+                if baseline in wall and wall[baseline] > 0 else None
+
+            print('%-13s %11s  %-20s %9.2f %6s %9s %6s %10s %8s %6s %6s' % (
+                scenario if first else '',
+                rows if first else '',
+                '%s/%d' % (release, segments),
+                wall[config],
+                '%d' % scans,
+                '%.3f' % (wall[config] / scans) if scans > 0 else '-',
+                '%d' % iterations if iterations > 0 else '-',
+                formatBytes(state),
+                '%.2f' % speedup if speedup is not None else '-',
+                '%.2f' % efficiency if efficiency is not None else '-',
+                '%.2f' % change if change is not None else '-'))
+            first = False
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description = 'End-to-end benchmarks of MADlib workloads',
+        epilog = __doc__,
+        formatter_class = argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest = 'command')
+
+    run = commands.add_parser('run',
+        help = 'Run the scenarios and append the results to a file')
+    run.add_argument('-d', '--database', help = 'Database name')
+    run.add_argument('-H', '--host', help = 'Database host')
+    run.add_argument('-p', '--port', type = int, help = 'Database port')
+    run.add_argument('-U', '--user', help = 'Database user')
+    run.add_argument('--psql', default = 'psql', help = 'psql executable')
+    run.add_argument('-s', '--schema', default = 'madlib',
+        help = 'Schema MADlib is installed in (default: madlib)')
+    run.add_argument('--work-schema', default = 'macrobench',
+        help = 'Schema for the data sets and outputs (default: macrobench)')
+    run.add_argument('--rows', default = '1e6,1e7,1e8',
+        help = 'Comma-separated numbers of rows (default: 1e6,1e7,1e8)')
+    run.add_argument('--scenarios', default = 'all',
+        help = 'Comma-separated scenarios (default: all): ' +
+            ', '.join(SCENARIO_NAMES))
+    run.add_argument('--width', type = int, default = 10,
+        help = 'Number of independent variables or coordinates, including '
+            'the intercept (default: 10)')
+    run.add_argument('--seed', type = int, default = 1,
+        help = 'Seed of the data sets (default: 1)')
+    run.add_argument('--repetitions', type = int, default = 1,
+        help = 'Runs per scenario and number of rows (default: 1)')
+    run.add_argument('--datagen', default = 'madlib_datagen',
+        help = 'madlib_datagen executable (on the database hosts for '
+            '--load program or web)')
+    run.add_argument('--load', choices = ['stdin', 'program', 'web'],
+        default = 'stdin',
+        help = 'Load the data sets through psql (stdin), with COPY FROM '
+            'PROGRAM (program), or with a Greenplum external web table that '
+            'generates the data on all segments (web). Default: stdin')
+    run.add_argument('--regenerate', action = 'store_true',
+        help = 'Generate the data sets even if they exist')
+    run.add_argument('--drop-data', action = 'store_true',
+        help = 'Drop the data sets of a number of rows once it is done')
+    run.add_argument('--stats-delay', type = float, default = 1.,
+        help = 'Seconds to wait for the statistics collector (default: 1)')
+    run.add_argument('--label',
+        help = 'Name of the configuration in the report (default: the '
+            'MADlib version)')
+    run.add_argument('-o', '--output', default = 'macrobench.jsonl',
+        help = 'File to append the results to (default: macrobench.jsonl)')
+
+    report = commands.add_parser('report',
+        help = 'Compare the results of several runs')
+    report.add_argument('files', nargs = '+', metavar = 'FILE',
+        help = 'Result files of macrobench.py run')
+
+    args = parser.parse_args(argv)
+    if args.command == 'run':
+        runCommand(args)
+    else:
+        reportCommand(args)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
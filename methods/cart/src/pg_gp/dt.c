@@ -126,6 +126,39 @@ static float8 DT_CONFIDENCE_DEV[]   =
 			} while (0)
 
 
+/*
+ * @brief Allocate a one-dimensional array of zeros whose elements are
+ *        8-byte values, such as int8 and float8. The counts are written
+ *        directly to the data of the returned array, which saves the 
+ *        separate buffer and the copy made by construct_array.
+ *
+ * @param num_elems     The number of elements.
+ * @param elem_type     The element type. Its length must be 8.
+ *
+ * @return The zero-filled array.
+ *
+ */
+static ArrayType*
+dt_new_zero_array
+	(
+	int num_elems,
+	Oid elem_type
+	)
+{
+	Size        nbytes = ARR_OVERHEAD_NONULLS(1) + sizeof(int64) * num_elems;
+	ArrayType  *result = (ArrayType *)palloc0(nbytes);
+
+	SET_VARSIZE(result, nbytes);
+	result->ndim        = 1;
+	result->dataoffset  = 0;
+	result->elemtype    = elem_type;
+	ARR_DIMS(result)[0]   = num_elems;
+	ARR_LBOUND(result)[0] = 1;
+
+	return result;
+}
+
+
 /* 
  * a forward declaration. 
  */ 
@@ -330,7 +363,6 @@ dt_rep_aggr_class_count_sfunc
     int classified_class    	 = PG_GETARG_INT32(1);
     int original_class      	 = PG_GETARG_INT32(2);
     int max_num_of_classes  	 = PG_GETARG_INT32(3);
-    bool rebuild_array     		 = false;
 
     dt_check_error_value
 		(
@@ -363,10 +395,9 @@ dt_rep_aggr_class_count_sfunc
     	 * We assume the maximum number of classes is limited (up to millions),
     	 * so that the allocated array won't break our memory limitation.
     	 */
-        class_count 	 = palloc0(sizeof(int64) * (max_num_of_classes + 1));
         array_length 	 = max_num_of_classes + 1;
-        rebuild_array 	 = true;
-
+        pg_class_count   = dt_new_zero_array(array_length, INT8OID);
+        class_count 	 = (int64 *)ARR_DATA_PTR(pg_class_count);
     }
     else
     {
@@ -422,20 +453,6 @@ dt_rep_aggr_class_count_sfunc
     /* In any sample, we will update the original class count */
     ++class_count[original_class];
 
-    if (rebuild_array)
-    {
-        /* construct a new array to keep the aggr states. */
-        pg_class_count =
-        	construct_array(
-        		(Datum *)class_count,
-                array_length,
-                INT8OID,
-                sizeof(int64),
-                true,
-                'd'
-                );
-    }
-
     PG_RETURN_ARRAYTYPE_P(pg_class_count);
 }
 PG_FUNCTION_INFO_V1(dt_rep_aggr_class_count_sfunc);
@@ -503,14 +520,14 @@ bigint_array_add
         
         dt_check_error
     		(
-    			!ARR_HASNULL(pg_array1),
-    			"bigint_array_add cannot accept arrays with NULL values"
+    			pg_array1,
+    			"invalid aggregation state array"
     		);
 
         dt_check_error
     		(
-    			pg_array1,
-    			"invalid aggregation state array"
+    			!ARR_HASNULL(pg_array1),
+    			"bigint_array_add cannot accept arrays with NULL values"
     		);
 
         array_dim = ARR_NDIM(pg_array1);
@@ -1810,6 +1827,68 @@ dt_sample_within_range
 PG_FUNCTION_INFO_V1(dt_sample_within_range);
 
 
+/*
+ * @brief The function computes the number of times a record is drawn for a
+ *        tree when bootstrapping. Instead of sampling with replacement, the
+ *        weight is a Poisson draw whose uniform variate is a hash of the
+ *        record ID, the tree ID and the seed. Therefore, the weights of all
+ *        records for all trees can be computed in a single scan without any
+ *        state, and the weights of the same (record, tree) pair are the same
+ *        every time they are computed.
+ *
+ * @param id              The ID of the record.
+ * @param tid             The ID of the tree.
+ * @param rate            The expected weight of a record in a tree.
+ * @param seed            Seed for the hash.
+ *
+ * @return The weight of the record in the tree. 0 means the record is not
+ *         used to train the tree.
+ *
+ */
+Datum
+dt_bootstrap_weight
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+	int64       id          = PG_GETARG_INT64(0);
+	int32       tid         = PG_GETARG_INT32(1);
+	float8      rate        = PG_GETARG_FLOAT8(2);
+	int32       seed        = PG_GETARG_INT32(3);
+
+	dt_check_error
+		(
+			rate > 0 && rate <= 64,
+			"the expected weight must be in the range (0, 64]"
+		);
+
+	/* splitmix64 finalizer over the record ID, tree ID and seed */
+	uint64 h = (uint64)id;
+	h ^= ((uint64)(uint32)tid << 32) | (uint64)(uint32)seed;
+	h += UINT64CONST(0x9E3779B97F4A7C15);
+	h  = (h ^ (h >> 30)) * UINT64CONST(0xBF58476D1CE4E5B9);
+	h  = (h ^ (h >> 27)) * UINT64CONST(0x94D049BB133111EB);
+	h ^= h >> 31;
+
+	/* uniform variate in [0, 1) from the high 53 bits */
+	float8 u    = (float8)(h >> 11) / 9007199254740992.0;
+
+	/* inversion of the Poisson CDF */
+	int32  k    = 0;
+	float8 p    = exp(-rate);
+	float8 cdf  = p;
+	while (u >= cdf && p > 0)
+	{
+		++k;
+		p   *= rate / k;
+		cdf += p;
+	}
+
+	PG_RETURN_INT32(k);
+}
+PG_FUNCTION_INFO_V1(dt_bootstrap_weight);
+
+
 /*
  * @brief Retrieve the specified number of unique features for a node.
  *        Discrete features used by ancestor nodes will be excluded.
@@ -2373,7 +2452,6 @@ dt_acc_count_sfunc
     int max_num_of_classes  	 = PG_GETARG_INT32(1);
     int64  count                 = PG_ARGISNULL(2)?0:PG_GETARG_INT64(2);
     int    class                 = PG_ARGISNULL(3)?0:PG_GETARG_INT32(3);
-    bool rebuild_array     		 = false;
 
     dt_check_error_value
 		(
@@ -2398,10 +2476,9 @@ dt_acc_count_sfunc
     	 * We assume the maximum number of classes is limited (up to millions),
     	 * so that the allocated array won't break our memory limitation.
     	 */
-        count_array 	 = palloc0(sizeof(int64) * max_num_of_classes);
         array_length 	 = max_num_of_classes;
-        rebuild_array 	 = true;
-
+        pg_count_array   = dt_new_zero_array(array_length, INT8OID);
+        count_array 	 = (int64 *)ARR_DATA_PTR(pg_count_array);
     }
     else
     {
@@ -2449,20 +2526,6 @@ dt_acc_count_sfunc
 
     count_array[class - 1] += count;
 
-    if (rebuild_array)
-    {
-        /* construct a new array to keep the aggr states. */
-        pg_count_array =
-        	construct_array(
-        		(Datum *)count_array,
-                array_length,
-                INT8OID,
-                sizeof(int64),
-                true,
-                'd'
-                );
-    }
-
     PG_RETURN_ARRAYTYPE_P(pg_count_array);
 }
 PG_FUNCTION_INFO_V1(dt_acc_count_sfunc);
@@ -2519,13 +2582,10 @@ PG_FUNCTION_INFO_V1(dt_to_text);
 Datum dt_array_indexed_agg_sfunc(PG_FUNCTION_ARGS)
 {
 	ArrayType       *state;
-	ArrayBuildState build_state;
 	Datum           elem;
-	Oid             elem_typ = FLOAT8OID;
 	int32_t         elem_cnt;
 	int32_t         elem_idx;
 	int32_t         iterator_idx;
-	int 		    lbs[1];
 	
     dt_check_error_value
         (
@@ -2553,44 +2613,19 @@ Datum dt_array_indexed_agg_sfunc(PG_FUNCTION_ARGS)
             elem_idx
         );
 
-	get_typlenbyvalalign
-        (
-         elem_typ, 
-         &build_state.typlen, 
-         &build_state.typbyval, 
-         &build_state.typalign
-        );
-
 	if (NULL == state)
 	{
-		build_state.mcontext = NULL;
-
 		/* 
 		 * allocate two element for each index, the first one is the value, 
-		 * the second one indicates whether the item is null 
+		 * the second one indicates whether the item is null. The state is 
+		 * written in place, without any intermediate Datum arrays.
 		 */ 
-		build_state.alen    = (elem_cnt << 1);
-		build_state.dvalues = (Datum *) palloc(build_state.alen * sizeof(Datum));
-		build_state.dnulls  = NULL;
-		build_state.nelems  = build_state.alen;
-		build_state.element_type = elem_typ;
+		state = dt_new_zero_array(elem_cnt << 1, FLOAT8OID);
 
-		for (iterator_idx = 0; iterator_idx < build_state.alen; iterator_idx++)
+		for (iterator_idx = 0; iterator_idx < (elem_cnt << 1); iterator_idx++)
 		{
-			build_state.dvalues[iterator_idx]   = Float8GetDatum(1);
+			((float8*)ARR_DATA_PTR(state))[iterator_idx] = 1;
 		}
-
-		/* put the elem into the target slot */
-		build_state.dvalues[elem_idx << 1]       = elem;
-		build_state.dvalues[(elem_idx << 1) + 1] =  
-			Float8GetDatum(PG_ARGISNULL(1) ? 1 : 0);
-		lbs[0] = 1;
-
-		state = construct_array(build_state.dvalues, build_state.nelems,
-			build_state.element_type, build_state.typlen, 
-			build_state.typbyval, build_state.typalign);
-
-		PG_RETURN_ARRAYTYPE_P(state);
 	}
 
     dt_check_error_value
@@ -2778,3 +2813,1231 @@ Datum dt_array_indexed_agg_ffunc(PG_FUNCTION_ARGS)
 	PG_RETURN_ARRAYTYPE_P(result);
 }
 PG_FUNCTION_INFO_V1(dt_array_indexed_agg_ffunc);
+
+
+/*
+ * @brief Binary search for the first of the ascending boundaries that is
+ *        not smaller than value.
+ *
+ * @return The index of the boundary, or num_bounds - 1 if all of the 
+ *         boundaries are smaller than value.
+ *
+ */
+static int
+dt_bin_search
+	(
+	const float8   *bounds,
+	int             num_bounds,
+	float8          value
+	)
+{
+	int low  = 0;
+	int high = num_bounds - 1;
+
+	while (low < high)
+	{
+		int mid = low + ((high - low) >> 1);
+		if (bounds[mid] < value)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+
+/*
+ * @brief Map a continuous feature value to the upper boundary of its
+ *        histogram bin, i.e., the smallest boundary that is not smaller
+ *        than the value. Values larger than all boundaries are mapped to
+ *        the last boundary.
+ *
+ * @param value         The value of the continuous feature.
+ * @param boundaries    The upper boundaries of the bins in ascending order.
+ *
+ * @return The upper boundary of the bin of value.
+ *
+ * Since the boundaries are values of the feature, a split on a boundary
+ * partitions the binned values exactly as it partitions the original values.
+ *
+ */
+Datum
+dt_bin_value
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+	float8      value       = PG_GETARG_FLOAT8(0);
+	ArrayType  *pg_bounds   = PG_GETARG_ARRAYTYPE_P(1);
+
+	dt_check_error_value
+		(
+			ARR_NDIM(pg_bounds) == 1,
+			"invalid array dimension: %d. "
+			"The dimension of the bin boundaries must be equal to 1",
+			ARR_NDIM(pg_bounds)
+		);
+
+	dt_check_error
+		(
+			!ARR_HASNULL(pg_bounds) && ARR_ELEMTYPE(pg_bounds) == FLOAT8OID,
+			"the bin boundaries must be a float8 array without NULL values"
+		);
+
+	int      num_bounds = ArrayGetNItems(1, ARR_DIMS(pg_bounds));
+	float8  *bounds     = (float8 *)ARR_DATA_PTR(pg_bounds);
+
+	dt_check_error
+		(
+			num_bounds > 0,
+			"the bin boundaries must not be empty"
+		);
+
+	PG_RETURN_FLOAT8(bounds[dt_bin_search(bounds, num_bounds, value)]);
+}
+PG_FUNCTION_INFO_V1(dt_bin_value);
+
+
+/*
+ * @brief Get the 1-based index of the histogram bin of a continuous 
+ *        feature value, i.e., the index of the smallest boundary that 
+ *        is not smaller than the value. Values larger than all boundaries 
+ *        are mapped to the last bin.
+ *
+ * @param value         The value of the continuous feature.
+ * @param boundaries    The upper boundaries of the bins in ascending order.
+ *
+ * @return The index of the bin of value.
+ *
+ * For any bin index b, value <= boundaries[b] if and only if the index of
+ * the bin of value is not greater than b.
+ *
+ */
+Datum
+dt_bin_index
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+	float8      value       = PG_GETARG_FLOAT8(0);
+	ArrayType  *pg_bounds   = PG_GETARG_ARRAYTYPE_P(1);
+
+	dt_check_error
+		(
+			ARR_NDIM(pg_bounds) == 1 && !ARR_HASNULL(pg_bounds) && 
+			ARR_ELEMTYPE(pg_bounds) == FLOAT8OID,
+			"the bin boundaries must be a one-dimensional float8 array "
+			"without NULL values"
+		);
+
+	int      num_bounds = ArrayGetNItems(1, ARR_DIMS(pg_bounds));
+
+	dt_check_error
+		(
+			num_bounds > 0,
+			"the bin boundaries must not be empty"
+		);
+
+	PG_RETURN_INT32
+		(
+			dt_bin_search((float8 *)ARR_DATA_PTR(pg_bounds), num_bounds, value) + 1
+		);
+}
+PG_FUNCTION_INFO_V1(dt_bin_index);
+
+
+/*
+ * The packed encoded training table stores all the encoded feature values
+ * of a record in one bytea. The fields are laid out back to back in the
+ * order of the feature ids, without any alignment. A discrete feature with
+ * width w > 0 takes w bits, and holds its code, 0 stands for NULL. A
+ * continuous feature takes DT_PACKED_CONT_BITS bits, one bit telling
+ * whether the value is present, followed by the bits of the float8 value.
+ * The widths are the same for all the records, and are not stored in the
+ * bytea.
+ */
+#define DT_PACKED_MAX_CODE_BITS 32
+#define DT_PACKED_CONT_BITS     65
+
+#define dt_packed_field_bits(width) \
+			((width) > 0 ? (width) : DT_PACKED_CONT_BITS)
+
+
+/*
+ * @brief Write the lowest num_bits bits of value to the bit position pos
+ *        of buf. The bits are assumed to be zero before writing.
+ */
+static void
+dt_put_bits
+    (
+    uint8  *buf,
+    int64   pos,
+    uint64  value,
+    int     num_bits
+    )
+{
+    while (num_bits > 0)
+    {
+        int     shift   = pos & 0x07;
+        int     len     = Min(8 - shift, num_bits);
+
+        buf[pos >> 3] |= (uint8)((value & ((1 << len) - 1)) << shift);
+        value         >>= len;
+        pos            += len;
+        num_bits       -= len;
+    }
+}
+
+
+/*
+ * @brief Read num_bits bits from the bit position pos of buf.
+ */
+static uint64
+dt_get_bits
+    (
+    const uint8    *buf,
+    int64           pos,
+    int             num_bits
+    )
+{
+    uint64  value   = 0;
+    int     done    = 0;
+
+    while (done < num_bits)
+    {
+        int     shift   = pos & 0x07;
+        int     len     = Min(8 - shift, num_bits - done);
+
+        value   |= ((uint64)((buf[pos >> 3] >> shift) & ((1 << len) - 1))) << done;
+        pos     += len;
+        done    += len;
+    }
+
+    return value;
+}
+
+
+/*
+ * @brief Check the widths array of the packed feature values.
+ *
+ * @param pg_widths     The widths array.
+ * @param num_fields    The number of fields will be returned through it.
+ *
+ * @return The widths.
+ *
+ */
+static int32 *
+dt_get_packed_widths
+    (
+    ArrayType  *pg_widths,
+    int        *num_fields
+    )
+{
+    int32  *widths  = NULL;
+    int     i       = 0;
+
+    dt_check_error
+        (
+            ARR_NDIM(pg_widths) == 1 && !ARR_HASNULL(pg_widths) &&
+            ARR_ELEMTYPE(pg_widths) == INT4OID,
+            "the widths must be a one-dimensional int4 array "
+            "without NULL values"
+        );
+
+    *num_fields = ArrayGetNItems(1, ARR_DIMS(pg_widths));
+    widths      = (int32 *)ARR_DATA_PTR(pg_widths);
+
+    for (i = 0; i < *num_fields; i++)
+    {
+        dt_check_error_value
+            (
+                widths[i] >= 0 && widths[i] <= DT_PACKED_MAX_CODE_BITS,
+                "invalid width: %d",
+                widths[i]
+            );
+    }
+
+    return widths;
+}
+
+
+/*
+ * @brief Get the total number of bits of the packed feature values.
+ */
+static int64
+dt_get_packed_bits
+    (
+    const int32    *widths,
+    int             num_fields
+    )
+{
+    int64   num_bits    = 0;
+    int     i           = 0;
+
+    for (i = 0; i < num_fields; i++)
+        num_bits += dt_packed_field_bits(widths[i]);
+
+    return num_bits;
+}
+
+
+/*
+ * @brief Decode one field of the packed feature values.
+ *
+ * @param buf       The packed feature values.
+ * @param pos       The bit position of the field.
+ * @param width     The width of the field.
+ * @param is_null   Whether the value is NULL will be returned through it.
+ *
+ * @return The feature value.
+ *
+ */
+static float8
+dt_get_packed_field
+    (
+    const uint8    *buf,
+    int64           pos,
+    int32           width,
+    bool           *is_null
+    )
+{
+    uint64  bits    = 0;
+    float8  value   = 0;
+
+    if (width > 0)
+    {
+        bits        = dt_get_bits(buf, pos, width);
+        *is_null    = (0 == bits);
+
+        return (float8)bits;
+    }
+
+    *is_null = (0 == dt_get_bits(buf, pos, 1));
+    if (!*is_null)
+    {
+        bits = dt_get_bits(buf, pos + 1, 64);
+        memcpy(&value, &bits, sizeof(value));
+    }
+
+    return value;
+}
+
+
+/*
+ * @brief Pack the encoded feature values of a record into a bytea.
+ *
+ * @param fvals     The encoded feature values, the i-th element is the 
+ *                  value of the feature with id i. 
+ * @param widths    The width of each feature in bits. 0 means the feature
+ *                  is continuous, otherwise, the codes of the discrete 
+ *                  feature must be in [1, 2^width - 1].
+ *
+ * @return The packed feature values.
+ *
+ * @note This is a strict function.
+ *
+ */
+Datum
+dt_pack_fvals
+    (
+    PG_FUNCTION_ARGS
+    )
+{
+    ArrayType  *pg_fvals    = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType  *pg_widths   = PG_GETARG_ARRAYTYPE_P(1);
+    int32      *widths      = NULL;
+    int         num_fields  = 0;
+    Datum      *fvals       = NULL;
+    bool       *nulls       = NULL;
+    int         num_fvals   = 0;
+    int64       num_bytes   = 0;
+    int64       pos         = 0;
+    bytea      *result      = NULL;
+    uint8      *buf         = NULL;
+    int         i           = 0;
+
+    widths = dt_get_packed_widths(pg_widths, &num_fields);
+
+    dt_check_error
+        (
+            ARR_NDIM(pg_fvals) == 1 && ARR_ELEMTYPE(pg_fvals) == FLOAT8OID,
+            "the feature values must be a one-dimensional float8 array"
+        );
+
+    deconstruct_array
+        (
+            pg_fvals,
+            FLOAT8OID,
+            sizeof(float8),
+            FLOAT8PASSBYVAL,
+            'd',
+            &fvals,
+            &nulls,
+            &num_fvals
+        );
+
+    dt_check_error_value
+        (
+            num_fvals == num_fields,
+            "the number of feature values should be %d",
+            num_fields
+        );
+
+    num_bytes   = (dt_get_packed_bits(widths, num_fields) + 7) >> 3;
+    result      = (bytea *)palloc0(VARHDRSZ + num_bytes);
+    SET_VARSIZE(result, VARHDRSZ + num_bytes);
+    buf         = (uint8 *)VARDATA(result);
+
+    for (i = 0; i < num_fields; i++)
+    {
+        if (widths[i] > 0)
+        {
+            if (!nulls[i])
+            {
+                float8 code = DatumGetFloat8(fvals[i]);
+
+                dt_check_error_value
+                    (
+                        code >= 1 && code == floor(code) &&
+                        code < (float8)((uint64)1 << widths[i]),
+                        "the code of feature %d does not fit in its width",
+                        i + 1
+                    );
+
+                dt_put_bits(buf, pos, (uint64)code, widths[i]);
+            }
+        }
+        else if (!nulls[i])
+        {
+            float8  value   = DatumGetFloat8(fvals[i]);
+            uint64  bits    = 0;
+
+            memcpy(&bits, &value, sizeof(bits));
+            dt_put_bits(buf, pos, 1, 1);
+            dt_put_bits(buf, pos + 1, bits, 64);
+        }
+
+        pos += dt_packed_field_bits(widths[i]);
+    }
+
+    PG_RETURN_BYTEA_P(result);
+}
+PG_FUNCTION_INFO_V1(dt_pack_fvals);
+
+
+/*
+ * @brief Unpack the feature values packed by dt_pack_fvals.
+ *
+ * @param packed    The packed feature values.
+ * @param widths    The width of each feature in bits.
+ *
+ * @return The encoded feature values.
+ *
+ * @note This is a strict function.
+ *
+ */
+Datum
+dt_unpack_fvals
+    (
+    PG_FUNCTION_ARGS
+    )
+{
+    bytea      *packed      = PG_GETARG_BYTEA_P(0);
+    ArrayType  *pg_widths   = PG_GETARG_ARRAYTYPE_P(1);
+    int32      *widths      = NULL;
+    int         num_fields  = 0;
+    Datum      *fvals       = NULL;
+    bool       *nulls       = NULL;
+    const uint8 *buf        = (const uint8 *)VARDATA(packed);
+    int64       pos         = 0;
+    int         lbs[1]      = {1};
+    int         i           = 0;
+
+    widths = dt_get_packed_widths(pg_widths, &num_fields);
+
+    dt_check_error
+        (
+            VARSIZE(packed) - VARHDRSZ ==
+                (dt_get_packed_bits(widths, num_fields) + 7) >> 3,
+            "the size of the packed feature values does not match the widths"
+        );
+
+    fvals   = (Datum *)palloc(num_fields * sizeof(Datum));
+    nulls   = (bool *)palloc(num_fields * sizeof(bool));
+
+    for (i = 0; i < num_fields; i++)
+    {
+        fvals[i] = Float8GetDatum
+                    (
+                        dt_get_packed_field(buf, pos, widths[i], &nulls[i])
+                    );
+        pos     += dt_packed_field_bits(widths[i]);
+    }
+
+    PG_RETURN_ARRAYTYPE_P
+        (
+            construct_md_array
+                (
+                    fvals,
+                    nulls,
+                    1,
+                    &num_fields,
+                    lbs,
+                    FLOAT8OID,
+                    sizeof(float8),
+                    FLOAT8PASSBYVAL,
+                    'd'
+                )
+        );
+}
+PG_FUNCTION_INFO_V1(dt_unpack_fvals);
+
+
+/*
+ * @brief Get the value of one feature from the packed feature values.
+ *
+ * @param packed    The packed feature values.
+ * @param widths    The width of each feature in bits.
+ * @param fid       The feature id.
+ *
+ * @return The encoded value of the feature.
+ *
+ * @note This is a strict function.
+ *
+ */
+Datum
+dt_packed_fval
+    (
+    PG_FUNCTION_ARGS
+    )
+{
+    bytea      *packed      = PG_GETARG_BYTEA_P(0);
+    ArrayType  *pg_widths   = PG_GETARG_ARRAYTYPE_P(1);
+    int32       fid         = PG_GETARG_INT32(2);
+    int32      *widths      = NULL;
+    int         num_fields  = 0;
+    int64       pos         = 0;
+    bool        is_null     = false;
+    float8      value       = 0;
+    int         i           = 0;
+
+    widths = dt_get_packed_widths(pg_widths, &num_fields);
+
+    dt_check_error_value
+        (
+            fid >= 1 && fid <= num_fields,
+            "the feature id %d is out of range",
+            fid
+        );
+
+    dt_check_error
+        (
+            VARSIZE(packed) - VARHDRSZ ==
+                (dt_get_packed_bits(widths, num_fields) + 7) >> 3,
+            "the size of the packed feature values does not match the widths"
+        );
+
+    for (i = 0; i < fid - 1; i++)
+        pos += dt_packed_field_bits(widths[i]);
+
+    value = dt_get_packed_field
+                (
+                    (const uint8 *)VARDATA(packed),
+                    pos,
+                    widths[fid - 1],
+                    &is_null
+                );
+
+    if (is_null)
+        PG_RETURN_NULL();
+
+    PG_RETURN_FLOAT8(value);
+}
+PG_FUNCTION_INFO_V1(dt_packed_fval);
+
+
+/*
+ * @brief The step function of the aggregate __gbdt_hist_aggr. It sums up 
+ *        the gradients and hessians of the records of a tree node per 
+ *        feature and histogram bin.
+ *
+ * @param state         The histogram array. The gradient sum of bin b of 
+ *                      feature f (both are 0-based) is kept in the element 
+ *                      2 * (f * (num_bins + 1) + b), and the hessian sum
+ *                      in the next element. Bin 0 holds the records whose
+ *                      value of the feature is NULL.
+ * @param packed        The packed bin indexes of the record.
+ * @param widths        The width of each feature in the packed record.
+ * @param num_bins      The number of bins per feature.
+ * @param grad          The gradient of the loss at the record.
+ * @param hess          The hessian of the loss at the record.
+ *
+ * @return The updated histogram array.
+ *
+ */
+Datum
+dt_gbdt_hist_sfunc
+    (
+    PG_FUNCTION_ARGS
+    )
+{
+    ArrayType  *state       = NULL;
+    bytea      *packed      = NULL;
+    int32      *widths      = NULL;
+    int         num_fields  = 0;
+    int32       num_bins    = 0;
+    float8      grad        = 0;
+    float8      hess        = 0;
+    float8     *hist        = NULL;
+    const uint8 *buf        = NULL;
+    int64       pos         = 0;
+    int         i           = 0;
+
+    dt_check_error_value
+        (
+            (fcinfo->context && IsA(fcinfo->context, AggState)),
+            "%s can only be used in aggregations",
+            __FUNCTION__
+        );
+
+    if (PG_ARGISNULL(1) || PG_ARGISNULL(2) || PG_ARGISNULL(3) ||
+        PG_ARGISNULL(4) || PG_ARGISNULL(5))
+    {
+        if (PG_ARGISNULL(0))
+            PG_RETURN_NULL();
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(0));
+    }
+
+    packed      = PG_GETARG_BYTEA_P(1);
+    widths      = dt_get_packed_widths(PG_GETARG_ARRAYTYPE_P(2), &num_fields);
+    num_bins    = PG_GETARG_INT32(3);
+    grad        = PG_GETARG_FLOAT8(4);
+    hess        = PG_GETARG_FLOAT8(5);
+
+    dt_check_error_value
+        (
+            num_bins > 0,
+            "the number of bins must be positive: %d",
+            num_bins
+        );
+
+    dt_check_error
+        (
+            VARSIZE(packed) - VARHDRSZ ==
+                (dt_get_packed_bits(widths, num_fields) + 7) >> 3,
+            "the size of the packed feature values does not match the widths"
+        );
+
+    if (PG_ARGISNULL(0))
+    {
+        state = dt_new_zero_array
+                    (
+                        2 * num_fields * (num_bins + 1),
+                        FLOAT8OID
+                    );
+    }
+    else
+    {
+        state = PG_GETARG_ARRAYTYPE_P(0);
+
+        dt_check_error
+            (
+                ARR_NDIM(state) == 1 &&
+                ARR_DIMS(state)[0] == 2 * num_fields * (num_bins + 1),
+                "invalid histogram array"
+            );
+    }
+
+    hist    = (float8 *)ARR_DATA_PTR(state);
+    buf     = (const uint8 *)VARDATA(packed);
+
+    for (i = 0; i < num_fields; i++)
+    {
+        bool    is_null = false;
+        int64   bin     = 0;
+
+        dt_check_error
+            (
+                widths[i] > 0,
+                "the bin indexes must be packed as discrete features"
+            );
+
+        bin  = (int64)dt_get_packed_field(buf, pos, widths[i], &is_null);
+        pos += widths[i];
+
+        dt_check_error_value
+            (
+                bin <= num_bins,
+                "the bin index of feature %d is out of range",
+                i + 1
+            );
+
+        bin = 2 * ((int64)i * (num_bins + 1) + bin);
+        hist[bin]     += grad;
+        hist[bin + 1] += hess;
+    }
+
+    PG_RETURN_ARRAYTYPE_P(state);
+}
+PG_FUNCTION_INFO_V1(dt_gbdt_hist_sfunc);
+
+
+/*
+ * @brief The pre-function of the aggregate __gbdt_hist_aggr.
+ *
+ * @param arg0  The first histogram array.
+ * @param arg1  The second histogram array.
+ *
+ * @return The sum of the two histograms.
+ *
+ */
+Datum
+dt_gbdt_hist_prefunc
+    (
+    PG_FUNCTION_ARGS
+    )
+{
+    ArrayType  *arg0    = NULL;
+    ArrayType  *arg1    = NULL;
+    float8     *hist0   = NULL;
+    float8     *hist1   = NULL;
+    int         len     = 0;
+    int         i       = 0;
+
+    dt_check_error_value
+        (
+            (fcinfo->context && IsA(fcinfo->context, AggState)),
+            "%s can only be used in aggregations",
+            __FUNCTION__
+        );
+
+    if (PG_ARGISNULL(0))
+    {
+        if (PG_ARGISNULL(1))
+            PG_RETURN_NULL();
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(1));
+    }
+    else if (PG_ARGISNULL(1))
+    {
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(0));
+    }
+
+    arg0 = PG_GETARG_ARRAYTYPE_P(0);
+    arg1 = PG_GETARG_ARRAYTYPE_P(1);
+
+    dt_check_error
+        (
+            ARR_NDIM(arg0) == 1 && ARR_NDIM(arg1) == 1 &&
+            ARR_DIMS(arg0)[0] == ARR_DIMS(arg1)[0],
+            "the sizes of the two histogram arrays must be the same"
+        );
+
+    len     = ARR_DIMS(arg0)[0];
+    hist0   = (float8 *)ARR_DATA_PTR(arg0);
+    hist1   = (float8 *)ARR_DATA_PTR(arg1);
+
+    for (i = 0; i < len; i++)
+        hist0[i] += hist1[i];
+
+    PG_RETURN_ARRAYTYPE_P(arg0);
+}
+PG_FUNCTION_INFO_V1(dt_gbdt_hist_prefunc);
+
+
+/*
+ * @brief Find the best split of a tree node from its gradient histogram.
+ *        The records whose bin index is not greater than the split bin,
+ *        and those whose value is NULL, go to the left child. The gain of
+ *        a split is 
+ *            GL^2 / (HL + lambda) + GR^2 / (HR + lambda) - G^2 / (H + lambda)
+ *        where G and H are the gradient and hessian sums of a node.
+ *
+ * @param hist              The histogram array built by __gbdt_hist_aggr.
+ * @param num_bins          The number of bins per feature.
+ * @param lambda            The L2 regularization of the leaf values.
+ * @param min_child_weight  The minimum hessian sum of a child node.
+ *
+ * @return A three-element array: the feature id, the split bin and the 
+ *         gain of the best split. NULL if no split has a positive gain.
+ *
+ * @note This is a strict function.
+ *
+ */
+Datum
+dt_gbdt_best_split
+    (
+    PG_FUNCTION_ARGS
+    )
+{
+    ArrayType  *pg_hist             = PG_GETARG_ARRAYTYPE_P(0);
+    int32       num_bins            = PG_GETARG_INT32(1);
+    float8      lambda              = PG_GETARG_FLOAT8(2);
+    float8      min_child_weight    = PG_GETARG_FLOAT8(3);
+    float8     *hist                = NULL;
+    int         num_fields          = 0;
+    float8      best_gain           = DT_EPSILON;
+    int         best_fid            = 0;
+    int         best_bin            = 0;
+    Datum       result[3];
+    int         f                   = 0;
+    int         b                   = 0;
+
+    dt_check_error_value
+        (
+            num_bins > 0,
+            "the number of bins must be positive: %d",
+            num_bins
+        );
+
+    dt_check_error
+        (
+            lambda >= 0 && min_child_weight >= 0,
+            "lambda and min_child_weight must not be negative"
+        );
+
+    dt_check_error
+        (
+            ARR_NDIM(pg_hist) == 1 && !ARR_HASNULL(pg_hist) &&
+            ARR_DIMS(pg_hist)[0] % (2 * (num_bins + 1)) == 0,
+            "invalid histogram array"
+        );
+
+    num_fields  = ARR_DIMS(pg_hist)[0] / (2 * (num_bins + 1));
+    hist        = (float8 *)ARR_DATA_PTR(pg_hist);
+
+    for (f = 0; f < num_fields; f++)
+    {
+        const float8   *fhist   = hist + 2 * f * (num_bins + 1);
+        float8          sum_g   = 0;
+        float8          sum_h   = 0;
+        float8          left_g  = 0;
+        float8          left_h  = 0;
+        float8          parent  = 0;
+
+        for (b = 0; b <= num_bins; b++)
+        {
+            sum_g += fhist[2 * b];
+            sum_h += fhist[2 * b + 1];
+        }
+        parent = sum_g * sum_g / (sum_h + lambda);
+
+        /* bin 0 holds the NULL values, which always go left */
+        left_g = fhist[0];
+        left_h = fhist[1];
+        for (b = 1; b < num_bins; b++)
+        {
+            float8 right_g  = 0;
+            float8 right_h  = 0;
+            float8 gain     = 0;
+
+            left_g  += fhist[2 * b];
+            left_h  += fhist[2 * b + 1];
+            right_g  = sum_g - left_g;
+            right_h  = sum_h - left_h;
+
+            if (left_h < min_child_weight || right_h < min_child_weight ||
+                dt_is_float_zero(left_h) || dt_is_float_zero(right_h))
+                continue;
+
+            gain = left_g * left_g / (left_h + lambda) +
+                   right_g * right_g / (right_h + lambda) - parent;
+
+            if (gain > best_gain)
+            {
+                best_gain   = gain;
+                best_fid    = f + 1;
+                best_bin    = b;
+            }
+        }
+    }
+
+    if (0 == best_fid)
+        PG_RETURN_NULL();
+
+    result[0] = Float8GetDatum((float8)best_fid);
+    result[1] = Float8GetDatum((float8)best_bin);
+    result[2] = Float8GetDatum(best_gain);
+
+    PG_RETURN_ARRAYTYPE_P
+        (
+            construct_array
+                (
+                    result,
+                    3,
+                    FLOAT8OID,
+                    sizeof(float8),
+                    FLOAT8PASSBYVAL,
+                    'd'
+                )
+        );
+}
+PG_FUNCTION_INFO_V1(dt_gbdt_best_split);
+
+
+/*
+ * A tree flattened into a struct of arrays for classification. The nodes
+ * are in ascending order of their IDs. Since the IDs of the children of a
+ * node are continuous and larger than the ID of the node, the children
+ * of node i are found from lmc_idx[i], the position of its leftmost child.
+ */
+typedef struct
+{
+	int         num_nodes;
+	int32      *ids;
+	int32      *features;
+	bool       *is_conts;
+	float8     *split_values;
+	int32      *lmc_nids;
+	int32      *lmc_fvals;
+	int        *lmc_idx;
+} dt_flat_tree;
+
+
+/*
+ * The cache of the flattened trees of a forest, indexed by the tree ID,
+ * and of the buffer for the feature values of the row being classified.
+ * It lives in fn_extra, so every tree is flattened once per query.
+ */
+typedef struct
+{
+	int             num_trees;
+	dt_flat_tree  **trees;
+	int             num_fvals;
+	float8         *fvals;
+	bool           *fnulls;
+} dt_flat_tree_cache;
+
+
+typedef struct
+{
+	int32       id;
+	int         pos;
+} dt_node_pos;
+
+
+static int
+dt_node_pos_cmp
+	(
+	const void *a,
+	const void *b
+	)
+{
+	int32 l = ((const dt_node_pos *)a)->id;
+	int32 r = ((const dt_node_pos *)b)->id;
+
+	return (l > r) - (l < r);
+}
+
+
+/*
+ * @brief Check that an argument of dt_tree_predict is a 1-dimensional
+ *        array without NULL values and return its number of elements.
+ */
+static int
+dt_tree_array_length
+	(
+	ArrayType  *array,
+	Oid         elem_type
+	)
+{
+	dt_check_error
+		(
+			ARR_NDIM(array) == 1 && !ARR_HASNULL(array) &&
+			ARR_ELEMTYPE(array) == elem_type,
+			"the arrays of a tree must be 1-dimensional arrays "
+			"without NULL values"
+		);
+
+	return ArrayGetNItems(1, ARR_DIMS(array));
+}
+
+
+/*
+ * @brief Flatten the node arrays of a tree into a dt_flat_tree
+ *        allocated in the given memory context.
+ */
+static dt_flat_tree*
+dt_flatten_tree
+	(
+	MemoryContext   mcxt,
+	ArrayType      *pg_ids,
+	ArrayType      *pg_features,
+	ArrayType      *pg_is_conts,
+	ArrayType      *pg_split_values,
+	ArrayType      *pg_lmc_nids,
+	ArrayType      *pg_lmc_fvals
+	)
+{
+	int             n       = dt_tree_array_length(pg_ids, INT4OID);
+	int32          *ids     = (int32 *)ARR_DATA_PTR(pg_ids);
+	int32          *features;
+	bool           *is_conts;
+	float8         *split_values;
+	int32          *lmc_nids;
+	int32          *lmc_fvals;
+	dt_node_pos    *order;
+	dt_flat_tree   *tree;
+	MemoryContext   oldcontext;
+
+	dt_check_error
+		(
+			n > 0 &&
+			dt_tree_array_length(pg_features, INT4OID) == n &&
+			dt_tree_array_length(pg_is_conts, BOOLOID) == n &&
+			dt_tree_array_length(pg_split_values, FLOAT8OID) == n &&
+			dt_tree_array_length(pg_lmc_nids, INT4OID) == n &&
+			dt_tree_array_length(pg_lmc_fvals, INT4OID) == n,
+			"the arrays of a tree must have the same non-zero length"
+		);
+
+	features        = (int32 *)ARR_DATA_PTR(pg_features);
+	is_conts        = (bool *)ARR_DATA_PTR(pg_is_conts);
+	split_values    = (float8 *)ARR_DATA_PTR(pg_split_values);
+	lmc_nids        = (int32 *)ARR_DATA_PTR(pg_lmc_nids);
+	lmc_fvals       = (int32 *)ARR_DATA_PTR(pg_lmc_fvals);
+
+	oldcontext = MemoryContextSwitchTo(mcxt);
+
+	tree                = palloc(sizeof(dt_flat_tree));
+	tree->num_nodes     = n;
+	tree->ids           = palloc(sizeof(int32) * n);
+	tree->features      = palloc(sizeof(int32) * n);
+	tree->is_conts      = palloc(sizeof(bool) * n);
+	tree->split_values  = palloc(sizeof(float8) * n);
+	tree->lmc_nids      = palloc(sizeof(int32) * n);
+	tree->lmc_fvals     = palloc(sizeof(int32) * n);
+	tree->lmc_idx       = palloc(sizeof(int) * n);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* the nodes may be aggregated in any order */
+	order = palloc(sizeof(dt_node_pos) * n);
+	for (int i = 0; i < n; ++i)
+	{
+		order[i].id  = ids[i];
+		order[i].pos = i;
+	}
+	qsort(order, n, sizeof(dt_node_pos), dt_node_pos_cmp);
+
+	for (int i = 0; i < n; ++i)
+	{
+		int pos = order[i].pos;
+
+		dt_check_error_value
+			(
+				i == 0 || order[i - 1].id < order[i].id,
+				"duplicated node ID %d in a tree",
+				order[i].id
+			);
+
+		tree->ids[i]            = ids[pos];
+		tree->features[i]       = features[pos];
+		tree->is_conts[i]       = is_conts[pos];
+		tree->split_values[i]   = split_values[pos];
+		tree->lmc_nids[i]       = lmc_nids[pos];
+		tree->lmc_fvals[i]      = lmc_fvals[pos];
+	}
+	pfree(order);
+
+	/* locate the leftmost child of each internal node */
+	for (int i = 0; i < n; ++i)
+	{
+		int low  = i + 1;
+		int high = n;
+
+		tree->lmc_idx[i] = -1;
+		if (tree->lmc_nids[i] <= 0)
+			continue;
+
+		while (low < high)
+		{
+			int mid = low + ((high - low) >> 1);
+			if (tree->ids[mid] < tree->lmc_nids[i])
+				low = mid + 1;
+			else
+				high = mid;
+		}
+
+		if (low < n && tree->ids[low] == tree->lmc_nids[i])
+			tree->lmc_idx[i] = low;
+	}
+
+	return tree;
+}
+
+
+/*
+ * @brief Classify a row with a tree. Starting from the root, the child is
+ *        chosen by the value of the split feature until a leaf is reached,
+ *        or until the child for the value does not exist, e.g., because
+ *        there was no such value in the training set. In both cases, the
+ *        row is classified by the node where the traversal stops.
+ *
+ * @param fvals         The encoded feature values of the row.
+ * @param tid           The ID of the tree.
+ * @param ids           The IDs of the nodes.
+ * @param features      The split feature of each node.
+ * @param is_conts      Whether the split feature of each node is continuous.
+ * @param split_values  The split value of each node.
+ * @param lmc_nids      The leftmost child of each node, 0 for leaves.
+ * @param lmc_fvals     The feature value which leads to the leftmost child.
+ *
+ * @return The ID of the node that classifies the row. NULL if the value of
+ *         a split feature on the path is missing.
+ *
+ * The arrays of a tree are the same for all rows, so the flattened tree
+ * is cached in fn_extra by tree ID. All trees of a forest can be evaluated
+ * in the same scan of the classification set.
+ *
+ */
+Datum
+dt_tree_predict
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+	ArrayType          *pg_fvals    = PG_GETARG_ARRAYTYPE_P(0);
+	int32               tid         = PG_GETARG_INT32(1);
+	dt_flat_tree_cache *cache       = (dt_flat_tree_cache *)fcinfo->flinfo->fn_extra;
+	dt_flat_tree       *tree        = NULL;
+	MemoryContext       mcxt        = fcinfo->flinfo->fn_mcxt;
+	int                 num_fvals   = 0;
+	float8             *fvals       = NULL;
+	bool               *fnulls      = NULL;
+
+	dt_check_error_value
+		(
+			tid > 0,
+			"invalid tree ID: %d",
+			tid
+		);
+
+	dt_check_error
+		(
+			ARR_NDIM(pg_fvals) == 1 && ARR_ELEMTYPE(pg_fvals) == FLOAT8OID,
+			"the feature values must be a 1-dimensional float8 array"
+		);
+
+	if (NULL == cache)
+	{
+		cache = MemoryContextAllocZero(mcxt, sizeof(dt_flat_tree_cache));
+		fcinfo->flinfo->fn_extra = cache;
+	}
+
+	if (tid > cache->num_trees)
+	{
+		int             num_trees   = Max(tid, cache->num_trees * 2);
+		dt_flat_tree  **trees       =
+			MemoryContextAllocZero(mcxt, sizeof(dt_flat_tree *) * num_trees);
+
+		if (cache->num_trees > 0)
+		{
+			memcpy(trees, cache->trees,
+				sizeof(dt_flat_tree *) * cache->num_trees);
+			pfree(cache->trees);
+		}
+		cache->trees        = trees;
+		cache->num_trees    = num_trees;
+	}
+
+	tree = cache->trees[tid - 1];
+	if (NULL == tree)
+	{
+		tree = dt_flatten_tree
+			(
+				mcxt,
+				PG_GETARG_ARRAYTYPE_P(2),
+				PG_GETARG_ARRAYTYPE_P(3),
+				PG_GETARG_ARRAYTYPE_P(4),
+				PG_GETARG_ARRAYTYPE_P(5),
+				PG_GETARG_ARRAYTYPE_P(6),
+				PG_GETARG_ARRAYTYPE_P(7)
+			);
+		cache->trees[tid - 1] = tree;
+	}
+
+	/* expand the feature values, which may contain NULLs */
+	num_fvals = ArrayGetNItems(1, ARR_DIMS(pg_fvals));
+	if (num_fvals > cache->num_fvals)
+	{
+		if (cache->num_fvals > 0)
+		{
+			pfree(cache->fvals);
+			pfree(cache->fnulls);
+		}
+		cache->fvals        = MemoryContextAlloc(mcxt, sizeof(float8) * num_fvals);
+		cache->fnulls       = MemoryContextAlloc(mcxt, sizeof(bool) * num_fvals);
+		cache->num_fvals    = num_fvals;
+	}
+	fvals  = cache->fvals;
+	fnulls = cache->fnulls;
+
+	if (ARR_HASNULL(pg_fvals))
+	{
+		bits8  *bitmap  = ARR_NULLBITMAP(pg_fvals);
+		float8 *data    = (float8 *)ARR_DATA_PTR(pg_fvals);
+
+		for (int i = 0; i < num_fvals; ++i)
+		{
+			fnulls[i] = !(bitmap[i >> 3] & (1 << (i & 0x07)));
+			fvals[i]  = fnulls[i] ? 0 : *data++;
+		}
+	}
+	else
+	{
+		memcpy(fvals, ARR_DATA_PTR(pg_fvals), sizeof(float8) * num_fvals);
+		memset(fnulls, 0, sizeof(bool) * num_fvals);
+	}
+
+	/* 
+	 * walk down from the root, which has the smallest ID. The position of
+	 * a child is larger than that of its parent, so the walk ends within
+	 * num_nodes steps.
+	 */
+	int node = 0;
+	while (tree->lmc_idx[node] >= 0)
+	{
+		int     fid     = tree->features[node] - 1;
+		int32   child_id;
+		int     low;
+		int     high;
+
+		if (fid < 0 || fid >= num_fvals || fnulls[fid])
+			PG_RETURN_NULL();
+
+		if (tree->is_conts[node])
+			child_id = tree->lmc_nids[node] + 1 - tree->lmc_fvals[node] +
+				(tree->split_values[node] < fvals[fid] ? 1 : 0);
+		else
+			child_id = tree->lmc_nids[node] - tree->lmc_fvals[node] +
+				(int32)rint(fvals[fid]);
+
+		if (child_id < tree->lmc_nids[node])
+			break;
+
+		/* 
+		 * without gaps in the IDs of the children, the child is at
+		 * lmc_idx + child_id - lmc_nid. Otherwise, it is before that.
+		 */
+		low  = tree->lmc_idx[node];
+		high = Min(tree->num_nodes,
+				low + (child_id - tree->lmc_nids[node]) + 1);
+		while (low < high)
+		{
+			int mid = low + ((high - low) >> 1);
+			if (tree->ids[mid] < child_id)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+
+		if (low >= tree->num_nodes || tree->ids[low] != child_id)
+			break;
+
+		node = low;
+	}
+
+	PG_RETURN_INT32(tree->ids[node]);
+}
+PG_FUNCTION_INFO_V1(dt_tree_predict);
@@ -24,6 +24,10 @@ PG_MODULE_MAGIC;
 
 #define FLOAT8ARRAYOID 1022
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 /*
  * This function constructs an array of zeros.
  */
@@ -43,21 +47,6 @@ static ArrayType *construct_zero_array(int inNumElements,
 	return array;
 }
 
-/*
- * This function applies the kernel function on its two arguments.
- * This function incurs a large overhead and is up to ten times slower
- * than a kernel function implemented in C and called directly here.
- */
-static float8 apply_kernel(Oid foid, ArrayType * x1, ArrayType * x2) 
-{
-	float8 ret = 
-	DatumGetFloat8(OidFunctionCall2(foid,PointerGetDatum(x1),PointerGetDatum(x2)));
-	return ret;
-}
-
-
-
-
 Datum svm_dot(PG_FUNCTION_ARGS);
 PG_FUNCTION_INFO_V1(svm_dot);
 
@@ -174,27 +163,110 @@ Datum svm_gaussian(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8(ret);
 }
 
+/*
+ * The kernel function of a support vector model, looked up once per query and
+ * cached in fn_extra of the calling function. Looking up the function and
+ * calling it through OidFunctionCall2() for every support vector incurs a
+ * large overhead.
+ */
+typedef struct {
+	char * name;          // kernel name, if looked up by svm_kernel_by_name()
+	Oid koid;
+	FmgrInfo flinfo;
+} svm_kernel_cache;
+
+/*
+ * This function returns the cached kernel function with the given oid.
+ */
+static svm_kernel_cache * svm_kernel_by_oid(FunctionCallInfo fcinfo, Oid koid)
+{
+	svm_kernel_cache * cache = (svm_kernel_cache *)fcinfo->flinfo->fn_extra;
+	
+	if (cache == NULL) {
+		cache = (svm_kernel_cache *)MemoryContextAllocZero(
+			fcinfo->flinfo->fn_mcxt, sizeof(svm_kernel_cache));
+		fcinfo->flinfo->fn_extra = cache;
+	}
+	if (cache->koid != koid) {
+		fmgr_info_cxt(koid, &cache->flinfo, fcinfo->flinfo->fn_mcxt);
+		cache->koid = koid;
+	}
+	return cache;
+}
+
+/*
+ * This function returns the cached kernel function with the given name.
+ */
+static svm_kernel_cache * svm_kernel_by_name(FunctionCallInfo fcinfo,
+											 text * kernel)
+{
+	svm_kernel_cache * cache = (svm_kernel_cache *)fcinfo->flinfo->fn_extra;
+	char * name = text_to_cstring(kernel);
+	
+	if (cache != NULL && cache->name != NULL && strcmp(cache->name, name) == 0) {
+		pfree(name);
+		return cache;
+	}
+	
+	Oid argtypes[2] = { FLOAT8ARRAYOID, FLOAT8ARRAYOID };
+	List * funcname = textToQualifiedNameList(kernel);
+	cache = svm_kernel_by_oid(fcinfo, LookupFuncName(funcname, 2, argtypes,
+													 false));
+	if (cache->name != NULL)
+		pfree(cache->name);
+	cache->name = MemoryContextStrdup(fcinfo->flinfo->fn_mcxt, name);
+	pfree(name);
+	return cache;
+}
+
 /*
  * This function evalues a support vector model on a data point.
+ *
+ * For svm_dot, the model is evaluated natively as one matrix-vector product
+ * with the contiguous support-vector matrix. Any other kernel is called
+ * through fmgr, with each support vector copied into a single reused array.
  */
 static float8 
-svm_predict_eval(Oid koid, float8 * weights, ArrayType * supp_vectors, 
-				 ArrayType * ind, int32 nsvs, int32 ind_dim)
+svm_predict_eval(svm_kernel_cache * kernel, float8 * weights,
+				 ArrayType * supp_vectors, ArrayType * ind, int32 nsvs,
+				 int32 ind_dim)
 {
 	// We are not error-checking the ArrayTypes here because that has
 	// been done in the calling function
 	
-	int i; float8 ret = 0;
+	int i, j; float8 ret = 0;
 	float8 * spvs = (float8 *)ARR_DATA_PTR(supp_vectors);
 	
+	if (nsvs == 0)
+		return 0;
+	
+	if (kernel->flinfo.fn_addr == svm_dot) {
+		float8 * x = (float8 *)ARR_DATA_PTR(ind);
+		
+		if (ArrayGetNItems(ARR_NDIM(ind), ARR_DIMS(ind)) != ind_dim)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("function \"svm_dot\" called with invalid parameters")));
+		for (i=0; i!=nsvs; i++) {
+			float8 * sv = spvs + ind_dim * i;
+			float8 k = 0;
+			for (j=0; j!=ind_dim; j++)
+				k += sv[j] * x[j];
+			ret += weights[i] * k;
+		}
+		return ret;
+	}
+	
 	ArrayType * spp_vec = construct_zero_array(ind_dim, FLOAT8OID, 8);
 	float8 * spp_vec_data = (float8 *)ARR_DATA_PTR(spp_vec);
 	
 	for (i=0; i!=nsvs; i++) {
 		// first copy the relevant portion of spvs to spp_vec_data
 		memcpy(spp_vec_data, spvs+ind_dim*i, sizeof(float8) * ind_dim);
-		ret += weights[i] * apply_kernel(koid, spp_vec, ind);
+		ret += weights[i] * DatumGetFloat8(FunctionCall2(&kernel->flinfo,
+			PointerGetDatum(spp_vec), PointerGetDatum(ind)));
 	}
+	pfree(spp_vec);
 	return ret;
 }
 
@@ -231,64 +303,101 @@ Datum svm_predict_sub(PG_FUNCTION_ARGS)
 	
 	weights = (float8 *)ARR_DATA_PTR(weights_arr);
 	
-	Oid argtypes[2] = { FLOAT8ARRAYOID, FLOAT8ARRAYOID };
-	List * funcname = textToQualifiedNameList(kernel);
-	Oid koid = LookupFuncName(funcname, 2, argtypes, false);
-	
-	ret = svm_predict_eval(koid,weights,supp_vecs_arr,ind_arr,nsvs,ind_dim);
+	ret = svm_predict_eval(svm_kernel_by_name(fcinfo, kernel),
+						   weights,supp_vecs_arr,ind_arr,nsvs,ind_dim);
 	
 	PG_RETURN_FLOAT8(ret);
 }
 
 
 /*
- * This function extends a weight array with the weight of a new support vector.
- * The extra work of pre-allocating a larger block of memory doesn't appear
- * to make a difference in terms of total computation time.
+ * This function returns the number of elements an array has room for. The
+ * initial state of the aggregates holds empty (zero-dimensional) arrays.
+ */
+static int array_capacity(ArrayType * arr)
+{
+	return ARR_NDIM(arr) == 1 ? ARR_DIMS(arr)[0] : 0;
+}
+
+/*
+ * This function returns an array with room for at least inMinElements
+ * elements, keeping the first inUsed elements of arr. The capacity is at least
+ * doubled each time, so that adding n support vectors copies O(n) elements in
+ * total instead of O(n^2) with a fixed block size.
  */
 static int blocksize = 100;
-static ArrayType * addNewWeight(ArrayType * weights, float8 weight, int nsvs) 
+static ArrayType * grow_array(ArrayType * arr, int inUsed, int inMinElements)
 {
-	float8 * weights_data = (float8 *)ARR_DATA_PTR(weights);
+	int capacity = array_capacity(arr);
 	
-	if (nsvs % blocksize == 0) {
-		ArrayType * ret_arr = 
-		construct_zero_array(nsvs+blocksize, FLOAT8OID, 8);
-		float8 * ret = (float8 *)ARR_DATA_PTR(ret_arr); 
-		
-		memcpy(ret, weights_data, sizeof(float8) * nsvs);
-		ret[nsvs] = weight;
-		
-		return ret_arr;
-	} else {
-		weights_data[nsvs] = weight;
-		return weights;
-	}
+	if (inMinElements <= capacity)
+		return arr;
+	
+	capacity = Max(2 * capacity, inMinElements);
+	ArrayType * ret_arr = construct_zero_array(capacity, FLOAT8OID, 8);
+	if (inUsed > 0)
+		memcpy(ARR_DATA_PTR(ret_arr), ARR_DATA_PTR(arr),
+			   sizeof(float8) * inUsed);
+	return ret_arr;
+}
+
+/*
+ * This function extends a weight array with the weight of a new support vector.
+ */
+static ArrayType * addNewWeight(ArrayType * weights, float8 weight, int nsvs) 
+{
+	weights = grow_array(weights, nsvs, Max(nsvs + 1, blocksize));
+	((float8 *)ARR_DATA_PTR(weights))[nsvs] = weight;
+	return weights;
 }
 
 /* 
  * This function extends a support vector array with a new support vector.
- * The extra work of pre-allocating a larger block of memory doesn't appear
- * to make a difference in terms of total computation time.
  */
 static ArrayType * addNewSV(ArrayType * spvs, float8 * ind, int nsvs, int dim) 
 {
-	int i;
-	float8 * spvs_data = (float8 *)ARR_DATA_PTR(spvs);
-	
-	if (nsvs % blocksize == 0) {
-		ArrayType * ret_arr = 
-		construct_zero_array((nsvs+blocksize)*dim, FLOAT8OID,8);
-		float8 * ret = (float8 *)ARR_DATA_PTR(ret_arr); 
-		
-		memcpy(ret, spvs_data, sizeof(float8) * nsvs * dim);
-		for (i=0; i!=dim; i++) ret[nsvs*dim + i] = ind[i];
-		
-		return ret_arr;
-	} else {
-		for (i=0; i!=dim; i++) spvs_data[nsvs*dim + i] = ind[i];
-		return spvs;
+	spvs = grow_array(spvs, nsvs * dim, Max(nsvs + 1, blocksize) * dim);
+	memcpy((float8 *)ARR_DATA_PTR(spvs) + nsvs * dim, ind,
+		   sizeof(float8) * dim);
+	return spvs;
+}
+
+/*
+ * This function returns the position for a new support vector. Without a
+ * budget (budget <= 0), or while there are fewer than budget support vectors,
+ * this is nsvs, i.e., the new support vector is appended. Otherwise, the
+ * support vector with the smallest absolute weight is replaced, which bounds
+ * both the size of the model and the number of kernel evaluations per row.
+ */
+static int svm_new_sv_slot(float8 * weights, int nsvs, int budget)
+{
+	int i, slot = 0;
+	
+	if (budget <= 0 || nsvs < budget)
+		return nsvs;
+	for (i=1; i!=nsvs; i++)
+		if (fabs(weights[i]) < fabs(weights[slot]))
+			slot = i;
+	return slot;
+}
+
+/*
+ * This function adds a new support vector, or replaces the support vector at
+ * position slot (see svm_new_sv_slot()). Returns the new number of support
+ * vectors.
+ */
+static int svm_set_sv(ArrayType ** weights_arr, ArrayType ** supp_vecs_arr,
+					  int slot, float8 weight, float8 * ind, int nsvs, int dim)
+{
+	if (slot == nsvs) {
+		*weights_arr = addNewWeight(*weights_arr,weight,nsvs);
+		*supp_vecs_arr = addNewSV(*supp_vecs_arr,ind,nsvs,dim);
+		return nsvs + 1;
 	}
+	((float8 *)ARR_DATA_PTR(*weights_arr))[slot] = weight;
+	memcpy((float8 *)ARR_DATA_PTR(*supp_vecs_arr) + slot * dim, ind,
+		   sizeof(float8) * dim);
+	return nsvs;
 }
 
 Datum svm_reg_update(PG_FUNCTION_ARGS);
@@ -319,6 +428,7 @@ Datum svm_reg_update(PG_FUNCTION_ARGS)
 	float8 eta = PG_GETARG_FLOAT8(4);
 	float8 nu = PG_GETARG_FLOAT8(5);
 	float8 slambda = PG_GETARG_FLOAT8(6);
+	int32 budget = PG_NARGS() > 7 ? PG_GETARG_INT32(7) : 0;
 	
 	if (eta <= 0 || eta > 1 || nu <= 0 || nu > 1 || eta * slambda > 1)
 		ereport(ERROR,
@@ -388,7 +498,8 @@ Datum svm_reg_update(PG_FUNCTION_ARGS)
 	float8 * weights = (float8 *)ARR_DATA_PTR(weights_arr);
 	
 	// This is the main regression update algorithm
-	p = svm_predict_eval(koid,weights,supp_vecs_arr,ind_arr,nsvs,ind_dim) + b; 
+	p = svm_predict_eval(svm_kernel_by_oid(fcinfo, koid),
+						 weights,supp_vecs_arr,ind_arr,nsvs,ind_dim) + b;
 	
 	diff = label - p;
 	error = fabs(diff);
@@ -412,9 +523,9 @@ Datum svm_reg_update(PG_FUNCTION_ARGS)
 		}
 		
 		weight = diff < 0 ? -eta : eta;
-		weights_arr = addNewWeight(weights_arr,weight,nsvs);
-		supp_vecs_arr = addNewSV(supp_vecs_arr,ind,nsvs,ind_dim);
-		nsvs++;
+		nsvs = svm_set_sv(&weights_arr, &supp_vecs_arr,
+						  svm_new_sv_slot(weights,nsvs,budget),
+						  weight, ind, nsvs, ind_dim);
 		b = b + weight;
 		epsilon = epsilon + (1 - nu) * eta;
 	} else {
@@ -481,6 +592,7 @@ Datum svm_cls_update(PG_FUNCTION_ARGS)
 									   * fraction of the training data will
 									   * become support vectors
 									   */
+	int32 budget = PG_NARGS() > 6 ? PG_GETARG_INT32(6) : 0;
 	
 	if (eta <= 0 || eta > 1 || nu <= 0 || nu > 1)
 		ereport(ERROR,
@@ -550,7 +662,8 @@ Datum svm_cls_update(PG_FUNCTION_ARGS)
 	float8 * weights = (float8 *)ARR_DATA_PTR(weights_arr);
 	
 	// This is the nu-SV classification update algorithm.
-	p = svm_predict_eval(koid,weights,supp_vecs_arr,ind_arr,nsvs,ind_dim) + b; 
+	p = svm_predict_eval(svm_kernel_by_oid(fcinfo, koid),
+						 weights,supp_vecs_arr,ind_arr,nsvs,ind_dim) + b;
 	
 	p = label * p;
 	
@@ -576,9 +689,9 @@ Datum svm_cls_update(PG_FUNCTION_ARGS)
 			weights[i] = weights[i] * (1 - 0.1*eta); 
 		}
 		
-		weights_arr = addNewWeight(weights_arr,label * eta,nsvs);
-		supp_vecs_arr = addNewSV(supp_vecs_arr,ind,nsvs,ind_dim);
-		nsvs++;
+		nsvs = svm_set_sv(&weights_arr, &supp_vecs_arr,
+						  svm_new_sv_slot(weights,nsvs,budget),
+						  label * eta, ind, nsvs, ind_dim);
 		b = b + eta * label;
 		rho = rho - eta * (1 - nu);
 	} else {
@@ -644,6 +757,7 @@ Datum svm_nd_update(PG_FUNCTION_ARGS)
 									   * fraction of the training data will
 									   * become support vectors
 									   */
+	int32 budget = PG_NARGS() > 5 ? PG_GETARG_INT32(5) : 0;
 	
 	if (eta <= 0 || eta > 1 || nu <= 0 || nu > 1)
 		ereport(ERROR,
@@ -713,7 +827,8 @@ Datum svm_nd_update(PG_FUNCTION_ARGS)
 	float8 * weights = (float8 *)ARR_DATA_PTR(weights_arr);
 	
 	// This is the nu-SV novelty detection update algorithm.
-	p = svm_predict_eval(koid,weights,supp_vecs_arr,ind_arr,nsvs,ind_dim); 
+	p = svm_predict_eval(svm_kernel_by_oid(fcinfo, koid),
+						 weights,supp_vecs_arr,ind_arr,nsvs,ind_dim);
 	inds++;
 	
 	if (p < rho) {
@@ -732,9 +847,9 @@ Datum svm_nd_update(PG_FUNCTION_ARGS)
 			weights[i] = weights[i] * (1 - 0.1*eta); 
 		}
 		
-		weights_arr = addNewWeight(weights_arr,eta,nsvs);
-		supp_vecs_arr = addNewSV(supp_vecs_arr,ind,nsvs,ind_dim);
-		nsvs++;
+		nsvs = svm_set_sv(&weights_arr, &supp_vecs_arr,
+						  svm_new_sv_slot(weights,nsvs,budget),
+						  eta, ind, nsvs, ind_dim);
 		rho = rho - eta * (1 - nu);
 	} else {
 		rho = rho + eta * nu; 
@@ -774,6 +889,303 @@ Datum svm_nd_update(PG_FUNCTION_ARGS)
 	PG_RETURN_DATUM(HeapTupleGetDatum(ret));
 }
 
+/*
+ * This function removes one support vector from a model, for bringing a
+ * merged model within its budget. The support vector j with the smallest
+ * absolute weight is merged into the nearest support vector k (in Euclidean
+ * distance) whose weight has the same sign: k is moved to the weighted mean
+ *
+ *     x_k = (|w_j| x_j + |w_k| x_k) / (|w_j| + |w_k|),  w_k = w_j + w_k.
+ *
+ * For the dot product kernel this leaves the model unchanged; for smooth
+ * kernels it is a first-order approximation that is good for close support
+ * vectors. If there is no such k, support vector j is dropped, as in
+ * svm_new_sv_slot(). Returns the new number of support vectors.
+ */
+static int svm_merge_sv(float8 * weights, float8 * spvs, int nsvs, int dim)
+{
+	int i, l, j = 0, k = -1;
+	float8 best = 0;
+	
+	for (i=1; i!=nsvs; i++)
+		if (fabs(weights[i]) < fabs(weights[j]))
+			j = i;
+	
+	float8 * xj = spvs + j * dim;
+	for (i=0; i!=nsvs; i++) {
+		if (i == j || weights[i] * weights[j] <= 0)
+			continue;
+		float8 * xi = spvs + i * dim;
+		float8 dist = 0;
+		for (l=0; l!=dim; l++)
+			dist += (xi[l] - xj[l]) * (xi[l] - xj[l]);
+		if (k < 0 || dist < best) {
+			k = i;
+			best = dist;
+		}
+	}
+	
+	if (k >= 0) {
+		float8 * xk = spvs + k * dim;
+		float8 aj = fabs(weights[j]), ak = fabs(weights[k]);
+		for (l=0; l!=dim; l++)
+			xk[l] = (aj * xj[l] + ak * xk[l]) / (aj + ak);
+		weights[k] += weights[j];
+	}
+	
+	// Move the last support vector into the slot of j
+	nsvs--;
+	if (j != nsvs) {
+		weights[j] = weights[nsvs];
+		memcpy(xj, spvs + nsvs * dim, sizeof(float8) * dim);
+	}
+	return nsvs;
+}
+
+Datum svm_merge_update(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(svm_merge_update);
+
+/**
+ * This function merges a support vector model into an ensemble model. The
+ * support vectors of the model are added with their weights scaled by scale,
+ * as are its offset, margin and epsilon, so that merging n models with scale
+ * 1/n gives a single model computing the average of the n predictions. Once
+ * the merged model has more than budget support vectors, they are compressed
+ * with svm_merge_sv(). A budget <= 0 means no budget.
+ * This function is wrapped in an aggregate function to merge the models that
+ * were learned in parallel on different segments.
+ */
+Datum svm_merge_update(PG_FUNCTION_ARGS)
+{
+	int i;
+	
+	HeapTupleHeader t = PG_GETARG_HEAPTUPLEHEADER(0);
+	HeapTupleHeader m = PG_GETARG_HEAPTUPLEHEADER(1);
+	float8 scale = PG_GETARG_FLOAT8(2);
+	int32 budget = PG_GETARG_INT32(3);
+	
+	if (scale <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("function \"%s\" called with invalid parameter",
+						format_procedure(fcinfo->flinfo->fn_oid))));
+	
+	// Read the attributes of the merged model and of the new model
+	bool nil[20] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 };
+	
+	int32 inds = DatumGetInt32(GetAttributeByName(t, "inds", &nil[0]));
+	float8 cum_err =DatumGetFloat8(GetAttributeByName(t,"cum_err",&nil[1]));
+	float8 epsilon =DatumGetFloat8(GetAttributeByName(t,"epsilon",&nil[2]));
+	float8 rho = DatumGetFloat8(GetAttributeByName(t, "rho", &nil[3]));
+	float8 b = DatumGetFloat8(GetAttributeByName(t, "b", &nil[4]));
+	int32 nsvs = DatumGetInt32(GetAttributeByName(t, "nsvs", &nil[5]));
+	int32 ind_dim =DatumGetInt32(GetAttributeByName(t, "ind_dim", &nil[6]));
+	ArrayType * weights_arr = 
+	DatumGetArrayTypeP(GetAttributeByName(t, "weights", &nil[7]));
+	ArrayType * supp_vecs_arr = 
+	DatumGetArrayTypeP(GetAttributeByName(t,"individuals",&nil[8]));
+	Oid koid = DatumGetUInt32(GetAttributeByName(t, "kernel_oid",&nil[9]));
+	
+	int32 m_inds = DatumGetInt32(GetAttributeByName(m, "inds", &nil[10]));
+	float8 m_cum_err =
+	DatumGetFloat8(GetAttributeByName(m, "cum_err", &nil[11]));
+	float8 m_epsilon =
+	DatumGetFloat8(GetAttributeByName(m, "epsilon", &nil[12]));
+	float8 m_rho = DatumGetFloat8(GetAttributeByName(m, "rho", &nil[13]));
+	float8 m_b = DatumGetFloat8(GetAttributeByName(m, "b", &nil[14]));
+	int32 m_nsvs = DatumGetInt32(GetAttributeByName(m, "nsvs", &nil[15]));
+	int32 m_ind_dim =
+	DatumGetInt32(GetAttributeByName(m, "ind_dim", &nil[16]));
+	ArrayType * m_weights_arr = 
+	DatumGetArrayTypeP(GetAttributeByName(m, "weights", &nil[17]));
+	ArrayType * m_supp_vecs_arr = 
+	DatumGetArrayTypeP(GetAttributeByName(m,"individuals",&nil[18]));
+	Oid m_koid =DatumGetUInt32(GetAttributeByName(m,"kernel_oid",&nil[19]));
+	
+	for (i=0; i!=20; i++)
+		if (nil[i]) elog(ERROR, "error reading support vector model");
+	
+	// Models without support vectors only contribute their offsets
+	if (m_nsvs > 0) {
+		if (ARR_NULLBITMAP(m_weights_arr) || ARR_NDIM(m_weights_arr) != 1 ||
+		    ARR_ELEMTYPE(m_weights_arr) != FLOAT8OID ||
+		    ARR_NULLBITMAP(m_supp_vecs_arr) ||
+		    ARR_NDIM(m_supp_vecs_arr) != 1 ||
+		    ARR_ELEMTYPE(m_supp_vecs_arr) != FLOAT8OID ||
+		    array_capacity(m_weights_arr) < m_nsvs ||
+		    array_capacity(m_supp_vecs_arr) < m_nsvs * m_ind_dim ||
+		    (nsvs > 0 && m_ind_dim != ind_dim) ||
+		    (koid != 0 && m_koid != koid))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("function \"%s\" called with incompatible models",
+							format_procedure(fcinfo->flinfo->fn_oid))));
+		if (nsvs == 0)
+			ind_dim = m_ind_dim;
+		koid = m_koid;
+	}
+	
+	// Append the scaled support vectors of the new model
+	if (m_nsvs > 0) {
+		ArrayType * new_weights_arr = 
+		construct_zero_array(nsvs + m_nsvs, FLOAT8OID, 8);
+		ArrayType * new_supp_vecs_arr = 
+		construct_zero_array((nsvs + m_nsvs) * ind_dim, FLOAT8OID, 8);
+		float8 * weights = (float8 *)ARR_DATA_PTR(new_weights_arr);
+		float8 * spvs = (float8 *)ARR_DATA_PTR(new_supp_vecs_arr);
+		float8 * m_weights = (float8 *)ARR_DATA_PTR(m_weights_arr);
+		
+		if (nsvs > 0) {
+			memcpy(weights, ARR_DATA_PTR(weights_arr), sizeof(float8) * nsvs);
+			memcpy(spvs, ARR_DATA_PTR(supp_vecs_arr),
+				   sizeof(float8) * nsvs * ind_dim);
+		}
+		for (i=0; i!=m_nsvs; i++)
+			weights[nsvs + i] = scale * m_weights[i];
+		memcpy(spvs + nsvs * ind_dim, ARR_DATA_PTR(m_supp_vecs_arr),
+			   sizeof(float8) * m_nsvs * ind_dim);
+		nsvs += m_nsvs;
+		
+		while (budget > 0 && nsvs > budget)
+			nsvs = svm_merge_sv(weights, spvs, nsvs, ind_dim);
+		
+		weights_arr = new_weights_arr;
+		supp_vecs_arr = new_supp_vecs_arr;
+	}
+	
+	inds += m_inds;
+	cum_err += m_cum_err;
+	epsilon += scale * m_epsilon;
+	rho += scale * m_rho;
+	b += scale * m_b;
+	
+	// Package up the attributes and return the resultant composite object
+	Datum values[10];
+	values[0] = Int32GetDatum(inds);
+	values[1] = Float8GetDatum(cum_err);
+	values[2] = Float8GetDatum(epsilon);
+	values[3] = Float8GetDatum(rho);
+	values[4] = Float8GetDatum(b);
+	values[5] = Int32GetDatum(nsvs);
+	values[6] = Int32GetDatum(ind_dim);
+	values[7] = PointerGetDatum(weights_arr);
+	values[8] = PointerGetDatum(supp_vecs_arr);
+	values[9] = UInt32GetDatum(koid);
+	
+	TupleDesc tuple;
+	if (get_call_result_type(fcinfo, NULL, &tuple) != TYPEFUNC_COMPOSITE)
+		ereport(ERROR,
+				(errcode( ERRCODE_FEATURE_NOT_SUPPORTED ),
+				 errmsg( "function returning record called in context "
+						"that cannot accept type record" )));
+	tuple = BlessTupleDesc(tuple);
+	
+	bool * isnulls = palloc0(10 * sizeof(bool));
+	HeapTuple ret = heap_form_tuple(tuple, values, isnulls);
+	
+	PG_RETURN_DATUM(HeapTupleGetDatum(ret));
+}
+
+/*
+ * The random projection of svm_random_fourier_features(), generated once per
+ * query and cached in fn_extra.
+ */
+typedef struct {
+	int32 ind_dim;
+	int32 num_features;
+	float8 gamma;
+	int32 seed;
+	float8 * directions;  // num_features x ind_dim, row major
+	float8 * offsets;     // num_features
+} svm_rff_cache;
+
+/*
+ * This function returns a standard normal variate (Box-Muller).
+ */
+static float8 svm_normal(unsigned short * xsubi)
+{
+	float8 u1 = 1 - erand48(xsubi);  // in (0, 1]
+	float8 u2 = erand48(xsubi);
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+Datum svm_random_fourier_features(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(svm_random_fourier_features);
+
+/**
+ * This function maps a data point to D random Fourier features
+ * z(x) = sqrt(2/D) cos(W x + b), with W drawn from N(0, 2 gamma I) and b
+ * uniformly from [0, 2 pi) (Rahimi and Recht, Random Features for Large-Scale
+ * Kernel Machines, NIPS 2007). Then z(x) . z(y) approximates the Gaussian
+ * kernel exp(-gamma ||x - y||^2), so that a linear model on z(x) approximates
+ * a kernel model of fixed size D.
+ *
+ * W and b only depend on the seed, so that training and prediction map their
+ * data points the same way.
+ */
+Datum svm_random_fourier_features(PG_FUNCTION_ARGS)
+{
+	ArrayType * ind_arr = PG_GETARG_ARRAYTYPE_P(0);
+	int32 num_features = PG_GETARG_INT32(1);
+	float8 gamma = PG_GETARG_FLOAT8(2);
+	int32 seed = PG_GETARG_INT32(3);
+	
+	if (ARR_NULLBITMAP(ind_arr) || ARR_NDIM(ind_arr) != 1 ||
+	    ARR_ELEMTYPE(ind_arr) != FLOAT8OID || num_features <= 0 || gamma <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("function \"%s\" called with invalid parameters",
+						format_procedure(fcinfo->flinfo->fn_oid))));
+	
+	int32 ind_dim = ARR_DIMS(ind_arr)[0];
+	float8 * ind = (float8 *)ARR_DATA_PTR(ind_arr);
+	svm_rff_cache * cache = (svm_rff_cache *)fcinfo->flinfo->fn_extra;
+	
+	if (cache == NULL || cache->ind_dim != ind_dim ||
+	    cache->num_features != num_features || cache->gamma != gamma ||
+	    cache->seed != seed) {
+		MemoryContext mcxt = fcinfo->flinfo->fn_mcxt;
+		unsigned short xsubi[3] = { 0x330E, (unsigned short) seed,
+									(unsigned short) (seed >> 16) };
+		float8 scale = sqrt(2 * gamma);
+		
+		if (cache == NULL) {
+			cache = (svm_rff_cache *)MemoryContextAlloc(mcxt,
+														sizeof(svm_rff_cache));
+		} else {
+			pfree(cache->directions);
+			pfree(cache->offsets);
+		}
+		cache->ind_dim = ind_dim;
+		cache->num_features = num_features;
+		cache->gamma = gamma;
+		cache->seed = seed;
+		cache->directions = (float8 *)MemoryContextAlloc(mcxt,
+			sizeof(float8) * num_features * ind_dim);
+		cache->offsets = (float8 *)MemoryContextAlloc(mcxt,
+			sizeof(float8) * num_features);
+		for (int i=0; i!=num_features * ind_dim; i++)
+			cache->directions[i] = scale * svm_normal(xsubi);
+		for (int i=0; i!=num_features; i++)
+			cache->offsets[i] = 2 * M_PI * erand48(xsubi);
+		fcinfo->flinfo->fn_extra = cache;
+	}
+	
+	ArrayType * ret_arr = construct_zero_array(num_features, FLOAT8OID, 8);
+	float8 * z = (float8 *)ARR_DATA_PTR(ret_arr);
+	float8 norm = sqrt(2.0 / num_features);
+	
+	for (int i=0; i!=num_features; i++) {
+		float8 * w = cache->directions + i * ind_dim;
+		float8 t = cache->offsets[i];
+		for (int j=0; j!=ind_dim; j++)
+			t += w[j] * ind[j];
+		z[i] = norm * cos(t);
+	}
+	
+	PG_RETURN_ARRAYTYPE_P(ret_arr);
+}
+
 // Hinge loss
 float8 dloss(float8 a, float8 y) {
 	float8 z = a * y;
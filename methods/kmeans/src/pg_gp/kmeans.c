@@ -1,4 +1,5 @@
 #include <postgres.h>
+#include <math.h>
 #include <nodes/memnodes.h>
 #include <utils/builtins.h>
 #include <utils/memutils.h>
@@ -91,6 +92,162 @@ compute_metric(PGFunction inMetricFn, MemoryContext inMemContext, Datum inVec1,
     return distance;
 }
 
+/*
+ * Native distance kernels
+ *
+ * The svec metric functions are fmgr functions that first materialize the
+ * difference (or product) of both vectors as a new svec. Here, instead, we
+ * walk the RLE runs of both vectors at the same time and accumulate all sums
+ * needed by the supported metrics in one pass, without any memory allocation.
+ * Scalar svecs (dimension -1) are broadcast by the svec operators, so we leave
+ * these to the fmgr path.
+ */
+typedef struct {
+    double l1;          /* sum |a - b| */
+    double l2;          /* sum (a - b)^2 */
+    double dot;         /* sum a * b */
+    double norm1;       /* sum a^2 */
+    double norm2;       /* sum b^2 */
+} KMeansDistanceSums;
+
+static
+inline
+void
+accumulate_sdata_pair(SparseData inLeft, SparseData inRight,
+    KMeansDistanceSums *outSums)
+{
+    double     *lvals = (double *) inLeft->vals->data;
+    double     *rvals = (double *) inRight->vals->data;
+    char       *lix = inLeft->index->data;
+    char       *rix = inRight->index->data;
+    int64       lremaining = compword_to_int8(lix);
+    int64       rremaining = compword_to_int8(rix);
+    int64       run;
+    double      a, b, d;
+    int         i = 0, j = 0;
+
+    memset(outSums, 0, sizeof(KMeansDistanceSums));
+    while (i < inLeft->unique_value_count && j < inRight->unique_value_count) {
+        run = Min(lremaining, rremaining);
+        a = lvals[i];
+        b = rvals[j];
+        d = a - b;
+        outSums->l1 += fabs(d) * run;
+        outSums->l2 += d * d * run;
+        outSums->dot += a * b * run;
+        outSums->norm1 += a * a * run;
+        outSums->norm2 += b * b * run;
+
+        lremaining -= run;
+        rremaining -= run;
+        if (lremaining == 0 && ++i < inLeft->unique_value_count) {
+            lix += int8compstoragesize(lix);
+            lremaining = compword_to_int8(lix);
+        }
+        if (rremaining == 0 && ++j < inRight->unique_value_count) {
+            rix += int8compstoragesize(rix);
+            rremaining = compword_to_int8(rix);
+        }
+    }
+}
+
+static
+inline
+double
+compute_metric_native(KMeansMetric inMetric, SvecType *inVec1,
+    SvecType *inVec2)
+{
+    KMeansDistanceSums  sums;
+    double              result;
+
+    if (inVec1->dimension != inVec2->dimension)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("array dimension of inputs are not the same: "
+                    "dim1=%d, dim2=%d", inVec1->dimension, inVec2->dimension)));
+
+    accumulate_sdata_pair(sdata_from_svec(inVec1), sdata_from_svec(inVec2),
+        &sums);
+
+    /* Same formulas (and clamping) as in svec/src/pg_gp/operators.c */
+    switch (inMetric) {
+        case L1NORM:
+            return sums.l1;
+        case L2NORM:
+            return sqrt(sums.l2);
+        case COSINE:
+            result = sums.dot / (sqrt(sums.norm1) * sqrt(sums.norm2));
+            return acos(result > 1.0 ? 1.0 : (result < -1.0 ? -1.0 : result));
+        case TANIMOTO:
+        default:
+            result = sums.dot / (sums.norm1 + sums.norm2 - sums.dot);
+            return 1. - (result > 1.0 ? 1.0 : (result < 0.0 ? 0.0 : result));
+    }
+}
+
+/*
+ * Distance between two (detoasted) svecs, using the native kernels where
+ * possible and falling back to the fmgr metric function otherwise
+ */
+static
+inline
+double
+compute_distance(KMeansMetric inMetric, PGFunction inMetricFn,
+    MemoryContext inMemContext, SvecType *inVec1, SvecType *inVec2)
+{
+    if (IS_SCALAR(inVec1) || IS_SCALAR(inVec2))
+        return compute_metric(inMetricFn, inMemContext,
+            PointerGetDatum(inVec1), PointerGetDatum(inVec2));
+
+    return compute_metric_native(inMetric, inVec1, inVec2);
+}
+
+static
+inline
+SvecType **
+detoast_svec_array_elms(Datum *inSvecArr, int inLen)
+{
+    SvecType  **svecs = (SvecType **) palloc(sizeof(SvecType *) * inLen);
+
+    for (int i = 0; i < inLen; i++)
+        svecs[i] = DatumGetSvecTypeP(inSvecArr[i]);
+    return svecs;
+}
+
+static
+inline
+float8 *
+get_float8_array_data(PG_FUNCTION_ARGS, int inArgNo, int inExpectedLen)
+{
+    ArrayType      *arr = PG_GETARG_ARRAYTYPE_P(inArgNo);
+
+    if (ARR_ELEMTYPE(arr) != FLOAT8OID || ARR_NDIM(arr) != 1
+        || ARR_HASNULL(arr) || ARR_DIMS(arr)[0] != inExpectedLen)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("function \"%s\" called with invalid array argument "
+                    "(expected %d non-null elements)",
+                    format_procedure(fcinfo->flinfo->fn_oid), inExpectedLen)));
+    return (float8 *) ARR_DATA_PTR(arr);
+}
+
+static
+inline
+ArrayType *
+construct_float8_array(const float8 *inValues, int inLen)
+{
+    size_t          bytes = ARR_OVERHEAD_NONULLS(1) + sizeof(float8) * inLen;
+    ArrayType      *arr = (ArrayType *) palloc0(bytes);
+
+    SET_VARSIZE(arr, bytes);
+    ARR_ELEMTYPE(arr) = FLOAT8OID;
+    ARR_NDIM(arr) = 1;
+    ARR_DIMS(arr)[0] = inLen;
+    ARR_LBOUND(arr)[0] = 1;
+    memcpy(ARR_DATA_PTR(arr), inValues, sizeof(float8) * inLen);
+    return arr;
+}
+
 static
 MemoryContext
 setup_mem_context_for_functional_calls() {
@@ -102,14 +259,420 @@ setup_mem_context_for_functional_calls() {
     return ctxt;
 }
 
+/*
+ * Pivot index over canopy centers
+ *
+ * Canopy clustering repeatedly asks which canopies are closer than a threshold
+ * to a given point. For L1, L2, and angular distance, the triangle inequality
+ * gives |d(p, z) - d(c, z)| <= d(p, c) for any pivot z, so a canopy c cannot
+ * be close to p if its distance to some pivot differs from that of p by at
+ * least the threshold. The first CANOPY_INDEX_PIVOTS canopies serve as pivots,
+ * and the canopies are kept sorted by their distance to the first pivot. A
+ * lookup therefore visits only a window of the sorted array, and exact
+ * distances are computed only for candidates that no pivot rules out. Unlike
+ * locality-sensitive hashing, no close canopy is ever missed, so results are
+ * identical to those of a linear scan.
+ *
+ * Canopies whose distance to the first pivot is not finite cannot be placed in
+ * the sorted array and are always candidates.
+ */
+#define CANOPY_INDEX_PIVOTS 4
+
+typedef struct {
+    KMeansMetric    metric;
+    int             num_pivots;
+    SvecType       *pivots[CANOPY_INDEX_PIVOTS];  /* copies of canopies */
+    int             num_canopies;
+    int             capacity;
+    float8         *distances;  /* [canopy][pivot] */
+    int            *sorted;     /* canopies by distance to the first pivot */
+    int             num_sorted;
+    int            *unsorted;   /* canopies with a non-finite distance */
+    int             num_unsorted;
+    int            *candidates; /* scratch space for lookups */
+} CanopyIndex;
+
+static
+inline
+bool
+canopy_index_supports(KMeansMetric inMetric)
+{
+    /* The Tanimoto distance violates the triangle inequality */
+    return inMetric == L1NORM || inMetric == L2NORM || inMetric == COSINE;
+}
+
+/*
+ * Bound on |d(p, z) - d(c, z)| for a canopy c that is close to p, relaxed to
+ * account for rounding errors in the distances. Angles close to 0 are
+ * ill-conditioned (acos), hence the absolute slack.
+ */
+static
+inline
+float8
+canopy_index_margin(KMeansMetric inMetric, float8 inThreshold, float8 inDist1,
+    float8 inDist2)
+{
+    return inThreshold + 1e-9 * (inThreshold + fabs(inDist1) + fabs(inDist2))
+        + (inMetric == COSINE ? 1e-4 : 0.);
+}
+
+static
+void
+canopy_index_init(CanopyIndex *outIndex, KMeansMetric inMetric,
+    int inCapacity)
+{
+    memset(outIndex, 0, sizeof(CanopyIndex));
+    outIndex->metric = inMetric;
+    outIndex->capacity = Max(inCapacity, 16);
+    outIndex->distances = (float8 *) palloc(
+        sizeof(float8) * CANOPY_INDEX_PIVOTS * outIndex->capacity);
+    outIndex->sorted = (int *) palloc(sizeof(int) * outIndex->capacity);
+    outIndex->unsorted = (int *) palloc(sizeof(int) * outIndex->capacity);
+    outIndex->candidates = (int *) palloc(sizeof(int) * outIndex->capacity);
+}
+
+static
+void
+canopy_index_free(CanopyIndex *inIndex)
+{
+    for (int p = 0; p < inIndex->num_pivots; p++)
+        pfree(inIndex->pivots[p]);
+    pfree(inIndex->distances);
+    pfree(inIndex->sorted);
+    pfree(inIndex->unsorted);
+    pfree(inIndex->candidates);
+}
+
+/*
+ * Position of the first canopy in the sorted array whose distance to the first
+ * pivot is greater than (or, if inStrict is false, at least) inKey
+ */
+static
+inline
+int
+canopy_index_lower_bound(const CanopyIndex *inIndex, float8 inKey,
+    bool inStrict)
+{
+    int     lo = 0, hi = inIndex->num_sorted, mid;
+    float8  key;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        key = inIndex->distances[
+            (size_t) inIndex->sorted[mid] * CANOPY_INDEX_PIVOTS];
+        if (inStrict ? key <= inKey : key < inKey)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Add the next canopy (the index is the number of canopies added before). Any
+ * memory is allocated in the current memory context.
+ */
+static
+void
+canopy_index_add(CanopyIndex *ioIndex, PGFunction inMetricFn,
+    MemoryContext inMemContext, SvecType *inCanopy)
+{
+    int             pos = ioIndex->num_canopies;
+    float8         *dist;
+    int             s;
+
+    if (pos == ioIndex->capacity) {
+        ioIndex->capacity *= 2;
+        ioIndex->distances = (float8 *) repalloc(ioIndex->distances,
+            sizeof(float8) * CANOPY_INDEX_PIVOTS * ioIndex->capacity);
+        ioIndex->sorted = (int *) repalloc(ioIndex->sorted,
+            sizeof(int) * ioIndex->capacity);
+        ioIndex->unsorted = (int *) repalloc(ioIndex->unsorted,
+            sizeof(int) * ioIndex->capacity);
+        ioIndex->candidates = (int *) repalloc(ioIndex->candidates,
+            sizeof(int) * ioIndex->capacity);
+    }
+
+    dist = ioIndex->distances + (size_t) pos * CANOPY_INDEX_PIVOTS;
+    for (int p = 0; p < ioIndex->num_pivots; p++)
+        dist[p] = compute_distance(ioIndex->metric, inMetricFn, inMemContext,
+            inCanopy, ioIndex->pivots[p]);
+    if (ioIndex->num_pivots < CANOPY_INDEX_PIVOTS) {
+        /* All previous canopies are pivots, so the distances are known */
+        for (int k = 0; k < pos; k++)
+            ioIndex->distances[(size_t) k * CANOPY_INDEX_PIVOTS + pos]
+                = dist[k];
+        dist[pos] = 0.;
+        ioIndex->pivots[pos] = (SvecType *) palloc(VARSIZE(inCanopy));
+        memcpy(ioIndex->pivots[pos], inCanopy, VARSIZE(inCanopy));
+        ioIndex->num_pivots++;
+    }
+    ioIndex->num_canopies++;
+
+    if (!isfinite(dist[0])) {
+        ioIndex->unsorted[ioIndex->num_unsorted++] = pos;
+        return;
+    }
+    s = canopy_index_lower_bound(ioIndex, dist[0], true);
+    memmove(ioIndex->sorted + s + 1, ioIndex->sorted + s,
+        sizeof(int) * (ioIndex->num_sorted - s));
+    ioIndex->sorted[s] = pos;
+    ioIndex->num_sorted++;
+}
+
+/*
+ * Distances between a point and all pivots. For a pivot, this is also the
+ * exact distance between the point and the canopy (in this order).
+ */
+static
+inline
+void
+canopy_index_pivot_distances(const CanopyIndex *inIndex,
+    PGFunction inMetricFn, MemoryContext inMemContext, SvecType *inPoint,
+    float8 *outDistances)
+{
+    for (int p = 0; p < inIndex->num_pivots; p++)
+        outDistances[p] = compute_distance(inIndex->metric, inMetricFn,
+            inMemContext, inPoint, inIndex->pivots[p]);
+}
+
+static
+inline
+bool
+canopy_index_rules_out(const CanopyIndex *inIndex, int inCanopy,
+    const float8 *inPointDistances, float8 inThreshold)
+{
+    const float8   *dist = inIndex->distances
+        + (size_t) inCanopy * CANOPY_INDEX_PIVOTS;
+
+    /* Comparisons involving NaN are false, so nothing is ruled out then */
+    for (int p = 0; p < inIndex->num_pivots; p++)
+        if (fabs(inPointDistances[p] - dist[p]) >= canopy_index_margin(
+                inIndex->metric, inThreshold, inPointDistances[p], dist[p]))
+            return true;
+    return false;
+}
+
+/*
+ * Canopies that may be closer to a point than the threshold, given the
+ * distances between the point and the pivots. The candidates are stored in
+ * ioIndex->candidates, in no particular order.
+ */
+static
+int
+canopy_index_candidates(CanopyIndex *ioIndex, const float8 *inPointDistances,
+    float8 inThreshold)
+{
+    float8  margin;
+    int     lo = 0, hi = ioIndex->num_sorted;
+    int     num_candidates = 0;
+
+    if (ioIndex->num_pivots == 0)
+        return 0;
+
+    if (isfinite(inPointDistances[0])) {
+        margin = canopy_index_margin(ioIndex->metric, inThreshold,
+            inPointDistances[0], fabs(inPointDistances[0]) + 2 * inThreshold);
+        lo = canopy_index_lower_bound(ioIndex,
+            inPointDistances[0] - margin, true);
+        hi = canopy_index_lower_bound(ioIndex,
+            inPointDistances[0] + margin, false);
+    }
+    for (int s = lo; s < hi; s++)
+        if (!canopy_index_rules_out(ioIndex, ioIndex->sorted[s],
+                inPointDistances, inThreshold))
+            ioIndex->candidates[num_candidates++] = ioIndex->sorted[s];
+    for (int s = 0; s < ioIndex->num_unsorted; s++)
+        if (!canopy_index_rules_out(ioIndex, ioIndex->unsorted[s],
+                inPointDistances, inThreshold))
+            ioIndex->candidates[num_candidates++] = ioIndex->unsorted[s];
+    return num_candidates;
+}
+
+static
+int
+compare_int(const void *inLeft, const void *inRight)
+{
+    int     left = *(const int *) inLeft;
+    int     right = *(const int *) inRight;
+
+    return left < right ? -1 : (left > right ? 1 : 0);
+}
+
+/*
+ * Index over the canopies argument of the most recent call, cached in fn_extra
+ *
+ * The same canopies are passed for every point in a query. Comparing them with
+ * those of the previous call is no more expensive than detoasting them.
+ */
+typedef struct {
+    ArrayType      *canopies;       /* copy of the canopies argument */
+    Datum          *canopy_datums;  /* pointing into canopies */
+    int             num_canopies;
+    CanopyIndex     index;
+} CloseCanopiesCache;
+
+static
+CloseCanopiesCache *
+get_close_canopies_cache(FunctionCallInfo fcinfo, ArrayType *inCanopies,
+    KMeansMetric inMetric, PGFunction inMetricFn, MemoryContext inMemContext)
+{
+    CloseCanopiesCache *cache = (CloseCanopiesCache *) fcinfo->flinfo->fn_extra;
+    MemoryContext       oldContext;
+
+    if (cache != NULL && cache->index.metric == inMetric
+        && VARSIZE(cache->canopies) == VARSIZE(inCanopies)
+        && memcmp(cache->canopies, inCanopies, VARSIZE(inCanopies)) == 0)
+        return cache;
+
+    oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    if (cache == NULL)
+        cache = (CloseCanopiesCache *) palloc0(sizeof(CloseCanopiesCache));
+    else {
+        pfree(cache->canopies);
+        pfree(cache->canopy_datums);
+        canopy_index_free(&cache->index);
+    }
+    fcinfo->flinfo->fn_extra = NULL;
+
+    cache->canopies = (ArrayType *) palloc(VARSIZE(inCanopies));
+    memcpy(cache->canopies, inCanopies, VARSIZE(inCanopies));
+    get_svec_array_elms(cache->canopies, &cache->canopy_datums,
+        &cache->num_canopies);
+    canopy_index_init(&cache->index, inMetric, cache->num_canopies);
+    for (int i = 0; i < cache->num_canopies; i++)
+        canopy_index_add(&cache->index, inMetricFn, inMemContext,
+            DatumGetSvecTypeP(cache->canopy_datums[i]));
+
+    /* Only publish the cache once the index is complete */
+    fcinfo->flinfo->fn_extra = cache;
+    MemoryContextSwitchTo(oldContext);
+    return cache;
+}
+
+/*
+ * Index over the canopies in the transition state of kmeans_canopy(), cached
+ * in fn_extra
+ *
+ * The state only changes when a canopy is appended, in which case the index is
+ * updated, too. The executor then copies the new state, so its address is not
+ * known until the next call, where it is confirmed by comparing the contents.
+ * Any other state (e.g., of a new scan) is indexed from scratch.
+ */
+typedef struct {
+    ArrayType      *state;          /* state of the previous call, or NULL */
+    ArrayType      *state_copy;     /* copy of the expected state */
+    CanopyIndex     index;
+} CanopyTransitionCache;
+
+static
+CanopyTransitionCache *
+get_canopy_transition_cache(FunctionCallInfo fcinfo, ArrayType *inState,
+    Datum *inCanopies, int inNumCanopies, KMeansMetric inMetric,
+    PGFunction inMetricFn, MemoryContext inMemContext)
+{
+    CanopyTransitionCache *cache
+        = (CanopyTransitionCache *) fcinfo->flinfo->fn_extra;
+    MemoryContext       oldContext;
+
+    if (cache != NULL && cache->index.metric == inMetric
+        && cache->index.num_canopies == inNumCanopies
+        && VARSIZE(cache->state_copy) == VARSIZE(inState)) {
+
+        if (cache->state == inState)
+            return cache;
+        if (memcmp(cache->state_copy, inState, VARSIZE(inState)) == 0) {
+            cache->state = inState;
+            return cache;
+        }
+    }
+
+    oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    if (cache == NULL)
+        cache = (CanopyTransitionCache *)
+            palloc0(sizeof(CanopyTransitionCache));
+    else {
+        pfree(cache->state_copy);
+        canopy_index_free(&cache->index);
+    }
+    fcinfo->flinfo->fn_extra = NULL;
+
+    cache->state = inState;
+    cache->state_copy = (ArrayType *) palloc(VARSIZE(inState));
+    memcpy(cache->state_copy, inState, VARSIZE(inState));
+    canopy_index_init(&cache->index, inMetric, inNumCanopies);
+    for (int i = 0; i < inNumCanopies; i++)
+        canopy_index_add(&cache->index, inMetricFn, inMemContext,
+            DatumGetSvecTypeP(inCanopies[i]));
+
+    fcinfo->flinfo->fn_extra = cache;
+    MemoryContextSwitchTo(oldContext);
+    return cache;
+}
+
+/*
+ * Detoasted centroids argument of the most recent call, cached in fn_extra
+ *
+ * As with the canopies, the same centroids are passed for every point in an
+ * assignment query. Deconstructing and detoasting them is thus only needed
+ * once per query (and segment), and not once per point.
+ */
+typedef struct {
+    ArrayType      *centroids;      /* copy of the centroids argument */
+    Datum          *centroid_datums;/* pointing into centroids */
+    SvecType      **centroid_svecs;
+    int             num_centroids;
+} CentroidsCache;
+
+static
+CentroidsCache *
+get_centroids_cache(FunctionCallInfo fcinfo, ArrayType *inCentroids)
+{
+    CentroidsCache *cache = (CentroidsCache *) fcinfo->flinfo->fn_extra;
+    MemoryContext   oldContext;
+
+    if (cache != NULL
+        && VARSIZE(cache->centroids) == VARSIZE(inCentroids)
+        && memcmp(cache->centroids, inCentroids, VARSIZE(inCentroids)) == 0)
+        return cache;
+
+    oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    if (cache == NULL)
+        cache = (CentroidsCache *) palloc0(sizeof(CentroidsCache));
+    else {
+        for (int i = 0; i < cache->num_centroids; i++)
+            if ((Pointer) cache->centroid_svecs[i]
+                != DatumGetPointer(cache->centroid_datums[i]))
+                pfree(cache->centroid_svecs[i]);
+        pfree(cache->centroid_svecs);
+        pfree(cache->centroid_datums);
+        pfree(cache->centroids);
+    }
+    fcinfo->flinfo->fn_extra = NULL;
+
+    cache->centroids = (ArrayType *) palloc(VARSIZE(inCentroids));
+    memcpy(cache->centroids, inCentroids, VARSIZE(inCentroids));
+    get_svec_array_elms(cache->centroids, &cache->centroid_datums,
+        &cache->num_centroids);
+    cache->centroid_svecs = detoast_svec_array_elms(cache->centroid_datums,
+        cache->num_centroids);
+
+    /* Only publish the cache once it is complete */
+    fcinfo->flinfo->fn_extra = cache;
+    MemoryContextSwitchTo(oldContext);
+    return cache;
+}
+
 PG_FUNCTION_INFO_V1(internal_get_array_of_close_canopies);
 Datum
 internal_get_array_of_close_canopies(PG_FUNCTION_ARGS)
 {
     SvecType       *svec;
+    ArrayType      *all_canopies_arr;
     Datum          *all_canopies;
     int             num_all_canopies;
     float8          threshold;
+    KMeansMetric    metric;
     PGFunction      metric_fn;
     
     ArrayType      *close_canopies_arr;
@@ -117,20 +680,53 @@ internal_get_array_of_close_canopies(PG_FUNCTION_ARGS)
     int             num_close_canopies;
     size_t          bytes;
     MemoryContext   mem_context_for_function_calls;
+    CloseCanopiesCache *cache;
+    float8          pivot_distances[CANOPY_INDEX_PIVOTS];
+    int             num_candidates;
+    int             i;
+    float8          distance;
     
     svec = PG_GETARG_SVECTYPE_P(verify_arg_nonnull(fcinfo, 0));
-    get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1)),
-        &all_canopies, &num_all_canopies);
+    all_canopies_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1));
     threshold = PG_GETARG_FLOAT8(verify_arg_nonnull(fcinfo, 2));
-    metric_fn = get_metric_fn(PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 3)));
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 3));
+    metric_fn = get_metric_fn(metric);
     
     mem_context_for_function_calls = setup_mem_context_for_functional_calls();
-    close_canopies = (int4 *) palloc(sizeof(int4) * num_all_canopies);
-    num_close_canopies = 0;
-    for (int i = 0; i < num_all_canopies; i++) {
-        if (compute_metric(metric_fn, mem_context_for_function_calls,
-                PointerGetDatum(svec), all_canopies[i]) < threshold)
-            close_canopies[num_close_canopies++] = i + 1 /* lower bound */;
+    if (canopy_index_supports(metric)) {
+        cache = get_close_canopies_cache(fcinfo, all_canopies_arr, metric,
+            metric_fn, mem_context_for_function_calls);
+        canopy_index_pivot_distances(&cache->index, metric_fn,
+            mem_context_for_function_calls, svec, pivot_distances);
+        num_candidates = canopy_index_candidates(&cache->index,
+            pivot_distances, threshold);
+        /* Report close canopies in the order of the canopies argument */
+        qsort(cache->index.candidates, num_candidates, sizeof(int),
+            compare_int);
+
+        close_canopies = (int4 *) palloc(sizeof(int4) * Max(num_candidates, 1));
+        num_close_canopies = 0;
+        for (int k = 0; k < num_candidates; k++) {
+            i = cache->index.candidates[k];
+            distance = i < cache->index.num_pivots
+                ? pivot_distances[i]
+                : compute_distance(metric, metric_fn,
+                    mem_context_for_function_calls, svec,
+                    DatumGetSvecTypeP(cache->canopy_datums[i]));
+            if (distance < threshold)
+                close_canopies[num_close_canopies++] = i + 1 /* lower bound */;
+        }
+    } else {
+        get_svec_array_elms(all_canopies_arr, &all_canopies,
+            &num_all_canopies);
+        close_canopies = (int4 *) palloc(sizeof(int4) * num_all_canopies);
+        num_close_canopies = 0;
+        for (i = 0; i < num_all_canopies; i++) {
+            if (compute_distance(metric, metric_fn,
+                    mem_context_for_function_calls, svec,
+                    DatumGetSvecTypeP(all_canopies[i])) < threshold)
+                close_canopies[num_close_canopies++] = i + 1 /* lower bound */;
+        }
     }
     MemoryContextDelete(mem_context_for_function_calls);
 
@@ -161,8 +757,9 @@ internal_kmeans_closest_centroid(PG_FUNCTION_ARGS) {
     ArrayType      *canopy_ids_arr = NULL;
     int4           *canopy_ids = NULL;
     ArrayType      *centroids_arr;
-    Datum          *centroids;
+    CentroidsCache *cache;
     int             num_centroids;
+    KMeansMetric    metric;
     PGFunction      metric_fn;
 
     bool            indirect;
@@ -185,16 +782,19 @@ internal_kmeans_closest_centroid(PG_FUNCTION_ARGS) {
         canopy_ids = (int4*) ARR_DATA_PTR(canopy_ids_arr);
     }
     centroids_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 2));
-    get_svec_array_elms(centroids_arr, &centroids, &num_centroids);
+    cache = get_centroids_cache(fcinfo, centroids_arr);
+    num_centroids = cache->num_centroids;
     if (!PG_ARGISNULL(1))
         num_centroids = ARR_DIMS(canopy_ids_arr)[0];
-    metric_fn = get_metric_fn(PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 3)));
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 3));
+    metric_fn = get_metric_fn(metric);
 
     mem_context_for_function_calls = setup_mem_context_for_functional_calls();
     for (int i = 0; i < num_centroids; i++) {
         cid = indirect ? canopy_ids[i] - ARR_LBOUND(canopy_ids_arr)[0] : i;
-        distance = compute_metric(metric_fn, mem_context_for_function_calls,
-            PointerGetDatum(svec), centroids[cid]);
+        distance = compute_distance(metric, metric_fn,
+            mem_context_for_function_calls, svec,
+            cache->centroid_svecs[cid]);
         if (distance < min_distance) {
             closest_centroid = cid;
             min_distance = distance;
@@ -212,30 +812,62 @@ internal_kmeans_canopy_transition(PG_FUNCTION_ARGS) {
     Datum          *canopies;
     int             num_canopies;
     SvecType       *point;
+    KMeansMetric    metric;
     PGFunction      metric_fn;
     float8          threshold;
 
     MemoryContext   mem_context_for_function_calls;
+    CanopyTransitionCache *cache = NULL;
+    float8          pivot_distances[CANOPY_INDEX_PIVOTS];
+    int             num_candidates;
+    int             i;
+    float8          distance;
+    ArrayType      *result;
+    MemoryContext   oldContext;
     
     canopies_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
     get_svec_array_elms(canopies_arr, &canopies, &num_canopies);
     point = PG_GETARG_SVECTYPE_P(verify_arg_nonnull(fcinfo, 1));
-    metric_fn = get_metric_fn(PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 2)));
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 2));
+    metric_fn = get_metric_fn(metric);
     threshold = PG_GETARG_FLOAT8(verify_arg_nonnull(fcinfo, 3));
     
     mem_context_for_function_calls = setup_mem_context_for_functional_calls();
-    for (int i = 0; i < num_canopies; i++) {
-        if (compute_metric(metric_fn, mem_context_for_function_calls,
-            PointerGetDatum(point), canopies[i]) < threshold)
-            PG_RETURN_ARRAYTYPE_P(canopies_arr);
+    if (canopy_index_supports(metric)) {
+        cache = get_canopy_transition_cache(fcinfo, canopies_arr, canopies,
+            num_canopies, metric, metric_fn, mem_context_for_function_calls);
+        canopy_index_pivot_distances(&cache->index, metric_fn,
+            mem_context_for_function_calls, point, pivot_distances);
+        num_candidates = canopy_index_candidates(&cache->index,
+            pivot_distances, threshold);
+        for (int k = 0; k < num_candidates; k++) {
+            i = cache->index.candidates[k];
+            distance = i < cache->index.num_pivots
+                ? pivot_distances[i]
+                : compute_distance(metric, metric_fn,
+                    mem_context_for_function_calls, point,
+                    DatumGetSvecTypeP(canopies[i]));
+            if (distance < threshold) {
+                MemoryContextDelete(mem_context_for_function_calls);
+                PG_RETURN_ARRAYTYPE_P(canopies_arr);
+            }
+        }
+    } else {
+        for (i = 0; i < num_canopies; i++) {
+            if (compute_distance(metric, metric_fn,
+                mem_context_for_function_calls, point,
+                DatumGetSvecTypeP(canopies[i])) < threshold) {
+
+                MemoryContextDelete(mem_context_for_function_calls);
+                PG_RETURN_ARRAYTYPE_P(canopies_arr);
+            }
+        }
     }
-    MemoryContextDelete(mem_context_for_function_calls);
     
     int idx = (ARR_NDIM(canopies_arr) == 0)
         ? 1
         : ARR_LBOUND(canopies_arr)[0] + ARR_DIMS(canopies_arr)[0];
-    return PointerGetDatum(
-        array_set(
+    result = array_set(
             canopies_arr, /* array: the initial array object (mustn't be NULL) */
             1, /* nSubscripts: number of subscripts supplied */
             &idx, /* indx[]: the subscript values */
@@ -244,8 +876,20 @@ internal_kmeans_canopy_transition(PG_FUNCTION_ARGS) {
             -1, /* arraytyplen: pg_type.typlen for the array type */
             -1, /* elmlen: pg_type.typlen for the array's element type */
             false, /* elmbyval: pg_type.typbyval for the array's element type */
-            'd') /* elmalign: pg_type.typalign for the array's element type */
-        );
+            'd'); /* elmalign: pg_type.typalign for the array's element type */
+
+    if (cache != NULL) {
+        oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+        canopy_index_add(&cache->index, metric_fn,
+            mem_context_for_function_calls, point);
+        pfree(cache->state_copy);
+        cache->state_copy = (ArrayType *) palloc(VARSIZE(result));
+        memcpy(cache->state_copy, result, VARSIZE(result));
+        cache->state = NULL;
+        MemoryContextSwitchTo(oldContext);
+    }
+    MemoryContextDelete(mem_context_for_function_calls);
+    PG_RETURN_ARRAYTYPE_P(result);
 }
 
 PG_FUNCTION_INFO_V1(internal_remove_close_canopies);
@@ -254,34 +898,85 @@ internal_remove_close_canopies(PG_FUNCTION_ARGS) {
     ArrayType      *all_canopies_arr;
     Datum          *all_canopies;
     int             num_all_canopies;
+    SvecType      **all_canopy_svecs;
+    KMeansMetric    metric;
     PGFunction      metric_fn;
     float8          threshold;
     
     Datum          *close_canopies;
+    SvecType      **close_canopy_svecs;
     int             num_close_canopies;
     bool            addIndexI;
     MemoryContext   mem_context_for_function_calls;
+    CanopyIndex     index;
+    bool           *kept;
+    float8         *pivot_distances;
+    int             num_candidates;
+    int             j;
+    float8          distance;
 
     all_canopies_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
     get_svec_array_elms(all_canopies_arr, &all_canopies, &num_all_canopies);
-    metric_fn = get_metric_fn(PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 1)));
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 1));
+    metric_fn = get_metric_fn(metric);
     threshold = PG_GETARG_FLOAT8(verify_arg_nonnull(fcinfo, 2));
     
+    /* Every canopy is compared against many others, so detoast only once */
+    all_canopy_svecs = detoast_svec_array_elms(all_canopies, num_all_canopies);
     mem_context_for_function_calls = setup_mem_context_for_functional_calls();
     close_canopies = (Datum *) palloc(sizeof(Datum) * num_all_canopies);
     num_close_canopies = 0;
-    for (int i = 0; i < num_all_canopies; i++) {
-        addIndexI = true;
-        for (int j = 0; j < num_close_canopies; j++) {
-            if (compute_metric(metric_fn, mem_context_for_function_calls,
-                all_canopies[i], close_canopies[j]) < threshold) {
-                
-                addIndexI = false;
-                break;
+    if (canopy_index_supports(metric)) {
+        /* A canopy is kept if no canopy kept before is close to it */
+        canopy_index_init(&index, metric, num_all_canopies);
+        for (int i = 0; i < num_all_canopies; i++)
+            canopy_index_add(&index, metric_fn,
+                mem_context_for_function_calls, all_canopy_svecs[i]);
+        kept = (bool *) palloc0(sizeof(bool) * num_all_canopies);
+        for (int i = 0; i < num_all_canopies; i++) {
+            pivot_distances = index.distances
+                + (size_t) i * CANOPY_INDEX_PIVOTS;
+            num_candidates = canopy_index_candidates(&index, pivot_distances,
+                threshold);
+            addIndexI = true;
+            for (int k = 0; k < num_candidates; k++) {
+                j = index.candidates[k];
+                if (!kept[j])
+                    continue;
+                distance = j < index.num_pivots
+                    ? pivot_distances[j]
+                    : compute_distance(metric, metric_fn,
+                        mem_context_for_function_calls, all_canopy_svecs[i],
+                        all_canopy_svecs[j]);
+                if (distance < threshold) {
+                    addIndexI = false;
+                    break;
+                }
+            }
+            if (addIndexI) {
+                kept[i] = true;
+                close_canopies[num_close_canopies++] = all_canopies[i];
+            }
+        }
+    } else {
+        close_canopy_svecs = (SvecType **)
+            palloc(sizeof(SvecType *) * num_all_canopies);
+        for (int i = 0; i < num_all_canopies; i++) {
+            addIndexI = true;
+            for (int j = 0; j < num_close_canopies; j++) {
+                if (compute_distance(metric, metric_fn,
+                    mem_context_for_function_calls, all_canopy_svecs[i],
+                    close_canopy_svecs[j]) < threshold) {
+                    
+                    addIndexI = false;
+                    break;
+                }
+            }
+            if (addIndexI) {
+                close_canopy_svecs[num_close_canopies] = all_canopy_svecs[i];
+                close_canopies[num_close_canopies++] = all_canopies[i];
             }
         }
-        if (addIndexI)
-            close_canopies[num_close_canopies++] = all_canopies[i];
     }
     MemoryContextDelete(mem_context_for_function_calls);
     
@@ -295,3 +990,681 @@ internal_remove_close_canopies(PG_FUNCTION_ARGS) {
             'd') /* elmalign */
         );
 }
+
+/*
+ * Bound-based pruning (Hamerly's variant of Lloyd's algorithm)
+ *
+ * For each point we keep an upper bound on the distance to its assigned
+ * centroid and a lower bound on the distance to any other centroid. When
+ * centroids move, the bounds are loosened by the distances the centroids
+ * moved. If the upper bound does not exceed the lower bound (or half of the
+ * distance between the assigned centroid and its closest other centroid), the
+ * assignment cannot have changed and no distance needs to be computed. This
+ * relies on the triangle inequality, so it must only be used with metrics.
+ */
+
+/*
+ * Half of the distance between each centroid and its closest other centroid
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_half_separations);
+Datum
+internal_kmeans_half_separations(PG_FUNCTION_ARGS) {
+    Datum          *centroids;
+    int             num_centroids;
+    SvecType      **centroid_svecs;
+    KMeansMetric    metric;
+    PGFunction      metric_fn;
+
+    float8         *half_separations;
+    float8          distance;
+    MemoryContext   mem_context_for_function_calls;
+
+    get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0)),
+        &centroids, &num_centroids);
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 1));
+    metric_fn = get_metric_fn(metric);
+
+    centroid_svecs = detoast_svec_array_elms(centroids, num_centroids);
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    half_separations = (float8 *) palloc(sizeof(float8) * num_centroids);
+    for (int i = 0; i < num_centroids; i++)
+        half_separations[i] = INFINITY;
+    for (int i = 0; i < num_centroids; i++) {
+        for (int j = i + 1; j < num_centroids; j++) {
+            distance = compute_distance(metric, metric_fn,
+                mem_context_for_function_calls, centroid_svecs[i],
+                centroid_svecs[j]);
+            if (distance < half_separations[i])
+                half_separations[i] = distance;
+            if (distance < half_separations[j])
+                half_separations[j] = distance;
+        }
+        half_separations[i] /= 2.;
+    }
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_float8_array(half_separations, num_centroids));
+}
+
+/*
+ * Distance each centroid moved from its previous position
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_centroid_shifts);
+Datum
+internal_kmeans_centroid_shifts(PG_FUNCTION_ARGS) {
+    Datum          *old_centroids;
+    int             num_old_centroids;
+    Datum          *new_centroids;
+    int             num_new_centroids;
+    KMeansMetric    metric;
+    PGFunction      metric_fn;
+
+    float8         *shifts;
+    MemoryContext   mem_context_for_function_calls;
+
+    get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0)),
+        &old_centroids, &num_old_centroids);
+    get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1)),
+        &new_centroids, &num_new_centroids);
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 2));
+    metric_fn = get_metric_fn(metric);
+
+    if (num_old_centroids != num_new_centroids)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("number of centroids changed from %d to %d",
+                num_old_centroids, num_new_centroids)));
+
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    shifts = (float8 *) palloc(sizeof(float8) * num_new_centroids);
+    for (int i = 0; i < num_new_centroids; i++)
+        shifts[i] = compute_distance(metric, metric_fn,
+            mem_context_for_function_calls,
+            DatumGetSvecTypeP(old_centroids[i]),
+            DatumGetSvecTypeP(new_centroids[i]));
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    PG_RETURN_ARRAYTYPE_P(construct_float8_array(shifts, num_new_centroids));
+}
+
+/*
+ * Given a point, its current assignment and bounds, find the closest centroid
+ *
+ * Returns the array {closest centroid, upper bound, lower bound}. If the
+ * current assignment, the bounds, or the centroid shifts are NULL, the
+ * distances to all centroids are computed.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_closest_centroid_bounded);
+Datum
+internal_kmeans_closest_centroid_bounded(PG_FUNCTION_ARGS) {
+    SvecType       *svec;
+    ArrayType      *centroids_arr;
+    Datum          *centroids;
+    int             num_centroids;
+    float8         *bounds;
+    float8         *half_separations;
+    float8         *shifts;
+    KMeansMetric    metric;
+    PGFunction      metric_fn;
+
+    bool            valid;
+    int             cid = -1;
+    float8          upper = INFINITY, lower = INFINITY;
+    float8          max_shift = 0., threshold, distance;
+    float8          result[3];
+    MemoryContext   mem_context_for_function_calls;
+
+    svec = PG_GETARG_SVECTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    centroids_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 3));
+    get_svec_array_elms(centroids_arr, &centroids, &num_centroids);
+    half_separations = get_float8_array_data(fcinfo,
+        verify_arg_nonnull(fcinfo, 4), num_centroids);
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 6));
+    metric_fn = get_metric_fn(metric);
+
+    valid = !PG_ARGISNULL(1) && !PG_ARGISNULL(2) && !PG_ARGISNULL(5);
+    if (valid) {
+        cid = PG_GETARG_INT32(1) - ARR_LBOUND(centroids_arr)[0];
+        valid = cid >= 0 && cid < num_centroids;
+    }
+
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    if (valid) {
+        bounds = get_float8_array_data(fcinfo, 2, 2);
+        shifts = get_float8_array_data(fcinfo, 5, num_centroids);
+        for (int i = 0; i < num_centroids; i++)
+            if (shifts[i] > max_shift)
+                max_shift = shifts[i];
+
+        upper = bounds[0] + shifts[cid];
+        lower = bounds[1] - max_shift;
+        threshold = Max(half_separations[cid], lower);
+        if (upper > threshold) {
+            /* Tighten the upper bound before falling back to a full scan */
+            upper = compute_distance(metric, metric_fn,
+                mem_context_for_function_calls, svec,
+                DatumGetSvecTypeP(centroids[cid]));
+            valid = upper <= threshold;
+        }
+    }
+    if (!valid) {
+        cid = 0;
+        upper = lower = INFINITY;
+        for (int i = 0; i < num_centroids; i++) {
+            distance = compute_distance(metric, metric_fn,
+                mem_context_for_function_calls, svec,
+                DatumGetSvecTypeP(centroids[i]));
+            if (distance < upper) {
+                lower = upper;
+                upper = distance;
+                cid = i;
+            } else if (distance < lower) {
+                lower = distance;
+            }
+        }
+    }
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    result[0] = cid + ARR_LBOUND(centroids_arr)[0];
+    result[1] = upper;
+    result[2] = lower;
+    PG_RETURN_ARRAYTYPE_P(construct_float8_array(result, 3));
+}
+
+/*
+ * Fused Lloyd iteration
+ *
+ * One aggregate call per iteration assigns every point to its closest
+ * centroid and accumulates, per centroid, the number of points and the sum of
+ * their coordinates. If the centroids of the previous iteration are given, the
+ * point is also assigned to those, so that the number of points that changed
+ * their cluster can be counted without storing the assignments. The state is
+ * a dense float8 array
+ *
+ *   {k, dimension, reassigned, count[1..k], sum[1..k][1..dimension]}.
+ *
+ * For the cosine and Tanimoto metrics, the points are normalized first, as
+ * the new centroid is the mean of the normalized points.
+ */
+#define KMEANS_STEP_HEADER 3
+
+static
+inline
+int
+find_closest_centroid(KMeansMetric inMetric, PGFunction inMetricFn,
+    MemoryContext inMemContext, SvecType *inPoint, Datum *inCentroids,
+    int inNumCentroids, int4 *inCanopyIDs, int inCanopyLBound)
+{
+    float8          distance, min_distance = INFINITY;
+    int             closest = 0;
+    int             cid;
+
+    for (int i = 0; i < inNumCentroids; i++) {
+        cid = inCanopyIDs ? inCanopyIDs[i] - inCanopyLBound : i;
+        distance = compute_distance(inMetric, inMetricFn, inMemContext,
+            inPoint, DatumGetSvecTypeP(inCentroids[cid]));
+        if (distance < min_distance) {
+            closest = cid;
+            min_distance = distance;
+        }
+    }
+    return closest;
+}
+
+/*
+ * Add inScale times the point to the dense array outAccum, run by run
+ */
+static
+inline
+void
+add_scaled_sdata(float8 *outAccum, SparseData inSdata, double inScale)
+{
+    char       *ix = inSdata->index->data;
+    double     *vals = (double *) inSdata->vals->data;
+    int64       pos = 0;
+    int64       run;
+    double      value;
+
+    for (int i = 0; i < inSdata->unique_value_count; i++) {
+        run = compword_to_int8(ix);
+        value = vals[i] * inScale;
+        if (value != 0.)
+            for (int64 j = pos; j < pos + run; j++)
+                outAccum[j] += value;
+        pos += run;
+        ix += int8compstoragesize(ix);
+    }
+}
+
+PG_FUNCTION_INFO_V1(internal_kmeans_step_transition);
+Datum
+internal_kmeans_step_transition(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+    SvecType       *svec;
+    SparseData      sdata;
+    ArrayType      *canopy_ids_arr = NULL;
+    int4           *canopy_ids = NULL;
+    int             canopy_lbound = 0;
+    Datum          *centroids;
+    int             num_centroids;
+    Datum          *prev_centroids;
+    int             num_prev_centroids;
+    KMeansMetric    metric;
+    PGFunction      metric_fn;
+
+    int             num_candidates;
+    int             dimension;
+    int             cid;
+    double          scale = 1.;
+    size_t          state_len;
+    MemoryContext   mem_context_for_function_calls;
+
+    if (PG_ARGISNULL(1))
+        PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+
+    svec = PG_GETARG_SVECTYPE_P(1);
+    sdata = sdata_from_svec(svec);
+    if (!PG_ARGISNULL(2)) {
+        canopy_ids_arr = PG_GETARG_ARRAYTYPE_P(2);
+        if (ARR_NDIM(canopy_ids_arr) == 0)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("internal error: array of close canopies cannot be empty")));
+        canopy_ids = (int4 *) ARR_DATA_PTR(canopy_ids_arr);
+        canopy_lbound = ARR_LBOUND(canopy_ids_arr)[0];
+    }
+    get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 3)),
+        &centroids, &num_centroids);
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 5));
+    metric_fn = get_metric_fn(metric);
+
+    if (IS_SCALAR(svec) || num_centroids == 0)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("points must be vectors and there must be at least one "
+                "centroid")));
+    dimension = svec->dimension;
+
+    if (PG_ARGISNULL(0)) {
+        state_len = KMEANS_STEP_HEADER + (size_t) num_centroids
+            * (1 + (size_t) dimension);
+        if (state_len > MaxAllocSize / sizeof(float8))
+            ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("too many centroids or dimensions for the k-means "
+                    "state")));
+        state_arr = (ArrayType *) palloc0(ARR_OVERHEAD_NONULLS(1)
+            + sizeof(float8) * state_len);
+        SET_VARSIZE(state_arr, ARR_OVERHEAD_NONULLS(1)
+            + sizeof(float8) * state_len);
+        ARR_ELEMTYPE(state_arr) = FLOAT8OID;
+        ARR_NDIM(state_arr) = 1;
+        ARR_DIMS(state_arr)[0] = (int) state_len;
+        ARR_LBOUND(state_arr)[0] = 1;
+        state = (float8 *) ARR_DATA_PTR(state_arr);
+        state[0] = num_centroids;
+        state[1] = dimension;
+    } else {
+        if (fcinfo->context && IsA(fcinfo->context, AggState))
+            state_arr = PG_GETARG_ARRAYTYPE_P(0);
+        else
+            state_arr = PG_GETARG_ARRAYTYPE_P_COPY(0);
+        state = (float8 *) ARR_DATA_PTR(state_arr);
+        if (state[0] != num_centroids || state[1] != dimension)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("input points must have the same dimensions and "
+                    "the centroids must not change during an iteration")));
+    }
+
+    num_candidates = canopy_ids ? ARR_DIMS(canopy_ids_arr)[0] : num_centroids;
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    cid = find_closest_centroid(metric, metric_fn,
+        mem_context_for_function_calls, svec, centroids, num_candidates,
+        canopy_ids, canopy_lbound);
+    if (!PG_ARGISNULL(4)) {
+        get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(4), &prev_centroids,
+            &num_prev_centroids);
+        if (num_prev_centroids != num_centroids)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("number of centroids changed from %d to %d",
+                    num_prev_centroids, num_centroids)));
+        if (find_closest_centroid(metric, metric_fn,
+                mem_context_for_function_calls, svec, prev_centroids,
+                num_candidates, canopy_ids, canopy_lbound) != cid)
+            state[2] += 1;
+    }
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    if (metric == COSINE || metric == TANIMOTO) {
+        scale = svec_l2norm_internal(svec);
+        scale = scale > 0. ? 1. / scale : 0.;
+    }
+    state[KMEANS_STEP_HEADER + cid] += 1;
+    add_scaled_sdata(state + KMEANS_STEP_HEADER + num_centroids
+        + (size_t) cid * dimension, sdata, scale);
+
+    PG_RETURN_ARRAYTYPE_P(state_arr);
+}
+
+PG_FUNCTION_INFO_V1(internal_kmeans_step_merge);
+Datum
+internal_kmeans_step_merge(PG_FUNCTION_ARGS) {
+    ArrayType      *left_arr;
+    ArrayType      *right_arr;
+    float8         *left;
+    float8         *right;
+    int             len;
+
+    if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+        PG_RETURN_NULL();
+    if (PG_ARGISNULL(0))
+        PG_RETURN_DATUM(PG_GETARG_DATUM(1));
+    if (PG_ARGISNULL(1))
+        PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+
+    if (fcinfo->context && IsA(fcinfo->context, AggState))
+        left_arr = PG_GETARG_ARRAYTYPE_P(0);
+    else
+        left_arr = PG_GETARG_ARRAYTYPE_P_COPY(0);
+    right_arr = PG_GETARG_ARRAYTYPE_P(1);
+    left = (float8 *) ARR_DATA_PTR(left_arr);
+    right = (float8 *) ARR_DATA_PTR(right_arr);
+    len = ARR_DIMS(left_arr)[0];
+
+    if (ARR_DIMS(right_arr)[0] != len || left[0] != right[0]
+        || left[1] != right[1])
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("cannot merge k-means states of different shapes")));
+
+    for (int i = 2; i < len; i++)
+        left[i] += right[i];
+
+    PG_RETURN_ARRAYTYPE_P(left_arr);
+}
+
+/*
+ * New centroids from the state of internal_kmeans_step
+ *
+ * A centroid that is not the closest centroid of any point keeps its old
+ * position.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_centroids);
+Datum
+internal_kmeans_step_centroids(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+    ArrayType      *centroids_arr;
+    Datum          *centroids;
+    int             num_centroids;
+    int             dimension;
+    float8         *sums;
+    double          count;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    centroids_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    get_svec_array_elms(centroids_arr, &centroids, &num_centroids);
+
+    state = (float8 *) ARR_DATA_PTR(state_arr);
+    if (ARR_DIMS(state_arr)[0] < KMEANS_STEP_HEADER
+        || state[0] != num_centroids)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("k-means state does not match the centroids")));
+    dimension = (int) state[1];
+
+    for (int i = 0; i < num_centroids; i++) {
+        count = state[KMEANS_STEP_HEADER + i];
+        if (count == 0)
+            continue;
+        sums = state + KMEANS_STEP_HEADER + num_centroids
+            + (size_t) i * dimension;
+        for (int j = 0; j < dimension; j++)
+            sums[j] /= count;
+        centroids[i] = PointerGetDatum(svec_from_sparsedata(
+            float8arr_to_sdata(sums, dimension), true));
+    }
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_array(
+            centroids, /* elems */
+            num_centroids, /* nelems */
+            ARR_ELEMTYPE(centroids_arr), /* elmtype */
+            -1, /* elmlen */
+            false, /* elmbyval */
+            'd') /* elmalign */
+        );
+}
+
+/*
+ * Number of points that changed their cluster, from the state of
+ * internal_kmeans_step
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_reassigned);
+Datum
+internal_kmeans_step_reassigned(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    if (ARR_DIMS(state_arr)[0] < KMEANS_STEP_HEADER)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("invalid k-means state")));
+
+    PG_RETURN_INT64((int64) ((float8 *) ARR_DATA_PTR(state_arr))[2]);
+}
+
+/*
+ * Numbers of points closest to each centroid, from the state of
+ * internal_kmeans_step
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_counts);
+Datum
+internal_kmeans_step_counts(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    state = (float8 *) ARR_DATA_PTR(state_arr);
+    if (ARR_DIMS(state_arr)[0] < KMEANS_STEP_HEADER
+        || ARR_DIMS(state_arr)[0] < KMEANS_STEP_HEADER + (int) state[0])
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("invalid k-means state")));
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_float8_array(state + KMEANS_STEP_HEADER, (int) state[0]));
+}
+
+/*
+ * Incrementally updated centroids from the state of internal_kmeans_step
+ *
+ * Centroid i with weight w_i (the discounted number of points it was computed
+ * from) moves to the weighted mean of its old position and the new points
+ * closest to it:
+ *
+ *   (decay * w_i * centroid_i + sum_i) / (decay * w_i + count_i).
+ *
+ * A centroid that is not the closest centroid of any new point keeps its old
+ * position.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_update);
+Datum
+internal_kmeans_step_update(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+    ArrayType      *centroids_arr;
+    Datum          *centroids;
+    int             num_centroids;
+    ArrayType      *weights_arr;
+    float8         *weights;
+    float8          decay;
+    SvecType       *centroid;
+    int             dimension;
+    float8         *sums;
+    double          count;
+    double          weight;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    centroids_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    weights_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 2));
+    decay = PG_GETARG_FLOAT8(verify_arg_nonnull(fcinfo, 3));
+    get_svec_array_elms(centroids_arr, &centroids, &num_centroids);
+
+    state = (float8 *) ARR_DATA_PTR(state_arr);
+    if (ARR_DIMS(state_arr)[0] < KMEANS_STEP_HEADER
+        || state[0] != num_centroids)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("k-means state does not match the centroids")));
+    if (ARR_NDIM(weights_arr) != 1 || ARR_DIMS(weights_arr)[0] != num_centroids
+        || ARR_HASNULL(weights_arr))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("there must be one weight per centroid")));
+    if (!(decay >= 0. && decay <= 1.))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("decay factor must be in [0, 1]")));
+    weights = (float8 *) ARR_DATA_PTR(weights_arr);
+    dimension = (int) state[1];
+
+    sums = (float8 *) palloc(sizeof(float8) * dimension);
+    for (int i = 0; i < num_centroids; i++) {
+        count = state[KMEANS_STEP_HEADER + i];
+        if (count == 0)
+            continue;
+        if (weights[i] < 0)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("centroid weights must not be negative")));
+        centroid = DatumGetSvecTypeP(centroids[i]);
+        if (centroid->dimension != dimension)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("centroids and points must have the same "
+                    "dimension")));
+        weight = decay * weights[i];
+        memcpy(sums, state + KMEANS_STEP_HEADER + num_centroids
+            + (size_t) i * dimension, sizeof(float8) * dimension);
+        add_scaled_sdata(sums, sdata_from_svec(centroid), weight);
+        for (int j = 0; j < dimension; j++)
+            sums[j] /= weight + count;
+        centroids[i] = PointerGetDatum(svec_from_sparsedata(
+            float8arr_to_sdata(sums, dimension), true));
+    }
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_array(
+            centroids, /* elems */
+            num_centroids, /* nelems */
+            ARR_ELEMTYPE(centroids_arr), /* elmtype */
+            -1, /* elmlen */
+            false, /* elmbyval */
+            'd') /* elmalign */
+        );
+}
+
+#undef KMEANS_STEP_HEADER
+
+/*
+ * Choose centroids among weighted candidates using kmeans++
+ *
+ * This is the last step of k-means|| seeding: candidates were oversampled in
+ * parallel, and each candidate is weighted by the number of points closest to
+ * it. The next centroid is chosen with probability proportional to the weight
+ * times the squared distance to the closest centroid chosen so far. Fewer
+ * than k centroids are returned if all remaining candidates coincide with
+ * chosen centroids.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_plusplus_weighted);
+Datum
+internal_kmeans_plusplus_weighted(PG_FUNCTION_ARGS) {
+    ArrayType      *candidates_arr;
+    Datum          *candidates;
+    int             num_candidates;
+    SvecType      **candidate_svecs;
+    float8         *weights;
+    int             k;
+    KMeansMetric    metric;
+    PGFunction      metric_fn;
+
+    Datum          *centroids;
+    int             num_centroids = 0;
+    float8         *min_sq_distances;
+    float8          total, target, distance, score;
+    int             next;
+    MemoryContext   mem_context_for_function_calls;
+
+    candidates_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    get_svec_array_elms(candidates_arr, &candidates, &num_candidates);
+    weights = get_float8_array_data(fcinfo, verify_arg_nonnull(fcinfo, 1),
+        num_candidates);
+    k = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 2));
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 3));
+    metric_fn = get_metric_fn(metric);
+
+    if (k <= 0)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("number of centroids must be positive")));
+
+    candidate_svecs = detoast_svec_array_elms(candidates, num_candidates);
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    centroids = (Datum *) palloc(sizeof(Datum) * Min(k, num_candidates));
+    min_sq_distances = (float8 *) palloc(sizeof(float8) * num_candidates);
+    for (int i = 0; i < num_candidates; i++)
+        min_sq_distances[i] = INFINITY;
+
+/* The first centroid is chosen with probability proportional to the weight */
+#define KMEANS_PLUSPLUS_SCORE(i) \
+    (num_centroids == 0 ? weights[i] : weights[i] * min_sq_distances[i])
+
+    while (num_centroids < k) {
+        total = 0.;
+        for (int i = 0; i < num_candidates; i++)
+            total += KMEANS_PLUSPLUS_SCORE(i);
+        if (!(total > 0.))
+            break;
+
+        target = total * ((double) random() / ((double) MAX_RANDOM_VALUE + 1.));
+        next = -1;
+        for (int i = 0; i < num_candidates; i++) {
+            score = KMEANS_PLUSPLUS_SCORE(i);
+            if (score <= 0.)
+                continue;
+            next = i;
+            target -= score;
+            if (target < 0.)
+                break;
+        }
+        centroids[num_centroids++] = candidates[next];
+
+        min_sq_distances[next] = 0.;
+        for (int i = 0; i < num_candidates; i++) {
+            if (min_sq_distances[i] <= 0.)
+                continue;
+            distance = compute_distance(metric, metric_fn,
+                mem_context_for_function_calls, candidate_svecs[i],
+                candidate_svecs[next]);
+            if (distance * distance < min_sq_distances[i])
+                min_sq_distances[i] = distance * distance;
+        }
+    }
+#undef KMEANS_PLUSPLUS_SCORE
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_array(
+            centroids, /* elems */
+            num_centroids, /* nelems */
+            ARR_ELEMTYPE(candidates_arr), /* elmtype */
+            -1, /* elmlen */
+            false, /* elmbyval */
+            'd') /* elmalign */
+        );
+}
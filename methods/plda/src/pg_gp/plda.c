@@ -29,10 +29,15 @@ PG_MODULE_MAGIC;
 #endif
 /* Indicate "version 1" calling conventions for all exported functions. */
 PG_FUNCTION_INFO_V1(sampleNewTopics);
+PG_FUNCTION_INFO_V1(sampleNewTopicsLocal);
+PG_FUNCTION_INFO_V1(labelDocument);
 PG_FUNCTION_INFO_V1(randomTopics);
 PG_FUNCTION_INFO_V1(zero_array);
 PG_FUNCTION_INFO_V1(sum_int4array);
 PG_FUNCTION_INFO_V1(cword_count);
+PG_FUNCTION_INFO_V1(cword_delta);
+PG_FUNCTION_INFO_V1(cword_delta_merge);
+PG_FUNCTION_INFO_V1(apply_cword_delta);
 
 /**
  * Returns an array of a given length filled with zeros
@@ -174,73 +179,468 @@ Datum cword_count(PG_FUNCTION_ARGS)
 	PG_RETURN_ARRAYTYPE_P(count_arr);
 }
 
+/**
+ * Word-topic count deltas are int4 arrays holding the number n of changes,
+ * followed by n pairs of a (0-indexed) position in the word-topic count array
+ * and the change of the count at this position. The array may have room for
+ * more pairs.
+ */
+static ArrayType * cword_delta_reserve(ArrayType * delta_arr, int32 num_changes)
+{
+	int32 capacity = (ARR_DIMS(delta_arr)[0] - 1) / 2;
+	int32 used = ((int32 *)ARR_DATA_PTR(delta_arr))[0];
+	ArrayType * ret;
+	Datum * array;
+
+	if (used + num_changes <= capacity)
+		return delta_arr;
+
+	// grow geometrically, so that appending is amortised constant time
+	capacity = Max(2 * capacity, used + num_changes);
+	array = palloc0((1 + 2 * capacity) * sizeof(Datum));
+	ret = construct_array(array, 1 + 2 * capacity, INT4OID, 4, true, 'i');
+	pfree(array);
+	memcpy(ARR_DATA_PTR(ret), ARR_DATA_PTR(delta_arr),
+	       (1 + 2 * used) * sizeof(int32));
+	return ret;
+}
+
+/**
+ * This function appends the changes of the word-topic counts caused by moving
+ * the words of a document from their old topics to their new topics. Only the
+ * words whose topic changed contribute, so the size of the result is
+ * proportional to the churn of the topic assignments instead of the size of
+ * the word-topic count array.
+ *
+ * Note: The function modifies the input delta array, and can only be used as
+ * part of the plda_cword_delta_agg() function.
+ */
+Datum cword_delta(PG_FUNCTION_ARGS);
+Datum cword_delta(PG_FUNCTION_ARGS)
+{
+	ArrayType * delta_arr, * doc_arr, * old_topics_arr, * new_topics_arr;
+	int32 * delta, * doc, * old_topics, * new_topics;
+	int32 doclen, num_topics, dsize, num_changes, i, n;
+
+	if (!(fcinfo->context && IsA(fcinfo->context, AggState)))
+		elog(ERROR, "cword_delta not used as part of an aggregate");
+
+	if (PG_ARGISNULL(1) || PG_ARGISNULL(2) || PG_ARGISNULL(3) ||
+	    PG_ARGISNULL(4) || PG_ARGISNULL(5))
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("transition function \"%s\" called with NULL arguments",
+			  format_procedure(fcinfo->flinfo->fn_oid))));
+
+	doc_arr = PG_GETARG_ARRAYTYPE_P(1);
+	old_topics_arr = PG_GETARG_ARRAYTYPE_P(2);
+	new_topics_arr = PG_GETARG_ARRAYTYPE_P(3);
+	num_topics = PG_GETARG_INT32(4);
+	dsize = PG_GETARG_INT32(5);
+
+	/* Check that the input arrays are of the right dimension and type */
+	if (ARR_NDIM(doc_arr) != 1 || ARR_ELEMTYPE(doc_arr) != INT4OID ||
+	    ARR_NDIM(old_topics_arr) != 1 ||
+	    ARR_ELEMTYPE(old_topics_arr) != INT4OID ||
+	    ARR_NDIM(new_topics_arr) != 1 ||
+	    ARR_ELEMTYPE(new_topics_arr) != INT4OID ||
+	    ARR_DIMS(old_topics_arr)[0] != ARR_DIMS(doc_arr)[0] ||
+	    ARR_DIMS(new_topics_arr)[0] != ARR_DIMS(doc_arr)[0])
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("transition function \"%s\" called with invalid parameters",
+			  format_procedure(fcinfo->flinfo->fn_oid))));
+
+	doc = (int32 *)ARR_DATA_PTR(doc_arr);
+	old_topics = (int32 *)ARR_DATA_PTR(old_topics_arr);
+	new_topics = (int32 *)ARR_DATA_PTR(new_topics_arr);
+	doclen = ARR_DIMS(doc_arr)[0];
+
+	num_changes = 0;
+	for (i=0; i!=doclen; i++)
+		if (old_topics[i] != new_topics[i])
+			num_changes += 2;
+
+	/* Construct an empty delta array at the first call of this function */
+	if (PG_ARGISNULL(0)) {
+		Datum * array = palloc0((1 + 2 * num_changes) * sizeof(Datum));
+		delta_arr = construct_array(array, 1 + 2 * num_changes, INT4OID, 4,
+					    true, 'i');
+	} else {
+		delta_arr = PG_GETARG_ARRAYTYPE_P(0);
+	}
+	delta_arr = cword_delta_reserve(delta_arr, num_changes);
+	delta = (int32 *)ARR_DATA_PTR(delta_arr);
+	n = delta[0];
+
+	for (i=0; i!=doclen; i++) {
+		if (old_topics[i] == new_topics[i])
+			continue;
+		if (doc[i] < 1 || doc[i] > dsize ||
+		    old_topics[i] < 1 || old_topics[i] > num_topics ||
+		    new_topics[i] < 1 || new_topics[i] > num_topics)
+			ereport
+			 (ERROR,
+			  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			   errmsg("function \"%s\" called with invalid parameters",
+				  format_procedure(fcinfo->flinfo->fn_oid))));
+
+		delta[1 + 2 * n] = (doc[i]-1) * num_topics + (old_topics[i]-1);
+		delta[2 + 2 * n] = -1;
+		n++;
+		delta[1 + 2 * n] = (doc[i]-1) * num_topics + (new_topics[i]-1);
+		delta[2 + 2 * n] = 1;
+		n++;
+	}
+	delta[0] = n;
+
+	PG_RETURN_ARRAYTYPE_P(delta_arr);
+}
+
+/**
+ * Returns the concatenation of two word-topic count delta arrays.
+ *
+ * Either argument can be NULL.
+ */
+Datum cword_delta_merge(PG_FUNCTION_ARGS);
+Datum cword_delta_merge(PG_FUNCTION_ARGS)
+{
+	ArrayType * delta0_arr, * delta1_arr;
+	int32 * delta1;
+
+	if (PG_ARGISNULL(0)) {
+		if (PG_ARGISNULL(1))
+			PG_RETURN_NULL();
+		PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(1));
+	}
+	delta0_arr = PG_GETARG_ARRAYTYPE_P(0);
+	if (PG_ARGISNULL(1))
+		PG_RETURN_ARRAYTYPE_P(delta0_arr);
+	delta1_arr = PG_GETARG_ARRAYTYPE_P(1);
+
+	if (ARR_NDIM(delta0_arr) != 1 || ARR_ELEMTYPE(delta0_arr) != INT4OID ||
+	    ARR_NDIM(delta1_arr) != 1 || ARR_ELEMTYPE(delta1_arr) != INT4OID)
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with invalid parameters",
+			  format_procedure(fcinfo->flinfo->fn_oid))));
+
+	delta1 = (int32 *)ARR_DATA_PTR(delta1_arr);
+	delta0_arr = cword_delta_reserve(delta0_arr, delta1[0]);
+	int32 * delta0 = (int32 *)ARR_DATA_PTR(delta0_arr);
+	memcpy(delta0 + 1 + 2 * delta0[0], delta1 + 1,
+	       2 * delta1[0] * sizeof(int32));
+	delta0[0] += delta1[0];
+
+	PG_RETURN_ARRAYTYPE_P(delta0_arr);
+}
+
+/**
+ * Returns the word-topic count array (first argument) with the changes of a
+ * word-topic count delta array (second argument) applied.
+ *
+ * The second argument can be NULL, meaning no changes; the first can't.
+ */
+Datum apply_cword_delta(PG_FUNCTION_ARGS);
+Datum apply_cword_delta(PG_FUNCTION_ARGS)
+{
+	ArrayType * count_arr, * delta_arr, * ret;
+	int32 * count, * delta;
+	int32 size, i, idx;
+
+	if (PG_ARGISNULL(0))
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with NULL first argument",
+			  format_procedure(fcinfo->flinfo->fn_oid))));
+
+	count_arr = PG_GETARG_ARRAYTYPE_P(0);
+	if (ARR_NDIM(count_arr) != 1 || ARR_ELEMTYPE(count_arr) != INT4OID)
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with invalid parameters",
+			  format_procedure(fcinfo->flinfo->fn_oid))));
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_ARRAYTYPE_P(count_arr);
+
+	delta_arr = PG_GETARG_ARRAYTYPE_P(1);
+	if (ARR_NDIM(delta_arr) != 1 || ARR_ELEMTYPE(delta_arr) != INT4OID)
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with invalid parameters",
+			  format_procedure(fcinfo->flinfo->fn_oid))));
+
+	/* Copy the counts; this is a single memcpy instead of an aggregation */
+	ret = DatumGetArrayTypePCopy(PG_GETARG_DATUM(0));
+	count = (int32 *)ARR_DATA_PTR(ret);
+	size = ARR_DIMS(ret)[0];
+	delta = (int32 *)ARR_DATA_PTR(delta_arr);
+
+	for (i=0; i!=delta[0]; i++) {
+		idx = delta[1 + 2 * i];
+		if (idx < 0 || idx >= size)
+			ereport
+			 (ERROR,
+			  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			   errmsg("function \"%s\" called with invalid parameters",
+				  format_procedure(fcinfo->flinfo->fn_oid))));
+		count[idx] += delta[2 + 2 * i];
+	}
+	PG_RETURN_ARRAYTYPE_P(ret);
+}
+
+/**
+ * The per-document part of the topic distribution used by sampleTopic().
+ *
+ * The unnormalised probability of topic j for a word w in document d is
+ *
+ *   (n_dj + alpha) (n_wj + eta) / (n_j + K eta)
+ *     = alpha eta / (n_j + K eta)             (smoothing bucket)
+ *     + n_dj eta / (n_j + K eta)              (document bucket)
+ *     + (n_dj + alpha) n_wj / (n_j + K eta)   (word bucket)
+ *
+ * (Yao, Mimno and McCallum, Efficient Methods for Topic Model Inference on
+ * Streaming Document Collections, KDD 2009). Within a call of sampleNewTopics,
+ * the counts do not change, so the first two buckets and the coefficients
+ * (n_dj + alpha) / (n_j + K eta) of the word bucket are computed once per
+ * document. The smoothing bucket is sampled with a Walker alias table, the
+ * document bucket from the k_d topics of the document, and the word bucket
+ * from the topics the word is assigned to in the corpus. These buckets are
+ * small for most words, so that the dense cumulative distribution over all K
+ * topics is no longer built for every word.
+ */
+typedef struct {
+	int32 numtopics;
+	float8 alpha;
+	float8 eta;
+	// 1 / (n_j + K eta)
+	float8 * inv_topic_counts;
+	// (n_dj + alpha) / (n_j + K eta)
+	float8 * word_coefs;
+	// smoothing bucket: total mass and alias table
+	float8 smooth_mass;
+	float8 * alias_prob;
+	int32 * alias;
+	// document bucket: total mass and the topics (0-indexed) of the document
+	float8 doc_mass;
+	int32 num_doc_topics;
+	int32 * doc_topics;
+} plda_doc_sampler;
+
+/**
+ * This function builds the Walker alias table (Vose's method) for the
+ * distribution proportional to the numtopics nonnegative weights.
+ */
+static void build_alias_table
+   (int32 numtopics, const float8 * weights, float8 total,
+    float8 * prob, int32 * alias)
+{
+	int32 j, nsmall = 0, nlarge = 0;
+	int32 * small = (int32 *)palloc(sizeof(int32) * numtopics);
+	int32 * large = (int32 *)palloc(sizeof(int32) * numtopics);
+
+	for (j=0; j!=numtopics; j++) {
+		prob[j] = weights[j] * numtopics / total;
+		alias[j] = j;
+		if (prob[j] < 1.0)
+			small[nsmall++] = j;
+		else
+			large[nlarge++] = j;
+	}
+	while (nsmall > 0 && nlarge > 0) {
+		int32 l = small[--nsmall];
+		int32 g = large[--nlarge];
+		alias[l] = g;
+		prob[g] = (prob[g] + prob[l]) - 1.0;
+		if (prob[g] < 1.0)
+			small[nsmall++] = g;
+		else
+			large[nlarge++] = g;
+	}
+	// what is left has probability 1, up to rounding
+	while (nlarge > 0)
+		prob[large[--nlarge]] = 1.0;
+	while (nsmall > 0)
+		prob[small[--nsmall]] = 1.0;
+
+	pfree(small);
+	pfree(large);
+}
+
+/**
+ * This function sets up the sampler for a document.
+ *
+ * Parameters
+ *  @param sampler the sampler to set up
+ *  @param numtopics number of topics
+ *  @param local_d the distribution of topics in the current document
+ *  @param topic_counts the distribution of number of words in the corpus assigned to each topic
+ *  @param alpha the Dirichlet parameter for the topic multinomial
+ *  @param eta the Dirichlet parameter for the per-topic word multinomial
+ */
+static void initDocSampler
+   (plda_doc_sampler * sampler, int32 numtopics, int32 * local_d,
+    int32 * topic_counts, float8 alpha, float8 eta)
+{
+	int32 j;
+	float8 * smooth = (float8 *)palloc(sizeof(float8) * numtopics);
+
+	sampler->numtopics = numtopics;
+	sampler->alpha = alpha;
+	sampler->eta = eta;
+	sampler->inv_topic_counts = (float8 *)palloc(sizeof(float8) * numtopics);
+	sampler->word_coefs = (float8 *)palloc(sizeof(float8) * numtopics);
+	sampler->alias_prob = (float8 *)palloc(sizeof(float8) * numtopics);
+	sampler->alias = (int32 *)palloc(sizeof(int32) * numtopics);
+	sampler->doc_topics = (int32 *)palloc(sizeof(int32) * numtopics);
+
+	sampler->smooth_mass = 0;
+	sampler->doc_mass = 0;
+	sampler->num_doc_topics = 0;
+	for (j=0; j!=numtopics; j++) {
+		float8 inv = 1.0 / (topic_counts[j] + numtopics * eta);
+		sampler->inv_topic_counts[j] = inv;
+		sampler->word_coefs[j] = (local_d[j] + alpha) * inv;
+		smooth[j] = alpha * eta * inv;
+		sampler->smooth_mass += smooth[j];
+		if (local_d[j] != 0) {
+			sampler->doc_topics[sampler->num_doc_topics++] = j;
+			sampler->doc_mass += local_d[j] * eta * inv;
+		}
+	}
+	build_alias_table(numtopics, smooth, sampler->smooth_mass,
+			  sampler->alias_prob, sampler->alias);
+	pfree(smooth);
+}
+
+/**
+ * This function frees the arrays allocated by initDocSampler().
+ */
+static void freeDocSampler(plda_doc_sampler * sampler)
+{
+	pfree(sampler->inv_topic_counts);
+	pfree(sampler->word_coefs);
+	pfree(sampler->alias_prob);
+	pfree(sampler->alias);
+	pfree(sampler->doc_topics);
+}
+
 /**
  * This function samples a new topic for a given word based on count statistics
  * computed on the rest of the corpus. This is the core function in the Gibbs
  * sampling inference algorithm for LDA. 
  * 
  * Parameters
- *  @param numtopics number of topics
+ *  @param sampler the sampler of the current document (see initDocSampler())
  *  @param widx the index of the current word whose topic is to be sampled
  *  @param wtopic the current assigned topic of the word
  *  @param global_count the word-topic count matrix
  *  @param local_d the distribution of topics in the current document
- *  @param topic_counts the distribution of number of words in the corpus assigned to each topic
- *  @param alpha the Dirichlet parameter for the topic multinomial
- *  @param eta the Dirichlet parameter for the per-topic word multinomial
+ *
+ * The counts are adjusted to exclude the current word's contribution. Since
+ * this only changes the probability of wtopic, wtopic is taken out of the
+ * three buckets and gets an exact bucket of its own.
  *
  * The function is non-destructive to all the input arguments.
  */
 static int32 sampleTopic
-   (int32 numtopics, int32 widx, int32 wtopic, int32 * global_count,
-    int32 * local_d, int32 * topic_counts, float8 alpha, float8 eta) 
+   (const plda_doc_sampler * sampler, int32 widx, int32 wtopic,
+    int32 * global_count, int32 * local_d) 
 {
-	int32 j, glcount_temp, locald_temp, ret;
-	float8 r, cl_prob, total_unpr;
-
-	// this array captures the cumulative prob. distribution of the topics
-	float8 * topic_prs = (float8 *)palloc(sizeof(float8) * numtopics); 
+	int32 j, t, numtopics = sampler->numtopics;
+	float8 r, wtopic_mass, smooth_mass, doc_mass, word_mass;
+	int32 * word_count;
 
 	/* make adjustment for 0-indexing */
 	widx--;
 	wtopic--;
 
-	/* calculate topic (unnormalised) probabilities */
-	total_unpr = 0;
-	for (j=0; j!=numtopics; j++) {
-		// number of times widx is assigned topic j in the corpus
-		glcount_temp = global_count[widx * numtopics + j];
-		// number of times a word is assigned topic j in this document
-		locald_temp = local_d[j];
-		// adjust the counts to exclude current word's contribution
-		if (j == wtopic) {
-			glcount_temp--;
-			locald_temp--;
-		}
-		// the topic probability for current word, proportional to 
-		//   fraction of times word is assigned topic j
-		// x fraction of times a word is assigned topic j in current doc
-		cl_prob = (locald_temp + alpha) * (glcount_temp + eta) /
-			  (topic_counts[j] + numtopics * eta);
-		total_unpr += cl_prob;
-		topic_prs[j] = total_unpr;
-	}
-	/* normalise probabilities */
+	if (wtopic < 0 || wtopic >= numtopics)
+		elog(ERROR, "sampleTopic: wtopic = %d", wtopic + 1);
+	if (numtopics == 1)
+		return 1;
+
+	word_count = global_count + widx * numtopics;
+
+	/* the exact probability of the current topic */
+	wtopic_mass = (local_d[wtopic] - 1 + sampler->alpha)
+		* (word_count[wtopic] - 1 + sampler->eta)
+		* sampler->inv_topic_counts[wtopic];
+	if (wtopic_mass < 0)
+		wtopic_mass = 0;
+
+	/* the buckets, without the current topic */
+	smooth_mass = sampler->smooth_mass - sampler->alpha * sampler->eta
+		* sampler->inv_topic_counts[wtopic];
+	if (smooth_mass < 0)
+		smooth_mass = 0;
+	doc_mass = sampler->doc_mass - local_d[wtopic] * sampler->eta
+		* sampler->inv_topic_counts[wtopic];
+	if (doc_mass < 0)
+		doc_mass = 0;
+	word_mass = 0;
 	for (j=0; j!=numtopics; j++)
-		topic_prs[j] = topic_prs[j] / total_unpr;
+		if (word_count[j] != 0 && j != wtopic)
+			word_mass += sampler->word_coefs[j] * word_count[j];
 
 	/* Draw a topic at random */
-	r = drand48();
-	ret = 1;
+	r = drand48() * (wtopic_mass + smooth_mass + doc_mass + word_mass);
+
+	if (r < wtopic_mass)
+		return wtopic + 1;
+	r -= wtopic_mass;
+
+	if (r < word_mass) {
+		for (j=0; j!=numtopics; j++) {
+			if (word_count[j] == 0 || j == wtopic)
+				continue;
+			r -= sampler->word_coefs[j] * word_count[j];
+			if (r < 0)
+				return j + 1;
+		}
+		// rounding: fall through to the document bucket
+		r = 0;
+	} else {
+		r -= word_mass;
+	}
+
+	if (r < doc_mass) {
+		int32 last = -1;
+		for (j=0; j!=sampler->num_doc_topics; j++) {
+			t = sampler->doc_topics[j];
+			if (t == wtopic)
+				continue;
+			last = t;
+			r -= local_d[t] * sampler->eta * sampler->inv_topic_counts[t];
+			if (r < 0)
+				return t + 1;
+		}
+		if (last >= 0)
+			return last + 1;
+	}
+
+	/* smoothing bucket: alias draws, rejecting the current topic */
 	while (true) {
-		if (ret == numtopics || r < topic_prs[ret-1]) break;
-		ret++; 
+		float8 u = drand48() * numtopics;
+		t = (int32) u;
+		if (t >= numtopics)
+			t = numtopics - 1;
+		if (u - t >= sampler->alias_prob[t])
+			t = sampler->alias[t];
+		if (t != wtopic)
+			break;
 	}
-	if (ret < 1 || ret > numtopics)
-		elog(ERROR, "sampleTopic: ret = %d", ret);
+	if (t < 0 || t >= numtopics)
+		elog(ERROR, "sampleTopic: ret = %d", t + 1);
 
-	pfree(topic_prs);
-	return ret;
+	return t + 1;
 }
 
 
@@ -286,6 +686,67 @@ static void check_array_sampleNewTopics
 	}
 }
 
+/**
+ * The global word-topic counts and topic counts of one iteration, cached in
+ * fn_extra of sampleNewTopics. The counts are the same for all documents of an
+ * iteration, but as a toasted argument they would be detoasted (decompressed
+ * and copied) once per document.
+ *
+ * sampleNewTopicsLocal updates the cached counts with the topics it samples,
+ * so that they are the counts of the segment (see there).
+ */
+typedef struct {
+	int32 iternum;
+	int32 size;
+	int32 * global_count;
+	int32 num_topic_counts;
+	int32 * topic_counts;
+} plda_global_count_cache;
+
+/**
+ * This function returns the cached global word-topic counts (argument 3) and
+ * topic counts (argument 4) of the given iteration, detoasting and copying
+ * them only at the first call for the iteration.
+ */
+static plda_global_count_cache * getGlobalCount
+   (FunctionCallInfo fcinfo, int32 iternum)
+{
+	plda_global_count_cache * cache =
+		(plda_global_count_cache *)fcinfo->flinfo->fn_extra;
+
+	if (cache != NULL && cache->iternum == iternum)
+		return cache;
+
+	ArrayType * global_count_arr = PG_GETARG_ARRAYTYPE_P(3);
+	check_array_sampleNewTopics(global_count_arr, fcinfo->flinfo->fn_oid,
+				    "global count array");
+	int32 size = ARR_DIMS(global_count_arr)[0];
+	ArrayType * topic_counts_arr = PG_GETARG_ARRAYTYPE_P(4);
+	int32 num_topic_counts = ARR_DIMS(topic_counts_arr)[0];
+
+	if (cache == NULL) {
+		cache = (plda_global_count_cache *)MemoryContextAlloc(
+			fcinfo->flinfo->fn_mcxt, sizeof(plda_global_count_cache));
+	} else {
+		pfree(cache->global_count);
+		pfree(cache->topic_counts);
+	}
+	cache->global_count = (int32 *)MemoryContextAlloc(
+		fcinfo->flinfo->fn_mcxt, sizeof(int32) * size);
+	memcpy(cache->global_count, ARR_DATA_PTR(global_count_arr),
+	       sizeof(int32) * size);
+	cache->size = size;
+	cache->topic_counts = (int32 *)MemoryContextAlloc(
+		fcinfo->flinfo->fn_mcxt, sizeof(int32) * num_topic_counts);
+	memcpy(cache->topic_counts, ARR_DATA_PTR(topic_counts_arr),
+	       sizeof(int32) * num_topic_counts);
+	cache->num_topic_counts = num_topic_counts;
+	cache->iternum = iternum;
+	fcinfo->flinfo->fn_extra = cache;
+
+	return cache;
+}
+
 /**
  * This function assigns a topic to each word in a document using the count
  * statistics obtained so far on the corpus. The function returns an array
@@ -293,6 +754,10 @@ static void check_array_sampleNewTopics
  * word in the document (the first len elements in the returned array), and
  * the number of words assigned to each topic (the last num_topics elements
  * of the returned array).
+ *
+ * If called with a tenth argument, the iteration number, the global
+ * word-topic counts are only read at the first call of each iteration (see
+ * getGlobalCount()).
  */
 Datum sampleNewTopics(PG_FUNCTION_ARGS);
 Datum sampleNewTopics(PG_FUNCTION_ARGS)
@@ -302,7 +767,6 @@ Datum sampleNewTopics(PG_FUNCTION_ARGS)
 	ArrayType * doc_arr = PG_GETARG_ARRAYTYPE_P(0);
 	ArrayType * topics_arr = PG_GETARG_ARRAYTYPE_P(1);
 	ArrayType * topic_d_arr = PG_GETARG_ARRAYTYPE_P(2);
-	ArrayType * global_count_arr = PG_GETARG_ARRAYTYPE_P(3);
 	ArrayType * topic_counts_arr = PG_GETARG_ARRAYTYPE_P(4);
 	int32 num_topics = PG_GETARG_INT32(5);
 	int32 dsize = PG_GETARG_INT32(6);
@@ -313,7 +777,6 @@ Datum sampleNewTopics(PG_FUNCTION_ARGS)
 	check_array_sampleNewTopics(doc_arr, fn_oid, "document array");
 	check_array_sampleNewTopics(topics_arr, fn_oid, "topic array");
 	check_array_sampleNewTopics(topic_d_arr, fn_oid, "topic distribution array");
-	check_array_sampleNewTopics(global_count_arr, fn_oid, "global count array");
 	check_array_sampleNewTopics(topic_counts_arr, fn_oid, "topic count array");
 
 	// the document array
@@ -327,7 +790,16 @@ Datum sampleNewTopics(PG_FUNCTION_ARGS)
 	int32 * topic_d = (int32 *)ARR_DATA_PTR(topic_d_arr);
 
 	// the word-topic count matrix
-	int32 * global_count = (int32 *)ARR_DATA_PTR(global_count_arr);
+	int32 * global_count;
+	if (PG_NARGS() > 9) {
+		global_count = getGlobalCount(fcinfo, PG_GETARG_INT32(9))
+			->global_count;
+	} else {
+		ArrayType * global_count_arr = PG_GETARG_ARRAYTYPE_P(3);
+		check_array_sampleNewTopics(global_count_arr, fn_oid,
+					    "global count array");
+		global_count = (int32 *)ARR_DATA_PTR(global_count_arr);
+	}
 
 	// total number of words assigned to each topic in the whole corpus
 	int32 * topic_counts = (int32 *)ARR_DATA_PTR(topic_counts_arr);
@@ -343,6 +815,9 @@ Datum sampleNewTopics(PG_FUNCTION_ARGS)
 	ret_topic_d_arr = construct_array(arr2,num_topics,INT4OID,4,true,'i');
 	ret_topic_d = (int32 *)ARR_DATA_PTR(ret_topic_d_arr);
 
+	plda_doc_sampler sampler;
+	initDocSampler(&sampler,num_topics,topic_d,topic_counts,alpha,eta);
+
 	for (i=0; i!=len; i++) {
 		widx = doc[i];
 
@@ -356,8 +831,7 @@ Datum sampleNewTopics(PG_FUNCTION_ARGS)
 			       format_procedure(fcinfo->flinfo->fn_oid), widx, dsize)));
 
 		wtopic = topics[i];
-		rtopic = sampleTopic(num_topics,widx,wtopic,global_count,
-				     topic_d,topic_counts,alpha,eta);
+		rtopic = sampleTopic(&sampler,widx,wtopic,global_count,topic_d);
 
 		// <sampleNewTopics error checking> 
 
@@ -388,6 +862,364 @@ Datum sampleNewTopics(PG_FUNCTION_ARGS)
 
 	PG_RETURN_DATUM(HeapTupleGetDatum(ret));
 }
+
+/**
+ * This function resamples the topics of all words of a document num_sweeps
+ * times. After every sweep, the changes of the topics are applied to count
+ * and topic_counts, which must include the current topics of the document.
+ *
+ * Parameters
+ *  @param doc the words of the document
+ *  @param len the length of the document
+ *  @param topics the current topics of the words, updated by each sweep
+ *  @param topic_d the distribution of topics in the document, updated by each sweep
+ *  @param count the word-topic count matrix
+ *  @param topic_counts the number of words assigned to each topic
+ *  @param ret_topics the topics of the last sweep
+ *  @param ret_topic_d the distribution of topics of the last sweep
+ */
+static void sampleSweeps
+   (int32 * doc, int32 len, int32 * topics, int32 * topic_d, int32 * count,
+    int32 * topic_counts, int32 num_topics, float8 alpha, float8 eta,
+    int32 num_sweeps, int32 * ret_topics, int32 * ret_topic_d)
+{
+	int32 i, s, widx, wtopic, rtopic;
+	plda_doc_sampler sampler;
+
+	for (s=0; s!=num_sweeps; s++) {
+		initDocSampler(&sampler,num_topics,topic_d,topic_counts,alpha,eta);
+		memset(ret_topic_d, 0, sizeof(int32) * num_topics);
+
+		for (i=0; i!=len; i++) {
+			rtopic = sampleTopic(&sampler,doc[i],topics[i],count,topic_d);
+			ret_topics[i] = rtopic;
+			ret_topic_d[rtopic-1]++;
+		}
+		freeDocSampler(&sampler);
+
+		// apply the changes of this sweep to the counts
+		for (i=0; i!=len; i++) {
+			wtopic = topics[i];
+			rtopic = ret_topics[i];
+			if (rtopic == wtopic)
+				continue;
+			widx = doc[i] - 1;
+			count[widx * num_topics + wtopic - 1]--;
+			count[widx * num_topics + rtopic - 1]++;
+			topic_counts[wtopic - 1]--;
+			topic_counts[rtopic - 1]++;
+			topics[i] = rtopic;
+		}
+		memcpy(topic_d, ret_topic_d, sizeof(int32) * num_topics);
+	}
+}
+
+/**
+ * This function is the AD-LDA (approximate distributed LDA, Newman et al.,
+ * Distributed Algorithms for Topic Models, JMLR 2009) variant of
+ * sampleNewTopics. Its arguments are those of sampleNewTopics with the
+ * iteration number, plus the number of sweeps (argument 10).
+ *
+ * At the first call of an iteration, the global word-topic counts and topic
+ * counts are copied as in getGlobalCount(). Each segment then samples against
+ * its own copy of the counts: the topic of every word of the document is
+ * resampled num_sweeps times, and after every sweep the changes of the topics
+ * are applied to the copy, so that later sweeps and documents of the same
+ * segment see them. The counts of the other segments are stale until the
+ * global counts are reconciled from the deltas of all segments (with
+ * plda_cword_delta_agg) before the next iteration. Each iteration thus does
+ * num_sweeps Gibbs sweeps with a single rewrite of the topic assignments.
+ */
+Datum sampleNewTopicsLocal(PG_FUNCTION_ARGS);
+Datum sampleNewTopicsLocal(PG_FUNCTION_ARGS)
+{
+	int32 i, widx;
+
+	ArrayType * doc_arr = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType * topics_arr = PG_GETARG_ARRAYTYPE_P(1);
+	ArrayType * topic_d_arr = PG_GETARG_ARRAYTYPE_P(2);
+	ArrayType * topic_counts_arr = PG_GETARG_ARRAYTYPE_P(4);
+	int32 num_topics = PG_GETARG_INT32(5);
+	int32 dsize = PG_GETARG_INT32(6);
+	float8 alpha = PG_GETARG_FLOAT8(7);
+	float8 eta = PG_GETARG_FLOAT8(8);
+	int32 iternum = PG_GETARG_INT32(9);
+	int32 num_sweeps = PG_GETARG_INT32(10);
+	Oid fn_oid = fcinfo->flinfo->fn_oid;
+
+	check_array_sampleNewTopics(doc_arr, fn_oid, "document array");
+	check_array_sampleNewTopics(topics_arr, fn_oid, "topic array");
+	check_array_sampleNewTopics(topic_d_arr, fn_oid, "topic distribution array");
+	check_array_sampleNewTopics(topic_counts_arr, fn_oid, "topic count array");
+
+	if (num_sweeps < 1)
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with invalid parameters. "
+			  "The number of sweeps should be positive",
+			  format_procedure(fn_oid))));
+
+	int32 * doc = (int32 *)ARR_DATA_PTR(doc_arr);
+	int32 len = ARR_DIMS(doc_arr)[0];
+
+	if (ARR_DIMS(topics_arr)[0] != len
+	    || ARR_DIMS(topic_d_arr)[0] != num_topics)
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with invalid parameters",
+			  format_procedure(fn_oid))));
+
+	// the word-topic counts and topic counts of this segment
+	plda_global_count_cache * cache = getGlobalCount(fcinfo, iternum);
+	int32 * local_count = cache->global_count;
+	int32 * local_topic_counts = cache->topic_counts;
+
+	if (cache->size < dsize * num_topics
+	    || cache->num_topic_counts != num_topics)
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with invalid parameters. "
+			  "The counts do not match the dictionary size and "
+			  "number of topics",
+			  format_procedure(fn_oid))));
+
+	for (i=0; i!=len; i++) {
+		widx = doc[i];
+		if (widx < 1 || widx > dsize)
+		     ereport
+		      (ERROR,
+		       (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			errmsg("function \"%s\" called with invalid parameters. Word index is: %d. "
+                    " Dictionary size is: %d. Word index should be in the range of [1, "
+                    " dict_size]",
+			       format_procedure(fn_oid), widx, dsize)));
+	}
+
+	// the topic assignments and distribution of the previous sweep
+	int32 * topics = (int32 *)palloc(sizeof(int32) * len);
+	memcpy(topics, ARR_DATA_PTR(topics_arr), sizeof(int32) * len);
+	int32 * topic_d = (int32 *)palloc(sizeof(int32) * num_topics);
+	memcpy(topic_d, ARR_DATA_PTR(topic_d_arr), sizeof(int32) * num_topics);
+
+	ArrayType * ret_topics_arr, * ret_topic_d_arr;
+	int32 * ret_topics, * ret_topic_d;
+
+	Datum * arr1 = palloc0(len * sizeof(Datum));
+	ret_topics_arr = construct_array(arr1,len,INT4OID,4,true,'i');
+	ret_topics = (int32 *)ARR_DATA_PTR(ret_topics_arr);
+
+	Datum * arr2 = palloc0(num_topics * sizeof(Datum));
+	ret_topic_d_arr = construct_array(arr2,num_topics,INT4OID,4,true,'i');
+	ret_topic_d = (int32 *)ARR_DATA_PTR(ret_topic_d_arr);
+
+	sampleSweeps(doc,len,topics,topic_d,local_count,local_topic_counts,
+		     num_topics,alpha,eta,num_sweeps,ret_topics,ret_topic_d);
+
+	Datum values[2];
+	values[0] = PointerGetDatum(ret_topics_arr);
+	values[1] = PointerGetDatum(ret_topic_d_arr);
+
+	TupleDesc tuple;
+	if (get_call_result_type(fcinfo, NULL, &tuple) != TYPEFUNC_COMPOSITE)
+		ereport(ERROR,
+			(errcode( ERRCODE_FEATURE_NOT_SUPPORTED ),
+			 errmsg( "function returning record called in context "
+				 "that cannot accept type record" )));
+	tuple = BlessTupleDesc(tuple);
+
+	bool * isnulls = palloc0(2 * sizeof(bool));
+	HeapTuple ret = heap_form_tuple(tuple, values, isnulls);
+
+	if (isnulls[0] || isnulls[1])
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("function \"%s\" produced null results",
+				format_procedure(fn_oid))));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(ret));
+}
+
+/**
+ * The trained word-topic counts, cached in fn_extra of labelDocument. The
+ * counts are usually the result of an uncorrelated scalar subquery, so that
+ * their stored representation (e.g., a TOAST pointer) is the same for all
+ * documents. It is kept to recognise the counts of the previous call without
+ * detoasting them again.
+ */
+typedef struct {
+	Size stored_size;
+	char * stored;
+	int32 size;
+	int32 * count;
+} plda_model_count_cache;
+
+/**
+ * This function returns a copy of the word-topic counts (argument 1), which
+ * is only made again if the stored representation of the argument differs
+ * from that of the previous call.
+ */
+static plda_model_count_cache * getModelCount(FunctionCallInfo fcinfo)
+{
+	plda_model_count_cache * cache =
+		(plda_model_count_cache *)fcinfo->flinfo->fn_extra;
+	char * stored = (char *)DatumGetPointer(PG_GETARG_DATUM(1));
+	Size stored_size = VARSIZE_ANY(stored);
+
+	if (cache != NULL && cache->stored_size == stored_size
+	    && memcmp(cache->stored, stored, stored_size) == 0)
+		return cache;
+
+	ArrayType * count_arr = PG_GETARG_ARRAYTYPE_P(1);
+	check_array_sampleNewTopics(count_arr, fcinfo->flinfo->fn_oid,
+				    "global count array");
+	int32 size = ARR_DIMS(count_arr)[0];
+
+	if (cache == NULL) {
+		cache = (plda_model_count_cache *)MemoryContextAlloc(
+			fcinfo->flinfo->fn_mcxt, sizeof(plda_model_count_cache));
+	} else {
+		pfree(cache->stored);
+		pfree(cache->count);
+	}
+	cache->stored = (char *)MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+						   stored_size);
+	memcpy(cache->stored, stored, stored_size);
+	cache->stored_size = stored_size;
+	cache->count = (int32 *)MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+						   sizeof(int32) * size);
+	memcpy(cache->count, ARR_DATA_PTR(count_arr), sizeof(int32) * size);
+	cache->size = size;
+	fcinfo->flinfo->fn_extra = cache;
+
+	return cache;
+}
+
+/**
+ * This function computes the topic assignments to the words of a new
+ * document, given the word-topic counts and topic counts of a trained model
+ * (which do not include the document). Starting from random topics, the
+ * topics are resampled num_iter times in memory (see sampleSweeps()), against
+ * the trained counts plus the current topics of the document. It returns
+ * the topics of the last sweep and the resulting topic distribution, like
+ * sampleNewTopics.
+ *
+ * The trained counts are copied only once for all documents (see
+ * getModelCount()); the topics of the document are added to the copy for
+ * the sweeps and removed again afterwards.
+ */
+Datum labelDocument(PG_FUNCTION_ARGS);
+Datum labelDocument(PG_FUNCTION_ARGS)
+{
+	int32 i, widx, rtopic;
+
+	ArrayType * doc_arr = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType * topic_counts_arr = PG_GETARG_ARRAYTYPE_P(2);
+	int32 num_topics = PG_GETARG_INT32(3);
+	int32 dsize = PG_GETARG_INT32(4);
+	float8 alpha = PG_GETARG_FLOAT8(5);
+	float8 eta = PG_GETARG_FLOAT8(6);
+	int32 num_iter = PG_GETARG_INT32(7);
+	Oid fn_oid = fcinfo->flinfo->fn_oid;
+
+	check_array_sampleNewTopics(doc_arr, fn_oid, "document array");
+	check_array_sampleNewTopics(topic_counts_arr, fn_oid, "topic count array");
+
+	if (num_topics < 1 || num_iter < 1
+	    || ARR_DIMS(topic_counts_arr)[0] != num_topics)
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with invalid parameters",
+			  format_procedure(fn_oid))));
+
+	int32 * doc = (int32 *)ARR_DATA_PTR(doc_arr);
+	int32 len = ARR_DIMS(doc_arr)[0];
+
+	// the trained word-topic counts
+	plda_model_count_cache * cache = getModelCount(fcinfo);
+	int32 * count = cache->count;
+
+	if (cache->size < dsize * num_topics)
+		ereport
+		 (ERROR,
+		  (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		   errmsg("function \"%s\" called with invalid parameters. "
+			  "The counts do not match the dictionary size and "
+			  "number of topics",
+			  format_procedure(fn_oid))));
+
+	for (i=0; i!=len; i++) {
+		widx = doc[i];
+		if (widx < 1 || widx > dsize)
+		     ereport
+		      (ERROR,
+		       (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			errmsg("function \"%s\" called with invalid parameters. Word index is: %d. "
+                    " Dictionary size is: %d. Word index should be in the range of [1, "
+                    " dict_size]",
+			       format_procedure(fn_oid), widx, dsize)));
+	}
+
+	int32 * topic_counts = (int32 *)palloc(sizeof(int32) * num_topics);
+	memcpy(topic_counts, ARR_DATA_PTR(topic_counts_arr),
+	       sizeof(int32) * num_topics);
+
+	// random initial topics, added to the counts
+	int32 * topics = (int32 *)palloc(sizeof(int32) * len);
+	int32 * topic_d = (int32 *)palloc0(sizeof(int32) * num_topics);
+	for (i=0; i!=len; i++) {
+		rtopic = random() % num_topics + 1;
+		topics[i] = rtopic;
+		topic_d[rtopic-1]++;
+		count[(doc[i] - 1) * num_topics + rtopic - 1]++;
+		topic_counts[rtopic-1]++;
+	}
+
+	ArrayType * ret_topics_arr, * ret_topic_d_arr;
+	int32 * ret_topics, * ret_topic_d;
+
+	Datum * arr1 = palloc0(len * sizeof(Datum));
+	ret_topics_arr = construct_array(arr1,len,INT4OID,4,true,'i');
+	ret_topics = (int32 *)ARR_DATA_PTR(ret_topics_arr);
+
+	Datum * arr2 = palloc0(num_topics * sizeof(Datum));
+	ret_topic_d_arr = construct_array(arr2,num_topics,INT4OID,4,true,'i');
+	ret_topic_d = (int32 *)ARR_DATA_PTR(ret_topic_d_arr);
+
+	sampleSweeps(doc,len,topics,topic_d,count,topic_counts,
+		     num_topics,alpha,eta,num_iter,ret_topics,ret_topic_d);
+
+	// remove the document from the trained counts again
+	for (i=0; i!=len; i++)
+		count[(doc[i] - 1) * num_topics + topics[i] - 1]--;
+
+	Datum values[2];
+	values[0] = PointerGetDatum(ret_topics_arr);
+	values[1] = PointerGetDatum(ret_topic_d_arr);
+
+	TupleDesc tuple;
+	if (get_call_result_type(fcinfo, NULL, &tuple) != TYPEFUNC_COMPOSITE)
+		ereport(ERROR,
+			(errcode( ERRCODE_FEATURE_NOT_SUPPORTED ),
+			 errmsg( "function returning record called in context "
+				 "that cannot accept type record" )));
+	tuple = BlessTupleDesc(tuple);
+
+	bool * isnulls = palloc0(2 * sizeof(bool));
+	HeapTuple ret = heap_form_tuple(tuple, values, isnulls);
+
+	if (isnulls[0] || isnulls[1])
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("function \"%s\" produced null results",
+				format_procedure(fn_oid))));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(ret));
+}
+
 /*
  <sampleNewTopics error checking>
  if (rtopic < 1 || rtopic > num_topics || wtopic < 1 || wtopic > num_topics)
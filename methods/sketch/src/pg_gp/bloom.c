@@ -0,0 +1,309 @@
+/*!
+ * \file bloom.c
+ *
+ * \brief Blocked Bloom filter implementation
+ */
+/*!
+ * \implementation
+ * A Bloom filter is a bitmap with k bits set for each value inserted, at
+ * positions given by k hash functions.  A value that was inserted is always
+ * reported as present; a value that was not is reported present with a
+ * small false positive rate, if all of its k bits happen to be set by other
+ * values.
+ *
+ * We use the blocked variant: the bitmap is divided into blocks of
+ * BLOOM_BLOCK_BITS bits (one 64-byte cache line), the first 64 bits of the
+ * hash of a value choose its block, and all of its k bits are set within
+ * that block.  A probe then touches a single cache line instead of k random
+ * ones, for a slightly higher false positive rate at the same size.  The k
+ * positions within the block come from the second 64 bits of the hash, by
+ * double hashing.
+ *
+ * Filters built with the same parameters and hash function are merged by
+ * OR-ing the bitmaps, so per-segment filters combine cheaply.
+ *
+ * See B. H. Bloom, "Space/time trade-offs in hash coding with allowable
+ * errors", CACM 13(7), 1970, and F. Putze, P. Sanders and J. Singler,
+ * "Cache-, hash- and space-efficient Bloom filters", WEA 2007.
+ */
+
+#include "postgres.h"
+#include "utils/elog.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "nodes/execnodes.h"
+#include "fmgr.h"
+#include "sketch_support.h"
+#include "bloom.h"
+#include <math.h>
+
+/*! number of bits in a block: one cache line */
+#define BLOOM_BLOCK_BITS 512
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS/64)
+/*! bound on the number of bits set for each value */
+#define BLOOM_MAX_HASHES 16
+/*! bound on the size of the bitmap */
+#define BLOOM_MAX_BLOCKS ((256*1024*1024)/(BLOOM_BLOCK_BITS/8))
+
+/*!
+ * \internal
+ * \brief transition value struct for Bloom filters
+ *
+ * The bitmap holds nblocks blocks of BLOOM_BLOCK_WORDS uint64 words each.
+ * \endinternal
+ */
+typedef struct {
+    uint32 hashtype;  /*! hash function, see SKETCH_HASH_DEFAULT */
+    Oid    typOid;    /*! type of the values inserted */
+    uint32 nblocks;   /*! number of blocks of the bitmap */
+    uint32 nhashes;   /*! number of bits set for each value */
+    uint32 reserved;  /*! unused, keeps the bitmap 8-byte aligned */
+    uint64 bits[];
+} bloomtransval;
+
+#define BLOOM_TRANSVAL(blob) ((bloomtransval *)VARDATA(blob))
+#define BLOOM_TRANSVAL_SZ(nblocks) (VARHDRSZ + sizeof(bloomtransval) + \
+                                    (Size)(nblocks)*BLOOM_BLOCK_WORDS*sizeof(uint64))
+
+/*!
+ * hash a value for a Bloom filter.  Varlena values are detoasted first, so
+ * that a short (1-byte header) value from a table hashes the same as the
+ * value from a constant.
+ * \param hash the output, two 64-bit words
+ */
+static void bloom_hash(Datum dat, Oid typOid, uint32 hashtype, uint64 *hash)
+{
+    bytea *hashed;
+
+    if (get_typlen(typOid) == -1)
+        dat = PointerGetDatum(PG_DETOAST_DATUM(dat));
+    hashed = sketch_hash_bytea(dat, typOid, hashtype);
+    memcpy(hash, VARDATA(hashed), 2*sizeof(uint64));
+    pfree(hashed);
+}
+
+/*! the block of a hashed value */
+#define BLOOM_BLOCK(t, hash) \
+    (&(t)->bits[((hash)[0] % (t)->nblocks)*BLOOM_BLOCK_WORDS])
+
+/*!
+ * generate a bytea holding an empty Bloom filter for about n values of type
+ * typOid, with a false positive rate of about p
+ */
+bytea *bloom_init_transval(Oid typOid, int64 n, float8 p)
+{
+    float8         nbits, nblocks, nhashes;
+    bytea         *transblob;
+    bloomtransval *transval;
+
+    if (n < 1)
+        elog(ERROR, "expected number of values of a Bloom filter must be positive");
+    if (!(p > 0 && p < 1))
+        elog(ERROR, "false positive rate of a Bloom filter must be between 0 and 1");
+
+    /* the optimal size and number of hashes of an unblocked filter */
+    nbits = ceil(-(float8)n * log(p) / (M_LN2 * M_LN2));
+    nblocks = Max(1, ceil(nbits / BLOOM_BLOCK_BITS));
+    if (nblocks > BLOOM_MAX_BLOCKS)
+        elog(ERROR, "Bloom filter would be larger than %d MB",
+             (int)(((Size)BLOOM_MAX_BLOCKS*BLOOM_BLOCK_BITS/8) >> 20));
+    nhashes = rint(M_LN2 * nblocks * BLOOM_BLOCK_BITS / n);
+    nhashes = Max(1, Min(BLOOM_MAX_HASHES, nhashes));
+
+    transblob = (bytea *)palloc0(BLOOM_TRANSVAL_SZ(nblocks));
+    SET_VARSIZE(transblob, BLOOM_TRANSVAL_SZ(nblocks));
+    transval = BLOOM_TRANSVAL(transblob);
+    transval->hashtype = SKETCH_HASH_DEFAULT;
+    transval->typOid = typOid;
+    transval->nblocks = (uint32)nblocks;
+    transval->nhashes = (uint32)nhashes;
+    return transblob;
+}
+
+/*!
+ * set the bits of a hashed value in a Bloom filter, or check them
+ * \param set whether to set the bits, or only check them
+ * \return whether all the bits were set before
+ */
+static bool bloom_bits(bloomtransval *transval, const uint64 *hash, bool set)
+{
+    uint64 *block = BLOOM_BLOCK(transval, hash);
+    uint32  pos = (uint32)hash[1];
+    /* an odd step visits different bits for the first BLOOM_BLOCK_BITS steps */
+    uint32  step = (uint32)(hash[1] >> 32) | 1;
+    bool    found = true;
+    uint32  i;
+
+    for (i = 0; i < transval->nhashes; i++, pos += step) {
+        uint32 bit = pos % BLOOM_BLOCK_BITS;
+        uint64 mask = (uint64)1 << (bit % 64);
+
+        if (!(block[bit / 64] & mask)) {
+            if (!set)
+                return false;
+            found = false;
+            block[bit / 64] |= mask;
+        }
+    }
+    return found;
+}
+
+PG_FUNCTION_INFO_V1(__bloomfilter_trans);
+
+/*! UDA transition function for the bloomfilter aggregate. */
+Datum __bloomfilter_trans(PG_FUNCTION_ARGS)
+{
+    bytea         *transblob = (bytea *)PG_GETARG_BYTEA_P(0);
+    bloomtransval *transval;
+    uint64         hash[2];
+
+    /* the bitmap is updated in place, see fm.c */
+    if (!(fcinfo->context &&
+          (IsA(fcinfo->context, AggState)
+    #ifdef NOTGP
+           || IsA(fcinfo->context, WindowAggState)
+    #endif
+          )))
+        elog(
+            ERROR,
+            "UDF call to a function that only works for aggs (destructive pass by reference)");
+
+    /* on the first call, we get the empty initcond */
+    if (VARSIZE(transblob) <= VARHDRSZ) {
+        Oid element_type = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+        if (!OidIsValid(element_type))
+            elog(ERROR, "could not determine data type of input");
+        transblob = bloom_init_transval(element_type, PG_GETARG_INT64(2),
+                                        PG_GETARG_FLOAT8(3));
+    }
+    transval = BLOOM_TRANSVAL(transblob);
+
+    bloom_hash(PG_GETARG_DATUM(1), transval->typOid, transval->hashtype, hash);
+    (void)bloom_bits(transval, hash, true);
+    PG_RETURN_BYTEA_P(transblob);
+}
+
+PG_FUNCTION_INFO_V1(__bloomfilter_merge);
+
+/*!
+ * Greenplum "prefunc": merge two transvals computed at different segments.
+ */
+Datum __bloomfilter_merge(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BYTEA_P(bloom_merge_c((bytea *)PG_GETARG_BYTEA_P(0),
+                                    (bytea *)PG_GETARG_BYTEA_P(1)));
+}
+
+/*!
+ * implementation of the merge of two Bloom filters, the bitwise OR of their
+ * bitmaps.  The result is a new bytea unless one of the inputs is empty, in
+ * which case the other is returned.
+ */
+bytea *bloom_merge_c(bytea *transblob1, bytea *transblob2)
+{
+    bloomtransval *transval1, *transval2, *newval;
+    bytea         *newblob;
+    Size           i, nwords;
+
+    /* deal with the case where one or both items is the initial value of '' */
+    if (VARSIZE(transblob1) <= VARHDRSZ)
+        return transblob2;
+    if (VARSIZE(transblob2) <= VARHDRSZ)
+        return transblob1;
+
+    transval1 = BLOOM_TRANSVAL(transblob1);
+    transval2 = BLOOM_TRANSVAL(transblob2);
+    if (transval1->hashtype != transval2->hashtype
+        || transval1->typOid != transval2->typOid)
+        elog(ERROR,
+             "cannot merge Bloom filters built with different hash functions or types");
+    if (transval1->nblocks != transval2->nblocks
+        || transval1->nhashes != transval2->nhashes)
+        elog(ERROR, "cannot merge Bloom filters built with different sizes");
+
+    newblob = (bytea *)palloc(VARSIZE(transblob1));
+    memcpy(newblob, transblob1, VARSIZE(transblob1));
+    newval = BLOOM_TRANSVAL(newblob);
+    nwords = (Size)newval->nblocks*BLOOM_BLOCK_WORDS;
+    for (i = 0; i < nwords; i++)
+        newval->bits[i] |= transval2->bits[i];
+    return newblob;
+}
+
+/*!
+ * \internal
+ * \brief the detoasted filter of the previous call of bloomfilter_contains
+ *
+ * A filter from a subquery is the same for every row probed, so we keep it
+ * around rather than detoast it for every value.
+ * \endinternal
+ */
+typedef struct {
+    struct varlena *raw;    /*! copy of the toasted datum */
+    bytea          *filter; /*! the detoasted filter */
+} bloomcache;
+
+/*!
+ * get the detoasted filter, from fn_extra if it was passed before.  The
+ * cache is keyed by the bytes of the toasted datum, which for out-of-line
+ * values is just the toast pointer.
+ */
+static bytea *bloom_get_filter(FunctionCallInfo fcinfo)
+{
+    struct varlena *raw = (struct varlena *)PG_GETARG_POINTER(0);
+    bloomcache     *cache = (bloomcache *)fcinfo->flinfo->fn_extra;
+    MemoryContext   oldcontext;
+    Size            rawlen;
+
+    if (!VARATT_IS_EXTENDED(raw))
+        return (bytea *)raw;
+
+    rawlen = VARSIZE_ANY(raw);
+    if (cache != NULL && VARSIZE_ANY(cache->raw) == rawlen
+        && memcmp(cache->raw, raw, rawlen) == 0)
+        return cache->filter;
+
+    oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    if (cache == NULL)
+        cache = (bloomcache *)palloc0(sizeof(bloomcache));
+    else {
+        pfree(cache->raw);
+        pfree(cache->filter);
+    }
+    cache->raw = (struct varlena *)palloc(rawlen);
+    memcpy(cache->raw, raw, rawlen);
+    cache->filter = (bytea *)PG_DETOAST_DATUM_COPY(PointerGetDatum(raw));
+    MemoryContextSwitchTo(oldcontext);
+    fcinfo->flinfo->fn_extra = cache;
+    return cache->filter;
+}
+
+PG_FUNCTION_INFO_V1(bloomfilter_contains);
+
+/*!
+ * scalar function probing a Bloom filter for a value: false if the value was
+ * certainly not inserted, true if it probably was
+ */
+Datum bloomfilter_contains(PG_FUNCTION_ARGS)
+{
+    bytea         *filter = bloom_get_filter(fcinfo);
+    bloomtransval *transval;
+    uint64         hash[2];
+    Oid            element_type = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+    /* nothing was ever inserted */
+    if (VARSIZE(filter) <= VARHDRSZ)
+        PG_RETURN_BOOL(false);
+
+    transval = BLOOM_TRANSVAL(filter);
+    if (VARSIZE(filter) != BLOOM_TRANSVAL_SZ(transval->nblocks))
+        elog(ERROR, "invalid Bloom filter");
+    if (OidIsValid(element_type) && element_type != transval->typOid)
+        elog(ERROR,
+             "Bloom filter was built for values of type %s, not %s",
+             format_type_be(transval->typOid), format_type_be(element_type));
+
+    bloom_hash(PG_GETARG_DATUM(1), transval->typOid, transval->hashtype, hash);
+    PG_RETURN_BOOL(bloom_bits(transval, hash, false));
+}
@@ -0,0 +1,17 @@
+/*!
+ * \file bloom.h
+ *
+ * \brief header file for Bloom filters
+ */
+#ifndef _BLOOM_H_
+#define _BLOOM_H_
+
+bytea *bloom_init_transval(Oid, int64, float8);
+bytea *bloom_merge_c(bytea *, bytea *);
+
+/* UDF protos */
+Datum __bloomfilter_trans(PG_FUNCTION_ARGS);
+Datum __bloomfilter_merge(PG_FUNCTION_ARGS);
+Datum bloomfilter_contains(PG_FUNCTION_ARGS);
+
+#endif /* _BLOOM_H_ */
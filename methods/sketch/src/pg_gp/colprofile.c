@@ -0,0 +1,822 @@
+/*!
+ * \file colprofile.c
+ *
+ * \brief Column profiles: the data_profile statistics of a column in a
+ *        single aggregate
+ */
+/*!
+ * \implementation
+ * A table profile runs a handful of aggregates on every column.  As
+ * separate aggregates, each of them fetches, detoasts and hashes every value
+ * on its own.  The colprofile aggregate instead keeps all statistics of a
+ * column in one transition value, so that every value is detoasted and
+ * hashed once:
+ *  - the number of NULL and non-NULL values,
+ *  - for numeric types, the minimum, maximum, mean and variance (by
+ *    Welford's method), and a quantile sketch,
+ *  - a HyperLogLog sketch for the distinct count, see hll.c,
+ *  - optionally an MFV sketch for the most frequent values, see mfvsketch.c.
+ * The HLL and MFV sketches share the 128-bit hash of the value.
+ *
+ * The transition value is a header followed by the sketches, each stored as
+ * a complete bytea at a MAXALIGN'ed offset.  The sketches are updated in
+ * place; only when one of them has to grow into a new bytea, the transition
+ * value is packed anew around it.
+ *
+ * The quantile sketch is a hierarchy of compactors in the spirit of Munro
+ * and Paterson, and of Karnin, Lang and Liberty ("Optimal Quantile
+ * Approximation in Streams", FOCS 2016): level l holds up to QS_K values of
+ * weight 2^l.  When a level is full, it is sorted and every other value is
+ * promoted to the next level, alternating between the odd and even
+ * positions.  Merging two sketches pushes the levels of one into the other.
+ * The space is QS_K values per level, i.e., logarithmic in the number of
+ * values, and rank errors are typically below one percent of the
+ * count.
+ *
+ * The results are read from the transition value with scalar functions, as
+ * for the cmsketch aggregate.
+ */
+
+#include "postgres.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/elog.h"
+#include "utils/lsyscache.h"
+#include "catalog/pg_type.h"
+#include "nodes/execnodes.h"
+#include "fmgr.h"
+#include "sketch_support.h"
+#include "countmin.h"
+#include "hll.h"
+#include <math.h>
+
+/*! number of values per level of the quantile sketch, must be even */
+#define QS_K 128
+/*! maximum number of levels of the quantile sketch */
+#define QS_MAX_LEVELS 56
+
+/*!
+ * \internal
+ * \brief the quantile sketch of a numeric column
+ *
+ * Level l starts at items[l*QS_K] and holds sizes[l] values of weight 2^l.
+ * The allocated number of levels follows from the size of the enclosing
+ * bytea.
+ * \endinternal
+ */
+typedef struct {
+    uint64 parity;                /*! bit l: offset of the next compaction */
+    uint32 sizes[QS_MAX_LEVELS];
+    float8 items[];
+} qstransval;
+
+#define QS_TRANSVAL(blob) ((qstransval *)VARDATA(blob))
+#define QS_SZ(nlevels) \
+    (VARHDRSZ + sizeof(qstransval) + (Size)(nlevels)*QS_K*sizeof(float8))
+#define QS_NLEVELS(blob) \
+    ((VARSIZE(blob) - VARHDRSZ - sizeof(qstransval))/(QS_K*sizeof(float8)))
+#define QS_LEVEL(t, l) (&(t)->items[(Size)(l)*QS_K])
+
+/*! sketches kept in a column profile */
+enum {
+    COLPROFILE_HLL,
+    COLPROFILE_MFV,
+    COLPROFILE_QUANTILE,
+    COLPROFILE_NSKETCHES
+};
+
+/*! the column is of a numeric type, whose values are read as float8 */
+#define COLPROFILE_NUMERIC 1
+
+/*!
+ * \internal
+ * \brief transition value struct for column profiles
+ *
+ * The sketches follow the struct, at the given offsets from the start of
+ * the struct (an offset of 0 means the sketch is not kept).
+ * \endinternal
+ */
+typedef struct {
+    Oid    typOid;
+    int32  typLen;
+    uint32 flags;
+    uint32 offsets[COLPROFILE_NSKETCHES];
+    int64  count;         /*! number of non-NULL values */
+    int64  nulls;         /*! number of NULL values */
+    float8 min;
+    float8 max;
+    float8 mean;
+    float8 m2;            /*! sum of squared differences from the mean */
+} colprofiletransval;
+
+#define COLPROFILE_TRANSVAL(blob) ((colprofiletransval *)VARDATA(blob))
+#define COLPROFILE_SKETCH(t, i) \
+    ((t)->offsets[i] ? (bytea *)((char *)(t) + (t)->offsets[i]) : NULL)
+
+Datum __colprofile_trans(PG_FUNCTION_ARGS);
+Datum __colprofile_merge(PG_FUNCTION_ARGS);
+Datum colprofile_count(PG_FUNCTION_ARGS);
+Datum colprofile_nulls(PG_FUNCTION_ARGS);
+Datum colprofile_min(PG_FUNCTION_ARGS);
+Datum colprofile_max(PG_FUNCTION_ARGS);
+Datum colprofile_mean(PG_FUNCTION_ARGS);
+Datum colprofile_variance(PG_FUNCTION_ARGS);
+Datum colprofile_dcount(PG_FUNCTION_ARGS);
+Datum colprofile_quantile(PG_FUNCTION_ARGS);
+Datum colprofile_depth_histogram(PG_FUNCTION_ARGS);
+Datum colprofile_width_histogram(PG_FUNCTION_ARGS);
+Datum colprofile_mfv(PG_FUNCTION_ARGS);
+
+/*!
+ * compare two float8, ordering NaN after everything else like Postgres
+ */
+static int colprofile_float8_cmp(const void *a, const void *b)
+{
+    float8 x = *(const float8 *)a;
+    float8 y = *(const float8 *)b;
+
+    if (isnan(x))
+        return isnan(y) ? 0 : 1;
+    if (isnan(y))
+        return -1;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/*!
+ * generate a bytea holding a quantile sketch with nlevels levels, copying
+ * the levels of template if it is not NULL
+ */
+static bytea *qs_new(uint32 nlevels, bytea *template)
+{
+    bytea *newblob = (bytea *)palloc0(QS_SZ(nlevels));
+
+    SET_VARSIZE(newblob, QS_SZ(nlevels));
+    if (template != NULL)
+        memcpy(VARDATA(newblob), VARDATA(template),
+               Min(VARSIZE(template), VARSIZE(newblob)) - VARHDRSZ);
+    return newblob;
+}
+
+static bytea *qs_push(bytea *, uint32, float8 *, uint32);
+
+/*!
+ * Sort a level and promote every other value to the next level.  An odd
+ * value out stays behind.
+ * \returns the sketch, which may be a new bytea
+ */
+static bytea *qs_compact(bytea *blob, uint32 level)
+{
+    qstransval *qs = QS_TRANSVAL(blob);
+    float8     *vals = QS_LEVEL(qs, level);
+    uint32      m = qs->sizes[level];
+    uint32      offset = (uint32)((qs->parity >> level) & 1);
+    float8      promoted[QS_K/2];
+    uint32      i;
+
+    qsort(vals, m, sizeof(float8), colprofile_float8_cmp);
+    for (i = 0; i < m/2; i++)
+        promoted[i] = vals[2*i + offset];
+    if (m % 2)
+        vals[0] = vals[m - 1];
+    qs->sizes[level] = m % 2;
+    qs->parity ^= UINT64CONST(1) << level;
+
+    return qs_push(blob, level + 1, promoted, m/2);
+}
+
+/*!
+ * add n values of weight 2^level to a quantile sketch
+ * \returns the sketch, which may be a new bytea
+ */
+static bytea *qs_push(bytea *blob, uint32 level, float8 *vals, uint32 n)
+{
+    while (n > 0) {
+        qstransval *qs;
+        uint32      take;
+
+        if (level >= QS_NLEVELS(blob)) {
+            if (level >= QS_MAX_LEVELS)
+                elog(ERROR, "maximum count exceeded in quantile sketch");
+            /* we can't use repalloc, for the same reasons as fm.c */
+            blob = qs_new(level + 1, blob);
+        }
+        if (QS_TRANSVAL(blob)->sizes[level] == QS_K)
+            blob = qs_compact(blob, level);
+
+        qs = QS_TRANSVAL(blob);
+        take = Min(n, QS_K - qs->sizes[level]);
+        memcpy(&QS_LEVEL(qs, level)[qs->sizes[level]], vals,
+               take*sizeof(float8));
+        qs->sizes[level] += take;
+        vals += take;
+        n -= take;
+    }
+    return blob;
+}
+
+/*!
+ * merge two quantile sketches into a new one
+ */
+static bytea *qs_merge(bytea *blob1, bytea *blob2)
+{
+    bytea  *newblob = qs_new(QS_NLEVELS(blob1), blob1);
+    uint32  l;
+
+    for (l = 0; l < QS_NLEVELS(blob2); l++) {
+        /* qs_push might compact into our source if it were the same */
+        float8 vals[QS_K];
+        uint32 n = QS_TRANSVAL(blob2)->sizes[l];
+
+        memcpy(vals, QS_LEVEL(QS_TRANSVAL(blob2), l), n*sizeof(float8));
+        newblob = qs_push(newblob, l, vals, n);
+    }
+    return newblob;
+}
+
+/*!
+ * \internal
+ * \brief a value of the quantile sketch with its weight
+ * \endinternal
+ */
+typedef struct {
+    float8 value;
+    float8 weight;
+} qsitem;
+
+static int qsitem_cmp(const void *a, const void *b)
+{
+    return colprofile_float8_cmp(&((const qsitem *)a)->value,
+                                 &((const qsitem *)b)->value);
+}
+
+/*!
+ * all values of a quantile sketch with their weights, sorted by value
+ * \param blob the quantile sketch
+ * \param n output: the number of values
+ * \param total output: the sum of weights
+ */
+static qsitem *qs_items(bytea *blob, uint32 *n, float8 *total)
+{
+    qstransval *qs = QS_TRANSVAL(blob);
+    uint32      nlevels = QS_NLEVELS(blob);
+    qsitem     *items = (qsitem *)palloc(Max(nlevels*QS_K, 1)*sizeof(qsitem));
+    uint32      l, i;
+
+    *n = 0;
+    *total = 0;
+    for (l = 0; l < nlevels; l++)
+        for (i = 0; i < qs->sizes[l]; i++) {
+            items[*n].value = QS_LEVEL(qs, l)[i];
+            items[*n].weight = ldexp(1.0, (int)l);
+            *total += items[*n].weight;
+            (*n)++;
+        }
+    qsort(items, *n, sizeof(qsitem), qsitem_cmp);
+    return items;
+}
+
+/*!
+ * the smallest value of the sketch with at least a fraction q of the
+ * total weight at or below it
+ */
+static float8 qs_items_quantile(qsitem *items, uint32 n, float8 total,
+                                float8 q)
+{
+    float8 cum = 0;
+    uint32 i;
+
+    for (i = 0; i + 1 < n; i++) {
+        cum += items[i].weight;
+        if (cum >= q*total)
+            break;
+    }
+    return items[i].value;
+}
+
+/*! the total weight of the values of the sketch at or below x */
+static float8 qs_items_rank(qsitem *items, uint32 n, float8 x)
+{
+    float8 cum = 0;
+    uint32 i;
+
+    for (i = 0; i < n && colprofile_float8_cmp(&items[i].value, &x) <= 0;
+         i++)
+        cum += items[i].weight;
+    return cum;
+}
+
+/*! whether values of a type are profiled as numbers */
+static bool colprofile_is_numeric(Oid typOid)
+{
+    switch (typOid) {
+        case INT2OID:
+        case INT4OID:
+        case INT8OID:
+        case FLOAT4OID:
+        case FLOAT8OID:
+        case NUMERICOID:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*! a value of a numeric type as float8, see colprofile_is_numeric */
+static float8 colprofile_float8(Datum dat, Oid typOid)
+{
+    switch (typOid) {
+        case INT2OID:
+            return (float8)DatumGetInt16(dat);
+        case INT4OID:
+            return (float8)DatumGetInt32(dat);
+        case INT8OID:
+            return (float8)DatumGetInt64(dat);
+        case FLOAT4OID:
+            return (float8)DatumGetFloat4(dat);
+        case FLOAT8OID:
+            return DatumGetFloat8(dat);
+        case NUMERICOID:
+            return DatumGetFloat8(
+                DirectFunctionCall1(numeric_float8_no_overflow, dat));
+        default:
+            elog(ERROR, "column profile of type %u is not numeric", typOid);
+            return 0;
+    }
+}
+
+/*!
+ * generate a bytea holding a column profile with the given header and
+ * sketches
+ * \param header the header, whose offsets are ignored
+ * \param sketches the sketches, NULL for those not kept
+ */
+static bytea *colprofile_pack(colprofiletransval *header, bytea **sketches)
+{
+    colprofiletransval *transval;
+    bytea              *newblob;
+    uint32              offsets[COLPROFILE_NSKETCHES];
+    Size                sz = MAXALIGN(VARHDRSZ + sizeof(colprofiletransval));
+    int                 i;
+
+    for (i = 0; i < COLPROFILE_NSKETCHES; i++) {
+        offsets[i] = sketches[i] ? (uint32)(sz - VARHDRSZ) : 0;
+        if (sketches[i])
+            sz += MAXALIGN(VARSIZE(sketches[i]));
+    }
+
+    newblob = (bytea *)palloc0(sz);
+    SET_VARSIZE(newblob, sz);
+    transval = COLPROFILE_TRANSVAL(newblob);
+    memcpy(transval, header, sizeof(colprofiletransval));
+    for (i = 0; i < COLPROFILE_NSKETCHES; i++) {
+        transval->offsets[i] = offsets[i];
+        if (sketches[i])
+            memcpy((char *)transval + offsets[i], sketches[i],
+                   VARSIZE(sketches[i]));
+    }
+    return newblob;
+}
+
+/*!
+ * put a sketch that may have moved back into a column profile
+ * \returns the column profile, a new bytea if the sketch moved
+ */
+static bytea *colprofile_replace(bytea *transblob, int which, bytea *sketch)
+{
+    colprofiletransval *transval = COLPROFILE_TRANSVAL(transblob);
+    colprofiletransval  header;
+    bytea              *sketches[COLPROFILE_NSKETCHES];
+    int                 i;
+
+    if (COLPROFILE_SKETCH(transval, which) == sketch)
+        return transblob;
+
+    header = *transval;
+    for (i = 0; i < COLPROFILE_NSKETCHES; i++)
+        sketches[i] = (i == which) ? sketch : COLPROFILE_SKETCH(transval, i);
+    return colprofile_pack(&header, sketches);
+}
+
+/*!
+ * generate a bytea holding an empty column profile
+ * \param typOid the type of the column
+ * \param max_mfvs the number of most frequent values to keep, no MFV
+ *        sketch is kept if 0
+ */
+static bytea *colprofile_init_transval(Oid typOid, int32 max_mfvs)
+{
+    colprofiletransval header;
+    bytea             *sketches[COLPROFILE_NSKETCHES];
+
+    memset(&header, 0, sizeof(header));
+    header.typOid = typOid;
+    header.typLen = get_typlen(typOid);
+    header.flags = colprofile_is_numeric(typOid) ? COLPROFILE_NUMERIC : 0;
+
+    sketches[COLPROFILE_HLL] = hll_init_transval(typOid);
+    sketches[COLPROFILE_MFV] =
+        (max_mfvs > 0) ? mfv_init_transval(max_mfvs, typOid) : NULL;
+    sketches[COLPROFILE_QUANTILE] =
+        (header.flags & COLPROFILE_NUMERIC) ? qs_new(1, NULL) : NULL;
+    return colprofile_pack(&header, sketches);
+}
+
+PG_FUNCTION_INFO_V1(__colprofile_trans);
+
+/*!
+ * UDA transition function for the colprofile aggregate.  It is not strict,
+ * so that it can count NULLs.
+ */
+Datum __colprofile_trans(PG_FUNCTION_ARGS)
+{
+    bytea              *transblob = PG_GETARG_BYTEA_P(0);
+    colprofiletransval *transval;
+    Datum               dat;
+    bytea              *hashed;
+
+    /* the sketches are updated in place, see fm.c */
+    if (!(fcinfo->context &&
+          (IsA(fcinfo->context, AggState)
+    #ifdef NOTGP
+           || IsA(fcinfo->context, WindowAggState)
+    #endif
+          )))
+        elog(
+            ERROR,
+            "UDF call to a function that only works for aggs (destructive pass by reference)");
+
+    /* on the first call, we get the empty initcond */
+    if (VARSIZE(transblob) <= VARHDRSZ) {
+        Oid typOid = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+        if (!OidIsValid(typOid))
+            elog(ERROR, "could not determine data type of input");
+        transblob = colprofile_init_transval(typOid,
+                                             PG_ARGISNULL(2) ? 0 :
+                                             PG_GETARG_INT32(2));
+    }
+    transval = COLPROFILE_TRANSVAL(transblob);
+
+    if (PG_ARGISNULL(1)) {
+        transval->nulls++;
+        PG_RETURN_BYTEA_P(transblob);
+    }
+
+    /*
+     * the sketches hash the raw bytes of a value, so varlena values must be
+     * in their plain form whatever the tuple stored
+     */
+    dat = PG_GETARG_DATUM(1);
+    if (transval->typLen == -1)
+        dat = PointerGetDatum(PG_DETOAST_DATUM(dat));
+
+    transval->count++;
+    if (transval->flags & COLPROFILE_NUMERIC) {
+        float8 x = colprofile_float8(dat, transval->typOid);
+        float8 delta = x - transval->mean;
+
+        if (transval->count == 1 || colprofile_float8_cmp(&x, &transval->min) < 0)
+            transval->min = x;
+        if (transval->count == 1 || colprofile_float8_cmp(&x, &transval->max) > 0)
+            transval->max = x;
+        transval->mean += delta / (float8)transval->count;
+        transval->m2 += delta * (x - transval->mean);
+
+        transblob = colprofile_replace(transblob, COLPROFILE_QUANTILE,
+            qs_push(COLPROFILE_SKETCH(transval, COLPROFILE_QUANTILE), 0,
+                    &x, 1));
+        transval = COLPROFILE_TRANSVAL(transblob);
+    }
+
+    hashed = sketch_hash_bytea(dat, transval->typOid, SKETCH_HASH_DEFAULT);
+    transblob = colprofile_replace(transblob, COLPROFILE_HLL,
+        hll_trans_hashed(COLPROFILE_SKETCH(transval, COLPROFILE_HLL),
+                         hashed));
+    transval = COLPROFILE_TRANSVAL(transblob);
+    if (transval->offsets[COLPROFILE_MFV])
+        transblob = colprofile_replace(transblob, COLPROFILE_MFV,
+            mfv_trans_hashed(COLPROFILE_SKETCH(transval, COLPROFILE_MFV),
+                             dat, hashed));
+
+    PG_RETURN_BYTEA_P(transblob);
+}
+
+PG_FUNCTION_INFO_V1(__colprofile_merge);
+
+/*!
+ * Greenplum "prefunc": merge two column profiles computed at different
+ * segments.  Means and variances are combined as in Chan et al., "Updating
+ * Formulae and a Pairwise Algorithm for Computing Sample Variances", 1979.
+ */
+Datum __colprofile_merge(PG_FUNCTION_ARGS)
+{
+    bytea              *transblob1 = PG_GETARG_BYTEA_P(0);
+    bytea              *transblob2 = PG_GETARG_BYTEA_P(1);
+    colprofiletransval *transval1, *transval2;
+    colprofiletransval  header;
+    bytea              *sketches[COLPROFILE_NSKETCHES];
+    bytea              *sketch1, *sketch2;
+
+    /* deal with the case where one or both items is the initial value of '' */
+    if (VARSIZE(transblob1) <= VARHDRSZ)
+        PG_RETURN_BYTEA_P(transblob2);
+    if (VARSIZE(transblob2) <= VARHDRSZ)
+        PG_RETURN_BYTEA_P(transblob1);
+
+    transval1 = COLPROFILE_TRANSVAL(transblob1);
+    transval2 = COLPROFILE_TRANSVAL(transblob2);
+    if (transval1->typOid != transval2->typOid)
+        elog(ERROR, "cannot merge column profiles of different types");
+
+    header = *transval1;
+    header.count = transval1->count + transval2->count;
+    header.nulls = transval1->nulls + transval2->nulls;
+    if (transval1->count == 0) {
+        header.min = transval2->min;
+        header.max = transval2->max;
+        header.mean = transval2->mean;
+        header.m2 = transval2->m2;
+    }
+    else if (transval2->count > 0) {
+        float8 delta = transval2->mean - transval1->mean;
+        float8 n1 = (float8)transval1->count;
+        float8 n2 = (float8)transval2->count;
+
+        if (colprofile_float8_cmp(&transval2->min, &header.min) < 0)
+            header.min = transval2->min;
+        if (colprofile_float8_cmp(&transval2->max, &header.max) > 0)
+            header.max = transval2->max;
+        header.mean = transval1->mean + delta * n2 / (n1 + n2);
+        header.m2 = transval1->m2 + transval2->m2
+                    + delta * delta * n1 * n2 / (n1 + n2);
+    }
+
+    sketches[COLPROFILE_HLL] =
+        hll_merge_c(COLPROFILE_SKETCH(transval1, COLPROFILE_HLL),
+                    COLPROFILE_SKETCH(transval2, COLPROFILE_HLL));
+
+    sketch1 = COLPROFILE_SKETCH(transval1, COLPROFILE_MFV);
+    sketch2 = COLPROFILE_SKETCH(transval2, COLPROFILE_MFV);
+    sketches[COLPROFILE_MFV] = (sketch1 && sketch2) ?
+                               mfvsketch_merge_c(sketch1, sketch2) :
+                               (sketch1 ? sketch1 : sketch2);
+
+    sketch1 = COLPROFILE_SKETCH(transval1, COLPROFILE_QUANTILE);
+    sketch2 = COLPROFILE_SKETCH(transval2, COLPROFILE_QUANTILE);
+    sketches[COLPROFILE_QUANTILE] = (sketch1 && sketch2) ?
+                                    qs_merge(sketch1, sketch2) : NULL;
+
+    PG_RETURN_BYTEA_P(colprofile_pack(&header, sketches));
+}
+
+/*
+ *******  Below are scalar functions to read a completed column profile.  ******
+ */
+
+/*!
+ * the column profile of the first argument, or NULL if the aggregate saw
+ * no rows
+ */
+static colprofiletransval *colprofile_arg(PG_FUNCTION_ARGS)
+{
+    bytea *transblob = PG_GETARG_BYTEA_P(0);
+
+    if (VARSIZE(transblob) <= VARHDRSZ)
+        return NULL;
+    return COLPROFILE_TRANSVAL(transblob);
+}
+
+/*!
+ * the column profile of the first argument, or NULL if it has no numeric
+ * values
+ */
+static colprofiletransval *colprofile_numeric_arg(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_arg(fcinfo);
+
+    if (transval == NULL || !(transval->flags & COLPROFILE_NUMERIC)
+        || transval->count == 0)
+        return NULL;
+    return transval;
+}
+
+PG_FUNCTION_INFO_V1(colprofile_count);
+
+/*! number of non-NULL values */
+Datum colprofile_count(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_arg(fcinfo);
+
+    PG_RETURN_INT64(transval ? transval->count : 0);
+}
+
+PG_FUNCTION_INFO_V1(colprofile_nulls);
+
+/*! number of NULL values */
+Datum colprofile_nulls(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_arg(fcinfo);
+
+    PG_RETURN_INT64(transval ? transval->nulls : 0);
+}
+
+PG_FUNCTION_INFO_V1(colprofile_min);
+
+/*! minimum of a numeric column */
+Datum colprofile_min(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_numeric_arg(fcinfo);
+
+    if (transval == NULL)
+        PG_RETURN_NULL();
+    PG_RETURN_FLOAT8(transval->min);
+}
+
+PG_FUNCTION_INFO_V1(colprofile_max);
+
+/*! maximum of a numeric column */
+Datum colprofile_max(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_numeric_arg(fcinfo);
+
+    if (transval == NULL)
+        PG_RETURN_NULL();
+    PG_RETURN_FLOAT8(transval->max);
+}
+
+PG_FUNCTION_INFO_V1(colprofile_mean);
+
+/*! mean of a numeric column */
+Datum colprofile_mean(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_numeric_arg(fcinfo);
+
+    if (transval == NULL)
+        PG_RETURN_NULL();
+    PG_RETURN_FLOAT8(transval->mean);
+}
+
+PG_FUNCTION_INFO_V1(colprofile_variance);
+
+/*! sample variance of a numeric column, like var_samp() */
+Datum colprofile_variance(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_numeric_arg(fcinfo);
+
+    if (transval == NULL || transval->count < 2)
+        PG_RETURN_NULL();
+    PG_RETURN_FLOAT8(transval->m2 / (float8)(transval->count - 1));
+}
+
+PG_FUNCTION_INFO_V1(colprofile_dcount);
+
+/*! approximate number of distinct non-NULL values */
+Datum colprofile_dcount(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_arg(fcinfo);
+
+    if (transval == NULL)
+        PG_RETURN_INT64(0);
+    PG_RETURN_INT64(hll_count_distinct_c(
+                        COLPROFILE_SKETCH(transval, COLPROFILE_HLL)));
+}
+
+PG_FUNCTION_INFO_V1(colprofile_quantile);
+
+/*! approximate q-quantile of a numeric column, for 0 <= q <= 1 */
+Datum colprofile_quantile(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_numeric_arg(fcinfo);
+    float8              q = PG_GETARG_FLOAT8(1);
+    qsitem             *items;
+    uint32              n;
+    float8              total;
+
+    if (!(q >= 0 && q <= 1))
+        elog(ERROR, "quantile must be between 0 and 1");
+    if (transval == NULL)
+        PG_RETURN_NULL();
+    if (q == 0)
+        PG_RETURN_FLOAT8(transval->min);
+    if (q == 1)
+        PG_RETURN_FLOAT8(transval->max);
+
+    items = qs_items(COLPROFILE_SKETCH(transval, COLPROFILE_QUANTILE),
+                     &n, &total);
+    PG_RETURN_FLOAT8(qs_items_quantile(items, n, total, q));
+}
+
+/*!
+ * a histogram as a 2-dimensional float8 array of {lo, hi, count} triples,
+ * where the first bucket is [bounds[0], bounds[1]] and the others are
+ * (bounds[i], bounds[i+1]]
+ */
+static ArrayType *colprofile_histogram(qsitem *items, uint32 n,
+                                       float8 *bounds, int32 nbuckets)
+{
+    Datum *histo = (Datum *)palloc(3*nbuckets*sizeof(Datum));
+    float8 below = 0;
+    int    dims[2], lbs[2];
+    int16  typlen;
+    bool   typbyval;
+    char   typalign;
+    int32  i;
+
+    for (i = 0; i < nbuckets; i++) {
+        float8 upto = qs_items_rank(items, n, bounds[i + 1]);
+
+        histo[3*i] = Float8GetDatum(bounds[i]);
+        histo[3*i + 1] = Float8GetDatum(bounds[i + 1]);
+        histo[3*i + 2] = Float8GetDatum(upto - below);
+        below = upto;
+    }
+
+    get_typlenbyvalalign(FLOAT8OID, &typlen, &typbyval, &typalign);
+    dims[0] = nbuckets;
+    dims[1] = 3;
+    lbs[0] = lbs[1] = 1;
+    return construct_md_array(histo, NULL, 2, dims, lbs, FLOAT8OID,
+                              typlen, typbyval, typalign);
+}
+
+PG_FUNCTION_INFO_V1(colprofile_depth_histogram);
+
+/*!
+ * approximate equi-depth histogram of a numeric column: nbuckets buckets
+ * with about the same count each, see colprofile_histogram
+ */
+Datum colprofile_depth_histogram(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_numeric_arg(fcinfo);
+    int32               nbuckets = PG_GETARG_INT32(1);
+    float8             *bounds;
+    qsitem             *items;
+    uint32              n;
+    float8              total;
+    int32               i;
+
+    if (nbuckets <= 0)
+        elog(ERROR, "number of buckets must be positive");
+    if (transval == NULL)
+        PG_RETURN_NULL();
+
+    items = qs_items(COLPROFILE_SKETCH(transval, COLPROFILE_QUANTILE),
+                     &n, &total);
+    bounds = (float8 *)palloc((nbuckets + 1)*sizeof(float8));
+    bounds[0] = transval->min;
+    for (i = 1; i < nbuckets; i++)
+        bounds[i] = qs_items_quantile(items, n, total,
+                                      (float8)i / (float8)nbuckets);
+    bounds[nbuckets] = transval->max;
+
+    PG_RETURN_ARRAYTYPE_P(colprofile_histogram(items, n, bounds, nbuckets));
+}
+
+PG_FUNCTION_INFO_V1(colprofile_width_histogram);
+
+/*!
+ * approximate equi-width histogram of a numeric column: nbuckets buckets
+ * of the same width between the minimum and the maximum, see
+ * colprofile_histogram
+ */
+Datum colprofile_width_histogram(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_numeric_arg(fcinfo);
+    int32               nbuckets = PG_GETARG_INT32(1);
+    float8             *bounds;
+    qsitem             *items;
+    uint32              n;
+    float8              total;
+    int32               i;
+
+    if (nbuckets <= 0)
+        elog(ERROR, "number of buckets must be positive");
+    if (transval == NULL)
+        PG_RETURN_NULL();
+
+    items = qs_items(COLPROFILE_SKETCH(transval, COLPROFILE_QUANTILE),
+                     &n, &total);
+    bounds = (float8 *)palloc((nbuckets + 1)*sizeof(float8));
+    for (i = 0; i < nbuckets; i++)
+        bounds[i] = transval->min
+                    + (transval->max - transval->min) * i / nbuckets;
+    bounds[nbuckets] = transval->max;
+
+    PG_RETURN_ARRAYTYPE_P(colprofile_histogram(items, n, bounds, nbuckets));
+}
+
+PG_FUNCTION_INFO_V1(colprofile_mfv);
+
+/*!
+ * histogram of the most frequent values, as returned by
+ * mfvsketch_quick_histogram, or NULL if the profile kept no mfvs
+ */
+Datum colprofile_mfv(PG_FUNCTION_ARGS)
+{
+    colprofiletransval *transval = colprofile_arg(fcinfo);
+
+    if (transval == NULL || !transval->offsets[COLPROFILE_MFV])
+        PG_RETURN_NULL();
+    PG_RETURN_DATUM(DirectFunctionCall1(__mfvsketch_final,
+        PointerGetDatum(COLPROFILE_SKETCH(transval, COLPROFILE_MFV))));
+}
@@ -5,6 +5,8 @@
  *
  * \implementation
  * The basic CountMin sketch is a set of DEPTH arrays, each with NUMCOUNTERS counters.
+ * (DEPTH and NUMCOUNTERS are the defaults; the depth and width of a sketch can also be
+ * chosen per aggregate call, and are stored in the transition value.)
  * The idea is that each of those arrays is used as an independent random trial of the
  * same process: for all the values x in a set, each holds counts of h_i(x) mod NUMCOUNTERS for a different random hash function h_i.
  * Estimates of the count of some value x are based on the <i>minimum</i> counter h_i(x) across
@@ -38,6 +40,7 @@
 #include "countmin.h"
 
 #include <ctype.h>
+#include <math.h>
 
 PG_FUNCTION_INFO_V1(__cmsketch_int8_trans);
 
@@ -48,7 +51,6 @@ PG_FUNCTION_INFO_V1(__cmsketch_int8_trans);
 Datum __cmsketch_int8_trans(PG_FUNCTION_ARGS)
 {
     bytea *     transblob = NULL;
-    cmtransval *transval;
 
     /*
      * This function makes destructive updates to its arguments.
@@ -67,15 +69,58 @@ Datum __cmsketch_int8_trans(PG_FUNCTION_ARGS)
     /* get the provided element, being careful in case it's NULL */
     if (!PG_ARGISNULL(1)) {
         transblob = cmsketch_check_transval(fcinfo, true);
-        transval = (cmtransval *)(VARDATA(transblob));
 
-        /* the following line modifies the contents of transval, and hence transblob */
-        countmin_dyadic_trans_c(transval, PG_GETARG_DATUM(1));
+        /* this modifies the contents of transblob, or returns a larger copy */
+        transblob = cmsketch_add(transblob, PG_GETARG_INT64(1), 1);
         PG_RETURN_DATUM(PointerGetDatum(transblob));
     }
     else PG_RETURN_DATUM(PointerGetDatum(PG_GETARG_BYTEA_P(0)));
 }
 
+PG_FUNCTION_INFO_V1(__cmsketch_int8_sized_trans);
+
+/*
+ * Same as __cmsketch_int8_trans, but with the depth (number of hash functions)
+ * and width (number of counters per hash function) of the sketches given as
+ * the third and fourth argument
+ */
+Datum __cmsketch_int8_sized_trans(PG_FUNCTION_ARGS)
+{
+    bytea *     transblob;
+    cmtransval *transval;
+    int32       depth = PG_GETARG_INT32(2);
+    int32       width = PG_GETARG_INT32(3);
+
+    if (!(fcinfo->context &&
+          (IsA(fcinfo->context, AggState)
+    #ifdef NOTGP
+           || IsA(fcinfo->context, WindowAggState)
+    #endif
+          )))
+        elog(ERROR,
+             "destructive pass by reference outside agg");
+
+    transblob = PG_GETARG_BYTEA_P(0);
+    if (!CM_TRANSVAL_INITIALIZED(transblob)) {
+        if (depth < 1 || depth > CM_MAX_DEPTH)
+            elog(ERROR, "cmsketch depth must be between 1 and %d", CM_MAX_DEPTH);
+        if (width < 1 || width > CM_MAX_WIDTH)
+            elog(ERROR, "cmsketch width must be between 1 and %d", CM_MAX_WIDTH);
+        transblob = cmsketch_init_sparse_transval(
+            get_fn_expr_argtype(fcinfo->flinfo, 1), depth, width);
+        transval = (cmtransval *)VARDATA(transblob);
+        transval->nargs = 0;
+    }
+    else {
+        transval = (cmtransval *)VARDATA(transblob);
+        if (transval->depth != (uint32)depth || transval->width != (uint32)width)
+            elog(ERROR, "cmsketch depth and width must not change within a group");
+    }
+
+    transblob = cmsketch_add(transblob, PG_GETARG_INT64(1), 1);
+    PG_RETURN_DATUM(PointerGetDatum(transblob));
+}
+
 /*!
  * check if the transblob is not initialized, and do so if not
  * \param transblob a cmsketch transval packed in a bytea
@@ -92,7 +137,8 @@ bytea *cmsketch_check_transval(PG_FUNCTION_ARGS, bool initargs)
      */
     if (!CM_TRANSVAL_INITIALIZED(transblob)) {
         /* XXX would be nice to pfree the existing transblob, but pfree complains. */
-        transblob = cmsketch_init_transval(element_type);
+        transblob = cmsketch_init_sparse_transval(element_type, DEPTH,
+                                                  NUMCOUNTERS);
         transval = (cmtransval *)VARDATA(transblob);
 
         if (initargs) {
@@ -118,65 +164,251 @@ bytea *cmsketch_check_transval(PG_FUNCTION_ARGS, bool initargs)
     return(transblob);
 }
 
-bytea *cmsketch_init_transval(Oid typOid)
+bytea *cmsketch_init_transval(Oid typOid, uint32 depth, uint32 width)
 {
     bool        typIsVarlena;
     cmtransval *transval;
 
     /* allocate and zero out a transval via palloc0 */
-    bytea *     transblob = (bytea *)palloc0(CM_TRANSVAL_SZ);
-    SET_VARSIZE(transblob, CM_TRANSVAL_SZ);
+    bytea *     transblob = (bytea *)palloc0(CM_TRANSVAL_SZ(depth, width));
+    SET_VARSIZE(transblob, CM_TRANSVAL_SZ(depth, width));
 
     transval = (cmtransval *)VARDATA(transblob);
     transval->typOid = typOid;
+    transval->hashtype = SKETCH_HASH_DEFAULT;
+    transval->depth = depth;
+    transval->width = width;
+    transval->status = CM_DENSE;
     getTypeOutputInfo(transval->typOid,
                       &(transval->outFuncOid),
                       &typIsVarlena);
     return(transblob);
 }
 
+/*!
+ * allocate a CM_SPARSE transval, which holds the exact counts of the values
+ * seen until there are too many of them for the sketches of the given size
+ */
+bytea *cmsketch_init_sparse_transval(Oid typOid, uint32 depth, uint32 width)
+{
+    bool        typIsVarlena;
+    cmtransval *transval;
+    uint32      capacity;
+    bytea *     transblob;
+
+    capacity = Min(CM_SPARSE_INITIAL, (Size)RANGES*depth*width/2);
+    transblob = (bytea *)palloc0(CM_SPARSE_SZ(capacity));
+    SET_VARSIZE(transblob, CM_SPARSE_SZ(capacity));
+
+    transval = (cmtransval *)VARDATA(transblob);
+    transval->typOid = typOid;
+    transval->hashtype = SKETCH_HASH_DEFAULT;
+    transval->depth = depth;
+    transval->width = width;
+    transval->status = CM_SPARSE;
+    transval->nvals = 0;
+    transval->capacity = capacity;
+    getTypeOutputInfo(transval->typOid,
+                      &(transval->outFuncOid),
+                      &typIsVarlena);
+    return(transblob);
+}
+
+/*!
+ * get the counter column for each row of a sketch from a hash: row i uses
+ * the i-th run of 16 bits, modulo the width
+ * \param hashval the hashed value
+ * \param depth the number of rows
+ * \param width the number of counters per row
+ * \param cols output array of depth columns
+ */
+static void hash_columns(bytea *hashval, uint32 depth, uint32 width,
+                         uint32 *cols)
+{
+    uint32 i;
+    char  *c;
+
+    /* see the comment on unaligned access in hash_counters_iterate() */
+    for (i = 0, c = (char *)VARDATA(hashval); i < depth; i++, c += 2)
+        cols[i] = *(unsigned short *)c % width;
+}
+
+/*!
+ * add count to the counters of val in the sketches of a CM_DENSE transval,
+ * one for each dyadic range (from 0 up to RANGES-1).
+ * \param transval the cmsketch transval
+ * \param input the value to be inserted
+ * \param count the number of times it is inserted
+ */
+static void countmin_dyadic_add(cmtransval *transval, int64 input,
+                                uint64 count)
+{
+    uint32 cols[RANGES][CM_MAX_DEPTH];
+    uint32 depth = transval->depth;
+    uint32 width = transval->width;
+    int64  val = input;
+    uint32 i, j;
+
+    /*
+     * First find the counters to increment in all dyadic ranges.  Dividing by
+     * 2 for the next range eventually leaves us with 0 or -1, so we only hash
+     * again if the value has changed.
+     */
+    for (j = 0; j < RANGES; j++, val >>= 1) {
+        if (j > 0 && val == (input >> (j - 1)))
+            memcpy(cols[j], cols[j - 1], depth * sizeof(uint32));
+        else
+            hash_columns(sketch_hash_bytea(Int64GetDatum(val), INT8OID,
+                                           transval->hashtype),
+                         depth, width, cols[j]);
+    }
+
+    /* Then increment them in one pass over the sketches */
+    for (j = 0; j < RANGES; j++) {
+        uint64 *sketch = CM_SKETCH(transval, j);
+
+        for (i = 0; i < depth; i++) {
+            uint64 *counter = &sketch[(Size)i * width + cols[j][i]];
+
+            if (*counter > (uint64)INT64_MAX - count)
+                elog(ERROR, "maximum count exceeded in sketch");
+            *counter += count;
+        }
+    }
+}
+
 /*!
  * perform multiple sketch insertions, one for each dyadic range (from 0 up to RANGES-1).
- * * \param transval the cmsketch transval
+ * * \param transval a CM_DENSE cmsketch transval
  * * \param inputi the value to be inserted
  */
 void countmin_dyadic_trans_c(cmtransval *transval, Datum input)
 {
-    uint32 j;
-    
     if (transval->typOid != INT8OID)
         elog(ERROR, "cmsketch can only compute ranges for int64");
+    countmin_dyadic_add(transval, DatumGetInt64(input), 1);
+}
 
-    for (j = 0; j < RANGES; j++) {
-        countmin_trans_c(transval->sketches[j], input, 
-                         transval->outFuncOid, transval->typOid);
-        /* now divide by 2 for the next dyadic range */
-        input = Int64GetDatum(DatumGetInt64(input) >> 1);
+/*!
+ * convert a CM_SPARSE transval into a CM_DENSE one, by inserting the exact
+ * counts into the sketches. Other transvals are returned as they are.
+ */
+bytea *cmsketch_densify(bytea *transblob)
+{
+    cmtransval *sparse = (cmtransval *)VARDATA(transblob);
+    cmtransval *dense;
+    bytea *     newblob;
+    uint32      i;
+
+    if (!CM_TRANSVAL_INITIALIZED(transblob) || sparse->status == CM_DENSE)
+        return(transblob);
+
+    newblob = cmsketch_init_transval(sparse->typOid, sparse->depth,
+                                     sparse->width);
+    dense = (cmtransval *)VARDATA(newblob);
+    memcpy(dense->args, sparse->args, sizeof(dense->args));
+    dense->nargs = sparse->nargs;
+    dense->hashtype = sparse->hashtype;
+    for (i = 0; i < sparse->nvals; i++)
+        countmin_dyadic_add(dense, (int64)sparse->counters[2*i],
+                            sparse->counters[2*i + 1]);
+    return(newblob);
+}
+
+/*!
+ * add count occurrences of val to a transval. This modifies the transval in
+ * place, unless a CM_SPARSE one has to grow, or to become CM_DENSE.
+ * \param transblob an initialized cmsketch transval packed in a bytea
+ * \param val the value to be inserted
+ * \param count the number of times it is inserted
+ * \return the updated transval
+ */
+bytea *cmsketch_add(bytea *transblob, int64 val, uint64 count)
+{
+    cmtransval *transval = (cmtransval *)VARDATA(transblob);
+    uint64 *    pairs;
+    uint32      lo, hi;
+
+    if (transval->typOid != INT8OID)
+        elog(ERROR, "cmsketch can only compute ranges for int64");
+    if (transval->status == CM_DENSE) {
+        countmin_dyadic_add(transval, val, count);
+        return(transblob);
+    }
+
+    /* binary search for the first value that is not smaller than val */
+    pairs = transval->counters;
+    lo = 0;
+    hi = transval->nvals;
+    while (lo < hi) {
+        uint32 mid = lo + (hi - lo)/2;
+
+        if ((int64)pairs[2*mid] < val)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    if (lo < transval->nvals && (int64)pairs[2*lo] == val) {
+        if (pairs[2*lo + 1] > (uint64)INT64_MAX - count)
+            elog(ERROR, "maximum count exceeded in sketch");
+        pairs[2*lo + 1] += count;
+        return(transblob);
+    }
+
+    if (transval->nvals >= CM_SPARSE_LIMIT(transval)) {
+        transblob = cmsketch_densify(transblob);
+        countmin_dyadic_add((cmtransval *)VARDATA(transblob), val, count);
+        return(transblob);
+    }
+    if (transval->nvals == transval->capacity) {
+        /* XXX would be nice to pfree the existing transblob, but pfree complains. */
+        uint32 capacity = Min(2*(Size)transval->capacity,
+                              CM_SPARSE_LIMIT(transval));
+        bytea *newblob = (bytea *)palloc(CM_SPARSE_SZ(capacity));
+
+        memcpy(newblob, transblob, CM_SPARSE_SZ(transval->nvals));
+        SET_VARSIZE(newblob, CM_SPARSE_SZ(capacity));
+        transblob = newblob;
+        transval = (cmtransval *)VARDATA(transblob);
+        transval->capacity = capacity;
+        pairs = transval->counters;
+    }
+
+    memmove(&pairs[2*lo + 2], &pairs[2*lo],
+            (Size)(transval->nvals - lo)*2*sizeof(uint64));
+    pairs[2*lo] = (uint64)val;
+    pairs[2*lo + 1] = count;
+    transval->nvals++;
+    return(transblob);
 }
 
 /*!
  * Main loop of Cormode and Muthukrishnan's sketching algorithm, for setting counters in
- * sketches at a single "dyadic range". For each call, we want to use DEPTH independent
- * hash functions.  We do this by using a single md5 hash function, and taking
+ * sketches at a single "dyadic range". For each call, we want to use depth independent
+ * hash functions.  We do this by using a single 128-bit hash function, and taking
  * successive 16-bit runs of the result as independent hash outputs.
  * \param sketch the current countmin sketch
+ * \param depth the number of rows of the sketch
+ * \param width the number of counters per row of the sketch
+ * \param hashtype the hash function, see SKETCH_HASH_DEFAULT
  * \param dat the datum to be inserted
  * \param outFuncOid Oid of the PostgreSQL function to convert dat to a string
  * \param typOid Oid of the Postgres type for dat
  */
-Datum countmin_trans_c(countmin sketch, Datum dat, Oid outFuncOid, Oid typOid)
+Datum countmin_trans_c(uint64 *sketch, uint32 depth, uint32 width,
+                       uint32 hashtype, Datum dat, Oid outFuncOid, Oid typOid)
 {
 	(void) outFuncOid; /* avoid warning about unused parameter */
     bytea *nhash;
 
-    nhash = sketch_md5_bytea(dat, typOid);
+    nhash = sketch_hash_bytea(dat, typOid, hashtype);
 
     /*
      * iterate through all sketches, incrementing the counters indicated by the hash
      * we don't care about return value here, so 3rd (initialization) argument is arbitrary.
      */
-    (void)hash_counters_iterate(nhash, sketch, 0, &increment_counter);
+    (void)hash_counters_iterate(nhash, sketch, depth, width, 0,
+                                &increment_counter);
     return(PointerGetDatum(nhash));
 }
 
@@ -185,22 +417,355 @@ Datum countmin_trans_c(countmin sketch, Datum dat, Oid outFuncOid, Oid typOid)
  */
 
 /*!
- * return the array of sketch counters as a bytea
+ * return the array of sketch counters as a bytea, preceded by the hash
+ * function, depth and width of the sketches (as three uint32)
  */
 PG_FUNCTION_INFO_V1(__cmsketch_final);
 Datum __cmsketch_final(PG_FUNCTION_ARGS)
 {
     bytea *     blob = PG_GETARG_BYTEA_P(0);
-    cmtransval *sketch = (cmtransval *)VARDATA(blob);
-    int         len = RANGES*sizeof(countmin) + VARHDRSZ;
-    bytea *out = palloc0(len);    
-    
-    memcpy((uint8 *)VARDATA(out), sketch->sketches, len - VARHDRSZ);
+    cmtransval *sketch;
+    Size        countersz;
+    Size        len;
+    bytea *     out;
+
+    /* no input rows: return an empty sketch of default size */
+    if (!CM_TRANSVAL_INITIALIZED(blob))
+        blob = cmsketch_init_transval(INT8OID, DEPTH, NUMCOUNTERS);
+    blob = cmsketch_densify(blob);
+    sketch = (cmtransval *)VARDATA(blob);
+
+    countersz = CM_TRANSVAL_SZ(sketch->depth, sketch->width)
+                - CM_TRANSVAL_SZ(0, 0);
+    len = VARHDRSZ + 3*sizeof(uint32) + countersz;
+    out = palloc(len);
+    ((uint32 *)VARDATA(out))[0] = sketch->hashtype;
+    ((uint32 *)VARDATA(out))[1] = sketch->depth;
+    ((uint32 *)VARDATA(out))[2] = sketch->width;
+    memcpy((uint8 *)VARDATA(out) + 3*sizeof(uint32), sketch->counters,
+           countersz);
+    SET_VARSIZE(out, len);
+
+    PG_RETURN_BYTEA_P(out);
+}
+
+/*
+ * Compact format of a sketch, for storing sketches in tables:
+ *
+ * - the uint32 CM_COMPACT_MAGIC, followed by the hash function, depth and
+ *   width of the sketches and the number nlevels of dyadic ranges stored,
+ *   all as uint32
+ * - for each of the nlevels stored dyadic ranges, the uint32 length in bytes
+ *   of its encoded counters, followed by them
+ *
+ * The dyadic ranges beyond nlevels are the same as the last one stored. This
+ * drops the higher ranges when the values span a narrow range, since all
+ * values end up as 0 or -1 there.
+ *
+ * The depth*width counters of a dyadic range are encoded as a sequence of
+ * pairs of varints (unsigned LEB128), one for each nonzero counter: the
+ * number of zero counters skipped since the previous nonzero one, and the
+ * zigzag-encoded difference to the previous nonzero counter.
+ */
+#define CM_COMPACT_MAGIC 0x315a4d43 /* "CMZ1" in little-endian */
+#define CM_COMPACT_HDRSZ (5*sizeof(uint32))
+
+/*!
+ * append the varint of v at out, unless out is NULL
+ * \return the number of bytes of the varint
+ */
+static Size varint_put(uint8 *out, uint64 v)
+{
+    Size len = 0;
+
+    do {
+        uint8 b = v & 0x7F;
+
+        v >>= 7;
+        if (out) out[len] = b | (v ? 0x80 : 0);
+        len++;
+    } while (v);
+    return len;
+}
+
+/*!
+ * encode the counters of one dyadic range
+ * \param out the output buffer, or NULL to just compute the length
+ * \return the number of bytes of the encoding
+ */
+static Size cmsketch_encode_counters(const uint64 *counters, Size numcounters,
+                                     uint8 *out)
+{
+    Size   i, len = 0, zeros = 0;
+    uint64 prev = 0;
+
+    for (i = 0; i < numcounters; i++) {
+        if (counters[i] == 0) {
+            zeros++;
+            continue;
+        }
+        len += varint_put(out ? out + len : NULL, zeros);
+        /* counters are at most INT64_MAX, so the difference fits an int64 */
+        {
+            int64 delta = (int64)counters[i] - (int64)prev;
+
+            len += varint_put(out ? out + len : NULL,
+                              ((uint64)delta << 1) ^ (uint64)(delta >> 63));
+        }
+        prev = counters[i];
+        zeros = 0;
+    }
+    return len;
+}
+
+/*!
+ * read a varint at *pos, and advance *pos past it
+ */
+static uint64 varint_get(const uint8 *in, Size len, Size *pos)
+{
+    uint64 v = 0;
+    int    shift = 0;
+    uint8  b;
+
+    do {
+        if (*pos >= len || shift > 63)
+            elog(ERROR, "invalid cmsketch");
+        b = in[(*pos)++];
+        v |= (uint64)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return v;
+}
+
+/*!
+ * decode the counters of one dyadic range, into counters that are zero
+ */
+static void cmsketch_decode_counters(const uint8 *in, Size len,
+                                     uint64 *counters, Size numcounters)
+{
+    Size   pos = 0, i = 0;
+    uint64 prev = 0;
+
+    while (pos < len) {
+        uint64 zeros = varint_get(in, len, &pos);
+        uint64 zigzag = varint_get(in, len, &pos);
+
+        if (zeros >= numcounters - i)
+            elog(ERROR, "invalid cmsketch");
+        i += zeros;
+        prev += (uint64)((int64)(zigzag >> 1) ^ -(int64)(zigzag & 1));
+        counters[i++] = prev;
+    }
+}
+
+/*!
+ * get the hash function and dimensions of a sketch in any of the formats
+ * accepted by __cmsketch_compact
+ * \return the counters, or NULL if the sketch is compact
+ */
+static uint64 *cmsketch_parse(bytea *in, uint32 *hashtype, uint32 *depth,
+                              uint32 *width)
+{
+    Size    inlen = VARSIZE(in) - VARHDRSZ;
+    uint32 *hdr = (uint32 *)VARDATA(in);
+
+    if (inlen >= CM_COMPACT_HDRSZ && hdr[0] == CM_COMPACT_MAGIC) {
+        *hashtype = hdr[1];
+        *depth = hdr[2];
+        *width = hdr[3];
+        if (*depth < 1 || *depth > CM_MAX_DEPTH || *width < 1
+            || *width > CM_MAX_WIDTH || hdr[4] < 1 || hdr[4] > RANGES)
+            elog(ERROR, "invalid cmsketch");
+        return NULL;
+    }
+    if (inlen == (Size)RANGES*DEPTH*NUMCOUNTERS*sizeof(uint64)) {
+        *hashtype = SKETCH_HASH_MD5;
+        *depth = DEPTH;
+        *width = NUMCOUNTERS;
+        return (uint64 *)VARDATA(in);
+    }
+    if (inlen < 3*sizeof(uint32))
+        elog(ERROR, "invalid cmsketch");
+    *hashtype = hdr[0];
+    *depth = hdr[1];
+    *width = hdr[2];
+    if (*depth < 1 || *depth > CM_MAX_DEPTH || *width < 1
+        || *width > CM_MAX_WIDTH
+        || inlen != 3*sizeof(uint32)
+                    + (Size)RANGES*(*depth)*(*width)*sizeof(uint64))
+        elog(ERROR, "invalid cmsketch");
+    return (uint64 *)(hdr + 3);
+}
+
+/*!
+ * convert the output of __cmsketch_final into the compact format described
+ * above. Sketches from earlier versions (the counters of a default-sized,
+ * md5-hashed sketch only) are accepted too, and compact sketches are
+ * returned as they are.
+ */
+PG_FUNCTION_INFO_V1(__cmsketch_compact);
+Datum __cmsketch_compact(PG_FUNCTION_ARGS)
+{
+    bytea * in = PG_GETARG_BYTEA_P(0);
+    uint32 *hdr;
+    uint32  hashtype, depth, width, nlevels, j;
+    uint64 *counters;
+    Size    levelsz, len;
+    bytea * out;
+    uint8 * outp;
+
+    counters = cmsketch_parse(in, &hashtype, &depth, &width);
+    if (counters == NULL)
+        PG_RETURN_BYTEA_P(in);
+    levelsz = (Size)depth*width;
+
+    /* drop the dyadic ranges that are the same as the one before */
+    for (nlevels = RANGES; nlevels > 1; nlevels--)
+        if (memcmp(&counters[(nlevels - 1)*levelsz],
+                   &counters[(nlevels - 2)*levelsz],
+                   levelsz*sizeof(uint64)) != 0)
+            break;
+
+    /* compute the size first, then encode */
+    len = VARHDRSZ + CM_COMPACT_HDRSZ;
+    for (j = 0; j < nlevels; j++)
+        len += sizeof(uint32)
+               + cmsketch_encode_counters(&counters[j*levelsz], levelsz, NULL);
+
+    out = (bytea *)palloc(len);
     SET_VARSIZE(out, len);
-    
+    hdr = (uint32 *)VARDATA(out);
+    hdr[0] = CM_COMPACT_MAGIC;
+    hdr[1] = hashtype;
+    hdr[2] = depth;
+    hdr[3] = width;
+    hdr[4] = nlevels;
+    outp = (uint8 *)VARDATA(out) + CM_COMPACT_HDRSZ;
+    for (j = 0; j < nlevels; j++) {
+        uint32 levellen = cmsketch_encode_counters(&counters[j*levelsz],
+                                                   levelsz,
+                                                   outp + sizeof(uint32));
+
+        memcpy(outp, &levellen, sizeof(uint32));
+        outp += sizeof(uint32) + levellen;
+    }
+
     PG_RETURN_BYTEA_P(out);
 }
 
+/*!
+ * multiply a counter by a weight, rounding to the nearest integer
+ */
+uint64 cmsketch_scale_count(uint64 count, float8 weight)
+{
+    float8 scaled = rint((float8)count * weight);
+
+    /* also catches NaN */
+    if (!(scaled < (float8)INT64_MAX))
+        elog(ERROR, "maximum count exceeded in sketch");
+    return (uint64)scaled;
+}
+
+/*!
+ * convert a sketch in any of the formats accepted by __cmsketch_compact into
+ * a CM_DENSE transval, with the counters multiplied by weight
+ */
+static bytea *cmsketch_from_sketch(bytea *in, float8 weight)
+{
+    uint32      hashtype, depth, width, nlevels, j;
+    uint64 *    counters = cmsketch_parse(in, &hashtype, &depth, &width);
+    bytea *     transblob = cmsketch_init_transval(INT8OID, depth, width);
+    cmtransval *transval = (cmtransval *)VARDATA(transblob);
+    Size        levelsz = (Size)depth*width;
+    Size        i;
+
+    transval->hashtype = hashtype;
+    transval->nargs = -1;
+    if (counters)
+        memcpy(transval->counters, counters,
+               RANGES*levelsz*sizeof(uint64));
+    else {
+        const uint8 *p = (uint8 *)VARDATA(in) + CM_COMPACT_HDRSZ;
+        const uint8 *end = (uint8 *)VARDATA(in) + VARSIZE(in) - VARHDRSZ;
+
+        nlevels = ((uint32 *)VARDATA(in))[4];
+        for (j = 0; j < nlevels; j++) {
+            uint32 levellen;
+
+            if ((Size)(end - p) < sizeof(uint32))
+                elog(ERROR, "invalid cmsketch");
+            memcpy(&levellen, p, sizeof(uint32));
+            p += sizeof(uint32);
+            if ((Size)(end - p) < levellen)
+                elog(ERROR, "invalid cmsketch");
+            cmsketch_decode_counters(p, levellen, CM_SKETCH(transval, j),
+                                     levelsz);
+            p += levellen;
+        }
+        for (; j < RANGES; j++)
+            memcpy(CM_SKETCH(transval, j), CM_SKETCH(transval, nlevels - 1),
+                   levelsz*sizeof(uint64));
+    }
+
+    if (weight != 1)
+        for (i = 0; i < RANGES*levelsz; i++)
+            transval->counters[i] = cmsketch_scale_count(transval->counters[i],
+                                                         weight);
+    return(transblob);
+}
+
+PG_FUNCTION_INFO_V1(__cmsketch_merge_trans);
+
+/*!
+ * transition function to add up finished sketches, e.g. one per time period,
+ * each with its counters multiplied by an optional weight (like an
+ * exponential decay in the age of the period)
+ */
+Datum __cmsketch_merge_trans(PG_FUNCTION_ARGS)
+{
+    bytea *     transblob = PG_GETARG_BYTEA_P(0);
+    float8      weight = (PG_NARGS() > 2) ? PG_GETARG_FLOAT8(2) : 1;
+    bytea *     sketch;
+    cmtransval *transval;
+    cmtransval *newval;
+    Size        i, numcounters;
+
+    if (!(fcinfo->context &&
+          (IsA(fcinfo->context, AggState)
+    #ifdef NOTGP
+           || IsA(fcinfo->context, WindowAggState)
+    #endif
+          )))
+        elog(ERROR,
+             "destructive pass by reference outside agg");
+
+    if (isnan(weight) || weight < 0)
+        elog(ERROR, "cmsketch weight must be a non-negative number");
+
+    /* the sketches are base64 text, like the output of cmsketch */
+    sketch = DatumGetByteaP(DirectFunctionCall2(binary_decode,
+                                                PG_GETARG_DATUM(1),
+                                                PointerGetDatum(cstring_to_text("base64"))));
+    sketch = cmsketch_from_sketch(sketch, weight);
+    if (!CM_TRANSVAL_INITIALIZED(transblob))
+        PG_RETURN_DATUM(PointerGetDatum(sketch));
+
+    transval = (cmtransval *)VARDATA(transblob);
+    newval = (cmtransval *)VARDATA(sketch);
+    if (transval->hashtype != newval->hashtype)
+        elog(ERROR, "cannot merge cmsketches built with different hash functions");
+    if (transval->depth != newval->depth || transval->width != newval->width)
+        elog(ERROR, "cannot merge cmsketches of different depth or width");
+
+    numcounters = (Size)RANGES * transval->depth * transval->width;
+    for (i = 0; i < numcounters; i++) {
+        if (transval->counters[i] > (uint64)INT64_MAX - newval->counters[i])
+            elog(ERROR, "maximum count exceeded in sketch");
+        transval->counters[i] += newval->counters[i];
+    }
+    PG_RETURN_DATUM(PointerGetDatum(transblob));
+}
+
 /*!
  * Greenplum "prefunc" to combine sketches from multiple machines
  */
@@ -212,11 +777,8 @@ Datum __cmsketch_merge(PG_FUNCTION_ARGS)
     cmtransval *transval1 = (cmtransval *)VARDATA(counterblob1);
     cmtransval *transval2 = (cmtransval *)VARDATA(counterblob2);
     cmtransval *newtrans;
-    countmin *  sketches2 = (countmin *)
-                            ((cmtransval *)(VARDATA(counterblob2)))->sketches;
     bytea *     newblob;
-    countmin *  newsketches;
-    uint32      i, j, k;
+    Size        i, numcounters;
     int         sz;
 
     /* make sure they're initialized! */
@@ -224,27 +786,53 @@ Datum __cmsketch_merge(PG_FUNCTION_ARGS)
         && !CM_TRANSVAL_INITIALIZED(counterblob2))
         /* if both are empty can return one of them */
         PG_RETURN_DATUM(PointerGetDatum(counterblob1));
-    else if (!CM_TRANSVAL_INITIALIZED(counterblob1)) {
-        counterblob1 = cmsketch_init_transval(transval2->typOid);
-        transval1 = (cmtransval *)VARDATA(counterblob1);
+    else if (!CM_TRANSVAL_INITIALIZED(counterblob1)
+             || !CM_TRANSVAL_INITIALIZED(counterblob2)) {
+        /* return a copy of the one that is not empty */
+        bytea *blob = CM_TRANSVAL_INITIALIZED(counterblob1) ? counterblob1
+                                                            : counterblob2;
+
+        newblob = (bytea *)palloc(VARSIZE(blob));
+        memcpy(newblob, blob, VARSIZE(blob));
+        PG_RETURN_DATUM(PointerGetDatum(newblob));
     }
-    else if (!CM_TRANSVAL_INITIALIZED(counterblob2)) {
-        counterblob2 = cmsketch_init_transval(transval1->typOid);
+
+    if (transval1->hashtype != transval2->hashtype)
+        elog(ERROR, "cannot merge cmsketches built with different hash functions");
+    if (transval1->depth != transval2->depth
+        || transval1->width != transval2->width)
+        elog(ERROR, "cannot merge cmsketches of different depth or width");
+
+    /*
+     * allocate a new transval as a copy of the dense input, or of the one
+     * with more exact counts if both are sparse, and add in the other
+     */
+    if (transval1->status == CM_SPARSE
+        && (transval2->status == CM_DENSE
+            || transval2->nvals > transval1->nvals)) {
+        bytea *tmp = counterblob1;
+
+        counterblob1 = counterblob2;
+        counterblob2 = tmp;
+        transval1 = (cmtransval *)VARDATA(counterblob1);
         transval2 = (cmtransval *)VARDATA(counterblob2);
     }
-
     sz = VARSIZE(counterblob1);
-    /* allocate a new transval as a copy of counterblob1 */
     newblob = (bytea *)palloc(sz);
     memcpy(newblob, counterblob1, sz);
-    newtrans = (cmtransval *)(VARDATA(newblob));
-    newsketches = (countmin *)(newtrans)->sketches;
 
-    /* add in values from counterblob2 */
-    for (i = 0; i < RANGES; i++)
-        for (j = 0; j < DEPTH; j++)
-            for (k = 0; k < NUMCOUNTERS; k++)
-                newsketches[i][j][k] += sketches2[i][j][k];
+    if (transval1->status == CM_DENSE && transval2->status == CM_DENSE) {
+        newtrans = (cmtransval *)(VARDATA(newblob));
+        numcounters = (Size)RANGES * newtrans->depth * newtrans->width;
+        for (i = 0; i < numcounters; i++)
+            newtrans->counters[i] += transval2->counters[i];
+    }
+    else {
+        for (i = 0; i < transval2->nvals; i++)
+            newblob = cmsketch_add(newblob, (int64)transval2->counters[2*i],
+                                   transval2->counters[2*i + 1]);
+        newtrans = (cmtransval *)(VARDATA(newblob));
+    }
 
     if (newtrans->nargs == -1) {
         /* transfer in the args from the other input */
@@ -268,20 +856,22 @@ Datum __cmsketch_merge(PG_FUNCTION_ARGS)
  * \param arg the Datum we want to find the count of
  * \param funcOid the Postgres function that converts arg to a string
  */
-int64 cmsketch_count_c(countmin sketch, Datum arg, Oid funcOid, Oid typOid)
+int64 cmsketch_count_c(uint64 *sketch, uint32 depth, uint32 width,
+                       uint32 hashtype, Datum arg, Oid funcOid, Oid typOid)
 {
     bytea *nhash;
 
-    /* get the md5 hash of the argument. */
-    nhash = sketch_md5_bytea(arg, typOid);
-    return(cmsketch_count_md5_datum(sketch, nhash, funcOid));
+    /* get the hash of the argument. */
+    nhash = sketch_hash_bytea(arg, typOid, hashtype);
+    return(cmsketch_count_hashed_datum(sketch, depth, width, nhash, funcOid));
 }
 
-int64 cmsketch_count_md5_datum(countmin sketch, bytea *md5_bytea, Oid funcOid)
+int64 cmsketch_count_hashed_datum(uint64 *sketch, uint32 depth, uint32 width,
+                                  bytea *hash_bytea, Oid funcOid)
 {
 	(void) funcOid; /* avoid warning about unused parameter */
     /* iterate through the sketches, finding the min counter associated with this hash */
-    return(hash_counters_iterate(md5_bytea, sketch, INT64_MAX,
+    return(hash_counters_iterate(hash_bytea, sketch, depth, width, INT64_MAX,
                                           &min_counter));
 }
 
@@ -294,39 +884,46 @@ PG_FUNCTION_INFO_V1(cmsketch_dump);
  */
 Datum cmsketch_dump(PG_FUNCTION_ARGS)
 {
-    bytea *   transblob = (bytea *)PG_GETARG_BYTEA_P(0);
-    countmin *sketches;
-    char *    newblob = (char *)palloc(10240);
-    uint32    i, j, k, c;
-
-    sketches = ((cmtransval *)VARDATA(transblob))->sketches;
-    for (i=0, c=0; i < RANGES; i++)
-        for (j=0; j < DEPTH; j++)
-            for(k=0; k < NUMCOUNTERS; k++) {
-                if (sketches[i][j][k] != 0)
+    bytea *     transblob = cmsketch_densify((bytea *)PG_GETARG_BYTEA_P(0));
+    cmtransval *transval = (cmtransval *)VARDATA(transblob);
+    char *      newblob = (char *)palloc(10240);
+    uint32      i, j, k, c;
+
+    for (i=0, c=0; i < RANGES; i++) {
+        uint64 *sketch = CM_SKETCH(transval, i);
+        for (j=0; j < transval->depth; j++)
+            for(k=0; k < transval->width; k++) {
+                uint64 cnt = sketch[(Size)j * transval->width + k];
+                if (cnt != 0)
                     c += sprintf(&newblob[c], "[(%d,%d,%d):" INT64_FORMAT
-                                 "], ", i, j, k, sketches[i][j][k]);
+                                 "], ", i, j, k, cnt);
                 if (c > 10000) break;
             }
+    }
     newblob[c] = '\0';
     PG_RETURN_NULL();
 }
 
 
 /*!
- * for each row of the sketch, use the 16 bits starting at 2^i mod NUMCOUNTERS,
+ * for each row of the sketch, use the 16 bits starting at 2^i mod width,
  * and invoke the lambda on those 16 bits (which may destructively modify counters).
- * \param hashval the MD5 hashed value that we take 16 bits at a time
- * \param sketch the cmsketch
+ * \param hashval the hashed value that we take 16 bits at a time
+ * \param sketch the cmsketch, as depth rows of width counters
+ * \param depth the number of rows of the sketch
+ * \param width the number of counters per row of the sketch
  * \param initial the initialized return value
  * \param lambdaptr the function to invoke on each 16 bits
  */
 int64 hash_counters_iterate(bytea *hashval,
-                            countmin sketch, /* width is DEPTH*NUMCOUNTERS */
+                            uint64 *sketch,
+                            uint32 depth,
+                            uint32 width,
                             int64 initial,
                             int64 (*lambdaptr)(uint32,
                                                uint32,
-                                               countmin,
+                                               uint64 *,
+                                               uint32,
                                                int64))
 {
     uint32         i, col;
@@ -341,11 +938,11 @@ int64 hash_counters_iterate(bytea *hashval,
      * XXX However the deref of 2 bytes seems to work OK.
      */
     for (i = 0, c = (char *)VARDATA(hashval); 
-         i < DEPTH; 
+         i < depth; 
          i++, c += 2) {
         twobytes = *(unsigned short *)c;
-        col = twobytes % NUMCOUNTERS;
-        retval = (*lambdaptr)(i, col, sketch, retval);
+        col = twobytes % width;
+        retval = (*lambdaptr)(i, col, sketch, width, retval);
     }
     return retval;
 }
@@ -356,20 +953,23 @@ int64 hash_counters_iterate(bytea *hashval,
  * \param i which row to update
  * \param col which column to update
  * \param sketch the sketch
+ * \param width the number of counters per row of the sketch
  * \param transval we don't need transval here, but its part of the
  * lambda interface for hash_counters_iterate
  */
 
 int64 increment_counter(uint32 i,
                         uint32 col,
-                        countmin sketch,
+                        uint64 *sketch,
+                        uint32 width,
                         int64 transval)
 {
 	(void) transval; /* avoid warning about unused parameter */
-    int64 oldval = sketch[i][col];
-    if (sketch[i][col] == (INT64_MAX))
+    uint64 *counter = &sketch[(Size)i * width + col];
+    int64 oldval = *counter;
+    if (*counter == (INT64_MAX))
         elog(ERROR, "maximum count exceeded in sketch");
-    sketch[i][col] = oldval + 1;
+    *counter = oldval + 1;
 
     /* return the incremented value, though unlikely anyone cares. */
     return oldval+1;
@@ -380,14 +980,16 @@ int64 increment_counter(uint32 i,
  * \param i which row to examine
  * \param col which column to examine
  * \param sketch the sketch
+ * \param width the number of counters per row of the sketch
  * \param transval smallest counter so far
  * lambda interface for hash_counters_iterate
  */
 int64 min_counter(uint32 i,
                   uint32 col,
-                  countmin sketch,
+                  uint64 *sketch,
+                  uint32 width,
                   int64 transval)
 {
-    int64 thisval = sketch[i][col];
+    int64 thisval = sketch[(Size)i * width + col];
     return (thisval < transval) ? thisval : transval;
 }
@@ -8,9 +8,15 @@
 #define _COUNTMIN_H_
 #define INT64BITS (sizeof(int64)*CHAR_BIT)
 #define RANGES INT64BITS
-#define DEPTH 8 /* magic tuning value: number of hash functions */
+#define DEPTH 8 /* magic tuning value: default number of hash functions */
 /* #define NUMCOUNTERS 65535 */
-#define NUMCOUNTERS 1024  /* another magic tuning value: modulus of hash functions */
+#define NUMCOUNTERS 1024  /* another magic tuning value: default modulus of hash functions */
+/*
+ * Each row uses a different 16-bit chunk of a single 128-bit hash, which bounds
+ * the depth and width of a sketch
+ */
+#define CM_MAX_DEPTH 8
+#define CM_MAX_WIDTH 65536
 
 #ifdef INT64_IS_BUSTED
 #define MAX_INT64 (INT64CONST(0x7FFFFFFF))
@@ -27,16 +33,27 @@
 
 
 /*!
- * \brief the CountMin sketch array
+ * \brief the CountMin sketch array of default size
  *
  * a CountMin sketch is a set of DEPTH arrays of NUMCOUNTERS each.
  * It's like a "counting Bloom Filter" where instead of just hashing to
- * DEPTH bitmaps, we count up hash-collisions in DEPTH counter arrays
+ * DEPTH bitmaps, we count up hash-collisions in DEPTH counter arrays.
+ * The functions below take a sketch as a pointer to its first counter,
+ * together with its depth and width, so that they also work for the
+ * variable-sized sketches in a cmtransval.
  */
 typedef uint64 countmin[DEPTH][NUMCOUNTERS];
 
 #define MAXARGS 3
 
+/*!
+ * a cmtransval starts out CM_SPARSE, holding exact counts of the values seen,
+ * since groups of few values are common, and the sketches take
+ * 64*depth*width counters. It becomes CM_DENSE past CM_SPARSE_LIMIT values,
+ * like FM sketches switch from a sortasort to bitmaps in fm.c.
+ */
+typedef enum {CM_DENSE, CM_SPARSE} cmstatus;
+
 /*!
  * \internal
  * \brief the transition value struct for CM sketches
@@ -50,13 +67,40 @@ typedef struct {
     int nargs;            /*! number of args being carried for finalizer */
     Oid typOid;     /*! oid of the data type we are sketching */
     Oid outFuncOid; /*! oid of the OutFunc for that data type */
-    countmin sketches[RANGES];
+    uint32 hashtype; /*! hash function, see SKETCH_HASH_DEFAULT */
+    uint32 depth;   /*! number of rows (hash functions) of each sketch */
+    uint32 width;   /*! number of counters in each row */
+    cmstatus status; /*! whether counters holds sketches or exact counts */
+    uint32 nvals;    /*! number of exact counts, if CM_SPARSE */
+    uint32 capacity; /*! room for exact counts, if CM_SPARSE */
+    /*!
+     * If CM_DENSE, RANGES sketches of depth*width counters each, stored
+     * row-major one after the other. If CM_SPARSE, nvals pairs of a value
+     * (as int64) and its count, sorted by value.
+     */
+    uint64 counters[];
 } cmtransval;
 
-/*! base size of a cmtransval */
-#define CM_TRANSVAL_SZ (VARHDRSZ + sizeof(cmtransval))
+/*! size of a cmtransval with the given sketch dimensions */
+#define CM_TRANSVAL_SZ(depth, width) (VARHDRSZ + sizeof(cmtransval) + \
+                                      (Size)RANGES*(depth)*(width)*sizeof(uint64))
 
-#define CM_TRANSVAL_INITIALIZED(t) (VARSIZE(t) >= CM_TRANSVAL_SZ)
+#define CM_TRANSVAL_INITIALIZED(t) (VARSIZE(t) >= CM_TRANSVAL_SZ(0, 0))
+
+/*! size of a CM_SPARSE cmtransval with room for the given number of counts */
+#define CM_SPARSE_SZ(capacity) (VARHDRSZ + sizeof(cmtransval) + \
+                                (Size)(capacity)*2*sizeof(uint64))
+#define CM_SPARSE_INITIAL 16
+#define CM_SPARSE_MAX 1024
+/*!
+ * number of exact counts past which a cmtransval becomes CM_DENSE; small
+ * sketches do so before the counts take more space than the sketches
+ */
+#define CM_SPARSE_LIMIT(t) Min(CM_SPARSE_MAX, \
+                               (Size)RANGES*(t)->depth*(t)->width/2)
+
+/*! the sketch for dyadic range r of a cmtransval */
+#define CM_SKETCH(t, r) (&(t)->counters[(Size)(r)*(t)->depth*(t)->width])
 
 
 /*!
@@ -109,6 +153,12 @@ typedef struct {
  * Each mfv entry contains an offset from the top of the structure where
  * we can find a Postgres text object holding the output format of a
  * frequent value.
+ *
+ * Between the mfv entries and the values, the transval holds an index over
+ * the entries (see MFV_SLOTS etc.): an open-addressing hash table of
+ * MFV_HASH_SIZE(max_mfvs) slots, each 0 or an entry number plus one; the
+ * hash of every entry; and a min-heap of entry numbers ordered by count,
+ * together with the heap position of every entry.
  * \endinternal
  */
 typedef struct {
@@ -129,8 +179,24 @@ typedef struct {
     offsetcnt mfvs[];
 } mfvtransval;
 
+/*! number of hash table slots for i mfvs, keeping the load below 1/2 */
+#define MFV_HASH_SIZE(i) (2*(i) + 1)
+
+/*! size of the index of i mfvs */
+#define MFV_INDEX_SZ(i) MAXALIGN((MFV_HASH_SIZE(i) + 3*(i))*sizeof(int32))
+
 /*! base size of an MFV transval */
-#define MFV_TRANSVAL_SZ(i) (VARHDRSZ + sizeof(mfvtransval) + i*sizeof(offsetcnt))
+#define MFV_TRANSVAL_SZ(i) (VARHDRSZ + sizeof(mfvtransval) + \
+                            (i)*sizeof(offsetcnt) + MFV_INDEX_SZ(i))
+
+/*! hash table of an mfvtransval */
+#define MFV_SLOTS(t) ((int32 *)&(t)->mfvs[(t)->max_mfvs])
+/*! hash of every mfv */
+#define MFV_HASHES(t) ((uint32 *)(MFV_SLOTS(t) + MFV_HASH_SIZE((t)->max_mfvs)))
+/*! min-heap of mfvs by count */
+#define MFV_HEAP(t) ((int32 *)(MFV_HASHES(t) + (t)->max_mfvs))
+/*! position of every mfv in the heap */
+#define MFV_HEAPPOS(t) (MFV_HEAP(t) + (t)->max_mfvs)
 
 /*! free space remaining for text values */
 #define MFV_TRANSVAL_CAPACITY(transblob) (VARSIZE(transblob) - VARHDRSZ - \
@@ -138,43 +204,53 @@ typedef struct {
                                           next_offset)
                                           
 /* countmin aggregate protos */
-Datum  countmin_trans_c(countmin, Datum, Oid, Oid);
+Datum  countmin_trans_c(uint64 *, uint32, uint32, uint32, Datum, Oid, Oid);
 bytea *cmsketch_check_transval(PG_FUNCTION_ARGS, bool);
-bytea *cmsketch_init_transval(Oid);
+bytea *cmsketch_init_transval(Oid, uint32, uint32);
+bytea *cmsketch_init_sparse_transval(Oid, uint32, uint32);
+bytea *cmsketch_densify(bytea *);
+bytea *cmsketch_add(bytea *, int64, uint64);
+uint64 cmsketch_scale_count(uint64, float8);
 void   countmin_dyadic_trans_c(cmtransval *, Datum);
 
 /* countmin scalar function protos */
-int64  cmsketch_count_c(countmin, Datum, Oid, Oid);
-int64  cmsketch_count_md5_datum(countmin, bytea *, Oid);
+int64  cmsketch_count_c(uint64 *, uint32, uint32, uint32, Datum, Oid, Oid);
+int64  cmsketch_count_hashed_datum(uint64 *, uint32, uint32, bytea *, Oid);
 
 /* hash_counters_iterate and its lambdas */
-int64  hash_counters_iterate(bytea *, countmin, int64, int64 (*lambdaptr)(
+int64  hash_counters_iterate(bytea *, uint64 *, uint32, uint32, int64,
+                             int64 (*lambdaptr)(
+                                 uint32,
                                  uint32,
+                                 uint64 *,
                                  uint32,
-                                 countmin,
                                  int64));
 
-int64  increment_counter(uint32, uint32, countmin, int64);
-int64  min_counter(uint32, uint32, countmin, int64);
+int64  increment_counter(uint32, uint32, uint64 *, uint32, int64);
+int64  min_counter(uint32, uint32, uint64 *, uint32, int64);
 
 /* MFV protos */
 bytea *mfv_transval_append(bytea *, Datum);
-int    mfv_find(bytea *, Datum);
+int    mfv_find(bytea *, Datum, uint32);
 bytea *mfv_transval_replace(bytea *, Datum, int);
 bytea *mfv_transval_insert_at(bytea *, Datum, uint32);
 void *mfv_transval_getval(bytea *, uint32);
 bytea *mfv_init_transval(int, Oid);
 bytea *mfvsketch_merge_c(bytea *, bytea *);
+bytea *mfv_trans_hashed(bytea *, Datum, bytea *);
 void   mfv_copy_datum(bytea *, int, Datum);
 int cnt_cmp_desc(const void *i, const void *j);
 
 
 /* UDF protos */
 Datum __cmsketch_int8_trans(PG_FUNCTION_ARGS);
+Datum __cmsketch_int8_sized_trans(PG_FUNCTION_ARGS);
 Datum cmsketch_width_histogram(PG_FUNCTION_ARGS);
 Datum cmsketch_dhistogram(PG_FUNCTION_ARGS);
 Datum __cmsketch_final(PG_FUNCTION_ARGS);
+Datum __cmsketch_compact(PG_FUNCTION_ARGS);
 Datum __cmsketch_merge(PG_FUNCTION_ARGS);
+Datum __cmsketch_merge_trans(PG_FUNCTION_ARGS);
 Datum cmsketch_dump(PG_FUNCTION_ARGS);
 Datum __cmsketch_count_final(PG_FUNCTION_ARGS);
 Datum __cmsketch_rangecount_final(PG_FUNCTION_ARGS);
@@ -184,6 +260,7 @@ Datum __cmsketch_dhist_final(PG_FUNCTION_ARGS);
 Datum __mfvsketch_trans(PG_FUNCTION_ARGS);
 Datum __mfvsketch_final(PG_FUNCTION_ARGS);
 Datum __mfvsketch_merge(PG_FUNCTION_ARGS);
+Datum __mfvsketch_merge_trans(PG_FUNCTION_ARGS);
 
 #endif /* _COUNTMIN_H_ */
 
@@ -54,7 +54,7 @@ PG_MODULE_MAGIC;
  * initial size for a sortasort: we'll guess at 8 bytes per datum.
  * sortasort will grow dynamically if we guessed too low
  */
-#define SORTASORT_INITIAL_STORAGE  sizeof(sortasort) + MINVALS*sizeof(uint32) + \
+#define SORTASORT_INITIAL_STORAGE  sizeof(sortasort) + SORTASORT_DIR_SZ(MINVALS) + \
     8*MINVALS
 
 typedef enum {SMALL, BIG} fmstatus;
@@ -76,6 +76,7 @@ typedef struct {
     Oid      funcOid;
     int16    typLen;
     bool     typByVal;   
+    uint32   hashtype;   /*! hash function, see SKETCH_HASH_DEFAULT */
     char storage[];
 } fmtransval;
 
@@ -140,6 +141,7 @@ Datum __fmsketch_trans(PG_FUNCTION_ARGS)
             /* figure out the outfunc for this type */
             getTypeOutputInfo(element_type, &funcOid, &typIsVarlena);
             get_typlenbyval(element_type, &(transval->typLen), &(transval->typByVal));
+            transval->hashtype = SKETCH_HASH_DEFAULT;
             transval->status = SMALL;
             sortasort_init((sortasort *)transval->storage,
                            MINVALS,
@@ -231,6 +233,8 @@ bytea *fm_new(fmtransval *template)
     /* copy over the struct values */
     if (template != NULL)
         memcpy(transval, template, sizeof(fmtransval));    
+    else
+        transval->hashtype = SKETCH_HASH_DEFAULT;
 
     /* set status to BIG, possibly overwriting what was in template */
     transval->status = BIG;
@@ -241,7 +245,7 @@ bytea *fm_new(fmtransval *template)
 
 /*!
  * Main logic of Flajolet and Martin's sketching algorithm.
- * For each call, we get an md5 hash of the value passed in.
+ * For each call, we get a 128-bit hash of the value passed in.
  * First we use the hash as a random number to choose one of
  * the NMAP bitmaps at random to update.
  * Then we find the position "rmost" of the rightmost 1 bit in the hashed value.
@@ -260,7 +264,7 @@ Datum __fmsketch_trans_c(bytea *transblob, Datum indat)
     // char        *hex;
     bytea       *hashed;
 
-    hashed = sketch_md5_bytea(indat, transval->typOid);
+    hashed = sketch_hash_bytea(indat, transval->typOid, transval->hashtype);
     c = (uint8 *)VARDATA(hashed);
     // hex = text_to_cstring((bytea *)DatumGetPointer(DirectFunctionCall2(binary_encode, PointerGetDatum(hashed),
     //                       CStringGetTextDatum("hex"))));
@@ -376,6 +380,25 @@ Datum __fmsketch_merge(PG_FUNCTION_ARGS)
     if (transval1->status == BIG && transval2->status == BIG) {
         /* easy case: merge two FM sketches via bitwise OR. */
         fmtransval *newval;
+
+        if (transval1->hashtype != transval2->hashtype)
+            elog(ERROR,
+                 "cannot merge FM sketches built with different hash functions");
+
+        /*
+         * In an agg context, the left transval is ours to modify, so OR the
+         * right one into it. Otherwise, merge into a fresh copy.
+         */
+        if (fcinfo->context &&
+            (IsA(fcinfo->context, AggState)
+    #ifdef NOTGP
+             || IsA(fcinfo->context, WindowAggState)
+    #endif
+            )) {
+            big_or((bytea *)transval1->storage, (bytea *)transval2->storage,
+                   (bytea *)transval1->storage);
+            PG_RETURN_DATUM(PointerGetDatum(transblob1));
+        }
         tblob_big = fm_new(transval1);
         newval = (fmtransval *)VARDATA(tblob_big);
 
@@ -443,9 +466,16 @@ Datum __fmsketch_merge(PG_FUNCTION_ARGS)
     PG_RETURN_DATUM(PointerGetDatum(tblob_big));
 }
 
-/*! OR of two big bitmaps, for gathering sketches computed in parallel. */
+/*!
+ * OR of two big bitmaps, for gathering sketches computed in parallel.
+ * out may be the same as bitmap1 or bitmap2.
+ */
 void big_or(bytea *bitmap1, bytea *bitmap2, bytea *out)
 {
+    uint8 * b1 = (uint8 *)VARDATA(bitmap1);
+    uint8 * b2 = (uint8 *)VARDATA(bitmap2);
+    uint8 * o = (uint8 *)VARDATA(out);
+    uint32  len = VARSIZE(bitmap1) - VARHDRSZ;
     uint32  i;
 
     if (VARSIZE(bitmap1) != VARSIZE(bitmap2))
@@ -461,10 +491,20 @@ void big_or(bytea *bitmap1, bytea *bitmap2, bytea *out)
              VARSIZE(out),
              VARSIZE(bitmap1));
 
-    /* could probably be more efficient doing this 32 or 64 bits at a time */
-    for (i=0; i < VARSIZE(bitmap1) - VARHDRSZ; i++)
-        ((char *)(VARDATA(out)))[i] = ((char *)(VARDATA(bitmap1)))[i] |
-                                      ((char *)(VARDATA(bitmap2)))[i];
+    /*
+     * 64 bits at a time. The bitmaps need not be aligned, so go through
+     * memcpy(), which compilers turn into plain (vectorizable) loads.
+     */
+    for (i = 0; i + sizeof(uint64) <= len; i += sizeof(uint64)) {
+        uint64 w1, w2;
+
+        memcpy(&w1, b1 + i, sizeof(uint64));
+        memcpy(&w2, b2 + i, sizeof(uint64));
+        w1 |= w2;
+        memcpy(o + i, &w1, sizeof(uint64));
+    }
+    for (; i < len; i++)
+        o[i] = b1[i] | b2[i];
 }
 
 /*!
@@ -502,9 +542,8 @@ bytea *fmsketch_sortasort_insert(bytea *transblob, Datum dat, size_t len)
          */
 
         new_storage_sz = s_in->storage_sz*2 + len;
-        /* XXX THIS POINTER ARITHMETIC SHOULD BE HIDDEN BY A MACRO IN THE SORTASORT LIBRARY! */
         newsize = VARHDRSZ + sizeof(fmtransval) + sizeof(sortasort)
-                  + s_in->capacity*sizeof(s_in->dir[0]) +
+                  + SORTASORT_DIR_SZ(s_in->capacity) +
                   new_storage_sz;
         newblob = (bytea *)palloc(newsize);
         memcpy(newblob, transblob, VARSIZE(transblob));
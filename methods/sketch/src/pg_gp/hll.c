@@ -0,0 +1,437 @@
+/*!
+ * \file hll.c
+ *
+ * \brief HyperLogLog sketch implementation
+ */
+/*!
+ * \implementation
+ * Like FM, the HyperLogLog sketch hashes every value and uses part of the hash
+ * to pick one of many substreams.  Instead of a bitmap per substream,
+ * HyperLogLog only keeps a small register with the maximum "rank" seen so far,
+ * where the rank is the position of the rightmost 1 bit in the rest of the hash.
+ * The distinct count is then estimated from the harmonic mean of 2^register
+ * across all HLL_REGISTERS registers.  With 2^14 registers of one byte each,
+ * the standard error is about 0.8%, in 16KB of state.
+ *
+ * Following HyperLogLog++, small sets are kept in a sparse encoding instead:
+ * a sorted array holding one (index, rank) pair for every substream seen,
+ * where the index uses a much higher precision (HLL_SPARSE_PRECISION bits)
+ * than the dense registers.  For those, linear counting over the
+ * 2^HLL_SPARSE_PRECISION substreams is nearly exact.  Once the sparse array
+ * would take more than half the space of the dense registers, the sketch is
+ * converted.  Because the rank bits do not overlap the index bits, a sparse
+ * entry maps to its dense register just by dropping the low index bits.
+ *
+ * We do not apply the empirical bias correction of HyperLogLog++, so
+ * estimates between roughly 2.5 and 5 times HLL_REGISTERS are a few percent
+ * high.
+ *
+ * Merging two sketches takes the maximum of every register (or merges the
+ * sorted sparse arrays), so per-segment sketches combine cheaply.
+ *
+ * See P. Flajolet et al., "HyperLogLog: the analysis of a near-optimal
+ * cardinality estimation algorithm", AofA 2007, and S. Heule et al.,
+ * "HyperLogLog in Practice", EDBT 2013, for details and error bounds.
+ */
+
+#include "postgres.h"
+#include "utils/elog.h"
+#include "utils/builtins.h"
+#include "nodes/execnodes.h"
+#include "fmgr.h"
+#include "sketch_support.h"
+#include "hll.h"
+#include <math.h>
+
+/*! number of index bits for the dense registers */
+#define HLL_PRECISION 14
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+/*! number of index bits for sparse entries */
+#define HLL_SPARSE_PRECISION 25
+/*! number of bits in a sparse entry holding the rank */
+#define HLL_RANK_BITS 7
+#define HLL_RANK_MASK ((1 << HLL_RANK_BITS) - 1)
+/*! initial number of sparse entries allocated */
+#define HLL_SPARSE_INITIAL 64
+/*! switch to dense registers beyond this many sparse entries */
+#define HLL_SPARSE_MAX (HLL_REGISTERS*sizeof(uint8)/(2*sizeof(uint32)))
+
+typedef enum {HLL_SPARSE, HLL_DENSE} hllstatus;
+
+/*!
+ * \internal
+ * \brief transition value struct for HyperLogLog sketches
+ *
+ * In HLL_SPARSE mode the storage is a sorted array of nentries uint32
+ * entries, each holding a sparse index in the upper bits and the rank in the
+ * lower HLL_RANK_BITS bits.  The allocated number of entries follows from the
+ * size of the enclosing bytea.
+ * In HLL_DENSE mode the storage is an array of HLL_REGISTERS uint8 registers.
+ * \endinternal
+ */
+typedef struct {
+    uint32 status;
+    uint32 hashtype;     /*! hash function, see SKETCH_HASH_DEFAULT */
+    Oid    typOid;
+    uint32 nentries;
+    char   storage[];
+} hlltransval;
+
+#define HLL_TRANSVAL(blob) ((hlltransval *)VARDATA(blob))
+#define HLL_SPARSE_ENTRIES(t) ((uint32 *)(t)->storage)
+#define HLL_REGS(t) ((uint8 *)(t)->storage)
+#define HLL_SPARSE_CAPACITY(blob) \
+    ((VARSIZE(blob) - VARHDRSZ - sizeof(hlltransval))/sizeof(uint32))
+/*! dense register of a sparse entry */
+#define HLL_ENTRY_REGISTER(e) \
+    ((e) >> (HLL_RANK_BITS + HLL_SPARSE_PRECISION - HLL_PRECISION))
+#define HLL_ENTRY_INDEX(e) ((e) >> HLL_RANK_BITS)
+#define HLL_ENTRY_RANK(e) ((e) & HLL_RANK_MASK)
+
+/*!
+ * generate a bytea holding an empty sparse transval.
+ * \param template the transval whose type and hash function we copy
+ * \param capacity the number of sparse entries to make room for
+ */
+static bytea *hll_new_sparse(hlltransval *template, uint32 capacity)
+{
+    size_t       sz = VARHDRSZ + sizeof(hlltransval) + capacity*sizeof(uint32);
+    bytea       *newblob = (bytea *)palloc0(sz);
+    hlltransval *transval = HLL_TRANSVAL(newblob);
+
+    SET_VARSIZE(newblob, sz);
+    transval->status = HLL_SPARSE;
+    transval->hashtype = template->hashtype;
+    transval->typOid = template->typOid;
+    transval->nentries = 0;
+    return newblob;
+}
+
+/*!
+ * generate a bytea holding dense registers, filled in from a sparse or dense
+ * transval.
+ * \param template the transval to copy
+ */
+static bytea *hll_new_dense(hlltransval *template)
+{
+    size_t       sz = VARHDRSZ + sizeof(hlltransval) + HLL_REGISTERS;
+    bytea       *newblob = (bytea *)palloc0(sz);
+    hlltransval *transval = HLL_TRANSVAL(newblob);
+    uint8       *regs = HLL_REGS(transval);
+    uint32       i;
+
+    SET_VARSIZE(newblob, sz);
+    transval->status = HLL_DENSE;
+    transval->hashtype = template->hashtype;
+    transval->typOid = template->typOid;
+    transval->nentries = 0;
+
+    if (template->status == HLL_DENSE)
+        memcpy(regs, HLL_REGS(template), HLL_REGISTERS);
+    else
+        for (i = 0; i < template->nentries; i++) {
+            uint32 e = HLL_SPARSE_ENTRIES(template)[i];
+            uint32 r = HLL_ENTRY_REGISTER(e);
+
+            if (regs[r] < HLL_ENTRY_RANK(e))
+                regs[r] = HLL_ENTRY_RANK(e);
+        }
+    return newblob;
+}
+
+/*!
+ * Turn the hash of a value into a sparse entry.  The first 64 bits of the
+ * hash choose the substream, the rank is one more than the number of
+ * trailing zeros in the second 64 bits.
+ * \param hashed the hash of the value, see sketch_hash_bytea
+ */
+static uint32 hll_hash_entry(bytea *hashed)
+{
+    uint8  *c = (uint8 *)VARDATA(hashed);
+    uint64  word;
+    uint32  rank;
+
+    memcpy(&word, c, sizeof(uint64));
+    rank = rightmost_one(c, 2, 64, 1) + 1;
+
+    return ((uint32)(word >> (64 - HLL_SPARSE_PRECISION)) << HLL_RANK_BITS)
+           | rank;
+}
+
+/*!
+ * Add an entry to a sparse transval, in place if there is room.
+ * \returns the transition value, which may be a new (sparse or dense) bytea
+ */
+static bytea *hll_sparse_insert(bytea *transblob, uint32 entry)
+{
+    hlltransval *transval = HLL_TRANSVAL(transblob);
+    uint32      *entries = HLL_SPARSE_ENTRIES(transval);
+    uint32       lo = 0, hi = transval->nentries;
+    uint32       capacity;
+
+    /* binary search for the first entry with an index >= ours */
+    while (lo < hi) {
+        uint32 mid = lo + (hi - lo)/2;
+
+        if (HLL_ENTRY_INDEX(entries[mid]) < HLL_ENTRY_INDEX(entry))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < transval->nentries
+        && HLL_ENTRY_INDEX(entries[lo]) == HLL_ENTRY_INDEX(entry)) {
+        if (HLL_ENTRY_RANK(entries[lo]) < HLL_ENTRY_RANK(entry))
+            entries[lo] = entry;
+        return transblob;
+    }
+
+    capacity = HLL_SPARSE_CAPACITY(transblob);
+    if (transval->nentries == capacity) {
+        bytea *newblob;
+
+        if (capacity >= HLL_SPARSE_MAX) {
+            /* the dense registers are now smaller: switch over */
+            newblob = hll_new_dense(transval);
+            transval = HLL_TRANSVAL(newblob);
+            if (HLL_REGS(transval)[HLL_ENTRY_REGISTER(entry)] <
+                HLL_ENTRY_RANK(entry))
+                HLL_REGS(transval)[HLL_ENTRY_REGISTER(entry)] =
+                    HLL_ENTRY_RANK(entry);
+            return newblob;
+        }
+        /* we can't use repalloc, for the same reasons as fm.c */
+        newblob = hll_new_sparse(transval, Min(capacity*2, HLL_SPARSE_MAX));
+        memcpy(HLL_SPARSE_ENTRIES(HLL_TRANSVAL(newblob)), entries,
+               transval->nentries*sizeof(uint32));
+        HLL_TRANSVAL(newblob)->nentries = transval->nentries;
+        transblob = newblob;
+        transval = HLL_TRANSVAL(transblob);
+        entries = HLL_SPARSE_ENTRIES(transval);
+    }
+
+    memmove(&entries[lo + 1], &entries[lo],
+            (transval->nentries - lo)*sizeof(uint32));
+    entries[lo] = entry;
+    transval->nentries++;
+    return transblob;
+}
+
+PG_FUNCTION_INFO_V1(__hllsketch_trans);
+
+/*! UDA transition function for the hllsketch aggregate. */
+Datum __hllsketch_trans(PG_FUNCTION_ARGS)
+{
+    bytea       *transblob = (bytea *)PG_GETARG_BYTEA_P(0);
+    hlltransval *transval;
+    Oid          element_type = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+    if (!OidIsValid(element_type))
+        elog(ERROR, "could not determine data type of input");
+
+    /* registers and sparse entries are updated in place, see fm.c */
+    if (!(fcinfo->context &&
+          (IsA(fcinfo->context, AggState)
+    #ifdef NOTGP
+           || IsA(fcinfo->context, WindowAggState)
+    #endif
+          )))
+        elog(
+            ERROR,
+            "UDF call to a function that only works for aggs (destructive pass by reference)");
+
+    if (PG_ARGISNULL(1))
+        PG_RETURN_BYTEA_P(transblob);
+
+    /* on the first call, we get the empty initcond */
+    if (VARSIZE(transblob) <= VARHDRSZ)
+        transblob = hll_init_transval(element_type);
+    transval = HLL_TRANSVAL(transblob);
+
+    PG_RETURN_BYTEA_P(hll_trans_hashed(transblob,
+                                       sketch_hash_bytea(PG_GETARG_DATUM(1),
+                                                         transval->typOid,
+                                                         transval->hashtype)));
+}
+
+/*!
+ * generate a bytea holding an empty HyperLogLog sketch for values of type
+ * typOid, hashed with SKETCH_HASH_DEFAULT.
+ */
+bytea *hll_init_transval(Oid typOid)
+{
+    hlltransval template;
+
+    template.hashtype = SKETCH_HASH_DEFAULT;
+    template.typOid = typOid;
+    return hll_new_sparse(&template, HLL_SPARSE_INITIAL);
+}
+
+/*!
+ * Add a value to an initialized sketch, in place if possible.
+ * \param transblob the transition value
+ * \param hashed the hash of the value, computed with the hash function of
+ *        the sketch
+ * \returns the transition value, which may be a new bytea
+ */
+bytea *hll_trans_hashed(bytea *transblob, bytea *hashed)
+{
+    hlltransval *transval = HLL_TRANSVAL(transblob);
+    uint32       entry = hll_hash_entry(hashed);
+
+    if (transval->status == HLL_SPARSE)
+        transblob = hll_sparse_insert(transblob, entry);
+    else if (HLL_REGS(transval)[HLL_ENTRY_REGISTER(entry)] <
+             HLL_ENTRY_RANK(entry))
+        HLL_REGS(transval)[HLL_ENTRY_REGISTER(entry)] = HLL_ENTRY_RANK(entry);
+    return transblob;
+}
+
+PG_FUNCTION_INFO_V1(__hllsketch_merge);
+
+/*!
+ * Greenplum "prefunc": merge two transvals computed at different segments.
+ * Sparse arrays are merged like sorted lists, keeping the larger rank for
+ * equal indexes.  As soon as one side is dense, the result is the
+ * register-wise maximum.
+ */
+Datum __hllsketch_merge(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BYTEA_P(hll_merge_c((bytea *)PG_GETARG_BYTEA_P(0),
+                                  (bytea *)PG_GETARG_BYTEA_P(1)));
+}
+
+/*!
+ * implementation of the merge of two HyperLogLog sketches, see
+ * __hllsketch_merge.  The result is a new bytea unless one of the inputs is
+ * empty, in which case the other is returned.
+ */
+bytea *hll_merge_c(bytea *transblob1, bytea *transblob2)
+{
+    hlltransval *transval1, *transval2, *newval;
+    bytea       *newblob;
+    uint32       i, j;
+
+    /* deal with the case where one or both items is the initial value of '' */
+    if (VARSIZE(transblob1) <= VARHDRSZ)
+        return transblob2;
+    if (VARSIZE(transblob2) <= VARHDRSZ)
+        return transblob1;
+
+    transval1 = HLL_TRANSVAL(transblob1);
+    transval2 = HLL_TRANSVAL(transblob2);
+    if (transval1->hashtype != transval2->hashtype)
+        elog(ERROR,
+             "cannot merge HyperLogLog sketches built with different hash functions");
+
+    if (transval1->status == HLL_SPARSE && transval2->status == HLL_SPARSE) {
+        uint32 *e1 = HLL_SPARSE_ENTRIES(transval1);
+        uint32 *e2 = HLL_SPARSE_ENTRIES(transval2);
+        uint32 *out;
+        uint32  n = 0;
+
+        newblob = hll_new_sparse(transval1,
+                                 transval1->nentries + transval2->nentries);
+        newval = HLL_TRANSVAL(newblob);
+        out = HLL_SPARSE_ENTRIES(newval);
+        i = j = 0;
+        while (i < transval1->nentries || j < transval2->nentries) {
+            if (j == transval2->nentries
+                || (i < transval1->nentries
+                    && HLL_ENTRY_INDEX(e1[i]) < HLL_ENTRY_INDEX(e2[j])))
+                out[n++] = e1[i++];
+            else if (i == transval1->nentries
+                     || HLL_ENTRY_INDEX(e2[j]) < HLL_ENTRY_INDEX(e1[i]))
+                out[n++] = e2[j++];
+            else {
+                /* equal indexes: entries sort by rank within an index */
+                out[n++] = Max(e1[i], e2[j]);
+                i++;
+                j++;
+            }
+        }
+        newval->nentries = n;
+
+        if (n > HLL_SPARSE_MAX)
+            newblob = hll_new_dense(newval);
+        return newblob;
+    }
+
+    /* at least one side is dense: start from it and fold in the other */
+    if (transval1->status != HLL_DENSE) {
+        hlltransval *tmp = transval1;
+
+        transval1 = transval2;
+        transval2 = tmp;
+    }
+    newblob = hll_new_dense(transval1);
+    newval = HLL_TRANSVAL(newblob);
+    if (transval2->status == HLL_DENSE) {
+        uint8 *regs = HLL_REGS(newval);
+        uint8 *other = HLL_REGS(transval2);
+
+        for (i = 0; i < HLL_REGISTERS; i++)
+            regs[i] = Max(regs[i], other[i]);
+    }
+    else
+        for (i = 0; i < transval2->nentries; i++) {
+            uint32 e = HLL_SPARSE_ENTRIES(transval2)[i];
+            uint32 r = HLL_ENTRY_REGISTER(e);
+
+            if (HLL_REGS(newval)[r] < HLL_ENTRY_RANK(e))
+                HLL_REGS(newval)[r] = HLL_ENTRY_RANK(e);
+        }
+
+    return newblob;
+}
+
+PG_FUNCTION_INFO_V1(__hllsketch_count_distinct);
+
+/*!
+ * UDA final function to get count(distinct) out of a HyperLogLog sketch.
+ * For sparse sketches, we use linear counting over the sparse substreams.
+ * For dense ones, we use the HyperLogLog estimate, falling back to linear
+ * counting over the registers in the small range where it is more accurate.
+ */
+Datum __hllsketch_count_distinct(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_INT64(hll_count_distinct_c((bytea *)PG_GETARG_BYTEA_P(0)));
+}
+
+/*! the distinct count estimate of a HyperLogLog sketch */
+int64 hll_count_distinct_c(bytea *transblob)
+{
+    hlltransval *transval;
+    double       m, estimate;
+
+    if (VARSIZE(transblob) <= VARHDRSZ)
+        /* nothing was ever aggregated! */
+        return 0;
+
+    transval = HLL_TRANSVAL(transblob);
+    if (transval->status == HLL_SPARSE) {
+        m = (double)(1 << HLL_SPARSE_PRECISION);
+        estimate = m * log(m / (m - transval->nentries));
+    }
+    else if (transval->status == HLL_DENSE) {
+        uint8  *regs = HLL_REGS(transval);
+        double  sum = 0;
+        uint32  zeros = 0;
+        uint32  i;
+
+        m = (double)HLL_REGISTERS;
+        for (i = 0; i < HLL_REGISTERS; i++) {
+            sum += ldexp(1.0, -(int)regs[i]);
+            if (regs[i] == 0)
+                zeros++;
+        }
+        estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+        if (estimate <= 2.5 * m && zeros > 0)
+            estimate = m * log(m / zeros);
+    }
+    else {
+        elog(ERROR, "HyperLogLog transval neither sparse nor dense");
+        return 0;
+    }
+
+    return (int64)floor(estimate + 0.5);
+}
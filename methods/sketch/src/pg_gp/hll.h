@@ -0,0 +1,19 @@
+/*!
+ * \file hll.h
+ *
+ * \brief header file for HyperLogLog sketches
+ */
+#ifndef _HLL_H_
+#define _HLL_H_
+
+bytea *hll_init_transval(Oid);
+bytea *hll_trans_hashed(bytea *, bytea *);
+bytea *hll_merge_c(bytea *, bytea *);
+int64  hll_count_distinct_c(bytea *);
+
+/* UDF protos */
+Datum __hllsketch_trans(PG_FUNCTION_ARGS);
+Datum __hllsketch_merge(PG_FUNCTION_ARGS);
+Datum __hllsketch_count_distinct(PG_FUNCTION_ARGS);
+
+#endif /* _HLL_H_ */
@@ -43,6 +43,14 @@
 #include "funcapi.h"
 
 #include <ctype.h>
+#include <math.h>
+
+static uint32 mfv_hash_of(bytea *);
+static void   mfv_slot_insert(mfvtransval *, uint32, uint32);
+static void   mfv_slot_remove(mfvtransval *, uint32);
+static void   mfv_heap_push(mfvtransval *, uint32);
+static void   mfv_heap_sift_down(mfvtransval *, uint32);
+static int    mfv_order_cmp_desc(const void *, const void *, void *);
 
 PG_FUNCTION_INFO_V1(__mfvsketch_trans);
 
@@ -56,9 +64,6 @@ Datum __mfvsketch_trans(PG_FUNCTION_ARGS)
     Datum        newdatum  = PG_GETARG_DATUM(1);
     int          max_mfvs  = PG_GETARG_INT32(2);
     mfvtransval *transval;
-    uint64       tmpcnt;
-    int          i;
-    Datum        md5_datum;
 
     /*
      * This function makes destructive updates to its arguments.
@@ -84,41 +89,65 @@ Datum __mfvsketch_trans(PG_FUNCTION_ARGS)
         PG_RETURN_DATUM(PointerGetDatum(transblob));
 
     transval = (mfvtransval *)VARDATA(transblob);
+    PG_RETURN_DATUM(PointerGetDatum(
+        mfv_trans_hashed(transblob, newdatum,
+                         sketch_hash_bytea(newdatum, transval->typOid,
+                                           SKETCH_HASH_DEFAULT))));
+}
+
+/*!
+ * count a value in an initialized mfv sketch, and update its most frequent
+ * values
+ * \param transblob a bytea holding an mfv transval
+ * \param newdatum the value
+ * \param hashed the hash of the value, computed with SKETCH_HASH_DEFAULT
+ * \returns the transition value, which may be a new bytea
+ */
+bytea *mfv_trans_hashed(bytea *transblob, Datum newdatum, bytea *hashed)
+{
+    mfvtransval *transval = (mfvtransval *)VARDATA(transblob);
+    uint64       tmpcnt;
+    int          i;
+    uint32       hash;
+
     /* insert into the countmin sketch */
-    md5_datum = countmin_trans_c(transval->sketch,
-                                newdatum,
-                                transval->outFuncOid,
-                                transval->typOid);
+    (void)hash_counters_iterate(hashed, (uint64 *)transval->sketch,
+                                DEPTH, NUMCOUNTERS, 0, &increment_counter);
 
-    tmpcnt = cmsketch_count_md5_datum(transval->sketch,
-                                      (bytea *)DatumGetPointer(md5_datum),
-                                      transval->outFuncOid);
-    i = mfv_find(transblob, newdatum);
+    tmpcnt = cmsketch_count_hashed_datum((uint64 *)transval->sketch,
+                                         DEPTH, NUMCOUNTERS, hashed,
+                                         transval->outFuncOid);
+    hash = mfv_hash_of(hashed);
+    i = mfv_find(transblob, newdatum, hash);
 
     if (i > -1) {
+        /* counts only grow, so the entry can only move down the heap */
         transval->mfvs[i].cnt = tmpcnt;
+        mfv_heap_sift_down(transval, MFV_HEAPPOS(transval)[i]);
     }
-    else {
-        /* try to insert as either a new or replacement entry */
-        for (i = 0; i < (int)transval->max_mfvs; i++) {
-            if ((i == (int)transval->next_mfv)) {
-                /* room for new */
-                transblob = mfv_transval_append(transblob, newdatum);
-                transval = (mfvtransval *)VARDATA(transblob);
-                transval->mfvs[i].cnt = tmpcnt;
-                break;
-            }
-            else if (transval->mfvs[i].cnt < tmpcnt) {
-                /* arg beats this mfv */
-                transblob = mfv_transval_replace(transblob, newdatum, i);
-                transval = (mfvtransval *)VARDATA(transblob);
-                transval->mfvs[i].cnt = tmpcnt;
-                break;
-            }
-            /* else this is not a frequent value */
+    else if (transval->next_mfv < transval->max_mfvs) {
+        /* room for new */
+        transblob = mfv_transval_append(transblob, newdatum);
+        transval = (mfvtransval *)VARDATA(transblob);
+        i = transval->next_mfv - 1;
+        transval->mfvs[i].cnt = tmpcnt;
+        mfv_slot_insert(transval, i, hash);
+        mfv_heap_push(transval, i);
+    }
+    else if (transval->max_mfvs > 0) {
+        /* arg replaces the least frequent mfv, if it beats it */
+        i = MFV_HEAP(transval)[0];
+        if (transval->mfvs[i].cnt < tmpcnt) {
+            mfv_slot_remove(transval, i);
+            transblob = mfv_transval_replace(transblob, newdatum, i);
+            transval = (mfvtransval *)VARDATA(transblob);
+            transval->mfvs[i].cnt = tmpcnt;
+            mfv_slot_insert(transval, i, hash);
+            mfv_heap_sift_down(transval, 0);
         }
+        /* else this is not a frequent value */
     }
-    PG_RETURN_DATUM(PointerGetDatum(transblob));
+    return transblob;
 }
 
 /*!
@@ -130,18 +159,26 @@ Datum __mfvsketch_trans(PG_FUNCTION_ARGS)
  * at offset 0!
  * \param blob a bytea holding an mfv transval
  * \param val the datum to search for
+ * \param hash the hash of val, see mfv_hash_of
  */
-int mfv_find(bytea *blob, Datum val)
+int mfv_find(bytea *blob, Datum val, uint32 hash)
 {
     mfvtransval *transval = (mfvtransval *)VARDATA(blob);
-    unsigned     i;
+    int32       *slots = MFV_SLOTS(transval);
+    uint32      *hashes = MFV_HASHES(transval);
+    uint32       size = MFV_HASH_SIZE(transval->max_mfvs);
+    uint32       s;
     uint32       len;
     void *       datp;
     Datum        iDat;
     void        *valp = DatumExtractPointer(val, transval->typByVal);
 
-    /* look for existing entry for this value */
-    for (i = 0; i < transval->next_mfv; i++) {
+    /* probe the hash table until we hit an empty slot */
+    for (s = hash % size; slots[s] != 0; s = (s + 1) % size) {
+        uint32 i = slots[s] - 1;
+
+        if (hashes[i] != hash)
+            continue;
         /* if they're the same */
         datp = mfv_transval_getval(blob,i);
         iDat = PointerExtractDatum(datp, transval->typByVal);
@@ -156,6 +193,126 @@ int mfv_find(bytea *blob, Datum val)
     return(-1);
 }
 
+/*!
+ * the hash of a value used for the mfv hash table, taken from the hash
+ * that was already computed for the countmin sketch.
+ * \param hashed a bytea holding the hash of the value
+ */
+static uint32 mfv_hash_of(bytea *hashed)
+{
+    uint32 hash;
+
+    memcpy(&hash, VARDATA(hashed), sizeof(uint32));
+    return hash;
+}
+
+/*!
+ * add mfv <c>i</c> to the hash table
+ * \param transval an mfv transval
+ * \param i the index of the mfv
+ * \param hash the hash of its value
+ */
+static void mfv_slot_insert(mfvtransval *transval, uint32 i, uint32 hash)
+{
+    int32  *slots = MFV_SLOTS(transval);
+    uint32  size = MFV_HASH_SIZE(transval->max_mfvs);
+    uint32  s;
+
+    MFV_HASHES(transval)[i] = hash;
+    for (s = hash % size; slots[s] != 0; s = (s + 1) % size)
+        ;
+    slots[s] = i + 1;
+}
+
+/*!
+ * remove mfv <c>i</c> from the hash table.  Later entries of the same probe
+ * sequence are shifted back, so that no tombstones are needed.
+ * \param transval an mfv transval
+ * \param i the index of the mfv
+ */
+static void mfv_slot_remove(mfvtransval *transval, uint32 i)
+{
+    int32  *slots = MFV_SLOTS(transval);
+    uint32 *hashes = MFV_HASHES(transval);
+    uint32  size = MFV_HASH_SIZE(transval->max_mfvs);
+    uint32  s, j, home;
+
+    for (s = hashes[i] % size; slots[s] != (int32)(i + 1); s = (s + 1) % size)
+        if (slots[s] == 0)
+            elog(ERROR, "mfv sketch hash table is corrupt");
+
+    slots[s] = 0;
+    for (j = (s + 1) % size; slots[j] != 0; j = (j + 1) % size) {
+        home = hashes[slots[j] - 1] % size;
+        /* move the entry back into the hole unless its home lies in (s, j] */
+        if ((s < j) ? (home <= s || home > j) : (home <= s && home > j)) {
+            slots[s] = slots[j];
+            slots[j] = 0;
+            s = j;
+        }
+    }
+}
+
+/*! swap two positions of the mfv heap */
+static void mfv_heap_swap(mfvtransval *transval, uint32 a, uint32 b)
+{
+    int32 *heap = MFV_HEAP(transval);
+    int32 *pos = MFV_HEAPPOS(transval);
+    int32  tmp = heap[a];
+
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    pos[heap[a]] = a;
+    pos[heap[b]] = b;
+}
+
+/*!
+ * add the newly appended mfv <c>i</c> at the bottom of the heap and move
+ * it up to its place
+ * \param transval an mfv transval
+ * \param i the index of the mfv, which must be next_mfv - 1
+ */
+static void mfv_heap_push(mfvtransval *transval, uint32 i)
+{
+    int32 *heap = MFV_HEAP(transval);
+    uint32 p = i;
+
+    heap[p] = i;
+    MFV_HEAPPOS(transval)[i] = p;
+    while (p > 0 && transval->mfvs[heap[(p - 1)/2]].cnt
+                    > transval->mfvs[heap[p]].cnt) {
+        mfv_heap_swap(transval, p, (p - 1)/2);
+        p = (p - 1)/2;
+    }
+}
+
+/*!
+ * move the mfv at heap position <c>p</c> down after its count grew
+ * \param transval an mfv transval
+ * \param p the heap position
+ */
+static void mfv_heap_sift_down(mfvtransval *transval, uint32 p)
+{
+    int32  *heap = MFV_HEAP(transval);
+    uint32  n = transval->next_mfv;
+
+    for (;;) {
+        uint32 smallest = p;
+        uint32 l = 2*p + 1, r = 2*p + 2;
+
+        if (l < n && transval->mfvs[heap[l]].cnt
+                     < transval->mfvs[heap[smallest]].cnt)
+            smallest = l;
+        if (r < n && transval->mfvs[heap[r]].cnt
+                     < transval->mfvs[heap[smallest]].cnt)
+            smallest = r;
+        if (smallest == p)
+            break;
+        mfv_heap_swap(transval, p, smallest);
+        p = smallest;
+    }
+}
+
 /*!
  * Initialize an mfv sketch
  * \param max_mfvs the number of "bins" in the histogram
@@ -350,6 +507,7 @@ Datum __mfvsketch_final(PG_FUNCTION_ARGS)
     mfvtransval *transval = (mfvtransval *)VARDATA(transblob);
     ArrayType *  retval;
     uint32       i;
+    uint32      *order;
     int          dims[2], lbs[2];
     /* Oid     typInput, typIOParam; */
     Oid          outFuncOid;
@@ -375,17 +533,26 @@ Datum __mfvsketch_final(PG_FUNCTION_ARGS)
 
     transval = (mfvtransval *)VARDATA(transblob);
 
-    qsort(transval->mfvs, transval->next_mfv, sizeof(offsetcnt), cnt_cmp_desc);
+    /*
+     * sort the mfvs by count without moving them, since the hash table and
+     * heap refer to them by position (the final function may be called
+     * before further transitions in a window).
+     */
+    order = (uint32 *)palloc(Max(transval->next_mfv, 1)*sizeof(uint32));
+    for (i = 0; i < transval->next_mfv; i++)
+        order[i] = i;
+    qsort_arg(order, transval->next_mfv, sizeof(uint32), mfv_order_cmp_desc,
+              transval);
     getTypeOutputInfo(INT8OID,
                       &outFuncOid,
                       &typIsVarlena);
 
     for (i = 0; i < transval->next_mfv; i++) {
-        void *tmpp = mfv_transval_getval(transblob,i);
+        void *tmpp = mfv_transval_getval(transblob,order[i]);
         Datum curval = PointerExtractDatum(tmpp, transval->typByVal);
         char *countbuf =
             OidOutputFunctionCall(outFuncOid,
-                                  Int64GetDatum(transval->mfvs[i].cnt));
+                                  Int64GetDatum(transval->mfvs[order[i]].cnt));
         char *valbuf = OidOutputFunctionCall(transval->outFuncOid, curval);
         
         histo[i][0] = PointerGetDatum(cstring_to_text(valbuf));
@@ -432,6 +599,21 @@ int cnt_cmp_desc(const void *i, const void *j)
     return (p->cnt - o->cnt);
 }
 
+/*!
+ * support function to sort mfv positions by count
+ * \param i an mfv position cast to a (void *)
+ * \param j an mfv position cast to a (void *)
+ * \param arg the mfvtransval
+ */
+static int mfv_order_cmp_desc(const void *i, const void *j, void *arg)
+{
+    mfvtransval *transval = (mfvtransval *)arg;
+    uint64       ci = transval->mfvs[*(const uint32 *)i].cnt;
+    uint64       cj = transval->mfvs[*(const uint32 *)j].cnt;
+
+    return (ci < cj) ? 1 : ((ci > cj) ? -1 : 0);
+}
+
 
 /*!
  * Greenplum "prefunc" to combine sketches from multiple machines.
@@ -446,6 +628,58 @@ Datum __mfvsketch_merge(PG_FUNCTION_ARGS)
     PG_RETURN_DATUM(PointerGetDatum(mfvsketch_merge_c(transblob1, transblob2)));
 }
 
+PG_FUNCTION_INFO_V1(__mfvsketch_merge_trans);
+
+/*!
+ * transition function to merge stored mfv sketches, e.g. one per time period,
+ * each with its counts multiplied by an optional weight (like an exponential
+ * decay in the age of the period)
+ */
+Datum __mfvsketch_merge_trans(PG_FUNCTION_ARGS)
+{
+    bytea *      transblob = PG_GETARG_BYTEA_P(0);
+    bytea *      sketch = PG_GETARG_BYTEA_P_COPY(1);
+    float8       weight = (PG_NARGS() > 2) ? PG_GETARG_FLOAT8(2) : 1;
+    mfvtransval *transval = (mfvtransval *)VARDATA(transblob);
+    mfvtransval *sketchval = (mfvtransval *)VARDATA(sketch);
+    uint32       i, j;
+
+    if (!(fcinfo->context &&
+          (IsA(fcinfo->context, AggState)
+   #ifdef NOTGP
+           || IsA(fcinfo->context, WindowAggState)
+   #endif
+          )))
+        elog(ERROR,
+             "destructive pass by reference outside agg");
+
+    if (isnan(weight) || weight < 0)
+        elog(ERROR, "mfvsketch weight must be a non-negative number");
+
+    /* skip the sketches of empty inputs */
+    if (VARSIZE(sketch) < MFV_TRANSVAL_SZ(0))
+        PG_RETURN_DATUM(PointerGetDatum(transblob));
+    if (VARSIZE(sketch) < MFV_TRANSVAL_SZ(sketchval->max_mfvs)
+        || sketchval->next_mfv > sketchval->max_mfvs)
+        elog(ERROR, "invalid mfv sketch");
+    if (VARSIZE(transblob) >= MFV_TRANSVAL_SZ(0)
+        && transval->typOid != sketchval->typOid)
+        elog(ERROR, "cannot merge mfv sketches of different types");
+
+    if (weight != 1) {
+        for (i = 0; i < DEPTH; i++)
+            for (j = 0; j < NUMCOUNTERS; j++)
+                sketchval->sketch[i][j] =
+                    cmsketch_scale_count(sketchval->sketch[i][j], weight);
+        for (i = 0; i < sketchval->next_mfv; i++)
+            sketchval->mfvs[i].cnt =
+                cmsketch_scale_count(sketchval->mfvs[i].cnt, weight);
+    }
+
+    /* this modifies both arguments, hence the copy of the sketch */
+    PG_RETURN_DATUM(PointerGetDatum(mfvsketch_merge_c(transblob, sketch)));
+}
+
 /*!
  * implementation of the merge of two mfv sketches.  we
  * first merge the embedded countmin sketches to get the
@@ -461,7 +695,7 @@ bytea *mfvsketch_merge_c(bytea *transblob1, bytea *transblob2)
     mfvtransval *transval2 = (mfvtransval *)VARDATA(transblob2);
     void        *newblob;
     mfvtransval *newval;
-    uint32       i, j, cnt;
+    uint32       i, j;
 
     /* handle uninitialized args */
     if (VARSIZE(transblob1) <= sizeof(MFV_TRANSVAL_SZ(0))
@@ -491,7 +725,9 @@ bytea *mfvsketch_merge_c(bytea *transblob1, bytea *transblob2)
         void *tmpp = mfv_transval_getval(transblob1,i);
         Datum dat = PointerExtractDatum(tmpp, transval1->typByVal);
 
-        transval1->mfvs[i].cnt = cmsketch_count_c(newval->sketch,
+        transval1->mfvs[i].cnt = cmsketch_count_c((uint64 *)newval->sketch,
+                                                  DEPTH, NUMCOUNTERS,
+                                                  SKETCH_HASH_DEFAULT,
                                                   dat,
                                                   newval->outFuncOid,
                                                   newval->typOid);
@@ -500,7 +736,9 @@ bytea *mfvsketch_merge_c(bytea *transblob1, bytea *transblob2)
         void *tmpp = mfv_transval_getval(transblob2,i);
         Datum dat = PointerExtractDatum(tmpp, transval2->typByVal);
 
-        transval2->mfvs[i].cnt = cmsketch_count_c(newval->sketch,
+        transval2->mfvs[i].cnt = cmsketch_count_c((uint64 *)newval->sketch,
+                                                  DEPTH, NUMCOUNTERS,
+                                                  SKETCH_HASH_DEFAULT,
                                                   dat,
                                                   newval->outFuncOid,
                                                   newval->typOid);
@@ -510,35 +748,47 @@ bytea *mfvsketch_merge_c(bytea *transblob1, bytea *transblob2)
     qsort(transval1->mfvs, transval1->next_mfv, sizeof(offsetcnt), cnt_cmp_desc);
     qsort(transval2->mfvs, transval2->next_mfv, sizeof(offsetcnt), cnt_cmp_desc);
 
-    /* choose top k from transval1 and transval2 */
-    for (i = j = cnt = 0;
-         cnt < newval->max_mfvs
-         && (j < transval2->next_mfv || i < transval1->next_mfv);
-         cnt++) {
-        Datum iDatum, jDatum;
-
-	if (i < transval1->next_mfv &&
+    /*
+     * choose top k from transval1 and transval2, skipping values that
+     * are frequent in both
+     */
+    i = j = 0;
+    while (newval->next_mfv < newval->max_mfvs
+           && (j < transval2->next_mfv || i < transval1->next_mfv)) {
+        bytea *srcblob;
+        uint64 cnt;
+        uint32 k;
+        Datum  dat;
+        bytea *hashed;
+        uint32 hash;
+
+        if (i < transval1->next_mfv &&
             (j == transval2->next_mfv
              || transval1->mfvs[i].cnt >= transval2->mfvs[j].cnt)) {
-          /* next item comes from transval1 */
-          iDatum = PointerExtractDatum(mfv_transval_getval(transblob1, i),
-                                       transval1->typByVal);
-          newblob = mfv_transval_append(newblob, iDatum);
-          newval = (mfvtransval *)VARDATA(newblob);
-          newval->mfvs[cnt].cnt = transval1->mfvs[i].cnt;
-          i++;
+            /* next item comes from transval1 */
+            srcblob = transblob1;
+            k = i++;
+            cnt = transval1->mfvs[k].cnt;
         }
-        else if (j < transval2->next_mfv &&
-                 (i == transval1->next_mfv 
-                  || transval1->mfvs[i].cnt < transval2->mfvs[j].cnt)) {
-          /* next item comes from transval2 */
-          jDatum = PointerExtractDatum(mfv_transval_getval(transblob2, j),
-                                       transval2->typByVal);
-          newblob = mfv_transval_append(newblob, jDatum);
-          newval = (mfvtransval *)VARDATA(newblob);
-          newval->mfvs[cnt].cnt = transval2->mfvs[j].cnt;
-          j++;
+        else {
+            /* next item comes from transval2 */
+            srcblob = transblob2;
+            k = j++;
+            cnt = transval2->mfvs[k].cnt;
         }
+        dat = PointerExtractDatum(mfv_transval_getval(srcblob, k),
+                                  newval->typByVal);
+        hashed = sketch_hash_bytea(dat, newval->typOid, SKETCH_HASH_DEFAULT);
+        hash = mfv_hash_of(hashed);
+        if (mfv_find(newblob, dat, hash) > -1)
+            continue;
+
+        newblob = mfv_transval_append(newblob, dat);
+        newval = (mfvtransval *)VARDATA(newblob);
+        k = newval->next_mfv - 1;
+        newval->mfvs[k].cnt = cnt;
+        mfv_slot_insert(newval, k, hash);
+        mfv_heap_push(newval, k);
     }
     return(newblob);
 }
@@ -44,7 +44,50 @@
 #include "utils/lsyscache.h"
 
 /*!
- * Simple linear function to find the rightmost bit that's set to one
+ * Load nbytes (at most 8) bytes as a big-endian integer, i.e., with the
+ * leftmost bit of the bitmap as the most significant one. Compilers turn this
+ * into an (unaligned) load and a byte swap.
+ */
+static inline uint64 load_bits(const uint8 *s, size_t nbytes)
+{
+    uint64 w = 0;
+    size_t k;
+
+    for (k = 0; k < nbytes; k++)
+        w = (w << CHAR_BIT) | s[k];
+    return w;
+}
+
+/*! number of trailing zeros of a nonzero 64-bit word */
+static inline uint32 ui64_trailing_zeros(uint64 v)
+{
+#if defined(__GNUC__)
+    return (uint32) __builtin_ctzll(v);
+#else
+    uint32 c = 0;
+
+    for (; !(v & 1); v >>= 1)
+        c++;
+    return c;
+#endif
+}
+
+/*! number of leading zeros of a nonzero 64-bit word */
+static inline uint32 ui64_leading_zeros(uint64 v)
+{
+#if defined(__GNUC__)
+    return (uint32) __builtin_clzll(v);
+#else
+    uint32 c = 0;
+
+    for (; !(v & ((uint64)1 << 63)); v <<= 1)
+        c++;
+    return c;
+#endif
+}
+
+/*!
+ * Find the rightmost bit that's set to one
  * (i.e. the # of trailing zeros to the right).
  * \param bits a bitmap containing many fm sketches
  * \param numsketches the number of sketches in the bits variable
@@ -59,7 +102,7 @@ uint32 rightmost_one(uint8 *bits,
     (void) numsketches; /* avoid warning about unused parameter */
     uint8 *s =
         &(((uint8 *)(bits))[sketchnum*sketchsz_bits/8]);
-    int    i;
+    size_t i = sketchsz_bits/CHAR_BIT;
     uint32 c = 0;       /* output: c will count trailing zero bits, */
 
     if (sketchsz_bits % (sizeof(uint32)*CHAR_BIT))
@@ -70,31 +113,25 @@ uint32 rightmost_one(uint8 *bits,
             (uint32)sizeof(uint32));
 
     /*
-     * loop through the chunks of bits from right to left, counting zeros.
-     * stop when we hit a 1.
-     * XXX currently we look at CHAR_BIT (8) bits at a time
-     * which would seem to avoid any 32- vs. 64-bit concerns.
-     * might be worth tuning this up to do 32 bits at a time.
+     * loop through the words of bits from right to left, counting zeros.
+     * stop when we hit a 1. The sketch size is a multiple of 32 bits, so the
+     * leftmost word may only have 32 bits.
      */
-    for (i = sketchsz_bits/(CHAR_BIT) -1; i >= 0; i--)
+    while (i > 0)
     {
-        uint32 v = (uint32) (s[i]);
-
-        if (!v)         /* all CHAR_BIT of these bits are 0 */
-            c += CHAR_BIT /* * sizeof(uint32) */;
-        else
-        {
-            c += ui_rightmost_one(v);
-            break;             /* we found a 1 in this value of i, so we stop looping here. */
-        }
+        size_t nbytes = (i >= sizeof(uint64)) ? sizeof(uint64) : i;
+        uint64 v = load_bits(s + i - nbytes, nbytes);
+
+        if (v)
+            return c + ui64_trailing_zeros(v);
+        c += nbytes*CHAR_BIT;
+        i -= nbytes;
     }
     return c;
 }
 
 /*!
- * Simple linear function to find the leftmost zero (# leading 1's)
- * Would be nice to unify with the previous -- e.g. a foomost_bar function
- * where foo would be left or right, and bar would be 0 or 1.
+ * Find the leftmost zero (# leading 1's)
  * \param bits a bitmap containing many fm sketches
  * \param numsketches the number of sketches in the bits variable
  * \param the size of each sketch in bits
@@ -107,9 +144,9 @@ uint32 leftmost_zero(uint8 *bits,
 {
     uint8 *  s = &(((uint8 *)bits)[sketchnum*sketchsz_bits/8]);
 
-    unsigned i;
-    uint32   c = 0;     /* output: c will count trailing zero bits, */
-    uint32   maxbyte = pow(2,8) - 1;
+    size_t   i;
+    size_t   nbytes;
+    uint32   c = 0;     /* output: c will count leading one bits, */
 
     if (sketchsz_bits % (sizeof(uint32)*8))
         elog(
@@ -124,31 +161,24 @@ uint32 leftmost_zero(uint8 *bits,
 
 
     /*
-     * loop through the chunks of bits from left to right, counting ones.
+     * loop through the words of bits from left to right, counting ones.
      * stop when we hit a 0.
      */
-    for (i = 0; i < sketchsz_bits/(CHAR_BIT); i++)
+    for (i = 0; i < sketchsz_bits/CHAR_BIT; i += nbytes)
     {
-        uint32 v = (uint32) s[i];
-
-        if (v == maxbyte)
-            c += CHAR_BIT /* * sizeof(uint32) */;
-        else
-        {
-            /*
-             * reverse and invert v, then do rightmost_one
-             * magic reverse from http://graphics.stanford.edu/~seander/bithacks.html#ReverseByteWith32Bits
-             */
-            uint8 b =
-                ((s[i] * 0x0802LU &
-                  0x22110LU) |
-                 (s[i] * 0x8020LU &
-                  0x88440LU)) * 0x10101LU >> 16;
-            v = (uint32) b ^ 0xff;
-
-            c += ui_rightmost_one(v);
-            break;             /* we found a 1 in this value of i, so we stop looping here. */
-        }
+        /* inverted, and shifted so that the first bit is the leftmost one */
+        uint64 v;
+
+        nbytes = sketchsz_bits/CHAR_BIT - i;
+        if (nbytes > sizeof(uint64))
+            nbytes = sizeof(uint64);
+        v = ~(load_bits(s + i, nbytes) << (64 - nbytes*CHAR_BIT));
+        if (nbytes < sizeof(uint64))
+            v &= ~(~(uint64)0 >> (nbytes*CHAR_BIT));
+
+        if (v)
+            return c + ui64_leading_zeros(v);
+        c += nbytes*CHAR_BIT;
     }
     return c;
 }
@@ -321,6 +351,114 @@ bytea *sketch_md5_bytea(Datum dat, Oid typOid)
     return out;
 }
 
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64 murmur3_fmix64(uint64 k)
+{
+    k ^= k >> 33;
+    k *= UINT64CONST(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= UINT64CONST(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+    return k;
+}
+
+/*!
+ * MurmurHash3 (x64, 128-bit variant) by Austin Appleby, who placed it in the
+ * public domain. Much cheaper than md5, and good enough for sketches, which
+ * only need the output bits to look independent and uniform.
+ * Like the reference implementation, blocks are read in native byte order.
+ * \param key the bytes to hash
+ * \param len the number of bytes
+ * \param seed the seed
+ * \param out 16 bytes for the result
+ */
+void murmur3_x64_128(const void *key, size_t len, uint32 seed, uint8 *out)
+{
+    const uint8  *data = (const uint8 *)key;
+    const size_t  nblocks = len / 16;
+    const uint64  c1 = UINT64CONST(0x87c37b91114253d5);
+    const uint64  c2 = UINT64CONST(0x4cf5ad432745937f);
+    uint64        h1 = seed;
+    uint64        h2 = seed;
+    uint64        k1, k2;
+    const uint8  *tail;
+    size_t        i;
+
+    for (i = 0; i < nblocks; i++) {
+        memcpy(&k1, data + i*16, sizeof(uint64));
+        memcpy(&k2, data + i*16 + 8, sizeof(uint64));
+
+        k1 *= c1; k1 = ROTL64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = ROTL64(h1, 27); h1 += h2; h1 = h1*5 + 0x52dce729;
+        k2 *= c2; k2 = ROTL64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = ROTL64(h2, 31); h2 += h1; h2 = h2*5 + 0x38495ab5;
+    }
+
+    tail = data + nblocks*16;
+    k1 = 0;
+    k2 = 0;
+    switch (len & 15) {
+        case 15: k2 ^= ((uint64)tail[14]) << 48;
+        case 14: k2 ^= ((uint64)tail[13]) << 40;
+        case 13: k2 ^= ((uint64)tail[12]) << 32;
+        case 12: k2 ^= ((uint64)tail[11]) << 24;
+        case 11: k2 ^= ((uint64)tail[10]) << 16;
+        case 10: k2 ^= ((uint64)tail[9]) << 8;
+        case 9:  k2 ^= ((uint64)tail[8]);
+                 k2 *= c2; k2 = ROTL64(k2, 33); k2 *= c1; h2 ^= k2;
+        case 8:  k1 ^= ((uint64)tail[7]) << 56;
+        case 7:  k1 ^= ((uint64)tail[6]) << 48;
+        case 6:  k1 ^= ((uint64)tail[5]) << 40;
+        case 5:  k1 ^= ((uint64)tail[4]) << 32;
+        case 4:  k1 ^= ((uint64)tail[3]) << 24;
+        case 3:  k1 ^= ((uint64)tail[2]) << 16;
+        case 2:  k1 ^= ((uint64)tail[1]) << 8;
+        case 1:  k1 ^= ((uint64)tail[0]);
+                 k1 *= c1; k1 = ROTL64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = murmur3_fmix64(h1);
+    h2 = murmur3_fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    memcpy(out, &h1, sizeof(uint64));
+    memcpy(out + 8, &h2, sizeof(uint64));
+}
+
+/*!
+ * Run the datum through the given hash function, see SKETCH_HASH_MD5 etc.
+ * \param dat a Postgres Datum
+ * \param typOid Postgres type Oid
+ * \param hashtype the hash function
+ * \returns a bytea containing the MD5_HASHLEN hashed bytes
+ */
+bytea *sketch_hash_bytea(Datum dat, Oid typOid, uint32 hashtype)
+{
+    bytea *out;
+    bool   byval;
+    int    len;
+    void  *datp;
+
+    if (hashtype == SKETCH_HASH_MD5)
+        return sketch_md5_bytea(dat, typOid);
+    else if (hashtype != SKETCH_HASH_MURMUR3)
+        elog(ERROR, "unknown sketch hash function %u", hashtype);
+
+    byval = get_typbyval(typOid);
+    len = ExtractDatumLen(dat, get_typlen(typOid), byval);
+    datp = DatumExtractPointer(dat, byval);
+    out = palloc(MD5_HASHLEN+VARHDRSZ);
+    murmur3_x64_128(datp, len, 0, (uint8 *)VARDATA(out));
+    SET_VARSIZE(out, MD5_HASHLEN+VARHDRSZ);
+    return out;
+}
+
 
 /*  TEST ROUTINES */
 PG_FUNCTION_INFO_V1(sketch_array_set_bit_in_place);
@@ -9,6 +9,16 @@
 #define MD5_HASHLEN 16
 #define MD5_HASHLEN_BITS 8*MD5_HASHLEN /*! md5 hash length in bits */
 
+/*!
+ * Hash functions for sketches. Every sketch records which one it was built
+ * with, so that sketches are only combined if they hash values the same way.
+ * All of them produce MD5_HASHLEN bytes.
+ */
+#define SKETCH_HASH_MD5     0
+#define SKETCH_HASH_MURMUR3 1 /*! MurmurHash3, x64 128-bit variant */
+/*! hash function for newly created sketches */
+#define SKETCH_HASH_DEFAULT SKETCH_HASH_MURMUR3
+
 #ifndef MAXINT8LEN
 #define MAXINT8LEN              25 /*! number of chars to hold an int8 */
 #endif
@@ -21,6 +31,8 @@ void   hex_to_bytes(char *hex, uint8 *bytes, size_t);
 void bit_print(uint8 *c, int numbytes);
 Datum md5_cstring(char *);
 bytea *sketch_md5_bytea(Datum, Oid);
+bytea *sketch_hash_bytea(Datum, Oid, uint32);
+void   murmur3_x64_128(const void *, size_t, uint32, uint8 *);
 int4   safe_log2(int64);
 void   int64_big_endianize(uint64 *, uint32, bool);
 
@@ -18,8 +18,11 @@
  * The initial directory entries are sorted in ascending order of the Datums
  * they point to, but the last < SORTA_SLOP entries are left unsorted to facilitate
  * efficient insertion.  Binary Search is used on all but those last entries,
- * which must be scanned. At every k*SORTA_SLOP'th insert, the full directory is
- * sorted.
+ * which must be scanned.  Every SORTA_SLOP inserts, the unsorted entries are
+ * sorted and merged into the sorted ones, which is linear in the size of the
+ * directory rather than a sort of the full directory.
+ * A bloom filter in front of the directory lets most lookups of new values
+ * return without any comparisons.
  */
 //#include <ctype.h>
 #include "postgres.h"
@@ -46,11 +49,13 @@ sortasort_init(sortasort *s,
     s->capacity = capacity;
 
     /* storage_sz is the number of bytes available for Datums at the end. */
-    s->storage_sz = s_sz - sizeof(sortasort) - capacity*sizeof(s->dir[0]);
-    if (s_sz - sizeof(sortasort) <= capacity*sizeof(s->dir[0]))
+    s->storage_sz = s_sz - sizeof(sortasort) - SORTASORT_DIR_SZ(capacity);
+    if (s_sz - sizeof(sortasort) <= SORTASORT_DIR_SZ(capacity))
         elog(
             ERROR,
             "sortasort initialized too small to hold its own directory");
+    memset(SORTASORT_BLOOM(s), 0, SORTASORT_DIR_SZ(capacity)
+                                  - capacity*sizeof(s->dir[0]));
 
     s->typLen = typLen;
     s->typByVal = typByVal;
@@ -61,27 +66,29 @@ sortasort_init(sortasort *s,
 
     /* offset after the directory to do the next insertion */
     s->storage_cur = 0;
+    s->num_sorted = 0;
     return(s);
 }
 
-/*! comparison function for qsort_arg */
-int sorta_cmp(const void *i, const void *j, void *thunk)
+/*!
+ * compare two marshalled values, ordering variable-length values by
+ * length first
+ * \param s the sortasort
+ * \param dat1 pointer to the first value
+ * \param dat2 pointer to the second value
+ */
+static int sorta_cmp_data(sortasort *s, const char *dat1, const char *dat2)
 {
-    /* the "thunk" in this case is the sortasort being sorted */
-    sortasort *s = (sortasort *)thunk;
-    int        first = *(int *)i;
-    int        second = *(int *)j;
-    char      *dat1 = SORTASORT_DATA(s) + first;
-    char      *dat2 = SORTASORT_DATA(s) + second;
-    int        len = s->typLen;
-    int        shorter;
-    
+    int len = s->typLen;
+    int shorter;
+
     /*
      * we always use typByVal = true, since we've marshalled the data into place
      */
     if (len < 0) {
-        len = (int)ExtractDatumLen(PointerGetDatum(dat1), len, s->typByVal);
-        if ((shorter = (len - ExtractDatumLen(PointerGetDatum(dat2), len, s->typByVal))))
+        len = (int)ExtractDatumLen(PointerGetDatum(dat1), s->typLen, s->typByVal);
+        if ((shorter = (len - (int)ExtractDatumLen(PointerGetDatum(dat2),
+                                                   s->typLen, s->typByVal))))
             /* order by length */
             return shorter;
         /* else drop through */
@@ -90,6 +97,97 @@ int sorta_cmp(const void *i, const void *j, void *thunk)
     return memcmp(dat1, dat2, len);
 }
 
+/*!
+ * compute the SORTA_BLOOM_HASHES bloom filter bits of a value, derived from
+ * the two halves of one 128-bit hash
+ * \param s the sortasort
+ * \param datp pointer to the value
+ * \param len length of the value
+ * \param bits output array of SORTA_BLOOM_HASHES bit positions
+ */
+static void sorta_bloom_bits(sortasort *s, const void *datp, size_t len,
+                             uint64 *bits)
+{
+    uint64 h[2];
+    uint64 nbits = (uint64)s->capacity * SORTA_BLOOM_BITS;
+    int    i;
+
+    murmur3_x64_128(datp, len, 0, (uint8 *)h);
+    for (i = 0; i < SORTA_BLOOM_HASHES; i++)
+        bits[i] = (h[0] + i*h[1]) % nbits;
+}
+
+/*! does the bloom filter of s possibly contain the value? */
+static bool sorta_bloom_test(sortasort *s, const void *datp, size_t len)
+{
+    uint8  *bloom = SORTASORT_BLOOM(s);
+    uint64  bits[SORTA_BLOOM_HASHES];
+    int     i;
+
+    if (s->capacity == 0)
+        return false;
+    sorta_bloom_bits(s, datp, len, bits);
+    for (i = 0; i < SORTA_BLOOM_HASHES; i++)
+        if (!(bloom[bits[i]/CHAR_BIT] & (1 << (bits[i] % CHAR_BIT))))
+            return false;
+    return true;
+}
+
+/*! add a value to the bloom filter of s */
+static void sorta_bloom_add(sortasort *s, const void *datp, size_t len)
+{
+    uint8  *bloom = SORTASORT_BLOOM(s);
+    uint64  bits[SORTA_BLOOM_HASHES];
+    int     i;
+
+    sorta_bloom_bits(s, datp, len, bits);
+    for (i = 0; i < SORTA_BLOOM_HASHES; i++)
+        bloom[bits[i]/CHAR_BIT] |= (1 << (bits[i] % CHAR_BIT));
+}
+
+/*!
+ * sort the unsorted tail of the directory and merge it into the sorted
+ * prefix.  The tail has fewer than SORTA_SLOP entries, so we set it aside and
+ * merge from the back, which needs no further space.
+ * \param s a sortasort
+ */
+static void sorta_merge_tail(sortasort *s)
+{
+    unsigned tail[SORTA_SLOP];
+    size_t   ntail = s->num_vals - s->num_sorted;
+    long     i = (long)s->num_sorted - 1;
+    long     j = (long)ntail - 1;
+    long     k = (long)s->num_vals - 1;
+
+    if (ntail > SORTA_SLOP)
+        elog(ERROR, "sortasort failure: %zu unsorted entries", ntail);
+
+    qsort_arg(&s->dir[s->num_sorted], ntail, sizeof(s->dir[0]),
+              sorta_cmp, (void *)s);
+    memcpy(tail, &s->dir[s->num_sorted], ntail*sizeof(s->dir[0]));
+
+    while (j >= 0) {
+        if (i >= 0 && sorta_cmp_data(s, SORTASORT_GETVAL(s, i),
+                                     SORTASORT_DATA(s) + tail[j]) > 0)
+            s->dir[k--] = s->dir[i--];
+        else
+            s->dir[k--] = tail[j--];
+    }
+    s->num_sorted = s->num_vals;
+}
+
+/*! comparison function for qsort_arg */
+int sorta_cmp(const void *i, const void *j, void *thunk)
+{
+    /* the "thunk" in this case is the sortasort being sorted */
+    sortasort *s = (sortasort *)thunk;
+    unsigned   first = *(const unsigned *)i;
+    unsigned   second = *(const unsigned *)j;
+
+    return sorta_cmp_data(s, SORTASORT_DATA(s) + first,
+                          SORTASORT_DATA(s) + second);
+}
+
 
 /*!
  * insert a new element into s_in if there's room and return TRUE
@@ -139,23 +237,19 @@ int sortasort_try_insert(sortasort *s_in, Datum dat, int len)
     s_in->storage_cur += len;
     if (s_in->storage_cur > s_in->storage_sz)
         elog(ERROR, "went off the end of sortasort storage");
+    sorta_bloom_add(s_in, datp, len);
 
-    /* re-sort every SORTA_SLOP vals */
-    if (s_in->num_vals % SORTA_SLOP == 0)
-        qsort_arg(s_in->dir,
-                  s_in->num_vals,
-                  sizeof(s_in->dir[0]),
-                  sorta_cmp,
-                  (void *)s_in);
+    /* merge the unsorted vals into the sorted ones every SORTA_SLOP vals */
+    if (s_in->num_vals - s_in->num_sorted >= SORTA_SLOP)
+        sorta_merge_tail(s_in);
 
     return TRUE;
 }
 
 /*!
- * find items in a sortasort.  this involves binary search in the sorted prefix,
- * and linear search in the <SORTA_SLOP-sized suffix.
- * We assume that the sorted prefix is the
- * highest multiple of SORTA_SLOP less than s->num_vals
+ * find items in a sortasort.  this involves a check of the bloom filter,
+ * binary search in the sorted prefix, and linear search in the
+ * <SORTA_SLOP-sized suffix.
  *
  * \param s a sortasort
  * \param v a value to find
@@ -165,48 +259,37 @@ int sortasort_try_insert(sortasort *s_in, Datum dat, int len)
  */
 int sortasort_find(sortasort *s, Datum dat)
 {
-    int    theguess, diff;
-    int    hi = (s->num_vals/SORTA_SLOP)*SORTA_SLOP;
-    int    themin = 0, themax = hi - 1;
-    size_t i;
-    int    addend, subtrahend;
-    size_t len = ExtractDatumLen(dat, s->typLen, s->typByVal);
+    void   *datp = DatumExtractPointer(dat, s->typByVal);
+    size_t  len = ExtractDatumLen(dat, s->typLen, s->typByVal);
+    size_t  lo = 0, hi = s->num_sorted;
+    size_t  i;
+    int     diff;
 
-    /* binary search on the front of the sortasort */
-    if (themax >= (int)s->num_vals) {
+    if (s->num_sorted > s->num_vals)
         elog(ERROR,
-             "sortasort failure: max = %d, num_vals = %zu",
-             themax,
+             "sortasort failure: num_sorted = %u, num_vals = %zu",
+             s->num_sorted,
              s->num_vals);
-    }
-    theguess = hi / 2;
-    while (themin < themax ) {
-        if (!(diff = memcmp(SORTASORT_GETVAL(s,theguess), 
-                            DatumExtractPointer(dat, s->typByVal), 
-                            len)))
-            return theguess;
-        if (themin == themax - 1) break;
-        else if (diff < 0) {
-            /* undershot */
-            addend = (themax - theguess) / 2;
-            if (!addend) addend = 1;
-            themin = theguess;
-            theguess += addend;
-        }
-        else {
-            /* overshot */
-            subtrahend = (theguess - themin) / 2;
-            if (!subtrahend) subtrahend = 1;
-            themax = theguess;
-            theguess -= subtrahend;
-        }
+
+    /* values never inserted are usually rejected here */
+    if (!sorta_bloom_test(s, datp, len))
+        return -1;
+
+    /* binary search on the front of the sortasort */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+
+        if (!(diff = sorta_cmp_data(s, SORTASORT_GETVAL(s, mid), datp)))
+            return mid;
+        else if (diff < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
     /* if we got here, continue with a naive linear search on the tail */
-    for (i = hi; i < s->num_vals; i++)
-        if (!memcmp(SORTASORT_GETVAL(s, i), 
-                    DatumExtractPointer(dat, s->typByVal), 
-                    len))
+    for (i = s->num_sorted; i < s->num_vals; i++)
+        if (!sorta_cmp_data(s, SORTASORT_GETVAL(s, i), datp))
             return i;
     return -1;
 }
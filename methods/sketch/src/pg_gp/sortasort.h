@@ -4,6 +4,10 @@
  * \brief header file for the sortasort directory data structure
  */
 #define SORTA_SLOP 100
+/*! bloom filter bits per directory entry */
+#define SORTA_BLOOM_BITS 8
+/*! number of bloom filter bits set per value */
+#define SORTA_BLOOM_HASHES 3
 
 /*!
  * \internal
@@ -13,12 +17,14 @@
  * modification, and network transmission as a single byte-string.  It is
  * structured as a header followed by an array of offsets (directory) that
  * point to the actual null-terminated strings stored in the "vals" array
- * at the end of the structure.
+ * at the end of the structure.  Between the directory and the vals is a
+ * bloom filter over all vals, with SORTA_BLOOM_BITS bits per directory entry.
  *
- * The directory is mostly sorted in ascending order of the vals it points
- * to, but the last < SORTA_SLOP entries are left unsorted.  Binary Search
- * is used on all but those last entries, which must be scanned. At every
- * k*SORTA_SLOP'th insert, the full directory is sorted.
+ * The first num_sorted entries of the directory are sorted in ascending
+ * order of the vals they point to, the remaining < SORTA_SLOP entries are
+ * left unsorted.  Binary Search is used on the sorted entries, the others
+ * must be scanned.  Once SORTA_SLOP entries are unsorted, they are sorted
+ * and merged into the sorted ones.
  * \endinternal
  */
 typedef struct {
@@ -28,11 +34,14 @@ typedef struct {
     int    typLen;         /*! length of this Postgres type (-1 for bytea, -2 for cstring) */
     size_t typByVal;       /*! Postgres typByVal flag */
     unsigned storage_cur;  /*! offset after the directory to do the next insertion */
+    unsigned num_sorted;   /*! number of sorted directory entries */
     unsigned dir[];        /*! storage of the strings */
 } sortasort;
 
-#define SORTASORT_DATA(s)  (((char *)(s->dir)) + \
-    (s->capacity * (sizeof (s->dir[0]))))
+/*! size of the directory and bloom filter of a sortasort with capacity c */
+#define SORTASORT_DIR_SZ(c) ((c) * (sizeof (unsigned) + SORTA_BLOOM_BITS/CHAR_BIT))
+#define SORTASORT_BLOOM(s) ((uint8 *)(&(s)->dir[(s)->capacity]))
+#define SORTASORT_DATA(s)  (((char *)(s->dir)) + SORTASORT_DIR_SZ(s->capacity))
 #define SORTASORT_GETVAL(s, i) (SORTASORT_DATA(s) + s->dir[i])
 
 int sortasort_try_insert(sortasort *, Datum, int);
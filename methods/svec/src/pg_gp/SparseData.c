@@ -24,8 +24,6 @@
 #include "access/htup.h"
 #include "catalog/pg_proc.h"
 
-void* array_pos_ref = NULL;
-
 
 /* -----------------------------------------------------------------------------
  *
@@ -772,10 +770,316 @@ double l1norm_sdata_values_double(SparseData sdata) {
  *   which creates a new SparseData array
  *------------------------------------------------------------------------------
  */
+/*
+ * Fast paths for float8 SparseData arrays (which is what svecs use)
+ *
+ * The generic loop in op_sdata_by_sdata() decodes the RLE index of both
+ * arguments one compword at a time and dispatches on the data type for every
+ * aligned run. Instead, we decode each index only once into an array of run
+ * lengths and then walk the aligned run intervals. Dense arguments (where all
+ * runs have length 1, e.g., uncompressed float8[]) do not need any decoding,
+ * and the loops over their values are simple enough to be vectorized by the
+ * compiler.
+ */
+static inline bool
+sdata_is_dense(SparseData sdata)
+{
+	return sdata->unique_value_count == sdata->total_value_count;
+}
+
+static inline double
+float8_op(enum operation_t operation, double left, double right)
+{
+	switch (operation)
+	{
+		case subtract: return left - right;
+		case multiply: return left * right;
+		case divide:   return left / right;
+		case add:
+		default:       return left + right;
+	}
+}
+
+/* Sum of count consecutive values, using independent partial sums */
+double
+sum_float8_values(const double *vals, int64 count)
+{
+	double s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+	int64 i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		s0 += vals[i];
+		s1 += vals[i + 1];
+		s2 += vals[i + 2];
+		s3 += vals[i + 3];
+	}
+	for (; i < count; i++)
+		s0 += vals[i];
+	return (s0 + s1) + (s2 + s3);
+}
+
+/* Sum of the absolute values of count consecutive values */
+double
+sum_abs_float8_values(const double *vals, int64 count)
+{
+	double s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+	int64 i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		s0 += fabs(vals[i]);
+		s1 += fabs(vals[i + 1]);
+		s2 += fabs(vals[i + 2]);
+		s3 += fabs(vals[i + 3]);
+	}
+	for (; i < count; i++)
+		s0 += fabs(vals[i]);
+	return (s0 + s1) + (s2 + s3);
+}
+
+/* Inner product of two dense float8 arrays of length count */
+double
+dot_float8_values(const double *left, const double *right, int64 count)
+{
+	double s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+	int64 i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		s0 += left[i] * right[i];
+		s1 += left[i + 1] * right[i + 1];
+		s2 += left[i + 2] * right[i + 2];
+		s3 += left[i + 3] * right[i + 3];
+	}
+	for (; i < count; i++)
+		s0 += left[i] * right[i];
+	return (s0 + s1) + (s2 + s3);
+}
+
+/* Elementwise operation on two dense float8 arrays of length count */
+void
+op_float8_values(enum operation_t operation, const double *left,
+		const double *right, double *result, int64 count)
+{
+	int64 i;
+
+	switch (operation)
+	{
+		case subtract:
+			for (i = 0; i < count; i++)
+				result[i] = left[i] - right[i];
+			break;
+		case multiply:
+			for (i = 0; i < count; i++)
+				result[i] = left[i] * right[i];
+			break;
+		case divide:
+			for (i = 0; i < count; i++)
+				result[i] = left[i] / right[i];
+			break;
+		case add:
+		default:
+			for (i = 0; i < count; i++)
+				result[i] = left[i] + right[i];
+			break;
+	}
+}
+
+/* Elementwise operation on a dense float8 array of length count and a scalar */
+void
+op_float8_values_by_scalar(enum operation_t operation, double scalar,
+		const double *vals, double *result, int64 count,
+		bool scalar_is_right)
+{
+	int64 i;
+
+	switch (operation)
+	{
+		case subtract:
+			if (scalar_is_right)
+				for (i = 0; i < count; i++)
+					result[i] = vals[i] - scalar;
+			else
+				for (i = 0; i < count; i++)
+					result[i] = scalar - vals[i];
+			break;
+		case multiply:
+			for (i = 0; i < count; i++)
+				result[i] = vals[i] * scalar;
+			break;
+		case divide:
+			if (scalar_is_right)
+				for (i = 0; i < count; i++)
+					result[i] = vals[i] / scalar;
+			else
+				for (i = 0; i < count; i++)
+					result[i] = scalar / vals[i];
+			break;
+		case add:
+		default:
+			for (i = 0; i < count; i++)
+				result[i] = vals[i] + scalar;
+			break;
+	}
+}
+
+static SparseData
+op_float8_sdata_by_sdata(enum operation_t operation,
+		SparseData left, SparseData right)
+{
+	double *lvals = (double *)left->vals->data;
+	double *rvals = (double *)right->vals->data;
+	int lcount = left->unique_value_count;
+	int rcount = right->unique_value_count;
+	SparseData sdata;
+	int64 *lruns, *rruns;
+	int64 lrem, rrem, run_len = 0;
+	double run_val = 0., new_val;
+	int i = 0, j = 0;
+
+	if (sdata_is_dense(left) && sdata_is_dense(right))
+	{
+		int count = left->total_value_count;
+		double *result = (double *)palloc(sizeof(float8) * count);
+
+		op_float8_values(operation, lvals, rvals, result, count);
+		/* arr_to_sdata() merges identical neighbouring values into runs */
+		sdata = float8arr_to_sdata(result, count);
+		pfree(result);
+		return sdata;
+	}
+
+	lruns = sdata_index_to_int64arr(left);
+	rruns = sdata_index_to_int64arr(right);
+	lrem = lruns[0];
+	rrem = rruns[0];
+	sdata = makeSparseData();
+
+	while (i < lcount && j < rcount)
+	{
+		int64 len = Min(lrem, rrem);
+
+		new_val = float8_op(operation, lvals[i], rvals[j]);
+
+		/*
+		 * Compare bitwise, as the generic code does, so that runs of NaNs
+		 * are merged, too.
+		 */
+		if (run_len > 0 && memcmp(&new_val, &run_val, sizeof(float8)))
+		{
+			add_run_to_sdata((char *)&run_val, run_len, sizeof(float8),
+				sdata);
+			run_len = 0;
+		}
+		run_val = new_val;
+		run_len += len;
+
+		lrem -= len;
+		rrem -= len;
+		if (lrem == 0 && ++i < lcount)
+			lrem = lruns[i];
+		if (rrem == 0 && ++j < rcount)
+			rrem = rruns[j];
+	}
+	if (run_len > 0)
+		add_run_to_sdata((char *)&run_val, run_len, sizeof(float8), sdata);
+
+	sdata->type_of_data = FLOAT8OID;
+
+	pfree(lruns);
+	pfree(rruns);
+
+	return sdata;
+}
+
+/*
+ * Inner product of two SparseData arrays
+ *
+ * This is the same as sum_sdata_values_double(op_sdata_by_sdata(multiply,
+ * left, right)), except that no intermediate SparseData is built for float8
+ * data.
+ */
+double dot_sdata_by_sdata(SparseData left, SparseData right)
+{
+	double *lvals, *rvals;
+	int64 *lruns, *rruns;
+	int64 lrem, rrem;
+	double accum = 0.;
+	int i = 0, j = 0;
+
+	check_sdata_dimensions(left,right);
+
+	if (left->type_of_data != FLOAT8OID || right->type_of_data != FLOAT8OID
+			|| left->total_value_count == 0)
+	{
+		SparseData mult_result = op_sdata_by_sdata(multiply,left,right);
+		accum = sum_sdata_values_double(mult_result);
+		freeSparseDataAndData(mult_result);
+		return accum;
+	}
+
+	/* Make sure that, if only one argument is dense, it is the right one */
+	if (sdata_is_dense(left))
+	{
+		SparseData tmp = left;
+		left = right;
+		right = tmp;
+	}
+	lvals = (double *)left->vals->data;
+	rvals = (double *)right->vals->data;
+
+	if (sdata_is_dense(left))
+		return dot_float8_values(lvals, rvals, left->total_value_count);
+
+	lruns = sdata_index_to_int64arr(left);
+
+	if (sdata_is_dense(right))
+	{
+		int64 pos = 0;
+
+		for (i = 0; i < left->unique_value_count; i++)
+		{
+			accum += lvals[i] * sum_float8_values(rvals + pos, lruns[i]);
+			pos += lruns[i];
+		}
+		pfree(lruns);
+		return accum;
+	}
+
+	rruns = sdata_index_to_int64arr(right);
+	lrem = lruns[0];
+	rrem = rruns[0];
+	while (i < left->unique_value_count && j < right->unique_value_count)
+	{
+		int64 len = Min(lrem, rrem);
+
+		accum += lvals[i] * rvals[j] * len;
+		lrem -= len;
+		rrem -= len;
+		if (lrem == 0 && ++i < left->unique_value_count)
+			lrem = lruns[i];
+		if (rrem == 0 && ++j < right->unique_value_count)
+			rrem = rruns[j];
+	}
+	pfree(lruns);
+	pfree(rruns);
+
+	return accum;
+}
+
 SparseData op_sdata_by_sdata(enum operation_t operation,
 					   SparseData left, SparseData right)
 {
-	SparseData sdata = makeSparseData();
+	SparseData sdata;
+
+	if (left->type_of_data == FLOAT8OID && right->type_of_data == FLOAT8OID
+			&& left->total_value_count > 0)
+	{
+		check_sdata_dimensions(left,right);
+		return op_float8_sdata_by_sdata(operation,left,right);
+	}
+	sdata = makeSparseData();
 
 	/*
 	 * Loop over the contents of the left array, operating on elements
@@ -1128,8 +1432,67 @@ SparseData arr_to_sdata(char *array, size_t width, Oid type_of_data, int count){
 	return sdata;
 }
 
-int compar(const void *i, const void *j){
-	return (int)((int64*)array_pos_ref)[*(int*)i] - ((int64*)array_pos_ref)[*(int*)j];
+/* Flipping the sign bit makes negative positions sort first as unsigned keys */
+static inline uint64 position_key(int64 pos)
+{
+	return (uint64)pos ^ ((uint64)1 << 63);
+}
+
+/*
+ * Returns the permutation of 0..count-1 that sorts the positions in
+ * increasing order, keeping equal positions in their input order.
+ *
+ * Positions that are already sorted are detected in one pass. Otherwise, we
+ * use an LSD radix sort on 8-bit digits, skipping the digits that are the
+ * same for all positions (usually all but the lowest three or four).
+ */
+static int *sort_positions(const int64 *array_pos, int count)
+{
+	int *index = (int*)palloc(count*sizeof(int));
+	int *buffer, *tmp;
+	int hist[8][256];
+	bool sorted = true;
+	int i, d;
+
+	for (i = 0; i < count; i++)
+		index[i] = i;
+	for (i = 1; i < count && sorted; i++)
+		sorted = (array_pos[i-1] <= array_pos[i]);
+	if (sorted)
+		return index;
+
+	memset(hist, 0, sizeof(hist));
+	for (i = 0; i < count; i++)
+	{
+		uint64 key = position_key(array_pos[i]);
+		for (d = 0; d < 8; d++)
+			hist[d][(key >> (8*d)) & 0xFF]++;
+	}
+
+	buffer = (int*)palloc(count*sizeof(int));
+	for (d = 0; d < 8; d++)
+	{
+		int offset = 0;
+		int digit;
+
+		/* All positions have the same digit d */
+		if (hist[d][(position_key(array_pos[0]) >> (8*d)) & 0xFF] == count)
+			continue;
+		for (digit = 0; digit < 256; digit++)
+		{
+			int num = hist[d][digit];
+			hist[d][digit] = offset;
+			offset += num;
+		}
+		for (i = 0; i < count; i++)
+		{
+			uint64 key = position_key(array_pos[index[i]]);
+			buffer[hist[d][(key >> (8*d)) & 0xFF]++] = index[i];
+		}
+		tmp = index; index = buffer; buffer = tmp;
+	}
+	pfree(buffer);
+	return index;
 }
 
 /**
@@ -1151,15 +1514,15 @@ SparseData position_to_sdata(double *array_val, int64 *array_pos,
 	char *run_val=array;
 	int64 run_len;
 	SparseData sdata = makeSparseData();
+	int *index = sort_positions(array_pos, count);
 
-	int *index = (int*)palloc(count*sizeof(int));
-	for(int i = 0; i < count; ++i)
-		index[i] = i;
-
-	/* this is a temp solution that will be in place only until qsort_r
-	 * is a standard library function */
-	array_pos_ref = array_pos;
-	qsort(index, count, sizeof(int), compar);
+	/*
+	 * There is at most one run per position, plus one run of default values
+	 * before each position and after the last one. Pre-size the buffers for
+	 * that, with one byte per run length in the index.
+	 */
+	enlargeStringInfo(sdata->vals, (2*count+1)*width);
+	enlargeStringInfo(sdata->index, 2*count+1);
 
 	sdata->type_of_data=type_of_data;
 	if(array_pos[index[0]] > 1){
@@ -1176,14 +1539,14 @@ SparseData position_to_sdata(double *array_val, int64 *array_pos,
 		 */
 		while ((i < count-1) &&
 		       ((array_pos[index[i+1]] - array_pos[index[i]])==1) &&
-		       (memcmp((array+index[i]*size_of_type(type_of_data)),
-			       (array+index[i+1]*size_of_type(type_of_data)),width)==0)) {
+		       (memcmp((array+index[i]*width),
+			       (array+index[i+1]*width),width)==0)) {
 			run_len++;
 			i++;
 		}
 		while ((i < count-1)&&((array_pos[index[i+1]] - array_pos[index[i]])==0)) {
-			if ((memcmp((array+index[i]*size_of_type(type_of_data)),
-				    (array+index[i+1]*size_of_type(type_of_data)),width)==0)) {
+			if ((memcmp((array+index[i]*width),
+				    (array+index[i+1]*width),width)==0)) {
 				i++;
 			} else {
 				ereport(ERROR,
@@ -1191,7 +1554,7 @@ SparseData position_to_sdata(double *array_val, int64 *array_pos,
 					 errmsg("posit_to_sdata conflicting values for the same position")));
 			}
 		}
-		run_val = array+index[i]*size_of_type(type_of_data);
+		run_val = array+index[i]*width;
 		add_run_to_sdata(run_val,run_len,width,sdata);
 
 		if(i < count-1){
@@ -1277,10 +1640,13 @@ int64 *sdata_index_to_int64arr(SparseData sdata) {
 /**
  * @param target The memory area to store the serialised SparseData
  * @para source The SparseData to be serialised
- * @return The serialisation of a SparseData structure
+ * @return The serialisation of a SparseData structure, including the l2 norm
+ * of its values
  */
 void serializeSparseData(char *target, SparseData source)
 {
+	double norm;
+
 	/* SparseDataStruct header */
 	memcpy(target,source,SIZEOF_SPARSEDATAHDR);
 	/* Two StringInfo structures describing the data and index */
@@ -1290,6 +1656,19 @@ void serializeSparseData(char *target, SparseData source)
 	memcpy(SDATA_VALS_PTR(target),source->vals->data,source->vals->maxlen);
 	/* The index values */
 	memcpy(SDATA_INDEX_PTR(target),source->index->data,source->index->maxlen);
+	/*
+	 * The l2 norm of the values, so that comparisons and angles do not need
+	 * to decode the vector
+	 */
+	if (source->type_of_data == FLOAT8OID)
+	{
+		norm = l2norm_sdata_values_double(source);
+		memcpy(SDATA_NORM_PTR(target),&norm,SDATA_NORM_SIZE);
+		SDATA_VERSION(target) = SDATA_VERSION_NORM;
+	} else {
+		memset(SDATA_NORM_PTR(target),0,SDATA_NORM_SIZE);
+		SDATA_VERSION(target) = 0;
+	}
 
 	/*
 	 * Set pointers to the data areas of the serialized structure
@@ -1350,6 +1729,84 @@ double sd_proj(SparseData sdata, int idx) {
 	return vals[i];
 }
 
+/**
+ * @param sdata A SparseData
+ * @return An array whose i-th element is the (one-based) position of the last
+ * element of the i-th run, i.e., the cumulative run lengths.
+ */
+int64 *sdata_index_to_run_ends(SparseData sdata) {
+	int64 *run_ends = sdata_index_to_int64arr(sdata);
+
+	for (int i=1; i<sdata->unique_value_count; i++)
+		run_ends[i] += run_ends[i-1];
+	return run_ends;
+}
+
+/**
+ * @param run_ends The cumulative run lengths, as returned by
+ *     sdata_index_to_run_ends()
+ * @param count The number of runs
+ * @param pos A position, counting from one
+ * @return The (zero-based) number of the run containing pos
+ */
+int sdata_run_of_position(const int64 *run_ends, int count, int64 pos) {
+	int low = 0, high = count - 1;
+
+	while (low < high) {
+		int mid = low + (high - low) / 2;
+		if (run_ends[mid] < pos)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/**
+ * Same as sd_proj(), but uses binary search on precomputed run ends
+ */
+double sd_proj_run_ends(SparseData sdata, const int64 *run_ends, int idx) {
+	double * vals = (double *)sdata->vals->data;
+
+	if (0 >= idx || idx > sdata->total_value_count)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("Index out of bounds.")));
+
+	return vals[sdata_run_of_position(run_ends, sdata->unique_value_count,
+		idx)];
+}
+
+/**
+ * Same as subarr(), but uses binary search on precomputed run ends
+ */
+SparseData subarr_run_ends(SparseData sdata, const int64 *run_ends,
+		int start, int end) {
+	double * vals = (double *)sdata->vals->data;
+	SparseData ret;
+	size_t wf8 = sizeof(float8);
+	int first, last;
+
+	if (start > end)
+		return reverse(subarr_run_ends(sdata,run_ends,end,start));
+
+	/* error checking */
+	if (0 >= start || end > sdata->total_value_count)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("Array index out of bounds.")));
+
+	ret = makeSparseData();
+	first = sdata_run_of_position(run_ends, sdata->unique_value_count, start);
+	last = sdata_run_of_position(run_ends, sdata->unique_value_count, end);
+	for (int j=first; j<=last; j++) {
+		int64 from = (j == first) ? start : run_ends[j-1] + 1;
+		int64 to = (j == last) ? end : run_ends[j];
+		add_run_to_sdata((char *)(&vals[j]), to-from+1, wf8, ret);
+	}
+	return ret;
+}
+
 /**
  * @param sdata The SparseData from which to extract a subarray
  * @param start The start index of the desired subarray
@@ -1503,6 +1960,131 @@ SparseData concat_replicate(SparseData rep, int multiplier) {
 
 static bool lapply_error_checking(Oid foid, List * funcname);
 
+/*
+ * Builtin functions that lapply() runs as native loops over the values,
+ * instead of calling them through fmgr once per value
+ */
+enum lapply_native_t {
+	lapply_fmgr, lapply_log10, lapply_ln, lapply_sqrt, lapply_exp, lapply_abs
+};
+
+/*
+ * A function resolved for lapply(). lapply_lookup() caches it in the fn_extra
+ * of the calling function, so that the name is only resolved again if it
+ * changes between calls.
+ */
+struct LapplyFunction {
+	text *name;                  /**< The name the function was resolved for */
+	FmgrInfo flinfo;             /**< The resolved function */
+	enum lapply_native_t native; /**< Whether it is one of the builtins above */
+};
+
+/**
+ * Resolves the function named func, as a function from float8 to float8.
+ *
+ * @param func The name of the function
+ * @param caller The FmgrInfo of the calling function, whose fn_extra caches
+ *        the result, or NULL for no caching
+ */
+LapplyFunction *lapply_lookup(text * func, FmgrInfo *caller) {
+	Oid argtypes[1] = { FLOAT8OID };
+	MemoryContext mcxt = caller ? caller->fn_mcxt : CurrentMemoryContext;
+	LapplyFunction *lfunc = caller ? (LapplyFunction *)caller->fn_extra : NULL;
+	List * funcname;
+	Oid foid;
+	PGFunction addr;
+
+	if (lfunc != NULL && VARSIZE(lfunc->name) == VARSIZE(func) &&
+	    memcmp(lfunc->name, func, VARSIZE(func)) == 0)
+		return lfunc;
+
+	funcname = textToQualifiedNameList(func);
+	foid = LookupFuncName(funcname, 1, argtypes, false);
+	lapply_error_checking(foid, funcname);
+
+	if (lfunc == NULL)
+	{
+		lfunc = (LapplyFunction *)MemoryContextAlloc(mcxt,
+						sizeof(LapplyFunction));
+		if (caller) caller->fn_extra = lfunc;
+	} else
+		pfree(lfunc->name);
+
+	lfunc->name = (text *)MemoryContextAlloc(mcxt, VARSIZE(func));
+	memcpy(lfunc->name, func, VARSIZE(func));
+	fmgr_info_cxt(foid, &lfunc->flinfo, mcxt);
+
+	/* Recognize the builtins by their implementation, whatever their name */
+	addr = lfunc->flinfo.fn_addr;
+	if (addr == dlog10)         lfunc->native = lapply_log10;
+	else if (addr == dlog1)     lfunc->native = lapply_ln;
+	else if (addr == dsqrt)     lfunc->native = lapply_sqrt;
+	else if (addr == dexp)      lfunc->native = lapply_exp;
+	else if (addr == float8abs) lfunc->native = lapply_abs;
+	else                        lfunc->native = lapply_fmgr;
+
+	return lfunc;
+}
+
+static inline double lapply_call(LapplyFunction *lfunc, double value) {
+	return DatumGetFloat8(FunctionCall1(&lfunc->flinfo,
+					    Float8GetDatum(value)));
+}
+
+/**
+ * Applies a function resolved by lapply_lookup() on all elements of a sparse
+ * data.
+ *
+ * The native loops leave the values outside of the domain of the builtin
+ * (or that overflow) to the builtin itself, so that it raises its own error.
+ */
+SparseData lapply_function(LapplyFunction *lfunc, SparseData sdata) {
+	SparseData result = makeSparseDataCopy(sdata);
+	double *in = (double *)sdata->vals->data;
+	double *out = (double *)result->vals->data;
+	int count = sdata->unique_value_count;
+	int i;
+
+	switch (lfunc->native)
+	{
+		case lapply_log10:
+			for (i = 0; i < count; i++)
+				out[i] = log10(in[i]);
+			for (i = 0; i < count; i++)
+				if (in[i] <= 0.) out[i] = lapply_call(lfunc, in[i]);
+			break;
+		case lapply_ln:
+			for (i = 0; i < count; i++)
+				out[i] = log(in[i]);
+			for (i = 0; i < count; i++)
+				if (in[i] <= 0.) out[i] = lapply_call(lfunc, in[i]);
+			break;
+		case lapply_sqrt:
+			for (i = 0; i < count; i++)
+				out[i] = sqrt(in[i]);
+			for (i = 0; i < count; i++)
+				if (in[i] < 0.) out[i] = lapply_call(lfunc, in[i]);
+			break;
+		case lapply_exp:
+			for (i = 0; i < count; i++)
+				out[i] = exp(in[i]);
+			for (i = 0; i < count; i++)
+				if ((isinf(out[i]) || out[i] == 0.) && !isinf(in[i]))
+					out[i] = lapply_call(lfunc, in[i]);
+			break;
+		case lapply_abs:
+			for (i = 0; i < count; i++)
+				out[i] = fabs(in[i]);
+			break;
+		case lapply_fmgr:
+		default:
+			for (i = 0; i < count; i++)
+				out[i] = lapply_call(lfunc, in[i]);
+			break;
+	}
+	return result;
+}
+
 /**
  * This function applies an input function on all elements of a sparse data.
  * The function is modelled after the corresponding function in R.
@@ -1512,19 +2094,7 @@ static bool lapply_error_checking(Oid foid, List * funcname);
  * @return A SparseData with the same dimension as sdata but with each element sdata[i] replaced by func(sdata[i])
  */
 SparseData lapply(text * func, SparseData sdata) {
-	Oid argtypes[1] = { FLOAT8OID };
-	List * funcname = textToQualifiedNameList(func);
-	SparseData result = makeSparseDataCopy(sdata);
-	Oid foid = LookupFuncName(funcname, 1, argtypes, false);
-
-	lapply_error_checking(foid, funcname);
-
-	for (int i=0; i<sdata->unique_value_count; i++)
-		valref(float8,result,i) =
-		    DatumGetFloat8(
-		      OidFunctionCall1(foid,
-				    Float8GetDatum(valref(float8,sdata,i))));
-	return result;
+	return lapply_function(lapply_lookup(func, NULL), sdata);
 }
 
 /* This function checks for error conditions in lapply() function calls.
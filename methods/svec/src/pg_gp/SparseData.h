@@ -24,6 +24,7 @@
 #include <math.h>
 #include <string.h>
 #include "postgres.h"
+#include "fmgr.h"
 #include "lib/stringinfo.h"
 #include "utils/array.h"
 #include "catalog/pg_type.h"
@@ -62,10 +63,14 @@ typedef SparseDataStruct *SparseData;
  * StringInfoData Contents for "index"
  * data contents for "vals" (size is vals->maxlen)
  * data contents for "index" (size is index->maxlen)
+ * l2 norm of the values (a float8, not aligned), since storage version 1
  *
  * 	The vals and index fields are serialized as StringInfoData, then the
  * 	data contents are serialized at the end.
  *
+ * 	The cursor field of the serialized "vals" StringInfoData holds the
+ * 	storage version tag. Version 0 (cursor is 0) has no cached norm.
+ *
  * 	Since two StringInfoData structs together are 64-bit aligned, there's
  * 	no need for padding.
  *
@@ -89,7 +94,15 @@ typedef SparseDataStruct *SparseData;
  */
 #define SIZEOF_SPARSEDATASERIAL(x) (SIZEOF_SPARSEDATAHDR + \
 		(2*sizeof(StringInfoData)) + \
-		(x)->vals->maxlen + (x)->index->maxlen)
+		(x)->vals->maxlen + (x)->index->maxlen + SDATA_NORM_SIZE)
+
+/** Size of the cached l2 norm at the end of a serialized SparseData */
+#define SDATA_NORM_SIZE		sizeof(float8)
+/**
+ * Storage version tag of serialized SparseData with a cached l2 norm. Any
+ * other value of the tag means that there is no cached norm.
+ */
+#define SDATA_VERSION_NORM	0x4e524d31
 
 /*
  * The following take a serialized SparseData as an argument and return
@@ -101,6 +114,8 @@ typedef SparseDataStruct *SparseData;
 #define SDATA_INDEX_SIZE(x)	(((StringInfo)SDATA_INDEX_SINFO(x))->maxlen)
 #define SDATA_VALS_PTR(x)       (SDATA_INDEX_SINFO(x)+sizeof(StringInfoData))
 #define SDATA_INDEX_PTR(x) 	(SDATA_VALS_PTR(x)+SDATA_DATA_SIZE(x))
+#define SDATA_NORM_PTR(x)	(SDATA_INDEX_PTR(x)+SDATA_INDEX_SIZE(x))
+#define SDATA_VERSION(x)	(((StringInfo)SDATA_DATA_SINFO(x))->cursor)
 
 #define SDATA_UNIQUE_VALCNT(x)	(((SparseData)(x))->unique_value_count)
 #define SDATA_TOTAL_VALCNT(x)	(((SparseData)(x))->total_value_count)
@@ -154,9 +169,17 @@ SparseData arr_to_sdata(char *array, size_t width, Oid type_of_data, int count);
 SparseData posit_to_sdata(char *array, int64* array_pos, size_t width, Oid type_of_data, int count, int64 end, char *base_val);
 
 /* Some functions for accessing and changing elements of a SparseData */
+typedef struct LapplyFunction LapplyFunction;
+LapplyFunction *lapply_lookup(text * func, FmgrInfo *caller);
+SparseData lapply_function(LapplyFunction *lfunc, SparseData sdata);
 SparseData lapply(text * func, SparseData sdata);
 double sd_proj(SparseData sdata, int idx);
 SparseData subarr(SparseData sdata, int start, int end);
+int64 *sdata_index_to_run_ends(SparseData sdata);
+int sdata_run_of_position(const int64 *run_ends, int count, int64 pos);
+double sd_proj_run_ends(SparseData sdata, const int64 *run_ends, int idx);
+SparseData subarr_run_ends(SparseData sdata, const int64 *run_ends,
+		int start, int end);
 SparseData reverse(SparseData sdata);
 SparseData concat(SparseData left, SparseData right);
 SparseData concat_replicate(SparseData rep, int multiplier);
@@ -167,6 +190,15 @@ enum operation_t { subtract, add, multiply, divide };
 double sum_sdata_values_double(SparseData sdata);
 SparseData op_sdata_by_sdata(enum operation_t operation, SparseData left,
     SparseData right);
+double dot_sdata_by_sdata(SparseData left, SparseData right);
+double sum_float8_values(const double *vals, int64 count);
+double sum_abs_float8_values(const double *vals, int64 count);
+double dot_float8_values(const double *left, const double *right,
+    int64 count);
+void op_float8_values(enum operation_t operation, const double *left,
+    const double *right, double *result, int64 count);
+void op_float8_values_by_scalar(enum operation_t operation, double scalar,
+    const double *vals, double *result, int64 count, bool scalar_is_right);
 bool sparsedata_eq(SparseData left, SparseData right);
 bool sparsedata_eq_zero_is_equal(SparseData left, SparseData right);
 bool sparsedata_contains(SparseData left, SparseData right);
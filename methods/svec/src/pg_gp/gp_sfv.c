@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "access/hash.h"
 #include "access/tupmacs.h"
 #include "catalog/pg_type.h"
 #if PG_VERSION_NUM >= 90100
@@ -16,12 +17,38 @@
 #include "utils/lsyscache.h"
 
 #include "sparse_vector.h"
+#include "../../../sketch/src/pg_gp/sketch_support.h"
 
 Datum gp_extract_feature_histogram(PG_FUNCTION_ARGS);
+Datum svec_hash_features(PG_FUNCTION_ARGS);
+Datum svec_hash_column_features(PG_FUNCTION_ARGS);
 
 static void gp_extract_feature_histogram_errout(char *msg);
 
-static SvecType * classify_document(Datum *features, int num_features,
+/*
+ * The dictionary of the most recent call, cached in fn_extra
+ *
+ * Typically, the same dictionary is passed for every document in a query.
+ * Checking that the dictionary is sorted and looking up words with bsearch()
+ * requires collation-aware text comparisons, which dominate the cost. We
+ * therefore keep a copy of the dictionary array together with an
+ * open-addressing hash table from words to positions. A word is found if it
+ * is bytewise equal to a dictionary entry, which is exactly when bttextcmp()
+ * considers the two equal (it breaks ties of strcoll() with strcmp()).
+ */
+typedef struct
+{
+	ArrayType  *dictionary;		/* copy of the dictionary argument */
+	Datum	   *features;		/* the words, pointing into dictionary */
+	int			num_features;
+	uint32		mask;			/* number of buckets minus one */
+	int		   *buckets;		/* feature position plus one, or 0 if empty */
+} FeatureDictionary;
+
+static FeatureDictionary * get_feature_dictionary(FunctionCallInfo fcinfo,
+				  ArrayType *arr0);
+
+static SvecType * classify_document(FeatureDictionary *dict,
 				  Datum *document, int num_words, bool *null_words);
 
 #if PG_VERSION_NUM >= 90100
@@ -113,13 +140,13 @@ Datum gp_extract_feature_histogram(PG_FUNCTION_ARGS)
 {
 	SvecType   *returnval;
 	ArrayType  *arr0, *arr1;
-	Datum	   *features, *document;
-	int			num_features, num_words;
+	Datum	   *document;
+	int			num_words;
 	bool	   *null_words;
 	int16		elmlen;
 	bool		elmbyval;
 	char		elmalign;
-	int			i;
+	FeatureDictionary *dict;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
@@ -144,32 +171,124 @@ Datum gp_extract_feature_histogram(PG_FUNCTION_ARGS)
 	if (ARR_ELEMTYPE(arr0) != TEXTOID || ARR_ELEMTYPE(arr1) != TEXTOID)
 		gp_extract_feature_histogram_errout("the input types must be text[]");
 
+	dict = get_feature_dictionary(fcinfo, arr0);
+
 	get_typlenbyvalalign(TEXTOID, &elmlen, &elmbyval, &elmalign);
-	deconstruct_array(arr0, TEXTOID, elmlen, elmbyval, elmalign,
-					  &features, NULL, &num_features);
 	deconstruct_array(arr1, TEXTOID, elmlen, elmbyval, elmalign,
 					  &document, &null_words, &num_words);
 
-	for (i = 0; i < num_features - 1; i++)
+	returnval = classify_document(dict, document, num_words, null_words);
+	pfree(document);
+
+	PG_RETURN_POINTER(returnval);
+}
+
+/*
+ * Hash of the contents of a text datum
+ */
+static uint32
+text_datum_hash(Datum word)
+{
+	text	   *t = (text *) DatumGetPointer(word);
+
+	return DatumGetUInt32(hash_any((unsigned char *) VARDATA_ANY(t),
+								   VARSIZE_ANY_EXHDR(t)));
+}
+
+/*
+ * Position of word in the dictionary, or -1 if it is not contained
+ */
+static int
+lookup_feature(FeatureDictionary *dict, Datum word)
+{
+	text	   *t = (text *) DatumGetPointer(word);
+	int			len = VARSIZE_ANY_EXHDR(t);
+	uint32		bucket = text_datum_hash(word) & dict->mask;
+
+	while (dict->buckets[bucket] != 0)
+	{
+		int		idx = dict->buckets[bucket] - 1;
+		text   *feature = (text *) DatumGetPointer(dict->features[idx]);
+
+		if (VARSIZE_ANY_EXHDR(feature) == len &&
+			memcmp(VARDATA_ANY(feature), VARDATA_ANY(t), len) == 0)
+			return idx;
+		bucket = (bucket + 1) & dict->mask;
+	}
+	return -1;
+}
+
+/*
+ * Return the cached dictionary if arr0 is identical to the one of the previous
+ * call. Otherwise, validate arr0 and build a new hash table.
+ */
+static FeatureDictionary *
+get_feature_dictionary(FunctionCallInfo fcinfo, ArrayType *arr0)
+{
+	FeatureDictionary *dict = (FeatureDictionary *) fcinfo->flinfo->fn_extra;
+	MemoryContext oldcontext;
+	int16		elmlen;
+	bool		elmbyval;
+	char		elmalign;
+	uint32		num_buckets;
+	int			i;
+
+	if (dict != NULL &&
+		VARSIZE(dict->dictionary) == VARSIZE(arr0) &&
+		memcmp(dict->dictionary, arr0, VARSIZE(arr0)) == 0)
+		return dict;
+
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	if (dict == NULL)
+		dict = (FeatureDictionary *) palloc0(sizeof(FeatureDictionary));
+	else
+	{
+		pfree(dict->dictionary);
+		pfree(dict->features);
+		pfree(dict->buckets);
+	}
+	fcinfo->flinfo->fn_extra = NULL;
+
+	dict->dictionary = (ArrayType *) palloc(VARSIZE(arr0));
+	memcpy(dict->dictionary, arr0, VARSIZE(arr0));
+
+	get_typlenbyvalalign(TEXTOID, &elmlen, &elmbyval, &elmalign);
+	deconstruct_array(dict->dictionary, TEXTOID, elmlen, elmbyval, elmalign,
+					  &dict->features, NULL, &dict->num_features);
+
+	for (i = 0; i < dict->num_features - 1; i++)
 	{
 		int		cmp;
 
-		cmp = TextDatumCmp(features[i], features[i + 1]);
+		cmp = TextDatumCmp(dict->features[i], dict->features[i + 1]);
 
 		if (cmp > 0)
 			elog(ERROR, "Dictionary is unsorted: '%s' is out of order.\n",
-					TextDatumGetCString(features[i + 1]));
+					TextDatumGetCString(dict->features[i + 1]));
 		else if (cmp == 0)
 			elog(ERROR, "Dictionary has duplicated word: '%s'\n",
-					TextDatumGetCString(features[i + 1]));
+					TextDatumGetCString(dict->features[i + 1]));
 	}
 
-	returnval = classify_document(features, num_features,
-								  document, num_words, null_words);
-	pfree(features);
-	pfree(document);
+	/* Keep the load factor at or below 1/2 */
+	for (num_buckets = 2; num_buckets < 2 * (uint32) dict->num_features; )
+		num_buckets *= 2;
+	dict->mask = num_buckets - 1;
+	dict->buckets = (int *) palloc0(sizeof(int) * num_buckets);
+	for (i = 0; i < dict->num_features; i++)
+	{
+		uint32	bucket = text_datum_hash(dict->features[i]) & dict->mask;
 
-	PG_RETURN_POINTER(returnval);
+		while (dict->buckets[bucket] != 0)
+			bucket = (bucket + 1) & dict->mask;
+		dict->buckets[bucket] = i + 1;
+	}
+
+	/* Only publish the dictionary once it has been validated */
+	fcinfo->flinfo->fn_extra = dict;
+	MemoryContextSwitchTo(oldcontext);
+
+	return dict;
 }
 
 static void
@@ -180,43 +299,262 @@ gp_extract_feature_histogram_errout(char *msg) {
 		"%s\ngp_extract_feature_histogram internal error.",msg)));
 }
 
-/*
- * The comparator for bsearch.
- */
-static int
-textdatum_cmp(const void *a, const void *b)
-{
-	return TextDatumCmp(*(Datum *) a, *(Datum *) b);
-}
-
 static SvecType *
-classify_document(Datum *features, int num_features,
+classify_document(FeatureDictionary *dict,
 				  Datum *document, int num_words, bool *null_words)
 {
-	float8 * histogram = (float8 *)palloc0(sizeof(float8)*num_features);
+	float8 * histogram = (float8 *)palloc0(sizeof(float8)*dict->num_features);
 	SvecType * output_sfv;
 	int i;
 
 	for (i = 0; i < num_words; i++)
 	{
-		void   *found;
+		int		idx;
 
 		/* Skip if this word is NULL */
 		if (null_words[i])
 			continue;
-		found = bsearch(&document[i], features, num_features,
-						sizeof(Datum), textdatum_cmp);
-		if (found)
-		{
-			int		idx;
-
-			idx = ((uintptr_t) found - (uintptr_t) features) / sizeof(Datum);
+		idx = lookup_feature(dict, document[i]);
+		if (idx >= 0)
 			histogram[idx]++;
-		}
-
 	}
-	output_sfv = svec_from_float8arr(histogram, num_features);
+	output_sfv = svec_from_float8arr(histogram, dict->num_features);
 	pfree(histogram);
 
 	return output_sfv;
 }
+
+/*
+ * Feature hashing
+ *
+ * Instead of looking up words in a dictionary, the hashing trick maps every
+ * feature to the position given by its hash, modulo the dimension 2^k of the
+ * feature space. With signed hashing, another bit of the hash decides whether
+ * the feature adds 1 or -1; collisions then cancel out in expectation, so
+ * that inner products of hashed vectors are unbiased.
+ *
+ * We use MurmurHash3, as the sketches do. Both halves of its 128-bit result
+ * are independent, so the position is taken from the first and the sign from
+ * the second.
+ */
+
+/* Largest supported k: the dimension must fit into an int4 */
+#define SVEC_HASH_MAX_BITS 30
+
+typedef struct
+{
+	int64		position;		/* 1-based */
+	double		value;
+} HashedFeature;
+
+static int
+hashed_feature_cmp(const void *a, const void *b)
+{
+	int64		x = ((const HashedFeature *) a)->position;
+	int64		y = ((const HashedFeature *) b)->position;
+
+	return (x > y) - (x < y);
+}
+
+static void
+check_hash_bits(int32 num_bits)
+{
+	if (num_bits < 1 || num_bits > SVEC_HASH_MAX_BITS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of hash bits must be between 1 and %d",
+						SVEC_HASH_MAX_BITS)));
+}
+
+/*
+ * Hash the contents of a text datum into a feature. The seed distinguishes
+ * features of different columns.
+ */
+static void
+hash_feature(Datum word, uint32 seed, int32 num_bits, bool is_signed,
+			 HashedFeature *feature)
+{
+	text	   *t = (text *) DatumGetPointer(word);
+	uint8		hash[MD5_HASHLEN];
+	uint64		h1, h2;
+
+	murmur3_x64_128(VARDATA_ANY(t), VARSIZE_ANY_EXHDR(t), seed, hash);
+	memcpy(&h1, hash, sizeof(uint64));
+	memcpy(&h2, hash + 8, sizeof(uint64));
+	feature->position = (int64) (h1 & ((UINT64CONST(1) << num_bits) - 1)) + 1;
+	feature->value = (is_signed && (h2 >> 63)) ? -1. : 1.;
+}
+
+/*
+ * Build the svec of dimension 2^num_bits from the hashed features, adding the
+ * values of features that collide
+ */
+static SvecType *
+svec_from_hashed_features(HashedFeature *features, int num_features,
+						  int32 num_bits)
+{
+	int64		dimension = INT64CONST(1) << num_bits;
+	int64	   *positions;
+	double	   *values;
+	int			num_nonzeros = 0;
+	int			i;
+	SparseData	sdata;
+	SvecType   *result;
+
+	qsort(features, num_features, sizeof(HashedFeature), hashed_feature_cmp);
+	positions = (int64 *) palloc(sizeof(int64) * Max(num_features, 1));
+	values = (double *) palloc(sizeof(double) * Max(num_features, 1));
+	for (i = 0; i < num_features; i++)
+	{
+		if (num_nonzeros > 0
+			&& positions[num_nonzeros - 1] == features[i].position)
+			values[num_nonzeros - 1] += features[i].value;
+		else
+		{
+			/* Drop the position if signed features cancelled out */
+			if (num_nonzeros > 0 && values[num_nonzeros - 1] == 0.)
+				num_nonzeros--;
+			positions[num_nonzeros] = features[i].position;
+			values[num_nonzeros] = features[i].value;
+			num_nonzeros++;
+		}
+	}
+	if (num_nonzeros > 0 && values[num_nonzeros - 1] == 0.)
+		num_nonzeros--;
+
+	if (num_nonzeros == 0)
+		sdata = makeSparseDataFromDouble(0., dimension);
+	else
+		sdata = position_to_sdata(values, positions, FLOAT8OID, num_nonzeros,
+								  dimension, 0.);
+	result = svec_from_sparsedata(sdata, true);
+	freeSparseDataAndData(sdata);
+	pfree(positions);
+	pfree(values);
+	return result;
+}
+
+/*
+ * Deconstruct a text array, or raise an error if it is of another type
+ */
+static void
+deconstruct_text_array(ArrayType *array, Datum **elems, bool **nulls,
+					   int *num_elems)
+{
+	int16		elmlen;
+	bool		elmbyval;
+	char		elmalign;
+
+	if (ARR_ELEMTYPE(array) != TEXTOID)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("the input types must be text[]")));
+
+	get_typlenbyvalalign(TEXTOID, &elmlen, &elmbyval, &elmalign);
+	deconstruct_array(array, TEXTOID, elmlen, elmbyval, elmalign,
+					  elems, nulls, num_elems);
+}
+
+/**
+ *	svec_hash_features
+ *	Map the tokens of a document to the hashed feature vector of dimension
+ *	2^num_bits with the count of each feature (or, if is_signed is true, with
+ *	the sum of the signs of its tokens). NULL tokens are ignored.
+ *
+ * Function Signature is:
+ *	svec_hash_features(text[] tokens, int4 num_bits, bool is_signed)
+ */
+PG_FUNCTION_INFO_V1( svec_hash_features );
+Datum svec_hash_features(PG_FUNCTION_ARGS)
+{
+	ArrayType  *tokens = PG_GETARG_ARRAYTYPE_P(0);
+	int32		num_bits = PG_GETARG_INT32(1);
+	bool		is_signed = PG_GETARG_BOOL(2);
+	Datum	   *words;
+	bool	   *null_words;
+	int			num_words;
+	HashedFeature *features;
+	int			num_features = 0;
+	int			i;
+	SvecType   *result;
+
+	check_hash_bits(num_bits);
+	deconstruct_text_array(tokens, &words, &null_words, &num_words);
+
+	features = (HashedFeature *) palloc(sizeof(HashedFeature)
+										* Max(num_words, 1));
+	for (i = 0; i < num_words; i++)
+		if (!null_words[i])
+			hash_feature(words[i], 0, num_bits, is_signed,
+						 &features[num_features++]);
+
+	result = svec_from_hashed_features(features, num_features, num_bits);
+	pfree(features);
+	pfree(words);
+	pfree(null_words);
+
+	PG_RETURN_POINTER(result);
+}
+
+/**
+ *	svec_hash_column_features
+ *	Like svec_hash_features, but for categorical columns: The feature of
+ *	value values[i] of column columns[i] is the pair of both, so that equal
+ *	values of different columns are different features. Pairs with a NULL
+ *	value are ignored.
+ *
+ * Function Signature is:
+ *	svec_hash_column_features(text[] columns, text[] values, int4 num_bits,
+ *		bool is_signed)
+ */
+PG_FUNCTION_INFO_V1( svec_hash_column_features );
+Datum svec_hash_column_features(PG_FUNCTION_ARGS)
+{
+	ArrayType  *columns = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType  *values = PG_GETARG_ARRAYTYPE_P(1);
+	int32		num_bits = PG_GETARG_INT32(2);
+	bool		is_signed = PG_GETARG_BOOL(3);
+	Datum	   *column_names, *column_values;
+	bool	   *null_names, *null_values;
+	int			num_columns, num_values;
+	HashedFeature *features;
+	int			num_features = 0;
+	int			i;
+	SvecType   *result;
+
+	check_hash_bits(num_bits);
+	deconstruct_text_array(columns, &column_names, &null_names, &num_columns);
+	deconstruct_text_array(values, &column_values, &null_values, &num_values);
+	if (num_columns != num_values)
+		ereport(ERROR,
+				(errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+				 errmsg("column and value arrays must have the same length")));
+
+	features = (HashedFeature *) palloc(sizeof(HashedFeature)
+										* Max(num_values, 1));
+	for (i = 0; i < num_values; i++)
+	{
+		text	   *name;
+		uint8		hash[MD5_HASHLEN];
+		uint32		seed;
+
+		if (null_names[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("column names must not be NULL")));
+		if (null_values[i])
+			continue;
+
+		/* The hash of the column name seeds the hash of the value */
+		name = (text *) DatumGetPointer(column_names[i]);
+		murmur3_x64_128(VARDATA_ANY(name), VARSIZE_ANY_EXHDR(name), 0, hash);
+		memcpy(&seed, hash, sizeof(uint32));
+		hash_feature(column_values[i], seed, num_bits, is_signed,
+					 &features[num_features++]);
+	}
+
+	result = svec_from_hashed_features(features, num_features, num_bits);
+	pfree(features);
+
+	PG_RETURN_POINTER(result);
+}
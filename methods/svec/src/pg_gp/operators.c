@@ -48,7 +48,7 @@ double svec_svec_dot_product(SvecType *svec1, SvecType *svec2) {
 	SparseData right = sdata_from_svec(svec2);
 	
 	check_dimension(svec1,svec2,"svec_svec_dot_product");
-	return sum_sdata_values_double( op_sdata_by_sdata(multiply,left,right));
+	return dot_sdata_by_sdata(left,right);
 }
 
 /**
@@ -78,7 +78,8 @@ Datum svec_lapply(PG_FUNCTION_ARGS)
 	text *func = PG_GETARG_TEXT_P(0);
 	SvecType *svec = PG_GETARG_SVECTYPE_P(1);
 	SparseData in = sdata_from_svec(svec);
-	PG_RETURN_SVECTYPE_P(svec_from_sparsedata(lapply(func,in),true));
+	LapplyFunction *lfunc = lapply_lookup(func,fcinfo->flinfo);
+	PG_RETURN_SVECTYPE_P(svec_from_sparsedata(lapply_function(lfunc,in),true));
 }
 
 /**
@@ -160,6 +161,63 @@ Datum svec_append(PG_FUNCTION_ARGS)
 }
 
 
+/**
+ * Cumulative run lengths of the svec most recently passed to a function,
+ * kept in fn_extra
+ *
+ * Queries such as svec_proj(v, i) over many i typically pass the same svec
+ * datum over and over again. The run ends are only recomputed if the datum
+ * pointer changes. Since the executor may reuse memory for a different value,
+ * a pointer match is confirmed by comparing the RLE index, which is much
+ * cheaper than decoding it.
+ */
+typedef struct {
+	Datum datum;
+	int unique_value_count;
+	int total_value_count;
+	int index_size;
+	char *index;
+	int64 *run_ends;
+} RunEndsCache;
+
+static const int64 *
+svec_run_ends_cached(FunctionCallInfo fcinfo, Datum datum, SparseData sdata)
+{
+	RunEndsCache *cache = (RunEndsCache *)fcinfo->flinfo->fn_extra;
+	MemoryContext oldcontext;
+	int64 *run_ends;
+
+	if (cache != NULL &&
+	    cache->datum == datum &&
+	    cache->unique_value_count == sdata->unique_value_count &&
+	    cache->total_value_count == sdata->total_value_count &&
+	    cache->index_size == (sdata->index->data ? sdata->index->len : 0) &&
+	    (cache->index_size == 0 ||
+	     memcmp(cache->index, sdata->index->data, cache->index_size) == 0))
+		return cache->run_ends;
+
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	run_ends = sdata_index_to_run_ends(sdata);
+	if (cache == NULL) {
+		cache = (RunEndsCache *)palloc0(sizeof(RunEndsCache));
+		fcinfo->flinfo->fn_extra = cache;
+	} else {
+		pfree(cache->index);
+		pfree(cache->run_ends);
+	}
+	cache->datum = datum;
+	cache->unique_value_count = sdata->unique_value_count;
+	cache->total_value_count = sdata->total_value_count;
+	cache->index_size = sdata->index->data ? sdata->index->len : 0;
+	cache->index = (char *)palloc(Max(cache->index_size, 1));
+	if (cache->index_size > 0)
+		memcpy(cache->index, sdata->index->data, cache->index_size);
+	cache->run_ends = run_ends;
+	MemoryContextSwitchTo(oldcontext);
+
+	return run_ends;
+}
+
 /**
  *  svec_proj - projects onto an element of an svec
  */
@@ -174,11 +232,12 @@ Datum svec_proj(PG_FUNCTION_ARGS)
 	int idx = PG_GETARG_INT32(1);
 
 	SparseData in = sdata_from_svec(sv);
-	double ret = sd_proj(in,idx);
+	double ret = sd_proj_run_ends(in,
+		svec_run_ends_cached(fcinfo, PG_GETARG_DATUM(0), in), idx);
 
 	if (IS_NVP(ret)) PG_RETURN_NULL();
 
-	PG_RETURN_FLOAT8(sd_proj(in,idx));
+	PG_RETURN_FLOAT8(ret);
 }
 
 /**
@@ -196,7 +255,9 @@ Datum svec_subvec(PG_FUNCTION_ARGS)
 	int end   = PG_GETARG_INT32(2);
 
 	SparseData in = sdata_from_svec(sv);
-	PG_RETURN_SVECTYPE_P(svec_from_sparsedata(subarr(in,start,end),true));
+	PG_RETURN_SVECTYPE_P(svec_from_sparsedata(subarr_run_ends(in,
+		svec_run_ends_cached(fcinfo, PG_GETARG_DATUM(0), in), start, end),
+		true));
 }
 
 /**
@@ -313,10 +374,8 @@ Datum svec_contains(PG_FUNCTION_ARGS)
  */
 static int32_t svec_l2_cmp_internal(SvecType *svec1, SvecType *svec2)
 {
-	SparseData left  = sdata_from_svec(svec1);
-	SparseData right = sdata_from_svec(svec2);
-	double magleft  = l2norm_sdata_values_double(left);
-	double magright = l2norm_sdata_values_double(right);
+	double magleft  = svec_l2norm_internal(svec1);
+	double magright = svec_l2norm_internal(svec2);
 	int result;
 
 	if (IS_NVP(magleft) || IS_NVP(magright)) {
@@ -648,9 +707,8 @@ PG_FUNCTION_INFO_V1( svec_l2norm );
 Datum svec_l2norm(PG_FUNCTION_ARGS)
 {
 	SvecType *svec = PG_GETARG_SVECTYPE_P(0);
-	SparseData sdata  = sdata_from_svec(svec);
 	double accum;
-	accum = l2norm_sdata_values_double(sdata);
+	accum = svec_l2norm_internal(svec);
 
 	if (IS_NVP(accum)) PG_RETURN_NULL();
 
@@ -669,9 +727,8 @@ Datum svec_svec_l2norm(PG_FUNCTION_ARGS)
 	check_dimension(svec1,svec2,"l2norm");
 	SvecType *result = op_svec_by_svec_internal(subtract,svec1,svec2);
 	
-	SparseData sdata  = sdata_from_svec(result);
 	double accum;
-	accum = l2norm_sdata_values_double(sdata);
+	accum = svec_l2norm_internal(result);
 	
 	if (IS_NVP(accum)) PG_RETURN_NULL();
 	
@@ -707,14 +764,12 @@ Datum svec_svec_angle(PG_FUNCTION_ARGS)
 {	
 	SvecType *svec1 = PG_GETARG_SVECTYPE_P(0);
 	SvecType *svec2 = PG_GETARG_SVECTYPE_P(1);
-	SparseData left  = sdata_from_svec(svec1);
-	SparseData right = sdata_from_svec(svec2);
 	double dot, m1, m2, result;
 	
 	dot = svec_svec_dot_product( svec1, svec2);
 
-	m1 = l2norm_sdata_values_double(left);
-	m2 = l2norm_sdata_values_double(right);
+	m1 = svec_l2norm_internal(svec1);
+	m2 = svec_l2norm_internal(svec2);
 
 	if (IS_NVP(dot) || IS_NVP(m1) || IS_NVP(m2)) PG_RETURN_NULL();
 	
@@ -738,14 +793,12 @@ Datum svec_svec_tanimoto_distance(PG_FUNCTION_ARGS)
 {	
 	SvecType *svec1 = PG_GETARG_SVECTYPE_P(0);
 	SvecType *svec2 = PG_GETARG_SVECTYPE_P(1);
-	SparseData left  = sdata_from_svec(svec1);
-	SparseData right = sdata_from_svec(svec2);
 	double dot, m1, m2, result;
 	
 	dot = svec_svec_dot_product( svec1, svec2);
 	
-	m1 = l2norm_sdata_values_double(left);
-	m2 = l2norm_sdata_values_double(right);
+	m1 = svec_l2norm_internal(svec1);
+	m2 = svec_l2norm_internal(svec2);
 	
 	if (IS_NVP(dot) || IS_NVP(m1) || IS_NVP(m2)) PG_RETURN_NULL();
 	
@@ -771,9 +824,10 @@ Datum svec_normalize(PG_FUNCTION_ARGS)
 	SparseData sdata = sdata_from_svec(svec);
 	double norm;
 		
-	norm = l2norm_sdata_values_double(sdata);
+	norm = svec_l2norm_internal(svec);
 	
-	op_sdata_by_scalar_inplace( 3, (char *)&norm, sdata, 2);
+	/* Do not change the argument in place */
+	sdata = op_sdata_by_scalar_copy( 3, (char *)&norm, sdata, 2);
 	
 	PG_RETURN_SVECTYPE_P( svec_from_sparsedata( sdata, true));
 }
@@ -821,6 +875,7 @@ Datum svec_log(PG_FUNCTION_ARGS)
 	int unique_value_count=SVEC_UNIQUE_VALCNT(svec);
 
 	for (int i=0;i<unique_value_count;i++) vals[i] = log(vals[i]);
+	svec_invalidate_norm(svec);
 
 	PG_RETURN_SVECTYPE_P(svec);
 }
@@ -1021,17 +1076,17 @@ Datum svec_cast_positions_float8arr(PG_FUNCTION_ARGS) {
 	float8 *array = (float8 *)ARR_DATA_PTR(A_PG);
 	int64 *array_pos =  (int64 *)ARR_DATA_PTR(B_PG);
 	
-	if ((array_pos[dimension-1] > size)&&(size > 0))
-		ereport(ERROR,
-			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-			 errmsg("svec_cast_positions_float8arr some of the position values are larger than maximum array size declared")));	
-	
 	for(i=0;i < dimension;++i){
 		if(array_pos[i] <= 0){
 			ereport(ERROR,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 				 errmsg("svec_cast_positions_float8arr only accepts position that are positive integers (x > 0)")));
 		}
+		/* The positions need not be sorted, so check all of them */
+		if ((array_pos[i] > size)&&(size > 0))
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("svec_cast_positions_float8arr some of the position values are larger than maximum array size declared")));	
 	}
 	
 	/* Create the output SVEC */
@@ -1111,15 +1166,12 @@ Datum float8arr_equals(PG_FUNCTION_ARGS) {
 }
 
 /*
- * Returns a SparseData formed from a dense float8[] in uncompressed format.
- * This is useful for creating a SparseData without processing that can be
- * used by the SparseData processing routines.
+ * Returns the values of a float8[], with null items converted into NVPs.
+ * Without null items, this is the array data itself. Otherwise, the values
+ * are copied into a palloc'ed buffer.
  */
-static SparseData sdata_uncompressed_from_float8arr_internal(ArrayType *array)
+static double *float8arr_values_with_nvps(ArrayType *array, int num)
 {
-        int dim = ARR_NDIM(array);
-        int *dims = ARR_DIMS(array);
-	int num = ArrayGetNItems(dim,dims);
         double *vals =(double *)ARR_DATA_PTR(array);
         bits8 *bitmap = ARR_NULLBITMAP(array);
         int   bitmask=1;
@@ -1146,6 +1198,35 @@ static SparseData sdata_uncompressed_from_float8arr_internal(ArrayType *array)
                         }
 		}
 	}
+	return(vals);
+}
+
+/*
+ * Returns true if a float8[] contains null items. Arrays may carry a null
+ * bitmap without any null in it, so we have to check the bits.
+ */
+static bool float8arr_contains_nulls(ArrayType *array, int num)
+{
+	bits8 *bitmap = ARR_NULLBITMAP(array);
+
+	if (!bitmap) return false;
+	for (int i=0; i<num/8; i++)
+		if (bitmap[i] != 0xFF) return true;
+	if (num % 8)
+		return (bitmap[num/8] & ((1 << (num % 8)) - 1)) != ((1 << (num % 8)) - 1);
+	return false;
+}
+
+/*
+ * Returns a SparseData formed from a dense float8[] in uncompressed format.
+ * This is useful for creating a SparseData without processing that can be
+ * used by the SparseData processing routines.
+ */
+static SparseData sdata_uncompressed_from_float8arr_internal(ArrayType *array)
+{
+	int num = ArrayGetNItems(ARR_NDIM(array),ARR_DIMS(array));
+	double *vals = float8arr_values_with_nvps(array,num);
+
 	/* Makes the SparseData; this relies on using NULL to represent a
 	 * count array of ones, as described in SparseData.h, after definition
 	 * of SparseDataStruct.
@@ -1157,6 +1238,22 @@ static SparseData sdata_uncompressed_from_float8arr_internal(ArrayType *array)
 	return(result);
 }
 
+/*
+ * The functions below take float8[] arguments. They work directly on the
+ * array data, without wrapping it into an uncompressed SparseData first.
+ * Null items of the arrays make the reductions (norms, sums, dot products)
+ * return NULL, and become NVPs in the results of elementwise operations.
+ */
+static void check_float8arr_dimensions(int left, int right)
+{
+	if (left != right)
+	{
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("dimensions of vectors must be the same")));
+	}
+}
+
 /**
  *  float8arr_l1norm - computes the l1 norm of a float8 array
  */
@@ -1164,13 +1261,12 @@ Datum float8arr_l1norm(PG_FUNCTION_ARGS);
 PG_FUNCTION_INFO_V1( float8arr_l1norm);
 Datum float8arr_l1norm(PG_FUNCTION_ARGS) {
 	ArrayType *array  = PG_GETARG_ARRAYTYPE_P(0);
-	SparseData sdata = sdata_uncompressed_from_float8arr_internal(array);
-	double result = l1norm_sdata_values_double(sdata);
-	pfree(sdata);
+	int num = ArrayGetNItems(ARR_NDIM(array),ARR_DIMS(array));
 
-	if (IS_NVP(result)) PG_RETURN_NULL();
+	if (float8arr_contains_nulls(array,num)) PG_RETURN_NULL();
 
-	PG_RETURN_FLOAT8(result);
+	PG_RETURN_FLOAT8(sum_abs_float8_values(
+				(double *)ARR_DATA_PTR(array),num));
 }
 
 /**
@@ -1180,13 +1276,11 @@ Datum float8arr_summate(PG_FUNCTION_ARGS);
 PG_FUNCTION_INFO_V1( float8arr_summate);
 Datum float8arr_summate(PG_FUNCTION_ARGS) {
 	ArrayType *array  = PG_GETARG_ARRAYTYPE_P(0);
-	SparseData sdata = sdata_uncompressed_from_float8arr_internal(array);
-	double result = sum_sdata_values_double(sdata);
-	pfree(sdata);
+	int num = ArrayGetNItems(ARR_NDIM(array),ARR_DIMS(array));
 
-	if (IS_NVP(result)) PG_RETURN_NULL();
+	if (float8arr_contains_nulls(array,num)) PG_RETURN_NULL();
 
-	PG_RETURN_FLOAT8(result);
+	PG_RETURN_FLOAT8(sum_float8_values((double *)ARR_DATA_PTR(array),num));
 }
 
 
@@ -1197,13 +1291,12 @@ Datum float8arr_l2norm(PG_FUNCTION_ARGS);
 PG_FUNCTION_INFO_V1( float8arr_l2norm);
 Datum float8arr_l2norm(PG_FUNCTION_ARGS) {
 	ArrayType *array  = PG_GETARG_ARRAYTYPE_P(0);
-	SparseData sdata = sdata_uncompressed_from_float8arr_internal(array);
-	double result = l2norm_sdata_values_double(sdata);
-	pfree(sdata);
+	int num = ArrayGetNItems(ARR_NDIM(array),ARR_DIMS(array));
+	double *vals = (double *)ARR_DATA_PTR(array);
 
-	if (IS_NVP(result)) PG_RETURN_NULL();
+	if (float8arr_contains_nulls(array,num)) PG_RETURN_NULL();
 
-	PG_RETURN_FLOAT8(result);
+	PG_RETURN_FLOAT8(sqrt(dot_float8_values(vals,vals,num)));
 }
 
 /**
@@ -1214,20 +1307,138 @@ PG_FUNCTION_INFO_V1( float8arr_dot);
 Datum float8arr_dot(PG_FUNCTION_ARGS) {
 	ArrayType *arr_left   = PG_GETARG_ARRAYTYPE_P(0);
 	ArrayType *arr_right  = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left  = sdata_uncompressed_from_float8arr_internal(arr_left);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr_right);
-	SparseData mult_result;
-	double accum;
+	int num_left  = ArrayGetNItems(ARR_NDIM(arr_left),ARR_DIMS(arr_left));
+	int num_right = ArrayGetNItems(ARR_NDIM(arr_right),ARR_DIMS(arr_right));
 
-	mult_result = op_sdata_by_sdata(multiply,left,right);
-	accum = sum_sdata_values_double(mult_result);
-	freeSparseData(left);
-	freeSparseData(right);
-	freeSparseDataAndData(mult_result);
+	check_float8arr_dimensions(num_left,num_right);
+	if (float8arr_contains_nulls(arr_left,num_left) ||
+	    float8arr_contains_nulls(arr_right,num_right))
+		PG_RETURN_NULL();
 
-	if (IS_NVP(accum)) PG_RETURN_NULL();
+	PG_RETURN_FLOAT8(dot_float8_values((double *)ARR_DATA_PTR(arr_left),
+				(double *)ARR_DATA_PTR(arr_right),num_left));
+}
 
-	PG_RETURN_FLOAT8(accum);
+/*
+ * Performs op between two float8 arrays. If one of them has a single item,
+ * it is treated as a scalar, like svecs of dimension one.
+ */
+static SvecType *op_float8arr_by_float8arr_internal(enum operation_t op,
+		ArrayType *arr1, ArrayType *arr2)
+{
+	int num1 = ArrayGetNItems(ARR_NDIM(arr1),ARR_DIMS(arr1));
+	int num2 = ArrayGetNItems(ARR_NDIM(arr2),ARR_DIMS(arr2));
+	double *vals1, *vals2, *result;
+	SvecType *svec;
+
+	if (num1 == 1 || num2 == 1)
+	{
+		SparseData left  = sdata_uncompressed_from_float8arr_internal(arr1);
+		SparseData right = sdata_uncompressed_from_float8arr_internal(arr2);
+		int scalar_args = check_scalar(SDATA_IS_SCALAR(left),
+					       SDATA_IS_SCALAR(right));
+		return svec_operate_on_sdata_pair(scalar_args,op,left,right);
+	}
+	check_float8arr_dimensions(num1,num2);
+
+	vals1 = float8arr_values_with_nvps(arr1,num1);
+	vals2 = float8arr_values_with_nvps(arr2,num2);
+	result = (double *)palloc(sizeof(float8) * num1);
+	op_float8_values(op,vals1,vals2,result,num1);
+	svec = svec_from_float8arr(result,num1);
+
+	pfree(result);
+	if (vals1 != (double *)ARR_DATA_PTR(arr1)) pfree(vals1);
+	if (vals2 != (double *)ARR_DATA_PTR(arr2)) pfree(vals2);
+	return svec;
+}
+
+/*
+ * Performs op between an svec and a float8 array, with the svec on the left
+ * if svec_is_left. Each run of the svec is applied to the corresponding
+ * slice of the array.
+ */
+static SvecType *op_svec_by_float8arr_internal(enum operation_t op,
+		SvecType *svec, ArrayType *arr, bool svec_is_left)
+{
+	SparseData sdata = sdata_from_svec(svec);
+	int num = ArrayGetNItems(ARR_NDIM(arr),ARR_DIMS(arr));
+	double *svals = (double *)sdata->vals->data;
+	char *ix = sdata->index->data;
+	double *avals, *result;
+	SvecType *svec_result;
+
+	if (SDATA_IS_SCALAR(sdata) || num == 1)
+	{
+		SparseData arrdata = sdata_uncompressed_from_float8arr_internal(arr);
+		SparseData left  = svec_is_left ? sdata : arrdata;
+		SparseData right = svec_is_left ? arrdata : sdata;
+		int scalar_args = check_scalar(SDATA_IS_SCALAR(left),
+					       SDATA_IS_SCALAR(right));
+		return svec_operate_on_sdata_pair(scalar_args,op,left,right);
+	}
+	check_float8arr_dimensions(sdata->total_value_count,num);
+
+	avals = float8arr_values_with_nvps(arr,num);
+	result = (double *)palloc(sizeof(float8) * num);
+	if (ix == NULL)
+	{
+		if (svec_is_left)
+			op_float8_values(op,svals,avals,result,num);
+		else
+			op_float8_values(op,avals,svals,result,num);
+	} else
+	{
+		int64 pos = 0;
+
+		for (int i=0; i<sdata->unique_value_count; i++)
+		{
+			int64 run_length = compword_to_int8(ix);
+
+			op_float8_values_by_scalar(op,svals[i],avals+pos,
+						   result+pos,run_length,
+						   !svec_is_left);
+			pos += run_length;
+			ix += int8compstoragesize(ix);
+		}
+	}
+	svec_result = svec_from_float8arr(result,num);
+
+	pfree(result);
+	if (avals != (double *)ARR_DATA_PTR(arr)) pfree(avals);
+	return svec_result;
+}
+
+/*
+ * Inner product of an svec and a float8 array. Sets *isnull if the array
+ * contains null items.
+ */
+static double svec_dot_float8arr_internal(SvecType *svec, ArrayType *arr,
+		bool *isnull)
+{
+	SparseData sdata = sdata_from_svec(svec);
+	int num = ArrayGetNItems(ARR_NDIM(arr),ARR_DIMS(arr));
+	double *svals = (double *)sdata->vals->data;
+	double *avals = (double *)ARR_DATA_PTR(arr);
+	char *ix = sdata->index->data;
+	double accum = 0.;
+	int64 pos = 0;
+
+	check_float8arr_dimensions(sdata->total_value_count,num);
+	*isnull = float8arr_contains_nulls(arr,num);
+	if (*isnull) return 0.;
+
+	if (ix == NULL) return dot_float8_values(svals,avals,num);
+
+	for (int i=0; i<sdata->unique_value_count; i++)
+	{
+		int64 run_length = compword_to_int8(ix);
+
+		accum += svals[i] * sum_float8_values(avals+pos,run_length);
+		pos += run_length;
+		ix += int8compstoragesize(ix);
+	}
+	return accum;
 }
 
 /*
@@ -1243,10 +1454,7 @@ float8arr_minus_float8arr(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr1 = PG_GETARG_ARRAYTYPE_P(0);
 	ArrayType *arr2 = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left  = sdata_uncompressed_from_float8arr_internal(arr1);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr2);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,subtract,left,right));
+	PG_RETURN_SVECTYPE_P(op_float8arr_by_float8arr_internal(subtract,arr1,arr2));
 }
 PG_FUNCTION_INFO_V1( svec_minus_float8arr );
 Datum
@@ -1254,10 +1462,7 @@ svec_minus_float8arr(PG_FUNCTION_ARGS)
 {
 	SvecType *svec = PG_GETARG_SVECTYPE_P(0);
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left = sdata_from_svec(svec);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,subtract,left,right));
+	PG_RETURN_SVECTYPE_P(op_svec_by_float8arr_internal(subtract,svec,arr,true));
 }
 PG_FUNCTION_INFO_V1( float8arr_minus_svec );
 Datum
@@ -1265,10 +1470,7 @@ float8arr_minus_svec(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(0);
 	SvecType *svec = PG_GETARG_SVECTYPE_P(1);
-	SparseData left = sdata_uncompressed_from_float8arr_internal(arr);
-	SparseData right = sdata_from_svec(svec);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,subtract,left,right));
+	PG_RETURN_SVECTYPE_P(op_svec_by_float8arr_internal(subtract,svec,arr,false));
 }
 
 PG_FUNCTION_INFO_V1( float8arr_plus_float8arr );
@@ -1277,10 +1479,7 @@ float8arr_plus_float8arr(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr1 = PG_GETARG_ARRAYTYPE_P(0);
 	ArrayType *arr2 = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left  = sdata_uncompressed_from_float8arr_internal(arr1);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr2);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,add,left,right));
+	PG_RETURN_SVECTYPE_P(op_float8arr_by_float8arr_internal(add,arr1,arr2));
 }
 PG_FUNCTION_INFO_V1( svec_plus_float8arr );
 Datum
@@ -1288,10 +1487,7 @@ svec_plus_float8arr(PG_FUNCTION_ARGS)
 {
 	SvecType *svec = PG_GETARG_SVECTYPE_P(0);
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left = sdata_from_svec(svec);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,add,left,right));
+	PG_RETURN_SVECTYPE_P(op_svec_by_float8arr_internal(add,svec,arr,true));
 }
 PG_FUNCTION_INFO_V1( float8arr_plus_svec );
 Datum
@@ -1299,10 +1495,7 @@ float8arr_plus_svec(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(0);
 	SvecType *svec = PG_GETARG_SVECTYPE_P(1);
-	SparseData left = sdata_uncompressed_from_float8arr_internal(arr);
-	SparseData right = sdata_from_svec(svec);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,add,left,right));
+	PG_RETURN_SVECTYPE_P(op_svec_by_float8arr_internal(add,svec,arr,false));
 }
 PG_FUNCTION_INFO_V1( float8arr_mult_float8arr );
 Datum
@@ -1310,11 +1503,7 @@ float8arr_mult_float8arr(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr1 = PG_GETARG_ARRAYTYPE_P(0);
 	ArrayType *arr2 = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left  = sdata_uncompressed_from_float8arr_internal(arr1);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr2);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	SvecType *svec = svec_operate_on_sdata_pair(scalar_args,multiply,left,right);
-	PG_RETURN_SVECTYPE_P(svec);
+	PG_RETURN_SVECTYPE_P(op_float8arr_by_float8arr_internal(multiply,arr1,arr2));
 }
 PG_FUNCTION_INFO_V1( svec_mult_float8arr );
 Datum
@@ -1322,11 +1511,7 @@ svec_mult_float8arr(PG_FUNCTION_ARGS)
 {
 	SvecType *svec = PG_GETARG_SVECTYPE_P(0);
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left = sdata_from_svec(svec);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	SvecType *result = svec_operate_on_sdata_pair(scalar_args,multiply,left,right);
-	PG_RETURN_SVECTYPE_P(result);
+	PG_RETURN_SVECTYPE_P(op_svec_by_float8arr_internal(multiply,svec,arr,true));
 }
 PG_FUNCTION_INFO_V1( float8arr_mult_svec );
 Datum
@@ -1334,10 +1519,7 @@ float8arr_mult_svec(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(0);
 	SvecType *svec = PG_GETARG_SVECTYPE_P(1);
-	SparseData left = sdata_uncompressed_from_float8arr_internal(arr);
-	SparseData right = sdata_from_svec(svec);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,multiply,left,right));
+	PG_RETURN_SVECTYPE_P(op_svec_by_float8arr_internal(multiply,svec,arr,false));
 }
 PG_FUNCTION_INFO_V1( float8arr_div_float8arr );
 Datum
@@ -1345,10 +1527,7 @@ float8arr_div_float8arr(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr1 = PG_GETARG_ARRAYTYPE_P(0);
 	ArrayType *arr2 = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left  = sdata_uncompressed_from_float8arr_internal(arr1);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr2);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,divide,left,right));
+	PG_RETURN_SVECTYPE_P(op_float8arr_by_float8arr_internal(divide,arr1,arr2));
 }
 PG_FUNCTION_INFO_V1( svec_div_float8arr );
 Datum
@@ -1356,10 +1535,7 @@ svec_div_float8arr(PG_FUNCTION_ARGS)
 {
 	SvecType *svec = PG_GETARG_SVECTYPE_P(0);
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData left = sdata_from_svec(svec);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,divide,left,right));
+	PG_RETURN_SVECTYPE_P(op_svec_by_float8arr_internal(divide,svec,arr,true));
 }
 PG_FUNCTION_INFO_V1( float8arr_div_svec );
 Datum
@@ -1367,10 +1543,7 @@ float8arr_div_svec(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(0);
 	SvecType *svec = PG_GETARG_SVECTYPE_P(1);
-	SparseData left = sdata_uncompressed_from_float8arr_internal(arr);
-	SparseData right = sdata_from_svec(svec);
-	int scalar_args = check_scalar(SDATA_IS_SCALAR(left),SDATA_IS_SCALAR(right));
-	PG_RETURN_SVECTYPE_P(svec_operate_on_sdata_pair(scalar_args,divide,left,right));
+	PG_RETURN_SVECTYPE_P(op_svec_by_float8arr_internal(divide,svec,arr,false));
 }
 PG_FUNCTION_INFO_V1( svec_dot_float8arr );
 Datum
@@ -1378,16 +1551,10 @@ svec_dot_float8arr(PG_FUNCTION_ARGS)
 {
 	SvecType *svec = PG_GETARG_SVECTYPE_P(0);
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(1);
-	SparseData right = sdata_uncompressed_from_float8arr_internal(arr);
-	SparseData left = sdata_from_svec(svec);
-	SparseData mult_result;
-	double accum;
-	mult_result = op_sdata_by_sdata(multiply,left,right);
-	accum = sum_sdata_values_double(mult_result);
-	freeSparseData(right);
-	freeSparseDataAndData(mult_result);
+	bool isnull;
+	double accum = svec_dot_float8arr_internal(svec,arr,&isnull);
 
-	if (IS_NVP(accum)) PG_RETURN_NULL();
+	if (isnull || IS_NVP(accum)) PG_RETURN_NULL();
 
 	PG_RETURN_FLOAT8(accum);
 }
@@ -1397,16 +1564,10 @@ float8arr_dot_svec(PG_FUNCTION_ARGS)
 {
 	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(0);
 	SvecType *svec = PG_GETARG_SVECTYPE_P(1);
-	SparseData left = sdata_uncompressed_from_float8arr_internal(arr);
-	SparseData right = sdata_from_svec(svec);
-	SparseData mult_result;
-	double accum;
-	mult_result = op_sdata_by_sdata(multiply,left,right);
-	accum = sum_sdata_values_double(mult_result);
-	freeSparseData(left);
-	freeSparseDataAndData(mult_result);
+	bool isnull;
+	double accum = svec_dot_float8arr_internal(svec,arr,&isnull);
 
-	if (IS_NVP(accum)) PG_RETURN_NULL();
+	if (isnull || IS_NVP(accum)) PG_RETURN_NULL();
 
 	PG_RETURN_FLOAT8(accum);
 }
@@ -1545,6 +1706,7 @@ Datum svec_pivot(PG_FUNCTION_ARGS)
 			sdata->index->cursor = len;
 		}
 	}
+	svec_invalidate_norm(svec);
 
 	PG_RETURN_SVECTYPE_P(svec);
 }
@@ -2141,3 +2303,123 @@ Datum svec_mean_final( PG_FUNCTION_ARGS)
 	PG_RETURN_SVECTYPE_P(svec);
 
 }
+
+/*
+ * Adds the elements of sdata to the dense array accum, run by run. If clamp
+ * is true, every value is first replaced by 1 if it is non-zero (and not
+ * NVP), and by 0 otherwise. Runs of zeros are skipped.
+ */
+static void
+add_sdata_to_float8arr(float8 *accum, SparseData sdata, bool clamp)
+{
+	char *ix = sdata->index->data;
+	double *vals = (double *)sdata->vals->data;
+	int64 pos = 0;
+
+	for (int i=0; i<sdata->unique_value_count; i++) {
+		int64 run_len = compword_to_int8(ix);
+		double value = vals[i];
+
+		if (clamp)
+			value = (value != 0. && !IS_NVP(value)) ? 1. : 0.;
+		if (value != 0.) {
+			for (int64 k=pos; k<pos+run_len; k++)
+				accum[k] += value;
+		}
+		pos += run_len;
+		ix += int8compstoragesize(ix);
+	}
+}
+
+/*
+ * Common transition for svec_sum and svec_count_nonzero: the state is a
+ * dense float8 array that is updated in place when called as an aggregate.
+ */
+static Datum
+svec_accum_transition(FunctionCallInfo fcinfo, bool clamp, char *msg)
+{
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(0));
+
+	SvecType *svec = PG_GETARG_SVECTYPE_P(1);
+	SparseData sdata = sdata_from_svec(svec);
+	int svec_dim = sdata->total_value_count;
+	ArrayType *transarray;
+
+	if (PG_ARGISNULL(0)) {
+		/*
+		 * This is the first call, so create a new state array of zeros
+		 */
+		float8 *state_array = (float8 *)palloc0(svec_dim * sizeof(float8));
+		transarray = construct_array((Datum *)state_array,
+					     svec_dim, FLOAT8OID,
+					     sizeof(float8),true,'d');
+		pfree(state_array);
+	} else if (fcinfo->context && IsA(fcinfo->context, AggState))
+		transarray = PG_GETARG_ARRAYTYPE_P(0);
+	else
+		transarray = PG_GETARG_ARRAYTYPE_P_COPY(0);
+
+	int state_dim = (ARR_NDIM(transarray) == 0) ? 0 : ARR_DIMS(transarray)[0];
+	if (state_dim != svec_dim)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("%s: input dimensions should be the same, but are: dim1=%d, dim2=%d\n",
+						msg, state_dim, svec_dim)));
+
+	add_sdata_to_float8arr((float8 *)ARR_DATA_PTR(transarray), sdata, clamp);
+
+	PG_RETURN_ARRAYTYPE_P(transarray);
+}
+
+/**
+ *  svec_sum_transition (float8arr, svec):
+ *
+ *		Adds the svec elementwise to the state array
+ *
+ */
+PG_FUNCTION_INFO_V1( svec_sum_transition );
+Datum svec_sum_transition(PG_FUNCTION_ARGS)
+{
+	return svec_accum_transition(fcinfo, false, "svec_sum_transition");
+}
+
+/**
+ *  svec_count_nonzero_transition (float8arr, svec):
+ *
+ *		Increments the state array at all positions where the svec has a
+ *		non-zero entry
+ *
+ */
+PG_FUNCTION_INFO_V1( svec_count_nonzero_transition );
+Datum svec_count_nonzero_transition(PG_FUNCTION_ARGS)
+{
+	return svec_accum_transition(fcinfo, true,
+		"svec_count_nonzero_transition");
+}
+
+/**
+ *  svec_sum_final (float8arr):
+ *
+ *		Compresses the state array into an SVEC. If there was no input, the
+ *		result is the scalar zero, as for the former svec-typed state.
+ *
+ */
+PG_FUNCTION_INFO_V1( svec_sum_final );
+Datum svec_sum_final(PG_FUNCTION_ARGS)
+{
+	SparseData sdata;
+
+	if (PG_ARGISNULL(0) || ARR_NDIM(PG_GETARG_ARRAYTYPE_P(0)) == 0) {
+		sdata = makeSparseDataFromDouble(0.,1);
+	} else {
+		ArrayType *transarray = PG_GETARG_ARRAYTYPE_P(0);
+		sdata = float8arr_to_sdata((float8 *)ARR_DATA_PTR(transarray),
+					   ARR_DIMS(transarray)[0]);
+	}
+
+	PG_RETURN_SVECTYPE_P(svec_from_sparsedata(sdata,true));
+}
@@ -46,6 +46,15 @@ typedef struct {
  */
 #define SVEC_INDEX_SIZE(x) 	(SDATA_INDEX_SIZE(SVEC_SDATAPTR(x)))
 #define SVEC_INDEX_PTR(x) 	(SDATA_INDEX_PTR(SVEC_SDATAPTR(x)))
+/* The cached l2 norm, only valid if SVEC_HAS_CACHED_NORM(x) */
+#define SVEC_NORM_PTR(x) 	(SDATA_NORM_PTR(SVEC_SDATAPTR(x)))
+/*
+ * svecs stored before the norm was cached have a zero version tag, and no
+ * room for the norm
+ */
+#define SVEC_HAS_CACHED_NORM(x)	\
+	(SDATA_VERSION(SVEC_SDATAPTR(x)) == SDATA_VERSION_NORM && \
+	 SVEC_NORM_PTR(x) + SDATA_NORM_SIZE <= (char *)(x) + VARSIZE(x))
 
 /** @return True if input is a scalar */
 #define IS_SCALAR(x)	(((x)->dimension) < 0 ? 1 : 0 )
@@ -85,6 +94,30 @@ static inline SparseData sdata_from_svec(SvecType *svec)
 	return(sdata);
 }
 
+/*
+ * Returns the l2 norm of an svec, from the cache if available.
+ */
+static inline double svec_l2norm_internal(SvecType *svec)
+{
+	double norm;
+
+	if (SVEC_HAS_CACHED_NORM(svec))
+	{
+		memcpy(&norm,SVEC_NORM_PTR(svec),SDATA_NORM_SIZE);
+		return(norm);
+	}
+	return(l2norm_sdata_values_double(sdata_from_svec(svec)));
+}
+
+/*
+ * Must be called after changing the values of an svec in place, and before
+ * computing its norm.
+ */
+static inline void svec_invalidate_norm(SvecType *svec)
+{
+	SDATA_VERSION(SVEC_SDATAPTR(svec)) = 0;
+}
+
 static inline void printout_svec(SvecType *svec, char *msg, int stop);
 static inline void printout_svec(SvecType *svec, char *msg, int stop)
 {
@@ -158,6 +191,9 @@ Datum svec_cast_float8arr(PG_FUNCTION_ARGS);
 Datum svec_cast_positions_float8arr(PG_FUNCTION_ARGS);
 Datum svec_unnest(PG_FUNCTION_ARGS);
 Datum svec_pivot(PG_FUNCTION_ARGS);
+Datum svec_sum_transition(PG_FUNCTION_ARGS);
+Datum svec_count_nonzero_transition(PG_FUNCTION_ARGS);
+Datum svec_sum_final(PG_FUNCTION_ARGS);
 
 Datum svec_hash(PG_FUNCTION_ARGS);
 
@@ -0,0 +1,776 @@
+/**
+ * @file
+ * This module defines the index/value sparse vector type spvec, a companion
+ * to the run-length encoded svec for vectors with scattered nonzeros.
+ *
+ * Binary operations walk the two sorted position arrays in a merge join. For
+ * dot products, where only the common positions matter, the walk gallops
+ * (exponential search followed by binary search) through the longer vector
+ * whenever the lengths differ a lot, so the cost is
+ * O(n log(m/n)) instead of O(n + m) for n << m nonzeros.
+ */
+
+#include <postgres.h>
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "catalog/pg_type.h"
+#include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+
+#include "sparse_vector.h"
+#include "spvec.h"
+
+/**
+ * Gallop when one vector has this many times more nonzeros than the other
+ */
+#define SPVEC_GALLOP_RATIO 16
+
+/**
+ * Allocates a zeroed spvec with room for nnz nonzeros
+ */
+SpvecType *makeEmptySpvec(int dimension, int nnz)
+{
+	Size size = SPVEC_SIZE(nnz);
+	SpvecType *result = (SpvecType *)palloc0(size);
+
+	SET_VARSIZE(result,size);
+	result->dimension = dimension;
+	result->nnz = nnz;
+	return(result);
+}
+
+/**
+ * Shrinks the number of nonzeros of a freshly built spvec, moving the values
+ * to their new offset. The memory is not reallocated.
+ */
+static void spvec_truncate(SpvecType *spvec, int nnz)
+{
+	float8 *old_vals = SPVEC_VALS_PTR(spvec);
+
+	spvec->nnz = nnz;
+	memmove(SPVEC_VALS_PTR(spvec),old_vals,nnz * sizeof(float8));
+	SET_VARSIZE(spvec,SPVEC_SIZE(nnz));
+}
+
+static void check_spvec_dimension(SpvecType *spvec1, SpvecType *spvec2,
+		char *msg)
+{
+	if (spvec1->dimension != spvec2->dimension)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("%s: dimensions of inputs are not the same: dim1=%d, dim2=%d",
+				msg, spvec1->dimension, spvec2->dimension)));
+}
+
+/**
+ * Checks positions and values, and builds an spvec from them. The positions
+ * are 0-based and need not be sorted; values at the same position are added
+ * up (as in feature hashing), and zeros are dropped.
+ */
+typedef struct {
+	int4 index;
+	float8 value;
+} spvec_entry;
+
+static int spvec_entry_cmp(const void *a, const void *b)
+{
+	int4 ia = ((const spvec_entry *)a)->index;
+	int4 ib = ((const spvec_entry *)b)->index;
+	return (ia > ib) - (ia < ib);
+}
+
+static SpvecType *spvec_from_entries(spvec_entry *entries, int count,
+		int dimension)
+{
+	SpvecType *result;
+	int4 *index;
+	float8 *vals;
+	bool sorted = true;
+	int i, nnz;
+
+	for (i = 0; i < count; i++) {
+		if (entries[i].index < 0 || entries[i].index >= dimension)
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("spvec position %d out of range [1,%d]",
+					entries[i].index + 1, dimension)));
+		if (isnan(entries[i].value))
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("spvec values must not be NULL or NaN")));
+		if (i > 0 && entries[i].index <= entries[i-1].index)
+			sorted = false;
+	}
+	if (!sorted)
+		qsort(entries,count,sizeof(spvec_entry),spvec_entry_cmp);
+
+	result = makeEmptySpvec(dimension,count);
+	index = SPVEC_INDEX_PTR(result);
+	vals = SPVEC_VALS_PTR(result);
+	nnz = 0;
+	for (i = 0; i < count; i++) {
+		if (nnz > 0 && index[nnz-1] == entries[i].index)
+			vals[nnz-1] += entries[i].value;
+		else {
+			/* Overwrite a previous entry that summed up to zero */
+			if (nnz > 0 && vals[nnz-1] == 0.)
+				nnz--;
+			index[nnz] = entries[i].index;
+			vals[nnz] = entries[i].value;
+			nnz++;
+		}
+	}
+	if (nnz > 0 && vals[nnz-1] == 0.)
+		nnz--;
+	spvec_truncate(result,nnz);
+	return(result);
+}
+
+/**
+ * Builds an spvec from arrays of 0-based positions and of values
+ */
+static SpvecType *spvec_from_arrays(int4 *index, float8 *vals, int count,
+		int dimension)
+{
+	spvec_entry *entries = (spvec_entry *)palloc(
+		Max(count,1) * sizeof(spvec_entry));
+	SpvecType *result;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		entries[i].index = index[i];
+		entries[i].value = vals[i];
+	}
+	result = spvec_from_entries(entries,count,dimension);
+	pfree(entries);
+	return(result);
+}
+
+/**
+ * Checks that an array argument is a one-dimensional array without NULLs,
+ * and returns its number of elements
+ */
+static int spvec_check_array(ArrayType *array, Oid elemtype, char *msg)
+{
+	if (ARR_ELEMTYPE(array) != elemtype)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("%s: unexpected array element type", msg)));
+	if (ARR_NDIM(array) == 0)
+		return 0;
+	if (ARR_NDIM(array) != 1)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("%s: only defined over 1 dimensional arrays", msg)));
+	if (ARR_HASNULL(array))
+		ereport(ERROR,
+			(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+			 errmsg("%s: NULL array elements are not allowed", msg)));
+	return ARR_DIMS(array)[0];
+}
+
+PG_FUNCTION_INFO_V1(spvec_in);
+/**
+ *  spvec_in - reads in a string and converts that to an spvec
+ *
+ * The input format is the dimension, followed by a standard Postgres array
+ * of 1-based positions and an array of values, separated by colons:
+ * 	10:{2,7}:{4.3,0.2}
+ */
+Datum spvec_in(PG_FUNCTION_ARGS)
+{
+	char *str = pstrdup(PG_GETARG_CSTRING(0));
+	char *index_str, *vals_str, *end;
+	ArrayType *pgarray_ix, *pgarray_vals;
+	SpvecType *result;
+	long dimension;
+	int4 *index;
+	int count, i;
+
+	if ((index_str = strchr(str,':')) == NULL ||
+	    (vals_str = strchr(index_str + 1,':')) == NULL)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+			 errmsg("Invalid input string for spvec")));
+	*index_str++ = '\0';
+	*vals_str++ = '\0';
+
+	dimension = strtol(str,&end,10);
+	if (end == str || *end != '\0' || dimension < 1 || dimension > INT_MAX)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+			 errmsg("Invalid dimension in input string for spvec")));
+
+	pgarray_ix = DatumGetArrayTypeP(
+			    OidFunctionCall3(F_ARRAY_IN,CStringGetDatum(index_str),
+			    ObjectIdGetDatum(INT4OID),Int32GetDatum(-1)));
+	pgarray_vals = DatumGetArrayTypeP(
+			    OidFunctionCall3(F_ARRAY_IN,CStringGetDatum(vals_str),
+			    ObjectIdGetDatum(FLOAT8OID),Int32GetDatum(-1)));
+
+	count = spvec_check_array(pgarray_ix,INT4OID,"spvec_in");
+	if (count != spvec_check_array(pgarray_vals,FLOAT8OID,"spvec_in"))
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("Position count not equal to value count")));
+
+	/* Convert to 0-based positions */
+	index = (int4 *)palloc(Max(count,1) * sizeof(int4));
+	for (i = 0; i < count; i++)
+		index[i] = ((int4 *)ARR_DATA_PTR(pgarray_ix))[i] - 1;
+
+	result = spvec_from_arrays(index,(float8 *)ARR_DATA_PTR(pgarray_vals),
+		count,(int)dimension);
+	pfree(index);
+	PG_RETURN_SPVECTYPE_P(result);
+}
+
+PG_FUNCTION_INFO_V1(spvec_out);
+/**
+ *  spvec_out - converts an spvec to a string
+ */
+Datum spvec_out(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	int4 *index = SPVEC_INDEX_PTR(spvec);
+	float8 *vals = SPVEC_VALS_PTR(spvec);
+	StringInfoData buf;
+	int i;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf,"%d:{",spvec->dimension);
+	for (i = 0; i < spvec->nnz; i++)
+		appendStringInfo(&buf,i == 0 ? "%d" : ",%d",index[i] + 1);
+	appendStringInfoString(&buf,"}:{");
+	for (i = 0; i < spvec->nnz; i++) {
+		if (i > 0)
+			appendStringInfoChar(&buf,',');
+		appendStringInfoString(&buf,DatumGetCString(
+			DirectFunctionCall1(float8out,Float8GetDatum(vals[i]))));
+	}
+	appendStringInfoChar(&buf,'}');
+
+	PG_RETURN_CSTRING(buf.data);
+}
+
+PG_FUNCTION_INFO_V1(spvec_send);
+/**
+ *  spvec_send - converts an spvec to binary format
+ */
+Datum spvec_send(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	int4 *index = SPVEC_INDEX_PTR(spvec);
+	float8 *vals = SPVEC_VALS_PTR(spvec);
+	StringInfoData buf;
+	int i;
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf,spvec->dimension,sizeof(int4));
+	pq_sendint(&buf,spvec->nnz,sizeof(int4));
+	for (i = 0; i < spvec->nnz; i++)
+		pq_sendint(&buf,index[i],sizeof(int4));
+	for (i = 0; i < spvec->nnz; i++)
+		pq_sendfloat8(&buf,vals[i]);
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(spvec_recv);
+/**
+ *  spvec_recv - converts external binary format to an spvec
+ */
+Datum spvec_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+	int dimension = pq_getmsgint(buf,sizeof(int4));
+	int nnz = pq_getmsgint(buf,sizeof(int4));
+	int4 *index;
+	float8 *vals;
+	SpvecType *result;
+	int i;
+
+	if (dimension < 1 || nnz < 0 || nnz > dimension)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+			 errmsg("invalid dimension or number of nonzeros in external spvec")));
+
+	index = (int4 *)palloc(Max(nnz,1) * sizeof(int4));
+	vals = (float8 *)palloc(Max(nnz,1) * sizeof(float8));
+	for (i = 0; i < nnz; i++)
+		index[i] = pq_getmsgint(buf,sizeof(int4));
+	for (i = 0; i < nnz; i++)
+		vals[i] = pq_getmsgfloat8(buf);
+
+	result = spvec_from_arrays(index,vals,nnz,dimension);
+	pfree(index);
+	pfree(vals);
+	PG_RETURN_SPVECTYPE_P(result);
+}
+
+PG_FUNCTION_INFO_V1(spvec_make);
+/**
+ *  spvec_make - builds an spvec from arrays of 1-based positions and values
+ *
+ * Positions need not be sorted. Values at the same position are added up.
+ */
+Datum spvec_make(PG_FUNCTION_ARGS)
+{
+	ArrayType *pgarray_ix = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType *pgarray_vals = PG_GETARG_ARRAYTYPE_P(1);
+	int dimension = PG_GETARG_INT32(2);
+	int count = spvec_check_array(pgarray_ix,INT4OID,"spvec_make");
+	int4 *index;
+	SpvecType *result;
+	int i;
+
+	if (count != spvec_check_array(pgarray_vals,FLOAT8OID,"spvec_make"))
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("spvec_make: position count not equal to value count")));
+	if (dimension < 1)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("spvec_make: dimension must be positive")));
+
+	index = (int4 *)palloc(Max(count,1) * sizeof(int4));
+	for (i = 0; i < count; i++)
+		index[i] = ((int4 *)ARR_DATA_PTR(pgarray_ix))[i] - 1;
+
+	result = spvec_from_arrays(index,(float8 *)ARR_DATA_PTR(pgarray_vals),
+		count,dimension);
+	pfree(index);
+	PG_RETURN_SPVECTYPE_P(result);
+}
+
+PG_FUNCTION_INFO_V1(spvec_dimension);
+/**
+ *  spvec_dimension - returns the number of elements in an spvec
+ */
+Datum spvec_dimension(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	PG_RETURN_INT32(spvec->dimension);
+}
+
+PG_FUNCTION_INFO_V1(spvec_nnz);
+/**
+ *  spvec_nnz - returns the number of nonzero elements in an spvec
+ */
+Datum spvec_nnz(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	PG_RETURN_INT32(spvec->nnz);
+}
+
+PG_FUNCTION_INFO_V1(spvec_indices);
+/**
+ *  spvec_indices - returns the 1-based positions of the nonzeros
+ */
+Datum spvec_indices(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	int4 *index = SPVEC_INDEX_PTR(spvec);
+	Datum *elems = (Datum *)palloc(Max(spvec->nnz,1) * sizeof(Datum));
+	int i;
+
+	for (i = 0; i < spvec->nnz; i++)
+		elems[i] = Int32GetDatum(index[i] + 1);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(elems,spvec->nnz,INT4OID,
+		sizeof(int4),true,'i'));
+}
+
+PG_FUNCTION_INFO_V1(spvec_values);
+/**
+ *  spvec_values - returns the nonzero values
+ */
+Datum spvec_values(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	float8 *vals = SPVEC_VALS_PTR(spvec);
+	Datum *elems = (Datum *)palloc(Max(spvec->nnz,1) * sizeof(Datum));
+	int i;
+
+	for (i = 0; i < spvec->nnz; i++)
+		elems[i] = Float8GetDatum(vals[i]);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(elems,spvec->nnz,FLOAT8OID,
+		sizeof(float8),FLOAT8PASSBYVAL,'d'));
+}
+
+/**
+ * Returns the first position p >= from with index[p] >= target, or count if
+ * there is none. The search probes from, from + 1, from + 3, from + 7, ...
+ * and then bisects the last interval.
+ */
+static int spvec_gallop(const int4 *index, int from, int count, int4 target)
+{
+	int lo = from, hi, step = 1;
+
+	if (lo >= count || index[lo] >= target)
+		return lo;
+	/* Invariant: index[lo] < target */
+	hi = lo + step;
+	while (hi < count && index[hi] < target) {
+		lo = hi;
+		step *= 2;
+		hi = lo + step;
+	}
+	if (hi > count)
+		hi = count;
+	/* Now index[lo] < target, and hi == count or index[hi] >= target */
+	while (hi - lo > 1) {
+		int mid = lo + (hi - lo) / 2;
+		if (index[mid] < target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return hi;
+}
+
+/**
+ * Dot product of two spvecs
+ */
+static double spvec_spvec_dot_product(SpvecType *spvec1, SpvecType *spvec2)
+{
+	SpvecType *small = spvec1, *large = spvec2;
+	int4 *ix_small, *ix_large;
+	float8 *v_small, *v_large;
+	double accum = 0.;
+	int i = 0, j = 0;
+
+	check_spvec_dimension(spvec1,spvec2,"spvec_dot");
+	if (small->nnz > large->nnz) {
+		small = spvec2;
+		large = spvec1;
+	}
+	ix_small = SPVEC_INDEX_PTR(small);
+	ix_large = SPVEC_INDEX_PTR(large);
+	v_small = SPVEC_VALS_PTR(small);
+	v_large = SPVEC_VALS_PTR(large);
+
+	if ((int64) small->nnz * SPVEC_GALLOP_RATIO < large->nnz) {
+		for (i = 0; i < small->nnz && j < large->nnz; i++) {
+			j = spvec_gallop(ix_large,j,large->nnz,ix_small[i]);
+			if (j < large->nnz && ix_large[j] == ix_small[i])
+				accum += v_small[i] * v_large[j++];
+		}
+	} else {
+		while (i < small->nnz && j < large->nnz) {
+			if (ix_small[i] < ix_large[j])
+				i++;
+			else if (ix_small[i] > ix_large[j])
+				j++;
+			else
+				accum += v_small[i++] * v_large[j++];
+		}
+	}
+	return accum;
+}
+
+/**
+ * Sum (sign = 1) or difference (sign = -1) of two spvecs, as a merge of the
+ * position arrays
+ */
+static SpvecType *spvec_add_internal(SpvecType *spvec1, SpvecType *spvec2,
+		double sign)
+{
+	int4 *ix1 = SPVEC_INDEX_PTR(spvec1), *ix2 = SPVEC_INDEX_PTR(spvec2);
+	float8 *v1 = SPVEC_VALS_PTR(spvec1), *v2 = SPVEC_VALS_PTR(spvec2);
+	SpvecType *result;
+	int4 *ix;
+	float8 *v;
+	int i = 0, j = 0, n = 0;
+
+	check_spvec_dimension(spvec1,spvec2,sign > 0 ? "spvec_plus" : "spvec_minus");
+	result = makeEmptySpvec(spvec1->dimension,spvec1->nnz + spvec2->nnz);
+	ix = SPVEC_INDEX_PTR(result);
+	v = SPVEC_VALS_PTR(result);
+
+	while (i < spvec1->nnz || j < spvec2->nnz) {
+		if (j >= spvec2->nnz || (i < spvec1->nnz && ix1[i] < ix2[j])) {
+			ix[n] = ix1[i];
+			v[n] = v1[i++];
+		} else if (i >= spvec1->nnz || ix1[i] > ix2[j]) {
+			ix[n] = ix2[j];
+			v[n] = sign * v2[j++];
+		} else {
+			ix[n] = ix1[i];
+			v[n] = v1[i++] + sign * v2[j++];
+		}
+		/* Exact cancellation: do not store the zero */
+		if (v[n] != 0.)
+			n++;
+	}
+	spvec_truncate(result,n);
+	return result;
+}
+
+PG_FUNCTION_INFO_V1(spvec_dot);
+/**
+ *  spvec_dot - computes the dot product of two spvecs
+ */
+Datum spvec_dot(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec1 = PG_GETARG_SPVECTYPE_P(0);
+	SpvecType *spvec2 = PG_GETARG_SPVECTYPE_P(1);
+
+	PG_RETURN_FLOAT8(spvec_spvec_dot_product(spvec1,spvec2));
+}
+
+PG_FUNCTION_INFO_V1(spvec_plus);
+/**
+ *  spvec_plus - adds two spvecs, element by element
+ */
+Datum spvec_plus(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec1 = PG_GETARG_SPVECTYPE_P(0);
+	SpvecType *spvec2 = PG_GETARG_SPVECTYPE_P(1);
+
+	PG_RETURN_SPVECTYPE_P(spvec_add_internal(spvec1,spvec2,1.));
+}
+
+PG_FUNCTION_INFO_V1(spvec_minus);
+/**
+ *  spvec_minus - subtracts the second spvec from the first, element by element
+ */
+Datum spvec_minus(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec1 = PG_GETARG_SPVECTYPE_P(0);
+	SpvecType *spvec2 = PG_GETARG_SPVECTYPE_P(1);
+
+	PG_RETURN_SPVECTYPE_P(spvec_add_internal(spvec1,spvec2,-1.));
+}
+
+PG_FUNCTION_INFO_V1(spvec_l2norm);
+/**
+ *  spvec_l2norm - computes the l2 norm of an spvec
+ */
+Datum spvec_l2norm(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	float8 *vals = SPVEC_VALS_PTR(spvec);
+	double accum = 0.;
+	int i;
+
+	for (i = 0; i < spvec->nnz; i++)
+		accum += vals[i] * vals[i];
+
+	PG_RETURN_FLOAT8(sqrt(accum));
+}
+
+PG_FUNCTION_INFO_V1(spvec_l1norm);
+/**
+ *  spvec_l1norm - computes the l1 norm of an spvec
+ */
+Datum spvec_l1norm(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	float8 *vals = SPVEC_VALS_PTR(spvec);
+	double accum = 0.;
+	int i;
+
+	for (i = 0; i < spvec->nnz; i++)
+		accum += fabs(vals[i]);
+
+	PG_RETURN_FLOAT8(accum);
+}
+
+PG_FUNCTION_INFO_V1(spvec_eq);
+/**
+ *  spvec_eq - returns true if two spvecs are equal
+ *
+ * Since spvecs never store zeros, equal vectors have identical
+ * representations.
+ */
+Datum spvec_eq(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec1 = PG_GETARG_SPVECTYPE_P(0);
+	SpvecType *spvec2 = PG_GETARG_SPVECTYPE_P(1);
+	float8 *v1 = SPVEC_VALS_PTR(spvec1), *v2 = SPVEC_VALS_PTR(spvec2);
+	int i;
+
+	if (spvec1->dimension != spvec2->dimension || spvec1->nnz != spvec2->nnz
+	    || memcmp(SPVEC_INDEX_PTR(spvec1),SPVEC_INDEX_PTR(spvec2),
+		      spvec1->nnz * sizeof(int4)) != 0)
+		PG_RETURN_BOOL(false);
+	for (i = 0; i < spvec1->nnz; i++)
+		if (v1[i] != v2[i])
+			PG_RETURN_BOOL(false);
+	PG_RETURN_BOOL(true);
+}
+
+PG_FUNCTION_INFO_V1(spvec_cast_svec);
+/**
+ *  spvec_cast_svec - turns an svec into an spvec
+ *
+ * Runs of nonzero values are expanded into one entry per element, so the
+ * size of the result is proportional to the number of nonzeros.
+ */
+Datum spvec_cast_svec(PG_FUNCTION_ARGS)
+{
+	SvecType *svec = PG_GETARG_SVECTYPE_P(0);
+	SparseData sdata = sdata_from_svec(svec);
+	double *vals = (double *)sdata->vals->data;
+	char *ix = sdata->index->data;
+	SpvecType *result;
+	int4 *index;
+	float8 *rvals;
+	int64 pos, nnz = 0;
+	int i, n;
+
+	if (IS_SCALAR(svec))
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("cannot cast a scalar svec to spvec")));
+
+	/* First pass: count the nonzeros, rejecting NULLs */
+	for (i = 0; i < sdata->unique_value_count; i++) {
+		int64 run_length = compword_to_int8(ix);
+		if (IS_NVP(vals[i]))
+			ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("cannot cast an svec with NULL values (NVP) to spvec")));
+		if (vals[i] != 0.)
+			nnz += run_length;
+		ix += int8compstoragesize(ix);
+	}
+
+	result = makeEmptySpvec(svec->dimension,(int)nnz);
+	index = SPVEC_INDEX_PTR(result);
+	rvals = SPVEC_VALS_PTR(result);
+
+	/* Second pass: expand the runs of nonzeros */
+	ix = sdata->index->data;
+	pos = 0;
+	n = 0;
+	for (i = 0; i < sdata->unique_value_count; i++) {
+		int64 run_length = compword_to_int8(ix);
+		if (vals[i] != 0.) {
+			int64 k;
+			for (k = 0; k < run_length; k++) {
+				index[n] = (int4)(pos + k);
+				rvals[n++] = vals[i];
+			}
+		}
+		pos += run_length;
+		ix += int8compstoragesize(ix);
+	}
+
+	PG_RETURN_SPVECTYPE_P(result);
+}
+
+PG_FUNCTION_INFO_V1(svec_cast_spvec);
+/**
+ *  svec_cast_spvec - turns an spvec into an svec
+ *
+ * Adjacent equal values are merged into one run.
+ */
+Datum svec_cast_spvec(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	int4 *index = SPVEC_INDEX_PTR(spvec);
+	float8 *vals = SPVEC_VALS_PTR(spvec);
+	SparseData sdata = makeSparseData();
+	double zero = 0.;
+	int64 pos = 0;
+	int i = 0;
+
+	sdata->type_of_data = FLOAT8OID;
+	while (i < spvec->nnz) {
+		int j = i + 1;
+
+		if (index[i] > pos)
+			add_run_to_sdata((char *)&zero,index[i] - pos,sizeof(float8),
+				sdata);
+		while (j < spvec->nnz && index[j] == index[j-1] + 1
+		       && vals[j] == vals[i])
+			j++;
+		add_run_to_sdata((char *)&vals[i],j - i,sizeof(float8),sdata);
+		pos = index[j-1] + 1;
+		i = j;
+	}
+	if (spvec->dimension > pos)
+		add_run_to_sdata((char *)&zero,spvec->dimension - pos,sizeof(float8),
+			sdata);
+
+	sdata->unique_value_count = sdata->vals->len / sizeof(float8);
+	sdata->total_value_count = spvec->dimension;
+
+	PG_RETURN_SVECTYPE_P(svec_from_sparsedata(sdata,true));
+}
+
+PG_FUNCTION_INFO_V1(spvec_cast_float8arr);
+/**
+ *  spvec_cast_float8arr - turns a float8 array into an spvec
+ */
+Datum spvec_cast_float8arr(PG_FUNCTION_ARGS)
+{
+	ArrayType *A_PG = PG_GETARG_ARRAYTYPE_P(0);
+	int dimension = spvec_check_array(A_PG,FLOAT8OID,"spvec_cast_float8arr");
+	float8 *array = (float8 *)ARR_DATA_PTR(A_PG);
+	SpvecType *result;
+	int4 *index;
+	float8 *vals;
+	int i, nnz = 0;
+
+	if (dimension == 0)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("spvec_cast_float8arr: array must not be empty")));
+	for (i = 0; i < dimension; i++) {
+		if (isnan(array[i]))
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("spvec values must not be NULL or NaN")));
+		if (array[i] != 0.)
+			nnz++;
+	}
+
+	result = makeEmptySpvec(dimension,nnz);
+	index = SPVEC_INDEX_PTR(result);
+	vals = SPVEC_VALS_PTR(result);
+	nnz = 0;
+	for (i = 0; i < dimension; i++)
+		if (array[i] != 0.) {
+			index[nnz] = i;
+			vals[nnz++] = array[i];
+		}
+
+	PG_RETURN_SPVECTYPE_P(result);
+}
+
+PG_FUNCTION_INFO_V1(spvec_return_array);
+/**
+ *  spvec_return_array - returns a float8 array of the elements of an spvec
+ */
+Datum spvec_return_array(PG_FUNCTION_ARGS)
+{
+	SpvecType *spvec = PG_GETARG_SPVECTYPE_P(0);
+	int4 *index = SPVEC_INDEX_PTR(spvec);
+	float8 *vals = SPVEC_VALS_PTR(spvec);
+	Size nbytes = ARR_OVERHEAD_NONULLS(1) + spvec->dimension * sizeof(float8);
+	ArrayType *result = (ArrayType *)palloc0(nbytes);
+	float8 *data;
+	int i;
+
+	SET_VARSIZE(result,nbytes);
+	result->ndim = 1;
+	result->dataoffset = 0;
+	result->elemtype = FLOAT8OID;
+	ARR_DIMS(result)[0] = spvec->dimension;
+	ARR_LBOUND(result)[0] = 1;
+	data = (float8 *)ARR_DATA_PTR(result);
+	for (i = 0; i < spvec->nnz; i++)
+		data[index[i]] = vals[i];
+
+	PG_RETURN_ARRAYTYPE_P(result);
+}
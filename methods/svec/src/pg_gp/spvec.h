@@ -0,0 +1,72 @@
+/**
+ * @file
+ * \brief Persistent storage for the index/value sparse vector datatype
+ *
+ */
+
+#ifndef SPVEC_H
+#define SPVEC_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+/*!
+ * \internal
+ * An index/value sparse vector stores only its nonzero elements, as an
+ * array of strictly increasing 0-based positions followed by an array of the
+ * corresponding values. Unlike the run-length encoded svec, every nonzero
+ * costs exactly one int4 and one float8, regardless of the values of its
+ * neighbors. This suits vectors with scattered nonzeros, like hashed
+ * features.
+ *
+ * The values start at the first 8-byte boundary after the positions.
+ * \endinternal
+ */
+typedef struct {
+	int4 vl_len_;   /**< Varlena header (do not touch directly!) */
+	int4 dimension; /**< Number of elements in this vector */
+	int4 nnz;       /**< Number of stored (nonzero) elements */
+	int4 reserved;  /**< Unused, keeps the positions 8-byte aligned */
+	int4 index[1];  /**< The nnz positions, followed by the nnz values */
+} SpvecType;
+
+#define DatumGetSpvecTypeP(X)          ((SpvecType *) PG_DETOAST_DATUM(X))
+#define PG_GETARG_SPVECTYPE_P(n)       DatumGetSpvecTypeP(PG_GETARG_DATUM(n))
+#define PG_RETURN_SPVECTYPE_P(x)       PG_RETURN_POINTER(x)
+
+/* All macros take an (SpvecType *) or a number of nonzeros as argument */
+#define SPVECHDRSIZE		(4 * sizeof(int4))
+#define SPVEC_VALS_OFFSET(nnz)	TYPEALIGN(sizeof(float8), \
+					SPVECHDRSIZE + (nnz) * sizeof(int4))
+#define SPVEC_SIZE(nnz)		(SPVEC_VALS_OFFSET(nnz) + (nnz) * sizeof(float8))
+#define SPVEC_INDEX_PTR(x)	((x)->index)
+#define SPVEC_VALS_PTR(x)	((float8 *)((char *)(x) + SPVEC_VALS_OFFSET((x)->nnz)))
+
+SpvecType *makeEmptySpvec(int dimension, int nnz);
+
+Datum spvec_in(PG_FUNCTION_ARGS);
+Datum spvec_out(PG_FUNCTION_ARGS);
+Datum spvec_send(PG_FUNCTION_ARGS);
+Datum spvec_recv(PG_FUNCTION_ARGS);
+
+Datum spvec_make(PG_FUNCTION_ARGS);
+Datum spvec_dimension(PG_FUNCTION_ARGS);
+Datum spvec_nnz(PG_FUNCTION_ARGS);
+Datum spvec_indices(PG_FUNCTION_ARGS);
+Datum spvec_values(PG_FUNCTION_ARGS);
+
+// Operators
+Datum spvec_dot(PG_FUNCTION_ARGS);
+Datum spvec_plus(PG_FUNCTION_ARGS);
+Datum spvec_minus(PG_FUNCTION_ARGS);
+Datum spvec_l2norm(PG_FUNCTION_ARGS);
+Datum spvec_l1norm(PG_FUNCTION_ARGS);
+Datum spvec_eq(PG_FUNCTION_ARGS);
+
+// Casts
+Datum spvec_cast_svec(PG_FUNCTION_ARGS);
+Datum svec_cast_spvec(PG_FUNCTION_ARGS);
+Datum spvec_cast_float8arr(PG_FUNCTION_ARGS);
+Datum spvec_return_array(PG_FUNCTION_ARGS);
+
+#endif  /* SPVEC_H */
@@ -0,0 +1,487 @@
+#include "postgres.h"
+#include <string.h>
+#include <math.h>
+#include "fmgr.h"
+#include "access/hash.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#if PG_VERSION_NUM >= 90100
+#include "catalog/pg_collation.h"
+#endif
+
+/**
+ * @file textfex.c
+ * @brief compute the r factors of a sentence (the single-state features of
+ *        its tokens) without materializing them for all distinct tokens
+ * @date October 2026
+ *
+ * The feature model is passed as arrays that are the same for every sentence
+ * of a query (uncorrelated scalar subqueries). It is hashed once per query
+ * and kept in fn_extra, together with the scores of the tokens seen so far,
+ * so that the regular expressions are evaluated at most once per distinct
+ * token, as in the SQL version of text_feature_extraction().
+ **/
+
+Datum vcrf_rfactors(PG_FUNCTION_ARGS);
+
+/* Number of model arguments, following the tokens argument */
+#define TEXTFEX_MODEL_ARGS 6
+
+/* Tokens whose scores are remembered, per query */
+#define TEXTFEX_MAX_MEMO 65536
+
+/*
+ * Open-addressing hash table (with linear probing) from strings to indices.
+ * The strings are not copied: They point into the cached arguments, or into
+ * memory owned by the cache.
+ */
+typedef struct
+{
+    MemoryContext context;
+    int           capacity;     /* power of 2, at least twice maxsize */
+    int           size;
+    int           maxsize;
+    int          *slots;        /* 0 for an empty slot, else 1 + index */
+    const char  **keys;
+    int          *lens;
+} textfex_strtab;
+
+/*
+ * The per-query state of vcrf_rfactors, kept in fn_extra:
+ *
+ * - args are copies of the model arguments, to detect a different model.
+ *   arg_ptrs are the arguments of the last call: If the same arrays are
+ *   passed again, we do not even need to compare the contents.
+ * - words maps the token of each word feature (the name without "W_") to a
+ *   row of word_weights, which holds the summed weights of all labels.
+ * - known holds the tokens of the dictionary. unknown_weights are the
+ *   weights of the unknown-token feature "U".
+ * - regex_patterns are the patterns of the regular expressions that have a
+ *   feature, and regex_weights their rows of weights.
+ * - memo maps tokens seen before to their row of memo_scores.
+ *
+ * All of it lives in context, a child of fn_mcxt, so that a new model
+ * replaces the old one with a single MemoryContextDelete().
+ */
+typedef struct
+{
+    MemoryContext   context;
+    ArrayType      *args[TEXTFEX_MODEL_ARGS];
+    ArrayType      *arg_ptrs[TEXTFEX_MODEL_ARGS];
+    int             nlabel;
+
+    textfex_strtab  words;
+    double         *word_weights;
+    textfex_strtab  known;
+    double         *unknown_weights;
+    int             nregex;
+    Datum          *regex_patterns;
+    double         *regex_weights;
+
+    textfex_strtab  memo;
+    int            *memo_scores;
+    double         *acc;
+} textfex_state;
+
+static uint32
+textfex_hash(const char *inKey, int inLen)
+{
+    return DatumGetUInt32(hash_any((const unsigned char *) inKey, inLen));
+}
+
+static void
+textfex_strtab_alloc(textfex_strtab *ioTable, int inMaxSize)
+{
+    int capacity = 16;
+
+    while (capacity < 2 * inMaxSize)
+        capacity *= 2;
+    ioTable->capacity = capacity;
+    ioTable->size = 0;
+    ioTable->maxsize = inMaxSize;
+    ioTable->slots = (int *) MemoryContextAllocZero(ioTable->context,
+        sizeof(int) * capacity);
+    ioTable->keys = (const char **) MemoryContextAlloc(ioTable->context,
+        sizeof(char *) * inMaxSize);
+    ioTable->lens = (int *) MemoryContextAlloc(ioTable->context,
+        sizeof(int) * inMaxSize);
+}
+
+static void
+textfex_strtab_init(textfex_strtab *outTable, MemoryContext inContext,
+    int inMaxSize)
+{
+    outTable->context = inContext;
+    textfex_strtab_alloc(outTable, Max(inMaxSize, 1));
+}
+
+static int textfex_strtab_find(textfex_strtab *ioTable, const char *inKey,
+    int inLen, bool inInsert);
+
+/*
+ * Double the number of entries that fit into the table
+ */
+static void
+textfex_strtab_grow(textfex_strtab *ioTable)
+{
+    int          *slots = ioTable->slots;
+    const char  **keys = ioTable->keys;
+    int          *lens = ioTable->lens;
+    int           size = ioTable->size;
+    int           i;
+
+    textfex_strtab_alloc(ioTable, 2 * ioTable->maxsize);
+    for (i = 0; i < size; i++)
+        textfex_strtab_find(ioTable, keys[i], lens[i], true);
+    pfree(slots);
+    pfree(keys);
+    pfree(lens);
+}
+
+/*
+ * Return the index of a string, or -1 if it is not in the table. If inInsert
+ * is true, a missing string is inserted (with the next index).
+ */
+static int
+textfex_strtab_find(textfex_strtab *ioTable, const char *inKey, int inLen,
+    bool inInsert)
+{
+    uint32  mask = (uint32) ioTable->capacity - 1;
+    uint32  pos = textfex_hash(inKey, inLen) & mask;
+    int     index;
+
+    while (ioTable->slots[pos] != 0) {
+        index = ioTable->slots[pos] - 1;
+        if (ioTable->lens[index] == inLen
+            && memcmp(ioTable->keys[index], inKey, inLen) == 0)
+            return index;
+        pos = (pos + 1) & mask;
+    }
+    if (!inInsert)
+        return -1;
+    if (ioTable->size == ioTable->maxsize) {
+        textfex_strtab_grow(ioTable);
+        return textfex_strtab_find(ioTable, inKey, inLen, true);
+    }
+
+    index = ioTable->size++;
+    ioTable->keys[index] = inKey;
+    ioTable->lens[index] = inLen;
+    ioTable->slots[pos] = index + 1;
+    return index;
+}
+
+/*
+ * Deconstruct a one-dimensional array without NULLs
+ */
+static void
+textfex_get_elms(ArrayType *inArray, const char *inName, Datum **outElems,
+    int *outLen)
+{
+    int16   typlen;
+    bool    typbyval;
+    char    typalign;
+    bool   *nulls;
+    int     i;
+
+    if (ARR_NDIM(inArray) > 1)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("%s must be a one-dimensional array", inName)));
+
+    get_typlenbyvalalign(ARR_ELEMTYPE(inArray), &typlen, &typbyval, &typalign);
+    deconstruct_array(inArray, ARR_ELEMTYPE(inArray), typlen, typbyval,
+        typalign, outElems, &nulls, outLen);
+    for (i = 0; i < *outLen; i++)
+        if (nulls[i])
+            ereport(ERROR,
+                (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                 errmsg("%s must not contain NULL values", inName)));
+}
+
+/*
+ * Build the hashed model from the copies of the model arguments in ioState
+ */
+static void
+textfex_build(textfex_state *ioState, MemoryContext inContext)
+{
+    Datum      *names, *labels, *weights, *regex_names, *patterns, *tokens;
+    int         nfeatures, nlabels, nweights, nregex_names, npatterns, ntokens;
+    int         nlabel = ioState->nlabel;
+    int         i, j, index, label;
+    const char *name;
+    int         len;
+    int        *regex_index;
+
+    textfex_get_elms(ioState->args[0], "feature names", &names, &nfeatures);
+    textfex_get_elms(ioState->args[1], "feature labels", &labels, &nlabels);
+    textfex_get_elms(ioState->args[2], "feature weights", &weights, &nweights);
+    textfex_get_elms(ioState->args[3], "regex names", &regex_names,
+        &nregex_names);
+    textfex_get_elms(ioState->args[4], "regex patterns", &patterns, &npatterns);
+    textfex_get_elms(ioState->args[5], "dictionary", &tokens, &ntokens);
+    if (nlabels != nfeatures || nweights != nfeatures)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("feature names, labels, and weights must have the same length")));
+    if (npatterns != nregex_names)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("regex names and patterns must have the same length")));
+
+    textfex_strtab_init(&ioState->known, inContext, ntokens);
+    for (i = 0; i < ntokens; i++)
+        textfex_strtab_find(&ioState->known,
+            VARDATA_ANY(DatumGetPointer(tokens[i])),
+            VARSIZE_ANY_EXHDR(DatumGetPointer(tokens[i])), true);
+
+    textfex_strtab_init(&ioState->words, inContext, nfeatures);
+    ioState->word_weights = (double *) MemoryContextAllocZero(inContext,
+        sizeof(double) * Max(nfeatures, 1) * nlabel);
+    ioState->unknown_weights = (double *) MemoryContextAllocZero(inContext,
+        sizeof(double) * nlabel);
+    ioState->regex_patterns = (Datum *) MemoryContextAlloc(inContext,
+        sizeof(Datum) * Max(nregex_names, 1));
+    ioState->regex_weights = (double *) MemoryContextAllocZero(inContext,
+        sizeof(double) * Max(nregex_names, 1) * nlabel);
+    ioState->nregex = 0;
+
+    /*
+     * A regex feature "R_x" belongs to the regular expressions named "x%"
+     * (the SQL version joins on features.name || '%' = 'R_' || regex.name).
+     * Only regular expressions with a feature are evaluated.
+     */
+    regex_index = (int *) palloc(sizeof(int) * Max(nregex_names, 1));
+    for (j = 0; j < nregex_names; j++)
+        regex_index[j] = -1;
+
+    for (i = 0; i < nfeatures; i++) {
+        name = VARDATA_ANY(DatumGetPointer(names[i]));
+        len = VARSIZE_ANY_EXHDR(DatumGetPointer(names[i]));
+        label = DatumGetInt32(labels[i]);
+        if (label < 0 || label >= nlabel)
+            continue;
+
+        if (len == 1 && name[0] == 'U') {
+            ioState->unknown_weights[label] += DatumGetFloat8(weights[i]);
+        } else if (len >= 2 && name[0] == 'W' && name[1] == '_') {
+            index = textfex_strtab_find(&ioState->words, name + 2, len - 2,
+                true);
+            ioState->word_weights[index * nlabel + label]
+                += DatumGetFloat8(weights[i]);
+        } else if (len >= 2 && name[0] == 'R' && name[1] == '_') {
+            for (j = 0; j < nregex_names; j++) {
+                const char *regex_name
+                    = VARDATA_ANY(DatumGetPointer(regex_names[j]));
+                int         regex_len
+                    = VARSIZE_ANY_EXHDR(DatumGetPointer(regex_names[j]));
+
+                if (regex_len != len - 1 || regex_name[regex_len - 1] != '%'
+                    || memcmp(regex_name, name + 2, len - 2) != 0)
+                    continue;
+                if (regex_index[j] < 0) {
+                    regex_index[j] = ioState->nregex++;
+                    ioState->regex_patterns[regex_index[j]] = patterns[j];
+                }
+                ioState->regex_weights[regex_index[j] * nlabel + label]
+                    += DatumGetFloat8(weights[i]);
+            }
+        }
+    }
+    pfree(regex_index);
+
+    textfex_strtab_init(&ioState->memo, inContext, 256);
+    ioState->memo_scores = (int *) MemoryContextAlloc(inContext,
+        sizeof(int) * nlabel * ioState->memo.maxsize);
+    ioState->acc = (double *) MemoryContextAlloc(inContext,
+        sizeof(double) * nlabel);
+}
+
+/*
+ * Return the cached state for the model arguments of this call, building it
+ * if the model or the number of labels changed
+ */
+static textfex_state *
+textfex_get_state(FunctionCallInfo fcinfo, int nlabel)
+{
+    textfex_state  *state = (textfex_state *) fcinfo->flinfo->fn_extra;
+    MemoryContext   context, oldContext;
+    ArrayType      *args[TEXTFEX_MODEL_ARGS];
+    bool            matches;
+    int             i;
+
+    for (i = 0; i < TEXTFEX_MODEL_ARGS; i++)
+        args[i] = PG_GETARG_ARRAYTYPE_P(i + 1);
+
+    if (state != NULL && state->nlabel == nlabel) {
+        matches = true;
+        for (i = 0; i < TEXTFEX_MODEL_ARGS && matches; i++) {
+            if (state->arg_ptrs[i] == args[i])
+                continue;
+            matches = VARSIZE(state->args[i]) == VARSIZE(args[i])
+                && memcmp(state->args[i], args[i], VARSIZE(args[i])) == 0;
+            if (matches)
+                state->arg_ptrs[i] = args[i];
+        }
+        if (matches)
+            return state;
+    }
+
+    /*
+     * The cache is rebuilt from scratch in its own memory context, which is
+     * only published once it is complete
+     */
+    if (state != NULL) {
+        fcinfo->flinfo->fn_extra = NULL;
+        MemoryContextDelete(state->context);
+    }
+    context = AllocSetContextCreate(fcinfo->flinfo->fn_mcxt,
+        "vcrf_rfactors cache", ALLOCSET_DEFAULT_MINSIZE,
+        ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
+    oldContext = MemoryContextSwitchTo(context);
+    state = (textfex_state *) palloc0(sizeof(textfex_state));
+    state->context = context;
+    state->nlabel = nlabel;
+    for (i = 0; i < TEXTFEX_MODEL_ARGS; i++) {
+        state->args[i] = (ArrayType *) palloc(VARSIZE(args[i]));
+        memcpy(state->args[i], args[i], VARSIZE(args[i]));
+        state->arg_ptrs[i] = args[i];
+    }
+    textfex_build(state, context);
+    MemoryContextSwitchTo(oldContext);
+
+    fcinfo->flinfo->fn_extra = state;
+    return state;
+}
+
+/*
+ * Compute the scores of a token (the summed weights of all its features,
+ * scaled by 1000 and rounded as by a cast to integer in SQL)
+ */
+static void
+textfex_score(textfex_state *ioState, Datum inToken, int *outScores)
+{
+    const char *token = VARDATA_ANY(DatumGetPointer(inToken));
+    int         len = VARSIZE_ANY_EXHDR(DatumGetPointer(inToken));
+    int         nlabel = ioState->nlabel;
+    double     *acc = ioState->acc;
+    int         index, i, label;
+
+    for (label = 0; label < nlabel; label++)
+        acc[label] = 0;
+
+    if (textfex_strtab_find(&ioState->known, token, len, false) < 0)
+        for (label = 0; label < nlabel; label++)
+            acc[label] += ioState->unknown_weights[label];
+
+    index = textfex_strtab_find(&ioState->words, token, len, false);
+    if (index >= 0)
+        for (label = 0; label < nlabel; label++)
+            acc[label] += ioState->word_weights[index * nlabel + label];
+
+    for (i = 0; i < ioState->nregex; i++) {
+#if PG_VERSION_NUM >= 90100
+        bool matches = DatumGetBool(DirectFunctionCall2Coll(textregexeq,
+            DEFAULT_COLLATION_OID, inToken, ioState->regex_patterns[i]));
+#else
+        bool matches = DatumGetBool(DirectFunctionCall2(textregexeq,
+            inToken, ioState->regex_patterns[i]));
+#endif
+        if (matches)
+            for (label = 0; label < nlabel; label++)
+                acc[label] += ioState->regex_weights[i * nlabel + label];
+    }
+
+    for (label = 0; label < nlabel; label++)
+        outScores[label] = (int) rint(acc[label] * 1000);
+}
+
+/*
+ * Remember the scores of a token for the rest of the query
+ */
+static void
+textfex_memo_add(textfex_state *ioState, Datum inToken, const int *inScores)
+{
+    int     len = VARSIZE_ANY_EXHDR(DatumGetPointer(inToken));
+    int     nlabel = ioState->nlabel;
+    int     maxsize = ioState->memo.maxsize;
+    char   *key;
+    int     index;
+
+    key = (char *) MemoryContextAlloc(ioState->context, Max(len, 1));
+    memcpy(key, VARDATA_ANY(DatumGetPointer(inToken)), len);
+    index = textfex_strtab_find(&ioState->memo, key, len, true);
+    if (ioState->memo.maxsize != maxsize)
+        ioState->memo_scores = (int *) repalloc(ioState->memo_scores,
+            sizeof(int) * nlabel * ioState->memo.maxsize);
+    memcpy(ioState->memo_scores + index * nlabel, inScores,
+        sizeof(int) * nlabel);
+}
+
+PG_FUNCTION_INFO_V1(vcrf_rfactors);
+
+/*
+ * Return the r factors of a sentence, in the layout expected by
+ * vcrf_top1_label: The scores of all labels of the first token, followed by
+ * those of the second token, etc.
+ *
+ * Arguments: tokens, feature names, feature labels, feature weights, regex
+ * names, regex patterns, dictionary (the tokens that are known), nlabel.
+ */
+Datum
+vcrf_rfactors(PG_FUNCTION_ARGS)
+{
+    ArrayType      *tokens_arr = PG_GETARG_ARRAYTYPE_P(0);
+    int             nlabel = PG_GETARG_INT32(TEXTFEX_MODEL_ARGS + 1);
+    textfex_state  *state;
+    Datum          *tokens;
+    int             ntokens;
+    ArrayType      *result;
+    int            *scores;
+    int             i, index;
+    int             len;
+
+    if (nlabel < 1)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("number of labels must be positive")));
+
+    state = textfex_get_state(fcinfo, nlabel);
+    textfex_get_elms(tokens_arr, "tokens", &tokens, &ntokens);
+
+    result = construct_empty_array(INT4OID);
+    if (ntokens == 0)
+        PG_RETURN_ARRAYTYPE_P(result);
+
+    {
+        int     dims[1];
+        int     lbs[1];
+        Datum  *elems = (Datum *) palloc(sizeof(Datum) * ntokens * nlabel);
+
+        dims[0] = ntokens * nlabel;
+        lbs[0] = 1;
+        scores = (int *) palloc(sizeof(int) * nlabel);
+        for (i = 0; i < ntokens; i++) {
+            const int *token_scores;
+
+            len = VARSIZE_ANY_EXHDR(DatumGetPointer(tokens[i]));
+            index = textfex_strtab_find(&state->memo,
+                VARDATA_ANY(DatumGetPointer(tokens[i])), len, false);
+            if (index >= 0) {
+                token_scores = state->memo_scores + index * nlabel;
+            } else {
+                textfex_score(state, tokens[i], scores);
+                token_scores = scores;
+                if (state->memo.size < TEXTFEX_MAX_MEMO)
+                    textfex_memo_add(state, tokens[i], scores);
+            }
+            for (index = 0; index < nlabel; index++)
+                elems[i * nlabel + index] = Int32GetDatum(token_scores[index]);
+        }
+        result = construct_md_array(elems, NULL, 1, dims, lbs, INT4OID,
+            sizeof(int4), true, 'i');
+    }
+    PG_RETURN_ARRAYTYPE_P(result);
+}
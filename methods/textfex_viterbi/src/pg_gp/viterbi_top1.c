@@ -13,7 +13,18 @@ PG_MODULE_MAGIC;
 #define min(a,b)((a) < (b) ? (a):(b))
 #endif
 
+/*
+ * log(exp(x)+exp(y)) on the scores scaled by 1000 is computed as
+ * min(x,y) + log_add(abs(x-y)). log_add is tabulated for differences below
+ * LOG_ADD_TABLE_SIZE, with the same expression as the direct computation,
+ * so that the results do not change.
+ */
+#define LOG_ADD_TABLE_SIZE 16384
+#define log_add_direct(d) ((int)(log(exp((d)/1000.0) + 1)*1000.0 + 0.5))
+
 Datum vcrf_top1_label(PG_FUNCTION_ARGS);
+Datum vcrf_top1_marginals(PG_FUNCTION_ARGS);
+Datum vcrf_topk_label(PG_FUNCTION_ARGS);
 
 /**
  * @file viterbi_top1.c
@@ -28,14 +39,121 @@ Datum vcrf_top1_label(PG_FUNCTION_ARGS);
  *         the fist number is the numerator, the second number is the normalization factor.
  **/
 
+/*
+ * The per-query state of vcrf_top1_label, kept in fn_extra:
+ *
+ * - trans is the transpose of the edge features in mArray, i.e.,
+ *   trans[currlabel*nlabel+prevlabel] = mArray[(prevlabel+1)*nlabel+currlabel],
+ *   so that the scores of all previous labels of a label are contiguous.
+ *   mArray is kept to detect a different model.
+ * - exp_trans is exp((trans - trans_max)/1000), the transition factors
+ *   of the scaled forward-backward pass in vcrf_top1_marginals.
+ * - log_add is the table of log_add_direct.
+ * - the remaining arrays are scratch buffers reused by all documents.
+ */
+typedef struct
+{
+    int     nlabel;
+    int    *mArray;
+    int    *trans;
+    double *exp_trans;
+    int     trans_max;
+    int    *log_add;
+    int    *prev_top1_array;
+    int    *curr_top1_array;
+    int    *prev_norm_array;
+    int    *curr_norm_array;
+    int    *scores;
+    int    *path;
+    int     path_size;
+    double *fscratch;
+    int     fscratch_size;
+    int    *kscratch;
+    int     kscratch_size;
+} vcrf_top1_state;
+
+static inline int
+log_add(const int *table, int d)
+{
+    return d < LOG_ADD_TABLE_SIZE ? table[d] : log_add_direct(d);
+}
+
+/*
+ * Return the cached state for the model in mArray, building the transposed
+ * transition matrix if the model or the number of labels changed.
+ */
+static vcrf_top1_state *
+vcrf_top1_get_state(FunctionCallInfo fcinfo, const int *mArray, int nlabel, int doclen)
+{
+    vcrf_top1_state *state = (vcrf_top1_state *) fcinfo->flinfo->fn_extra;
+    MemoryContext    mcxt  = fcinfo->flinfo->fn_mcxt;
+    int              msize = (nlabel + 2) * nlabel;
+    int              d, prevlabel, currlabel;
+
+    if (state == NULL) {
+        state = (vcrf_top1_state *) MemoryContextAllocZero(mcxt, sizeof(vcrf_top1_state));
+        state->log_add = (int *) MemoryContextAlloc(mcxt, sizeof(int) * LOG_ADD_TABLE_SIZE);
+        for (d = 0; d < LOG_ADD_TABLE_SIZE; d++)
+            state->log_add[d] = log_add_direct(d);
+        fcinfo->flinfo->fn_extra = state;
+    }
+
+    if (state->nlabel != nlabel) {
+        if (state->nlabel > 0) {
+            pfree(state->mArray);
+            pfree(state->trans);
+            pfree(state->exp_trans);
+            pfree(state->prev_top1_array);
+            pfree(state->curr_top1_array);
+            pfree(state->prev_norm_array);
+            pfree(state->curr_norm_array);
+            pfree(state->scores);
+        }
+        state->mArray = (int *) MemoryContextAlloc(mcxt, sizeof(int) * msize);
+        state->trans = (int *) MemoryContextAlloc(mcxt, sizeof(int) * nlabel * nlabel);
+        state->exp_trans = (double *) MemoryContextAlloc(mcxt, sizeof(double) * nlabel * nlabel);
+        state->prev_top1_array = (int *) MemoryContextAlloc(mcxt, sizeof(int) * nlabel);
+        state->curr_top1_array = (int *) MemoryContextAlloc(mcxt, sizeof(int) * nlabel);
+        state->prev_norm_array = (int *) MemoryContextAlloc(mcxt, sizeof(int) * nlabel);
+        state->curr_norm_array = (int *) MemoryContextAlloc(mcxt, sizeof(int) * nlabel);
+        state->scores = (int *) MemoryContextAlloc(mcxt, sizeof(int) * nlabel);
+        state->nlabel = nlabel;
+        // force the transposition below
+        state->mArray[0] = ~mArray[0];
+    }
+
+    if (memcmp(state->mArray, mArray, sizeof(int) * msize) != 0) {
+        memcpy(state->mArray, mArray, sizeof(int) * msize);
+        for (currlabel = 0; currlabel < nlabel; currlabel++)
+            for (prevlabel = 0; prevlabel < nlabel; prevlabel++)
+                state->trans[currlabel*nlabel+prevlabel] = mArray[(prevlabel+1)*nlabel+currlabel];
+        state->trans_max = state->trans[0];
+        for (d = 1; d < nlabel * nlabel; d++)
+            state->trans_max = Max(state->trans_max, state->trans[d]);
+        for (d = 0; d < nlabel * nlabel; d++)
+            state->exp_trans[d] = exp((state->trans[d] - state->trans_max)/1000.0);
+    }
+
+    if (state->path_size < doclen * nlabel) {
+        if (state->path_size > 0)
+            pfree(state->path);
+        state->path_size = Max(doclen * nlabel, state->path_size * 2);
+        state->path = (int *) MemoryContextAlloc(mcxt, sizeof(int) * state->path_size);
+    }
+
+    return state;
+}
+
 PG_FUNCTION_INFO_V1(vcrf_top1_label);
 
 Datum
 vcrf_top1_label(PG_FUNCTION_ARGS)
 {
-	ArrayType *result;
-        int *prev_top1_array, *curr_top1_array, *prev_norm_array, *curr_norm_array, *path, *mArray, *rArray;
-        int ndatabytes, nbytes, norm_factor, i;
+        ArrayType *result;
+        vcrf_top1_state *state;
+        int *prev_top1_array, *curr_top1_array, *prev_norm_array, *curr_norm_array, *path, *mArray, *rArray, *scores, *tmp;
+        const int *trans, *log_table;
+        int norm_factor, i;
         int start_pos, label, currlabel, prevlabel, doclen, nlabel;
         Oid     element_type;
         mArray = (int*)ARR_DATA_PTR(PG_GETARG_ARRAYTYPE_P(0));
@@ -43,16 +161,23 @@ vcrf_top1_label(PG_FUNCTION_ARGS)
         rArray = (int*)ARR_DATA_PTR(PG_GETARG_ARRAYTYPE_P(1));
         nlabel = PG_GETARG_INT32(2);
         doclen = ARR_DIMS(PG_GETARG_ARRAYTYPE_P(1))[0]/nlabel;
-        // initialize the four temporary arrays
-        ndatabytes = sizeof(int) * nlabel;
-        prev_top1_array = (int*) palloc0(ndatabytes);
-        curr_top1_array = (int*) palloc0(ndatabytes);
-        prev_norm_array = (int*) palloc0(ndatabytes);
-        curr_norm_array = (int*) palloc0(ndatabytes);
-        
-        // define the path
-        nbytes = doclen*nlabel*sizeof(int); 
-        path = (int*)palloc0(nbytes);
+        if (ARR_DIMS(PG_GETARG_ARRAYTYPE_P(0))[0] < (nlabel+2)*nlabel)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("the edge feature array must have at least (nlabel+2)*nlabel elements")));
+
+        // the transposed transition matrix and the scratch buffers are cached across calls
+        state = vcrf_top1_get_state(fcinfo, mArray, nlabel, doclen);
+        trans = state->trans;
+        log_table = state->log_add;
+        prev_top1_array = state->prev_top1_array;
+        curr_top1_array = state->curr_top1_array;
+        prev_norm_array = state->prev_norm_array;
+        curr_norm_array = state->curr_norm_array;
+        scores = state->scores;
+        path = state->path;
+        memset(curr_top1_array, 0, nlabel*sizeof(int));
+        memset(curr_norm_array, 0, nlabel*sizeof(int));
         
         // define the output, the first doclen elements are to store the best label sequence
         // the last two elements are used to calculate the probability.
@@ -64,50 +189,61 @@ vcrf_top1_label(PG_FUNCTION_ARGS)
         ARR_DIMS(result)[0] = doclen+1; 
         ARR_LBOUND(result)[0] = 1;
         for(start_pos=0;start_pos<doclen;start_pos++){
-            memset(curr_top1_array, 0, nlabel*sizeof(int));
-            memset(curr_norm_array, 0, nlabel*sizeof(int));
+            // swap the buffers, the current scores become the previous ones
+            tmp = prev_top1_array; prev_top1_array = curr_top1_array; curr_top1_array = tmp;
+            tmp = prev_norm_array; prev_norm_array = curr_norm_array; curr_norm_array = tmp;
             if (start_pos == 0){// the first token in a sentence, the start feature to be fired.
-               for(int label=0; label<nlabel; label++){
-                  curr_norm_array[label] = rArray[start_pos*nlabel+label] + mArray[label]; 
-                  curr_top1_array[label] = rArray[start_pos*nlabel+label] + mArray[label]; 
+               for(label=0; label<nlabel; label++){
+                  curr_norm_array[label] = rArray[label] + mArray[label]; 
+                  curr_top1_array[label] = rArray[label] + mArray[label]; 
+                  path[label] = 0;
                }
             } else {
+                    const int *rrow = rArray + start_pos*nlabel;
+                    // the last token in a sentence, the end feature should be fired 
+                    const int *end = (start_pos == doclen-1) ? mArray + (nlabel+1)*nlabel : NULL;
                     for(currlabel=0; currlabel<nlabel; currlabel++){
+                       const int *trow = trans + currlabel*nlabel;
+                       int state_score = rrow[currlabel] + (end ? end[currlabel] : 0);
+                       int best = prev_top1_array[0] + trow[0];
+                       int best_label = 0;
+                       int norm;
+
+                       // calculate the best label sequence, the maximum is
+                       // taken first so that the loop has no data-dependent branch
+                       for(prevlabel=1; prevlabel<nlabel; prevlabel++){
+                          int s = prev_top1_array[prevlabel] + trow[prevlabel];
+                          best = s > best ? s : best;
+                       }
+                       // only a positive score replaces the initial 0, and the first
+                       // previous label with the best score is on the path
+                       if (best + state_score > 0){
+                          while (prev_top1_array[best_label] + trow[best_label] != best)
+                             best_label++;
+                          curr_top1_array[currlabel] = best + state_score;
+                       } else {
+                          curr_top1_array[currlabel] = 0;
+                       }
+                       path[start_pos*nlabel+currlabel] = best_label;
+
+                       // calculate the probability of the best label sequence
+                       for(prevlabel=0; prevlabel<nlabel; prevlabel++)
+                          scores[prevlabel] = prev_norm_array[prevlabel] + trow[prevlabel] + state_score;
+                       // the following wants to do z=log(exp(x)+exp(y)), the faster implementation is 
+                       // z=min(x,y) + log(exp(abs(x-y))+1)
+                       // 0.5 is for rounding
+                       norm = 0;
                        for(prevlabel=0; prevlabel<nlabel; prevlabel++){
-                          // calculate the best label sequence
-                          int top1_new_score = prev_top1_array[prevlabel] + rArray[start_pos*nlabel+currlabel] +
-                                               mArray[(prevlabel+1)*nlabel+currlabel];
-                          // the last token in a sentence, the end feature should be fired 
-                          if (start_pos == doclen-1){
-                             top1_new_score += mArray[(nlabel+1)*nlabel+currlabel];
-                          }
-                          if(top1_new_score > curr_top1_array[currlabel]){
-                             curr_top1_array[currlabel] = top1_new_score;
-                             path[start_pos*nlabel+currlabel] = prevlabel;
-                          }
-                          // calculate the probability of the best label sequence
-                          int norm_new_score = prev_norm_array[prevlabel] + rArray[start_pos*nlabel+currlabel] +
-                                               mArray[(prevlabel+1)*nlabel+currlabel];
-                          // the last token in a sentence, the end feature should be fired 
-                          if(start_pos == doclen-1){
-                              norm_new_score += mArray[(nlabel+1)*nlabel+currlabel];
-                          }  
-                          // the following wants to do z=log(exp(x)+exp(y)), the faster implementation is 
-                          // z=min(x,y) + log(exp(abs(x-y))+1)
-                          // 0.5 is for rounding
-                          if (curr_norm_array[currlabel] == 0){
-                              curr_norm_array[currlabel] = norm_new_score;
+                          if (norm == 0){
+                              norm = scores[prevlabel];
                           } else {
-                              curr_norm_array[currlabel] = min(curr_norm_array[currlabel], norm_new_score) + 
-                              (int)(log(exp(abs(norm_new_score - curr_norm_array[currlabel])/1000.0) + 1)*1000.0 + 0.5);
+                              norm = min(norm, scores[prevlabel]) +
+                                     log_add(log_table, abs(scores[prevlabel] - norm));
                           }
-                       } 
+                       }
+                       curr_norm_array[currlabel] = norm;
                    }
             }
-            for(label=0; label<nlabel; label++){
-                       prev_top1_array[label] = curr_top1_array[label];
-                       prev_norm_array[label] = curr_norm_array[label];
-            }
         }
         // find the label of the last token in a sentence
         int top1label = 0;
@@ -120,7 +256,8 @@ vcrf_top1_label(PG_FUNCTION_ARGS)
                }
         }
         // trace back to get the labels for the rest tokens in a sentence
-        ((int*)ARR_DATA_PTR(result))[doclen-1] = top1label;
+        if (doclen > 0)
+            ((int*)ARR_DATA_PTR(result))[doclen-1] = top1label;
         for (pos=doclen-1; pos>=1; pos--){
             top1label = path[pos*nlabel+top1label];  
             ((int*)ARR_DATA_PTR(result))[pos-1] = top1label;           
@@ -135,7 +272,7 @@ vcrf_top1_label(PG_FUNCTION_ARGS)
                norm_factor = curr_norm_array[0];
             } else {
                norm_factor = min(curr_norm_array[i], norm_factor) +
-                             (int)(log(exp(abs(norm_factor - curr_norm_array[i])/1000.0) + 1)*1000.0 + 0.5);
+                             log_add(log_table, abs(norm_factor - curr_norm_array[i]));
             } 
         }
         // calculate the conditional probability.
@@ -145,3 +282,364 @@ vcrf_top1_label(PG_FUNCTION_ARGS)
 
         PG_RETURN_ARRAYTYPE_P(result);
 }
+
+/**
+ * @brief find the most probable sequence assignment together with its log-probability and,
+ *        optionally, the marginal probability of every label of every token, in one
+ *        forward-backward pass over the sentence.
+ * @param marray  Encode the edge feature, start feature and end feature
+ * @param rarray  Encode the single state feature, e.g, word feature, regex feature.
+ * @param nlabel Total number of labels in the label space
+ * @param marginals Whether to return the per-token marginals
+ * @return the most probable sequence assignment (doclen elements) followed by log P(top1|sentence).
+ *         With marginals, doclen*nlabel more elements follow, P(label of token pos = label|sentence)
+ *         at 1+doclen+pos*nlabel+label.
+ *
+ * Unlike vcrf_top1_label, the scores are the log-potentials scaled by 1000, the start and
+ * end features are fired for every sentence, and the normalization is exact. The forward
+ * and backward passes are scaled per token, so that they need no exp or log per label pair.
+ **/
+PG_FUNCTION_INFO_V1(vcrf_top1_marginals);
+
+Datum
+vcrf_top1_marginals(PG_FUNCTION_ARGS)
+{
+        ArrayType *result;
+        vcrf_top1_state *state;
+        int *mArray, *rArray, *path, *prev_top1_array, *curr_top1_array, *tmp;
+        const int *trans;
+        const double *exp_trans;
+        double *alpha, *beta, *emit, *scale, *out;
+        double logz, top1_score;
+        int start_pos, label, currlabel, prevlabel, doclen, nlabel, nout, scratch;
+        bool marginals;
+        mArray = (int*)ARR_DATA_PTR(PG_GETARG_ARRAYTYPE_P(0));
+        rArray = (int*)ARR_DATA_PTR(PG_GETARG_ARRAYTYPE_P(1));
+        nlabel = PG_GETARG_INT32(2);
+        marginals = PG_GETARG_BOOL(3);
+        if (nlabel <= 0)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("the number of labels must be positive")));
+        doclen = ARR_DIMS(PG_GETARG_ARRAYTYPE_P(1))[0]/nlabel;
+        if (ARR_DIMS(PG_GETARG_ARRAYTYPE_P(0))[0] < (nlabel+2)*nlabel)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("the edge feature array must have at least (nlabel+2)*nlabel elements")));
+        if (doclen <= 0)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("the sentence must have at least one token")));
+
+        state = vcrf_top1_get_state(fcinfo, mArray, nlabel, doclen);
+        trans = state->trans;
+        exp_trans = state->exp_trans;
+        path = state->path;
+        prev_top1_array = state->prev_top1_array;
+        curr_top1_array = state->curr_top1_array;
+
+        // alpha, beta and the emission factors have doclen*nlabel elements, scale has doclen
+        scratch = 3*doclen*nlabel + doclen;
+        if (state->fscratch_size < scratch) {
+            if (state->fscratch_size > 0)
+                pfree(state->fscratch);
+            state->fscratch_size = Max(scratch, state->fscratch_size * 2);
+            state->fscratch = (double *) MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+                                                            sizeof(double) * state->fscratch_size);
+        }
+        alpha = state->fscratch;
+        beta = alpha + doclen*nlabel;
+        emit = beta + doclen*nlabel;
+        scale = emit + doclen*nlabel;
+
+        // the emission factors exp((score - max score of the token)/1000), the start and
+        // end features are part of the scores of the first and the last token
+        logz = 0;
+        for(start_pos=0;start_pos<doclen;start_pos++){
+            const int *rrow = rArray + start_pos*nlabel;
+            double *erow = emit + start_pos*nlabel;
+            int tmax = 0;
+            for(label=0; label<nlabel; label++){
+                int score = rrow[label];
+                if (start_pos == 0) score += mArray[label];
+                if (start_pos == doclen-1) score += mArray[(nlabel+1)*nlabel+label];
+                curr_top1_array[label] = score;
+                if (label == 0 || score > tmax) tmax = score;
+            }
+            for(label=0; label<nlabel; label++)
+                erow[label] = exp((curr_top1_array[label] - tmax)/1000.0);
+            logz += tmax/1000.0;
+            if (start_pos > 0) logz += state->trans_max/1000.0;
+        }
+
+        // the scaled forward pass, each row of alpha sums to 1
+        for(start_pos=0;start_pos<doclen;start_pos++){
+            double *arow = alpha + start_pos*nlabel;
+            const double *erow = emit + start_pos*nlabel;
+            double sum = 0;
+            if (start_pos == 0){
+                for(label=0; label<nlabel; label++)
+                    arow[label] = erow[label];
+            } else {
+                const double *prow = arow - nlabel;
+                for(currlabel=0; currlabel<nlabel; currlabel++){
+                    const double *trow = exp_trans + currlabel*nlabel;
+                    double s = 0;
+                    for(prevlabel=0; prevlabel<nlabel; prevlabel++)
+                        s += prow[prevlabel] * trow[prevlabel];
+                    arow[currlabel] = s * erow[currlabel];
+                }
+            }
+            for(label=0; label<nlabel; label++)
+                sum += arow[label];
+            scale[start_pos] = sum;
+            for(label=0; label<nlabel; label++)
+                arow[label] /= sum;
+            logz += log(sum);
+        }
+
+        // the best label sequence, by max-plus over the integer scores
+        for(start_pos=0;start_pos<doclen;start_pos++){
+            const int *rrow = rArray + start_pos*nlabel;
+            tmp = prev_top1_array; prev_top1_array = curr_top1_array; curr_top1_array = tmp;
+            for(currlabel=0; currlabel<nlabel; currlabel++){
+                int score = rrow[currlabel];
+                int best = 0, best_label = 0;
+                if (start_pos == 0) score += mArray[currlabel];
+                if (start_pos == doclen-1) score += mArray[(nlabel+1)*nlabel+currlabel];
+                if (start_pos > 0){
+                    const int *trow = trans + currlabel*nlabel;
+                    best = prev_top1_array[0] + trow[0];
+                    for(prevlabel=1; prevlabel<nlabel; prevlabel++){
+                        int s = prev_top1_array[prevlabel] + trow[prevlabel];
+                        best = s > best ? s : best;
+                    }
+                    while (prev_top1_array[best_label] + trow[best_label] != best)
+                        best_label++;
+                }
+                curr_top1_array[currlabel] = best + score;
+                path[start_pos*nlabel+currlabel] = best_label;
+            }
+        }
+
+        nout = doclen + 1 + (marginals ? doclen*nlabel : 0);
+        result = (ArrayType *) palloc(sizeof(double)*nout + ARR_OVERHEAD_NONULLS(1));
+        SET_VARSIZE(result, sizeof(double)*nout + ARR_OVERHEAD_NONULLS(1));
+        result->ndim = 1;
+        result->dataoffset = 0;
+        result->elemtype = FLOAT8OID;
+        ARR_DIMS(result)[0] = nout;
+        ARR_LBOUND(result)[0] = 1;
+        out = (double*)ARR_DATA_PTR(result);
+
+        // trace back from the best label of the last token
+        {
+            int top1label = 0, pos;
+            for(label=1; label<nlabel; label++)
+                if (curr_top1_array[label] > curr_top1_array[top1label])
+                    top1label = label;
+            top1_score = curr_top1_array[top1label]/1000.0;
+            out[doclen-1] = top1label;
+            for (pos=doclen-1; pos>=1; pos--){
+                top1label = path[pos*nlabel+top1label];
+                out[pos-1] = top1label;
+            }
+        }
+        out[doclen] = top1_score - logz;
+
+        if (marginals) {
+            // the backward pass with the same scaling as the forward pass, so that
+            // alpha*beta is the marginal without further normalization
+            double *brow = beta + (doclen-1)*nlabel;
+            for(label=0; label<nlabel; label++)
+                brow[label] = 1;
+            for(start_pos=doclen-2;start_pos>=0;start_pos--){
+                const double *nrow = beta + (start_pos+1)*nlabel;
+                const double *erow = emit + (start_pos+1)*nlabel;
+                brow = beta + start_pos*nlabel;
+                for(prevlabel=0; prevlabel<nlabel; prevlabel++)
+                    brow[prevlabel] = 0;
+                for(currlabel=0; currlabel<nlabel; currlabel++){
+                    const double *trow = exp_trans + currlabel*nlabel;
+                    double w = erow[currlabel] * nrow[currlabel] / scale[start_pos+1];
+                    for(prevlabel=0; prevlabel<nlabel; prevlabel++)
+                        brow[prevlabel] += trow[prevlabel] * w;
+                }
+            }
+            for(start_pos=0;start_pos<doclen;start_pos++)
+                for(label=0; label<nlabel; label++)
+                    out[doclen+1+start_pos*nlabel+label] =
+                        alpha[start_pos*nlabel+label] * beta[start_pos*nlabel+label];
+        }
+
+        PG_RETURN_ARRAYTYPE_P(result);
+}
+
+/**
+ * @brief find the k most probable sequence assignments in one pass of the Viterbi algorithm,
+ *        keeping the k best partial paths ending in every label at every position.
+ * @param marray  Encode the edge feature, start feature and end feature
+ * @param rarray  Encode the single state feature, e.g, word feature, regex feature.
+ * @param nlabel Total number of labels in the label space
+ * @param k The number of sequence assignments
+ * @return a two-dimensional array with one row per sequence assignment, best first. The first doclen
+ *         elements of a row are the labels, the last one is the score of the assignment
+ *         (the sum of the features, scaled by 1000 as in the inputs). There are fewer than k rows
+ *         if the sentence has fewer than k assignments.
+ *
+ * As in vcrf_top1_marginals, the start and end features are fired for every sentence, and
+ * scores are not floored at 0, so the first row is the exact top1 assignment. Ties are
+ * broken in favor of smaller previous labels.
+ **/
+PG_FUNCTION_INFO_V1(vcrf_topk_label);
+
+Datum
+vcrf_topk_label(PG_FUNCTION_ARGS)
+{
+        ArrayType *result;
+        vcrf_top1_state *state;
+        int *mArray, *rArray, *score, *back_label, *back_rank, *count, *out;
+        const int *trans;
+        int start_pos, label, currlabel, prevlabel, rank, doclen, nlabel, k, nrows, ncols, scratch, i;
+        int dims[2], lbs[2];
+        mArray = (int*)ARR_DATA_PTR(PG_GETARG_ARRAYTYPE_P(0));
+        rArray = (int*)ARR_DATA_PTR(PG_GETARG_ARRAYTYPE_P(1));
+        nlabel = PG_GETARG_INT32(2);
+        k = PG_GETARG_INT32(3);
+        if (nlabel <= 0)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("the number of labels must be positive")));
+        if (k <= 0 || k > 1000)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("k must be in the range [1, 1000]")));
+        doclen = ARR_DIMS(PG_GETARG_ARRAYTYPE_P(1))[0]/nlabel;
+        if (ARR_DIMS(PG_GETARG_ARRAYTYPE_P(0))[0] < (nlabel+2)*nlabel)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("the edge feature array must have at least (nlabel+2)*nlabel elements")));
+        if (doclen <= 0)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("the sentence must have at least one token")));
+
+        state = vcrf_top1_get_state(fcinfo, mArray, nlabel, doclen);
+        trans = state->trans;
+
+        // for every (position, label), the scores of the k best partial paths ending there in
+        // descending order, and the label and rank at the previous position of each of them
+        scratch = 3*doclen*nlabel*k + doclen*nlabel;
+        if (state->kscratch_size < scratch) {
+            if (state->kscratch_size > 0)
+                pfree(state->kscratch);
+            state->kscratch_size = Max(scratch, state->kscratch_size * 2);
+            state->kscratch = (int *) MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+                                                         sizeof(int) * state->kscratch_size);
+        }
+        score = state->kscratch;
+        back_label = score + doclen*nlabel*k;
+        back_rank = back_label + doclen*nlabel*k;
+        count = back_rank + doclen*nlabel*k;
+
+        for(start_pos=0;start_pos<doclen;start_pos++){
+            const int *rrow = rArray + start_pos*nlabel;
+            for(currlabel=0; currlabel<nlabel; currlabel++){
+                int cell = start_pos*nlabel + currlabel;
+                int *cscore = score + cell*k;
+                int *clabel = back_label + cell*k;
+                int *crank = back_rank + cell*k;
+                int emit = rrow[currlabel];
+                int n = 0;
+                if (start_pos == 0) emit += mArray[currlabel];
+                if (start_pos == doclen-1) emit += mArray[(nlabel+1)*nlabel+currlabel];
+                if (start_pos == 0){
+                    cscore[0] = emit;
+                    clabel[0] = -1;
+                    crank[0] = -1;
+                    count[cell] = 1;
+                    continue;
+                }
+                const int *trow = trans + currlabel*nlabel;
+                for(prevlabel=0; prevlabel<nlabel; prevlabel++){
+                    int pcell = cell - nlabel - currlabel + prevlabel;
+                    const int *pscore = score + pcell*k;
+                    for(rank=0; rank<count[pcell]; rank++){
+                        int s = pscore[rank] + trow[prevlabel] + emit;
+                        // the candidates of prevlabel are sorted, the rest cannot enter either
+                        if (n == k && s <= cscore[k-1])
+                            break;
+                        // insert into the sorted candidates, dropping the k+1-th
+                        i = (n < k) ? n++ : k-1;
+                        while (i > 0 && cscore[i-1] < s){
+                            cscore[i] = cscore[i-1];
+                            clabel[i] = clabel[i-1];
+                            crank[i] = crank[i-1];
+                            i--;
+                        }
+                        cscore[i] = s;
+                        clabel[i] = prevlabel;
+                        crank[i] = rank;
+                    }
+                }
+                count[cell] = n;
+            }
+        }
+
+        // merge the candidates of all labels at the last position, in the fixed top array
+        {
+            int *top_score = (int *) palloc(sizeof(int) * k);
+            int *top_label = (int *) palloc(sizeof(int) * k);
+            int *top_rank = (int *) palloc(sizeof(int) * k);
+            int row;
+            nrows = 0;
+            for(label=0; label<nlabel; label++){
+                int cell = (doclen-1)*nlabel + label;
+                for(rank=0; rank<count[cell]; rank++){
+                    int s = score[cell*k + rank];
+                    if (nrows == k && s <= top_score[k-1])
+                        break;
+                    i = (nrows < k) ? nrows++ : k-1;
+                    while (i > 0 && top_score[i-1] < s){
+                        top_score[i] = top_score[i-1];
+                        top_label[i] = top_label[i-1];
+                        top_rank[i] = top_rank[i-1];
+                        i--;
+                    }
+                    top_score[i] = s;
+                    top_label[i] = label;
+                    top_rank[i] = rank;
+                }
+            }
+
+            ncols = doclen + 1;
+            result = (ArrayType *) palloc0(sizeof(int)*nrows*ncols + ARR_OVERHEAD_NONULLS(2));
+            SET_VARSIZE(result, sizeof(int)*nrows*ncols + ARR_OVERHEAD_NONULLS(2));
+            result->ndim = 2;
+            result->dataoffset = 0;
+            result->elemtype = INT4OID;
+            dims[0] = nrows; dims[1] = ncols;
+            lbs[0] = 1; lbs[1] = 1;
+            memcpy(ARR_DIMS(result), dims, sizeof(dims));
+            memcpy(ARR_LBOUND(result), lbs, sizeof(lbs));
+            out = (int*)ARR_DATA_PTR(result);
+
+            // trace back every path through the stored labels and ranks
+            for(row=0; row<nrows; row++){
+                int *orow = out + row*ncols;
+                int cur_label = top_label[row], cur_rank = top_rank[row];
+                orow[doclen] = top_score[row];
+                for(start_pos=doclen-1; start_pos>=0; start_pos--){
+                    int at = (start_pos*nlabel + cur_label)*k + cur_rank;
+                    orow[start_pos] = cur_label;
+                    cur_label = back_label[at];
+                    cur_rank = back_rank[at];
+                }
+            }
+            pfree(top_score);
+            pfree(top_label);
+            pfree(top_rank);
+        }
+
+        PG_RETURN_ARRAYTYPE_P(result);
+}
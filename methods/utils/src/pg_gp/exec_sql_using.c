@@ -4,6 +4,7 @@
 #include <catalog/pg_proc.h>
 #include <catalog/pg_type.h>
 #include <utils/builtins.h>
+#include <utils/memutils.h>
 #include <utils/syscache.h>
 
 // On Greenplum 4.2.0, spi.h indirectly includes <emcconnect/api.h>. However,
@@ -27,9 +28,50 @@
 #endif // defined(SearchSysCache1)
 
 
-PG_FUNCTION_INFO_V1(exec_sql_using);
-Datum
-exec_sql_using(PG_FUNCTION_ARGS) {
+/*
+ * Prepared plans of recently executed statements
+ *
+ * Iterative drivers typically run the same few statements through functions
+ * implemented by exec_sql_using() in every iteration. For short iterations,
+ * planning a statement can take longer than executing it, so we keep the
+ * saved plans of the most recently used statements for the lifetime of the
+ * backend, keyed by function and statement text.
+ *
+ * Since PostgreSQL 8.3, saved plans are revalidated if objects they depend on
+ * change (see plancache.c). Older versions (which Greenplum 4.x is based on)
+ * do not do that, so the cache is disabled there.
+ */
+#if PG_VERSION_NUM >= 80300
+    #define PLAN_CACHE_SIZE 16
+#else
+    #define PLAN_CACHE_SIZE 0
+#endif
+
+typedef struct {
+    Oid funcOid;
+    char* stmt;
+    SPIPlanPtr plan;
+    uint64 lastUse;
+} PlanCacheEntry;
+
+#if PLAN_CACHE_SIZE > 0
+static PlanCacheEntry planCache[PLAN_CACHE_SIZE];
+static uint64 planCacheClock = 0;
+#endif
+
+/*
+ * Argument types of a function, cached in fn_extra of its FmgrInfo
+ */
+typedef struct {
+    int nargs;
+    Oid* types;
+} ArgumentInfo;
+
+static ArgumentInfo*
+get_argument_info(FunctionCallInfo fcinfo) {
+    if (fcinfo->flinfo->fn_extra != NULL)
+        return (ArgumentInfo*) fcinfo->flinfo->fn_extra;
+
     HeapTuple procedureTuple = SearchSysCache1(PROCOID,
         ObjectIdGetDatum(fcinfo->flinfo->fn_oid));
     if (!HeapTupleIsValid(procedureTuple))
@@ -57,25 +99,107 @@ exec_sql_using(PG_FUNCTION_ARGS) {
                         format_procedure(fcinfo->flinfo->fn_oid))
                     ));
         }
-    else if (PG_ARGISNULL(0))
+    
+    if (types[0] != TEXTOID && types[0] != VARCHAROID)
+        ereport(ERROR, (
+            errmsg("function \"%s\" does not have a leading VARCHAR/TEXT "
+                "argument",
+                format_procedure(fcinfo->flinfo->fn_oid))
+            ));
+
+    ArgumentInfo* info = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+        sizeof(ArgumentInfo));
+    info->nargs = nargs;
+    info->types = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+        sizeof(Oid) * nargs);
+    memcpy(info->types, types, sizeof(Oid) * nargs);
+    fcinfo->flinfo->fn_extra = info;
+    return info;
+}
+
+/*
+ * Return the plan for a statement, preparing it if it is not cached
+ *
+ * Must be called while connected to SPI. If *outIsCached is false, the caller
+ * has to free the plan after use.
+ */
+static SPIPlanPtr
+get_plan(FunctionCallInfo fcinfo, const ArgumentInfo* info, const char* stmt,
+    bool* outIsCached) {
+
+    Oid funcOid = fcinfo->flinfo->fn_oid;
+    *outIsCached = false;
+
+#if PLAN_CACHE_SIZE > 0
+    PlanCacheEntry* victim = &planCache[0];
+    for (int i = 0; i < PLAN_CACHE_SIZE; i++) {
+        PlanCacheEntry* entry = &planCache[i];
+        if (entry->plan != NULL && entry->funcOid == funcOid
+            && strcmp(entry->stmt, stmt) == 0) {
+
+            entry->lastUse = ++planCacheClock;
+            *outIsCached = true;
+            return entry->plan;
+        }
+        if (entry->plan == NULL
+            || (victim->plan != NULL && entry->lastUse < victim->lastUse))
+            victim = entry;
+    }
+#endif
+    
+    SPIPlanPtr plan = SPI_prepare(stmt, info->nargs - 1, &info->types[1]);
+    if (plan == NULL)
+        ereport(ERROR, (
+            errmsg("function \"%s\" could not obtain execution plan for "
+                "SQL statement",
+                format_procedure(funcOid))
+            ));
+
+#if PLAN_CACHE_SIZE > 0
+    SPIPlanPtr savedPlan = SPI_saveplan(plan);
+    SPI_freeplan(plan);
+    if (savedPlan == NULL)
+        ereport(ERROR, (
+            errmsg("function \"%s\" could not save execution plan for "
+                "SQL statement",
+                format_procedure(funcOid))
+            ));
+
+    if (victim->plan != NULL) {
+        SPI_freeplan(victim->plan);
+        pfree(victim->stmt);
+    }
+    victim->funcOid = funcOid;
+    victim->stmt = MemoryContextStrdup(TopMemoryContext, stmt);
+    victim->plan = savedPlan;
+    victim->lastUse = ++planCacheClock;
+    *outIsCached = true;
+    return savedPlan;
+#else
+    return plan;
+#endif
+}
+
+
+PG_FUNCTION_INFO_V1(exec_sql_using);
+Datum
+exec_sql_using(PG_FUNCTION_ARGS) {
+    const ArgumentInfo* info = get_argument_info(fcinfo);
+    int nargs = info->nargs;
+
+    if (PG_ARGISNULL(0))
         ereport(ERROR, (
             errmsg("function \"%s\" called with NULL as first argument",
                 format_procedure(fcinfo->flinfo->fn_oid))
             ));
     
     char* stmt = NULL;
-    if (types[0] == TEXTOID)
+    if (info->types[0] == TEXTOID)
         stmt = DatumGetCString(
             DirectFunctionCall1(textout, PG_GETARG_DATUM(0)));
-    else if (types[0] == VARCHAROID)
+    else
         stmt = DatumGetCString(
             DirectFunctionCall1(varcharout, PG_GETARG_DATUM(0)));
-    else
-        ereport(ERROR, (
-            errmsg("function \"%s\" does not have a leading VARCHAR/TEXT "
-                "argument",
-                format_procedure(fcinfo->flinfo->fn_oid))
-            ));
     
     char* nulls = NULL;
     for (int i = 1; i < nargs; i++)
@@ -88,17 +212,13 @@ exec_sql_using(PG_FUNCTION_ARGS) {
         }
     
     SPI_connect();
-    SPIPlanPtr plan = SPI_prepare(stmt, nargs - 1, &types[1]);
-    if (plan == NULL)
-        ereport(ERROR, (
-            errmsg("function \"%s\" could not obtain execution plan for "
-                "SQL statement",
-                format_procedure(fcinfo->flinfo->fn_oid))
-            ));
+    bool isCached;
+    SPIPlanPtr plan = get_plan(fcinfo, info, stmt, &isCached);
     
     int result = SPI_execute_plan(plan, &fcinfo->arg[1], nulls, false, 0);
     
-    SPI_freeplan(plan);
+    if (!isCached)
+        SPI_freeplan(plan);
     if (nulls)
         pfree(nulls);
     SPI_finish();
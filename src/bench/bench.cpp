@@ -0,0 +1,555 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file bench.cpp
+ *
+ * @brief Microbenchmarks of aggregate functions, run outside of the database
+ *
+ * Each benchmark drives the transition, merge, and final functions of an
+ * aggregate the way the executor of a two-segment query would: The rows of a
+ * synthetic data set are split into two halves, each half is folded into its
+ * own transition state, the two states are merged, and the final function is
+ * applied. Functions are called through the benchmark connector in
+ * src/bench/dbconnector, so the measured code is exactly that of src/modules.
+ *
+ * The result is written as JSON (to standard output by default), e.g., for
+ * tracking performance across releases:
+ *
+ * <pre>{
+ *   "madlib_version": "...", "compiler": "...",
+ *   "rows": ..., "width": ..., "repetitions": ..., "threads": ...,
+ *   "benchmarks": [
+ *     { "name": "linregr", "transition_seconds": ...,
+ *       "transition_rows_per_second": ..., "merge_seconds": ...,
+ *       "final_seconds": ... },
+ *     ...
+ *   ]
+ * }</pre>
+ *
+ * Times are the minimum over all repetitions. The time spent on building the
+ * argument lists is included, similar to the overhead of the function manager
+ * in a backend.
+ *
+ * Legacy sparse vectors and the sketches are implemented in C on top of the
+ * backend and cannot be benchmarked here.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <modules/regress/linear.hpp>
+#include <modules/regress/logistic.hpp>
+#include <modules/convex/logit_igd.hpp>
+#include <modules/convex/lmf_igd.hpp>
+
+#include <boost/random/uniform_01.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+#ifndef MADLIB_VERSION_STRING
+#define MADLIB_VERSION_STRING "unknown"
+#endif
+
+namespace madlib {
+
+namespace bench {
+
+using dbconnector::postgres::MemoryPool;
+using dbconnector::postgres::UDF;
+
+namespace regress = modules::regress;
+namespace convex = modules::convex;
+
+/**
+ * @brief Command-line options
+ */
+struct Options {
+    Options()
+      : numRows(100000), width(10), repetitions(5), numThreads(1),
+        lmfDim(1000), lmfRank(10), output("-") { }
+
+    uint64_t numRows;
+    uint32_t width;
+    unsigned int repetitions;
+    unsigned int numThreads;
+    uint32_t lmfDim;
+    uint32_t lmfRank;
+    std::string filter;
+    std::string output;
+};
+
+/**
+ * @brief Synthetic data set
+ *
+ * Independent variables are uniform in [-1, 1] with an intercept in the first
+ * column. The dependent variable of the linear models is a fixed linear
+ * combination plus noise, the binary labels are drawn from the logistic
+ * model with the same coefficients. The LMF ratings are the products of two
+ * random rank-k factors. All arrays are allocated before the measurement
+ * starts and live until the end.
+ */
+class Dataset {
+public:
+    Dataset(const Options& inOptions);
+
+    uint64_t numRows;
+    uint32_t width;
+    uint32_t lmfDim;
+    uint32_t lmfRank;
+
+    std::vector<ArrayHandle<double> > x;
+    std::vector<ArrayHandle<float> > xFloat;
+    std::vector<double> y;
+    std::vector<bool> label;
+    std::vector<int32_t> lmfRow;
+    std::vector<int32_t> lmfColumn;
+    std::vector<double> lmfValue;
+};
+
+Dataset::Dataset(const Options& inOptions)
+  : numRows(inOptions.numRows), width(inOptions.width),
+    lmfDim(inOptions.lmfDim), lmfRank(inOptions.lmfRank) {
+
+    PhiloxRandomNumberGenerator engine;
+    engine.seed(42);
+    boost::uniform_01<PhiloxRandomNumberGenerator&> uniform(engine);
+
+    std::vector<double> coef(width);
+    for (uint32_t k = 0; k < width; ++k)
+        coef[k] = 2. * uniform() - 1.;
+
+    x.reserve(numRows);
+    xFloat.reserve(numRows);
+    y.reserve(numRows);
+    label.reserve(numRows);
+    for (uint64_t i = 0; i < numRows; ++i) {
+        MutableArrayHandle<double> row
+            = defaultAllocator().allocateArray<double>(width);
+        MutableArrayHandle<float> rowFloat
+            = defaultAllocator().allocateArray<float>(width);
+        double dot = 0.;
+        for (uint32_t k = 0; k < width; ++k) {
+            row[k] = k == 0 ? 1. : 2. * uniform() - 1.;
+            rowFloat[k] = static_cast<float>(row[k]);
+            dot += coef[k] * row[k];
+        }
+        x.push_back(row);
+        xFloat.push_back(rowFloat);
+        y.push_back(dot + 0.1 * (uniform() - 0.5));
+        label.push_back(uniform() < 1. / (1. + std::exp(-dot)));
+    }
+
+    std::vector<double> u(static_cast<size_t>(lmfDim) * lmfRank);
+    std::vector<double> v(static_cast<size_t>(lmfDim) * lmfRank);
+    for (size_t k = 0; k < u.size(); ++k) {
+        u[k] = uniform();
+        v[k] = uniform();
+    }
+    lmfRow.reserve(numRows);
+    lmfColumn.reserve(numRows);
+    lmfValue.reserve(numRows);
+    for (uint64_t n = 0; n < numRows; ++n) {
+        uint32_t i = static_cast<uint32_t>(uniform() * lmfDim) % lmfDim;
+        uint32_t j = static_cast<uint32_t>(uniform() * lmfDim) % lmfDim;
+        double value = 0.;
+        for (uint32_t k = 0; k < lmfRank; ++k)
+            value += u[i * lmfRank + k] * v[j * lmfRank + k];
+        lmfRow.push_back(static_cast<int32_t>(i + 1));
+        lmfColumn.push_back(static_cast<int32_t>(j + 1));
+        lmfValue.push_back(value);
+    }
+}
+
+/**
+ * @brief An aggregate function, as seen by the executor
+ */
+class Aggregate {
+public:
+    Aggregate(const char* inName) : mName(inName) { }
+    virtual ~Aggregate() { }
+
+    const char* name() const { return mName; }
+
+    /**
+     * @brief Return a new state corresponding to the INITCOND
+     */
+    virtual AnyType initialState() const = 0;
+    virtual AnyType transition(const AnyType& inState, uint64_t inRow) = 0;
+    virtual AnyType merge(const AnyType& inLeft, const AnyType& inRight) = 0;
+    virtual AnyType final(const AnyType& inState) = 0;
+
+protected:
+    /**
+     * @brief Return a DOUBLE PRECISION[] of the given length filled with zeros
+     */
+    static AnyType zeros(size_t inLength) {
+        return defaultAllocator().allocateArray<double>(inLength);
+    }
+
+    const char* mName;
+};
+
+/**
+ * @brief Aggregate with the given merge and final functions
+ */
+template <class Merge, class Final>
+class AggregateBase : public Aggregate {
+public:
+    AggregateBase(const char* inName, const Dataset& inData)
+      : Aggregate(inName), mData(inData) { }
+
+    AnyType merge(const AnyType& inLeft, const AnyType& inRight) {
+        AnyType args;
+        args << inLeft << inRight;
+        return UDF::invoke<Merge>(args);
+    }
+
+    AnyType final(const AnyType& inState) {
+        AnyType args;
+        args << inState;
+        return UDF::invoke<Final>(args);
+    }
+
+protected:
+    const Dataset& mData;
+};
+
+class LinearRegression : public AggregateBase<regress::linregr_merge_states,
+    regress::linregr_final> {
+public:
+    LinearRegression(const Dataset& inData)
+      : AggregateBase<regress::linregr_merge_states, regress::linregr_final>(
+            "linregr", inData) { }
+
+    AnyType initialState() const {
+        return defaultAllocator().allocateByteString<
+            dbal::FunctionContext, dbal::DoZero, dbal::ThrowBadAlloc>(0);
+    }
+
+    AnyType transition(const AnyType& inState, uint64_t inRow) {
+        AnyType args;
+        args << inState << mData.y[inRow] << mData.x[inRow];
+        return UDF::invoke<regress::linregr_transition>(args);
+    }
+};
+
+/**
+ * @brief One iteration of the logistic-regression aggregates
+ */
+template <class Transition, class Merge, class Final, size_t StateLength>
+class LogisticRegression : public AggregateBase<Merge, Final> {
+    typedef AggregateBase<Merge, Final> Base;
+
+public:
+    LogisticRegression(const char* inName, const Dataset& inData)
+      : Base(inName, inData) { }
+
+    AnyType initialState() const {
+        return Aggregate::zeros(StateLength);
+    }
+
+    AnyType transition(const AnyType& inState, uint64_t inRow) {
+        AnyType args;
+        args << inState << static_cast<bool>(this->mData.label[inRow])
+            << this->mData.x[inRow] << Null();
+        return UDF::invoke<Transition>(args);
+    }
+};
+
+typedef LogisticRegression<regress::logregr_cg_step_transition,
+    regress::logregr_cg_step_merge_states, regress::logregr_cg_step_final, 6>
+    LogisticRegressionCG;
+typedef LogisticRegression<regress::logregr_irls_step_transition,
+    regress::logregr_irls_step_merge_states, regress::logregr_irls_step_final,
+    5> LogisticRegressionIRLS;
+typedef LogisticRegression<regress::logregr_igd_step_transition,
+    regress::logregr_igd_step_merge_states, regress::logregr_igd_step_final, 4>
+    LogisticRegressionIGD;
+
+class LogitIGD : public AggregateBase<convex::logit_igd_merge,
+    convex::logit_igd_final> {
+public:
+    LogitIGD(const Dataset& inData)
+      : AggregateBase<convex::logit_igd_merge, convex::logit_igd_final>(
+            "logit_igd", inData) { }
+
+    AnyType initialState() const {
+        return zeros(7);
+    }
+
+    AnyType transition(const AnyType& inState, uint64_t inRow) {
+        AnyType args;
+        args << inState << mData.x[inRow]
+            << static_cast<bool>(mData.label[inRow]) << Null()
+            << static_cast<int32_t>(mData.width) << 0.01
+            << static_cast<int32_t>(1);
+        return UDF::invoke<convex::logit_igd_transition>(args);
+    }
+};
+
+class LogitIGDFloat : public AggregateBase<convex::logit_igd_merge,
+    convex::logit_igd_final> {
+public:
+    LogitIGDFloat(const Dataset& inData)
+      : AggregateBase<convex::logit_igd_merge, convex::logit_igd_final>(
+            "logit_igd_float", inData) { }
+
+    AnyType initialState() const {
+        return zeros(7);
+    }
+
+    AnyType transition(const AnyType& inState, uint64_t inRow) {
+        AnyType args;
+        args << inState << mData.xFloat[inRow]
+            << static_cast<bool>(mData.label[inRow]) << Null()
+            << static_cast<int32_t>(mData.width) << 0.01;
+        return UDF::invoke<convex::logit_igd_float_transition>(args);
+    }
+};
+
+class LMFIGD : public AggregateBase<convex::lmf_igd_merge,
+    convex::lmf_igd_final> {
+public:
+    LMFIGD(const Dataset& inData)
+      : AggregateBase<convex::lmf_igd_merge, convex::lmf_igd_final>(
+            "lmf_igd", inData) { }
+
+    AnyType initialState() const {
+        return zeros(9);
+    }
+
+    AnyType transition(const AnyType& inState, uint64_t inRow) {
+        AnyType args;
+        args << inState << mData.lmfRow[inRow] << mData.lmfColumn[inRow]
+            << mData.lmfValue[inRow] << Null()
+            << static_cast<int32_t>(mData.lmfDim)
+            << static_cast<int32_t>(mData.lmfDim)
+            << static_cast<int32_t>(mData.lmfRank) << 0.01 << 0.1;
+        return UDF::invoke<convex::lmf_igd_transition>(args);
+    }
+};
+
+/**
+ * @brief Measured times of one benchmark, in seconds
+ */
+struct Result {
+    Result()
+      : transition(std::numeric_limits<double>::infinity()),
+        merge(transition), final(transition) { }
+
+    double transition;
+    double merge;
+    double final;
+};
+
+inline
+double
+now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) + 1e-9 * ts.tv_nsec;
+}
+
+/**
+ * @brief Run an aggregate over the data set, keeping the best times
+ */
+void
+run(Aggregate& inAggregate, const Dataset& inData, Result& ioResult) {
+    uint64_t half = inData.numRows / 2;
+    size_t mark = MemoryPool::get().mark();
+
+    double start = now();
+    AnyType left = inAggregate.initialState();
+    for (uint64_t i = 0; i < half; ++i)
+        left = inAggregate.transition(left, i);
+    AnyType right = inAggregate.initialState();
+    for (uint64_t i = half; i < inData.numRows; ++i)
+        right = inAggregate.transition(right, i);
+    double transitionEnd = now();
+
+    AnyType merged = inAggregate.merge(left, right);
+    double mergeEnd = now();
+
+    AnyType result = inAggregate.final(merged);
+    double finalEnd = now();
+
+    ioResult.transition = std::min(ioResult.transition,
+        transitionEnd - start);
+    ioResult.merge = std::min(ioResult.merge, mergeEnd - transitionEnd);
+    ioResult.final = std::min(ioResult.final, finalEnd - mergeEnd);
+
+    MemoryPool::get().release(mark);
+}
+
+/**
+ * @brief Escape a string for JSON output
+ */
+std::string
+escape(const std::string& inString) {
+    std::string escaped;
+    for (std::string::const_iterator it = inString.begin();
+        it != inString.end(); ++it) {
+
+        if (*it == '"' || *it == '\\')
+            escaped += '\\';
+        if (static_cast<unsigned char>(*it) >= 0x20)
+            escaped += *it;
+    }
+    return escaped;
+}
+
+void
+usage(const char* inProgram) {
+    std::cerr << "Usage: " << inProgram << " [options]\n"
+        "  --rows N         number of rows (default: 100000)\n"
+        "  --width N        number of independent variables, including the "
+            "intercept\n"
+        "                   (default: 10)\n"
+        "  --repetitions N  number of runs per benchmark, the best is "
+            "reported\n"
+        "                   (default: 5)\n"
+        "  --threads N      number of threads for parallelFor() (default: 1)\n"
+        "  --lmf-dim N      number of rows and columns of the LMF matrix "
+            "(default: 1000)\n"
+        "  --lmf-rank N     rank of the LMF model (default: 10)\n"
+        "  --filter STRING  only run benchmarks whose name contains STRING\n"
+        "  --output FILE    write JSON to FILE instead of standard output\n";
+}
+
+bool
+parseOptions(int argc, char** argv, Options& outOptions) {
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--help" || option == "-h")
+            return false;
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for option " << option << ".\n";
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (option == "--rows")
+            outOptions.numRows = std::strtoull(value, NULL, 10);
+        else if (option == "--width")
+            outOptions.width = std::strtoul(value, NULL, 10);
+        else if (option == "--repetitions")
+            outOptions.repetitions = std::strtoul(value, NULL, 10);
+        else if (option == "--threads")
+            outOptions.numThreads = std::strtoul(value, NULL, 10);
+        else if (option == "--lmf-dim")
+            outOptions.lmfDim = std::strtoul(value, NULL, 10);
+        else if (option == "--lmf-rank")
+            outOptions.lmfRank = std::strtoul(value, NULL, 10);
+        else if (option == "--filter")
+            outOptions.filter = value;
+        else if (option == "--output")
+            outOptions.output = value;
+        else {
+            std::cerr << "Unknown option " << option << ".\n";
+            return false;
+        }
+    }
+
+    if (outOptions.numRows < 2 || outOptions.width == 0
+        || outOptions.repetitions == 0 || outOptions.numThreads == 0
+        || outOptions.lmfDim == 0 || outOptions.lmfRank == 0) {
+
+        std::cerr << "Invalid option value.\n";
+        return false;
+    }
+    return true;
+}
+
+int
+main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    dbconnector::postgres::setNumThreads(options.numThreads);
+
+    Dataset data(options);
+
+    std::vector<Aggregate*> aggregates;
+    aggregates.push_back(new LinearRegression(data));
+    aggregates.push_back(new LogisticRegressionCG("logregr_cg", data));
+    aggregates.push_back(new LogisticRegressionIRLS("logregr_irls", data));
+    aggregates.push_back(new LogisticRegressionIGD("logregr_igd", data));
+    aggregates.push_back(new LogitIGD(data));
+    aggregates.push_back(new LogitIGDFloat(data));
+    aggregates.push_back(new LMFIGD(data));
+
+    std::ofstream file;
+    if (options.output != "-") {
+        file.open(options.output.c_str());
+        if (!file) {
+            std::cerr << "Cannot open " << options.output << ".\n";
+            return 1;
+        }
+    }
+    std::ostream& out = options.output != "-" ? file : std::cout;
+    out.precision(6);
+
+    out << "{\n"
+        "  \"madlib_version\": \"" << escape(MADLIB_VERSION_STRING) << "\",\n"
+        "  \"compiler\": \"" << escape(__VERSION__) << "\",\n"
+        "  \"rows\": " << options.numRows << ",\n"
+        "  \"width\": " << options.width << ",\n"
+        "  \"repetitions\": " << options.repetitions << ",\n"
+        "  \"threads\": " << options.numThreads << ",\n"
+        "  \"benchmarks\": [";
+
+    bool first = true;
+    int status = 0;
+    for (std::vector<Aggregate*>::iterator it = aggregates.begin();
+        it != aggregates.end(); ++it) {
+
+        Aggregate& aggregate = **it;
+        if (std::string(aggregate.name()).find(options.filter)
+            == std::string::npos)
+            continue;
+
+        Result result;
+        try {
+            for (unsigned int r = 0; r < options.repetitions; ++r)
+                run(aggregate, data, result);
+        } catch (const std::exception& exc) {
+            std::cerr << aggregate.name() << ": " << exc.what() << "\n";
+            status = 1;
+            continue;
+        }
+
+        out << (first ? "\n" : ",\n") <<
+            "    { \"name\": \"" << aggregate.name() << "\", "
+            "\"transition_seconds\": " << result.transition << ", "
+            "\"transition_rows_per_second\": "
+                << options.numRows / result.transition << ", "
+            "\"merge_seconds\": " << result.merge << ", "
+            "\"final_seconds\": " << result.final << " }";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+
+    for (std::vector<Aggregate*>::iterator it = aggregates.begin();
+        it != aggregates.end(); ++it)
+        delete *it;
+
+    return status;
+}
+
+} // namespace bench
+
+} // namespace madlib
+
+int
+main(int argc, char** argv) {
+    return madlib::bench::main(argc, argv);
+}
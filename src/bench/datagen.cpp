@@ -0,0 +1,595 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file datagen.cpp
+ *
+ * @brief Reproducible synthetic data sets at arbitrary scale
+ *
+ * madlib_datagen writes a synthetic data set in the text format of COPY
+ * (tab-separated columns, arrays as "{...}", sparse vectors in the run-length
+ * notation "{counts}:{values}" of svec) to standard output. Each row is
+ * generated from a random-number generator keyed with the seed and the row
+ * number only, so the output does not depend on how the rows are distributed.
+ * With "--segment i --segments n", only the i-th of n consecutive slices of
+ * the rows is written. If not specified, these default to the environment
+ * variables GP_SEGMENT_ID and GP_SEGMENT_COUNT, so that in Greenplum an
+ * external web table generates the data on all segments in parallel:
+ *
+ * <pre>CREATE EXTERNAL WEB TABLE points_ext (id BIGINT, coords FLOAT8[],
+ *     cluster INTEGER)
+ * EXECUTE 'madlib_datagen --dataset kmeans --rows 1000000000 --width 10'
+ * FORMAT 'TEXT';</pre>
+ *
+ * In PostgreSQL, use, e.g., <tt>COPY ... FROM PROGRAM</tt>. The data sets
+ * and their columns are:
+ *
+ * - <tt>linear</tt>: id BIGINT, y FLOAT8, x FLOAT8[] (for linregr)
+ * - <tt>logistic</tt>: id BIGINT, y BOOLEAN, x FLOAT8[] (for logregr and SVM)
+ * - <tt>sparse</tt>: id BIGINT, y FLOAT8, x SVEC
+ * - <tt>kmeans</tt>: id BIGINT, coords FLOAT8[], cluster INTEGER
+ * - <tt>documents</tt>: id BIGINT, term_counts SVEC
+ * - <tt>ratings</tt>: row_id INTEGER, col_id INTEGER, rating FLOAT8 (for LMF)
+ * - <tt>sequences</tt>: start_pos INTEGER, doc_id INTEGER, seg_text TEXT,
+ *   max_pos INTEGER, label INTEGER (the first four columns are those of the
+ *   segment table of the Viterbi functions)
+ *
+ * The first column of the design matrices is the intercept. For
+ * <tt>sequences</tt>, a row is one document.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace madlib {
+
+namespace bench {
+
+/**
+ * @brief Command-line options
+ */
+struct Options {
+    Options()
+      : numRows(1000), width(10), seed(1), segment(0), numSegments(1),
+        density(0.1), numClusters(5), stddev(1.), vocabularySize(10000),
+        numWords(100), numLabels(10), rowDim(1000), colDim(1000), rank(10),
+        noise(0.1) { }
+
+    std::string dataset;
+    uint64_t numRows;
+    uint32_t width;
+    uint64_t seed;
+    uint32_t segment;
+    uint32_t numSegments;
+    double density;
+    uint32_t numClusters;
+    double stddev;
+    uint32_t vocabularySize;
+    uint32_t numWords;
+    uint32_t numLabels;
+    uint32_t rowDim;
+    uint32_t colDim;
+    uint32_t rank;
+    double noise;
+};
+
+/**
+ * @brief Random numbers for one row (or one model parameter) of a data set
+ *
+ * The key of the underlying Philox generator is derived from the seed, a
+ * stream identifier, and an index. Different streams are used for the model
+ * (e.g., the regression coefficients) and the rows.
+ */
+class Random {
+public:
+    enum Stream {
+        kModel = 1,
+        kRow,
+        kRowFactor,
+        kColumnFactor
+    };
+
+    Random(uint64_t inSeed, Stream inStream, uint64_t inIndex) {
+        uint64_t key = mix(inSeed ^ mix((static_cast<uint64_t>(inStream) << 56)
+            ^ inIndex));
+        // The key must be exactly representable as double
+        mEngine.seed(static_cast<double>(key >> 11));
+    }
+
+    /**
+     * @brief Uniform in [0, 1)
+     */
+    double uniform() {
+        return mEngine();
+    }
+
+    /**
+     * @brief Uniform in [-1, 1)
+     */
+    double symmetric() {
+        return 2. * mEngine() - 1.;
+    }
+
+    /**
+     * @brief Uniform in {0, ..., inN - 1}
+     */
+    uint32_t index(uint32_t inN) {
+        uint32_t i = static_cast<uint32_t>(mEngine() * inN);
+        return i < inN ? i : inN - 1;
+    }
+
+    /**
+     * @brief Standard normal, using the Box-Muller transform
+     */
+    double normal() {
+        double u = 1. - mEngine();
+        return std::sqrt(-2. * std::log(u))
+            * std::cos(6.283185307179586 * mEngine());
+    }
+
+private:
+    /**
+     * @brief The finalizer of SplitMix64
+     */
+    static uint64_t mix(uint64_t inValue) {
+        inValue ^= inValue >> 30;
+        inValue *= 0xBF58476D1CE4E5B9ULL;
+        inValue ^= inValue >> 27;
+        inValue *= 0x94D049BB133111EBULL;
+        return inValue ^ (inValue >> 31);
+    }
+
+    PhiloxRandomNumberGenerator mEngine;
+};
+
+/**
+ * @brief Buffered writer of COPY text format
+ */
+class Writer {
+public:
+    Writer() : mFirstColumn(true) { }
+
+    ~Writer() {
+        std::fflush(stdout);
+    }
+
+    Writer& column() {
+        if (!mFirstColumn)
+            std::fputc('\t', stdout);
+        mFirstColumn = false;
+        return *this;
+    }
+
+    Writer& integer(int64_t inValue) {
+        std::printf("%lld", static_cast<long long>(inValue));
+        return *this;
+    }
+
+    Writer& real(double inValue) {
+        std::printf("%.10g", inValue);
+        return *this;
+    }
+
+    Writer& text(const char* inValue) {
+        std::fputs(inValue, stdout);
+        return *this;
+    }
+
+    Writer& array(const std::vector<double>& inValues) {
+        std::fputc('{', stdout);
+        for (size_t i = 0; i < inValues.size(); ++i) {
+            if (i > 0)
+                std::fputc(',', stdout);
+            real(inValues[i]);
+        }
+        std::fputc('}', stdout);
+        return *this;
+    }
+
+    /**
+     * @brief Write a sparse vector of the given length
+     *
+     * @param inEntries Non-zero entries, ordered by index
+     */
+    Writer& svec(const std::map<uint32_t, double>& inEntries,
+        uint32_t inLength) {
+
+        mCounts.clear();
+        mValues.clear();
+        uint32_t pos = 0;
+        for (std::map<uint32_t, double>::const_iterator it = inEntries.begin();
+            it != inEntries.end(); ++it) {
+
+            if (it->first > pos)
+                appendRun(it->first - pos, 0.);
+            appendRun(1, it->second);
+            pos = it->first + 1;
+        }
+        if (pos < inLength)
+            appendRun(inLength - pos, 0.);
+
+        std::fputc('{', stdout);
+        for (size_t i = 0; i < mCounts.size(); ++i)
+            std::printf(i > 0 ? ",%u" : "%u", mCounts[i]);
+        std::fputs("}:", stdout);
+        array(mValues);
+        return *this;
+    }
+
+    void endRow() {
+        std::fputc('\n', stdout);
+        mFirstColumn = true;
+    }
+
+private:
+    void appendRun(uint32_t inCount, double inValue) {
+        if (!mValues.empty() && mValues.back() == inValue)
+            mCounts.back() += inCount;
+        else {
+            mCounts.push_back(inCount);
+            mValues.push_back(inValue);
+        }
+    }
+
+    bool mFirstColumn;
+    std::vector<uint32_t> mCounts;
+    std::vector<double> mValues;
+};
+
+/**
+ * @brief Model coefficients shared by all rows, with the intercept first
+ */
+std::vector<double>
+coefficients(const Options& inOptions) {
+    Random random(inOptions.seed, Random::kModel, 0);
+    std::vector<double> coef(inOptions.width);
+    for (uint32_t k = 0; k < inOptions.width; ++k)
+        coef[k] = random.symmetric();
+    return coef;
+}
+
+/**
+ * @brief Independent variables uniform in [-1, 1], and their product with coef
+ */
+double
+denseRow(Random& ioRandom, const std::vector<double>& inCoef,
+    std::vector<double>& outX) {
+
+    double dot = 0.;
+    for (size_t k = 0; k < outX.size(); ++k) {
+        outX[k] = k == 0 ? 1. : ioRandom.symmetric();
+        dot += inCoef[k] * outX[k];
+    }
+    return dot;
+}
+
+void
+linear(const Options& inOptions, uint64_t inBegin, uint64_t inEnd) {
+    std::vector<double> coef = coefficients(inOptions);
+    std::vector<double> x(inOptions.width);
+    Writer out;
+
+    for (uint64_t id = inBegin; id < inEnd; ++id) {
+        Random random(inOptions.seed, Random::kRow, id);
+        double y = denseRow(random, coef, x)
+            + inOptions.noise * random.normal();
+        out.column().integer(id + 1).column().real(y).column().array(x);
+        out.endRow();
+    }
+}
+
+void
+logistic(const Options& inOptions, uint64_t inBegin, uint64_t inEnd) {
+    std::vector<double> coef = coefficients(inOptions);
+    std::vector<double> x(inOptions.width);
+    Writer out;
+
+    for (uint64_t id = inBegin; id < inEnd; ++id) {
+        Random random(inOptions.seed, Random::kRow, id);
+        double dot = denseRow(random, coef, x);
+        bool y = random.uniform() < 1. / (1. + std::exp(-dot));
+        out.column().integer(id + 1).column().text(y ? "t" : "f")
+            .column().array(x);
+        out.endRow();
+    }
+}
+
+void
+sparse(const Options& inOptions, uint64_t inBegin, uint64_t inEnd) {
+    std::vector<double> coef = coefficients(inOptions);
+    std::map<uint32_t, double> x;
+    Writer out;
+
+    for (uint64_t id = inBegin; id < inEnd; ++id) {
+        Random random(inOptions.seed, Random::kRow, id);
+        x.clear();
+        x[0] = 1.;
+        double y = coef[0];
+        for (uint32_t k = 1; k < inOptions.width; ++k) {
+            if (random.uniform() < inOptions.density) {
+                double value = random.symmetric();
+                x[k] = value;
+                y += coef[k] * value;
+            }
+        }
+        y += inOptions.noise * random.normal();
+        out.column().integer(id + 1).column().real(y)
+            .column().svec(x, inOptions.width);
+        out.endRow();
+    }
+}
+
+void
+kmeans(const Options& inOptions, uint64_t inBegin, uint64_t inEnd) {
+    std::vector<std::vector<double> > centers(inOptions.numClusters,
+        std::vector<double>(inOptions.width));
+    for (uint32_t c = 0; c < inOptions.numClusters; ++c) {
+        Random random(inOptions.seed, Random::kModel, c);
+        for (uint32_t k = 0; k < inOptions.width; ++k)
+            centers[c][k] = 10. * random.symmetric();
+    }
+
+    std::vector<double> coords(inOptions.width);
+    Writer out;
+    for (uint64_t id = inBegin; id < inEnd; ++id) {
+        Random random(inOptions.seed, Random::kRow, id);
+        uint32_t cluster = random.index(inOptions.numClusters);
+        for (uint32_t k = 0; k < inOptions.width; ++k)
+            coords[k] = centers[cluster][k]
+                + inOptions.stddev * random.normal();
+        out.column().integer(id + 1).column().array(coords)
+            .column().integer(cluster + 1);
+        out.endRow();
+    }
+}
+
+/**
+ * @brief Term counts of documents
+ *
+ * Term ranks are log-uniform, which approximates Zipf's law with exponent 1.
+ */
+void
+documents(const Options& inOptions, uint64_t inBegin, uint64_t inEnd) {
+    double logVocabulary = std::log(inOptions.vocabularySize + 1.);
+    std::map<uint32_t, double> counts;
+    Writer out;
+
+    for (uint64_t id = inBegin; id < inEnd; ++id) {
+        Random random(inOptions.seed, Random::kRow, id);
+        counts.clear();
+        for (uint32_t w = 0; w < inOptions.numWords; ++w) {
+            uint32_t term = static_cast<uint32_t>(
+                std::exp(random.uniform() * logVocabulary)) - 1;
+            counts[std::min(term, inOptions.vocabularySize - 1)] += 1.;
+        }
+        out.column().integer(id + 1)
+            .column().svec(counts, inOptions.vocabularySize);
+        out.endRow();
+    }
+}
+
+/**
+ * @brief Noisy entries of a random matrix of the given rank
+ *
+ * The factors are uniform in [0, 1). Each entry is scaled by 1 / rank, so
+ * that ratings are in [0, 1) before adding noise.
+ */
+void
+ratings(const Options& inOptions, uint64_t inBegin, uint64_t inEnd) {
+    std::vector<double> u(inOptions.rank);
+    Writer out;
+
+    for (uint64_t id = inBegin; id < inEnd; ++id) {
+        Random random(inOptions.seed, Random::kRow, id);
+        uint32_t i = random.index(inOptions.rowDim);
+        uint32_t j = random.index(inOptions.colDim);
+
+        Random rowFactor(inOptions.seed, Random::kRowFactor, i);
+        Random columnFactor(inOptions.seed, Random::kColumnFactor, j);
+        double rating = 0.;
+        for (uint32_t k = 0; k < inOptions.rank; ++k)
+            rating += rowFactor.uniform() * columnFactor.uniform();
+        rating = rating / inOptions.rank + inOptions.noise * random.normal();
+
+        out.column().integer(i + 1).column().integer(j + 1)
+            .column().real(rating);
+        out.endRow();
+    }
+}
+
+/**
+ * @brief Token sequences generated by a hidden Markov model
+ *
+ * The label stays the same with probability 1/2 and is uniform otherwise.
+ * Each label prefers its own slice of the vocabulary: With probability 0.8,
+ * the token is uniform within that slice, and uniform over the whole
+ * vocabulary otherwise.
+ */
+void
+sequences(const Options& inOptions, uint64_t inBegin, uint64_t inEnd) {
+    uint32_t sliceSize = std::max(inOptions.vocabularySize
+        / inOptions.numLabels, 1U);
+    char token[16];
+    Writer out;
+
+    for (uint64_t id = inBegin; id < inEnd; ++id) {
+        Random random(inOptions.seed, Random::kRow, id);
+        uint32_t label = random.index(inOptions.numLabels);
+        for (uint32_t pos = 0; pos < inOptions.numWords; ++pos) {
+            if (pos > 0 && random.uniform() >= 0.5)
+                label = random.index(inOptions.numLabels);
+            uint32_t term = random.uniform() < 0.8
+                ? std::min(label * sliceSize + random.index(sliceSize),
+                    inOptions.vocabularySize - 1)
+                : random.index(inOptions.vocabularySize);
+            std::sprintf(token, "w%u", term);
+
+            out.column().integer(pos).column().integer(id + 1)
+                .column().text(token).column().integer(inOptions.numWords - 1)
+                .column().integer(label);
+            out.endRow();
+        }
+    }
+}
+
+void
+usage(const char* inProgram) {
+    std::cerr << "Usage: " << inProgram << " --dataset NAME [options]\n"
+        "Data sets: linear, logistic, sparse, kmeans, documents, ratings, "
+            "sequences\n"
+        "  --rows N          number of rows, documents, or ratings "
+            "(default: 1000)\n"
+        "  --width N         number of independent variables or coordinates "
+            "(default: 10)\n"
+        "  --seed N          seed (default: 1)\n"
+        "  --segment I       only write the I-th slice of the rows "
+            "(default: $GP_SEGMENT_ID or 0)\n"
+        "  --segments N      number of slices (default: $GP_SEGMENT_COUNT "
+            "or 1)\n"
+        "  --density P       fraction of non-zero variables for sparse "
+            "(default: 0.1)\n"
+        "  --clusters N      number of clusters for kmeans (default: 5)\n"
+        "  --stddev S        standard deviation within clusters "
+            "(default: 1)\n"
+        "  --vocabulary N    vocabulary size for documents and sequences "
+            "(default: 10000)\n"
+        "  --words N         words per document or sequence (default: 100)\n"
+        "  --labels N        number of labels for sequences (default: 10)\n"
+        "  --row-dim N       number of rows of the rating matrix "
+            "(default: 1000)\n"
+        "  --column-dim N    number of columns of the rating matrix "
+            "(default: 1000)\n"
+        "  --rank N          rank of the rating matrix (default: 10)\n"
+        "  --noise S         standard deviation of the noise (default: 0.1)\n";
+}
+
+bool
+parseOptions(int argc, char** argv, Options& outOptions) {
+    if (const char* segment = std::getenv("GP_SEGMENT_ID"))
+        outOptions.segment = std::strtoul(segment, NULL, 10);
+    if (const char* numSegments = std::getenv("GP_SEGMENT_COUNT"))
+        outOptions.numSegments = std::strtoul(numSegments, NULL, 10);
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--help" || option == "-h")
+            return false;
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for option " << option << ".\n";
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (option == "--dataset")
+            outOptions.dataset = value;
+        else if (option == "--rows")
+            outOptions.numRows = std::strtoull(value, NULL, 10);
+        else if (option == "--width")
+            outOptions.width = std::strtoul(value, NULL, 10);
+        else if (option == "--seed")
+            outOptions.seed = std::strtoull(value, NULL, 10);
+        else if (option == "--segment")
+            outOptions.segment = std::strtoul(value, NULL, 10);
+        else if (option == "--segments")
+            outOptions.numSegments = std::strtoul(value, NULL, 10);
+        else if (option == "--density")
+            outOptions.density = std::strtod(value, NULL);
+        else if (option == "--clusters")
+            outOptions.numClusters = std::strtoul(value, NULL, 10);
+        else if (option == "--stddev")
+            outOptions.stddev = std::strtod(value, NULL);
+        else if (option == "--vocabulary")
+            outOptions.vocabularySize = std::strtoul(value, NULL, 10);
+        else if (option == "--words")
+            outOptions.numWords = std::strtoul(value, NULL, 10);
+        else if (option == "--labels")
+            outOptions.numLabels = std::strtoul(value, NULL, 10);
+        else if (option == "--row-dim")
+            outOptions.rowDim = std::strtoul(value, NULL, 10);
+        else if (option == "--column-dim")
+            outOptions.colDim = std::strtoul(value, NULL, 10);
+        else if (option == "--rank")
+            outOptions.rank = std::strtoul(value, NULL, 10);
+        else if (option == "--noise")
+            outOptions.noise = std::strtod(value, NULL);
+        else {
+            std::cerr << "Unknown option " << option << ".\n";
+            return false;
+        }
+    }
+
+    if (outOptions.dataset.empty()) {
+        std::cerr << "No data set given.\n";
+        return false;
+    }
+    if (outOptions.width == 0 || outOptions.numSegments == 0
+        || outOptions.segment >= outOptions.numSegments
+        || outOptions.numClusters == 0 || outOptions.vocabularySize == 0
+        || outOptions.numLabels == 0 || outOptions.rowDim == 0
+        || outOptions.colDim == 0 || outOptions.rank == 0
+        || !(outOptions.density >= 0. && outOptions.density <= 1.)) {
+
+        std::cerr << "Invalid option value.\n";
+        return false;
+    }
+    return true;
+}
+
+int
+main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static char buffer[1 << 16];
+    std::setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    // Slices differ in size by at most one row. Computed in long double,
+    // as numRows * segment may not fit into 64 bits.
+    uint64_t begin = static_cast<uint64_t>(static_cast<long double>(
+        options.numRows) * options.segment / options.numSegments);
+    uint64_t end = static_cast<uint64_t>(static_cast<long double>(
+        options.numRows) * (options.segment + 1) / options.numSegments);
+
+    typedef void (*Generator)(const Options&, uint64_t, uint64_t);
+    struct {
+        const char* name;
+        Generator generate;
+    } generators[] = {
+        { "linear", linear },
+        { "logistic", logistic },
+        { "sparse", sparse },
+        { "kmeans", kmeans },
+        { "documents", documents },
+        { "ratings", ratings },
+        { "sequences", sequences }
+    };
+
+    for (size_t i = 0; i < sizeof(generators) / sizeof(generators[0]); ++i) {
+        if (options.dataset == generators[i].name) {
+            generators[i].generate(options, begin, end);
+            return std::ferror(stdout) ? 1 : 0;
+        }
+    }
+
+    std::cerr << "Unknown data set " << options.dataset << ".\n";
+    usage(argv[0]);
+    return 1;
+}
+
+} // namespace bench
+
+} // namespace madlib
+
+int
+main(int argc, char** argv) {
+    return madlib::bench::main(argc, argv);
+}
@@ -0,0 +1,246 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file Allocator_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_ALLOCATOR_IMPL_HPP
+#define MADLIB_BENCH_ALLOCATOR_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Construct an empty array of the given size
+ *
+ * The layout is the same as that of a PostgreSQL array without nulls.
+ */
+template <typename T, std::size_t Dimensions, dbal::MemoryContext MC,
+    dbal::ZeroMemory ZM, dbal::OnMemoryAllocationFailure F>
+inline
+MutableArrayHandle<T>
+Allocator::internalAllocateArray(
+    const std::array<std::size_t, Dimensions>& inNumElements) const {
+
+    std::size_t numElements = Dimensions ? 1 : 0;
+    for (std::size_t i = 0; i < Dimensions; ++i)
+        numElements *= inNumElements[i];
+
+    if ((std::numeric_limits<std::size_t>::max()
+        - ARR_OVERHEAD_NONULLS(Dimensions)) / sizeof(T) < numElements)
+        throw std::bad_alloc();
+
+    std::size_t size = sizeof(T) * numElements
+        + ARR_OVERHEAD_NONULLS(Dimensions);
+    ArrayType *array = static_cast<ArrayType*>(
+        allocate<MC, dbal::DoZero, F>(size));
+    if (array == NULL)
+        return MutableArrayHandle<T>(NULL);
+
+    SET_VARSIZE(array, size);
+    array->ndim = Dimensions;
+    array->dataoffset = 0;
+    array->elemtype = TypeTraits<T>::oid;
+    for (std::size_t i = 0; i < Dimensions; ++i) {
+        ARR_DIMS(array)[i] = static_cast<int>(inNumElements[i]);
+        ARR_LBOUND(array)[i] = 1;
+    }
+
+    return MutableArrayHandle<T>(array);
+}
+
+#define MADLIB_ALLOCATE_ARRAY_DEF(z, n, _ignored) \
+    template <typename T> \
+    inline \
+    MutableArrayHandle<T> \
+    Allocator::allocateArray( \
+        BOOST_PP_ENUM_PARAMS_Z(z, BOOST_PP_INC(n), std::size_t inDim) \
+    ) const { \
+        std::array<std::size_t, BOOST_PP_INC(n)> numElements = {{ \
+            BOOST_PP_ENUM_PARAMS_Z(z, BOOST_PP_INC(n), inDim) \
+        }}; \
+        return internalAllocateArray<T, BOOST_PP_INC(n), \
+            dbal::FunctionContext, dbal::DoZero, dbal::ThrowBadAlloc> \
+            (numElements); \
+    } \
+    \
+    template <typename T, dbal::MemoryContext MC, \
+        dbal::ZeroMemory ZM, dbal::OnMemoryAllocationFailure F> \
+    inline \
+    MutableArrayHandle<T> \
+    Allocator::allocateArray( \
+        BOOST_PP_ENUM_PARAMS_Z(z, BOOST_PP_INC(n), std::size_t inDim) \
+    ) const { \
+        std::array<std::size_t, BOOST_PP_INC(n)> numElements = {{ \
+            BOOST_PP_ENUM_PARAMS_Z(z, BOOST_PP_INC(n), inDim) \
+        }}; \
+        return internalAllocateArray<T, BOOST_PP_INC(n), MC, ZM, F> \
+        (numElements); \
+    }
+BOOST_PP_REPEAT(MADLIB_MAX_ARRAY_DIMS, MADLIB_ALLOCATE_ARRAY_DEF,
+    0 /* ignored */)
+#undef MADLIB_ALLOCATE_ARRAY_DEF
+
+/**
+ * @brief Construct a byte string of the given size
+ */
+template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
+    dbal::OnMemoryAllocationFailure F>
+inline
+MutableByteString
+Allocator::allocateByteString(std::size_t inSize) const {
+    bytea* byteString = static_cast<bytea*>(
+        allocate<MC, dbal::DoZero, F>(ByteString::kEffectiveHeaderSize + inSize)
+    );
+    if (byteString != NULL)
+        SET_VARSIZE(byteString, ByteString::kEffectiveHeaderSize + inSize);
+    return byteString;
+}
+
+template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
+    dbal::OnMemoryAllocationFailure F>
+inline
+void *
+Allocator::allocate(size_t inSize) const {
+    void *ptr = MemoryPool::get().allocate(inSize, ZM == dbal::DoZero);
+    if (ptr == NULL && F == dbal::ThrowBadAlloc)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
+    dbal::OnMemoryAllocationFailure F>
+inline
+void *
+Allocator::reallocate(void *inPtr, size_t inSize) const {
+    void *ptr = MemoryPool::get().reallocate(inPtr, inSize);
+    if (ptr == NULL && F == dbal::ThrowBadAlloc)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+template <dbal::MemoryContext MC>
+inline
+void
+Allocator::free(void *inPtr) const {
+    MemoryPool::get().free(inPtr);
+}
+
+/**
+ * @brief Get the default allocator
+ */
+inline
+Allocator&
+defaultAllocator() {
+    static Allocator sDefaultAllocator;
+    return sDefaultAllocator;
+}
+
+inline
+MemoryPool&
+MemoryPool::get() {
+    static MemoryPool sPool;
+    return sPool;
+}
+
+inline
+void *
+MemoryPool::allocate(size_t inSize, bool inZero) {
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, 16, inSize ? inSize : 1) != 0)
+        return NULL;
+    if (inZero)
+        std::memset(ptr, 0, inSize);
+
+    Block block = { ptr, inSize };
+    mBlocks.push_back(block);
+    mBytesAllocated += inSize;
+    return ptr;
+}
+
+/**
+ * @brief Change the size of a block
+ *
+ * Like repalloc(), this does not zero the new part of the block.
+ */
+inline
+void *
+MemoryPool::reallocate(void *inPtr, size_t inSize) {
+    if (inPtr == NULL)
+        return allocate(inSize, false);
+
+    void *ptr = allocate(inSize, false);
+    if (ptr == NULL)
+        return NULL;
+
+    std::vector<Block>::iterator block = find(inPtr);
+    std::memcpy(ptr, inPtr, std::min(block->size, inSize));
+    free(inPtr);
+    return ptr;
+}
+
+inline
+void
+MemoryPool::free(void *inPtr) {
+    if (inPtr == NULL)
+        return;
+
+    std::vector<Block>::iterator block = find(inPtr);
+    mBytesAllocated -= block->size;
+    std::free(block->ptr);
+    mBlocks.erase(block);
+}
+
+/**
+ * @brief Free all blocks, like MemoryContextReset()
+ */
+inline
+void
+MemoryPool::reset() {
+    release(0);
+}
+
+/**
+ * @brief Free all blocks allocated since mark() returned inMark
+ *
+ * Blocks allocated before are kept, provided none of them was freed in the
+ * meantime.
+ */
+inline
+void
+MemoryPool::release(size_t inMark) {
+    for (std::vector<Block>::iterator it = mBlocks.begin() + inMark;
+        it != mBlocks.end(); ++it) {
+
+        mBytesAllocated -= it->size;
+        std::free(it->ptr);
+    }
+    mBlocks.resize(inMark);
+}
+
+/**
+ * @brief Find a block, searching the most recent ones first
+ */
+inline
+std::vector<MemoryPool::Block>::iterator
+MemoryPool::find(void *inPtr) {
+    for (std::vector<Block>::iterator it = mBlocks.end();
+        it != mBlocks.begin(); ) {
+        --it;
+        if (it->ptr == inPtr)
+            return it;
+    }
+    throw std::logic_error("Attempt to free memory that was not allocated "
+        "with Allocator.");
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_BENCH_ALLOCATOR_IMPL_HPP)
@@ -0,0 +1,115 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file Allocator_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_ALLOCATOR_PROTO_HPP
+#define MADLIB_BENCH_ALLOCATOR_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+template <typename T>
+class MutableArrayHandle;
+
+class MutableByteString;
+
+/**
+ * @brief Memory allocator with the interface of the PostgreSQL port
+ *
+ * All memory contexts are served by MemoryPool, which plays the role of the
+ * aggregate context of a query: Memory is only given back when the benchmark
+ * harness calls MemoryPool::reset().
+ */
+class Allocator {
+public:
+#define MADLIB_ALLOCATE_ARRAY_DECL(z, n, _ignored) \
+    template <typename T, dbal::MemoryContext MC, \
+        dbal::ZeroMemory ZM, dbal::OnMemoryAllocationFailure F> \
+    MutableArrayHandle<T> allocateArray( \
+        BOOST_PP_ENUM_PARAMS_Z(z, BOOST_PP_INC(n), std::size_t inDim) \
+    ) const; \
+    \
+    template <typename T> \
+    MutableArrayHandle<T> allocateArray( \
+        BOOST_PP_ENUM_PARAMS_Z(z, BOOST_PP_INC(n), std::size_t inDim) \
+    ) const;
+    BOOST_PP_REPEAT(MADLIB_MAX_ARRAY_DIMS, MADLIB_ALLOCATE_ARRAY_DECL,
+        0 /* ignored */)
+#undef MADLIB_ALLOCATE_ARRAY_DECL
+
+    template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
+        dbal::OnMemoryAllocationFailure F>
+    MutableByteString allocateByteString(std::size_t inSize) const;
+
+    template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
+        dbal::OnMemoryAllocationFailure F>
+    void *allocate(const size_t inSize) const;
+
+    template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
+        dbal::OnMemoryAllocationFailure F>
+    void *reallocate(void *inPtr, const size_t inSize) const;
+
+    template <dbal::MemoryContext MC>
+    void free(void *inPtr) const;
+
+protected:
+    template <typename T, std::size_t Dimensions, dbal::MemoryContext MC,
+        dbal::ZeroMemory ZM, dbal::OnMemoryAllocationFailure F>
+    MutableArrayHandle<T> internalAllocateArray(
+        const std::array<std::size_t, Dimensions>& inNumElements) const;
+};
+
+Allocator& defaultAllocator();
+
+/**
+ * @brief All memory allocated through an Allocator
+ *
+ * Blocks are 16-byte aligned, as with the PostgreSQL port.
+ */
+class MemoryPool {
+public:
+    static MemoryPool& get();
+
+    void *allocate(size_t inSize, bool inZero);
+    void *reallocate(void *inPtr, size_t inSize);
+    void free(void *inPtr);
+    void reset();
+    void release(size_t inMark);
+
+    /**
+     * @brief Mark to pass to release() later
+     */
+    size_t mark() const { return mBlocks.size(); }
+
+    /**
+     * @brief Number of bytes currently allocated
+     */
+    size_t bytesAllocated() const { return mBytesAllocated; }
+
+protected:
+    struct Block {
+        void *ptr;
+        size_t size;
+    };
+
+    MemoryPool() : mBytesAllocated(0) { }
+    ~MemoryPool() { reset(); }
+
+    std::vector<Block>::iterator find(void *inPtr);
+
+    std::vector<Block> mBlocks;
+    size_t mBytesAllocated;
+};
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_BENCH_ALLOCATOR_PROTO_HPP)
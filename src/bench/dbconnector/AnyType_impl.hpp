@@ -0,0 +1,133 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file AnyType_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_ANYTYPE_IMPL_HPP
+#define MADLIB_BENCH_ANYTYPE_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Template constructor (will \b not be used as copy constructor)
+ */
+template <typename T>
+inline
+AnyType::AnyType(const T& inValue)
+  : mContent(Scalar),
+    mDatum(TypeTraits<T>::toDatum(inValue)),
+    mTypeID(TypeTraits<T>::oid)
+    { }
+
+/**
+ * @brief Default constructor, initializes AnyType object as Null
+ */
+inline
+AnyType::AnyType()
+  : mContent(Null),
+    mDatum(0),
+    mTypeID(InvalidOid)
+    { }
+
+/**
+ * @brief Convert object to the type specified as template argument
+ */
+template <typename T>
+inline
+T
+AnyType::getAs() const {
+    if (isNull())
+        throw std::invalid_argument("Invalid type conversion. "
+            "Null where not expected.");
+
+    if (isComposite())
+        throw std::invalid_argument("Invalid type conversion. "
+            "Composite type where not expected.");
+
+    if (TypeTraits<T>::oid != InvalidOid && mTypeID != TypeTraits<T>::oid) {
+        std::stringstream errorMsg;
+        errorMsg << "Invalid type conversion. Expected type ID "
+            << TypeTraits<T>::oid << " but got " << mTypeID << '.';
+        throw std::invalid_argument(errorMsg.str());
+    }
+
+    return TypeTraits<T>::toCXXType(mDatum);
+}
+
+inline
+bool
+AnyType::isNull() const {
+    return mContent == Null;
+}
+
+inline
+bool
+AnyType::isComposite() const {
+    return mContent == Composite;
+}
+
+inline
+uint16_t
+AnyType::numFields() const {
+    switch (mContent) {
+        case Null: return 0;
+        case Scalar: return 1;
+        default: return static_cast<uint16_t>(mChildren.size());
+    }
+}
+
+/**
+ * @brief Return the n-th element from a composite value
+ */
+inline
+AnyType
+AnyType::operator[](uint16_t inID) const {
+    if (isNull())
+        throw std::invalid_argument("Invalid type conversion. "
+            "Null where not expected.");
+    if (!isComposite())
+        throw std::invalid_argument("Invalid type conversion. "
+            "Composite type where not expected.");
+    if (inID >= mChildren.size())
+        throw std::out_of_range("Invalid type conversion. Access behind "
+            "end of argument list.");
+
+    return mChildren[inID];
+}
+
+/**
+ * @brief Add an element to a composite value
+ */
+inline
+AnyType&
+AnyType::operator<<(const AnyType &inValue) {
+    madlib_assert(mContent == Null || mContent == Composite,
+        std::logic_error("Internal inconsistency while creating composite "
+            "value."));
+
+    mContent = Composite;
+    mChildren.push_back(inValue);
+    return *this;
+}
+
+/**
+ * @brief Return an AnyType object representing Null.
+ */
+inline
+AnyType
+Null() {
+    return AnyType();
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_BENCH_ANYTYPE_IMPL_HPP)
@@ -0,0 +1,59 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file AnyType_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_ANYTYPE_PROTO_HPP
+#define MADLIB_BENCH_ANYTYPE_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Proxy for values passed to and returned from user-defined functions
+ *
+ * In the benchmark connector, an AnyType object is either Null, a scalar
+ * value (a Datum together with its type ID), or a composite value consisting
+ * of a vector of AnyType objects. The argument list of a function is a
+ * composite value, too, which the caller builds with operator<<().
+ *
+ * Arrays and byte strings are passed by reference, like in an aggregate
+ * context. In particular, functions may modify their first argument in place.
+ */
+class AnyType {
+public:
+    AnyType();
+    template <typename T> AnyType(const T& inValue);
+    template <typename T> T getAs() const;
+    AnyType operator[](uint16_t inID) const;
+    uint16_t numFields() const;
+    bool isNull() const;
+    bool isComposite() const;
+    AnyType &operator<<(const AnyType& inValue);
+
+protected:
+    enum Content {
+        Null,
+        Scalar,
+        Composite
+    };
+
+    Content mContent;
+    Datum mDatum;
+    Oid mTypeID;
+    std::vector<AnyType> mChildren;
+};
+
+AnyType Null();
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_BENCH_ANYTYPE_PROTO_HPP)
@@ -0,0 +1,105 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file Backend.hpp
+ *
+ * @brief The parts of the PostgreSQL C API that the C++ AL relies on
+ *
+ * The benchmark connector does not link against a database. It only needs the
+ * memory layout of arrays and byte strings, so that the handles of the
+ * PostgreSQL port (ArrayHandle, ByteString, ...) can be used unchanged. The
+ * definitions below follow postgres.h and utils/array.h. Varlena headers are
+ * always 4 bytes and store the plain length, i.e., there are no short,
+ * compressed, or TOASTed values.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_BACKEND_HPP
+#define MADLIB_BENCH_BACKEND_HPP
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+typedef unsigned int Oid;
+typedef uint64_t Datum;
+
+#define InvalidOid ((Oid) 0)
+#define BOOLOID 16
+#define BYTEAOID 17
+#define INT8OID 20
+#define INT2OID 21
+#define INT4OID 23
+#define FLOAT4OID 700
+#define FLOAT8OID 701
+#define INT4ARRAYOID 1007
+#define INT8ARRAYOID 1016
+#define FLOAT4ARRAYOID 1021
+#define FLOAT8ARRAYOID 1022
+
+#define ALIGNOF_SHORT 2
+#define ALIGNOF_INT 4
+#define ALIGNOF_DOUBLE 8
+#define MAXIMUM_ALIGNOF 8
+#define MAXALIGN(LEN) \
+    (((uintptr_t) (LEN) + (MAXIMUM_ALIGNOF - 1)) \
+        & ~((uintptr_t) (MAXIMUM_ALIGNOF - 1)))
+
+struct varlena {
+    uint32_t vl_len_;
+    char vl_dat[1];
+};
+typedef struct varlena bytea;
+
+#define VARHDRSZ ((int32_t) sizeof(uint32_t))
+#define VARSIZE(PTR) (((const struct varlena *) (PTR))->vl_len_)
+#define SET_VARSIZE(PTR, len) \
+    (((struct varlena *) (PTR))->vl_len_ = (uint32_t) (len))
+#define VARDATA(PTR) (((struct varlena *) (PTR))->vl_dat)
+
+struct ArrayType {
+    uint32_t vl_len_;
+    int ndim;
+    int32_t dataoffset;
+    Oid elemtype;
+};
+
+#define ARR_SIZE(a) VARSIZE(a)
+#define ARR_NDIM(a) ((a)->ndim)
+#define ARR_ELEMTYPE(a) ((a)->elemtype)
+#define ARR_DIMS(a) ((int *) (((char *) (a)) + sizeof(ArrayType)))
+#define ARR_LBOUND(a) \
+    ((int *) (((char *) (a)) + sizeof(ArrayType) + sizeof(int) * ARR_NDIM(a)))
+#define ARR_OVERHEAD_NONULLS(ndims) \
+    MAXALIGN(sizeof(ArrayType) + 2 * sizeof(int) * (ndims))
+#define ARR_DATA_OFFSET(a) ARR_OVERHEAD_NONULLS(ARR_NDIM(a))
+#define ARR_DATA_PTR(a) (((char *) (a)) + ARR_DATA_OFFSET(a))
+
+inline Datum PointerGetDatum(const void* X) {
+    return static_cast<Datum>(reinterpret_cast<uintptr_t>(X));
+}
+
+inline void* DatumGetPointer(Datum X) {
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(X));
+}
+
+inline Datum Float8GetDatum(double X) {
+    Datum result;
+    std::memcpy(&result, &X, sizeof(X));
+    return result;
+}
+
+inline double DatumGetFloat8(Datum X) {
+    double result;
+    std::memcpy(&result, &X, sizeof(result));
+    return result;
+}
+
+inline Datum Int64GetDatum(int64_t X) {
+    return static_cast<Datum>(X);
+}
+
+inline int64_t DatumGetInt64(Datum X) {
+    return static_cast<int64_t>(X);
+}
+
+#endif // defined(MADLIB_BENCH_BACKEND_HPP)
@@ -0,0 +1,76 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file NativeRandomNumberGenerator_impl.hpp
+ *
+ * @brief Stand-in for the random-number generator of the backend
+ *
+ * The sequence does not depend on anything but the seed, so that benchmark
+ * runs are reproducible.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_NATIVERANDOMNUMBERGENERATOR_IMPL_HPP
+#define MADLIB_BENCH_NATIVERANDOMNUMBERGENERATOR_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Shared state, like that of drandom() in a PostgreSQL backend
+ */
+inline
+unsigned short*
+nativeRandomState() {
+    static unsigned short sState[3] = { 0x330E, 0xABCD, 0x1234 };
+    return sState;
+}
+
+inline
+NativeRandomNumberGenerator::NativeRandomNumberGenerator() { }
+
+inline
+void
+NativeRandomNumberGenerator::seed(result_type inSeed) {
+    uint64_t bits = static_cast<uint64_t>(inSeed * 2147483647.0);
+    unsigned short* state = nativeRandomState();
+    state[0] = 0x330E;
+    state[1] = static_cast<unsigned short>(bits);
+    state[2] = static_cast<unsigned short>(bits >> 16);
+}
+
+inline
+NativeRandomNumberGenerator::result_type
+NativeRandomNumberGenerator::operator()() {
+    return erand48(nativeRandomState());
+}
+
+inline
+void
+NativeRandomNumberGenerator::fill(result_type* outValues,
+    std::size_t inNumValues) {
+    for (std::size_t i = 0; i < inNumValues; i++)
+        outValues[i] = (*this)();
+}
+
+inline
+NativeRandomNumberGenerator::result_type
+NativeRandomNumberGenerator::min() {
+    return 0.0;
+}
+
+inline
+NativeRandomNumberGenerator::result_type
+NativeRandomNumberGenerator::max() {
+    return 1.0;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_BENCH_NATIVERANDOMNUMBERGENERATOR_IMPL_HPP)
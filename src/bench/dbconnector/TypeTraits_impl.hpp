@@ -0,0 +1,309 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file TypeTraits_impl.hpp
+ *
+ * @brief Conversion between Datums and C++ types in the benchmark connector
+ *
+ * Unlike in the PostgreSQL port, arrays are never copied when converting to
+ * C++ types: There is no TOAST and all values passed around are owned by the
+ * benchmark harness. Eigen objects returned by a function are copied into a
+ * new array, as in the PostgreSQL port.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_TYPETRAITS_IMPL_HPP
+#define MADLIB_BENCH_TYPETRAITS_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+template <typename T>
+struct TypeTraitsBase {
+    enum { oid = InvalidOid };
+    enum { alignment = MAXIMUM_ALIGNOF };
+
+    typedef T value_type;
+};
+
+/**
+ * @brief Traits of scalars that fit into a Datum by value
+ *
+ * All integers are passed as 64-bit values.
+ */
+template <typename T, Oid TypeID, Oid ArrayTypeID, int Alignment>
+struct IntegralTypeTraits : public TypeTraitsBase<T> {
+    enum { oid = TypeID };
+    enum { arrayOID = ArrayTypeID };
+    enum { alignment = Alignment };
+
+    static Datum toDatum(const T& value) {
+        return Int64GetDatum(static_cast<int64_t>(value));
+    }
+    static T toCXXType(Datum value) {
+        return static_cast<T>(DatumGetInt64(value));
+    }
+};
+
+template <>
+struct TypeTraits<double> : public TypeTraitsBase<double> {
+    enum { oid = FLOAT8OID };
+    enum { arrayOID = FLOAT8ARRAYOID };
+    enum { alignment = ALIGNOF_DOUBLE };
+
+    static Datum toDatum(const double& value) {
+        return Float8GetDatum(value);
+    }
+    static double toCXXType(Datum value) {
+        return DatumGetFloat8(value);
+    }
+};
+
+template <>
+struct TypeTraits<float> : public TypeTraitsBase<float> {
+    enum { oid = FLOAT4OID };
+    enum { arrayOID = FLOAT4ARRAYOID };
+    enum { alignment = ALIGNOF_INT };
+
+    static Datum toDatum(const float& value) {
+        return Float8GetDatum(value);
+    }
+    static float toCXXType(Datum value) {
+        return static_cast<float>(DatumGetFloat8(value));
+    }
+};
+
+template <>
+struct TypeTraits<int64_t>
+  : public IntegralTypeTraits<int64_t, INT8OID, INT8ARRAYOID, ALIGNOF_DOUBLE>
+    { };
+
+template <>
+struct TypeTraits<uint64_t>
+  : public IntegralTypeTraits<uint64_t, INT8OID, INT8ARRAYOID, ALIGNOF_DOUBLE>
+    { };
+
+template <>
+struct TypeTraits<int32_t>
+  : public IntegralTypeTraits<int32_t, INT4OID, INT4ARRAYOID, ALIGNOF_INT>
+    { };
+
+template <>
+struct TypeTraits<uint32_t>
+  : public IntegralTypeTraits<uint32_t, INT4OID, INT4ARRAYOID, ALIGNOF_INT>
+    { };
+
+template <>
+struct TypeTraits<int16_t>
+  : public IntegralTypeTraits<int16_t, INT2OID, InvalidOid, ALIGNOF_SHORT>
+    { };
+
+template <>
+struct TypeTraits<uint16_t>
+  : public IntegralTypeTraits<uint16_t, INT2OID, InvalidOid, ALIGNOF_SHORT>
+    { };
+
+template <>
+struct TypeTraits<bool>
+  : public IntegralTypeTraits<bool, BOOLOID, InvalidOid, 1>
+    { };
+
+template <>
+struct TypeTraits<ByteString> : public TypeTraitsBase<ByteString> {
+    enum { oid = BYTEAOID };
+
+    static Datum toDatum(const ByteString& value) {
+        return PointerGetDatum(value.byteString());
+    }
+    static ByteString toCXXType(Datum value) {
+        return static_cast<const bytea*>(DatumGetPointer(value));
+    }
+};
+
+template <>
+struct TypeTraits<MutableByteString>
+  : public TypeTraitsBase<MutableByteString> {
+
+    enum { oid = BYTEAOID };
+
+    static Datum toDatum(const MutableByteString& value) {
+        return PointerGetDatum(value.byteString());
+    }
+    static MutableByteString toCXXType(Datum value) {
+        return static_cast<bytea*>(DatumGetPointer(value));
+    }
+};
+
+template <typename T>
+struct TypeTraits<ArrayHandle<T> > : public TypeTraitsBase<ArrayHandle<T> > {
+    enum { oid = TypeTraits<T>::arrayOID };
+
+    static Datum toDatum(const ArrayHandle<T>& value) {
+        return PointerGetDatum(value.array());
+    }
+    static ArrayHandle<T> toCXXType(Datum value) {
+        return static_cast<const ArrayType*>(DatumGetPointer(value));
+    }
+};
+
+template <typename T>
+struct TypeTraits<MutableArrayHandle<T> >
+  : public TypeTraitsBase<MutableArrayHandle<T> > {
+
+    enum { oid = TypeTraits<T>::arrayOID };
+
+    static Datum toDatum(const MutableArrayHandle<T>& value) {
+        return PointerGetDatum(value.array());
+    }
+    static MutableArrayHandle<T> toCXXType(Datum value) {
+        return static_cast<ArrayType*>(DatumGetPointer(value));
+    }
+};
+
+/**
+ * @brief Copy an Eigen vector or matrix into a new array
+ */
+template <typename Derived>
+inline
+Datum
+EigenToDatum(const Eigen::MatrixBase<Derived>& inValue) {
+    return PointerGetDatum(
+        Derived::RowsAtCompileTime == 1 || Derived::ColsAtCompileTime == 1
+            ? VectorToNativeArray(inValue)
+            : MatrixToNativeArray(inValue));
+}
+
+/**
+ * @brief Traits of Eigen maps of arrays (e.g., MappedColumnVector)
+ */
+template <class EigenType, typename T>
+struct TypeTraits<
+    dbal::eigen_integration::HandleMap<EigenType, ArrayHandle<T> > >
+  : public TypeTraitsBase<
+        dbal::eigen_integration::HandleMap<EigenType, ArrayHandle<T> > > {
+
+    typedef dbal::eigen_integration::HandleMap<EigenType, ArrayHandle<T> >
+        value_type;
+
+    enum { oid = TypeTraits<T>::arrayOID };
+
+    static Datum toDatum(const value_type& value) {
+        return PointerGetDatum(value.memoryHandle().array());
+    }
+    static value_type toCXXType(Datum value) {
+        return value_type(ArrayHandle<T>(
+            static_cast<const ArrayType*>(DatumGetPointer(value))));
+    }
+};
+
+template <class EigenType, typename T>
+struct TypeTraits<
+    dbal::eigen_integration::HandleMap<EigenType, MutableArrayHandle<T> > >
+  : public TypeTraitsBase<
+        dbal::eigen_integration::HandleMap<EigenType, MutableArrayHandle<T> > > {
+
+    typedef dbal::eigen_integration::HandleMap<EigenType,
+        MutableArrayHandle<T> > value_type;
+
+    enum { oid = TypeTraits<T>::arrayOID };
+
+    static Datum toDatum(const value_type& value) {
+        return PointerGetDatum(value.memoryHandle().array());
+    }
+    static value_type toCXXType(Datum value) {
+        return value_type(MutableArrayHandle<T>(
+            static_cast<ArrayType*>(DatumGetPointer(value))));
+    }
+};
+
+/**
+ * @brief Traits of Eigen maps of other memory (e.g., parts of a state)
+ *
+ * These can only be returned.
+ */
+template <class EigenType, typename T, bool IsMutable>
+struct TypeTraits<
+    dbal::eigen_integration::HandleMap<EigenType,
+        TransparentHandle<T, IsMutable> > >
+  : public TypeTraitsBase<
+        dbal::eigen_integration::HandleMap<EigenType,
+            TransparentHandle<T, IsMutable> > > {
+
+    typedef dbal::eigen_integration::HandleMap<EigenType,
+        TransparentHandle<T, IsMutable> > value_type;
+
+    enum { oid = TypeTraits<T>::arrayOID };
+
+    static Datum toDatum(const value_type& value) {
+        return EigenToDatum(value);
+    }
+};
+
+template <typename Scalar, int Rows, int Cols, int Options, int MaxRows,
+    int MaxCols>
+struct TypeTraits<Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows,
+    MaxCols> >
+  : public TypeTraitsBase<Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows,
+        MaxCols> > {
+
+    enum { oid = TypeTraits<Scalar>::arrayOID };
+
+    static Datum toDatum(const Eigen::Matrix<Scalar, Rows, Cols, Options,
+        MaxRows, MaxCols>& value) {
+
+        return EigenToDatum(value);
+    }
+};
+
+template<class XprType, int BlockRows, bool InnerPanel, bool HasDirectAccess>
+struct TypeTraits<
+    Eigen::Block<XprType, BlockRows, /* BlockCols */ 1, InnerPanel,
+        HasDirectAccess> >
+  : public TypeTraitsBase<
+        Eigen::Block<XprType, BlockRows, 1, InnerPanel, HasDirectAccess> > {
+
+    enum { oid = FLOAT8ARRAYOID };
+
+    static Datum toDatum(const Eigen::Block<XprType, BlockRows, 1, InnerPanel,
+        HasDirectAccess>& value) {
+
+        return PointerGetDatum(VectorToNativeArray(value));
+    }
+};
+
+/**
+ * @brief Legacy sparse vectors are implemented in C on top of the backend and
+ *     therefore not available
+ */
+template <>
+struct TypeTraits<dbal::eigen_integration::SparseColumnVector>
+  : public TypeTraitsBase<dbal::eigen_integration::SparseColumnVector> {
+
+    typedef dbal::eigen_integration::SparseColumnVector value_type;
+
+    static Datum toDatum(const value_type&) {
+        throw std::invalid_argument("Sparse vectors are not supported by the "
+            "benchmark connector.");
+    }
+    static value_type toCXXType(Datum) {
+        throw std::invalid_argument("Sparse vectors are not supported by the "
+            "benchmark connector.");
+    }
+};
+
+template <>
+struct TypeTraits<dbal::ByteStreamMaximumAlignmentType>
+  : public TypeTraitsBase<dbal::ByteStreamMaximumAlignmentType> {
+
+    enum { alignment = MAXIMUM_ALIGNOF };
+};
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_BENCH_TYPETRAITS_IMPL_HPP)
@@ -0,0 +1,88 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file UDF_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_UDF_IMPL_HPP
+#define MADLIB_BENCH_UDF_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Call a user-defined function
+ *
+ * Each function has a single call-site cache, i.e., the harness behaves like
+ * a query with only one call site per function.
+ */
+template <class Function>
+inline
+AnyType
+UDF::invoke(AnyType& args) {
+    static void* sCallSiteCache = NULL;
+
+    Function function;
+    UDF& udf = function;
+    udf.mArgs = &args;
+    udf.mCallSiteCache = &sCallSiteCache;
+    return function.run(args);
+}
+
+inline
+void*&
+UDF::callSiteCache() const {
+    return *mCallSiteCache;
+}
+
+/**
+ * @brief Allocate zeroed memory that lives as long as the call-site cache
+ *
+ * Like in the PostgreSQL port, this memory is not freed with MemoryPool.
+ */
+inline
+void*
+UDF::allocateCallSiteCache(std::size_t inSize) const {
+    void* ptr = std::calloc(1, inSize);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+inline
+void
+UDF::freeCallSiteCache(void* inPtr) const {
+    std::free(inPtr);
+}
+
+/**
+ * @brief Return a DOUBLE PRECISION[] argument
+ *
+ * Arrays never need detoasting here, so there is nothing to cache.
+ */
+inline
+ArrayHandle<double>
+UDF::cachedArrayArgument(uint16_t inID) const {
+    return (*mArgs)[inID].getAs<ArrayHandle<double> >();
+}
+
+inline
+std::streambuf*
+UDF::nullStreamBuffer() {
+    struct NullStreamBuffer : public std::streambuf {
+        int overflow(int c) { return traits_type::not_eof(c); }
+    };
+    static NullStreamBuffer sBuffer;
+    return &sBuffer;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_BENCH_UDF_IMPL_HPP)
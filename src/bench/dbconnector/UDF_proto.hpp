@@ -0,0 +1,59 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file UDF_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_UDF_PROTO_HPP
+#define MADLIB_BENCH_UDF_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief User-defined function
+ *
+ * The benchmark harness calls a function with invoke(). Output written to
+ * dbout and dberr is discarded, so that it does not distort the measurements.
+ */
+class UDF : public Allocator {
+public:
+    UDF() : dbout(nullStreamBuffer()), dberr(nullStreamBuffer()),
+        mArgs(NULL), mCallSiteCache(NULL) { }
+
+    template <class Function>
+    static AnyType invoke(AnyType& args);
+
+protected:
+    void*& callSiteCache() const;
+    void* allocateCallSiteCache(std::size_t inSize) const;
+    void freeCallSiteCache(void* inPtr) const;
+    ArrayHandle<double> cachedArrayArgument(uint16_t inID) const;
+
+    /**
+     * @brief Informational output stream
+     */
+    std::ostream dbout;
+
+    /**
+     * @brief Warning and non-fatal error output stream
+     */
+    std::ostream dberr;
+
+private:
+    static std::streambuf* nullStreamBuffer();
+
+    AnyType* mArgs;
+    void** mCallSiteCache;
+};
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_BENCH_UDF_PROTO_HPP)
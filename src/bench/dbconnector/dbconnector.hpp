@@ -0,0 +1,138 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file dbconnector.hpp
+ *
+ * @brief Connector for running C++ AL functions outside of the database
+ *
+ * This file takes the place of the PostgreSQL dbconnector.hpp when compiling
+ * the modules for the benchmark harness (see bench.cpp). User code is compiled
+ * without changes: Handles, Eigen integration, and the thread pool are those
+ * of the PostgreSQL port; only memory allocation, AnyType, the type
+ * conversions and UDF are replaced. Features that require a backend
+ * (FunctionHandle, SystemInformation, legacy sparse vectors) are not available.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_BENCH_DBCONNECTOR_HPP
+#define MADLIB_BENCH_DBCONNECTOR_HPP
+
+// The PostgreSQL headers are replaced by the bare memory layout
+#include "Backend.hpp"
+
+#include <boost/mpl/if.hpp>
+#include <boost/type_traits/is_const.hpp>
+#include <boost/type_traits/remove_cv.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <boost/tr1/array.hpp>
+#include <boost/tr1/tuple.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <vector>
+#include <fstream>
+
+#include <dbal/dbal_proto.hpp>
+#include <utils/Reference.hpp>
+#include <utils/Math.hpp>
+
+namespace std {
+    // Import names from TR1.
+
+    // The following are currently provided by boost.
+    using tr1::array;
+    using tr1::tuple;
+    using tr1::get;
+}
+
+#if !defined(NDEBUG) && !defined(EIGEN_NO_DEBUG)
+#define eigen_assert(x) \
+    do { \
+        if(!Eigen::internal::copy_bool(x)) \
+            throw std::runtime_error(std::string( \
+                "Internal error. Eigen assertion failed (" \
+                EIGEN_MAKESTRING(x) ") in function ") + __PRETTY_FUNCTION__ + \
+                " at " __FILE__ ":" EIGEN_MAKESTRING(__LINE__)); \
+    } while(false)
+#endif // !defined(NDEBUG) && !defined(EIGEN_NO_DEBUG)
+
+/**
+ * The maximum number of dimensions in an array
+ */
+#define MADLIB_MAX_ARRAY_DIMS 2
+
+// There is no way to obtain legacy sparse vectors without a backend
+#define MADLIB_NO_LEGACY_SVEC
+
+#include "Allocator_proto.hpp"
+#include <ports/postgres/dbconnector/ArrayHandle_proto.hpp>
+#include "AnyType_proto.hpp"
+#include <ports/postgres/dbconnector/ByteString_proto.hpp>
+#include <ports/postgres/dbconnector/NativeRandomNumberGenerator_proto.hpp>
+#include <ports/postgres/dbconnector/PhiloxRandomNumberGenerator_proto.hpp>
+#include <ports/postgres/dbconnector/ThreadPool_proto.hpp>
+#include <ports/postgres/dbconnector/TransparentHandle_proto.hpp>
+#include <ports/postgres/dbconnector/TypeTraits_proto.hpp>
+#include "UDF_proto.hpp"
+
+namespace madlib {
+
+// Import MADlib types into madlib namespace
+using dbconnector::postgres::Allocator;
+using dbconnector::postgres::AnyType;
+using dbconnector::postgres::ArrayHandle;
+using dbconnector::postgres::ByteString;
+using dbconnector::postgres::MutableArrayHandle;
+using dbconnector::postgres::MutableByteString;
+using dbconnector::postgres::NativeRandomNumberGenerator;
+using dbconnector::postgres::ParallelTask;
+using dbconnector::postgres::PhiloxRandomNumberGenerator;
+using dbconnector::postgres::TransparentHandle;
+
+// Import MADlib functions into madlib namespace
+using dbconnector::postgres::defaultAllocator;
+using dbconnector::postgres::Null;
+using dbconnector::postgres::parallelFor;
+
+} // namespace madlib
+
+#include <dbal/dbal_impl.hpp>
+
+#include <ports/postgres/dbconnector/EigenIntegration_proto.hpp>
+
+#include "Allocator_impl.hpp"
+#include "AnyType_impl.hpp"
+#include <ports/postgres/dbconnector/ArrayHandle_impl.hpp>
+#include <ports/postgres/dbconnector/ByteString_impl.hpp>
+#include <ports/postgres/dbconnector/EigenIntegration_impl.hpp>
+#include "NativeRandomNumberGenerator_impl.hpp"
+#include <ports/postgres/dbconnector/PhiloxRandomNumberGenerator_impl.hpp>
+#include <ports/postgres/dbconnector/ThreadPool_impl.hpp>
+#include <ports/postgres/dbconnector/TransparentHandle_impl.hpp>
+#include "TypeTraits_impl.hpp"
+#include "UDF_impl.hpp"
+
+namespace madlib {
+
+typedef dbal::DynamicStructRootContainer<
+    ByteString, dbconnector::postgres::TypeTraits> RootContainer;
+typedef dbal::DynamicStructRootContainer<
+    MutableByteString, dbconnector::postgres::TypeTraits> MutableRootContainer;
+
+} // namespace madlib
+
+#define DECLARE_UDF(_module, _name) \
+    namespace madlib { \
+    namespace modules { \
+    namespace _module { \
+    struct _name : public dbconnector::postgres::UDF { \
+        AnyType run(AnyType &args); \
+    }; \
+    } \
+    } \
+    }
+
+#endif // defined(MADLIB_BENCH_DBCONNECTOR_HPP)
@@ -80,12 +80,12 @@ ByteStreamHandleBuf<Storage, CharType, IsMutable>::storage() const {
 template <class Storage, class CharType>
 ByteStreamHandleBuf<Storage, CharType, Mutable>::ByteStreamHandleBuf(
     size_t inSize)
-  : Base(inSize) { }
+  : Base(inSize), mCapacity(inSize) { }
 
 template <class Storage, class CharType>
 ByteStreamHandleBuf<Storage, CharType, Mutable>::ByteStreamHandleBuf(
     const Storage_type& inStorage)
-  : Base(inStorage) { }
+  : Base(inStorage), mCapacity(0) { }
 
 template <class Storage, class CharType>
 typename ByteStreamHandleBuf<Storage, CharType, Mutable>::char_type*
@@ -93,6 +93,31 @@ ByteStreamHandleBuf<Storage, CharType, Mutable>::ptr() {
     return const_cast<char_type*>(static_cast<Base*>(this)->ptr());
 }
 
+/**
+ * @brief Return the number of bytes the storage can grow to without
+ *     reallocation
+ */
+template <class Storage, class CharType>
+size_t
+ByteStreamHandleBuf<Storage, CharType, Mutable>::capacity() const {
+    return mCapacity > this->size() ? mCapacity : this->size();
+}
+
+/**
+ * @brief Insert or remove bytes at the given position
+ *
+ * If the storage grows beyond its capacity, the capacity is (at least)
+ * doubled, so that a sequence of appends takes amortized constant time per
+ * byte. Storage that this buffer allocated is grown with
+ * Allocator::reallocate(), which invalidates all pointers into it. Storage
+ * passed in from outside (e.g., a transition state of the backend) is left
+ * untouched and copied instead.
+ *
+ * @internal
+ *     The capacity is not stored in the byte string: The backend copies only
+ *     the size of a value (e.g., when it keeps a transition state), so a
+ *     stored capacity could refer to memory beyond the end of the copy.
+ */
 template <class Storage, class CharType>
 void
 ByteStreamHandleBuf<Storage, CharType, Mutable>::resize(
@@ -101,21 +126,41 @@ ByteStreamHandleBuf<Storage, CharType, Mutable>::resize(
     if (inSize == this->size())
         return;
 
-    char_type* oldPtr = this->ptr();
-    size_t secondChunkStart
-        = inPivot > this->size() ? this->size() : inPivot;
     size_t oldSize = this->size();
-    ptrdiff_t delta = inSize - oldSize;
-
-    // FIXME: Deallocate old memory!
-    this->mStorage = defaultAllocator().allocateByteString<
-        dbal::FunctionContext, dbal::DoZero, dbal::ThrowBadAlloc>(inSize);
-
-    std::copy(oldPtr, oldPtr + secondChunkStart, this->ptr());
-    std::copy(oldPtr + secondChunkStart, oldPtr + oldSize,
-        this->ptr() + secondChunkStart + delta);
-    std::fill(this->ptr() + secondChunkStart,
-        this->ptr() + secondChunkStart + delta, 0);
+    size_t secondChunkStart = inPivot > oldSize ? oldSize : inPivot;
+
+    if (inSize > capacity()) {
+        size_t newCapacity = std::max(inSize, 2 * capacity());
+        if (mCapacity > 0) {
+            this->mStorage = static_cast<bytea*>(
+                defaultAllocator().reallocate<dbal::FunctionContext,
+                    dbal::DoNotZero, dbal::ThrowBadAlloc>(
+                        this->mStorage.byteString(),
+                        Storage_type::kEffectiveHeaderSize + newCapacity));
+        } else {
+            const char_type* oldPtr = this->ptr();
+            Storage_type newStorage = defaultAllocator().allocateByteString<
+                dbal::FunctionContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                    newCapacity);
+            std::copy(oldPtr, oldPtr + oldSize, newStorage.ptr());
+            this->mStorage = newStorage;
+        }
+        mCapacity = newCapacity;
+    }
+
+    // Growing inserts zeros at the pivot, shrinking removes the bytes
+    // immediately in front of it
+    char_type* data = this->ptr();
+    if (inSize > oldSize) {
+        std::copy_backward(data + secondChunkStart, data + oldSize,
+            data + inSize);
+        std::fill(data + secondChunkStart,
+            data + secondChunkStart + (inSize - oldSize), 0);
+    } else {
+        std::copy(data + secondChunkStart, data + oldSize,
+            data + secondChunkStart - (oldSize - inSize));
+    }
+    this->mStorage.setSize(inSize);
 }
 
 } // namespace dbal
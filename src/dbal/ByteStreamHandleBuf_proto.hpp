@@ -50,8 +50,19 @@ public:
     ByteStreamHandleBuf(const Storage_type& inStorage);
 
     char_type* ptr();
+    size_t capacity() const;
     void resize(size_t inSize, size_t inPivot);
 
+protected:
+    /**
+     * @brief Number of bytes allocated for the storage, or 0 if the storage
+     *     was not allocated by this buffer (and may therefore not be
+     *     reallocated)
+     */
+    size_t mCapacity;
+
+public:
+
     BOOST_STATIC_ASSERT_MSG(
         Storage_type::isMutable,
         "Mutable ByteStreamHandleBuf requires mutable storage.");
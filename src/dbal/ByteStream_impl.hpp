@@ -41,7 +41,7 @@ ByteStream<StreamBuf, TypeTraits, IsMutable>::DryRun::leave() {
 template <class StreamBuf, template <class T> class TypeTraits, bool IsMutable>
 ByteStream<StreamBuf, TypeTraits, IsMutable>::ByteStream(
     StreamBuf_type* inStreamBuf)
-  : mStreamBuf(inStreamBuf), mDryRun(false) { }
+  : mStreamBuf(inStreamBuf), mDryRun(false), mAlignedPtr(NULL) { }
 
 template <class StreamBuf, template <class T> class TypeTraits, bool IsMutable>
 template <class T>
@@ -67,10 +67,14 @@ ByteStream<StreamBuf, TypeTraits, IsMutable>::seek(std::ptrdiff_t inOffset,
     BOOST_STATIC_ASSERT_MSG(
         (Alignment & (Alignment - 1)) == 0 && Alignment > 0,
         "Alignment must be a power of 2.");
-    madlib_assert(
-        reinterpret_cast<uint64_t>(this->ptr()) % Alignment == 0,
-        std::logic_error("ByteString improperly aligned for "
-            "alignment request in seek()."));
+    if (Alignment > maximumAlignment || this->ptr() != mAlignedPtr) {
+        madlib_assert(
+            reinterpret_cast<uint64_t>(this->ptr()) % Alignment == 0,
+            std::logic_error("ByteString improperly aligned for "
+                "alignment request in seek()."));
+        if (reinterpret_cast<uint64_t>(this->ptr()) % maximumAlignment == 0)
+            mAlignedPtr = this->ptr();
+    }
 
     size_t newPos =
         inDir == std::ios_base::beg
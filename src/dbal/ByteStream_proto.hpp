@@ -81,6 +81,16 @@ protected:
      *     other objects are not touched
      */
     int32_t mDryRun;
+
+    /**
+     * @brief Storage address that is known to be aligned on a
+     *     <tt>maximumAlignment</tt> boundary
+     *
+     * Each read verifies that the storage is properly aligned. Since the
+     * storage only moves if it is reallocated, we only need to do this check
+     * once per storage address.
+     */
+    const char_type* mAlignedPtr;
 };
 
 template <class StreamBuf, template <class T> class TypeTraits>
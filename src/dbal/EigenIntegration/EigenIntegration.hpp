@@ -23,9 +23,12 @@ namespace eigen_integration {
 typedef Eigen::VectorXd ColumnVector;
 typedef Eigen::RowVectorXd RowVector;
 typedef Eigen::MatrixXd Matrix;
+typedef Eigen::VectorXf FloatColumnVector;
+typedef Eigen::MatrixXf FloatMatrix;
 typedef EIGEN_DEFAULT_DENSE_INDEX_TYPE Index;
 
 typedef Eigen::SparseVector<double> SparseColumnVector;
+typedef Eigen::SparseMatrix<double, Eigen::ColMajor, int32_t> SparseMatrix;
 
 enum ViewMode {
     Lower = Eigen::Lower,
@@ -38,7 +41,9 @@ enum DecompositionOptions {
 };
 
 enum SPDDecompositionExtras {
-    ComputePseudoInverse = 0x01
+    ComputePseudoInverse = 0x01,
+    ComputeSolver = 0x02,
+    EstimateConditionNo = 0x04
 };
 
 // In the following we make several definitions that allow certain object
@@ -91,9 +96,11 @@ static isfinite(const Eigen::MatrixBase<Derived>& mat) {
 } // namespace madlib
 
 #include "HandleMap_proto.hpp"
+#include "SparseHandleMap_proto.hpp"
 #include "SymmetricPositiveDefiniteEigenDecomposition_proto.hpp"
 
 #include "HandleMap_impl.hpp"
+#include "SparseHandleMap_impl.hpp"
 #include "SymmetricPositiveDefiniteEigenDecomposition_impl.hpp"
 
 #endif // defined(MADLIB_EIGEN_INTEGRATION_HPP)
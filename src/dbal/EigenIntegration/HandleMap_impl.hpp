@@ -109,6 +109,34 @@ HandleMap<EigenType, Handle, MapOptions>::memoryHandle() const {
     return mMemoryHandle;
 }
 
+/**
+ * @brief Is the data aligned well enough for aligned()?
+ *
+ * Eigen requires 16-byte alignment for its aligned packet loads.
+ */
+template <class EigenType, class Handle, int MapOptions>
+inline
+bool
+HandleMap<EigenType, Handle, MapOptions>::isAligned() const {
+    return reinterpret_cast<uintptr_t>(this->data()) % 16 == 0;
+}
+
+/**
+ * @brief Return a map of the same data that tells Eigen the data is aligned
+ *
+ * Only call if isAligned() is true.
+ */
+template <class EigenType, class Handle, int MapOptions>
+inline
+typename HandleMap<EigenType, Handle, MapOptions>::AlignedMap
+HandleMap<EigenType, Handle, MapOptions>::aligned() const {
+    madlib_assert(isAligned(), std::logic_error("HandleMap::aligned() "
+        "called for unaligned data."));
+
+    return AlignedMap(const_cast<Scalar*>(this->data()), this->rows(),
+        this->cols());
+}
+
 } // namespace eigen_integration
 
 } // namespace dbal
@@ -15,6 +15,11 @@ namespace eigen_integration {
 
 /**
  * @brief Wrapper class for linear-algebra types based on Eigen
+ *
+ * The map type is fixed at compile time, and the data of the backend is not
+ * always aligned. By default, Eigen therefore has to use unaligned loads.
+ * Kernels can test isAligned() and then operate on aligned(), for which Eigen
+ * uses aligned loads.
  */
 template <class EigenType, class Handle, int MapOptions = Eigen::Unaligned>
 class HandleMap : public Eigen::Map<EigenType, MapOptions> {
@@ -22,6 +27,7 @@ public:
     typedef Eigen::Map<EigenType, MapOptions> Base;
     typedef typename Base::Scalar Scalar;
     typedef typename Base::Index Index;
+    typedef Eigen::Map<EigenType, Eigen::Aligned> AlignedMap;
 
     using Base::operator=;
 
@@ -83,6 +89,8 @@ public:
     HandleMap& rebind(Index inSize);
     HandleMap& rebind(Index inRows, Index inCols);
     const Handle &memoryHandle() const;
+    bool isAligned() const;
+    AlignedMap aligned() const;
 
 protected:
     Handle mMemoryHandle;
@@ -0,0 +1,162 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file SparseHandleMap_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_DBAL_EIGEN_SPARSEHANDLEMAP_IMPL_HPP
+#define MADLIB_DBAL_EIGEN_SPARSEHANDLEMAP_IMPL_HPP
+
+namespace madlib {
+
+namespace dbal {
+
+namespace eigen_integration {
+
+/**
+ * @brief Initialize SparseHandleMap backed by the given handle
+ *
+ * The handle needs to have ptr() and size() methods. The offsets and row
+ * indices are checked, because the byte string may come from the user. This
+ * takes time linear in the number of nonzeros, but no copy is made.
+ *
+ * @internal
+ *     The header is read before it is checked. The pointers passed to the
+ *     base class are not dereferenced before the size of the handle has been
+ *     verified.
+ */
+template <class Handle>
+inline
+SparseHandleMap<Handle>::SparseHandleMap(const Handle &inHandle)
+  : Base(header(inHandle, 0), header(inHandle, 1), header(inHandle, 2),
+        reinterpret_cast<StorageIndex*>(payload(inHandle,
+            kHeaderSize + sizeof(double)
+                * static_cast<std::size_t>(header(inHandle, 2)))),
+        reinterpret_cast<StorageIndex*>(payload(inHandle,
+            kHeaderSize + sizeof(double)
+                * static_cast<std::size_t>(header(inHandle, 2))
+            + sizeof(StorageIndex)
+                * (static_cast<std::size_t>(header(inHandle, 1)) + 1))),
+        reinterpret_cast<double*>(payload(inHandle, kHeaderSize))),
+    mMemoryHandle(inHandle) {
+
+    Index rows = header(inHandle, 0);
+    Index cols = header(inHandle, 1);
+    Index nnz = header(inHandle, 2);
+    if (inHandle.size() < static_cast<std::size_t>(kHeaderSize)
+        || rows < 0 || cols < 0 || nnz < 0
+        || inHandle.size() != storageSize(rows, cols, nnz))
+        throw std::invalid_argument("Invalid compressed sparse matrix: "
+            "Size does not match header.");
+
+    const StorageIndex *outer = reinterpret_cast<const StorageIndex*>(
+        payload(inHandle, kHeaderSize
+            + sizeof(double) * static_cast<std::size_t>(nnz)));
+    const StorageIndex *inner = outer + cols + 1;
+    if (outer[0] != 0 || outer[cols] != nnz)
+        throw std::invalid_argument("Invalid compressed sparse matrix: "
+            "Column offsets do not match the number of nonzeros.");
+    for (Index j = 0; j < cols; ++j) {
+        if (outer[j + 1] < outer[j])
+            throw std::invalid_argument("Invalid compressed sparse matrix: "
+                "Column offsets are not increasing.");
+        for (StorageIndex k = outer[j]; k < outer[j + 1]; ++k)
+            if (inner[k] < 0 || inner[k] >= rows
+                || (k > outer[j] && inner[k] <= inner[k - 1]))
+                throw std::invalid_argument("Invalid compressed sparse "
+                    "matrix: Row indices out of range or not increasing.");
+    }
+}
+
+/**
+ * @brief Return the size of the byte string for the given dimensions
+ */
+template <class Handle>
+inline
+std::size_t
+SparseHandleMap<Handle>::storageSize(Index inRows, Index inCols,
+    Index inNNZ) {
+
+    (void) inRows;
+    return kHeaderSize
+        + static_cast<std::size_t>(inNNZ)
+            * (sizeof(double) + sizeof(StorageIndex))
+        + (static_cast<std::size_t>(inCols) + 1) * sizeof(StorageIndex);
+}
+
+/**
+ * @brief Return the Handle that backs this SparseHandleMap.
+ */
+template <class Handle>
+inline
+const Handle&
+SparseHandleMap<Handle>::memoryHandle() const {
+    return mMemoryHandle;
+}
+
+/**
+ * @brief Return a field of the header, or 0 if the handle is too small
+ */
+template <class Handle>
+inline
+int32_t
+SparseHandleMap<Handle>::header(const Handle &inHandle, int inField) {
+    if (inHandle.size() < static_cast<std::size_t>(kHeaderSize))
+        return 0;
+
+    int32_t value;
+    std::memcpy(&value, inHandle.ptr() + inField * sizeof(int32_t),
+        sizeof(int32_t));
+    return value;
+}
+
+template <class Handle>
+inline
+char *
+SparseHandleMap<Handle>::payload(const Handle &inHandle,
+    std::size_t inOffset) {
+
+    return const_cast<char*>(reinterpret_cast<const char*>(inHandle.ptr()))
+        + inOffset;
+}
+
+template <class SparseMatrixType>
+inline
+void
+writeCompressedSparseMatrix(const SparseMatrixType &inMatrix,
+    char *outStorage) {
+
+    typedef typename SparseMatrixType::Index Index;
+
+    int32_t header[4] = {
+        static_cast<int32_t>(inMatrix.rows()),
+        static_cast<int32_t>(inMatrix.cols()),
+        static_cast<int32_t>(inMatrix.nonZeros()),
+        0
+    };
+    std::memcpy(outStorage, header, sizeof(header));
+
+    double *values = reinterpret_cast<double*>(outStorage + sizeof(header));
+    int32_t *outer = reinterpret_cast<int32_t*>(values + inMatrix.nonZeros());
+    int32_t *inner = outer + inMatrix.cols() + 1;
+
+    int32_t pos = 0;
+    for (Index j = 0; j < inMatrix.cols(); ++j) {
+        outer[j] = pos;
+        for (typename SparseMatrixType::InnerIterator it(inMatrix, j); it;
+            ++it, ++pos) {
+
+            values[pos] = it.value();
+            inner[pos] = static_cast<int32_t>(it.row());
+        }
+    }
+    outer[inMatrix.cols()] = pos;
+}
+
+} // namespace eigen_integration
+
+} // namespace dbal
+
+} // namespace madlib
+
+#endif // defined(MADLIB_DBAL_EIGEN_SPARSEHANDLEMAP_IMPL_HPP)
@@ -0,0 +1,73 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file SparseHandleMap_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_DBAL_EIGEN_SPARSEHANDLEMAP_PROTO_HPP
+#define MADLIB_DBAL_EIGEN_SPARSEHANDLEMAP_PROTO_HPP
+
+namespace madlib {
+
+namespace dbal {
+
+namespace eigen_integration {
+
+/**
+ * @brief Sparse matrix in compressed-column format, mapped onto the memory of
+ *     a byte-string handle without copying
+ *
+ * The layout of the byte string is:
+ * - Header: number of rows, number of columns, number of nonzeros, and a
+ *   reserved 0, each as int32
+ * - The nonzero values (double), column by column
+ * - The (number of columns + 1) offsets (int32) of the columns into the values
+ * - The 0-based row index (int32) of every value, increasing within each
+ *   column
+ *
+ * The values come directly after the header, so they are aligned if the
+ * handle is aligned to 8 bytes. As the database represents a matrix as an
+ * array of columns, each column is a row of the matrix in the database, i.e.,
+ * in database terms the format is compressed sparse rows (CSR). A sparse
+ * vector is a matrix with one column.
+ */
+template <class Handle>
+class SparseHandleMap
+  : public Eigen::MappedSparseMatrix<double, Eigen::ColMajor, int32_t> {
+
+public:
+    typedef Eigen::MappedSparseMatrix<double, Eigen::ColMajor, int32_t> Base;
+    typedef int32_t StorageIndex;
+
+    enum { kHeaderSize = 4 * sizeof(int32_t) };
+
+    SparseHandleMap(const Handle &inHandle);
+
+    static std::size_t storageSize(Index inRows, Index inCols, Index inNNZ);
+    const Handle &memoryHandle() const;
+
+protected:
+    static int32_t header(const Handle &inHandle, int inField);
+    static char *payload(const Handle &inHandle, std::size_t inOffset);
+
+    Handle mMemoryHandle;
+};
+
+/**
+ * @brief Write a sparse matrix into memory in the format of SparseHandleMap
+ *
+ * @param inMatrix The sparse matrix
+ * @param outStorage Memory of at least
+ *     SparseHandleMap<Handle>::storageSize() bytes
+ */
+template <class SparseMatrixType>
+void writeCompressedSparseMatrix(const SparseMatrixType &inMatrix,
+    char *outStorage);
+
+} // namespace eigen_integration
+
+} // namespace dbal
+
+} // namespace madlib
+
+#endif // defined(MADLIB_DBAL_EIGEN_SPARSEHANDLEMAP_PROTO_HPP)
@@ -29,8 +29,11 @@ inline
 SymmetricPositiveDefiniteEigenDecomposition<MatrixType>
     ::SymmetricPositiveDefiniteEigenDecomposition(
     const MatrixType &inMatrix, int inOptions, int inExtras)
-  : Base(inMatrix, inOptions) {
+  : Base(inMatrix.rows()), mUseLDLT(false), mLDLTComputed(false),
+    mConditionNoEstimated(false), mEstimatedConditionNo(0) {
 
+    if (!(inExtras & EstimateConditionNo) || !estimateConditionNo(inMatrix))
+        Base::compute(inMatrix, inOptions);
     computeExtras(inMatrix, inExtras);
 }
 
@@ -48,6 +51,9 @@ double
 SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::conditionNo()
     const {
 
+    if (mConditionNoEstimated)
+        return mEstimatedConditionNo;
+
     const RealVectorType& ev = eigenvalues();
 
     double numerator = ev(ev.size() - 1);
@@ -77,6 +83,310 @@ SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::pseudoInverse() const {
     return mPinv;
 }
 
+namespace {
+
+/**
+ * @brief Smallest matrix dimension for which computeExtras() uses parallelFor()
+ *
+ * For smaller matrices, the cost of starting threads outweighs the gain.
+ */
+enum { kMinParallelSize = 256 };
+
+/**
+ * @brief Largest condition number for which computeExtras() uses an
+ *     \f$ L D L^T \f$ decomposition instead of the eigen decomposition
+ */
+enum { kMaxLDLTConditionNo = 1000 };
+
+/**
+ * @brief Maximum number of Lanczos steps taken by estimateConditionNo()
+ */
+enum { kMaxLanczosSteps = 20 };
+
+/**
+ * @brief Product with the lower triangle of a symmetric matrix
+ */
+template <class MatrixType>
+struct SelfAdjointProductOperator {
+    SelfAdjointProductOperator(const MatrixType& inMatrix)
+      : matrix(inMatrix) { }
+
+    template <class VectorType, class ResultType>
+    void apply(const VectorType& inVector, ResultType& outResult) const {
+        outResult.noalias() = matrix.template selfadjointView<Eigen::Lower>()
+            * inVector;
+    }
+
+    const MatrixType& matrix;
+};
+
+/**
+ * @brief Product with the inverse of a matrix, given a solver
+ */
+template <class SolverType>
+struct SolveOperator {
+    SolveOperator(const SolverType& inSolver)
+      : solver(inSolver) { }
+
+    template <class VectorType, class ResultType>
+    void apply(const VectorType& inVector, ResultType& outResult) const {
+        outResult = solver.solve(inVector);
+    }
+
+    const SolverType& solver;
+};
+
+/**
+ * @brief Estimate the largest eigenvalue of a symmetric positive
+ *     semi-definite operator with the Lanczos method
+ *
+ * We take at most kMaxLanczosSteps steps, with full reorthogonalization. The
+ * result is the largest Ritz value, which is a lower bound on the largest
+ * eigenvalue. It is exact (up to rounding) if the Krylov space is exhausted,
+ * in particular if the dimension is at most kMaxLanczosSteps. Each step costs
+ * one application of the operator, plus \f$ O(kn) \f$ operations for the
+ * reorthogonalization in step \f$ k \f$.
+ */
+template <class MatrixType, class OperatorType>
+inline
+double
+lanczosLargestEigenvalue(const OperatorType& inOperator, Index inSize) {
+    typedef typename MatrixType::Scalar Scalar;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorType;
+
+    Index maxSteps = std::min(inSize, static_cast<Index>(kMaxLanczosSteps));
+    MatrixType basis(inSize, maxSteps);
+    MatrixType tridiagonal = MatrixType::Zero(maxSteps, maxSteps);
+    VectorType w(inSize);
+    Scalar norm = 0;
+
+    // A fixed start vector, so that results are reproducible. It is not
+    // orthogonal to any eigenvector in practice.
+    for (Index i = 0; i < inSize; ++i)
+        basis(i, 0) = Scalar(1) / static_cast<Scalar>(i + 1);
+    basis.col(0).normalize();
+
+    Index steps = 0;
+    while (steps < maxSteps) {
+        inOperator.apply(basis.col(steps), w);
+
+        // Classical Gram-Schmidt, done twice
+        for (int pass = 0; pass < 2; ++pass) {
+            VectorType projection
+                = basis.leftCols(steps + 1).transpose() * w;
+            w.noalias() -= basis.leftCols(steps + 1) * projection;
+            tridiagonal(steps, steps) += projection(steps);
+        }
+        Scalar beta = w.norm();
+        norm = std::max(norm, std::abs(tridiagonal(steps, steps)) + beta);
+        if (++steps == maxSteps
+            || beta <= norm * std::numeric_limits<Scalar>::epsilon())
+            break;
+
+        tridiagonal(steps, steps - 1) = beta;
+        basis.col(steps) = w / beta;
+    }
+
+    Eigen::SelfAdjointEigenSolver<MatrixType> ritz(
+        tridiagonal.topLeftCorner(steps, steps), Eigen::EigenvaluesOnly);
+    return ritz.eigenvalues()(steps - 1);
+}
+
+/**
+ * @brief Solve for blocks of columns of the identity matrix, given an
+ *     \f$ L D L^T \f$ decomposition
+ */
+template <class MatrixType, class SolverType>
+struct SolveIdentityColumnsTask : public ParallelTask {
+    SolveIdentityColumnsTask(const SolverType& inSolver, MatrixType& outResult)
+      : solver(inSolver), result(outResult) { }
+
+    void run(size_t inBegin, size_t inEnd) {
+        Index rows = result.rows();
+        Index numCols = static_cast<Index>(inEnd - inBegin);
+        result.middleCols(inBegin, numCols) = solver.solve(
+            MatrixType::Identity(rows, result.cols())
+                .middleCols(inBegin, numCols));
+    }
+
+    const SolverType& solver;
+    MatrixType& result;
+};
+
+/**
+ * @brief Compute blocks of columns of the product \f$ A B^T \f$
+ */
+template <class MatrixType>
+struct ProductTransposeColumnsTask : public ParallelTask {
+    ProductTransposeColumnsTask(const MatrixType& inLeft,
+        const MatrixType& inRight, MatrixType& outResult)
+      : left(inLeft), right(inRight), result(outResult) { }
+
+    void run(size_t inBegin, size_t inEnd) {
+        Index numCols = static_cast<Index>(inEnd - inBegin);
+        result.middleCols(inBegin, numCols).noalias()
+            = left * right.middleRows(inBegin, numCols).transpose();
+    }
+
+    const MatrixType& left;
+    const MatrixType& right;
+    MatrixType& result;
+};
+
+/**
+ * @brief Compute a range of the diagonal of the inverse, given an
+ *     \f$ L D L^T \f$ decomposition
+ *
+ * With \f$ P A P^T = L D L^T \f$, the \f$ i \f$-th diagonal element of
+ * \f$ A^{-1} \f$ is \f$ \sum_k y_k^2 / d_k \f$ where \f$ y = L^{-1} P e_i
+ * \f$. This takes one triangular solve per element, instead of the two needed
+ * for a column of the full inverse.
+ */
+template <class MatrixType, class SolverType>
+struct InverseDiagonalTask : public ParallelTask {
+    typedef typename SolverType::Scalar Scalar;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorType;
+
+    InverseDiagonalTask(const SolverType& inSolver, VectorType& outResult)
+      : solver(inSolver), result(outResult) { }
+
+    void run(size_t inBegin, size_t inEnd) {
+        Index rows = result.size();
+        Index numCols = static_cast<Index>(inEnd - inBegin);
+        MatrixType block = solver.transpositionsP()
+            * MatrixType::Identity(rows, rows).middleCols(inBegin, numCols);
+        solver.matrixL().solveInPlace(block);
+        for (Index j = 0; j < numCols; ++j)
+            result(inBegin + j) = block.col(j).cwiseAbs2()
+                .cwiseQuotient(solver.vectorD()).sum();
+    }
+
+    const SolverType& solver;
+    VectorType& result;
+};
+
+} // anonymous namespace
+
+/**
+ * @brief Return the diagonal of the pseudo inverse previously computed using
+ *     computeExtras().
+ *
+ * The result of this function is undefined if computeExtras() has not been
+ * called or the solver was not set to be computed.
+ */
+template <class MatrixType>
+inline
+const typename SymmetricPositiveDefiniteEigenDecomposition<MatrixType>
+    ::RealVectorType&
+SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::pseudoInverseDiagonal()
+    const {
+
+    return mPinvDiagonal;
+}
+
+/**
+ * @brief Return the product of the pseudo inverse and a vector
+ *
+ * If the matrix is well-conditioned, this uses the \f$ L D L^T \f$
+ * decomposition computed by computeExtras(). Otherwise it uses the eigen
+ * decomposition, i.e., it returns \f$ V D^+ V^T b \f$. In both cases, the
+ * cost is quadratic in the size of the matrix. The result of this function
+ * is undefined if computeExtras() has not been called or the solver was not
+ * set to be computed.
+ */
+template <class MatrixType>
+template <class RhsType>
+inline
+typename SymmetricPositiveDefiniteEigenDecomposition<MatrixType>
+    ::RealVectorType
+SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::solve(
+    const Eigen::MatrixBase<RhsType>& inRhs) const {
+
+    if (mUseLDLT)
+        return mLDLT.solve(inRhs);
+
+    RealVectorType scaled = Base::eigenvectors().transpose() * inRhs;
+    scaled = scaled.cwiseProduct(mInvertedEigenvalues);
+    return Base::eigenvectors() * scaled;
+}
+
+/**
+ * @brief Return the reciprocals of the eigenvalues, with zero for all
+ *     eigenvalues that are numerically zero
+ */
+template <class MatrixType>
+inline
+typename SymmetricPositiveDefiniteEigenDecomposition<MatrixType>
+    ::RealVectorType
+SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::invertedEigenvalues()
+    const {
+
+    const RealVectorType& ev = eigenvalues();
+
+    // The eigenvalue are sorted in increasing order
+    Scalar epsilon = static_cast<double>(ev.size())
+                   * ev(ev.size() - 1)
+                   * std::numeric_limits<Scalar>::epsilon();
+
+    RealVectorType inverted(ev.size());
+    for (Index i = 0; i < static_cast<Index>(ev.size()); ++i) {
+        inverted(i) = ev(i) < epsilon
+                    ? Scalar(0)
+                    : Scalar(1) / ev(i);
+    }
+    return inverted;
+}
+
+/**
+ * @brief Estimate the condition number from an \f$ L D L^T \f$ decomposition
+ *
+ * The condition number is estimated as the product of the largest eigenvalues
+ * of the matrix and of its inverse. Both are estimated with a few steps of
+ * the Lanczos method (see lanczosLargestEigenvalue()), where the inverse is
+ * applied with the \f$ L D L^T \f$ decomposition. This takes
+ * \f$ O(n^2) \f$ operations per step, which is much cheaper than the
+ * \f$ O(n^3) \f$ eigen decomposition. Since the estimates of both
+ * eigenvalues are lower bounds, so is the estimate of the condition number.
+ *
+ * The entries of \f$ D \f$ are diagonal entries of Schur complements, so
+ * they lie between the smallest and the largest eigenvalue. Their ratio is
+ * therefore another lower bound, which comes for free: If it is too large
+ * (in particular, if the matrix is numerically rank deficient and the
+ * smallest entry is close to zero), we skip the Lanczos steps.
+ *
+ * @return Whether the estimate is less than kMaxLDLTConditionNo, so that the
+ *     eigen decomposition is not needed
+ */
+template <class MatrixType>
+inline
+bool
+SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::estimateConditionNo(
+    const MatrixType &inMatrix) {
+
+    Index size = inMatrix.rows();
+    if (size == 0)
+        return false;
+
+    mLDLT.compute(inMatrix);
+    mLDLTComputed = true;
+
+    RealVectorType d = mLDLT.vectorD();
+    if (!(d.minCoeff() * kMaxLDLTConditionNo > d.maxCoeff()))
+        return false;
+
+    double largest = lanczosLargestEigenvalue<MatrixType>(
+        SelfAdjointProductOperator<MatrixType>(inMatrix), size);
+    double largestOfInverse = lanczosLargestEigenvalue<MatrixType>(
+        SolveOperator<LDLTType>(mLDLT), size);
+    double estimate = largest * largestOfInverse;
+    if (!(estimate < kMaxLDLTConditionNo))
+        return false;
+
+    mEstimatedConditionNo = estimate;
+    mConditionNoEstimated = true;
+    return true;
+}
+
 /**
  * @brief Perform extra computations after the decomposition
  *
@@ -106,6 +416,18 @@ SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::pseudoInverse() const {
  *
  * Only the <b>lower triangular part</b> of the input matrix
  * is referenced.
+ *
+ * For matrices with at least kMinParallelSize rows, the columns of the
+ * pseudo-inverse are computed in blocks with parallelFor(). The decomposition
+ * itself remains sequential.
+ *
+ * With ComputeSolver, no pseudo-inverse is formed. Instead, solve() and
+ * pseudoInverseDiagonal() are prepared: If the condition number is less than
+ * 1000, using an \f$ L D L^T \f$ decomposition, and otherwise using the
+ * eigenvectors.
+ *
+ * With EstimateConditionNo, the \f$ L D L^T \f$ decomposition computed by
+ * estimateConditionNo() is reused.
  */
 template <class MatrixType>
 inline
@@ -113,36 +435,66 @@ void
 SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::computeExtras(
     const MatrixType &inMatrix, int inExtras) {
 
+    if ((inExtras & (ComputePseudoInverse | ComputeSolver))
+        && conditionNo() < kMaxLDLTConditionNo && !mLDLTComputed) {
+
+        // We are doing a Cholesky decomposition of a matrix with
+        // pivoting. This is faster than the PartialPivLU that
+        // Eigen's inverse() method would use
+        mLDLT.compute(inMatrix);
+        mLDLTComputed = true;
+    }
+
     if (inExtras & ComputePseudoInverse) {
         mPinv.resize(inMatrix.rows(), inMatrix.cols());
 
-        // FIXME: No hard-coded constant here
-        if (conditionNo() < 1000) {
-            // We are doing a Cholesky decomposition of a matrix with
-            // pivoting. This is faster than the PartialPivLU that
-            // Eigen's inverse() method would use
-            mPinv = inMatrix.template selfadjointView<Eigen::Lower>().ldlt()
-                .solve(MatrixType::Identity(inMatrix.rows(), inMatrix.cols()));
+        if (conditionNo() < kMaxLDLTConditionNo) {
+            if (inMatrix.rows() < kMinParallelSize) {
+                mPinv = mLDLT.solve(MatrixType::Identity(inMatrix.rows(),
+                    inMatrix.cols()));
+            } else {
+                SolveIdentityColumnsTask<MatrixType, LDLTType> task(
+                    mLDLT, mPinv);
+                parallelFor(task, mPinv.cols(), kMinParallelSize / 4);
+            }
         } else {
             if (!Base::m_eigenvectorsOk)
                 Base::compute(inMatrix, Eigen::ComputeEigenvectors);
 
-            const RealVectorType& ev = eigenvalues();
+            RealVectorType eigenvectorsInverted = invertedEigenvalues();
+            if (inMatrix.rows() < kMinParallelSize) {
+                mPinv = Base::eigenvectors()
+                      * eigenvectorsInverted.asDiagonal()
+                      * Base::eigenvectors().transpose();
+            } else {
+                MatrixType scaledEigenvectors = Base::eigenvectors()
+                    * eigenvectorsInverted.asDiagonal();
+                ProductTransposeColumnsTask<MatrixType> task(
+                    scaledEigenvectors, Base::eigenvectors(), mPinv);
+                parallelFor(task, mPinv.cols(), kMinParallelSize / 4);
+            }
+        }
+    }
 
-            // The eigenvalue are sorted in increasing order
-            Scalar epsilon = static_cast<double>(inMatrix.rows())
-                           * ev(ev.size() - 1)
-                           * std::numeric_limits<Scalar>::epsilon();
+    if (inExtras & ComputeSolver) {
+        mUseLDLT = conditionNo() < kMaxLDLTConditionNo;
+        mPinvDiagonal.resize(inMatrix.rows());
 
-            RealVectorType eigenvectorsInverted(ev.size());
-            for (Index i = 0; i < static_cast<Index>(ev.size()); ++i) {
-                eigenvectorsInverted(i) = ev(i) < epsilon
-                                        ? Scalar(0)
-                                        : Scalar(1) / ev(i);
-            }
-            mPinv = Base::eigenvectors()
-                  * eigenvectorsInverted.asDiagonal()
-                  * Base::eigenvectors().transpose();
+        if (mUseLDLT) {
+            InverseDiagonalTask<MatrixType, LDLTType> task(mLDLT,
+                mPinvDiagonal);
+            if (inMatrix.rows() < kMinParallelSize)
+                task.run(0, inMatrix.rows());
+            else
+                parallelFor(task, inMatrix.rows(), kMinParallelSize / 4);
+        } else {
+            if (!Base::m_eigenvectorsOk)
+                Base::compute(inMatrix, Eigen::ComputeEigenvectors);
+
+            // diag(V D^+ V^T)_i = sum_k V_ik^2 / d_k
+            mInvertedEigenvalues = invertedEigenvalues();
+            mPinvDiagonal.noalias() = Base::eigenvectors().cwiseAbs2()
+                * mInvertedEigenvalues;
         }
     }
 }
@@ -21,6 +21,13 @@ namespace eigen_integration {
  * semi-definite if all its eigenvalues are non-negative. This class
  * computes the eigenvalues, the eigenvectors, and the Moore-Penrose
  * pseudo-inverse of a symmetric positive semi-definite matrix.
+ *
+ * With the extra EstimateConditionNo, the eigen decomposition is only
+ * computed if an \f$ L D L^T \f$ decomposition and a cheap estimate of the
+ * condition number indicate that the matrix is ill-conditioned. Otherwise,
+ * only conditionNo(), pseudoInverse(), pseudoInverseDiagonal(), and solve()
+ * may be called (depending on the other extras), and conditionNo() returns
+ * the estimate.
  */
 template <class MatrixType>
 class SymmetricPositiveDefiniteEigenDecomposition
@@ -40,11 +47,27 @@ public:
     double conditionNo() const;
     
     const MatrixType &pseudoInverse() const;
+
+    const RealVectorType &pseudoInverseDiagonal() const;
+
+    template <class RhsType>
+    RealVectorType solve(const Eigen::MatrixBase<RhsType>& inRhs) const;
     
 protected:
+    typedef Eigen::LDLT<MatrixType, Eigen::Lower> LDLTType;
+
+    bool estimateConditionNo(const MatrixType &inMatrix);
     void computeExtras(const MatrixType &inMatrix, int inExtras);
+    RealVectorType invertedEigenvalues() const;
     
     MatrixType mPinv;
+    RealVectorType mPinvDiagonal;
+    RealVectorType mInvertedEigenvalues;
+    LDLTType mLDLT;
+    bool mUseLDLT;
+    bool mLDLTComputed;
+    bool mConditionNoEstimated;
+    double mEstimatedConditionNo;
 };
 
 } // namespace eigen_integration
@@ -42,10 +42,16 @@ enum Mutability {
  * An implementation may choose to perform an allocation in a specific aggregate
  * context if the memory needs to live longer than the current function call.
  * It should be used, e.g., when allocating transition states.
+ *
+ * \c ScratchContext is for temporaries that are not needed any more once the
+ * current call into the AL returns (and that must not be returned to the
+ * backend). Allocation is cheap, deallocation is a no-op, and all memory is
+ * reclaimed at once when the call returns.
  */
 enum MemoryContext {
     FunctionContext,
-    AggregateContext
+    AggregateContext,
+    ScratchContext
 };
 
 enum ZeroMemory {
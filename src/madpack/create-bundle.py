@@ -0,0 +1,65 @@
+#!/usr/bin/python
+
+"""
+create-bundle.py
+
+Pre-render the SQL files of all modules of a port version into one script (the
+bundle), in the order in which madpack would run them. "madpack install
+--bundle" then only has to fill in the installation-specific values and can
+apply the whole bundle in a single transaction, instead of running m4 and
+psql once per file.
+
+The values only known at installation time are left as placeholders:
+@madlib_schema@, @plpython_libdir@, and @module_pathname_<module>@ (the
+library of the module, see MADLIB_MODULE_LIBRARIES). They must not contain the
+names of the m4 macros, which m4 would expand again. Example:
+
+  $ create-bundle.py build/src/config m4 POSTGRES \\
+        build/src/ports/postgres/9.1/madpack build/src/ports/postgres/modules \\
+        build/src/ports/postgres/9.1/madpack/madlib_bundle.sql
+"""
+
+import glob
+import os
+import subprocess
+import sys
+
+import configyml
+
+def main(args):
+    if len(args) != 6:
+        print __doc__
+        sys.exit(1)
+    (maddir_conf, m4, portid_uc, maddir_madpack, maddir_mod_sql, outfile) = args
+    portspecs = configyml.get_modules(maddir_conf)
+
+    out = open(outfile, 'w')
+    for moduleinfo in portspecs['modules']:
+        module = moduleinfo['name']
+
+        # Platform-specific modules without a directory for this port are
+        # skipped, as by madpack
+        if not os.path.isdir(maddir_mod_sql + '/' + module):
+            continue
+
+        for sqlfile in sorted(glob.glob(maddir_mod_sql + '/' + module + '/*.sql_in')):
+            out.write('\n-- Module %s: %s\n' % (module, os.path.basename(sqlfile)))
+            out.flush()
+            m4args = [ m4,
+                        '-P',
+                        '-DMADLIB_SCHEMA=@madlib_schema@',
+                        '-DPLPYTHON_LIBDIR=@plpython_libdir@',
+                        '-DMODULE_PATHNAME=@module_pathname_' + module + '@',
+                        '-DMODULE_NAME=' + module,
+                        '-I' + maddir_madpack,
+                        '-D' + portid_uc,
+                        sqlfile ]
+            if subprocess.call(m4args, stdout=out) != 0:
+                out.close()
+                os.remove(outfile)
+                print "ERROR: Failed executing m4 on %s" % sqlfile
+                sys.exit(1)
+    out.close()
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
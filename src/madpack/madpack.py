@@ -56,6 +56,7 @@ dbconn = None       # DB Connection object
 dbver = None        # DB version
 con_args = {}       # DB connection arguments
 verbose = None      # Verbose flag
+use_bundle = None   # Install from pre-rendered SQL bundle
 
 ## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
 # Create a temp dir 
@@ -154,6 +155,19 @@ def __run_sql_query(sql, show_error):
     
     return results
 
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Get the shared library of a module
+# @param module name of the module
+# Returns the library of this module if MADlib was built with
+# MADLIB_MODULE_LIBRARIES, and the library with all modules otherwise
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+def __get_module_pathname(module):
+    modlib = os.path.join(os.path.dirname(maddir_lib),
+        'libmadlib_' + module + '.so')
+    if os.path.isfile(modlib):
+        return modlib
+    return maddir_lib
+
 ## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
 # Run SQL file
 # @param schema name of the target schema  
@@ -190,7 +204,7 @@ def __run_sql_file(schema, maddir_mod_py, module, sqlfile, tmpfile, logfile, pre
                     '-P', 
                     '-DMADLIB_SCHEMA=' + schema, 
                     '-DPLPYTHON_LIBDIR=' + maddir_mod_py, 
-                    '-DMODULE_PATHNAME=' + maddir_lib, 
+                    '-DMODULE_PATHNAME=' + __get_module_pathname(module), 
                     '-DMODULE_NAME=' + module, 
                     '-I' + maddir_madpack,
                     '-D' + portid.upper(), 
@@ -204,6 +218,49 @@ def __run_sql_file(schema, maddir_mod_py, module, sqlfile, tmpfile, logfile, pre
         __error("Failed executing m4 on %s" % sqlfile, False)
         raise Exception
 
+    return __run_psql_file(tmpfile, logfile, False)
+
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Run pre-rendered SQL bundle (see create-bundle.py) in a single transaction
+# @param schema name of the target schema
+# @param maddir_mod_py name of the module dir with Python code
+# @param bundlefile name of the bundle
+# @param tmpfile name of the temp file to run
+# @param logfile name of the log file (stdout)
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+def __run_sql_bundle(schema, maddir_mod_py, bundlefile, tmpfile, logfile):
+
+    # Check if the bundle exists
+    if not os.path.isfile(bundlefile):
+        __error("Missing SQL bundle (%s). Install without --bundle." % bundlefile, False)
+        raise Exception
+
+    # Fill in the placeholders
+    try:
+        f = open(bundlefile, 'r')
+        sql = f.read()
+        f.close()
+        sql = sql.replace('@madlib_schema@', schema) \
+                 .replace('@plpython_libdir@', maddir_mod_py)
+        sql = re.sub(r'@module_pathname_(\w+)@',
+                     lambda m: __get_module_pathname(m.group(1)), sql)
+        f = open(tmpfile, 'w')
+        f.write(sql)
+        f.close()
+    except:
+        __error("Failed preparing %s" % bundlefile, False)
+        raise Exception
+
+    return __run_psql_file(tmpfile, logfile, True)
+
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+# Run SQL file using DB command-line utility
+# @param tmpfile name of the file to run
+# @param logfile name of the log file (stdout)
+# @param single_transaction run the whole file in one transaction?
+## # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+def __run_psql_file(tmpfile, logfile, single_transaction):
+
     # Run the SQL using DB command-line utility
     if portid == 'greenplum' or portid == 'postgres':
 
@@ -222,6 +279,8 @@ def __run_sql_file(schema, maddir_mod_py, module, sqlfile, tmpfile, logfile, pre
                     '-d', con_args['database'],
                     '-U', con_args['user'],
                     '-f', tmpfile]
+        if single_transaction:
+            runcmd.insert(1, '--single-transaction')
         runenv = os.environ
         runenv["PGPASSWORD"] = con_args['password']
         
@@ -546,6 +605,21 @@ def __db_create_objects(schema, old_schema):
         __error("Cannot insert data into %s.migrationhistory table" % schema, False)
         raise Exception
     
+    # Run the pre-rendered bundle instead of the migration SQLs of all modules
+    if use_bundle:
+        __info("> Creating objects for all modules from SQL bundle", True)
+        maddir_madpack = maddir + "/ports/" + portid + "/" + dbver + "/madpack"
+        maddir_mod_py = maddir + "/ports/" + portid + "/" + dbver + "/modules"
+        tmpfile = tmpdir + '/madlib_bundle.sql.tmp'
+        logfile = tmpdir + '/madlib_bundle.sql.log'
+        retval = __run_sql_bundle(schema, maddir_mod_py,
+            maddir_madpack + '/madlib_bundle.sql', tmpfile, logfile)
+        if retval != 0:
+            __error("Failed executing %s" % tmpfile, False)
+            __error("Check the log at %s" % logfile, False)
+            raise Exception
+        return
+
     # Run migration SQLs    
     __info("> Creating objects for modules:", True)  
     
@@ -720,6 +794,11 @@ def main(argv):
     parser.add_argument('-d', '--tmpdir', dest='tmpdir', default = '/tmp/',
                          help="Temporary directory location for installation log files.")
 
+    parser.add_argument('-b', '--bundle', dest='bundle', default=False,
+                         action="store_true",
+                         help="Install/update from the SQL bundle pre-rendered at build time,\n"
+                            + "in a single transaction and database session.")
+
     parser.add_argument('-t', '--testcase', dest='testcase', default="",
                          help="Module names to test, comma separated. Effective only for install-check.")
 
@@ -732,6 +811,8 @@ def main(argv):
     __info("Arguments: " + str(args), verbose);    
     global keeplogs
     keeplogs = args.keeplogs
+    global use_bundle
+    use_bundle = args.bundle
 
     global tmpdir
     try:
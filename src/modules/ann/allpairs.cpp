@@ -0,0 +1,494 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file allpairs.cpp
+ *
+ * @brief All-pairs similarity join of sparse vectors
+ *
+ * Finds all pairs of sparse vectors whose cosine or Tanimoto similarity is at
+ * least a given threshold, without comparing every pair. We follow the
+ * AllPairs algorithm of Bayardo et al. (2007) with the L2-norm bound of
+ * Anastasiu and Karypis (2014):
+ *
+ * Let \f$ t \f$ be the cosine threshold and let all vectors be normalized.
+ * Features are ordered by decreasing frequency. For each vector \f$ y \f$, the
+ * longest prefix \f$ U(y) \f$ (in feature order) with \f$ \|U(y)\| < t \f$ is
+ * left out of the inverted index; only the remaining features \f$ I(y) \f$
+ * are indexed. By Cauchy-Schwarz, \f$ x \cdot U(y) \leq \|U(y)\| < t \f$, so
+ * any \f$ x \f$ with \f$ x \cdot y \geq t \f$ shares an indexed feature with
+ * \f$ y \f$ and is found by probing the inverted index. A candidate is
+ * verified exactly only if the partial dot product accumulated from the index
+ * plus \f$ \|U(y)\| \f$ reaches \f$ t \f$. Since the most frequent features
+ * are never indexed, the inverted lists stay short.
+ *
+ * A Tanimoto similarity of at least \f$ t \f$ implies a cosine similarity of
+ * at least \f$ 2t / (1 + t) \f$, which is used as candidate threshold.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "allpairs.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace ann {
+
+namespace {
+
+/**
+ * @brief Ids are stored in DOUBLE PRECISION arrays, so they must be exactly
+ *     representable as doubles
+ */
+const int64_t kMaxExactId = static_cast<int64_t>(1) << 53;
+
+double
+idToDouble(int64_t inId) {
+    if (inId > kMaxExactId || inId < -kMaxExactId)
+        throw std::invalid_argument("Ids in a similarity join must not exceed "
+            "2^53 in absolute value.");
+    return static_cast<double>(inId);
+}
+
+enum SimilarityMetric {
+    kCosine = 1,
+    kTanimoto = 2
+};
+
+/**
+ * @brief Slack for rounding errors in the filters. The filters may only let
+ *     through more candidates than necessary, never fewer.
+ */
+const double kFilterSlack = 1e-9;
+
+} // anonymous namespace
+
+/**
+ * @brief Transition state for collecting the vectors of a similarity join
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * threshold, metric, dimension, numVectors, used, capacity, followed by the
+ * vectors. Each vector takes 2 + 2 * nnz elements: id, nnz, and the nnz
+ * (index, value) pairs of its nonzero elements. The first used elements of
+ * the capacity elements after the header are taken.
+ *
+ * The state grows geometrically: Whenever it is full, it is copied into an
+ * array of twice the capacity.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 6, and all elements are 0.
+ */
+template <class Handle>
+class AllPairsState {
+    template <class OtherHandle>
+    friend class AllPairsState;
+
+public:
+    AllPairsState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint64_t>(mStorage[5]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, double inThreshold,
+        SimilarityMetric inMetric, uint32_t inDimension, uint64_t inCapacity) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(kHeaderSize + inCapacity);
+        rebind(inCapacity);
+        threshold = inThreshold;
+        metric = static_cast<uint32_t>(inMetric);
+        dimension = inDimension;
+        capacity = inCapacity;
+    }
+
+    bool isInitialized() const {
+        return dimension > 0;
+    }
+
+    /**
+     * @brief Check that the parameters agree with those of the first row
+     */
+    void checkParameters(double inThreshold, uint32_t inMetric,
+        uint32_t inDimension) const {
+
+        if (inThreshold != threshold || inMetric != metric)
+            throw std::invalid_argument("Similarity threshold must be the "
+                "same in all rows.");
+        if (inDimension != dimension)
+            throw std::invalid_argument("Vectors in a similarity join must all "
+                "have the same dimension.");
+    }
+
+    /**
+     * @brief Add a vector, growing the state if necessary
+     */
+    void add(const Allocator &inAllocator, double inId,
+        const SparseColumnVector &inX) {
+
+        uint64_t nnz = static_cast<uint64_t>(inX.nonZeros());
+        reserve(inAllocator, used + 2 + 2 * nnz);
+
+        double *out = vectors + static_cast<uint64_t>(used);
+        *out++ = inId;
+        *out++ = static_cast<double>(nnz);
+        for (SparseColumnVector::InnerIterator it(inX); it; ++it) {
+            if (!std::isfinite(it.value()))
+                throw std::invalid_argument("Vectors in a similarity join "
+                    "must not contain NULL or non-finite values.");
+            *out++ = static_cast<double>(it.index());
+            *out++ = it.value();
+        }
+        used = used + 2 + 2 * nnz;
+        numVectors = numVectors + 1;
+    }
+
+    /**
+     * @brief Add all vectors of another state
+     */
+    template <class OtherHandle>
+    void add(const Allocator &inAllocator,
+        const AllPairsState<OtherHandle> &inOther) {
+
+        checkParameters(inOther.threshold, inOther.metric, inOther.dimension);
+        reserve(inAllocator, used + inOther.used);
+        std::copy(inOther.vectors, inOther.vectors
+            + static_cast<uint64_t>(inOther.used),
+            vectors + static_cast<uint64_t>(used));
+        used = used + inOther.used;
+        numVectors = numVectors + inOther.numVectors;
+    }
+
+private:
+    static const uint64_t kHeaderSize = 6;
+
+    void rebind(uint64_t inCapacity) {
+        madlib_assert(mStorage.size() >= kHeaderSize + inCapacity,
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        threshold.rebind(&mStorage[0]);
+        metric.rebind(&mStorage[1]);
+        dimension.rebind(&mStorage[2]);
+        numVectors.rebind(&mStorage[3]);
+        used.rebind(&mStorage[4]);
+        capacity.rebind(&mStorage[5]);
+        // The state may be empty, so compute the pointer without going
+        // through the bounds-checked Handle::operator[]
+        vectors = mStorage.ptr() + kHeaderSize;
+    }
+
+    /**
+     * @brief Make room for at least inCapacity elements
+     */
+    void reserve(const Allocator &inAllocator, uint64_t inCapacity) {
+        if (inCapacity <= capacity)
+            return;
+
+        uint64_t num = used;
+        uint64_t newCapacity = std::max(inCapacity,
+            static_cast<uint64_t>(capacity) * 2);
+        Handle newStorage = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                kHeaderSize + newCapacity);
+
+        double *newPtr = newStorage.ptr();
+        std::copy(mStorage.ptr(), mStorage.ptr() + kHeaderSize + num, newPtr);
+        newPtr[5] = static_cast<double>(newCapacity);
+
+        mStorage = newStorage;
+        rebind(newCapacity);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToDouble threshold;
+    typename HandleTraits<Handle>::ReferenceToUInt32 metric;
+    typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numVectors;
+    typename HandleTraits<Handle>::ReferenceToUInt64 used;
+    typename HandleTraits<Handle>::ReferenceToUInt64 capacity;
+    typename HandleTraits<Handle>::DoublePtr vectors;
+};
+
+namespace {
+
+/**
+ * @brief A pair of vectors (by position in the state) and their similarity
+ */
+struct SimilarPair {
+    SimilarPair(uint64_t inFirst, uint64_t inSecond, double inSimilarity)
+      : first(inFirst), second(inSecond), similarity(inSimilarity) { }
+
+    uint64_t first;
+    uint64_t second;
+    double similarity;
+};
+
+/**
+ * @brief Find all pairs of vectors with similarity at least the threshold
+ *
+ * @param inVectors Vectors in the layout of AllPairsState
+ * @param inNumVectors Number of vectors
+ * @param inThreshold Similarity threshold, in (0, 1]
+ * @param inMetric Similarity metric
+ * @param outIds Ids of the vectors
+ * @param outPairs All pairs \f$ (i, j) \f$ with \f$ j < i \f$ whose
+ *     similarity is at least the threshold
+ */
+void
+allPairs(const double *inVectors, uint64_t inNumVectors, double inThreshold,
+    SimilarityMetric inMetric, std::vector<double> &outIds,
+    std::vector<SimilarPair> &outPairs) {
+
+    typedef std::pair<uint32_t, double> Entry;
+
+    // Parse the vectors, and count in how many vectors each feature occurs
+    std::vector<uint64_t> offsets(inNumVectors);
+    std::vector<uint32_t> features;
+    outIds.resize(inNumVectors);
+    const double *in = inVectors;
+    for (uint64_t i = 0; i < inNumVectors; i++) {
+        outIds[i] = in[0];
+        uint64_t nnz = static_cast<uint64_t>(in[1]);
+        offsets[i] = features.size();
+        for (uint64_t k = 0; k < nnz; k++)
+            features.push_back(static_cast<uint32_t>(in[2 + 2 * k]));
+        in += 2 + 2 * nnz;
+    }
+    std::vector<uint32_t> distinct(features);
+    std::sort(distinct.begin(), distinct.end());
+    std::vector<std::pair<uint64_t, uint32_t> > byFrequency;
+    for (std::vector<uint32_t>::iterator it = distinct.begin();
+            it != distinct.end(); ) {
+        std::vector<uint32_t>::iterator end
+            = std::upper_bound(it, distinct.end(), *it);
+        byFrequency.push_back(std::make_pair(
+            static_cast<uint64_t>(end - it), *it));
+        it = end;
+    }
+    distinct.erase(std::unique(distinct.begin(), distinct.end()),
+        distinct.end());
+
+    // Rank features by decreasing frequency: rank[k] is the rank of feature
+    // distinct[k]
+    std::sort(byFrequency.begin(), byFrequency.end(),
+        std::greater<std::pair<uint64_t, uint32_t> >());
+    std::vector<uint32_t> rank(distinct.size());
+    for (uint32_t r = 0; r < byFrequency.size(); r++)
+        rank[std::lower_bound(distinct.begin(), distinct.end(),
+            byFrequency[r].second) - distinct.begin()] = r;
+
+    // Normalize the vectors and sort their entries by feature rank
+    std::vector<Entry> entries(features.size());
+    std::vector<double> norms(inNumVectors);
+    in = inVectors;
+    for (uint64_t i = 0; i < inNumVectors; i++) {
+        uint64_t nnz = static_cast<uint64_t>(in[1]);
+        double sumOfSquares = 0.;
+        for (uint64_t k = 0; k < nnz; k++)
+            sumOfSquares += in[3 + 2 * k] * in[3 + 2 * k];
+        norms[i] = std::sqrt(sumOfSquares);
+        for (uint64_t k = 0; k < nnz; k++) {
+            uint32_t feature = static_cast<uint32_t>(in[2 + 2 * k]);
+            entries[offsets[i] + k] = Entry(
+                rank[std::lower_bound(distinct.begin(), distinct.end(),
+                    feature) - distinct.begin()],
+                in[3 + 2 * k] / norms[i]);
+        }
+        std::sort(entries.begin() + offsets[i],
+            entries.begin() + offsets[i] + nnz);
+        in += 2 + 2 * nnz;
+    }
+    offsets.push_back(entries.size());
+
+    double cosineThreshold = inMetric == kTanimoto
+        ? 2. * inThreshold / (1. + inThreshold)
+        : inThreshold;
+
+    // For each vector, the norm of the prefix that is not indexed
+    std::vector<double> prefixNorm(inNumVectors);
+    std::vector<std::vector<std::pair<uint64_t, double> > > index(
+        distinct.size());
+    std::vector<double> accumulator(inNumVectors, 0.);
+    std::vector<bool> touched(inNumVectors, false);
+    std::vector<uint64_t> candidates;
+
+    for (uint64_t i = 0; i < inNumVectors; i++) {
+        // Vectors of norm zero have no similarity with any other vector
+        if (norms[i] == 0.)
+            continue;
+
+        // Probe the inverted index with all features of the vector
+        for (uint64_t k = offsets[i]; k < offsets[i + 1]; k++) {
+            const std::vector<std::pair<uint64_t, double> > &list
+                = index[entries[k].first];
+            for (size_t l = 0; l < list.size(); l++) {
+                uint64_t j = list[l].first;
+                if (!touched[j]) {
+                    touched[j] = true;
+                    candidates.push_back(j);
+                }
+                accumulator[j] += entries[k].second * list[l].second;
+            }
+        }
+
+        // Verify the candidates
+        for (size_t c = 0; c < candidates.size(); c++) {
+            uint64_t j = candidates[c];
+            double bound = accumulator[j] + prefixNorm[j];
+            accumulator[j] = 0.;
+            touched[j] = false;
+            if (bound < cosineThreshold - kFilterSlack)
+                continue;
+
+            // Complete the dot product with the unindexed prefix of j
+            double cosine = 0.;
+            uint64_t a = offsets[i], b = offsets[j];
+            while (a < offsets[i + 1] && b < offsets[j + 1]) {
+                if (entries[a].first < entries[b].first)
+                    a++;
+                else if (entries[a].first > entries[b].first)
+                    b++;
+                else
+                    cosine += entries[a++].second * entries[b++].second;
+            }
+            double similarity = std::min(cosine, 1.);
+            if (inMetric == kTanimoto) {
+                double dot = cosine * norms[i] * norms[j];
+                similarity = std::max(0., std::min(1., dot
+                    / (norms[i] * norms[i] + norms[j] * norms[j] - dot)));
+            }
+            if (similarity >= inThreshold)
+                outPairs.push_back(SimilarPair(j, i, similarity));
+        }
+        candidates.clear();
+
+        // Index all entries after the longest prefix with norm below the
+        // threshold
+        double sumOfSquares = 0.;
+        uint64_t k = offsets[i];
+        for (; k < offsets[i + 1]; k++) {
+            double next = sumOfSquares + entries[k].second * entries[k].second;
+            if (std::sqrt(next) >= cosineThreshold - kFilterSlack)
+                break;
+            sumOfSquares = next;
+        }
+        prefixNorm[i] = std::sqrt(sumOfSquares);
+        for (; k < offsets[i + 1]; k++)
+            index[entries[k].first].push_back(
+                std::make_pair(i, entries[k].second));
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Add a vector to a similarity join
+ */
+static AnyType
+allPairsTransition(AnyType &args, const Allocator &inAllocator,
+    SimilarityMetric inMetric) {
+
+    AllPairsState<MutableArrayHandle<double> > state = args[0];
+    double id = idToDouble(args[1].getAs<int64_t>());
+    SparseColumnVector x = args[2].getAs<SparseColumnVector>();
+    double threshold = args[3].getAs<double>();
+
+    if (!(threshold > 0. && threshold <= 1.))
+        throw std::invalid_argument("Similarity threshold must be in (0, 1].");
+    if (x.size() == 0)
+        throw std::invalid_argument("Vectors in a similarity join must not be "
+            "empty.");
+    if (!state.isInitialized())
+        state.initialize(inAllocator, threshold, inMetric,
+            static_cast<uint32_t>(x.size()), 64);
+    else
+        state.checkParameters(threshold, static_cast<uint32_t>(inMetric),
+            static_cast<uint32_t>(x.size()));
+
+    state.add(inAllocator, id, x);
+    return state;
+}
+
+AnyType
+allpairs_cosine_transition::run(AnyType &args) {
+    return allPairsTransition(args, *this, kCosine);
+}
+
+AnyType
+allpairs_tanimoto_transition::run(AnyType &args) {
+    return allPairsTransition(args, *this, kTanimoto);
+}
+
+/**
+ * @brief Perform the preliminary aggregation function: Merge transition states
+ */
+AnyType
+allpairs_merge_states::run(AnyType &args) {
+    AllPairsState<MutableArrayHandle<double> > stateLeft = args[0];
+    AllPairsState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+
+    stateLeft.add(*this, stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Return all pairs of vectors with similarity at least the threshold
+ *
+ * In each pair, the vector that was added first comes first.
+ */
+AnyType
+allpairs_final::run(AnyType &args) {
+    AllPairsState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    std::vector<double> ids;
+    std::vector<SimilarPair> pairs;
+    allPairs(state.vectors, state.numVectors, state.threshold,
+        static_cast<SimilarityMetric>(static_cast<uint32_t>(state.metric)),
+        ids, pairs);
+
+    MutableArrayHandle<int64_t> ids1 = allocateArray<int64_t>(pairs.size());
+    MutableArrayHandle<int64_t> ids2 = allocateArray<int64_t>(pairs.size());
+    MutableArrayHandle<double> similarities
+        = allocateArray<double>(pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++) {
+        ids1[i] = static_cast<int64_t>(ids[pairs[i].first]);
+        ids2[i] = static_cast<int64_t>(ids[pairs[i].second]);
+        similarities[i] = pairs[i].similarity;
+    }
+
+    AnyType tuple;
+    return tuple << ids1 << ids2 << similarities;
+}
+
+} // namespace ann
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,29 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file allpairs.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief All-pairs similarity join: Transition function for collecting the
+ *     vectors, with cosine similarity
+ */
+DECLARE_UDF(ann, allpairs_cosine_transition)
+
+/**
+ * @brief All-pairs similarity join: Transition function for collecting the
+ *     vectors, with Tanimoto similarity
+ */
+DECLARE_UDF(ann, allpairs_tanimoto_transition)
+
+/**
+ * @brief All-pairs similarity join: State merge function for collecting the
+ *     vectors
+ */
+DECLARE_UDF(ann, allpairs_merge_states)
+
+/**
+ * @brief All-pairs similarity join: Final function returning all pairs of
+ *     vectors with similarity at least the threshold
+ */
+DECLARE_UDF(ann, allpairs_final)
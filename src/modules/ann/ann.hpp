@@ -0,0 +1,11 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ann.hpp
+ *
+ * @brief Umbrella header that includes all approximate nearest-neighbor
+ *     search functions
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include "allpairs.hpp"
+#include "ivf.hpp"
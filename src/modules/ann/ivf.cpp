@@ -0,0 +1,440 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ivf.cpp
+ *
+ * @brief Inverted-file (IVF) index for approximate nearest-neighbor search
+ *
+ * An IVF index partitions the points by k-means. Each partition is stored as
+ * one row holding the ids and a matrix with the coordinates of its members
+ * (one member per column). A query probes only the partitions whose centroids
+ * are closest to it, and ranks the members of these partitions exactly with
+ * the closest-column kernels of the linalg module.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <modules/linalg/metric.hpp>
+#include <modules/linalg/metric_impl.hpp>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "ivf.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace ann {
+
+/**
+ * @brief Ids are stored in DOUBLE PRECISION arrays, so they must be exactly
+ *     representable as doubles
+ */
+static const int64_t kMaxExactId = static_cast<int64_t>(1) << 53;
+
+static double
+idToDouble(int64_t inId) {
+    if (inId > kMaxExactId || inId < -kMaxExactId)
+        throw std::invalid_argument("Ids in an IVF index must not exceed "
+            "2^53 in absolute value.");
+    return static_cast<double>(inId);
+}
+
+/**
+ * @brief Transition state for collecting the members of a partition
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * dimension, numMembers, capacity, followed by capacity ids and
+ * dimension * capacity coordinates (one member after the other).
+ *
+ * The state grows geometrically: Whenever it is full, it is copied into an
+ * array of twice the capacity.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elements are 0.
+ */
+template <class Handle>
+class IVFPartitionState {
+    template <class OtherHandle>
+    friend class IVFPartitionState;
+
+public:
+    IVFPartitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[2]),
+            static_cast<uint32_t>(mStorage[0]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator,
+        uint32_t inDimension, uint32_t inCapacity) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inCapacity, inDimension));
+        rebind(inCapacity, inDimension);
+        dimension = inDimension;
+        capacity = inCapacity;
+    }
+
+    bool isInitialized() const {
+        return dimension > 0;
+    }
+
+    /**
+     * @brief Add a member, growing the state if necessary
+     */
+    template <class Derived>
+    void add(const Allocator &inAllocator, double inId,
+        const Eigen::MatrixBase<Derived> &inCoords) {
+
+        reserve(inAllocator, numMembers + 1);
+        ids[numMembers] = inId;
+        std::copy(inCoords.derived().data(),
+            inCoords.derived().data() + dimension,
+            coords + static_cast<size_t>(numMembers) * dimension);
+        numMembers = numMembers + 1;
+    }
+
+    /**
+     * @brief Add all members of another state
+     */
+    template <class OtherHandle>
+    void add(const Allocator &inAllocator,
+        const IVFPartitionState<OtherHandle> &inOther) {
+
+        if (inOther.dimension != dimension)
+            throw std::invalid_argument("Vectors in an IVF partition must all "
+                "have the same length.");
+
+        reserve(inAllocator, numMembers + inOther.numMembers);
+        std::copy(inOther.ids, inOther.ids + inOther.numMembers,
+            ids + numMembers);
+        std::copy(inOther.coords,
+            inOther.coords + static_cast<size_t>(inOther.numMembers)
+                * dimension,
+            coords + static_cast<size_t>(numMembers) * dimension);
+        numMembers = numMembers + inOther.numMembers;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inCapacity, uint32_t inDimension) {
+        return 3 + static_cast<size_t>(inCapacity) * (1 + inDimension);
+    }
+
+    void rebind(uint32_t inCapacity, uint32_t inDimension) {
+        madlib_assert(mStorage.size() >= arraySize(inCapacity, inDimension),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        dimension.rebind(&mStorage[0]);
+        numMembers.rebind(&mStorage[1]);
+        capacity.rebind(&mStorage[2]);
+        // The state may be empty, so compute the pointers without going
+        // through the bounds-checked Handle::operator[]
+        ids = mStorage.ptr() + 3;
+        coords = mStorage.ptr() + 3 + inCapacity;
+    }
+
+    /**
+     * @brief Make room for at least inCapacity members
+     */
+    void reserve(const Allocator &inAllocator, uint32_t inCapacity) {
+        if (inCapacity <= capacity)
+            return;
+
+        uint32_t dim = dimension;
+        uint32_t num = numMembers;
+        uint32_t newCapacity = std::max(inCapacity,
+            static_cast<uint32_t>(capacity) * 2);
+        Handle newStorage = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(newCapacity, dim));
+
+        double *newPtr = newStorage.ptr();
+        newPtr[0] = dim;
+        newPtr[1] = num;
+        newPtr[2] = newCapacity;
+        std::copy(ids, ids + num, newPtr + 3);
+        std::copy(coords, coords + static_cast<size_t>(num) * dim,
+            newPtr + 3 + newCapacity);
+
+        mStorage = newStorage;
+        rebind(newCapacity, dim);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numMembers;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::DoublePtr ids;
+    typename HandleTraits<Handle>::DoublePtr coords;
+};
+
+/**
+ * @brief Transition state for the k nearest members of the probed partitions
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * k, numResults, followed by k distances and k ids. The results are kept
+ * sorted by (distance, id).
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 2, and all elements are 0.
+ */
+template <class Handle>
+class IVFTopKState {
+    template <class OtherHandle>
+    friend class IVFTopKState;
+
+public:
+    IVFTopKState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inK) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(2 + 2 * inK);
+        rebind(inK);
+        k = inK;
+    }
+
+    bool isInitialized() const {
+        return k > 0;
+    }
+
+    /**
+     * @brief Add a candidate, keeping only the k smallest (distance, id)
+     *     pairs
+     */
+    void add(double inDistance, double inId) {
+        std::pair<double, double> candidate(inDistance, inId);
+        uint32_t pos = numResults;
+        if (pos == k) {
+            if (!(candidate < std::make_pair(distances[k - 1], ids[k - 1])))
+                return;
+            pos--;
+        } else {
+            numResults = numResults + 1;
+        }
+        // Insertion sort: k is small compared to the number of candidates
+        for (; pos > 0 && candidate
+                < std::make_pair(distances[pos - 1], ids[pos - 1]); pos--) {
+            distances[pos] = distances[pos - 1];
+            ids[pos] = ids[pos - 1];
+        }
+        distances[pos] = inDistance;
+        ids[pos] = inId;
+    }
+
+    /**
+     * @brief Add all results of another state
+     */
+    template <class OtherHandle>
+    void add(const IVFTopKState<OtherHandle> &inOther) {
+        if (inOther.k != k)
+            throw std::invalid_argument("Number of nearest neighbors must be "
+                "the same in all rows.");
+
+        for (uint32_t i = 0; i < inOther.numResults; i++)
+            add(inOther.distances[i], inOther.ids[i]);
+    }
+
+private:
+    void rebind(uint32_t inK) {
+        madlib_assert(mStorage.size() >= 2 + 2 * inK,
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        k.rebind(&mStorage[0]);
+        numResults.rebind(&mStorage[1]);
+        distances = mStorage.ptr() + 2;
+        ids = mStorage.ptr() + 2 + inK;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 k;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numResults;
+    typename HandleTraits<Handle>::DoublePtr distances;
+    typename HandleTraits<Handle>::DoublePtr ids;
+};
+
+/**
+ * @brief Add a point to a partition
+ */
+AnyType
+ivf_partition_transition::run(AnyType &args) {
+    IVFPartitionState<MutableArrayHandle<double> > state = args[0];
+    double id = idToDouble(args[1].getAs<int64_t>());
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+
+    if (x.size() == 0)
+        throw std::invalid_argument("Vectors in an IVF partition must not be "
+            "empty.");
+    if (!state.isInitialized())
+        state.initialize(*this, static_cast<uint32_t>(x.size()), 16);
+    else if (x.size() != static_cast<Index>(state.dimension))
+        throw std::invalid_argument("Vectors in an IVF partition must all "
+            "have the same length.");
+
+    state.add(*this, id, x);
+    return state;
+}
+
+/**
+ * @brief Perform the preliminary aggregation function: Merge transition states
+ */
+AnyType
+ivf_partition_merge_states::run(AnyType &args) {
+    IVFPartitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    IVFPartitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+
+    stateLeft.add(*this, stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Return the members of a partition, sorted by id
+ *
+ * The coordinates are returned as a two-dimensional array with one member
+ * per row, i.e., one member per column of the equivalent matrix.
+ */
+AnyType
+ivf_partition_final::run(AnyType &args) {
+    IVFPartitionState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    uint32_t num = state.numMembers;
+    uint32_t dim = state.dimension;
+    std::vector<std::pair<double, uint32_t> > order(num);
+    for (uint32_t i = 0; i < num; i++)
+        order[i] = std::make_pair(state.ids[i], i);
+    std::sort(order.begin(), order.end());
+
+    MutableArrayHandle<int64_t> memberIds = allocateArray<int64_t>(num);
+    MutableArrayHandle<double> members = allocateArray<double>(num, dim);
+    for (uint32_t i = 0; i < num; i++) {
+        memberIds[i] = static_cast<int64_t>(order[i].first);
+        const double *src = state.coords
+            + static_cast<size_t>(order[i].second) * dim;
+        std::copy(src, src + dim, members.ptr() + static_cast<size_t>(i) * dim);
+    }
+
+    AnyType tuple;
+    return tuple << memberIds << members;
+}
+
+/**
+ * @brief Rank the members of a probed partition
+ */
+AnyType
+ivf_topk_transition::run(AnyType &args) {
+    IVFTopKState<MutableArrayHandle<double> > state = args[0];
+    ArrayHandle<int64_t> memberIds = args[1].getAs<ArrayHandle<int64_t> >();
+    MappedMatrix members = args[2].getAs<MappedMatrix>();
+    MappedColumnVector query = args[3].getAs<MappedColumnVector>();
+    int32_t k = args[4].getAs<int32_t>();
+    FunctionHandle dist = args[5].getAs<FunctionHandle>();
+
+    if (k < 1)
+        throw std::invalid_argument("Number of nearest neighbors must be "
+            "positive.");
+    if (!state.isInitialized())
+        state.initialize(*this, static_cast<uint32_t>(k));
+    else if (static_cast<uint32_t>(k) != state.k)
+        throw std::invalid_argument("Number of nearest neighbors must be "
+            "the same in all rows.");
+    if (members.cols() != static_cast<Index>(memberIds.size()))
+        throw std::invalid_argument("Number of member ids does not match "
+            "number of members in IVF partition.");
+    if (members.rows() != query.size())
+        throw std::invalid_argument("Query vector and IVF index have "
+            "different dimensions.");
+
+    std::vector<std::pair<double, Index> > closest
+        = linalg::closestColumnsAndDistances(members, query, dist,
+            static_cast<std::size_t>(k));
+    for (std::size_t i = 0; i < closest.size(); ++i) {
+        if (std::isnan(closest[i].first))
+            continue;
+        state.add(closest[i].first,
+            static_cast<double>(memberIds[closest[i].second]));
+    }
+    return state;
+}
+
+/**
+ * @brief Perform the preliminary aggregation function: Merge transition states
+ */
+AnyType
+ivf_topk_merge_states::run(AnyType &args) {
+    IVFTopKState<MutableArrayHandle<double> > stateLeft = args[0];
+    IVFTopKState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+
+    stateLeft.add(stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Return the ids and distances of the nearest members, sorted by
+ *     distance
+ */
+AnyType
+ivf_topk_final::run(AnyType &args) {
+    IVFTopKState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    uint32_t num = state.numResults;
+    MutableArrayHandle<int64_t> ids = allocateArray<int64_t>(num);
+    MutableArrayHandle<double> distances = allocateArray<double>(num);
+    for (uint32_t i = 0; i < num; i++) {
+        ids[i] = static_cast<int64_t>(state.ids[i]);
+        distances[i] = state.distances[i];
+    }
+
+    AnyType tuple;
+    return tuple << ids << distances;
+}
+
+} // namespace ann
+
+} // namespace modules
+
+} // namespace madlib
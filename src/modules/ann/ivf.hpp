@@ -0,0 +1,41 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ivf.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Inverted-file index: Transition function for collecting the members
+ *     of a partition
+ */
+DECLARE_UDF(ann, ivf_partition_transition)
+
+/**
+ * @brief Inverted-file index: State merge function for collecting the members
+ *     of a partition
+ */
+DECLARE_UDF(ann, ivf_partition_merge_states)
+
+/**
+ * @brief Inverted-file index: Final function for collecting the members of a
+ *     partition
+ */
+DECLARE_UDF(ann, ivf_partition_final)
+
+/**
+ * @brief Inverted-file index: Transition function for the k nearest members
+ *     of the probed partitions
+ */
+DECLARE_UDF(ann, ivf_topk_transition)
+
+/**
+ * @brief Inverted-file index: State merge function for the k nearest members
+ *     of the probed partitions
+ */
+DECLARE_UDF(ann, ivf_topk_merge_states)
+
+/**
+ * @brief Inverted-file index: Final function for the k nearest members of the
+ *     probed partitions
+ */
+DECLARE_UDF(ann, ivf_topk_final)
@@ -0,0 +1,10 @@
+/* -----------------------------------------------------------------------------
+ *
+ * @file assoc_rules.hpp
+ *
+ * @brief Umbrella header that includes all association rules headers
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "eclat.hpp"
+#include "fp_growth.hpp"
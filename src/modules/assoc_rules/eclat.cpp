@@ -0,0 +1,517 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file eclat.cpp
+ *
+ * @brief Eclat functions for frequent itemset mining
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+#include "eclat.hpp"
+#include "frequent_itemsets.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace assoc_rules {
+
+/**
+ * @brief Transition state for the Eclat aggregate
+ *
+ * The state collects the transactions, in the order in which they are added,
+ * so that the position of a transaction is its transaction id. Every
+ * transaction is stored as its number of items followed by its items in
+ * ascending order. Merging two states concatenates their transactions.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * minCount, part, numParts, numTrans, size, capacity, followed by capacity
+ * elements, of which the first size are used. Since we do not want to
+ * reallocate too often, the capacity is doubled whenever it is exhausted.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 6, and all elemenets are 0. Handle::operator[] will
+ * perform bounds checking.
+ */
+template <class Handle>
+class EclatTransitionState {
+    template <class OtherHandle>
+    friend class EclatTransitionState;
+
+public:
+    EclatTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[5]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, int64_t inMinCount,
+        uint32_t inPart, uint32_t inNumParts) {
+
+        uint32_t cap = 1024;
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(cap));
+        rebind(cap);
+        minCount = static_cast<double>(inMinCount);
+        part = inPart;
+        numParts = inNumParts;
+        capacity = cap;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return capacity > 0;
+    }
+
+    /**
+     * @brief Make sure that inNumNewElements more elements can be appended
+     */
+    void reserve(const Allocator &inAllocator, uint32_t inNumNewElements) {
+        uint64_t required = static_cast<uint64_t>(size) + inNumNewElements;
+        if (required <= capacity)
+            return;
+
+        uint64_t cap = capacity;
+        while (cap < required)
+            cap *= 2;
+        if (cap > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Too many items in Eclat transactions.");
+
+        // Save our current state, so we can subsequently restore it with the
+        // new storage
+        EclatTransitionState oldSelf = *this;
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(static_cast<uint32_t>(cap)));
+        rebind(static_cast<uint32_t>(cap));
+        minCount = oldSelf.minCount;
+        part = oldSelf.part;
+        numParts = oldSelf.numParts;
+        numTrans = oldSelf.numTrans;
+        size = oldSelf.size;
+        capacity = static_cast<uint32_t>(cap);
+        std::copy(oldSelf.transactions, oldSelf.transactions + oldSelf.size,
+            transactions);
+    }
+
+    /**
+     * @brief Append a transaction (with its items in ascending order)
+     *
+     * The caller has to reserve() space for 1 + inItems.size() elements
+     * beforehand.
+     */
+    void add(const std::vector<uint32_t> &inItems) {
+        madlib_assert(static_cast<uint64_t>(size) + 1 + inItems.size()
+                <= capacity,
+            std::logic_error("Eclat transition state is full."));
+
+        double *record = transactions + size;
+        record[0] = static_cast<double>(inItems.size());
+        std::copy(inItems.begin(), inItems.end(), record + 1);
+        size = static_cast<uint32_t>(size + 1 + inItems.size());
+        numTrans = numTrans + 1;
+    }
+
+    /**
+     * @brief Append all transactions of another state
+     *
+     * The caller has to reserve() space beforehand.
+     */
+    template <class OtherHandle>
+    void add(const EclatTransitionState<OtherHandle> &inOther) {
+        madlib_assert(static_cast<uint64_t>(size) + inOther.size <= capacity,
+            std::logic_error("Eclat transition state is full."));
+
+        std::copy(inOther.transactions, inOther.transactions + inOther.size,
+            transactions + size);
+        size = size + inOther.size;
+        numTrans = numTrans + inOther.numTrans;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inCapacity) {
+        return 6 + static_cast<size_t>(inCapacity);
+    }
+
+    void rebind(uint32_t inCapacity) {
+        madlib_assert(mStorage.size() >= arraySize(inCapacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        minCount.rebind(&mStorage[0]);
+        part.rebind(&mStorage[1]);
+        numParts.rebind(&mStorage[2]);
+        numTrans.rebind(&mStorage[3]);
+        size.rebind(&mStorage[4]);
+        capacity.rebind(&mStorage[5]);
+        // There may be no transactions, so compute the pointer without going
+        // through the bounds-checked Handle::operator[]
+        transactions = mStorage.ptr() + 6;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToDouble minCount;
+    typename HandleTraits<Handle>::ReferenceToUInt32 part;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numParts;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numTrans;
+    typename HandleTraits<Handle>::ReferenceToUInt32 size;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::DoublePtr transactions;
+};
+
+/**
+ * @brief Perform the Eclat transition step
+ *
+ * Adds one transaction. Its frequent items are passed as an array of positive
+ * integers, numbered by descending support. If the items are split into
+ * numParts parts, the transaction is truncated after its last item of this
+ * part, see transactionItemsForPart().
+ */
+AnyType
+eclat_transition::run(AnyType &args) {
+    EclatTransitionState<MutableArrayHandle<double> > state = args[0];
+    ArrayHandle<int32_t> items = args[1].getAs<ArrayHandle<int32_t> >();
+    int64_t minCount = args[2].getAs<int64_t>();
+    int32_t part = args[3].getAs<int32_t>();
+    int32_t numParts = args[4].getAs<int32_t>();
+
+    if (!state.isInitialized()) {
+        if (minCount < 1)
+            throw std::invalid_argument("Minimum count must be positive.");
+        if (numParts < 1 || part < 0 || part >= numParts)
+            throw std::invalid_argument("Part must be between 0 and the "
+                "number of parts minus 1.");
+        state.initialize(*this, minCount, static_cast<uint32_t>(part),
+            static_cast<uint32_t>(numParts));
+    } else if (static_cast<double>(minCount) != state.minCount
+            || static_cast<uint32_t>(part) != state.part
+            || static_cast<uint32_t>(numParts) != state.numParts)
+        throw std::invalid_argument("Minimum count and part must not change "
+            "during aggregation.");
+
+    std::vector<uint32_t> transaction;
+    transactionItemsForPart(items, state.part, state.numParts, transaction);
+    if (transaction.empty())
+        return state;
+
+    state.reserve(*this, static_cast<uint32_t>(1 + transaction.size()));
+    state.add(transaction);
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+eclat_merge_states::run(AnyType &args) {
+    EclatTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    EclatTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    if (stateLeft.minCount != stateRight.minCount
+            || stateLeft.part != stateRight.part
+            || stateLeft.numParts != stateRight.numParts)
+        throw std::invalid_argument("Minimum count and part must not change "
+            "during aggregation.");
+
+    stateLeft.reserve(*this, stateRight.size);
+    stateLeft.add(stateRight);
+    return stateLeft;
+}
+
+namespace {
+
+inline uint32_t
+popcount(uint64_t inWord) {
+#if defined(__GNUC__)
+    return static_cast<uint32_t>(__builtin_popcountll(inWord));
+#else
+    inWord = inWord - ((inWord >> 1) & 0x5555555555555555ULL);
+    inWord = (inWord & 0x3333333333333333ULL)
+        + ((inWord >> 2) & 0x3333333333333333ULL);
+    inWord = (inWord + (inWord >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<uint32_t>((inWord * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/**
+ * @brief Set of transaction ids
+ *
+ * Like the containers of a Roaring bitmap, a set is either a bitmap (if it
+ * is dense) or a sorted array of transaction ids (if it is sparse). A bitmap
+ * of n transactions takes n / 8 bytes, an array 4 bytes per id, so a set is
+ * a bitmap if it contains more than 1/32 of all transactions.
+ */
+class TidSet {
+public:
+    TidSet() : mSupport(0) { }
+
+    static bool isDense(uint32_t inSupport, uint32_t inNumTrans) {
+        return 32 * static_cast<uint64_t>(inSupport) > inNumTrans;
+    }
+
+    /**
+     * @brief Prepare an empty set for adding inSupport ids in ascending
+     *     order
+     */
+    void reset(uint32_t inSupport, uint32_t inNumTrans) {
+        mSupport = 0;
+        mWords.clear();
+        mTids.clear();
+        if (isDense(inSupport, inNumTrans))
+            mWords.assign((static_cast<size_t>(inNumTrans) + 63) / 64, 0);
+        else
+            mTids.reserve(inSupport);
+    }
+
+    void add(uint32_t inTid) {
+        if (isBitmap())
+            mWords[inTid / 64] |= static_cast<uint64_t>(1) << (inTid % 64);
+        else
+            mTids.push_back(inTid);
+        mSupport++;
+    }
+
+    /**
+     * @brief Set this set to the intersection of two sets, if the
+     *     intersection has at least the given support
+     *
+     * The intersection of two bitmaps is a word-wise AND followed by a
+     * popcount, which compilers vectorize. Its support is computed before
+     * anything is stored, so infrequent candidates cost no memory.
+     *
+     * @return Whether the intersection has support at least inMinCount
+     */
+    bool intersect(const TidSet &inLeft, const TidSet &inRight,
+        uint32_t inMinCount, uint32_t inNumTrans) {
+
+        if (std::min(inLeft.mSupport, inRight.mSupport) < inMinCount)
+            return false;
+
+        if (inLeft.isBitmap() && inRight.isBitmap()) {
+            const uint64_t *left = &inLeft.mWords[0];
+            const uint64_t *right = &inRight.mWords[0];
+            size_t numWords = inLeft.mWords.size();
+            uint32_t support = 0;
+            for (size_t i = 0; i < numWords; i++)
+                support += popcount(left[i] & right[i]);
+            if (support < inMinCount)
+                return false;
+
+            reset(support, inNumTrans);
+            if (isBitmap()) {
+                for (size_t i = 0; i < numWords; i++)
+                    mWords[i] = left[i] & right[i];
+                mSupport = support;
+            } else {
+                for (size_t i = 0; i < numWords; i++)
+                    for (uint64_t word = left[i] & right[i]; word != 0;
+                            word &= word - 1)
+                        add(static_cast<uint32_t>(64 * i
+                            + popcount((word & (~word + 1)) - 1)));
+            }
+            return true;
+        }
+
+        // The intersection with a sparse set is sparse
+        mSupport = 0;
+        mWords.clear();
+        mTids.clear();
+        if (inLeft.isBitmap() || inRight.isBitmap()) {
+            const TidSet &bitmap = inLeft.isBitmap() ? inLeft : inRight;
+            const TidSet &array = inLeft.isBitmap() ? inRight : inLeft;
+            for (size_t i = 0; i < array.mTids.size(); i++) {
+                uint32_t tid = array.mTids[i];
+                if (bitmap.mWords[tid / 64]
+                        & (static_cast<uint64_t>(1) << (tid % 64)))
+                    mTids.push_back(tid);
+            }
+        } else {
+            std::set_intersection(inLeft.mTids.begin(), inLeft.mTids.end(),
+                inRight.mTids.begin(), inRight.mTids.end(),
+                std::back_inserter(mTids));
+        }
+        mSupport = static_cast<uint32_t>(mTids.size());
+        if (mSupport < inMinCount) {
+            std::vector<uint32_t>().swap(mTids);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Free the memory of the set
+     */
+    void release() {
+        std::vector<uint64_t>().swap(mWords);
+        std::vector<uint32_t>().swap(mTids);
+    }
+
+    bool isBitmap() const {
+        return !mWords.empty();
+    }
+
+    uint32_t support() const {
+        return mSupport;
+    }
+
+private:
+    uint32_t mSupport;
+    std::vector<uint64_t> mWords;
+    std::vector<uint32_t> mTids;
+};
+
+/**
+ * @brief An item that extends the common prefix of an equivalence class,
+ *     together with the transactions that contain prefix and item
+ */
+struct EclatExtension {
+    uint32_t item;
+    TidSet tids;
+};
+
+/**
+ * @brief Mine all frequent itemsets of an equivalence class
+ *
+ * Every extension, added to the prefix, is frequent. Its equivalence class
+ * consists of the intersections with all later extensions that are still
+ * frequent, and is then mined recursively (Zaki, "Scalable Algorithms for
+ * Association Mining", 2000).
+ *
+ * @param ioExtensions Extensions of the prefix, in ascending order of items.
+ *     Their sets are released once their class has been mined.
+ * @param inMinCount Minimum support of a frequent itemset
+ * @param inNumTrans Number of transactions
+ * @param inPart Only itemsets whose largest item belongs to this part are
+ *     returned
+ * @param inNumParts Number of parts
+ * @param ioPrefix Prefix of the equivalence class
+ * @param ioResult Frequent itemsets with at least two items
+ */
+void
+mine(std::vector<EclatExtension> &ioExtensions, uint32_t inMinCount,
+    uint32_t inNumTrans, uint32_t inPart, uint32_t inNumParts,
+    std::vector<uint32_t> &ioPrefix, FrequentItemsets &ioResult) {
+
+    for (size_t i = 0; i < ioExtensions.size(); i++) {
+        EclatExtension &extension = ioExtensions[i];
+        ioPrefix.push_back(extension.item);
+        if (ioPrefix.size() >= 2 && (extension.item - 1) % inNumParts == inPart)
+            ioResult.add(ioPrefix, extension.tids.support());
+
+        // Reserve, so that no sets are copied when next grows
+        std::vector<EclatExtension> next;
+        next.reserve(ioExtensions.size() - i - 1);
+        for (size_t j = i + 1; j < ioExtensions.size(); j++) {
+            next.push_back(EclatExtension());
+            next.back().item = ioExtensions[j].item;
+            if (!next.back().tids.intersect(extension.tids,
+                    ioExtensions[j].tids, inMinCount, inNumTrans))
+                next.pop_back();
+        }
+        extension.tids.release();
+        if (!next.empty())
+            mine(next, inMinCount, inNumTrans, inPart, inNumParts, ioPrefix,
+                ioResult);
+
+        ioPrefix.pop_back();
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Perform the Eclat final step
+ *
+ * Builds the set of transaction ids of every frequent item, and then mines
+ * all frequent itemsets by intersecting these sets depth-first. Returns all
+ * frequent itemsets with at least two items whose largest item belongs to
+ * the part, see FrequentItemsets::toArray().
+ */
+AnyType
+eclat_final::run(AnyType &args) {
+    EclatTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (!state.isInitialized() || state.numTrans == 0)
+        return Null();
+
+    uint32_t numTrans = state.numTrans;
+    uint32_t minCount = static_cast<uint32_t>(std::min(
+        static_cast<double>(state.minCount),
+        static_cast<double>(std::numeric_limits<uint32_t>::max())));
+
+    std::vector<uint32_t> supports;
+    for (uint32_t pos = 0; pos < state.size; ) {
+        uint32_t length = static_cast<uint32_t>(state.transactions[pos]);
+        for (uint32_t k = 1; k <= length; k++) {
+            uint32_t item = static_cast<uint32_t>(state.transactions[pos + k]);
+            if (item >= supports.size())
+                supports.resize(item + 1, 0);
+            supports[item]++;
+        }
+        pos += 1 + length;
+    }
+
+    // Vertical layout: One set of transaction ids per frequent item
+    std::vector<EclatExtension> extensions;
+    extensions.reserve(static_cast<size_t>(std::count_if(supports.begin(),
+        supports.end(), std::bind2nd(std::greater_equal<uint32_t>(),
+            minCount))));
+    std::vector<uint32_t> extensionOfItem(supports.size(), 0);
+    for (uint32_t item = 1; item < supports.size(); item++)
+        if (supports[item] >= minCount) {
+            extensions.push_back(EclatExtension());
+            extensions.back().item = item;
+            extensions.back().tids.reset(supports[item], numTrans);
+            extensionOfItem[item] = static_cast<uint32_t>(extensions.size());
+        }
+    uint32_t tid = 0;
+    for (uint32_t pos = 0; pos < state.size; tid++) {
+        uint32_t length = static_cast<uint32_t>(state.transactions[pos]);
+        for (uint32_t k = 1; k <= length; k++) {
+            uint32_t ext = extensionOfItem[
+                static_cast<uint32_t>(state.transactions[pos + k])];
+            if (ext > 0)
+                extensions[ext - 1].tids.add(tid);
+        }
+        pos += 1 + length;
+    }
+
+    FrequentItemsets itemsets;
+    std::vector<uint32_t> prefix;
+    mine(extensions, minCount, numTrans, state.part, state.numParts, prefix,
+        itemsets);
+    if (itemsets.empty())
+        return Null();
+    return itemsets.toArray(*this);
+}
+
+} // namespace assoc_rules
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file eclat.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Eclat: Transition function
+ */
+DECLARE_UDF(assoc_rules, eclat_transition)
+
+/**
+ * @brief Eclat: State merge function
+ */
+DECLARE_UDF(assoc_rules, eclat_merge_states)
+
+/**
+ * @brief Eclat: Final function
+ */
+DECLARE_UDF(assoc_rules, eclat_final)
@@ -0,0 +1,508 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file fp_growth.cpp
+ *
+ * @brief FP-growth functions for frequent itemset mining
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <utils/Math.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "fp_growth.hpp"
+#include "frequent_itemsets.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace assoc_rules {
+
+/**
+ * @brief Hash of a tree edge, i.e., of a (parent node, item) pair
+ */
+static inline
+uint64_t
+hashEdge(uint32_t inParent, uint32_t inItem) {
+    uint64_t h = (static_cast<uint64_t>(inParent) << 32) | inItem;
+    // Finalizer of MurmurHash3, so that the low bits depend on all bits
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * @brief Transition state for the FP-growth aggregate
+ *
+ * The state is an FP-tree (Han et al.): Every transaction is a path from the
+ * root, with its items in ascending order, and every node counts the
+ * transactions whose path passes through it. Items are positive integers,
+ * numbered by descending support, so that frequent items share the nodes
+ * close to the root. Nodes are numbered in the order of their creation, so a
+ * parent always has a smaller number than its children. Node 0 is the root.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * minCount, part, numParts, capacity, numNodes, followed by capacity nodes of
+ * the form (parent, item, count), and an index of 2 * capacity slots. The
+ * index is a hash table (with open addressing and linear probing) that maps
+ * (parent, item) to the child node, so that inserting a transaction takes
+ * time linear in its length. A slot is empty if it is 0. The capacity is
+ * always a power of 2, and doubled whenever it is exhausted.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 5, and all elemenets are 0. Handle::operator[] will
+ * perform bounds checking.
+ */
+template <class Handle>
+class FPTreeTransitionState {
+    template <class OtherHandle>
+    friend class FPTreeTransitionState;
+
+public:
+    FPTreeTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[3]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, int64_t inMinCount,
+        uint32_t inPart, uint32_t inNumParts) {
+
+        uint32_t cap = 1024;
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(cap));
+        rebind(cap);
+        minCount = static_cast<double>(inMinCount);
+        part = inPart;
+        numParts = inNumParts;
+        capacity = cap;
+        // The root node: parent 0, item 0, count 0
+        numNodes = 1;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return capacity > 0;
+    }
+
+    /**
+     * @brief Make sure that inNumNewNodes more nodes can be created
+     *
+     * If the tree needs to grow, we double its capacity (as often as
+     * necessary), copy all nodes into newly allocated storage, and rebuild
+     * the index.
+     */
+    void reserve(const Allocator &inAllocator, uint32_t inNumNewNodes) {
+        uint64_t required = static_cast<uint64_t>(numNodes) + inNumNewNodes;
+        if (required <= capacity)
+            return;
+
+        uint64_t cap = capacity;
+        while (cap < required)
+            cap *= 2;
+        if (cap > std::numeric_limits<uint32_t>::max() / 2)
+            throw std::runtime_error("Too many nodes in FP-tree.");
+
+        // Save our current state, so we can subsequently restore it with the
+        // new storage
+        FPTreeTransitionState oldSelf = *this;
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(static_cast<uint32_t>(cap)));
+        rebind(static_cast<uint32_t>(cap));
+        minCount = oldSelf.minCount;
+        part = oldSelf.part;
+        numParts = oldSelf.numParts;
+        capacity = static_cast<uint32_t>(cap);
+        numNodes = oldSelf.numNodes;
+        std::copy(oldSelf.nodes, oldSelf.nodes + 3 * oldSelf.numNodes, nodes);
+        for (uint32_t i = 1; i < numNodes; i++)
+            *findSlot(static_cast<uint32_t>(nodes[3 * i]),
+                static_cast<uint32_t>(nodes[3 * i + 1])) = i;
+    }
+
+    /**
+     * @brief Add a path of items (in ascending order) with the given count
+     *
+     * The caller has to reserve() space for inLength nodes beforehand.
+     */
+    void add(const uint32_t *inItems, size_t inLength, double inCount) {
+        uint32_t node = 0;
+        nodes[2] += inCount;
+        for (size_t i = 0; i < inLength; i++) {
+            node = child(node, inItems[i]);
+            nodes[3 * node + 2] += inCount;
+        }
+    }
+
+    /**
+     * @brief Add all paths of another tree
+     *
+     * The caller has to reserve() space beforehand.
+     */
+    template <class OtherHandle>
+    void add(const FPTreeTransitionState<OtherHandle> &inOther) {
+        // Parents are created before their children, so a single pass in
+        // node order suffices to map every node of the other tree
+        std::vector<uint32_t> map(inOther.numNodes, 0);
+        nodes[2] += inOther.nodes[2];
+        for (uint32_t i = 1; i < inOther.numNodes; i++) {
+            const double *node = inOther.nodes + 3 * i;
+            map[i] = child(map[static_cast<uint32_t>(node[0])],
+                static_cast<uint32_t>(node[1]));
+            nodes[3 * map[i] + 2] += node[2];
+        }
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inCapacity) {
+        return 5 + 5 * static_cast<size_t>(inCapacity);
+    }
+
+    void rebind(uint32_t inCapacity) {
+        madlib_assert(mStorage.size() >= arraySize(inCapacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        minCount.rebind(&mStorage[0]);
+        part.rebind(&mStorage[1]);
+        numParts.rebind(&mStorage[2]);
+        capacity.rebind(&mStorage[3]);
+        numNodes.rebind(&mStorage[4]);
+        // The tree may be empty, so compute the pointers without going
+        // through the bounds-checked Handle::operator[]
+        nodes = mStorage.ptr() + 5;
+        index = nodes + 3 * static_cast<size_t>(inCapacity);
+    }
+
+    /**
+     * @brief Return the index slot of an edge, or the empty slot where it
+     *     belongs
+     */
+    typename HandleTraits<Handle>::DoublePtr findSlot(uint32_t inParent,
+        uint32_t inItem) const {
+
+        uint64_t mask = 2 * static_cast<uint64_t>(capacity) - 1;
+        uint64_t pos = hashEdge(inParent, inItem) & mask;
+        for (;;) {
+            typename HandleTraits<Handle>::DoublePtr slot = index + pos;
+            if (*slot == 0)
+                return slot;
+            const double *node = nodes + 3 * static_cast<uint32_t>(*slot);
+            if (node[0] == inParent && node[1] == inItem)
+                return slot;
+            pos = (pos + 1) & mask;
+        }
+    }
+
+    /**
+     * @brief Return the child of a node with the given item, and create it
+     *     if it does not exist yet
+     */
+    uint32_t child(uint32_t inParent, uint32_t inItem) {
+        double *slot = findSlot(inParent, inItem);
+        if (*slot != 0)
+            return static_cast<uint32_t>(*slot);
+
+        madlib_assert(numNodes < capacity,
+            std::logic_error("FP-tree is full."));
+        uint32_t node = numNodes;
+        nodes[3 * node] = inParent;
+        nodes[3 * node + 1] = inItem;
+        nodes[3 * node + 2] = 0;
+        *slot = node;
+        numNodes = node + 1;
+        return node;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToDouble minCount;
+    typename HandleTraits<Handle>::ReferenceToUInt32 part;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numParts;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numNodes;
+    typename HandleTraits<Handle>::DoublePtr nodes;
+    typename HandleTraits<Handle>::DoublePtr index;
+};
+
+/**
+ * @brief Perform the FP-growth transition step
+ *
+ * Adds one transaction. Its frequent items are passed as an array of positive
+ * integers, numbered by descending support. If the tree is split into
+ * numParts parts, the transaction is truncated after its last item of this
+ * part, see transactionItemsForPart().
+ */
+AnyType
+fp_growth_transition::run(AnyType &args) {
+    FPTreeTransitionState<MutableArrayHandle<double> > state = args[0];
+    ArrayHandle<int32_t> items = args[1].getAs<ArrayHandle<int32_t> >();
+    int64_t minCount = args[2].getAs<int64_t>();
+    int32_t part = args[3].getAs<int32_t>();
+    int32_t numParts = args[4].getAs<int32_t>();
+
+    if (!state.isInitialized()) {
+        if (minCount < 1)
+            throw std::invalid_argument("Minimum count must be positive.");
+        if (numParts < 1 || part < 0 || part >= numParts)
+            throw std::invalid_argument("Part must be between 0 and the "
+                "number of parts minus 1.");
+        state.initialize(*this, minCount, static_cast<uint32_t>(part),
+            static_cast<uint32_t>(numParts));
+    } else if (static_cast<double>(minCount) != state.minCount
+            || static_cast<uint32_t>(part) != state.part
+            || static_cast<uint32_t>(numParts) != state.numParts)
+        throw std::invalid_argument("Minimum count and part must not change "
+            "during aggregation.");
+
+    std::vector<uint32_t> path;
+    transactionItemsForPart(items, state.part, state.numParts, path);
+    if (path.empty())
+        return state;
+
+    state.reserve(*this, static_cast<uint32_t>(path.size()));
+    state.add(&path[0], path.size(), 1);
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+fp_growth_merge_states::run(AnyType &args) {
+    FPTreeTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    FPTreeTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    if (stateLeft.minCount != stateRight.minCount
+            || stateLeft.part != stateRight.part
+            || stateLeft.numParts != stateRight.numParts)
+        throw std::invalid_argument("Minimum count and part must not change "
+            "during aggregation.");
+
+    stateLeft.reserve(*this, stateRight.numNodes);
+    stateLeft.add(stateRight);
+    return stateLeft;
+}
+
+namespace {
+
+/**
+ * @brief An FP-tree in backend memory, with node links per item
+ *
+ * Used for the trees of the final function: The tree of the transition state
+ * and the conditional trees built from it during mining.
+ */
+class FPTree {
+public:
+    FPTree(uint32_t inMaxItem)
+      : mHead(inMaxItem + 1, 0), mSupport(inMaxItem + 1, 0), mIndex(16, 0) {
+        // The root node
+        mParent.push_back(0);
+        mItem.push_back(0);
+        mCount.push_back(0);
+        mNext.push_back(0);
+    }
+
+    /**
+     * @brief Add a path of items (in ascending order) with the given count
+     */
+    void add(const uint32_t *inItems, size_t inLength, double inCount) {
+        uint32_t node = 0;
+        for (size_t i = 0; i < inLength; i++) {
+            node = child(node, inItems[i]);
+            mCount[node] += inCount;
+            mSupport[inItems[i]] += inCount;
+        }
+    }
+
+    /**
+     * @brief Return the child of a node with the given item, and create it
+     *     if it does not exist yet
+     */
+    uint32_t child(uint32_t inParent, uint32_t inItem) {
+        uint32_t *slot = findSlot(inParent, inItem);
+        if (*slot != 0)
+            return *slot;
+
+        uint32_t node = static_cast<uint32_t>(mParent.size());
+        mParent.push_back(inParent);
+        mItem.push_back(inItem);
+        mCount.push_back(0);
+        mNext.push_back(mHead[inItem]);
+        mHead[inItem] = node;
+        *slot = node;
+
+        // Keep the index at most half full
+        if (2 * mParent.size() > mIndex.size()) {
+            mIndex.assign(2 * mIndex.size(), 0);
+            for (uint32_t i = 1; i < mParent.size(); i++)
+                *findSlot(mParent[i], mItem[i]) = i;
+        }
+        return node;
+    }
+
+    uint32_t maxItem() const {
+        return static_cast<uint32_t>(mHead.size() - 1);
+    }
+
+    bool empty() const {
+        return mParent.size() == 1;
+    }
+
+    std::vector<uint32_t> mParent;
+    std::vector<uint32_t> mItem;
+    std::vector<double> mCount;
+    /// Next node with the same item, 0 if none
+    std::vector<uint32_t> mNext;
+    /// First node of every item, 0 if none
+    std::vector<uint32_t> mHead;
+    /// Sum of the counts of all nodes of every item
+    std::vector<double> mSupport;
+
+private:
+    uint32_t *findSlot(uint32_t inParent, uint32_t inItem) {
+        size_t mask = mIndex.size() - 1;
+        size_t pos = static_cast<size_t>(hashEdge(inParent, inItem)) & mask;
+        for (;;) {
+            uint32_t *slot = &mIndex[pos];
+            if (*slot == 0
+                    || (mParent[*slot] == inParent && mItem[*slot] == inItem))
+                return slot;
+            pos = (pos + 1) & mask;
+        }
+    }
+
+    std::vector<uint32_t> mIndex;
+};
+
+/**
+ * @brief Mine all frequent itemsets of a (conditional) FP-tree
+ *
+ * For every item x of the tree, inSuffix + {x} is frequent if the support of
+ * x is. Its conditional tree is built from the prefix paths of all nodes of
+ * x (the conditional pattern base), keeping only the items that are frequent
+ * together with x, and then mined recursively.
+ *
+ * @param inTree The tree
+ * @param inMinCount Minimum support of a frequent itemset
+ * @param inPart If inNumParts > 1, only the items x of this part are mined.
+ *     Only used for the tree of the transition state.
+ * @param inNumParts Number of parts
+ * @param ioSuffix Items that all transactions of the tree contain
+ * @param ioResult Frequent itemsets with at least two items
+ */
+void
+mine(const FPTree &inTree, double inMinCount, uint32_t inPart,
+    uint32_t inNumParts, std::vector<uint32_t> &ioSuffix,
+    FrequentItemsets &ioResult) {
+
+    std::vector<uint32_t> path;
+    for (uint32_t x = inTree.maxItem(); x > 0; x--) {
+        if (inTree.mHead[x] == 0 || inTree.mSupport[x] < inMinCount
+                || (x - 1) % inNumParts != inPart)
+            continue;
+
+        ioSuffix.push_back(x);
+        if (ioSuffix.size() >= 2)
+            ioResult.add(ioSuffix, inTree.mSupport[x]);
+
+        // Supports of the items in the conditional pattern base of x
+        std::vector<double> support(x, 0);
+        for (uint32_t n = inTree.mHead[x]; n != 0; n = inTree.mNext[n])
+            for (uint32_t p = inTree.mParent[n]; p != 0; p = inTree.mParent[p])
+                support[inTree.mItem[p]] += inTree.mCount[n];
+
+        uint32_t condMaxItem = x - 1;
+        while (condMaxItem > 0 && support[condMaxItem] < inMinCount)
+            condMaxItem--;
+        if (condMaxItem > 0) {
+            FPTree condTree(condMaxItem);
+            for (uint32_t n = inTree.mHead[x]; n != 0; n = inTree.mNext[n]) {
+                path.clear();
+                for (uint32_t p = inTree.mParent[n]; p != 0;
+                        p = inTree.mParent[p])
+                    if (support[inTree.mItem[p]] >= inMinCount)
+                        path.push_back(inTree.mItem[p]);
+                if (path.empty())
+                    continue;
+                std::reverse(path.begin(), path.end());
+                condTree.add(&path[0], path.size(), inTree.mCount[n]);
+            }
+            if (!condTree.empty())
+                mine(condTree, inMinCount, 0, 1, ioSuffix, ioResult);
+        }
+
+        ioSuffix.pop_back();
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Perform the FP-growth final step
+ *
+ * Returns all frequent itemsets with at least two items whose largest item
+ * belongs to the part, see FrequentItemsets::toArray().
+ */
+AnyType
+fp_growth_final::run(AnyType &args) {
+    FPTreeTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (!state.isInitialized() || state.numNodes <= 1)
+        return Null();
+
+    uint32_t maxItem = 0;
+    for (uint32_t i = 1; i < state.numNodes; i++)
+        maxItem = std::max(maxItem,
+            static_cast<uint32_t>(state.nodes[3 * i + 1]));
+
+    // Parents are created before their children, so mapping the nodes in
+    // order preserves the tree
+    FPTree tree(maxItem);
+    std::vector<uint32_t> map(state.numNodes, 0);
+    for (uint32_t i = 1; i < state.numNodes; i++) {
+        const double *node = state.nodes + 3 * i;
+        uint32_t item = static_cast<uint32_t>(node[1]);
+        map[i] = tree.child(map[static_cast<uint32_t>(node[0])], item);
+        tree.mCount[map[i]] += node[2];
+        tree.mSupport[item] += node[2];
+    }
+
+    FrequentItemsets itemsets;
+    std::vector<uint32_t> suffix;
+    mine(tree, state.minCount, state.part, state.numParts, suffix, itemsets);
+    if (itemsets.empty())
+        return Null();
+    return itemsets.toArray(*this);
+}
+
+} // namespace assoc_rules
+
+} // namespace modules
+
+} // namespace madlib
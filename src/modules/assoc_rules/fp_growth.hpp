@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file fp_growth.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief FP-growth: Transition function
+ */
+DECLARE_UDF(assoc_rules, fp_growth_transition)
+
+/**
+ * @brief FP-growth: State merge function
+ */
+DECLARE_UDF(assoc_rules, fp_growth_merge_states)
+
+/**
+ * @brief FP-growth: Final function
+ */
+DECLARE_UDF(assoc_rules, fp_growth_final)
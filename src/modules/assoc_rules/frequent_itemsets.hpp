@@ -0,0 +1,124 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file frequent_itemsets.hpp
+ *
+ * @brief Helpers shared by the frequent itemset mining aggregates
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_MODULES_ASSOC_RULES_FREQUENT_ITEMSETS_HPP
+#define MADLIB_MODULES_ASSOC_RULES_FREQUENT_ITEMSETS_HPP
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace madlib {
+
+namespace modules {
+
+namespace assoc_rules {
+
+/**
+ * @brief Read the items of a transaction for a part of the items
+ *
+ * Items are positive integers, numbered by descending support. If the items
+ * are split into inNumParts parts, item i belongs to part (i - 1) % inNumParts,
+ * and the transaction is truncated after the last item of part inPart: Every
+ * itemset whose largest item belongs to the part still has the same support
+ * (Li et al., "PFP: Parallel FP-Growth for Query Recommendation", 2008).
+ *
+ * @param inItems Items of the transaction, in any order and possibly repeated
+ * @param inPart Part of the items
+ * @param inNumParts Number of parts
+ * @param outItems Distinct items of the truncated transaction, in ascending
+ *     order. Empty if the transaction has no item of the part.
+ */
+inline void
+transactionItemsForPart(const ArrayHandle<int32_t> &inItems, uint32_t inPart,
+    uint32_t inNumParts, std::vector<uint32_t> &outItems) {
+
+    outItems.clear();
+    outItems.reserve(inItems.size());
+    for (size_t i = 0; i < inItems.size(); i++) {
+        if (inItems[i] < 1)
+            throw std::invalid_argument("Items must be positive integers.");
+        outItems.push_back(static_cast<uint32_t>(inItems[i]));
+    }
+    std::sort(outItems.begin(), outItems.end());
+    outItems.erase(std::unique(outItems.begin(), outItems.end()),
+        outItems.end());
+
+    size_t length = outItems.size();
+    while (length > 0 && (outItems[length - 1] - 1) % inNumParts != inPart)
+        length--;
+    outItems.resize(length);
+}
+
+/**
+ * @brief Frequent itemsets found by a mining algorithm
+ */
+class FrequentItemsets {
+public:
+    FrequentItemsets() : mMaxLength(0) { }
+
+    /**
+     * @brief Add an itemset, with its items in any order
+     */
+    void add(const std::vector<uint32_t> &inItems, double inCount) {
+        mCounts.push_back(inCount);
+        mOffsets.push_back(mItems.size());
+        mItems.insert(mItems.end(), inItems.begin(), inItems.end());
+        if (inItems.size() > mMaxLength)
+            mMaxLength = inItems.size();
+    }
+
+    bool empty() const {
+        return mCounts.empty();
+    }
+
+    /**
+     * @brief Return all itemsets as rows of width w, preceded by w
+     *
+     * Every row is the itemset's count followed by its items in ascending
+     * order. Itemsets with fewer than w - 1 items repeat their largest item,
+     * so that rows can be sliced without knowing their length.
+     */
+    MutableArrayHandle<double> toArray(const Allocator &inAllocator) const {
+        size_t width = mMaxLength + 1;
+        MutableArrayHandle<double> result = inAllocator.allocateArray<double>(
+            1 + width * mCounts.size());
+        result[0] = static_cast<double>(width);
+
+        std::vector<uint32_t> items;
+        for (size_t i = 0; i < mCounts.size(); i++) {
+            double *row = result.ptr() + 1 + width * i;
+            size_t end = i + 1 < mCounts.size()
+                ? mOffsets[i + 1] : mItems.size();
+            items.assign(mItems.begin() + mOffsets[i], mItems.begin() + end);
+            std::sort(items.begin(), items.end());
+
+            row[0] = mCounts[i];
+            std::copy(items.begin(), items.end(), row + 1);
+            std::fill(row + 1 + items.size(), row + width,
+                static_cast<double>(items.back()));
+        }
+        return result;
+    }
+
+private:
+    std::vector<double> mCounts;
+    std::vector<size_t> mOffsets;
+    /// Items of all itemsets, concatenated
+    std::vector<uint32_t> mItems;
+    size_t mMaxLength;
+};
+
+} // namespace assoc_rules
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_MODULES_ASSOC_RULES_FREQUENT_ITEMSETS_HPP)
@@ -0,0 +1,863 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file naive_bayes.cpp
+ *
+ * @brief Naive Bayes training functions
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <utils/Math.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "naive_bayes.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace bayes {
+
+/**
+ * @brief Hash of a (class, attr, value) triple
+ *
+ * The caller has to map -0.0 to 0.0 first, since they are the same value but
+ * have different bits.
+ */
+static inline
+uint64_t
+hashKey(int32_t inClass, int32_t inAttr, double inValue) {
+    uint64_t valueBits;
+    std::memcpy(&valueBits, &inValue, sizeof(valueBits));
+
+    uint64_t h = static_cast<uint32_t>(inClass);
+    h = h * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(inAttr);
+    h = h * 0x9E3779B97F4A7C15ULL + valueBits;
+    // Finalizer of MurmurHash3, so that the low bits depend on all bits
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * @brief Transition state for the Naive Bayes counts aggregate
+ *
+ * The state is a hash table (with open addressing and linear probing) that
+ * maps triples (class, attr, value) to the number of training rows with that
+ * class and value of the attribute, i.e., \#(c,i,a). The number of rows of
+ * class c, \#c, is stored with the key (c, 0, 0). Attributes are numbered
+ * starting from 1, so these keys do not collide with any feature triple.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * numAttrs, capacity, numKeys, followed by capacity slots of the form
+ * (class, attr, value, count). A slot is empty if its count is 0. The capacity
+ * is always a power of 2, and we keep the table at most half full.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0. Handle::operator[] will
+ * perform bounds checking.
+ */
+template <class Handle>
+class NBCountsTransitionState {
+    template <class OtherHandle>
+    friend class NBCountsTransitionState;
+
+public:
+    NBCountsTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[1]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inNumAttrs) {
+        uint32_t cap = utils::nextPowerOfTwo(4 * (inNumAttrs + 1));
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(cap));
+        rebind(cap);
+        numAttrs = inNumAttrs;
+        capacity = cap;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return capacity > 0;
+    }
+
+    /**
+     * @brief Make sure that inNumNewKeys more keys can be inserted without
+     *     exceeding the maximum load factor
+     *
+     * If the table needs to grow, we double its capacity (as often as
+     * necessary) and rehash all keys into newly allocated storage.
+     */
+    void reserve(const Allocator &inAllocator, uint32_t inNumNewKeys) {
+        uint64_t required = 2 * (static_cast<uint64_t>(numKeys)
+            + inNumNewKeys);
+        if (required <= capacity)
+            return;
+
+        uint64_t cap = capacity;
+        while (cap < required)
+            cap *= 2;
+        if (cap > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Too many distinct (class, attribute, "
+                "value) triples.");
+
+        // Save our current state, so we can subsequently restore it with the
+        // new storage
+        NBCountsTransitionState oldSelf = *this;
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(static_cast<uint32_t>(cap)));
+        rebind(static_cast<uint32_t>(cap));
+        numAttrs = oldSelf.numAttrs;
+        capacity = static_cast<uint32_t>(cap);
+        numKeys = 0;
+        add(oldSelf);
+    }
+
+    /**
+     * @brief Add to the count of a triple
+     *
+     * The caller has to reserve() space beforehand.
+     */
+    void add(int32_t inClass, int32_t inAttr, double inValue,
+        double inCount) {
+
+        // -0.0 and 0.0 are the same value, but have different bits
+        if (inValue == 0)
+            inValue = 0;
+        double *slot = find(inClass, inAttr, inValue);
+        if (slot[3] == 0) {
+            madlib_assert(2 * (static_cast<uint64_t>(numKeys) + 1)
+                    <= capacity,
+                std::logic_error("Naive Bayes hash table is full."));
+            slot[0] = inClass;
+            slot[1] = inAttr;
+            slot[2] = inValue;
+            numKeys = numKeys + 1;
+        }
+        slot[3] += inCount;
+    }
+
+    /**
+     * @brief Add all counts of another state
+     *
+     * The caller has to reserve() space beforehand.
+     */
+    template <class OtherHandle>
+    void add(const NBCountsTransitionState<OtherHandle> &inOther) {
+        for (uint32_t i = 0; i < inOther.capacity; i++) {
+            const double *slot = inOther.slots + 4 * i;
+            if (slot[3] != 0)
+                add(static_cast<int32_t>(slot[0]),
+                    static_cast<int32_t>(slot[1]),
+                    slot[2], slot[3]);
+        }
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inCapacity) {
+        return 3 + 4 * static_cast<size_t>(inCapacity);
+    }
+
+    void rebind(uint32_t inCapacity) {
+        madlib_assert(mStorage.size() >= arraySize(inCapacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        numAttrs.rebind(&mStorage[0]);
+        capacity.rebind(&mStorage[1]);
+        numKeys.rebind(&mStorage[2]);
+        // The table may be empty, so compute the pointer without going
+        // through the bounds-checked Handle::operator[]
+        slots = mStorage.ptr() + 3;
+    }
+
+    /**
+     * @brief Return the slot of a triple, or the empty slot where it belongs
+     */
+    double *find(int32_t inClass, int32_t inAttr, double inValue) {
+        uint64_t mask = static_cast<uint64_t>(capacity) - 1;
+        uint64_t pos = hashKey(inClass, inAttr, inValue) & mask;
+        for (;;) {
+            double *slot = slots + 4 * pos;
+            if (slot[3] == 0 || (slot[0] == inClass && slot[1] == inAttr
+                    && slot[2] == inValue))
+                return slot;
+            pos = (pos + 1) & mask;
+        }
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numAttrs;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numKeys;
+    typename HandleTraits<Handle>::DoublePtr slots;
+};
+
+/**
+ * @brief Perform the Naive Bayes counts transition step
+ *
+ * Adds one training row: The class count and one count for each of the first
+ * numAttrs attributes.
+ */
+AnyType
+nb_counts_transition::run(AnyType &args) {
+    NBCountsTransitionState<MutableArrayHandle<double> > state = args[0];
+    int32_t cls = args[1].getAs<int32_t>();
+    ArrayHandle<double> attrs = args[2].getAs<ArrayHandle<double> >();
+    int32_t numAttrs = args[3].getAs<int32_t>();
+
+    if (!state.isInitialized()) {
+        if (numAttrs < 1)
+            throw std::invalid_argument("Number of attributes must be "
+                "positive.");
+        state.initialize(*this, static_cast<uint32_t>(numAttrs));
+    } else if (static_cast<uint32_t>(numAttrs) != state.numAttrs)
+        throw std::invalid_argument("Number of attributes must not change "
+            "during aggregation.");
+    if (attrs.size() < static_cast<size_t>(numAttrs))
+        throw std::invalid_argument("Attribute array is shorter than the "
+            "number of attributes.");
+    for (uint32_t i = 0; i < state.numAttrs; i++)
+        if (std::isnan(attrs[i]))
+            throw std::invalid_argument("Attribute values must not be NaN.");
+
+    state.reserve(*this, static_cast<uint32_t>(numAttrs) + 1);
+    state.add(cls, 0, 0, 1);
+    for (uint32_t i = 0; i < state.numAttrs; i++)
+        state.add(cls, static_cast<int32_t>(i + 1), attrs[i], 1);
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+nb_counts_merge_states::run(AnyType &args) {
+    NBCountsTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    NBCountsTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    if (stateLeft.numAttrs != stateRight.numAttrs)
+        throw std::invalid_argument("Number of attributes must not change "
+            "during aggregation.");
+
+    stateLeft.reserve(*this, stateRight.numKeys);
+    stateLeft.add(stateRight);
+    return stateLeft;
+}
+
+namespace {
+
+/**
+ * @brief Order rows of a flat array by their first three elements, i.e., by
+ *     (class, attr, value)
+ */
+struct NBKeyLess {
+    NBKeyLess(const double *inRows, size_t inWidth)
+      : mRows(inRows), mWidth(inWidth) { }
+
+    bool operator()(uint32_t inLeft, uint32_t inRight) const {
+        return std::lexicographical_compare(
+            mRows + mWidth * inLeft, mRows + mWidth * inLeft + 3,
+            mRows + mWidth * inRight, mRows + mWidth * inRight + 3);
+    }
+
+    const double *mRows;
+    size_t mWidth;
+};
+
+} // anonymous namespace
+
+/**
+ * @brief Perform the Naive Bayes counts final step
+ *
+ * Returns the non-zero counts as a flat array of quadruples
+ * (class, attr, value, count), ordered by (class, attr, value). Class counts
+ * have attr = value = 0.
+ */
+AnyType
+nb_counts_final::run(AnyType &args) {
+    NBCountsTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (!state.isInitialized() || state.numKeys == 0)
+        return Null();
+
+    std::vector<uint32_t> order;
+    order.reserve(state.numKeys);
+    for (uint32_t i = 0; i < state.capacity; i++)
+        if (state.slots[4 * i + 3] != 0)
+            order.push_back(i);
+    std::sort(order.begin(), order.end(), NBKeyLess(state.slots, 4));
+
+    MutableArrayHandle<double> result = allocateArray<double>(4 * order.size());
+    for (size_t i = 0; i < order.size(); i++)
+        std::copy(state.slots + 4 * order[i], state.slots + 4 * order[i] + 4,
+            result.ptr() + 4 * i);
+    return result;
+}
+
+/**
+ * @brief Transition state for the Naive Bayes model aggregate
+ *
+ * The state is a list of rows (class, attr, value, cnt, attr_cnt), with the
+ * class priors stored as rows (class, 0, 0, class_cnt, all_cnt). The layout
+ * of the DOUBLE PRECISION array is: numRows, capacity, followed by capacity
+ * rows of 5 elements each. Since we do not want to reallocate too often, the
+ * capacity is doubled whenever it is exhausted.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 2, and all elemenets are 0. Handle::operator[] will
+ * perform bounds checking.
+ */
+template <class Handle>
+class NBModelTransitionState {
+    template <class OtherHandle>
+    friend class NBModelTransitionState;
+
+public:
+    NBModelTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[1]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Make sure that inNumNewRows more rows can be appended
+     */
+    void reserve(const Allocator &inAllocator, uint32_t inNumNewRows) {
+        uint64_t required = static_cast<uint64_t>(numRows) + inNumNewRows;
+        if (required <= capacity)
+            return;
+
+        uint64_t cap = std::max<uint64_t>(capacity, 16);
+        while (cap < required)
+            cap *= 2;
+        if (cap > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Too many rows in Naive Bayes model.");
+
+        // Save our current state, so we can subsequently restore it with the
+        // new storage
+        NBModelTransitionState oldSelf = *this;
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(static_cast<uint32_t>(cap)));
+        rebind(static_cast<uint32_t>(cap));
+        numRows = oldSelf.numRows;
+        capacity = static_cast<uint32_t>(cap);
+        std::copy(oldSelf.rows, oldSelf.rows + 5 * oldSelf.numRows, rows);
+    }
+
+    /**
+     * @brief Append rows. The caller has to reserve() space beforehand.
+     */
+    void append(const double *inRows, uint32_t inNumRows) {
+        madlib_assert(static_cast<uint64_t>(numRows) + inNumRows <= capacity,
+            std::logic_error("Naive Bayes model state is full."));
+        std::copy(inRows, inRows + 5 * inNumRows, rows + 5 * numRows);
+        numRows = numRows + inNumRows;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inCapacity) {
+        return 2 + 5 * static_cast<size_t>(inCapacity);
+    }
+
+    void rebind(uint32_t inCapacity) {
+        madlib_assert(mStorage.size() >= arraySize(inCapacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        numRows.rebind(&mStorage[0]);
+        capacity.rebind(&mStorage[1]);
+        rows = mStorage.ptr() + 2;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::DoublePtr rows;
+};
+
+/**
+ * @brief Perform the Naive Bayes model transition step
+ */
+AnyType
+nb_model_transition::run(AnyType &args) {
+    NBModelTransitionState<MutableArrayHandle<double> > state = args[0];
+    double row[5] = {
+        static_cast<double>(args[1].getAs<int32_t>()),
+        static_cast<double>(args[2].getAs<int32_t>()),
+        args[3].getAs<double>(),
+        args[4].getAs<double>(),
+        args[5].getAs<double>()
+    };
+
+    state.reserve(*this, 1);
+    state.append(row, 1);
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+nb_model_merge_states::run(AnyType &args) {
+    NBModelTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    NBModelTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateRight.numRows == 0)
+        return stateLeft;
+    if (stateLeft.numRows == 0)
+        return stateRight;
+
+    stateLeft.reserve(*this, stateRight.numRows);
+    stateLeft.append(stateRight.rows, stateRight.numRows);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the Naive Bayes model final step
+ *
+ * Returns the rows as a flat array of 5-tuples, ordered by
+ * (class, attr, value).
+ */
+AnyType
+nb_model_final::run(AnyType &args) {
+    NBModelTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (state.numRows == 0)
+        return Null();
+
+    std::vector<uint32_t> order(state.numRows);
+    for (uint32_t i = 0; i < state.numRows; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), NBKeyLess(state.rows, 5));
+
+    MutableArrayHandle<double> result = allocateArray<double>(5 * order.size());
+    for (size_t i = 0; i < order.size(); i++)
+        std::copy(state.rows + 5 * order[i], state.rows + 5 * order[i] + 5,
+            result.ptr() + 5 * i);
+    return result;
+}
+
+/**
+ * @brief Naive Bayes classifier, cached per call site of nb_classify()
+ *
+ * For each distinct (attr, value) pair, logProbs holds the vector of
+ * \f$ \log_{10} P(A_i = a \mid C = c) \f$ over all classes c, so that scoring
+ * a row takes one hash lookup and one vector addition per attribute. A
+ * probability that the SQL implementation would not define (the count is 0
+ * without smoothing, or the model has no row for the class) is NaN, so that
+ * it propagates to the score of the class.
+ *
+ * The struct is followed by the arrays it points to, in a single block of
+ * call-site memory. It is plain-old data as required by
+ * UDF::callSiteCache().
+ */
+struct NBClassifier {
+    /**
+     * The model array of the last call. If the same array is passed again
+     * (which is the case for the result of an uncorrelated scalar subquery),
+     * we do not even need to compare the contents.
+     */
+    const double *modelPtr;
+    size_t modelSize;
+    int32_t numAttrs;
+    double smoothingFactor;
+    uint32_t numClasses;
+    uint32_t numKeys;
+    uint32_t capacity;
+
+    double *model;
+    double *logPriors;
+    double *keyValues;
+    double *logProbs;
+    double *scores;
+    int32_t *classes;
+    int32_t *keyAttrs;
+    uint32_t *slots;
+
+    /**
+     * @brief Whether this classifier was built for the given arguments
+     */
+    bool matches(const ArrayHandle<double> &inModel, int32_t inNumAttrs,
+        double inSmoothingFactor) {
+
+        if (numAttrs != inNumAttrs || smoothingFactor != inSmoothingFactor
+            || modelSize != inModel.size())
+            return false;
+        if (modelPtr != inModel.ptr()) {
+            if (std::memcmp(model, inModel.ptr(), sizeof(double) * modelSize))
+                return false;
+            modelPtr = inModel.ptr();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Return the slot of an (attr, value) pair, or the empty slot where
+     *     it belongs
+     */
+    uint32_t *find(int32_t inAttr, double inValue) const {
+        uint64_t mask = static_cast<uint64_t>(capacity) - 1;
+        uint64_t pos = hashKey(0, inAttr, inValue) & mask;
+        for (;;) {
+            uint32_t *slot = slots + pos;
+            if (*slot == 0 || (keyAttrs[*slot - 1] == inAttr
+                    && keyValues[*slot - 1] == inValue))
+                return slot;
+            pos = (pos + 1) & mask;
+        }
+    }
+
+    /**
+     * @brief Compute the log-probabilities of all classes for a row
+     *
+     * The scores are left in \c scores. Returns false if the probabilities of
+     * all classes are undefined because an attribute value does not occur in
+     * the model.
+     */
+    template <class Array>
+    bool score(const Array &inAttrs) {
+        std::copy(logPriors, logPriors + numClasses, scores);
+        for (int32_t i = 0; i < numAttrs; i++) {
+            // Map -0.0 to 0.0, as NBClassifierBuilder::normalized() does
+            double value = inAttrs[static_cast<size_t>(i)];
+            uint32_t k = *find(i + 1, value == 0 ? 0 : value);
+            if (k == 0)
+                return false;
+            const double *probs = logProbs
+                + static_cast<size_t>(k - 1) * numClasses;
+            for (uint32_t c = 0; c < numClasses; c++)
+                scores[c] += probs[c];
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Build an NBClassifier from a model returned by nb_model()
+ *
+ * The constructor parses the model, so that we know how much memory the
+ * classifier needs before building it in build().
+ */
+class NBClassifierBuilder {
+public:
+    NBClassifierBuilder(const ArrayHandle<double> &inModel,
+        int32_t inNumAttrs, double inSmoothingFactor)
+      : mModel(inModel), mNumAttrs(inNumAttrs),
+        mSmoothingFactor(inSmoothingFactor) {
+
+        if (mModel.size() % 5 != 0)
+            throw std::invalid_argument("Invalid Naive Bayes model. Models "
+                "must be obtained from the nb_model aggregate.");
+
+        const double *rows = mModel.ptr();
+        size_t numRows = mModel.size() / 5;
+        for (size_t i = 0; i < numRows; i++) {
+            const double *row = rows + 5 * i;
+            int32_t attr = static_cast<int32_t>(row[1]);
+            if (attr == 0)
+                mPriors.push_back(std::make_pair(
+                    static_cast<int32_t>(row[0]), i));
+            else if (attr > 0 && attr <= mNumAttrs)
+                mKeys.push_back(std::make_pair(attr, normalized(row[2])));
+        }
+        std::sort(mPriors.begin(), mPriors.end());
+        for (size_t i = 1; i < mPriors.size(); i++)
+            if (mPriors[i - 1].first == mPriors[i].first)
+                throw std::invalid_argument("Invalid Naive Bayes model. "
+                    "Duplicate class prior.");
+        std::sort(mKeys.begin(), mKeys.end());
+        mKeys.erase(std::unique(mKeys.begin(), mKeys.end()), mKeys.end());
+
+        if (mPriors.size() >= std::numeric_limits<uint32_t>::max()
+            || mKeys.size() >= std::numeric_limits<uint32_t>::max() / 2)
+            throw std::runtime_error("Naive Bayes model is too large.");
+        mNumClasses = static_cast<uint32_t>(mPriors.size());
+        mNumKeys = static_cast<uint32_t>(mKeys.size());
+        mCapacity = utils::nextPowerOfTwo(2 * mNumKeys + 1);
+    }
+
+    /**
+     * @brief Number of bytes needed for the classifier
+     */
+    size_t size() const {
+        return headerSize()
+            + sizeof(double) * (mModel.size() + 2 * mNumClasses + mNumKeys
+                + static_cast<size_t>(mNumKeys) * mNumClasses)
+            + sizeof(int32_t) * (mNumClasses + mNumKeys)
+            + sizeof(uint32_t) * mCapacity;
+    }
+
+    /**
+     * @brief Build the classifier in zeroed memory of (at least) size() bytes
+     */
+    NBClassifier *build(void *inMemory) const {
+        NBClassifier *clf = static_cast<NBClassifier*>(inMemory);
+        double *doubles = reinterpret_cast<double*>(
+            static_cast<char*>(inMemory) + headerSize());
+
+        clf->modelPtr = mModel.ptr();
+        clf->modelSize = mModel.size();
+        clf->numAttrs = mNumAttrs;
+        clf->smoothingFactor = mSmoothingFactor;
+        clf->numClasses = mNumClasses;
+        clf->numKeys = mNumKeys;
+        clf->capacity = mCapacity;
+        clf->model = doubles;
+        clf->logPriors = clf->model + mModel.size();
+        clf->keyValues = clf->logPriors + mNumClasses;
+        clf->logProbs = clf->keyValues + mNumKeys;
+        clf->scores = clf->logProbs + static_cast<size_t>(mNumKeys)
+            * mNumClasses;
+        clf->classes = reinterpret_cast<int32_t*>(clf->scores + mNumClasses);
+        clf->keyAttrs = clf->classes + mNumClasses;
+        clf->slots = reinterpret_cast<uint32_t*>(clf->keyAttrs + mNumKeys);
+
+        const double *rows = mModel.ptr();
+        std::copy(rows, rows + mModel.size(), clf->model);
+
+        for (uint32_t c = 0; c < mNumClasses; c++) {
+            const double *row = rows + 5 * mPriors[c].second;
+            clf->classes[c] = mPriors[c].first;
+            clf->logPriors[c] = std::log10(row[3] / row[4]);
+        }
+
+        for (uint32_t k = 0; k < mNumKeys; k++) {
+            clf->keyAttrs[k] = mKeys[k].first;
+            clf->keyValues[k] = mKeys[k].second;
+            *clf->find(mKeys[k].first, mKeys[k].second) = k + 1;
+        }
+
+        std::fill(clf->logProbs,
+            clf->logProbs + static_cast<size_t>(mNumKeys) * mNumClasses,
+            std::numeric_limits<double>::quiet_NaN());
+        size_t numRows = mModel.size() / 5;
+        for (size_t i = 0; i < numRows; i++) {
+            const double *row = rows + 5 * i;
+            int32_t attr = static_cast<int32_t>(row[1]);
+            if (attr <= 0 || attr > mNumAttrs)
+                continue;
+
+            int32_t cls = static_cast<int32_t>(row[0]);
+            std::vector<std::pair<int32_t, size_t> >::const_iterator prior
+                = std::lower_bound(mPriors.begin(), mPriors.end(),
+                    std::make_pair(cls, static_cast<size_t>(0)));
+            if (prior == mPriors.end() || prior->first != cls)
+                continue;
+
+            size_t c = static_cast<size_t>(prior - mPriors.begin());
+            double classCount = rows[5 * prior->second + 3];
+            uint32_t k = *clf->find(attr, normalized(row[2])) - 1;
+            double &logProb = clf->logProbs[
+                static_cast<size_t>(k) * mNumClasses + c];
+            if (!std::isnan(logProb))
+                throw std::invalid_argument("Invalid Naive Bayes model. "
+                    "Duplicate feature probability.");
+            if (row[3] > 0 || mSmoothingFactor > 0)
+                logProb = std::log10((row[3] + mSmoothingFactor)
+                    / (classCount + mSmoothingFactor * row[4]));
+        }
+        return clf;
+    }
+
+    /**
+     * @brief Map -0.0 to 0.0, since they are the same value but have
+     *     different bits
+     */
+    static double normalized(double inValue) {
+        return inValue == 0 ? 0 : inValue;
+    }
+
+private:
+    static size_t headerSize() {
+        return (sizeof(NBClassifier) + sizeof(double) - 1)
+            / sizeof(double) * sizeof(double);
+    }
+
+    const ArrayHandle<double> &mModel;
+    int32_t mNumAttrs;
+    double mSmoothingFactor;
+    // Pairs of class and row index of its prior, sorted by class
+    std::vector<std::pair<int32_t, size_t> > mPriors;
+    // Distinct (attr, value) pairs, sorted
+    std::vector<std::pair<int32_t, double> > mKeys;
+    uint32_t mNumClasses;
+    uint32_t mNumKeys;
+    uint32_t mCapacity;
+};
+
+/**
+ * @brief Classify a row with a Naive Bayes model
+ *
+ * Returns all classes of maximal probability. If, for the row, the
+ * probabilities of all classes are undefined (in particular, if an attribute
+ * value does not occur in the training data), all classes are returned. This
+ * is the same result as the argmax over the log-probabilities computed in SQL.
+ *
+ * The model (typically the result of a scalar subquery) is hashed only at the
+ * first call from each call site, see NBClassifier.
+ */
+AnyType
+nb_classify::run(AnyType &args) {
+    ArrayHandle<double> attrs = args[0].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> model = args[1].getAs<ArrayHandle<double> >();
+    int32_t numAttrs = args[2].getAs<int32_t>();
+    double smoothingFactor = args[3].getAs<double>();
+
+    if (numAttrs < 1)
+        throw std::invalid_argument("Number of attributes must be positive.");
+    if (attrs.size() < static_cast<size_t>(numAttrs))
+        throw std::invalid_argument("Attribute array is shorter than the "
+            "number of attributes.");
+    if (!(smoothingFactor >= 0))
+        throw std::invalid_argument("Smoothing factor must be non-negative.");
+
+    void *&cache = callSiteCache();
+    NBClassifier *clf = static_cast<NBClassifier*>(cache);
+    if (clf == NULL || !clf->matches(model, numAttrs, smoothingFactor)) {
+        if (clf != NULL) {
+            cache = NULL;
+            freeCallSiteCache(clf);
+        }
+        NBClassifierBuilder builder(model, numAttrs, smoothingFactor);
+        clf = builder.build(allocateCallSiteCache(builder.size()));
+        cache = clf;
+    }
+
+    uint32_t numClasses = clf->numClasses;
+    if (numClasses == 0)
+        return Null();
+
+    bool defined = clf->score(attrs);
+    double maxScore = -std::numeric_limits<double>::infinity();
+    uint32_t numMax = 0;
+    if (defined) {
+        for (uint32_t c = 0; c < numClasses; c++) {
+            double score = clf->scores[c];
+            if (std::isnan(score) || score < maxScore)
+                continue;
+            if (score > maxScore || numMax == 0) {
+                maxScore = score;
+                numMax = 0;
+            }
+            numMax++;
+        }
+    }
+
+    MutableArrayHandle<int32_t> result = allocateArray<int32_t>(
+        numMax > 0 ? numMax : numClasses);
+    size_t pos = 0;
+    for (uint32_t c = 0; c < numClasses; c++)
+        if (numMax == 0 || clf->scores[c] == maxScore)
+            result[pos++] = clf->classes[c];
+    return result;
+}
+
+/**
+ * @brief Compute the Naive Bayes probabilities of all classes for a row
+ *
+ * Returns a two-dimensional array with one pair (class, probability) per
+ * class, ordered by class. The probabilities are those that
+ * create_bayes_probabilities() used to compute with a join against the model
+ * tables: Log-probabilities are normalized by the maximum before
+ * exponentiating, a difference of less than -300 is taken as probability 0,
+ * and the probability of a class whose log-probability is undefined is NaN
+ * (NULL in SQL).
+ *
+ * Like nb_classify(), the function hashes the model only at the first call
+ * from each call site.
+ */
+AnyType
+nb_probabilities::run(AnyType &args) {
+    ArrayHandle<double> attrs = args[0].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> model = args[1].getAs<ArrayHandle<double> >();
+    int32_t numAttrs = args[2].getAs<int32_t>();
+    double smoothingFactor = args[3].getAs<double>();
+
+    if (numAttrs < 1)
+        throw std::invalid_argument("Number of attributes must be positive.");
+    if (attrs.size() < static_cast<size_t>(numAttrs))
+        throw std::invalid_argument("Attribute array is shorter than the "
+            "number of attributes.");
+    if (!(smoothingFactor >= 0))
+        throw std::invalid_argument("Smoothing factor must be non-negative.");
+
+    void *&cache = callSiteCache();
+    NBClassifier *clf = static_cast<NBClassifier*>(cache);
+    if (clf == NULL || !clf->matches(model, numAttrs, smoothingFactor)) {
+        if (clf != NULL) {
+            cache = NULL;
+            freeCallSiteCache(clf);
+        }
+        NBClassifierBuilder builder(model, numAttrs, smoothingFactor);
+        clf = builder.build(allocateCallSiteCache(builder.size()));
+        cache = clf;
+    }
+
+    uint32_t numClasses = clf->numClasses;
+    if (numClasses == 0)
+        return Null();
+
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    double maxScore = nan;
+    if (clf->score(attrs)) {
+        for (uint32_t c = 0; c < numClasses; c++)
+            if (!std::isnan(clf->scores[c])
+                && (std::isnan(maxScore) || clf->scores[c] > maxScore))
+                maxScore = clf->scores[c];
+    }
+
+    MutableArrayHandle<double> result = allocateArray<double>(numClasses, 2);
+    double sum = 0;
+    for (uint32_t c = 0; c < numClasses; c++) {
+        double diff = clf->scores[c] - maxScore;
+        double prob = std::isnan(diff) ? nan
+            : diff < -300 ? 0 : std::pow(10., diff);
+        result[2 * c] = clf->classes[c];
+        result[2 * c + 1] = prob;
+        if (!std::isnan(prob))
+            sum += prob;
+    }
+    for (uint32_t c = 0; c < numClasses; c++)
+        result[2 * c + 1] /= sum;
+    return result;
+}
+
+} // namespace bayes
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,46 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file naive_bayes.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Naive Bayes counts: Transition function
+ */
+DECLARE_UDF(bayes, nb_counts_transition)
+
+/**
+ * @brief Naive Bayes counts: State merge function
+ */
+DECLARE_UDF(bayes, nb_counts_merge_states)
+
+/**
+ * @brief Naive Bayes counts: Final function
+ */
+DECLARE_UDF(bayes, nb_counts_final)
+
+/**
+ * @brief Naive Bayes model: Transition function
+ */
+DECLARE_UDF(bayes, nb_model_transition)
+
+/**
+ * @brief Naive Bayes model: State merge function
+ */
+DECLARE_UDF(bayes, nb_model_merge_states)
+
+/**
+ * @brief Naive Bayes model: Final function
+ */
+DECLARE_UDF(bayes, nb_model_final)
+
+/**
+ * @brief Naive Bayes: Classify a row with a model returned by nb_model()
+ */
+DECLARE_UDF(bayes, nb_classify)
+
+/**
+ * @brief Naive Bayes: Compute the class probabilities of a row with a model
+ *     returned by nb_model()
+ */
+DECLARE_UDF(bayes, nb_probabilities)
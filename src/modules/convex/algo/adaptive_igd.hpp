@@ -0,0 +1,168 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file adaptive_igd.hpp
+ *
+ * Generic implementaion of incremental gradient descent with per-coordinate
+ * step sizes (AdaGrad, Adam), in the fashion of user-definied aggregates.
+ * They should be called by actually database functions, after arguments are
+ * properly parsed.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#ifndef MADLIB_MODULES_CONVEX_ALGO_ADAPTIVE_IGD_HPP_
+#define MADLIB_MODULES_CONVEX_ALGO_ADAPTIVE_IGD_HPP_
+
+#include <cmath>
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Incremental gradient with per-coordinate step sizes
+ *
+ * With AdaGrad, coordinate \f$ i \f$ takes steps of size
+ * \f$ \eta / (\sqrt{G_i} + \epsilon) \f$, where \f$ G_i \f$ is the sum of the
+ * squared partial derivatives seen so far. With Adam, the step is
+ * \f$ \eta \hat m_i / (\sqrt{\hat v_i} + \epsilon) \f$, where
+ * \f$ \hat m_i \f$ and \f$ \hat v_i \f$ are the bias-corrected moving
+ * averages of the partial derivative and of its square. Rarely active or
+ * badly scaled features thus get larger steps than with a single step size.
+ *
+ * Every step needs the full gradient of the tuple, so the cost per tuple is
+ * linear in the dimension of the model, even for sparse independent
+ * variables.
+ */
+template <class State, class ConstState, class Task>
+class AdaptiveIGD {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Task::tuple_type tuple_type;
+    typedef typename Task::model_type model_type;
+
+    enum Method { AdaGrad = 0, Adam = 1 };
+
+    static void transition(state_type &state, const tuple_type &tuple);
+    static void transitionWithLoss(state_type &state,
+            const tuple_type &tuple);
+    static void merge(state_type &state, const_state_type &otherState);
+    static void final(state_type &state);
+};
+
+template <class State, class ConstState, class Task>
+void
+AdaptiveIGD<State, ConstState, Task>::transition(state_type &state,
+        const tuple_type &tuple) {
+    ColumnVector g = ColumnVector::Zero(state.task.dimension);
+    model_type gradient;
+    gradient.rebind(g.data(), g.size());
+    Task::gradient(state.algo.incrModel, tuple.indVar, tuple.depVar,
+            gradient);
+
+    double epsilon = state.task.epsilon;
+    state.algo.incrNumSteps ++;
+    if (state.task.method == AdaGrad) {
+        state.algo.incrAccum.array() += g.array().square();
+        state.algo.incrModel.array() -= state.task.stepsize * g.array()
+            / (state.algo.incrAccum.array().sqrt() + epsilon);
+    } else {
+        double beta1 = state.task.beta1;
+        double beta2 = state.task.beta2;
+        double t = static_cast<double>(state.algo.incrNumSteps);
+        state.algo.incrMoment = beta1 * state.algo.incrMoment
+            + (1. - beta1) * g;
+        state.algo.incrAccum.array() = beta2 * state.algo.incrAccum.array()
+            + (1. - beta2) * g.array().square();
+        // Bias correction of both moving averages, folded into the step size
+        double stepsize = state.task.stepsize
+            * std::sqrt(1. - std::pow(beta2, t)) / (1. - std::pow(beta1, t));
+        state.algo.incrModel.array() -= stepsize
+            * state.algo.incrMoment.array()
+            / (state.algo.incrAccum.array().sqrt() + epsilon);
+    }
+}
+
+/**
+ * @brief Transition and loss computation
+ *
+ * As in IGD::transitionWithLoss(), the loss is evaluated at the incremental
+ * model, right before the update of this tuple.
+ */
+template <class State, class ConstState, class Task>
+void
+AdaptiveIGD<State, ConstState, Task>::transitionWithLoss(state_type &state,
+        const tuple_type &tuple) {
+    state.algo.loss += Task::loss(state.algo.incrModel, tuple.indVar,
+            tuple.depVar);
+    transition(state, tuple);
+}
+
+/**
+ * @brief Merge the model and the accumulators of two states
+ *
+ * Models are averaged, weighted by rows seen, as in IGD::merge(). The
+ * accumulators have to be merged such that the merged state looks as if it
+ * had seen the tuples of both states: AdaGrad sums of squares (and the
+ * numbers of steps) are sums, so the increments of both states over the
+ * common task state are added. The Adam moving averages are averages, so
+ * they are weighted like the models.
+ */
+template <class State, class ConstState, class Task>
+void
+AdaptiveIGD<State, ConstState, Task>::merge(state_type &state,
+        const_state_type &otherState) {
+    if (state.algo.numRows == 0) {
+        state.algo.incrNumSteps = otherState.algo.incrNumSteps;
+        state.algo.incrModel = otherState.algo.incrModel;
+        state.algo.incrAccum = otherState.algo.incrAccum;
+        state.algo.incrMoment = otherState.algo.incrMoment;
+        return;
+    } else if (otherState.algo.numRows == 0) {
+        return;
+    }
+
+    double totalNumRows = static_cast<double>(state.algo.numRows
+        + otherState.algo.numRows);
+    double weight = static_cast<double>(state.algo.numRows) / totalNumRows;
+    double otherWeight = 1. - weight;
+
+    state.algo.incrModel = weight * state.algo.incrModel
+        + otherWeight * otherState.algo.incrModel;
+    state.algo.incrNumSteps = state.algo.incrNumSteps
+        + otherState.algo.incrNumSteps - otherState.task.numSteps;
+    if (state.task.method == AdaGrad) {
+        state.algo.incrAccum += otherState.algo.incrAccum;
+        state.algo.incrAccum -= otherState.task.accum;
+    } else {
+        state.algo.incrAccum = weight * state.algo.incrAccum
+            + otherWeight * otherState.algo.incrAccum;
+        state.algo.incrMoment = weight * state.algo.incrMoment
+            + otherWeight * otherState.algo.incrMoment;
+    }
+}
+
+template <class State, class ConstState, class Task>
+void
+AdaptiveIGD<State, ConstState, Task>::final(state_type &state) {
+    state.task.numSteps = state.algo.incrNumSteps;
+    state.task.model = state.algo.incrModel;
+    state.task.accum = state.algo.incrAccum;
+    state.task.moment = state.algo.incrMoment;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif
+
@@ -0,0 +1,161 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file admm.hpp
+ *
+ * Consensus alternating direction method of multipliers (ADMM), with the
+ * local subproblems solved by incremental gradient descent.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#ifndef MADLIB_MODULES_CONVEX_ALGO_ADMM_HPP_
+#define MADLIB_MODULES_CONVEX_ALGO_ADMM_HPP_
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Consensus ADMM over blocks of rows
+ *
+ * The objective \f$ \sum_k f_k(x) \f$ is split into the losses \f$ f_k \f$ of
+ * disjoint blocks of rows. Each iteration (one scan of the data) performs,
+ * with the scaled dual variables \f$ u_k \f$:
+ *
+ * - \f$ x_k \leftarrow \arg\min_x f_k(x)
+ *   + \frac{\rho}{2} \| x - z + u_k \|^2 \f$, approximately, by one pass of
+ *   incremental gradient over block \f$ k \f$, warm-started from the last
+ *   \f$ x_k \f$
+ * - \f$ z \leftarrow \frac 1K \sum_k (x_k + u_k) \f$
+ * - \f$ u_k \leftarrow u_k + x_k - z \f$
+ *
+ * Unlike the model averaging of IGD::merge(), the dual variables pull the
+ * local models towards agreement with the consensus across iterations, so
+ * that fewer scans of the data are needed when the blocks see differently
+ * distributed data.
+ *
+ * The blocks are independent of how the database distributes the rows: Rows
+ * of the same block may be seen by several segments, whose partial local
+ * models are averaged in merge() as in IGD.
+ */
+template <class State, class ConstState, class Task>
+class ADMM {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Task::tuple_type tuple_type;
+    typedef typename Task::model_type model_type;
+
+    static void transitionWithLoss(state_type &state,
+            const tuple_type &tuple, uint32_t block);
+    static void merge(state_type &state, const_state_type &otherState);
+    static void final(state_type &state);
+};
+
+/**
+ * @brief Gradient step on the augmented Lagrangian of the block of the tuple,
+ *     adding the loss of the tuple before the step
+ *
+ * The quadratic penalty is spread evenly over the rows of the block, using
+ * the number of rows the block had in the last iteration. In the first
+ * iteration \f$ z = u_k = 0 \f$, and the penalty is skipped.
+ */
+template <class State, class ConstState, class Task>
+void
+ADMM<State, ConstState, Task>::transitionWithLoss(state_type &state,
+        const tuple_type &tuple, uint32_t block) {
+    model_type localModel;
+    localModel.rebind(state.algo.incrModel.col(block).data(),
+            state.task.dimension);
+
+    state.algo.loss += Task::gradientInPlaceWithLoss(
+            localModel,
+            tuple.indVar,
+            tuple.depVar,
+            state.task.stepsize);
+
+    double blockRows = state.task.lastBlockRows(block);
+    if (blockRows > 0) {
+        localModel -= (state.task.stepsize * state.task.rho / blockRows)
+            * (localModel - state.task.model + state.task.dual.col(block));
+    }
+    state.algo.blockRows(block) += 1;
+}
+
+/**
+ * @brief Merge partial local models, weighted by rows seen per block
+ */
+template <class State, class ConstState, class Task>
+void
+ADMM<State, ConstState, Task>::merge(state_type &state,
+        const_state_type &otherState) {
+    for (Index k = 0; k < state.algo.blockRows.size(); k ++) {
+        double rows = state.algo.blockRows(k);
+        double otherRows = otherState.algo.blockRows(k);
+        if (otherRows == 0) {
+            continue;
+        } else if (rows == 0) {
+            state.algo.incrModel.col(k) = otherState.algo.incrModel.col(k);
+        } else {
+            state.algo.incrModel.col(k) = (rows * state.algo.incrModel.col(k)
+                + otherRows * otherState.algo.incrModel.col(k))
+                / (rows + otherRows);
+        }
+    }
+
+    state.algo.blockRows += otherState.algo.blockRows;
+    state.algo.loss += otherState.algo.loss;
+}
+
+/**
+ * @brief Consensus and dual update, and residuals for the stopping criterion
+ *
+ * Blocks that saw no rows keep their local model and dual variable, and do
+ * not take part in the consensus.
+ */
+template <class State, class ConstState, class Task>
+void
+ADMM<State, ConstState, Task>::final(state_type &state) {
+    ColumnVector oldModel = state.task.model;
+    ColumnVector sum = ColumnVector::Zero(state.task.dimension);
+    double numActive = 0;
+    for (Index k = 0; k < state.algo.blockRows.size(); k ++) {
+        if (state.algo.blockRows(k) > 0) {
+            state.task.localModel.col(k) = state.algo.incrModel.col(k);
+            sum += state.task.localModel.col(k) + state.task.dual.col(k);
+            numActive ++;
+        }
+    }
+    if (numActive == 0)
+        return;
+    state.task.model = sum / numActive;
+
+    double primalResidual = 0;
+    for (Index k = 0; k < state.algo.blockRows.size(); k ++) {
+        if (state.algo.blockRows(k) > 0) {
+            state.task.dual.col(k) += state.task.localModel.col(k)
+                - state.task.model;
+            primalResidual += (state.task.localModel.col(k)
+                - state.task.model).squaredNorm();
+        }
+    }
+    state.task.primalResidual = std::sqrt(primalResidual);
+    state.task.dualResidual = state.task.rho * std::sqrt(numActive)
+        * (state.task.model - oldModel).norm();
+    state.task.lastBlockRows = state.algo.blockRows;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif
+
@@ -0,0 +1,100 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file bundle_igd.hpp
+ *
+ * Incremental gradient descent for a bundle of models that differ only in
+ * their hyperparameters (e.g., the step size), trained in a single pass over
+ * the data.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#ifndef MADLIB_MODULES_CONVEX_ALGO_BUNDLE_IGD_HPP_
+#define MADLIB_MODULES_CONVEX_ALGO_BUNDLE_IGD_HPP_
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Incremental gradient descent for all models of a bundle state
+ *
+ * The models are the columns of <tt>state.algo.incrModel</tt>. For each
+ * tuple, Task::bundleGradientInPlaceWithLoss() computes the inner products
+ * with all models at once (a matrix-vector product) and updates all models
+ * with one rank-one update. All models see the same tuples, so merging and
+ * finalizing work exactly as in IGD, only for every column.
+ */
+template <class State, class ConstState, class Task>
+class BundleIGD {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Task::tuple_type tuple_type;
+
+    static void transitionWithLoss(state_type &state,
+            const tuple_type &tuple);
+    static void merge(state_type &state, const_state_type &otherState);
+    static void final(state_type &state);
+};
+
+/**
+ * @brief Gradient step for all models, adding the loss of the tuple under
+ *     each model before its step
+ */
+template <class State, class ConstState, class Task>
+void
+BundleIGD<State, ConstState, Task>::transitionWithLoss(state_type &state,
+        const tuple_type &tuple) {
+    Task::bundleGradientInPlaceWithLoss(
+            state.algo.incrModel,
+            tuple.indVar,
+            tuple.depVar,
+            state.task.stepsize,
+            state.algo.loss);
+}
+
+template <class State, class ConstState, class Task>
+void
+BundleIGD<State, ConstState, Task>::merge(state_type &state,
+        const_state_type &otherState) {
+    if (state.algo.numRows == 0) {
+        state.algo.incrModel = otherState.algo.incrModel;
+        state.algo.loss = otherState.algo.loss;
+        return;
+    } else if (otherState.algo.numRows == 0) {
+        return;
+    }
+
+    // model averaging, weighted by rows seen (see IGD::merge()). All models
+    // have seen the same rows, so the weights are the same for all columns.
+    double totalNumRows = static_cast<double>(state.algo.numRows
+        + otherState.algo.numRows);
+    state.algo.incrModel *= static_cast<double>(state.algo.numRows)
+        / static_cast<double>(otherState.algo.numRows);
+    state.algo.incrModel += otherState.algo.incrModel;
+    state.algo.incrModel *= static_cast<double>(otherState.algo.numRows)
+        / totalNumRows;
+
+    state.algo.loss += otherState.algo.loss;
+}
+
+template <class State, class ConstState, class Task>
+void
+BundleIGD<State, ConstState, Task>::final(state_type &state) {
+    state.task.model = state.algo.incrModel;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif
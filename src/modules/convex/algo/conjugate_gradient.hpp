@@ -13,6 +13,8 @@
 #ifndef MADLIB_MODULES_CONVEX_ALGO_CONJUGATE_GRADIENT_HPP_
 #define MADLIB_MODULES_CONVEX_ALGO_CONJUGATE_GRADIENT_HPP_
 
+#include <cmath>
+
 namespace madlib {
 
 namespace modules {
@@ -121,6 +123,224 @@ ConjugateGradient<State, ConstState, Task>::final(state_type &state) {
     state.task.model += state.task.stepsize * state.task.direction;
 }
 
+/**
+ * @brief Nonlinear conjugate gradient with a line search in the same pass
+ *
+ * ConjugateGradient takes a fixed step size along each direction, and a
+ * conventional line search would take one pass per trial step. Here, each
+ * pass evaluates the loss, its derivative along task.direction, and the
+ * gradient at all points <tt>task.model + task.candidate(k) *
+ * task.direction</tt>. The final function moves to the candidate of smallest
+ * loss. Its gradient is the gradient at the new model, from which the next
+ * direction follows. Every iteration thus takes exactly one pass.
+ *
+ * The first candidate step size is 0, so the loss never increases. The
+ * others form a geometric grid (with ratio 2) around task.stepsize. For the
+ * next iteration, the grid is centered at the minimum along the current
+ * direction, estimated by the secant method from the two candidates between
+ * which the derivative changes sign.
+ */
+template <class State, class ConstState, class Task>
+class LineSearchConjugateGradient {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Task::tuple_type tuple_type;
+    typedef typename Task::model_type model_type;
+
+    static void transition(state_type &state, const tuple_type &tuple);
+    static void merge(state_type &state, const_state_type &otherState);
+    static void final(state_type &state);
+    static void setCandidates(state_type &state);
+};
+
+template <class State, class ConstState, class Task>
+void
+LineSearchConjugateGradient<State, ConstState, Task>::transition(
+        state_type &state, const tuple_type &tuple) {
+    Task::lineSearchGradientWithLoss(
+            state.task.model,
+            state.task.direction,
+            tuple.indVar,
+            tuple.depVar,
+            state.task.candidate,
+            state.algo.loss,
+            state.algo.derivative,
+            state.algo.incrGradient);
+}
+
+template <class State, class ConstState, class Task>
+void
+LineSearchConjugateGradient<State, ConstState, Task>::merge(
+        state_type &state, const_state_type &otherState) {
+    state.algo.loss += otherState.algo.loss;
+    state.algo.derivative += otherState.algo.derivative;
+    state.algo.incrGradient += otherState.algo.incrGradient;
+}
+
+template <class State, class ConstState, class Task>
+void
+LineSearchConjugateGradient<State, ConstState, Task>::final(
+        state_type &state) {
+    Index numCandidates = state.task.candidate.size();
+
+    // In the first iteration, the direction is 0 and all candidates coincide
+    Index best = 0;
+    if (state.task.iteration > 0) {
+        for (Index k = 1; k < numCandidates; k++)
+            if (state.algo.loss(k) < state.algo.loss(best))
+                best = k;
+
+        double center = state.task.candidate(numCandidates - 1);
+        if (best == 0) {
+            center = state.task.candidate(1) / 2.;
+        } else {
+            for (Index k = 0; k + 1 < numCandidates; k++) {
+                double left = state.algo.derivative(k);
+                double right = state.algo.derivative(k + 1);
+                if (left < 0. && right >= 0.) {
+                    center = state.task.candidate(k) - left
+                        * (state.task.candidate(k + 1)
+                            - state.task.candidate(k)) / (right - left);
+                    break;
+                }
+            }
+        }
+        state.task.stepsize = center;
+    }
+
+    ColumnVector gradient = state.algo.incrGradient.col(best);
+    state.task.model += state.task.candidate(best) * state.task.direction;
+    state.task.loss = state.algo.loss(best);
+
+    // Dai-Yuan, as in ConjugateGradient::final(). We restart from the
+    // steepest direction if not even the smallest step decreased the loss.
+    double denumerator = dot(gradient - state.task.gradient,
+            state.task.direction);
+    if (state.task.iteration == 0 || best == 0 || denumerator == 0.) {
+        state.task.direction = -gradient;
+    } else {
+        double beta = dot(gradient, gradient) / denumerator;
+        state.task.direction *= beta;
+        state.task.direction -= gradient;
+        if (dot(state.task.direction, gradient) >= 0.)
+            state.task.direction = -gradient;
+    }
+    state.task.gradient = gradient;
+    setCandidates(state);
+}
+
+/**
+ * @brief Set the candidate step sizes of the next iteration from
+ *     task.stepsize
+ */
+template <class State, class ConstState, class Task>
+void
+LineSearchConjugateGradient<State, ConstState, Task>::setCandidates(
+        state_type &state) {
+    Index numCandidates = state.task.candidate.size();
+    double middle = (numCandidates - 2) / 2.;
+
+    state.task.candidate(0) = 0.;
+    for (Index k = 1; k < numCandidates; k++)
+        state.task.candidate(k) = state.task.stepsize
+            * std::pow(2., static_cast<double>(k - 1) - middle);
+}
+
+/**
+ * @brief Conjugate gradient method for linear systems \f$ A X = B \f$
+ *
+ * Unlike ConjugateGradient, which minimizes a convex objective with a fixed
+ * step size, this solves a linear system with a symmetric positive definite
+ * matrix A. The tuples are the rows of A, with the 0-based row number as the
+ * tuple id. Each iteration takes a single pass to compute A P for the current
+ * directions P. The exact step size and the next directions then follow from
+ * the scalar recurrences in final(). All columns of B share the same pass,
+ * but are otherwise solved independently.
+ *
+ * With task.preconditioned, the Jacobi preconditioner \f$ M = diag(A) \f$
+ * is used. The diagonal is collected in the first pass, so the first
+ * iteration is a steepest-descent step, after which preconditioned conjugate
+ * gradient is restarted.
+ */
+template <class State, class ConstState, class Tuple>
+class LinearConjugateGradient {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef Tuple tuple_type;
+
+    static void transition(state_type &state, const tuple_type &tuple);
+    static void merge(state_type &state, const_state_type &otherState);
+    static void final(state_type &state);
+};
+
+template <class State, class ConstState, class Tuple>
+void
+LinearConjugateGradient<State, ConstState, Tuple>::transition(
+        state_type &state, const tuple_type &tuple) {
+    // accumulating row tuple.id of A P
+    state.algo.incrDirection.row(tuple.id) +=
+        trans(tuple.indVar) * state.task.direction;
+    if (state.task.iteration == 0) {
+        state.algo.incrDiagonal(tuple.id) += tuple.indVar(tuple.id);
+    }
+}
+
+template <class State, class ConstState, class Tuple>
+void
+LinearConjugateGradient<State, ConstState, Tuple>::merge(state_type &state,
+        const_state_type &otherState) {
+    state.algo.incrDirection += otherState.algo.incrDirection;
+    state.algo.incrDiagonal += otherState.algo.incrDiagonal;
+}
+
+template <class State, class ConstState, class Tuple>
+void
+LinearConjugateGradient<State, ConstState, Tuple>::final(state_type &state) {
+    // mapping for the usual notation
+    // x_k, r_k, p_k: columns of task.model, task.residual, task.direction
+    // A p_k:         columns of algo.incrDirection
+    // z_k:           M^{-1} r_k (r_k without preconditioning)
+    if (state.task.iteration == 0) {
+        state.task.diagonal = state.algo.incrDiagonal;
+        if (state.task.preconditioned && !(state.task.diagonal.minCoeff() > 0))
+            throw std::invalid_argument("Matrix is not positive definite.");
+    }
+
+    for (Index j = 0; j < state.task.model.cols(); j++) {
+        double pAp = dot(state.task.direction.col(j),
+            state.algo.incrDirection.col(j));
+        if (!(pAp > 0)) {
+            // the right-hand side has been solved exactly
+            if (state.task.rz(j) == 0)
+                continue;
+            throw std::invalid_argument("Matrix is not positive definite.");
+        }
+
+        // x_{k+1} = x_k + alpha * p_k, r_{k+1} = r_k - alpha * A p_k
+        double alpha = state.task.rz(j) / pAp;
+        state.task.model.col(j) += alpha * state.task.direction.col(j);
+        state.task.residual.col(j) -= alpha * state.algo.incrDirection.col(j);
+        state.task.residualNorm(j) = state.task.residual.col(j).squaredNorm();
+
+        ColumnVector z = state.task.residual.col(j);
+        if (state.task.preconditioned)
+            z = z.cwiseQuotient(state.task.diagonal);
+        double rzNew = dot(state.task.residual.col(j), z);
+
+        // p_{k+1} = z_{k+1} + beta * p_k
+        if (state.task.preconditioned && state.task.iteration == 0) {
+            state.task.direction.col(j) = z;
+        } else {
+            double beta = state.task.rz(j) > 0 ? rzNew / state.task.rz(j) : 0.;
+            state.task.direction.col(j) *= beta;
+            state.task.direction.col(j) += z;
+        }
+        state.task.rz(j) = rzNew;
+    }
+}
+
 } // namespace convex
 
 } // namespace modules
@@ -0,0 +1,83 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file cv_igd.hpp
+ *
+ * Incremental gradient descent for the fold models of k-fold
+ * cross-validation, trained in a single pass over the data.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#ifndef MADLIB_MODULES_CONVEX_ALGO_CV_IGD_HPP_
+#define MADLIB_MODULES_CONVEX_ALGO_CV_IGD_HPP_
+
+#include "bundle_igd.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Incremental gradient descent for the fold models of a bundle state
+ *
+ * Column k of <tt>state.algo.incrModel</tt> is the model of fold k, which is
+ * trained on all tuples not in fold k. A tuple of fold k therefore updates
+ * all models except model k, with a single bundle step in which the step
+ * size of model k is zero.
+ *
+ * The loss of fold k is the holdout loss: the loss of the tuples of fold k
+ * under <tt>state.task.model.col(k)</tt>, the model of fold k after the
+ * previous iteration. The holdout loss of the models of an iteration is thus
+ * available after the next iteration, without an extra scan.
+ *
+ * Merging and finalizing work as in BundleIGD. The fold models of a state
+ * have seen slightly different numbers of rows, but since folds are
+ * assigned by hash, the model-averaging weights are nearly the same.
+ */
+template <class State, class ConstState, class Task>
+class CrossValidationIGD : public BundleIGD<State, ConstState, Task> {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Task::tuple_type tuple_type;
+    typedef typename Task::model_type model_type;
+
+    static void transitionWithLoss(state_type &state,
+            const tuple_type &tuple, uint32_t fold);
+};
+
+template <class State, class ConstState, class Task>
+void
+CrossValidationIGD<State, ConstState, Task>::transitionWithLoss(
+        state_type &state, const tuple_type &tuple, uint32_t fold) {
+    model_type holdoutModel;
+    holdoutModel.rebind(state.task.model.col(fold).data(),
+            state.task.dimension);
+    state.algo.loss(fold) += Task::loss(holdoutModel, tuple.indVar,
+            tuple.depVar);
+
+    // The in-sample losses of the bundle step are not needed
+    ColumnVector stepsizes = state.task.stepsize;
+    stepsizes(fold) = 0;
+    ColumnVector losses = ColumnVector::Zero(stepsizes.size());
+    Task::bundleGradientInPlaceWithLoss(
+            state.algo.incrModel,
+            tuple.indVar,
+            tuple.depVar,
+            stepsizes,
+            losses);
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif
@@ -34,7 +34,14 @@ public:
     typedef typename Task::model_type model_type;
 
     static void transition(state_type &state, const tuple_type &tuple);
+    static void transitionWithLoss(state_type &state,
+            const tuple_type &tuple);
+    template <class BatchIndVar, class BatchDepVar>
+    static void batchTransition(state_type &state, const BatchIndVar &X,
+            const BatchDepVar &y);
     static void merge(state_type &state, const_state_type &otherState);
+    static void mergeDisjoint(state_type &state,
+            const_state_type &otherState);
     static void final(state_type &state);
 };
 
@@ -56,6 +63,43 @@ IGD<State, ConstState, Task>::transition(state_type &state,
             state.task.stepsize);
 }
 
+/**
+ * @brief Transition and loss computation in one pass over the tuple
+ *
+ * Unlike Loss::transition(), the loss is evaluated at the incremental model,
+ * right before the update of this tuple. This needs no separate pass over
+ * the tuple (e.g., a second inner product), and it still converges to the
+ * loss of the final model.
+ */
+template <class State, class ConstState, class Task>
+void
+IGD<State, ConstState, Task>::transitionWithLoss(state_type &state,
+        const tuple_type &tuple) {
+    state.algo.loss += Task::gradientInPlaceWithLoss(
+            state.algo.incrModel,
+            tuple.indVar,
+            tuple.depVar,
+            state.task.stepsize);
+}
+
+/**
+ * @brief One gradient step for a whole batch of tuples
+ *
+ * The columns of \c X are the independent variables, \c y holds the
+ * dependent variables. See MiniBatchIGD for the buffering.
+ */
+template <class State, class ConstState, class Task>
+template <class BatchIndVar, class BatchDepVar>
+void
+IGD<State, ConstState, Task>::batchTransition(state_type &state,
+        const BatchIndVar &X, const BatchDepVar &y) {
+    Task::batchGradientInPlace(
+            state.algo.incrModel,
+            X,
+            y,
+            state.task.stepsize);
+}
+
 template <class State, class ConstState, class Task>
 void
 IGD<State, ConstState, Task>::merge(state_type &state,
@@ -82,6 +126,29 @@ IGD<State, ConstState, Task>::merge(state_type &state,
     state.algo.incrModel *= static_cast<double>(otherState.algo.numRows) / static_cast<double>(totalNumRows);
 }
 
+/**
+ * @brief Merge two states that updated disjoint parts of the same model
+ *
+ * Both states have to start from the same task.model, and the tuples seen by
+ * them must touch disjoint parts of the model (e.g., the strata of a
+ * stratified matrix factorization). Then no averaging is needed: the changes
+ * of the other state are simply added to this state.
+ */
+template <class State, class ConstState, class Task>
+void
+IGD<State, ConstState, Task>::mergeDisjoint(state_type &state,
+        const_state_type &otherState) {
+    if (state.algo.numRows == 0) {
+        state.algo.incrModel = otherState.algo.incrModel;
+        return;
+    } else if (otherState.algo.numRows == 0) {
+        return;
+    }
+
+    state.algo.incrModel += otherState.algo.incrModel;
+    state.algo.incrModel -= otherState.task.model;
+}
+
 template <class State, class ConstState, class Task>
 void
 IGD<State, ConstState, Task>::final(state_type &state) {
@@ -0,0 +1,183 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file lbfgs.hpp
+ *
+ * Generic implementaion of limited-memory BFGS, in the fashion of
+ * user-definied aggregates. They should be called by actually database
+ * functions, after arguments are properly parsed.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#ifndef MADLIB_MODULES_CONVEX_ALGO_LBFGS_HPP_
+#define MADLIB_MODULES_CONVEX_ALGO_LBFGS_HPP_
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Limited-memory BFGS
+ *
+ * Like ConjugateGradient, the aggregate only accumulates the loss and the
+ * gradient at task.model, so neither the transition state nor the final
+ * function ever needs a dimension x dimension matrix (unlike Newton). The
+ * inverse Hessian is approximated from the last historySize correction
+ * pairs with the two-loop recursion (Nocedal and Wright, "Numerical
+ * Optimization", Algorithm 7.4).
+ *
+ * There is no line search within an iteration. Instead, a trial step that
+ * does not decrease the loss is rejected in the next final function, and the
+ * step is halved (backtracking across iterations). The loss is evaluated in
+ * the same scan as the gradient, so a rejected step costs one scan.
+ */
+template <class State, class ConstState, class Task>
+class LBFGS {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Task::tuple_type tuple_type;
+    typedef typename Task::model_type model_type;
+
+    static void transition(state_type &state, const tuple_type &tuple);
+    static void merge(state_type &state, const_state_type &otherState);
+    static void final(state_type &state);
+
+    /**
+     * @brief Smallest fraction of the direction that is tried before
+     *     giving up on it
+     */
+    static double minStep() { return 1. / 1048576.; }
+
+private:
+    static void updateDirection(state_type &state);
+};
+
+template <class State, class ConstState, class Task>
+void
+LBFGS<State, ConstState, Task>::transition(state_type &state,
+        const tuple_type &tuple) {
+    // accumulating the gradient
+    Task::gradient(
+            state.task.model,
+            tuple.indVar,
+            tuple.depVar,
+            state.algo.incrGradient);
+}
+
+template <class State, class ConstState, class Task>
+void
+LBFGS<State, ConstState, Task>::merge(state_type &state,
+        const_state_type &otherState) {
+    // merging accumulated gradient
+    state.algo.incrGradient += otherState.algo.incrGradient;
+}
+
+/**
+ * @brief Accept or reject the trial step, and compute the next trial model
+ */
+template <class State, class ConstState, class Task>
+void
+LBFGS<State, ConstState, Task>::final(state_type &state) {
+    // mapping for design document
+    // x_k:         task.lastModel
+    // x_k + t p_k: task.model
+    // p_k:         task.direction
+    // t:           task.step
+    if (state.task.iteration > 0 && state.algo.loss > state.task.lastLoss) {
+        // reject: backtrack along the same direction
+        if (state.task.step * 0.5 >= minStep()) {
+            state.task.step = state.task.step * 0.5;
+            state.task.model = state.task.lastModel
+                + state.task.step * state.task.direction;
+        } else {
+            state.task.step = 0;
+            state.task.model = state.task.lastModel;
+        }
+        return;
+    }
+
+    if (state.task.iteration > 0) {
+        // accept: store the correction pair, dropping the oldest if needed
+        ColumnVector s = state.task.model - state.task.lastModel;
+        ColumnVector y = state.algo.incrGradient - state.task.lastGradient;
+        // skip pairs that would make the approximation indefinite
+        if (dot(s, y) > std::numeric_limits<double>::epsilon()
+                * y.squaredNorm() && state.task.historySize > 0) {
+            Index n = state.task.numPairs;
+            if (n == static_cast<Index>(state.task.historySize)) {
+                for (Index i = 1; i < n; i ++) {
+                    state.task.s.col(i - 1) = state.task.s.col(i);
+                    state.task.y.col(i - 1) = state.task.y.col(i);
+                }
+                n --;
+            }
+            state.task.s.col(n) = s;
+            state.task.y.col(n) = y;
+            state.task.numPairs = static_cast<uint32_t>(n + 1);
+        }
+    }
+
+    state.task.lastModel = state.task.model;
+    state.task.lastGradient = state.algo.incrGradient;
+    state.task.lastLoss = state.algo.loss;
+
+    updateDirection(state);
+    state.task.step = 1;
+    state.task.model = state.task.lastModel + state.task.direction;
+}
+
+/**
+ * @brief Set the direction to \f$ -H_k g_k \f$ by the two-loop recursion
+ *
+ * Without correction pairs, this is the steepest-descent direction scaled by
+ * task.stepsize.
+ */
+template <class State, class ConstState, class Task>
+void
+LBFGS<State, ConstState, Task>::updateDirection(state_type &state) {
+    Index n = state.task.numPairs;
+    if (n == 0) {
+        state.task.direction = -state.task.stepsize * state.task.lastGradient;
+        return;
+    }
+
+    ColumnVector q = state.task.lastGradient;
+    ColumnVector alpha(n);
+    ColumnVector rho(n);
+    for (Index i = n - 1; i >= 0; i --) {
+        rho(i) = 1. / dot(state.task.y.col(i), state.task.s.col(i));
+        alpha(i) = rho(i) * dot(state.task.s.col(i), q);
+        q -= alpha(i) * state.task.y.col(i);
+    }
+    // initial approximation H_k^0 = gamma * I
+    q *= dot(state.task.s.col(n - 1), state.task.y.col(n - 1))
+        / state.task.y.col(n - 1).squaredNorm();
+    for (Index i = 0; i < n; i ++) {
+        double beta = rho(i) * dot(state.task.y.col(i), q);
+        q += (alpha(i) - beta) * state.task.s.col(i);
+    }
+    state.task.direction = -q;
+
+    // restart if not a descent direction
+    if (dot(state.task.direction, state.task.lastGradient) >= 0.) {
+        state.task.numPairs = 0;
+        state.task.direction = -state.task.stepsize
+            * state.task.lastGradient;
+    }
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif
+
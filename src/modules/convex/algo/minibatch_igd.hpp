@@ -0,0 +1,119 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file minibatch_igd.hpp
+ *
+ * Generic implementaion of mini-batch incremental gradient descent, in the
+ * fashion of user-definied aggregates. They should be called by actually
+ * database functions, after arguments are properly parsed.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#ifndef MADLIB_MODULES_CONVEX_ALGO_MINIBATCH_IGD_HPP_
+#define MADLIB_MODULES_CONVEX_ALGO_MINIBATCH_IGD_HPP_
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Buffer tuples in the state and take one gradient step per batch
+ *
+ * Algo is the underlying per-tuple algorithm (e.g., IGD or RegularizedIGD).
+ * It has to provide transition() for a single tuple and batchTransition() for
+ * a batch of tuples stored column-wise. If the batch size in the state is 1
+ * (or 0), tuples are passed to Algo::transition() directly.
+ */
+template <class State, class ConstState, class Algo>
+class MiniBatchIGD {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Algo::tuple_type tuple_type;
+
+    static void transition(state_type &state, const tuple_type &tuple);
+    static void flush(state_type &state);
+    static void mergeBuffers(state_type &state,
+            const_state_type &otherState);
+
+private:
+    template <class IndependentVariables>
+    static void buffer(state_type &state, const IndependentVariables &x,
+            double y);
+};
+
+template <class State, class ConstState, class Algo>
+void
+MiniBatchIGD<State, ConstState, Algo>::transition(state_type &state,
+        const tuple_type &tuple) {
+    if (state.task.batchSize <= 1) {
+        Algo::transition(state, tuple);
+    } else {
+        buffer(state, tuple.indVar, tuple.depVar);
+    }
+}
+
+/**
+ * @brief Apply the gradient step for all tuples currently buffered
+ *
+ * This has to be called before the model is used (i.e., before merging and
+ * in the final function), since the last batch is usually not full.
+ */
+template <class State, class ConstState, class Algo>
+void
+MiniBatchIGD<State, ConstState, Algo>::flush(state_type &state) {
+    Index n = static_cast<uint32_t>(state.algo.numBuffered);
+    if (n == 0) { return; }
+
+    Algo::batchTransition(state,
+            state.algo.batchIndVar.leftCols(n),
+            state.algo.batchDepVar.head(n));
+    state.algo.numBuffered = 0;
+}
+
+/**
+ * @brief Move the tuples buffered in another state into this state
+ *
+ * The other state is immutable, so its buffered tuples cannot be applied to
+ * its own model. Instead, they are applied to the merged model. This should be
+ * called after the models have been averaged.
+ */
+template <class State, class ConstState, class Algo>
+void
+MiniBatchIGD<State, ConstState, Algo>::mergeBuffers(state_type &state,
+        const_state_type &otherState) {
+    Index n = static_cast<uint32_t>(otherState.algo.numBuffered);
+    for (Index k = 0; k < n; k ++) {
+        buffer(state, otherState.algo.batchIndVar.col(k),
+                otherState.algo.batchDepVar(k));
+    }
+}
+
+template <class State, class ConstState, class Algo>
+template <class IndependentVariables>
+void
+MiniBatchIGD<State, ConstState, Algo>::buffer(state_type &state,
+        const IndependentVariables &x, double y) {
+    Index k = static_cast<uint32_t>(state.algo.numBuffered);
+    state.algo.batchIndVar.col(k) = x;
+    state.algo.batchDepVar(k) = y;
+    state.algo.numBuffered ++;
+
+    if (static_cast<uint32_t>(state.algo.numBuffered)
+            == static_cast<uint32_t>(state.task.batchSize)) { flush(state); }
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif
+
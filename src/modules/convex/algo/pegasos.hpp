@@ -0,0 +1,161 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file pegasos.hpp
+ *
+ * Generic implementaion of the Pegasos solver (primal estimated sub-gradient)
+ * for L2-regularized hinge-loss problems, in the fashion of user-definied
+ * aggregates. They should be called by actually database functions, after
+ * arguments are properly parsed.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#ifndef MADLIB_MODULES_CONVEX_ALGO_PEGASOS_HPP_
+#define MADLIB_MODULES_CONVEX_ALGO_PEGASOS_HPP_
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Pegasos: sub-gradient steps with step size 1 / (lambda t) followed
+ *     by a projection onto the ball of radius 1 / sqrt(lambda)
+ *
+ * The objective is
+ * \f[
+ *     \frac{\lambda}{2} \| w \|^2 + \frac 1M \sum_{m=1}^M \ell(w; x_m, y_m).
+ * \f]
+ * Step t, for a batch \f$ B \f$ of tuples, is
+ * \f[
+ *     w \leftarrow \Pi\left( (1 - 1/t) w - \frac{1}{\lambda t |B|}
+ *         \sum_{m \in B} \nabla \ell(w; x_m, y_m) \right),
+ * \f]
+ * where \f$ \Pi \f$ projects onto the ball containing the optimum.
+ *
+ * The state is a RegularizedGLMIGDState. <tt>task.lambda</tt> is the
+ * regularization, and <tt>task.totalRows</tt> counts the rows processed in
+ * previous iterations, so that step numbers (and step sizes) continue across
+ * iterations; final() updates it. <tt>task.stepsize</tt> is not used. This can
+ * be used as the Algo of MiniBatchIGD.
+ *
+ * States are merged with IGD::merge() (model averaging). The ball is convex,
+ * so the average of projected models needs no further projection.
+ */
+template <class State, class ConstState, class Task>
+class Pegasos {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Task::tuple_type tuple_type;
+    typedef typename Task::model_type model_type;
+
+    static void transition(state_type &state, const tuple_type &tuple);
+    template <class BatchIndVar, class BatchDepVar>
+    static void batchTransition(state_type &state, const BatchIndVar &X,
+            const BatchDepVar &y);
+    static void final(state_type &state);
+
+private:
+    static double stepNumber(const state_type &state);
+    static void project(state_type &state);
+};
+
+template <class State, class ConstState, class Task>
+void
+Pegasos<State, ConstState, Task>::transition(state_type &state,
+        const tuple_type &tuple) {
+    double t = stepNumber(state);
+
+    state.algo.gradient.setZero();
+    Task::gradient(
+            state.algo.incrModel,
+            tuple.indVar,
+            tuple.depVar,
+            state.algo.gradient);
+
+    state.algo.incrModel *= 1. - 1. / t;
+    state.algo.incrModel -= 1. / (state.task.lambda * t)
+        * state.algo.gradient;
+    project(state);
+}
+
+/**
+ * @brief One Pegasos step for a whole batch of tuples
+ *
+ * Task::batchGradient() averages the (sub)gradient over the batch.
+ */
+template <class State, class ConstState, class Task>
+template <class BatchIndVar, class BatchDepVar>
+void
+Pegasos<State, ConstState, Task>::batchTransition(state_type &state,
+        const BatchIndVar &X, const BatchDepVar &y) {
+    double t = stepNumber(state);
+
+    state.algo.gradient.setZero();
+    Task::batchGradient(
+            state.algo.incrModel,
+            X,
+            y,
+            state.algo.gradient);
+
+    state.algo.incrModel *= 1. - 1. / t;
+    state.algo.incrModel -= 1. / (state.task.lambda * t)
+        * state.algo.gradient;
+    project(state);
+}
+
+/**
+ * @brief Add the regularization to the loss and make the model of this
+ *     iteration the model of the next one
+ *
+ * Before this, algo.loss is the sum of the loss of each row at task.model. It
+ * becomes numRows times the objective at task.model.
+ */
+template <class State, class ConstState, class Task>
+void
+Pegasos<State, ConstState, Task>::final(state_type &state) {
+    state.algo.loss += static_cast<double>(state.algo.numRows)
+        * state.task.lambda / 2. * state.task.model.squaredNorm();
+    state.task.model = state.algo.incrModel;
+    state.task.totalRows += state.algo.numRows;
+}
+
+/**
+ * @brief Number (starting at 1) of the step taken with the current row
+ *
+ * The row is not counted in algo.numRows yet. With mini-batches, the step of
+ * a full batch is the number of full batches so far.
+ */
+template <class State, class ConstState, class Task>
+double
+Pegasos<State, ConstState, Task>::stepNumber(const state_type &state) {
+    double batchSize = state.task.batchSize > 1
+        ? static_cast<double>(state.task.batchSize) : 1.;
+    return std::ceil(static_cast<double>(state.task.totalRows
+        + state.algo.numRows + 1) / batchSize);
+}
+
+template <class State, class ConstState, class Task>
+void
+Pegasos<State, ConstState, Task>::project(state_type &state) {
+    double norm = state.algo.incrModel.norm();
+    double radius = 1. / std::sqrt(state.task.lambda);
+    if (norm > radius) {
+        state.algo.incrModel *= radius / norm;
+    }
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif
+
@@ -30,6 +30,9 @@ public:
     typedef typename Task::model_type model_type;
 
     static void transition(state_type &state, const tuple_type &tuple);
+    template <class BatchIndVar, class BatchDepVar>
+    static void batchTransition(state_type &state, const BatchIndVar &X,
+            const BatchDepVar &y);
 };
 
 template <class State, class Task, class Regularizer>
@@ -57,6 +60,124 @@ RegularizedIGD<State, Task, Regularizer>::transition(state_type &state,
     state.algo.incrModel -= state.task.stepsize * state.algo.gradient;
 }
 
+/**
+ * @brief One regularized gradient step for a whole batch of tuples
+ *
+ * The loss gradient is averaged over the batch, so the amortized lambda is
+ * the same as for a single tuple.
+ */
+template <class State, class Task, class Regularizer>
+template <class BatchIndVar, class BatchDepVar>
+void
+RegularizedIGD<State, Task, Regularizer>::batchTransition(state_type &state,
+        const BatchIndVar &X, const BatchDepVar &y) {
+    state.algo.gradient.setZero();
+
+    Task::batchGradient(
+            state.algo.incrModel,
+            X,
+            y,
+            state.algo.gradient);
+    Regularizer::gradient(
+            state.algo.incrModel,
+            state.task.lambda / static_cast<double>(state.task.totalRows), // amortizing lambda
+            state.algo.gradient);
+
+    state.algo.incrModel -= state.task.stepsize * state.algo.gradient;
+}
+
+/**
+ * @brief IGD with a regularizer whose penalty is applied just in time
+ *
+ * For sparse tuples, applying the regularizer to the whole model for every
+ * tuple costs O(dimension) per tuple, while the gradient step only touches
+ * the nonzeros. Instead, <tt>state.algo.penalty</tt> accumulates the total
+ * penalty every coefficient should have received so far, and
+ * <tt>state.algo.gradient</tt> records the penalty applied to each
+ * coefficient. Regularizer::applyCumulativePenalty() then brings only the
+ * coefficients touched by a tuple up to date. flush() applies all outstanding
+ * penalties, and needs to be called before the model is used as a whole
+ * (merge and final function).
+ *
+ * The independent variables of \c Task must be a SparseColumnVector.
+ */
+template <class State, class ConstState, class Task, class Regularizer>
+class LazyRegularizedIGD {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Task::tuple_type tuple_type;
+
+    static void transition(state_type &state, const tuple_type &tuple);
+    static void flush(state_type &state);
+    static void merge(state_type &state, const_state_type &otherState);
+};
+
+template <class State, class ConstState, class Task, class Regularizer>
+void
+LazyRegularizedIGD<State, ConstState, Task, Regularizer>::transition(
+        state_type &state, const tuple_type &tuple) {
+    state.algo.penalty += state.task.stepsize * state.task.lambda
+        / static_cast<double>(state.task.totalRows); // amortizing lambda
+
+    Task::gradientInPlace(
+            state.algo.incrModel,
+            tuple.indVar,
+            tuple.depVar,
+            state.task.stepsize);
+
+    for (SparseColumnVector::InnerIterator it(tuple.indVar); it; ++it) {
+        Regularizer::applyCumulativePenalty(state.algo.incrModel,
+            state.algo.gradient, state.algo.penalty, it.index());
+    }
+}
+
+template <class State, class ConstState, class Task, class Regularizer>
+void
+LazyRegularizedIGD<State, ConstState, Task, Regularizer>::flush(
+        state_type &state) {
+    for (Index i = 0; i < state.algo.incrModel.size(); i ++) {
+        Regularizer::applyCumulativePenalty(state.algo.incrModel,
+            state.algo.gradient, state.algo.penalty, i);
+    }
+    state.algo.penalty = 0.;
+    state.algo.gradient.setZero();
+}
+
+/**
+ * @brief Merge two states after applying all outstanding penalties
+ *
+ * The models are averaged as in IGD::merge(). The caller is responsible
+ * for updating numRows afterwards.
+ */
+template <class State, class ConstState, class Task, class Regularizer>
+void
+LazyRegularizedIGD<State, ConstState, Task, Regularizer>::merge(
+        state_type &state, const_state_type &otherState) {
+    flush(state);
+    if (otherState.algo.numRows == 0) { return; }
+
+    ColumnVector otherModel = otherState.algo.incrModel;
+    ColumnVector otherApplied = otherState.algo.gradient;
+    for (Index i = 0; i < otherModel.size(); i ++) {
+        Regularizer::applyCumulativePenalty(otherModel, otherApplied,
+            otherState.algo.penalty, i);
+    }
+
+    if (state.algo.numRows == 0) {
+        state.algo.incrModel = otherModel;
+        return;
+    }
+
+    // model averaging, weighted by rows seen (see IGD::merge())
+    double totalNumRows = static_cast<double>(state.algo.numRows
+        + otherState.algo.numRows);
+    state.algo.incrModel *= static_cast<double>(state.algo.numRows)
+        / totalNumRows;
+    state.algo.incrModel += static_cast<double>(otherState.algo.numRows)
+        / totalNumRows * otherModel;
+}
+
 } // namespace convex
 
 } // namespace modules
@@ -0,0 +1,146 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file shuffle_igd.hpp
+ *
+ * Generic implementaion of incremental gradient descent with a shuffle
+ * buffer, in the fashion of user-definied aggregates. They should be called
+ * by actually database functions, after arguments are properly parsed.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#ifndef MADLIB_MODULES_CONVEX_ALGO_SHUFFLE_IGD_HPP_
+#define MADLIB_MODULES_CONVEX_ALGO_SHUFFLE_IGD_HPP_
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Pass tuples to the underlying algorithm in random order, using the
+ *     buffer of the state as a shuffle buffer
+ *
+ * Until the buffer (of batchSize tuples) is full, tuples are only buffered.
+ * After that, every new tuple takes the place of a buffered tuple chosen at
+ * random, which is passed to Algo::transitionWithLoss(). Rows that arrive in
+ * physical order (e.g., sorted by date or by label) are thus seen by Algo in
+ * an order that is random within windows of about batchSize tuples, without
+ * sorting the table.
+ *
+ * Algo is the underlying per-tuple algorithm. Its tuple type has to map the
+ * columns of the buffer (e.g., BufferedGLMTuple). All random numbers are
+ * drawn from an RNG with values in [RNG::min(), RNG::max()).
+ */
+template <class State, class ConstState, class Algo>
+class ShuffleIGD {
+public:
+    typedef State state_type;
+    typedef ConstState const_state_type;
+    typedef typename Algo::tuple_type tuple_type;
+
+    template <class IndependentVariables, class RNG>
+    static void transition(state_type &state, const IndependentVariables &x,
+            double y, RNG &rng);
+    template <class RNG>
+    static void flush(state_type &state, RNG &rng);
+    template <class RNG>
+    static void mergeBuffers(state_type &state, const_state_type &otherState,
+            RNG &rng);
+
+private:
+    static void emit(state_type &state, Index k);
+    template <class RNG>
+    static Index randomIndex(RNG &rng, Index n);
+};
+
+template <class State, class ConstState, class Algo>
+template <class IndependentVariables, class RNG>
+void
+ShuffleIGD<State, ConstState, Algo>::transition(state_type &state,
+        const IndependentVariables &x, double y, RNG &rng) {
+    Index n = static_cast<uint32_t>(state.algo.numBuffered);
+    Index k = n;
+    if (n < static_cast<uint32_t>(state.task.batchSize)) {
+        state.algo.numBuffered ++;
+    } else {
+        k = randomIndex(rng, n);
+        emit(state, k);
+    }
+    state.algo.batchIndVar.col(k) = x;
+    state.algo.batchDepVar(k) = y;
+}
+
+/**
+ * @brief Pass all tuples currently buffered, in random order
+ *
+ * This has to be called before the model is used (i.e., before merging and
+ * in the final function).
+ */
+template <class State, class ConstState, class Algo>
+template <class RNG>
+void
+ShuffleIGD<State, ConstState, Algo>::flush(state_type &state, RNG &rng) {
+    Index n = static_cast<uint32_t>(state.algo.numBuffered);
+    while (n > 0) {
+        Index k = randomIndex(rng, n);
+        emit(state, k);
+        n --;
+        // The last buffered tuple fills the gap
+        state.algo.batchIndVar.col(k) = state.algo.batchIndVar.col(n);
+        state.algo.batchDepVar(k) = state.algo.batchDepVar(n);
+    }
+    state.algo.numBuffered = 0;
+}
+
+/**
+ * @brief Move the tuples buffered in another state into this state
+ *
+ * The other state is immutable, so its buffered tuples cannot be applied to
+ * its own model. Instead, they are shuffled into the buffer of this state.
+ * This should be called after the models have been averaged.
+ */
+template <class State, class ConstState, class Algo>
+template <class RNG>
+void
+ShuffleIGD<State, ConstState, Algo>::mergeBuffers(state_type &state,
+        const_state_type &otherState, RNG &rng) {
+    Index n = static_cast<uint32_t>(otherState.algo.numBuffered);
+    for (Index k = 0; k < n; k ++) {
+        transition(state, otherState.algo.batchIndVar.col(k),
+                otherState.algo.batchDepVar(k), rng);
+    }
+}
+
+template <class State, class ConstState, class Algo>
+void
+ShuffleIGD<State, ConstState, Algo>::emit(state_type &state, Index k) {
+    tuple_type tuple;
+    tuple.indVar.rebind(state.algo.batchIndVar.data()
+            + k * state.algo.batchIndVar.rows(),
+            state.algo.batchIndVar.rows());
+    tuple.depVar = state.algo.batchDepVar(k);
+    Algo::transitionWithLoss(state, tuple);
+}
+
+template <class State, class ConstState, class Algo>
+template <class RNG>
+Index
+ShuffleIGD<State, ConstState, Algo>::randomIndex(RNG &rng, Index n) {
+    double u = (rng() - RNG::min()) / (RNG::max() - RNG::min());
+    return std::min(n - 1, static_cast<Index>(u * n));
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif
+
@@ -7,10 +7,16 @@
  * -------------------------------------------------------------------------- */
 
 #include "lmf_igd.hpp"
+#include "lmf_als.hpp"
+#include "lmf_quantized.hpp"
+#include "lmf_recommend.hpp"
 #include "linear_svm_igd.hpp"
 #include "linear_svm_cg.hpp"
 #include "logit_igd.hpp"
 #include "logit_newton.hpp"
+#include "logit_lbfgs.hpp"
+#include "logit_cg.hpp"
 #include "ridge_newton.hpp"
 #include "lasso_igd.hpp"
+#include "linear_cg.hpp"
 
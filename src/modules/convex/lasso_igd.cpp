@@ -14,6 +14,7 @@
 #include "task/l1.hpp"
 #include "algo/igd.hpp"
 #include "algo/regularized_igd.hpp"
+#include "algo/minibatch_igd.hpp"
 #include "algo/loss.hpp"
 
 #include "type/tuple.hpp"
@@ -26,13 +27,17 @@ namespace modules {
 
 namespace convex {
 
-// This 4 classes contain public static methods that can be called
+// This 5 classes contain public static methods that can be called
 typedef L1<GLMModel > GLML1Regularizer;
 
 typedef RegularizedIGD<RegularizedGLMIGDState<MutableArrayHandle<double> >,
         OLS<GLMModel, GLMTuple >,
         GLML1Regularizer > OLSL1RegularizedIGDAlgorithm;
 
+typedef MiniBatchIGD<RegularizedGLMIGDState<MutableArrayHandle<double> >,
+        RegularizedGLMIGDState<ArrayHandle<double> >,
+        OLSL1RegularizedIGDAlgorithm> OLSL1MiniBatchIGDAlgorithm;
+
 typedef IGD<RegularizedGLMIGDState<MutableArrayHandle<double> >, 
         RegularizedGLMIGDState<ArrayHandle<double> >,
         OLS<GLMModel, GLMTuple > > OLSIGDAlgorithm;
@@ -41,6 +46,15 @@ typedef Loss<RegularizedGLMIGDState<MutableArrayHandle<double> >,
         RegularizedGLMIGDState<ArrayHandle<double> >,
         OLS<GLMModel, GLMTuple > > OLSLossAlgorithm;
 
+typedef LazyRegularizedIGD<RegularizedGLMIGDState<MutableArrayHandle<double> >,
+        RegularizedGLMIGDState<ArrayHandle<double> >,
+        OLS<GLMModel, SparseGLMTuple >,
+        GLML1Regularizer > OLSLazyL1IGDAlgorithm;
+
+typedef Loss<RegularizedGLMIGDState<MutableArrayHandle<double> >,
+        RegularizedGLMIGDState<ArrayHandle<double> >,
+        OLS<GLMModel, SparseGLMTuple > > OLSSparseLossAlgorithm;
+
 /**
  * @brief Perform the LASSO transition step
  *
@@ -58,7 +72,8 @@ lasso_igd_transition::run(AnyType &args) {
     if (state.algo.numRows == 0) {
         if (!args[3].isNull()) {
             RegularizedGLMIGDState<ArrayHandle<double> > previousState = args[3];
-            state.allocate(*this, previousState.task.dimension);
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.batchSize);
             state = previousState;
         } else {
             // configuration parameters
@@ -66,8 +81,9 @@ lasso_igd_transition::run(AnyType &args) {
             double stepsize = args[5].getAs<double>();
             double lambda = args[6].getAs<double>();
             uint64_t totalRows = args[7].getAs<uint64_t>();
+            uint32_t batchSize = args[8].getAs<uint32_t>();
 
-            state.allocate(*this, dimension); // with zeros
+            state.allocate(*this, dimension, batchSize); // with zeros
             state.task.stepsize = stepsize;
             state.task.lambda = lambda;
             state.task.totalRows = totalRows;
@@ -83,7 +99,7 @@ lasso_igd_transition::run(AnyType &args) {
     tuple.depVar = args[2].getAs<double>();
 
     // Now do the transition step
-    OLSL1RegularizedIGDAlgorithm::transition(state, tuple);
+    OLSL1MiniBatchIGDAlgorithm::transition(state, tuple);
     OLSLossAlgorithm::transition(state, tuple);
     state.algo.numRows ++;
 
@@ -104,11 +120,14 @@ lasso_igd_merge::run(AnyType &args) {
     else if (stateRight.algo.numRows == 0) { return stateLeft; }
 
     // Merge states together
+    OLSL1MiniBatchIGDAlgorithm::flush(stateLeft);
     OLSIGDAlgorithm::merge(stateLeft, stateRight);
     OLSLossAlgorithm::merge(stateLeft, stateRight);
     // The following numRows update, cannot be put above, because the model
     // averaging depends on their original values
     stateLeft.algo.numRows += stateRight.algo.numRows;
+    // Tuples still buffered on the right are applied to the merged model
+    OLSL1MiniBatchIGDAlgorithm::mergeBuffers(stateLeft, stateRight);
 
     return stateLeft;
 }
@@ -126,6 +145,7 @@ lasso_igd_final::run(AnyType &args) {
     if (state.algo.numRows == 0) { return Null(); }
 
     // finalizing
+    OLSL1MiniBatchIGDAlgorithm::flush(state);
     GLML1Regularizer::loss(state.task.model, state.task.lambda);
     OLSIGDAlgorithm::final(state);
     
@@ -135,6 +155,97 @@ lasso_igd_final::run(AnyType &args) {
     return state;
 }
 
+/**
+ * @brief Perform the LASSO transition step for sparse independent variables
+ *
+ * Called for each tuple. The L1 penalty is applied just in time, so the cost
+ * is proportional to the number of nonzero independent variables.
+ * Mini-batches are not supported.
+ */
+AnyType
+lasso_igd_sparse_transition::run(AnyType &args) {
+    RegularizedGLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            RegularizedGLMIGDState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            double stepsize = args[5].getAs<double>();
+            double lambda = args[6].getAs<double>();
+            uint64_t totalRows = args[7].getAs<uint64_t>();
+
+            state.allocate(*this, dimension); // with zeros
+            state.task.stepsize = stepsize;
+            state.task.lambda = lambda;
+            state.task.totalRows = totalRows;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    SparseGLMTuple tuple;
+    tuple.indVar = args[1].getAs<SparseColumnVector>();
+    tuple.depVar = args[2].getAs<double>();
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    OLSSparseLossAlgorithm::transition(state, tuple);
+    OLSLazyL1IGDAlgorithm::transition(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition
+ *     states with outstanding L1 penalties
+ */
+AnyType
+lasso_igd_sparse_merge::run(AnyType &args) {
+    RegularizedGLMIGDState<MutableArrayHandle<double> > stateLeft = args[0];
+    RegularizedGLMIGDState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    // Merge states together
+    OLSLazyL1IGDAlgorithm::merge(stateLeft, stateRight);
+    OLSSparseLossAlgorithm::merge(stateLeft, stateRight);
+    // The following numRows update, cannot be put above, because the model
+    // averaging depends on their original values
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the LASSO final step for sparse independent variables
+ */
+AnyType
+lasso_igd_sparse_final::run(AnyType &args) {
+    RegularizedGLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    // finalizing
+    OLSLazyL1IGDAlgorithm::flush(state);
+    OLSIGDAlgorithm::final(state);
+
+    return state;
+}
+
 /**
  * @brief Return the difference in RMSE between two states
  */
@@ -173,7 +284,7 @@ internal_lasso_igd_result::run(AnyType &args) {
 AnyType
 lasso_igd_predict::run(AnyType &args) {
     using madlib::dbal::eigen_integration::MappedColumnVector;
-    MappedColumnVector model = args[0].getAs<MappedColumnVector>();
+    MappedColumnVector model(cachedArrayArgument(0));
     MappedColumnVector indVar = args[1].getAs<MappedColumnVector>();
 
     return OLS<MappedColumnVector, GLMTuple>::predict(model, indVar);
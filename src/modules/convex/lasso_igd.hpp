@@ -19,6 +19,24 @@ DECLARE_UDF(convex, lasso_igd_merge)
  */
 DECLARE_UDF(convex, lasso_igd_final)
 
+/**
+ * @brief LASSO (incremental gradient): Transition function for sparse
+ *     independent variables
+ */
+DECLARE_UDF(convex, lasso_igd_sparse_transition)
+
+/**
+ * @brief LASSO (incremental gradient): State merge function for sparse
+ *     independent variables
+ */
+DECLARE_UDF(convex, lasso_igd_sparse_merge)
+
+/**
+ * @brief LASSO (incremental gradient): Final function for sparse
+ *     independent variables
+ */
+DECLARE_UDF(convex, lasso_igd_sparse_final)
+
 /**
  * @brief Logistic regression (incremental gradient): Difference in
  *     log-likelihood between two transition states
@@ -0,0 +1,189 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file linear_cg.cpp
+ *
+ * @brief Conjugate gradient functions for linear systems
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include "linear_cg.hpp"
+
+#include "algo/conjugate_gradient.hpp"
+
+#include "type/tuple.hpp"
+#include "type/state.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// This class contains public static methods that can be called
+typedef LinearConjugateGradient<LinearCGState<MutableArrayHandle<double> >,
+        LinearCGState<ArrayHandle<double> >, MatrixRowTuple>
+            LinearCGAlgorithm;
+
+/**
+ * @brief Perform the linear conjugate gradient transition step
+ *
+ * Called for each row of the matrix.
+ */
+AnyType
+linear_cg_transition::run(AnyType &args) {
+    // The real state.
+    // For the first tuple: args[0] is nothing more than a marker that
+    // indicates that we should do some initial operations.
+    // For other tuples: args[0] holds the computation state until last tuple
+    LinearCGState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            LinearCGState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.numRHS);
+            state = previousState;
+        } else {
+            // The right-hand sides are either a vector, or a matrix with one
+            // right-hand side per row
+            ArrayHandle<double> b = args[4].getAs<ArrayHandle<double> >();
+            uint32_t dimension, numRHS;
+            if (b.dims() == 1) {
+                dimension = static_cast<uint32_t>(b.sizeOfDim(0));
+                numRHS = 1;
+            } else if (b.dims() == 2) {
+                dimension = static_cast<uint32_t>(b.sizeOfDim(1));
+                numRHS = static_cast<uint32_t>(b.sizeOfDim(0));
+            } else {
+                throw std::invalid_argument("Invalid parameter: Right-hand "
+                    "side must be a vector or a matrix with one right-hand "
+                    "side per row.");
+            }
+            if (dimension == 0 || numRHS == 0)
+                throw std::invalid_argument("Invalid parameter: Right-hand "
+                    "side must not be empty.");
+
+            state.allocate(*this, dimension, numRHS); // with zeros
+            state.task.preconditioned = args[5].getAs<bool>();
+
+            // x_0 = 0, so r_0 = p_0 = b
+            HandleTraits<ArrayHandle<double> >::MatrixTransparentHandleMap
+                rhs(b.ptr(), dimension, numRHS);
+            state.task.residual = rhs;
+            state.task.direction = rhs;
+            state.task.residualNorm = trans(rhs.colwise().squaredNorm());
+            state.task.rz = state.task.residualNorm;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    MatrixRowTuple tuple;
+    int32_t rowNum = args[1].getAs<int32_t>();
+    tuple.indVar.rebind(args[2].getAs<MappedColumnVector>().memoryHandle());
+
+    if (rowNum < 1 || static_cast<uint32_t>(rowNum) > state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Row numbers must be "
+            "between 1 and the dimension of the right-hand side.");
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "matrix rows does not match the right-hand side.");
+    tuple.id = rowNum - 1;
+
+    // Now do the transition step
+    LinearCGAlgorithm::transition(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+linear_cg_merge::run(AnyType &args) {
+    LinearCGState<MutableArrayHandle<double> > stateLeft = args[0];
+    LinearCGState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    // Merge states together
+    LinearCGAlgorithm::merge(stateLeft, stateRight);
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the linear conjugate gradient final step
+ */
+AnyType
+linear_cg_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    LinearCGState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    if (state.algo.numRows != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Matrix must have "
+            "exactly one row per element of the right-hand side.");
+
+    // finalizing
+    LinearCGAlgorithm::final(state);
+    state.task.iteration ++;
+
+    return state;
+}
+
+/**
+ * @brief Return the largest squared 2-norm of the residuals \f$ b - A x \f$
+ */
+AnyType
+internal_linear_cg_residual::run(AnyType &args) {
+    LinearCGState<ArrayHandle<double> > state = args[0];
+
+    return state.task.residualNorm.maxCoeff();
+}
+
+/**
+ * @brief Return the solution of the state
+ *
+ * The solution has the same shape as the right-hand side: A vector for a
+ * single right-hand side, and a matrix with one solution per row otherwise.
+ */
+AnyType
+internal_linear_cg_result::run(AnyType &args) {
+    LinearCGState<ArrayHandle<double> > state = args[0];
+
+    if (state.task.numRHS == 1) {
+        MutableMappedColumnVector solution(
+            allocateArray<double>(state.task.dimension));
+        solution = state.task.model.col(0);
+        return solution;
+    }
+
+    MutableArrayHandle<double> solution = allocateArray<double>(
+        state.task.numRHS, state.task.dimension);
+    HandleTraits<MutableArrayHandle<double> >::MatrixTransparentHandleMap
+        solutionMatrix(solution.ptr(), state.task.dimension,
+            state.task.numRHS);
+    solutionMatrix = state.task.model;
+    return solution;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,31 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file linear_cg.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Linear conjugate gradient: Transition function
+ */
+DECLARE_UDF(convex, linear_cg_transition)
+
+/**
+ * @brief Linear conjugate gradient: State merge function
+ */
+DECLARE_UDF(convex, linear_cg_merge)
+
+/**
+ * @brief Linear conjugate gradient: Final function
+ */
+DECLARE_UDF(convex, linear_cg_final)
+
+/**
+ * @brief Linear conjugate gradient: Largest squared residual norm of a
+ *     transition state
+ */
+DECLARE_UDF(convex, internal_linear_cg_residual)
+
+/**
+ * @brief Linear conjugate gradient: Convert transition state to solution
+ */
+DECLARE_UDF(convex, internal_linear_cg_result)
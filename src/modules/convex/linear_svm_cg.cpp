@@ -8,6 +8,8 @@
 
 #include <dbconnector/dbconnector.hpp>
 
+#include <limits>
+
 #include "linear_svm_cg.hpp"
 
 #include "task/linear_svm.hpp"
@@ -33,6 +35,11 @@ typedef Loss<GLMCGState<MutableArrayHandle<double> >,
         GLMCGState<ArrayHandle<double> >, LinearSVM<GLMModel, GLMTuple > >
             LinearSVMLossAlgorithm;
 
+typedef LineSearchConjugateGradient<
+        GLMCGLineSearchState<MutableArrayHandle<double> >,
+        GLMCGLineSearchState<ArrayHandle<double> >,
+        LinearSVM<GLMModel, GLMTuple > > LinearSVMCGLineSearchAlgorithm;
+
 /**
  * @brief Perform the linear support vector machine transition step
  *
@@ -150,13 +157,137 @@ internal_linear_svm_cg_result::run(AnyType &args) {
     return tuple;
 }
 
+/**
+ * @brief Perform the linear support vector machine transition step, with a
+ *     line search over several candidate step sizes
+ *
+ * Called for each tuple.
+ */
+AnyType
+linear_svm_cg_ls_transition::run(AnyType &args) {
+    GLMCGLineSearchState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            GLMCGLineSearchState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.numCandidates);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            double stepsize = args[5].getAs<double>();
+            int32_t numCandidates = args[6].getAs<int32_t>();
+            if (!(stepsize > 0))
+                throw std::invalid_argument("Invalid parameter: Step size "
+                    "must be positive.");
+            if (numCandidates < 2)
+                throw std::invalid_argument("Invalid parameter: Number of "
+                    "candidate step sizes must be at least 2.");
+
+            state.allocate(*this, dimension,
+                    static_cast<uint32_t>(numCandidates)); // with zeros
+            state.task.stepsize = stepsize;
+            LinearSVMCGLineSearchAlgorithm::setCandidates(state);
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LinearSVMCGLineSearchAlgorithm::transition(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Merge transition states of the line-search variant
+ */
+AnyType
+linear_svm_cg_ls_merge::run(AnyType &args) {
+    GLMCGLineSearchState<MutableArrayHandle<double> > stateLeft = args[0];
+    GLMCGLineSearchState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    LinearSVMCGLineSearchAlgorithm::merge(stateLeft, stateRight);
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step of the line-search variant
+ */
+AnyType
+linear_svm_cg_ls_final::run(AnyType &args) {
+    GLMCGLineSearchState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    LinearSVMCGLineSearchAlgorithm::final(state);
+    state.task.iteration ++;
+
+    return state;
+}
+
+/**
+ * @brief Return the relative difference in loss between two states of the
+ *     line-search variant
+ *
+ * See internal_logit_cg_distance() for the case that no candidate step
+ * decreased the loss.
+ */
+AnyType
+internal_linear_svm_cg_ls_distance::run(AnyType &args) {
+    GLMCGLineSearchState<ArrayHandle<double> > stateLeft = args[0];
+    GLMCGLineSearchState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateRight.task.loss >= stateLeft.task.loss
+            && (stateLeft.task.direction
+                + stateLeft.task.gradient).squaredNorm() > 0)
+        return std::numeric_limits<double>::infinity();
+
+    return std::abs((stateLeft.task.loss - stateRight.task.loss)
+            / stateRight.task.loss);
+}
+
+/**
+ * @brief Return the coefficients and diagnostic statistics of a state of the
+ *     line-search variant
+ */
+AnyType
+internal_linear_svm_cg_ls_result::run(AnyType &args) {
+    GLMCGLineSearchState<ArrayHandle<double> > state = args[0];
+
+    AnyType tuple;
+    tuple << state.task.model
+        << static_cast<double>(state.task.loss);
+
+    return tuple;
+}
+
 /**
  * @brief Return the prediction reselt
  */
 AnyType
 linear_svm_cg_predict::run(AnyType &args) {
     using madlib::dbal::eigen_integration::MappedColumnVector;
-    MappedColumnVector model = args[0].getAs<MappedColumnVector>();
+    MappedColumnVector model(cachedArrayArgument(0));
     MappedColumnVector indVar = args[1].getAs<MappedColumnVector>();
 
     double p = LinearSVM<MappedColumnVector, GLMTuple>::predict(model, indVar);
@@ -31,6 +31,36 @@ DECLARE_UDF(convex, internal_linear_svm_cg_distance)
  */
 DECLARE_UDF(convex, internal_linear_svm_cg_result)
 
+/**
+ * @brief Linear support vector machine (conjugate gradient with line search):
+ *     Transition function
+ */
+DECLARE_UDF(convex, linear_svm_cg_ls_transition)
+
+/**
+ * @brief Linear support vector machine (conjugate gradient with line search):
+ *     State merge function
+ */
+DECLARE_UDF(convex, linear_svm_cg_ls_merge)
+
+/**
+ * @brief Linear support vector machine (conjugate gradient with line search):
+ *     Final function
+ */
+DECLARE_UDF(convex, linear_svm_cg_ls_final)
+
+/**
+ * @brief Linear support vector machine (conjugate gradient with line search):
+ *     Difference in loss between two transition states
+ */
+DECLARE_UDF(convex, internal_linear_svm_cg_ls_distance)
+
+/**
+ * @brief Linear support vector machine (conjugate gradient with line search):
+ *     Convert transition state to result tuple
+ */
+DECLARE_UDF(convex, internal_linear_svm_cg_ls_result)
+
 /**
  * @brief Linear support vector machine (conjugate gradient): Prediction
  */
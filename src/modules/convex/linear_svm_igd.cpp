@@ -12,6 +12,8 @@
 
 #include "task/linear_svm.hpp"
 #include "algo/igd.hpp"
+#include "algo/minibatch_igd.hpp"
+#include "algo/pegasos.hpp"
 #include "algo/loss.hpp"
 
 #include "type/tuple.hpp"
@@ -24,13 +26,36 @@ namespace modules {
 
 namespace convex {
 
-// This 2 classes contain public static methods that can be called
+// This 3 classes contain public static methods that can be called
 typedef IGD<GLMIGDState<MutableArrayHandle<double> >, GLMIGDState<ArrayHandle<double> >,
         LinearSVM<GLMModel, GLMTuple > > LinearSVMIGDAlgorithm;
 
+typedef MiniBatchIGD<GLMIGDState<MutableArrayHandle<double> >,
+        GLMIGDState<ArrayHandle<double> >,
+        LinearSVMIGDAlgorithm> LinearSVMMiniBatchIGDAlgorithm;
+
 typedef Loss<GLMIGDState<MutableArrayHandle<double> >, GLMIGDState<ArrayHandle<double> >,
         LinearSVM<GLMModel, GLMTuple > > LinearSVMLossAlgorithm;
 
+typedef IGD<GLMIGDState<MutableArrayHandle<double> >, GLMIGDState<ArrayHandle<double> >,
+        LinearSVM<GLMModel, FloatGLMTuple > > LinearSVMFloatIGDAlgorithm;
+
+typedef Pegasos<RegularizedGLMIGDState<MutableArrayHandle<double> >,
+        RegularizedGLMIGDState<ArrayHandle<double> >,
+        LinearSVM<GLMModel, GLMTuple > > LinearSVMPegasosAlgorithm;
+
+typedef MiniBatchIGD<RegularizedGLMIGDState<MutableArrayHandle<double> >,
+        RegularizedGLMIGDState<ArrayHandle<double> >,
+        LinearSVMPegasosAlgorithm> LinearSVMMiniBatchPegasosAlgorithm;
+
+typedef IGD<RegularizedGLMIGDState<MutableArrayHandle<double> >,
+        RegularizedGLMIGDState<ArrayHandle<double> >,
+        LinearSVM<GLMModel, GLMTuple > > LinearSVMPegasosMergeAlgorithm;
+
+typedef Loss<RegularizedGLMIGDState<MutableArrayHandle<double> >,
+        RegularizedGLMIGDState<ArrayHandle<double> >,
+        LinearSVM<GLMModel, GLMTuple > > LinearSVMPegasosLossAlgorithm;
+
 /**
  * @brief Perform the linear support vector machine transition step
  *
@@ -48,14 +73,16 @@ linear_svm_igd_transition::run(AnyType &args) {
     if (state.algo.numRows == 0) {
         if (!args[3].isNull()) {
             GLMIGDState<ArrayHandle<double> > previousState = args[3];
-            state.allocate(*this, previousState.task.dimension);
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.batchSize);
             state = previousState;
         } else {
             // configuration parameters
             uint32_t dimension = args[4].getAs<uint32_t>();
             double stepsize = args[5].getAs<double>();
+            uint32_t batchSize = args[6].getAs<uint32_t>();
 
-            state.allocate(*this, dimension); // with zeros
+            state.allocate(*this, dimension, batchSize); // with zeros
             state.task.stepsize = stepsize;
         }
         // resetting in either case
@@ -69,8 +96,62 @@ linear_svm_igd_transition::run(AnyType &args) {
     tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
 
     // Now do the transition step
-    LinearSVMIGDAlgorithm::transition(state, tuple);
-    LinearSVMLossAlgorithm::transition(state, tuple);
+    if (state.task.batchSize <= 1) {
+        LinearSVMIGDAlgorithm::transitionWithLoss(state, tuple);
+    } else {
+        // the loss of buffered tuples is computed at the model of the last
+        // iteration, since the incremental model is only updated per batch
+        LinearSVMMiniBatchIGDAlgorithm::transition(state, tuple);
+        LinearSVMLossAlgorithm::transition(state, tuple);
+    }
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the linear support vector machine transition step for single-precision
+ *     independent variables
+ *
+ * Called for each tuple. The independent variables are mapped as \c REAL[]
+ * without conversion, while the model and the state are kept in double
+ * precision. The state is the same as for linear_svm_igd_transition, so merge and
+ * final function are shared. Mini-batches are not supported.
+ */
+AnyType
+linear_svm_igd_float_transition::run(AnyType &args) {
+    GLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            GLMIGDState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            double stepsize = args[5].getAs<double>();
+
+            state.allocate(*this, dimension); // with zeros
+            state.task.stepsize = stepsize;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    FloatGLMTuple tuple;
+    tuple.indVar.rebind(
+        args[1].getAs<MappedFloatColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LinearSVMFloatIGDAlgorithm::transitionWithLoss(state, tuple);
     state.algo.numRows ++;
 
     return state;
@@ -90,11 +171,14 @@ linear_svm_igd_merge::run(AnyType &args) {
     else if (stateRight.algo.numRows == 0) { return stateLeft; }
 
     // Merge states together
+    LinearSVMMiniBatchIGDAlgorithm::flush(stateLeft);
     LinearSVMIGDAlgorithm::merge(stateLeft, stateRight);
     LinearSVMLossAlgorithm::merge(stateLeft, stateRight);
     // The following numRows update, cannot be put above, because the model
     // averaging depends on their original values
     stateLeft.algo.numRows += stateRight.algo.numRows;
+    // Tuples still buffered on the right are applied to the merged model
+    LinearSVMMiniBatchIGDAlgorithm::mergeBuffers(stateLeft, stateRight);
 
     return stateLeft;
 }
@@ -112,6 +196,7 @@ linear_svm_igd_final::run(AnyType &args) {
     if (state.algo.numRows == 0) { return Null(); }
 
     // finalizing
+    LinearSVMMiniBatchIGDAlgorithm::flush(state);
     LinearSVMIGDAlgorithm::final(state);
     // LinearSVMLossAlgorithm::final(state); // empty function call causes a warning
     
@@ -147,13 +232,142 @@ internal_linear_svm_igd_result::run(AnyType &args) {
     return tuple;
 }
 
+/**
+ * @brief Perform the linear support vector machine transition step of the
+ *     Pegasos solver
+ *
+ * Called for each tuple. Unlike linear_svm_igd_transition, the step sizes
+ * are determined by the regularization lambda (see Pegasos).
+ */
+AnyType
+linear_svm_pegasos_transition::run(AnyType &args) {
+    RegularizedGLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            RegularizedGLMIGDState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.batchSize);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            double lambda = args[5].getAs<double>();
+            uint32_t batchSize = args[6].getAs<uint32_t>();
+
+            if (lambda <= 0.)
+                throw std::invalid_argument("Invalid parameter: lambda "
+                    "must be positive.");
+
+            state.allocate(*this, dimension, batchSize); // with zeros
+            state.task.lambda = lambda;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LinearSVMMiniBatchPegasosAlgorithm::transition(state, tuple);
+    LinearSVMPegasosLossAlgorithm::transition(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function of the Pegasos solver:
+ *     Merge transition states
+ */
+AnyType
+linear_svm_pegasos_merge::run(AnyType &args) {
+    RegularizedGLMIGDState<MutableArrayHandle<double> > stateLeft = args[0];
+    RegularizedGLMIGDState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    // Merge states together
+    LinearSVMMiniBatchPegasosAlgorithm::flush(stateLeft);
+    LinearSVMPegasosMergeAlgorithm::merge(stateLeft, stateRight);
+    LinearSVMPegasosLossAlgorithm::merge(stateLeft, stateRight);
+    // The following numRows update, cannot be put above, because the model
+    // averaging depends on their original values
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+    // Tuples still buffered on the right are applied to the merged model
+    LinearSVMMiniBatchPegasosAlgorithm::mergeBuffers(stateLeft, stateRight);
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the linear support vector machine final step of the Pegasos
+ *     solver
+ */
+AnyType
+linear_svm_pegasos_final::run(AnyType &args) {
+    RegularizedGLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    // finalizing
+    LinearSVMMiniBatchPegasosAlgorithm::flush(state);
+    LinearSVMPegasosAlgorithm::final(state);
+
+    return state;
+}
+
+/**
+ * @brief Return the relative difference in the objective between two states
+ *     of the Pegasos solver
+ */
+AnyType
+internal_linear_svm_pegasos_distance::run(AnyType &args) {
+    RegularizedGLMIGDState<ArrayHandle<double> > stateLeft = args[0];
+    RegularizedGLMIGDState<ArrayHandle<double> > stateRight = args[1];
+
+    return std::abs((stateLeft.algo.loss - stateRight.algo.loss)
+            / stateRight.algo.loss);
+}
+
+/**
+ * @brief Return the coefficients and the objective of a state of the Pegasos
+ *     solver
+ *
+ * The objective is the one of the model of the previous iteration.
+ */
+AnyType
+internal_linear_svm_pegasos_result::run(AnyType &args) {
+    RegularizedGLMIGDState<ArrayHandle<double> > state = args[0];
+
+    AnyType tuple;
+    tuple << state.task.model
+        << static_cast<double>(state.algo.loss)
+            / static_cast<double>(state.algo.numRows);
+
+    return tuple;
+}
+
 /**
  * @brief Return the prediction reselt
  */
 AnyType
 linear_svm_igd_predict::run(AnyType &args) {
     using madlib::dbal::eigen_integration::MappedColumnVector;
-    MappedColumnVector model = args[0].getAs<MappedColumnVector>();
+    MappedColumnVector model(cachedArrayArgument(0));
     MappedColumnVector indVar = args[1].getAs<MappedColumnVector>();
 
     double p = LinearSVM<MappedColumnVector, GLMTuple>::predict(model, indVar);
@@ -161,6 +375,44 @@ linear_svm_igd_predict::run(AnyType &args) {
     return (p > 0.);
 }
 
+/**
+ * @brief Return the prediction result for sparse independent variables
+ */
+AnyType
+linear_svm_igd_sparse_predict::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    MappedColumnVector model(cachedArrayArgument(0));
+    SparseColumnVector indVar = args[1].getAs<SparseColumnVector>();
+
+    if (indVar.size() != model.size())
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    double p = LinearSVM<MappedColumnVector, SparseGLMTuple>::predict(model, indVar);
+
+    return (p > 0.);
+}
+
+/**
+ * @brief Return the prediction result for single-precision independent
+ *     variables
+ */
+AnyType
+linear_svm_igd_float_predict::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    MappedColumnVector model(cachedArrayArgument(0));
+    MappedFloatColumnVector indVar = args[1].getAs<MappedFloatColumnVector>();
+
+    if (indVar.size() != model.size())
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    double p = LinearSVM<MappedColumnVector, FloatGLMTuple>::predict(model,
+        indVar);
+
+    return (p > 0.);
+}
+
 } // namespace convex
 
 } // namespace modules
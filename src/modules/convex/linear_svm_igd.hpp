@@ -9,6 +9,12 @@
  */
 DECLARE_UDF(convex, linear_svm_igd_transition)
 
+/**
+ * @brief Linear support vector machine (incremental gradient): Transition
+ *     function for single-precision independent variables
+ */
+DECLARE_UDF(convex, linear_svm_igd_float_transition)
+
 /**
  * @brief Linear support vector machine (incremental gradient): State merge function
  */
@@ -36,3 +42,42 @@ DECLARE_UDF(convex, internal_linear_svm_igd_result)
  */
 DECLARE_UDF(convex, linear_svm_igd_predict)
 
+/**
+ * @brief Linear support vector machine (incremental gradient): Prediction
+ *     for sparse independent variables
+ */
+DECLARE_UDF(convex, linear_svm_igd_sparse_predict)
+
+
+/**
+ * @brief Linear support vector machine (incremental gradient): Prediction
+ *     for single-precision independent variables
+ */
+DECLARE_UDF(convex, linear_svm_igd_float_predict)
+
+/**
+ * @brief Linear support vector machine (Pegasos): Transition function
+ */
+DECLARE_UDF(convex, linear_svm_pegasos_transition)
+
+/**
+ * @brief Linear support vector machine (Pegasos): State merge function
+ */
+DECLARE_UDF(convex, linear_svm_pegasos_merge)
+
+/**
+ * @brief Linear support vector machine (Pegasos): Final function
+ */
+DECLARE_UDF(convex, linear_svm_pegasos_final)
+
+/**
+ * @brief Linear support vector machine (Pegasos): Relative difference in the
+ *     objective between two transition states
+ */
+DECLARE_UDF(convex, internal_linear_svm_pegasos_distance)
+
+/**
+ * @brief Linear support vector machine (Pegasos): Convert transition state
+ *     to result tuple
+ */
+DECLARE_UDF(convex, internal_linear_svm_pegasos_result)
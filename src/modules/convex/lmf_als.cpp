@@ -0,0 +1,379 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file lmf_als.cpp
+ *
+ * @brief Low-rank Matrix Factorization functions: Alternating least squares
+ *
+ * With the factors of all columns fixed, the factor \f$ u_i \f$ of row i that
+ * minimizes the regularized squared error is the solution of the r x r normal
+ * equations
+ * \f[
+ *     \Big( \sum_j v_j v_j^T + \lambda n_i I \Big) u_i = \sum_j a_{ij} v_j ,
+ * \f]
+ * where j ranges over the \f$ n_i \f$ available entries of row i (weighted
+ * lambda regularization). One half-iteration is therefore an aggregate grouped
+ * by row, and the other one an aggregate grouped by column. The transition
+ * states are small and can be added, so the work is distributed across
+ * segments just like any other aggregate.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <new>
+
+#include "lmf_als.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// Use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+/**
+ * @brief Transition state for solving the normal equations of one row (or
+ *     column)
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * rank, numRows, lambda, followed by the lower triangle (stored as full
+ * column-major rank x rank matrix) of the sum of outer products of the fixed
+ * factors, followed by the rank-vector of right-hand sides.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0.
+ */
+template <class Handle>
+class LMFALSState {
+    template <class OtherHandle>
+    friend class LMFALSState;
+
+public:
+    LMFALSState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inRank,
+        double inLambda) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inRank));
+        rebind(inRank);
+        rank = inRank;
+        lambda = inLambda;
+    }
+
+    /**
+     * @brief Merge with another state
+     */
+    template <class OtherHandle>
+    LMFALSState &operator+=(const LMFALSState<OtherHandle> &inOther) {
+        if (mStorage.size() != inOther.mStorage.size()
+                || static_cast<double>(lambda)
+                != static_cast<double>(inOther.lambda))
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOther.numRows;
+        normal += inOther.normal;
+        rhs += inOther.rhs;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inRank) {
+        return 3 + static_cast<size_t>(inRank) * (inRank + 1);
+    }
+
+    void rebind(uint32_t inRank) {
+        madlib_assert(mStorage.size() >= arraySize(inRank),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        rank.rebind(&mStorage[0]);
+        numRows.rebind(&mStorage[1]);
+        lambda.rebind(&mStorage[2]);
+        // Before the first row, the state has no room for the matrices, so
+        // compute the pointers without the bounds-checked Handle::operator[]
+        normal.rebind(mStorage.ptr() + 3, inRank, inRank);
+        rhs.rebind(mStorage.ptr() + 3 + static_cast<size_t>(inRank) * inRank,
+            inRank);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 rank;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToDouble lambda;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap normal;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap rhs;
+};
+
+/**
+ * @brief Transition state for collecting the factors of all rows (or
+ *     columns) into one matrix
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * rank, dim, numRows, followed by the rank x dim matrix of factors (one
+ * column per row of the factorized matrix, as in LMFModel). Rows without a
+ * factor are 0.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0.
+ */
+template <class Handle>
+class LMFALSMatrixState {
+    template <class OtherHandle>
+    friend class LMFALSMatrixState;
+
+public:
+    LMFALSMatrixState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]),
+            static_cast<uint32_t>(mStorage[1]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inRank,
+        uint32_t inDim) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inRank, inDim));
+        rebind(inRank, inDim);
+        rank = inRank;
+        dim = inDim;
+    }
+
+    /**
+     * @brief Merge with another state. Both states are expected to contain
+     *     disjoint factors.
+     */
+    template <class OtherHandle>
+    LMFALSMatrixState &operator+=(
+        const LMFALSMatrixState<OtherHandle> &inOther) {
+
+        if (mStorage.size() != inOther.mStorage.size())
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOther.numRows;
+        factors += inOther.factors;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inRank, uint32_t inDim) {
+        return 3 + static_cast<size_t>(inRank) * inDim;
+    }
+
+    void rebind(uint32_t inRank, uint32_t inDim) {
+        madlib_assert(mStorage.size() >= arraySize(inRank, inDim),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        rank.rebind(&mStorage[0]);
+        dim.rebind(&mStorage[1]);
+        numRows.rebind(&mStorage[2]);
+        factors.rebind(mStorage.ptr() + 3, inRank, inDim);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 rank;
+    typename HandleTraits<Handle>::ReferenceToUInt32 dim;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap factors;
+};
+
+/**
+ * @brief Return a factor of uniform random numbers in [0, scale_factor)
+ */
+AnyType
+lmf_als_random_factor::run(AnyType &args) {
+    int32_t maxRank = args[0].getAs<int32_t>();
+    double scaleFactor = args[1].getAs<double>();
+
+    if (maxRank <= 0)
+        throw std::invalid_argument("Invalid parameter: max_rank <= 0");
+    if (scaleFactor <= 0.)
+        throw std::invalid_argument("Invalid parameter: scale_factor <= 0.0");
+
+    // The generator is kept for all rows of the query
+    void *&cache = callSiteCache();
+    if (cache == NULL) {
+        void *memory = allocateCallSiteCache(
+            sizeof(PhiloxRandomNumberGenerator));
+        cache = new (memory) PhiloxRandomNumberGenerator;
+    }
+    PhiloxRandomNumberGenerator &rng
+        = *static_cast<PhiloxRandomNumberGenerator*>(cache);
+
+    MutableArrayHandle<double> factor = allocateArray<double>(maxRank);
+    double base = rng.min();
+    double span = rng.max() - base;
+    rng.fill(factor.ptr(), maxRank);
+    for (int32_t i = 0; i < maxRank; i++)
+        factor[i] = scaleFactor * (factor[i] - base) / span;
+
+    return factor;
+}
+
+/**
+ * @brief Perform the alternating-least-squares transition step
+ *
+ * Called for each available entry of a row (or column), with the fixed factor
+ * of its column (or row).
+ */
+AnyType
+lmf_als_transition::run(AnyType &args) {
+    LMFALSState<MutableArrayHandle<double> > state = args[0];
+    MappedColumnVector factor = args[1].getAs<MappedColumnVector>();
+    double value = args[2].getAs<double>();
+
+    if (state.numRows == 0) {
+        double lambda = args[3].getAs<double>();
+        if (lambda < 0.)
+            throw std::invalid_argument("Invalid parameter: lambda < 0.0");
+        if (factor.size() == 0)
+            throw std::invalid_argument("Invalid parameter: empty factor");
+        state.initialize(*this, static_cast<uint32_t>(factor.size()),
+            lambda);
+    } else if (factor.size() != static_cast<Index>(state.rank))
+        throw std::invalid_argument("Invalid parameter: factors of "
+            "different ranks");
+
+    triangularView<Lower>(state.normal) += factor * trans(factor);
+    state.rhs += value * factor;
+    state.numRows++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the merging of two alternating-least-squares transition
+ *     states
+ */
+AnyType
+lmf_als_merge::run(AnyType &args) {
+    LMFALSState<MutableArrayHandle<double> > stateLeft = args[0];
+    LMFALSState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0) { return stateRight; }
+    else if (stateRight.numRows == 0) { return stateLeft; }
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the alternating-least-squares final step: Solve the
+ *     regularized normal equations
+ */
+AnyType
+lmf_als_final::run(AnyType &args) {
+    LMFALSState<ArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.numRows == 0) { return Null(); }
+
+    // LDLT only reads the lower triangle, which is all that is accumulated
+    Matrix normal = state.normal;
+    normal.diagonal().array()
+        += state.lambda * static_cast<double>(state.numRows);
+    ColumnVector solution = normal.ldlt().solve(state.rhs);
+
+    MutableArrayHandle<double> factor = allocateArray<double>(state.rank);
+    for (uint32_t i = 0; i < state.rank; i++)
+        factor[i] = solution(i);
+    return factor;
+}
+
+/**
+ * @brief Perform the transition step of collecting factors into a matrix
+ */
+AnyType
+lmf_als_matrix_transition::run(AnyType &args) {
+    LMFALSMatrixState<MutableArrayHandle<double> > state = args[0];
+    int32_t id = args[1].getAs<int32_t>();
+    MappedColumnVector factor = args[2].getAs<MappedColumnVector>();
+
+    if (state.numRows == 0) {
+        int32_t dim = args[3].getAs<int32_t>();
+        if (dim <= 0)
+            throw std::invalid_argument("Invalid parameter: dimension <= 0");
+        if (factor.size() == 0)
+            throw std::invalid_argument("Invalid parameter: empty factor");
+        state.initialize(*this, static_cast<uint32_t>(factor.size()),
+            static_cast<uint32_t>(dim));
+    } else if (factor.size() != static_cast<Index>(state.rank))
+        throw std::invalid_argument("Invalid parameter: factors of "
+            "different ranks");
+    if (id <= 0 || static_cast<uint32_t>(id) > state.dim)
+        throw std::invalid_argument("Invalid parameter: [col_row] > row_dim "
+            "or [col_column] > column_dim in table [rel_source]");
+
+    // database starts from 1, while C++ starts from 0
+    state.factors.col(id - 1) = factor;
+    state.numRows++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the merging of two states of collecting factors into a
+ *     matrix
+ */
+AnyType
+lmf_als_matrix_merge::run(AnyType &args) {
+    LMFALSMatrixState<MutableArrayHandle<double> > stateLeft = args[0];
+    LMFALSMatrixState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateLeft.numRows == 0) { return stateRight; }
+    else if (stateRight.numRows == 0) { return stateLeft; }
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step of collecting factors into a matrix
+ *
+ * The result has one row per row (or column) of the factorized matrix, like
+ * the factors returned by internal_lmf_igd_result().
+ */
+AnyType
+lmf_als_matrix_final::run(AnyType &args) {
+    LMFALSMatrixState<ArrayHandle<double> > state = args[0];
+
+    if (state.numRows == 0) { return Null(); }
+
+    Matrix factors = state.factors;
+    return factors;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,47 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file lmf_als.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Low-rank matrix factorization (alternating least squares): Random
+ *     initial factor
+ */
+DECLARE_UDF(convex, lmf_als_random_factor)
+
+/**
+ * @brief Low-rank matrix factorization (alternating least squares):
+ *     Transition function
+ */
+DECLARE_UDF(convex, lmf_als_transition)
+
+/**
+ * @brief Low-rank matrix factorization (alternating least squares): State
+ *     merge function
+ */
+DECLARE_UDF(convex, lmf_als_merge)
+
+/**
+ * @brief Low-rank matrix factorization (alternating least squares): Final
+ *     function
+ */
+DECLARE_UDF(convex, lmf_als_final)
+
+/**
+ * @brief Low-rank matrix factorization (alternating least squares):
+ *     Transition function for collecting factors into a matrix
+ */
+DECLARE_UDF(convex, lmf_als_matrix_transition)
+
+/**
+ * @brief Low-rank matrix factorization (alternating least squares): State
+ *     merge function for collecting factors into a matrix
+ */
+DECLARE_UDF(convex, lmf_als_matrix_merge)
+
+/**
+ * @brief Low-rank matrix factorization (alternating least squares): Final
+ *     function for collecting factors into a matrix
+ */
+DECLARE_UDF(convex, lmf_als_matrix_final)
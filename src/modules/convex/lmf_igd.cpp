@@ -54,15 +54,15 @@ lmf_igd_transition::run(AnyType &args) {
             state = previousState;
         } else {
             // configuration parameters
-            uint16_t rowDim = args[5].getAs<uint16_t>();
+            uint32_t rowDim = args[5].getAs<uint32_t>();
             if (rowDim == 0) {
                 throw std::runtime_error("Invalid parameter: row_dim = 0");
             }
-            uint16_t columnDim = args[6].getAs<uint16_t>();
+            uint32_t columnDim = args[6].getAs<uint32_t>();
             if (columnDim == 0) {
                 throw std::runtime_error("Invalid parameter: column_dim = 0");
             }
-            uint16_t maxRank = args[7].getAs<uint16_t>();
+            uint32_t maxRank = args[7].getAs<uint32_t>();
             if (maxRank == 0) {
                 throw std::runtime_error("Invalid parameter: max_rank = 0");
             }
@@ -79,7 +79,7 @@ lmf_igd_transition::run(AnyType &args) {
             state.allocate(*this, rowDim, columnDim, maxRank);
             state.task.stepsize = stepsize;
             state.task.scaleFactor = scaleFactor;
-            state.task.model.initialize(scaleFactor);
+            state.task.model.initialize(scaleFactor, maxRank);
         }
         // resetting in either case
         state.reset();
@@ -87,20 +87,24 @@ lmf_igd_transition::run(AnyType &args) {
 
     // tuple
     LMFTuple tuple;
-    tuple.indVar.i = args[1].getAs<uint16_t>();
-    tuple.indVar.j = args[2].getAs<uint16_t>();
+    tuple.indVar.i = args[1].getAs<uint32_t>();
+    tuple.indVar.j = args[2].getAs<uint32_t>();
     if (tuple.indVar.i == 0 || tuple.indVar.j == 0) {
         throw std::runtime_error("Invalid parameter: [col_row] = 0 or "
                 "[col_column] = 0 in table [rel_source]");
     }
+    if (tuple.indVar.i > static_cast<uint32_t>(state.task.rowDim)
+            || tuple.indVar.j > static_cast<uint32_t>(state.task.colDim)) {
+        throw std::runtime_error("Invalid parameter: [col_row] > row_dim or "
+                "[col_column] > column_dim in table [rel_source]");
+    }
     // database starts from 1, while C++ starts from 0
     tuple.indVar.i --;
     tuple.indVar.j --;
     tuple.depVar = args[3].getAs<double>();
 
     // Now do the transition step
-    LMFIGDAlgorithm::transition(state, tuple);
-    LMFLossAlgorithm::transition(state, tuple);
+    LMFIGDAlgorithm::transitionWithLoss(state, tuple);
     state.algo.numRows ++;
 
     return state;
@@ -129,6 +133,28 @@ lmf_igd_merge::run(AnyType &args) {
     return stateLeft;
 }
 
+/**
+ * @brief Merge transition states of a stratified (DSGD) iteration
+ *
+ * Within one sub-epoch of the stratified driver, the tuples of different
+ * segments belong to different strata, so they update disjoint rows of U and
+ * V. The updates are therefore added, not averaged.
+ */
+AnyType
+lmf_igd_stratified_merge::run(AnyType &args) {
+    LMFIGDState<MutableArrayHandle<double> > stateLeft = args[0];
+    LMFIGDState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    LMFIGDAlgorithm::mergeDisjoint(stateLeft, stateRight);
+    LMFLossAlgorithm::merge(stateLeft, stateRight);
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
 /**
  * @brief Perform the low-rank matrix factorization final step
  */
@@ -170,8 +196,9 @@ AnyType
 internal_lmf_igd_result::run(AnyType &args) {
     LMFIGDState<ArrayHandle<double> > state = args[0];
 
-    Matrix U = trans(state.task.model.matrixU);
-    Matrix V = trans(state.task.model.matrixV);
+    // the model is already stored transposed, only the padding is dropped
+    Matrix U = state.task.model.matrixU.topRows(state.task.maxRank);
+    Matrix V = state.task.model.matrixV.topRows(state.task.maxRank);
     double RMSE = state.task.RMSE;
 
     AnyType tuple;
@@ -14,6 +14,12 @@ DECLARE_UDF(convex, lmf_igd_transition)
  */
 DECLARE_UDF(convex, lmf_igd_merge)
 
+/**
+ * @brief Low-rank matrix factorization (incremental gradient): State merge
+ *     function for disjoint strata
+ */
+DECLARE_UDF(convex, lmf_igd_stratified_merge)
+
 /**
  * @brief Low-rank matrix factorization (incremental gradient): Final function
  */
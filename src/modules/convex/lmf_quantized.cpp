@@ -0,0 +1,422 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file lmf_quantized.cpp
+ *
+ * @brief Low-rank Matrix Factorization functions: Quantized factors for
+ *     scoring
+ *
+ * Scoring all rows against all columns of a factor model only computes dot
+ * products of factors, so it is limited by how fast the factors can be read.
+ * The functions here store the factors of a model as 8-bit integers or 16-bit
+ * floats, with one scale per block of consecutive factors, and compute the
+ * dot products directly on the quantized codes.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "lmf_quantized.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// Use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+namespace {
+
+/**
+ * @brief Convert a single-precision float to IEEE half precision
+ *
+ * Rounds to nearest even. Values beyond the half-precision range become
+ * infinity, which does not happen for the normalized values that are stored
+ * in QuantizedFactors.
+ */
+inline
+uint16_t
+floatToHalf(float inValue) {
+    uint32_t bits;
+    std::memcpy(&bits, &inValue, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent <= 0) {
+        // Subnormal half (or zero)
+        if (exponent < -10)
+            return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    if (exponent >= 31)
+        return static_cast<uint16_t>(sign | 0x7C00);
+
+    uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFF;
+    // A carry out of the mantissa correctly increments the exponent
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;
+    return static_cast<uint16_t>(sign | half);
+}
+
+/**
+ * @brief Convert a finite IEEE half-precision number to single precision
+ *
+ * Written without branches on the data, so that loops over codes can be
+ * vectorized.
+ */
+inline
+float
+halfToFloat(uint16_t inHalf) {
+    uint32_t sign = static_cast<uint32_t>(inHalf & 0x8000) << 16;
+    uint32_t exponent = (inHalf >> 10) & 0x1F;
+    uint32_t mantissa = inHalf & 0x3FF;
+
+    uint32_t bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float normal;
+    std::memcpy(&normal, &bits, sizeof(normal));
+    float subnormal = static_cast<float>(mantissa) * (1.f / 16777216.f);
+    if (sign)
+        subnormal = -subnormal;
+    return exponent ? normal : subnormal;
+}
+
+/**
+ * @brief Quantized factors of all rows (or all columns) of a factor model
+ *
+ * The layout of the byte string is:
+ * - Header: bits (8 or 16), number of vectors, rank, block size, each as
+ *   uint32
+ * - The float scale of every block, block-major within each vector,
+ *   padded to a multiple of 8 bytes
+ * - The codes (int8 or IEEE half) of every vector. The last block of each
+ *   vector is padded with zeros to the full block size, so that all blocks
+ *   have the same length.
+ *
+ * A factor is the scale of its block times its code: For 8 bits, codes are in
+ * [-127, 127] and the scale is the largest absolute value in the block divided
+ * by 127. For 16 bits, codes are in [-1, 1] and the scale is the largest
+ * absolute value.
+ */
+class QuantizedFactors {
+public:
+    enum { kHeaderSize = 4 * sizeof(uint32_t) };
+
+    QuantizedFactors(const ByteString &inStorage)
+      : mStorage(inStorage.ptr()) {
+
+        if (inStorage.size() < kHeaderSize)
+            throw std::invalid_argument("Invalid quantized factors.");
+        readHeader();
+        if ((bits != 8 && bits != 16) || blockSize == 0
+            || inStorage.size() != storageSize(bits, numVectors, rank,
+                blockSize))
+            throw std::invalid_argument("Invalid quantized factors.");
+        bind();
+    }
+
+    /**
+     * @brief Quantize the columns of a matrix into new storage
+     */
+    static MutableByteString quantize(const Allocator &inAllocator,
+        const MappedMatrix &inFactors, uint32_t inBits, uint32_t inBlockSize) {
+
+        uint32_t numVectors = static_cast<uint32_t>(inFactors.cols());
+        uint32_t rank = static_cast<uint32_t>(inFactors.rows());
+        MutableByteString storage = inAllocator.allocateByteString<
+            dbal::FunctionContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                storageSize(inBits, numVectors, rank, inBlockSize));
+
+        uint32_t header[4] = { inBits, numVectors, rank, inBlockSize };
+        std::memcpy(storage.ptr(), header, kHeaderSize);
+
+        QuantizedFactors quantized(storage);
+        float *scales = const_cast<float*>(quantized.mScales);
+        for (uint32_t j = 0; j < numVectors; ++j) {
+            for (uint32_t b = 0; b < quantized.numBlocks; ++b) {
+                uint32_t begin = b * inBlockSize;
+                uint32_t length = std::min(inBlockSize, rank - begin);
+                double maxAbs = inFactors.col(j).segment(begin, length)
+                    .cwiseAbs().maxCoeff();
+                float scale = static_cast<float>(
+                    inBits == 8 ? maxAbs / 127. : maxAbs);
+                size_t block = static_cast<size_t>(j) * quantized.numBlocks
+                    + b;
+                scales[block] = scale;
+                if (!(scale > 0))
+                    continue;
+
+                if (inBits == 8) {
+                    int8_t *codes = const_cast<int8_t*>(
+                        quantized.int8Codes(block));
+                    for (uint32_t i = 0; i < length; ++i) {
+                        double code = std::floor(
+                            inFactors(begin + i, j) / scale + 0.5);
+                        codes[i] = static_cast<int8_t>(
+                            std::max(-127., std::min(127., code)));
+                    }
+                } else {
+                    uint16_t *codes = const_cast<uint16_t*>(
+                        quantized.halfCodes(block));
+                    for (uint32_t i = 0; i < length; ++i) {
+                        double code = inFactors(begin + i, j) / scale;
+                        codes[i] = floatToHalf(static_cast<float>(
+                            std::max(-1., std::min(1., code))));
+                    }
+                }
+            }
+        }
+        return storage;
+    }
+
+    /**
+     * @brief Throw if the factors of another model cannot be multiplied with
+     *     these
+     */
+    void checkCompatible(const QuantizedFactors &inOther) const {
+        if (bits != inOther.bits || rank != inOther.rank
+            || blockSize != inOther.blockSize)
+            throw std::invalid_argument("Quantized factors have different "
+                "ranks, bits, or block sizes.");
+    }
+
+    /**
+     * @brief Check a 1-based row (or column) id and return the 0-based index
+     */
+    uint32_t index(int32_t inId) const {
+        if (inId <= 0 || static_cast<uint32_t>(inId) > numVectors)
+            throw std::invalid_argument("Invalid parameter: row or column id "
+                "out of range of the quantized factors");
+        return static_cast<uint32_t>(inId - 1);
+    }
+
+    /**
+     * @brief Dot product of vector i of this and vector j of another model
+     *
+     * For 8 bits, the products of codes are summed as integers within each
+     * block, and only the block sums are scaled.
+     */
+    double dot(uint32_t inIndex, const QuantizedFactors &inOther,
+        uint32_t inOtherIndex) const {
+
+        double result = 0;
+        size_t block = static_cast<size_t>(inIndex) * numBlocks;
+        size_t otherBlock = static_cast<size_t>(inOtherIndex) * numBlocks;
+        for (uint32_t b = 0; b < numBlocks; ++b, ++block, ++otherBlock) {
+            double scale = static_cast<double>(mScales[block])
+                * inOther.mScales[otherBlock];
+            if (bits == 8) {
+                const int8_t *x = int8Codes(block);
+                const int8_t *y = inOther.int8Codes(otherBlock);
+                int32_t sum = 0;
+                for (uint32_t i = 0; i < blockSize; ++i)
+                    sum += static_cast<int32_t>(x[i]) * y[i];
+                result += scale * sum;
+            } else {
+                const uint16_t *x = halfCodes(block);
+                const uint16_t *y = inOther.halfCodes(otherBlock);
+                float sum = 0;
+                for (uint32_t i = 0; i < blockSize; ++i)
+                    sum += halfToFloat(x[i]) * halfToFloat(y[i]);
+                result += scale * sum;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Dot products of vector i of this with all vectors of another
+     *     model
+     *
+     * For 16 bits, vector i is decoded only once.
+     */
+    void dots(uint32_t inIndex, const QuantizedFactors &inOther,
+        double *outDots) const {
+
+        if (bits == 8) {
+            for (uint32_t j = 0; j < inOther.numVectors; ++j)
+                outDots[j] = dot(inIndex, inOther, j);
+            return;
+        }
+
+        std::vector<float> decoded(static_cast<size_t>(numBlocks) * blockSize);
+        const uint16_t *x = halfCodes(static_cast<size_t>(inIndex)
+            * numBlocks);
+        for (size_t i = 0; i < decoded.size(); ++i)
+            decoded[i] = halfToFloat(x[i]);
+
+        for (uint32_t j = 0; j < inOther.numVectors; ++j) {
+            double result = 0;
+            size_t block = static_cast<size_t>(inIndex) * numBlocks;
+            size_t otherBlock = static_cast<size_t>(j) * numBlocks;
+            for (uint32_t b = 0; b < numBlocks; ++b, ++block, ++otherBlock) {
+                const float *u = &decoded[static_cast<size_t>(b) * blockSize];
+                const uint16_t *y = inOther.halfCodes(otherBlock);
+                float sum = 0;
+                for (uint32_t i = 0; i < blockSize; ++i)
+                    sum += u[i] * halfToFloat(y[i]);
+                result += static_cast<double>(mScales[block])
+                    * inOther.mScales[otherBlock] * sum;
+            }
+            outDots[j] = result;
+        }
+    }
+
+    /**
+     * @brief Decode all factors into a rank x numVectors matrix
+     */
+    void dequantize(MutableMappedMatrix &outFactors) const {
+        for (uint32_t j = 0; j < numVectors; ++j) {
+            for (uint32_t b = 0; b < numBlocks; ++b) {
+                size_t block = static_cast<size_t>(j) * numBlocks + b;
+                uint32_t begin = b * blockSize;
+                uint32_t length = std::min(blockSize, rank - begin);
+                for (uint32_t i = 0; i < length; ++i)
+                    outFactors(begin + i, j) = mScales[block]
+                        * (bits == 8
+                            ? static_cast<double>(int8Codes(block)[i])
+                            : static_cast<double>(
+                                halfToFloat(halfCodes(block)[i])));
+            }
+        }
+    }
+
+    uint32_t bits;
+    uint32_t numVectors;
+    uint32_t rank;
+    uint32_t blockSize;
+    uint32_t numBlocks;
+
+private:
+    static size_t scalesSize(uint32_t inNumVectors, uint32_t inNumBlocks) {
+        return (static_cast<size_t>(inNumVectors) * inNumBlocks * sizeof(float)
+            + 7) / 8 * 8;
+    }
+
+    static size_t storageSize(uint32_t inBits, uint32_t inNumVectors,
+        uint32_t inRank, uint32_t inBlockSize) {
+
+        uint32_t numBlocks = (inRank + inBlockSize - 1) / inBlockSize;
+        return kHeaderSize + scalesSize(inNumVectors, numBlocks)
+            + static_cast<size_t>(inNumVectors) * numBlocks * inBlockSize
+                * (inBits / 8);
+    }
+
+    void readHeader() {
+        uint32_t header[4];
+        std::memcpy(header, mStorage, kHeaderSize);
+        bits = header[0];
+        numVectors = header[1];
+        rank = header[2];
+        blockSize = header[3];
+        numBlocks = blockSize > 0 ? (rank + blockSize - 1) / blockSize : 0;
+    }
+
+    void bind() {
+        mScales = reinterpret_cast<const float*>(mStorage + kHeaderSize);
+        mCodes = mStorage + kHeaderSize + scalesSize(numVectors, numBlocks);
+    }
+
+    const int8_t *int8Codes(size_t inBlock) const {
+        return reinterpret_cast<const int8_t*>(mCodes) + inBlock * blockSize;
+    }
+
+    const uint16_t *halfCodes(size_t inBlock) const {
+        return reinterpret_cast<const uint16_t*>(mCodes) + inBlock * blockSize;
+    }
+
+    const char *mStorage;
+    const float *mScales;
+    const char *mCodes;
+};
+
+} // anonymous namespace
+
+/**
+ * @brief Quantize the factors returned by lmf_igd_run() or lmf_als_run()
+ */
+AnyType
+lmf_quantize::run(AnyType &args) {
+    MappedMatrix factors = args[0].getAs<MappedMatrix>();
+    int32_t bits = args[1].getAs<int32_t>();
+    int32_t blockSize = args[2].getAs<int32_t>();
+
+    if (bits != 8 && bits != 16)
+        throw std::invalid_argument("Invalid parameter: bits must be 8 or 16");
+    if (blockSize <= 0 || blockSize > 65536)
+        throw std::invalid_argument("Invalid parameter: block_size must be in "
+            "[1, 65536]");
+    if (factors.size() == 0)
+        throw std::invalid_argument("Invalid parameter: empty factors");
+    if (!isfinite(factors))
+        throw std::invalid_argument("Invalid parameter: factors are not "
+            "finite");
+
+    return QuantizedFactors::quantize(*this, factors,
+        static_cast<uint32_t>(bits), static_cast<uint32_t>(blockSize));
+}
+
+/**
+ * @brief Decode quantized factors into the format of the model table
+ */
+AnyType
+lmf_dequantize::run(AnyType &args) {
+    QuantizedFactors quantized(args[0].getAs<ByteString>());
+
+    MutableMappedMatrix factors(
+        allocateArray<double>(quantized.numVectors, quantized.rank));
+    quantized.dequantize(factors);
+    return factors;
+}
+
+/**
+ * @brief Predict a single entry from quantized row and column factors
+ */
+AnyType
+lmf_quantized_predict::run(AnyType &args) {
+    QuantizedFactors u(args[0].getAs<ByteString>());
+    QuantizedFactors v(args[1].getAs<ByteString>());
+    u.checkCompatible(v);
+
+    return u.dot(u.index(args[2].getAs<int32_t>()), v,
+        v.index(args[3].getAs<int32_t>()));
+}
+
+/**
+ * @brief Predict all entries of a row from quantized row and column factors
+ *
+ * Element j of the result is the prediction for column j.
+ */
+AnyType
+lmf_quantized_predict_row::run(AnyType &args) {
+    QuantizedFactors u(args[0].getAs<ByteString>());
+    QuantizedFactors v(args[1].getAs<ByteString>());
+    u.checkCompatible(v);
+    uint32_t row = u.index(args[2].getAs<int32_t>());
+
+    MutableArrayHandle<double> predictions
+        = allocateArray<double>(v.numVectors);
+    u.dots(row, v, predictions.ptr());
+    return predictions;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,27 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file lmf_quantized.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Low-rank matrix factorization: Quantize factors for scoring
+ */
+DECLARE_UDF(convex, lmf_quantize)
+
+/**
+ * @brief Low-rank matrix factorization: Decode quantized factors
+ */
+DECLARE_UDF(convex, lmf_dequantize)
+
+/**
+ * @brief Low-rank matrix factorization: Predict one entry from quantized
+ *     factors
+ */
+DECLARE_UDF(convex, lmf_quantized_predict)
+
+/**
+ * @brief Low-rank matrix factorization: Predict all entries of a row from
+ *     quantized factors
+ */
+DECLARE_UDF(convex, lmf_quantized_predict_row)
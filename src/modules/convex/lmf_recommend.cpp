@@ -0,0 +1,218 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file lmf_recommend.cpp
+ *
+ * @brief Low-rank Matrix Factorization functions: Top-N recommendations
+ *
+ * The predictions of a block of rows (users) for a chunk of columns (items)
+ * are one matrix product of their factors, so the factors of each item are
+ * read once per block of users instead of once per user. The best N items of
+ * every user are kept in a bounded min-heap.
+ *
+ * Items are visited in order of decreasing norm of their factors. By the
+ * Cauchy-Schwarz inequality, no prediction for user u in a chunk can exceed
+ * \f$ \| u \| \cdot \| v \| \f$, where \f$ v \f$ is the first item of the
+ * chunk. Once this bound does not beat the N-th best prediction of any user of
+ * the block, the remaining items are skipped. The result is exact either way.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "lmf_recommend.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// Use Eigen
+using namespace madlib::dbal::eigen_integration;
+
+namespace {
+
+// Number of users scored together, and number of items per matrix product
+const Index kUserBlockSize = 64;
+const Index kItemChunkSize = 256;
+
+// A prediction and the 0-based index of its item. Among equal predictions,
+// the smaller item index is better.
+typedef std::pair<double, Index> ScoredItem;
+
+struct BetterItem {
+    bool operator()(const ScoredItem &inLeft, const ScoredItem &inRight)
+        const {
+
+        return inLeft.first > inRight.first
+            || (inLeft.first == inRight.first
+                && inLeft.second < inRight.second);
+    }
+};
+
+/**
+ * @brief The N best items seen so far, as a heap with the worst item on top
+ */
+class BoundedHeap {
+public:
+    BoundedHeap(std::size_t inCapacity) : mCapacity(inCapacity) {
+        mItems.reserve(inCapacity);
+    }
+
+    bool full() const {
+        return mItems.size() >= mCapacity;
+    }
+
+    /**
+     * @brief The N-th best prediction (only defined if the heap is full)
+     */
+    double worstScore() const {
+        return mItems.front().first;
+    }
+
+    void push(const ScoredItem &inItem) {
+        if (!full()) {
+            mItems.push_back(inItem);
+            std::push_heap(mItems.begin(), mItems.end(), BetterItem());
+        } else if (BetterItem()(inItem, mItems.front())) {
+            std::pop_heap(mItems.begin(), mItems.end(), BetterItem());
+            mItems.back() = inItem;
+            std::push_heap(mItems.begin(), mItems.end(), BetterItem());
+        }
+    }
+
+    /**
+     * @brief Return the items, best first. The heap is empty afterwards.
+     */
+    std::vector<ScoredItem> &sorted() {
+        std::sort_heap(mItems.begin(), mItems.end(), BetterItem());
+        return mItems;
+    }
+
+private:
+    std::size_t mCapacity;
+    std::vector<ScoredItem> mItems;
+};
+
+} // anonymous namespace
+
+/**
+ * @brief Compute the top-N columns (items) of the given rows (users)
+ *
+ * Returns the composite of two two-dimensional arrays with one inner array
+ * per user: the 1-based item ids, best first, and their predictions. If there
+ * are fewer than N items, all items are returned.
+ */
+AnyType
+lmf_recommend_block::run(AnyType &args) {
+    // Factors are stored with one column per user (or item), see
+    // internal_lmf_igd_result()
+    MappedMatrix U = args[0].getAs<MappedMatrix>();
+    MappedMatrix V = args[1].getAs<MappedMatrix>();
+    ArrayHandle<int32_t> userIds = args[2].getAs<ArrayHandle<int32_t> >();
+    int32_t n = args[3].getAs<int32_t>();
+    bool prune = args[4].getAs<bool>();
+
+    if (U.rows() != V.rows())
+        throw std::invalid_argument("Invalid parameter: matrix_u and "
+            "matrix_v have different ranks");
+    if (n <= 0)
+        throw std::invalid_argument("Invalid parameter: n <= 0");
+    if (V.cols() == 0 || userIds.size() == 0)
+        return Null();
+
+    Index numUsers = static_cast<Index>(userIds.size());
+    Index numItems = V.cols();
+    Index numResults = std::min(static_cast<Index>(n), numItems);
+
+    std::vector<Index> users(numUsers);
+    for (Index i = 0; i < numUsers; ++i) {
+        int32_t id = userIds[i];
+        if (id <= 0 || static_cast<Index>(id) > U.cols())
+            throw std::invalid_argument("Invalid parameter: user id out of "
+                "range of matrix_u");
+        users[i] = id - 1;
+    }
+
+    // Visit items by decreasing norm, so that each chunk starts with the
+    // largest norm of all remaining items
+    ColumnVector itemNorms = V.colwise().norm().transpose();
+    std::vector<Index> order(numItems);
+    for (Index j = 0; j < numItems; ++j)
+        order[j] = j;
+    if (prune) {
+        std::vector<std::pair<double, Index> > byNorm(numItems);
+        for (Index j = 0; j < numItems; ++j)
+            byNorm[j] = std::make_pair(-itemNorms(j), j);
+        std::sort(byNorm.begin(), byNorm.end());
+        for (Index j = 0; j < numItems; ++j)
+            order[j] = byNorm[j].second;
+    }
+
+    Matrix sortedV(V.rows(), numItems);
+    for (Index j = 0; j < numItems; ++j)
+        sortedV.col(j) = V.col(order[j]);
+
+    MutableArrayHandle<int32_t> itemIds = allocateArray<int32_t>(
+        numUsers, numResults);
+    MutableArrayHandle<double> scores = allocateArray<double>(
+        numUsers, numResults);
+
+    Matrix blockU;
+    Matrix predictions;
+    for (Index begin = 0; begin < numUsers; begin += kUserBlockSize) {
+        Index blockSize = std::min(kUserBlockSize, numUsers - begin);
+        blockU.resize(U.rows(), blockSize);
+        for (Index i = 0; i < blockSize; ++i)
+            blockU.col(i) = U.col(users[begin + i]);
+        ColumnVector userNorms = blockU.colwise().norm().transpose();
+
+        std::vector<BoundedHeap> heaps(blockSize,
+            BoundedHeap(static_cast<std::size_t>(numResults)));
+        for (Index chunk = 0; chunk < numItems; chunk += kItemChunkSize) {
+            Index chunkSize = std::min(kItemChunkSize, numItems - chunk);
+
+            if (prune) {
+                double maxItemNorm = itemNorms(order[chunk]);
+                bool anyActive = false;
+                for (Index i = 0; i < blockSize && !anyActive; ++i)
+                    anyActive = !heaps[i].full()
+                        || userNorms(i) * maxItemNorm
+                            >= heaps[i].worstScore();
+                if (!anyActive)
+                    break;
+            }
+
+            predictions.noalias() = trans(blockU)
+                * sortedV.middleCols(chunk, chunkSize);
+            for (Index j = 0; j < chunkSize; ++j)
+                for (Index i = 0; i < blockSize; ++i)
+                    heaps[i].push(ScoredItem(predictions(i, j),
+                        order[chunk + j]));
+        }
+
+        for (Index i = 0; i < blockSize; ++i) {
+            std::vector<ScoredItem> &best = heaps[i].sorted();
+            for (Index r = 0; r < numResults; ++r) {
+                std::size_t pos = static_cast<std::size_t>(begin + i)
+                    * numResults + r;
+                itemIds[pos] = static_cast<int32_t>(best[r].second + 1);
+                scores[pos] = best[r].first;
+            }
+        }
+    }
+
+    AnyType tuple;
+    return tuple << itemIds << scores;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,10 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file lmf_recommend.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Low-rank matrix factorization: Top-N items of a block of users
+ */
+DECLARE_UDF(convex, lmf_recommend_block)
@@ -0,0 +1,171 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file logit_cg.cpp
+ *
+ * @brief Logistic Regression functions
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <limits>
+
+#include "logit_cg.hpp"
+
+#include "task/logit.hpp"
+#include "algo/conjugate_gradient.hpp"
+
+#include "type/tuple.hpp"
+#include "type/model.hpp"
+#include "type/state.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// This class contains public static methods that can be called
+typedef LineSearchConjugateGradient<
+        GLMCGLineSearchState<MutableArrayHandle<double> >,
+        GLMCGLineSearchState<ArrayHandle<double> >,
+        Logit<GLMModel, GLMTuple > > LogitCGAlgorithm;
+
+/**
+ * @brief Perform the logistic regression transition step
+ *
+ * Called for each tuple.
+ */
+AnyType
+logit_cg_transition::run(AnyType &args) {
+    // The real state.
+    // For the first tuple: args[0] is nothing more than a marker that
+    // indicates that we should do some initial operations.
+    // For other tuples: args[0] holds the computation state until last tuple
+    GLMCGLineSearchState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            GLMCGLineSearchState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.numCandidates);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            double stepsize = args[5].getAs<double>();
+            int32_t numCandidates = args[6].getAs<int32_t>();
+            if (!(stepsize > 0))
+                throw std::invalid_argument("Invalid parameter: Step size "
+                    "must be positive.");
+            if (numCandidates < 2)
+                throw std::invalid_argument("Invalid parameter: Number of "
+                    "candidate step sizes must be at least 2.");
+
+            state.allocate(*this, dimension,
+                    static_cast<uint32_t>(numCandidates)); // with zeros
+            state.task.stepsize = stepsize;
+            LogitCGAlgorithm::setCandidates(state);
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LogitCGAlgorithm::transition(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+logit_cg_merge::run(AnyType &args) {
+    GLMCGLineSearchState<MutableArrayHandle<double> > stateLeft = args[0];
+    GLMCGLineSearchState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    // Merge states together
+    LogitCGAlgorithm::merge(stateLeft, stateRight);
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the logistic regression final step
+ */
+AnyType
+logit_cg_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    GLMCGLineSearchState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    // finalizing
+    LogitCGAlgorithm::final(state);
+    state.task.iteration ++;
+
+    return state;
+}
+
+/**
+ * @brief Return the relative difference in loss between two states
+ *
+ * If no candidate step along a conjugate direction decreased the loss, the
+ * next iteration restarts from the steepest direction, so this returns
+ * infinity instead of 0.
+ */
+AnyType
+internal_logit_cg_distance::run(AnyType &args) {
+    GLMCGLineSearchState<ArrayHandle<double> > stateLeft = args[0];
+    GLMCGLineSearchState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateRight.task.loss >= stateLeft.task.loss
+            && (stateLeft.task.direction
+                + stateLeft.task.gradient).squaredNorm() > 0)
+        return std::numeric_limits<double>::infinity();
+
+    return std::abs((stateLeft.task.loss - stateRight.task.loss)
+            / stateRight.task.loss);
+}
+
+/**
+ * @brief Return the coefficients and diagnostic statistics of the state
+ */
+AnyType
+internal_logit_cg_result::run(AnyType &args) {
+    GLMCGLineSearchState<ArrayHandle<double> > state = args[0];
+
+    AnyType tuple;
+    tuple << state.task.model
+        << static_cast<double>(state.task.loss);
+
+    return tuple;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
@@ -0,0 +1,32 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file logit_cg.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Logistic regression (conjugate gradient): Transition function
+ */
+DECLARE_UDF(convex, logit_cg_transition)
+
+/**
+ * @brief Logistic regression (conjugate gradient): State merge function
+ */
+DECLARE_UDF(convex, logit_cg_merge)
+
+/**
+ * @brief Logistic regression (conjugate gradient): Final function
+ */
+DECLARE_UDF(convex, logit_cg_final)
+
+/**
+ * @brief Logistic regression (conjugate gradient): Difference in
+ *     log-likelihood between two transition states
+ */
+DECLARE_UDF(convex, internal_logit_cg_distance)
+
+/**
+ * @brief Logistic regression (conjugate gradient): Convert transition state
+ *     to result tuple
+ */
+DECLARE_UDF(convex, internal_logit_cg_result)
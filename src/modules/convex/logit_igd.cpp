@@ -7,11 +7,18 @@
  *//* ----------------------------------------------------------------------- */
 
 #include <dbconnector/dbconnector.hpp>
+#include <modules/shared/RowHash.hpp>
 
 #include "logit_igd.hpp"
 
 #include "task/logit.hpp"
 #include "algo/igd.hpp"
+#include "algo/bundle_igd.hpp"
+#include "algo/cv_igd.hpp"
+#include "algo/admm.hpp"
+#include "algo/minibatch_igd.hpp"
+#include "algo/shuffle_igd.hpp"
+#include "algo/adaptive_igd.hpp"
 #include "algo/loss.hpp"
 
 #include "type/tuple.hpp"
@@ -24,13 +31,46 @@ namespace modules {
 
 namespace convex {
 
-// This 2 classes contain public static methods that can be called
+// This 3 classes contain public static methods that can be called
 typedef IGD<GLMIGDState<MutableArrayHandle<double> >, GLMIGDState<ArrayHandle<double> >,
         Logit<GLMModel, GLMTuple > > LogitIGDAlgorithm;
 
+typedef MiniBatchIGD<GLMIGDState<MutableArrayHandle<double> >,
+        GLMIGDState<ArrayHandle<double> >,
+        LogitIGDAlgorithm> LogitMiniBatchIGDAlgorithm;
+
 typedef Loss<GLMIGDState<MutableArrayHandle<double> >, GLMIGDState<ArrayHandle<double> >,
         Logit<GLMModel, GLMTuple > > LogitLossAlgorithm;
 
+typedef IGD<GLMIGDState<MutableArrayHandle<double> >, GLMIGDState<ArrayHandle<double> >,
+        Logit<GLMModel, SparseGLMTuple > > LogitSparseIGDAlgorithm;
+
+typedef IGD<GLMIGDState<MutableArrayHandle<double> >, GLMIGDState<ArrayHandle<double> >,
+        Logit<GLMModel, FloatGLMTuple > > LogitFloatIGDAlgorithm;
+
+typedef IGD<GLMIGDState<MutableArrayHandle<double> >, GLMIGDState<ArrayHandle<double> >,
+        Logit<GLMModel, BufferedGLMTuple > > LogitBufferedIGDAlgorithm;
+
+typedef ShuffleIGD<GLMIGDState<MutableArrayHandle<double> >,
+        GLMIGDState<ArrayHandle<double> >,
+        LogitBufferedIGDAlgorithm> LogitShuffleIGDAlgorithm;
+
+typedef AdaptiveIGD<GLMAdaptiveIGDState<MutableArrayHandle<double> >,
+        GLMAdaptiveIGDState<ArrayHandle<double> >,
+        Logit<GLMModel, GLMTuple > > LogitAdaptiveIGDAlgorithm;
+
+typedef BundleIGD<GLMIGDBundleState<MutableArrayHandle<double> >,
+        GLMIGDBundleState<ArrayHandle<double> >,
+        Logit<GLMModel, GLMTuple > > LogitBundleIGDAlgorithm;
+
+typedef CrossValidationIGD<GLMIGDBundleState<MutableArrayHandle<double> >,
+        GLMIGDBundleState<ArrayHandle<double> >,
+        Logit<GLMModel, GLMTuple > > LogitCrossValidationIGDAlgorithm;
+
+typedef ADMM<GLMADMMState<MutableArrayHandle<double> >,
+        GLMADMMState<ArrayHandle<double> >,
+        Logit<GLMModel, GLMTuple > > LogitADMMAlgorithm;
+
 /**
  * @brief Perform the logistic regression transition step
  *
@@ -48,14 +88,16 @@ logit_igd_transition::run(AnyType &args) {
     if (state.algo.numRows == 0) {
         if (!args[3].isNull()) {
             GLMIGDState<ArrayHandle<double> > previousState = args[3];
-            state.allocate(*this, previousState.task.dimension);
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.batchSize);
             state = previousState;
         } else {
             // configuration parameters
             uint32_t dimension = args[4].getAs<uint32_t>();
             double stepsize = args[5].getAs<double>();
+            uint32_t batchSize = args[6].getAs<uint32_t>();
 
-            state.allocate(*this, dimension); // with zeros
+            state.allocate(*this, dimension, batchSize); // with zeros
             state.task.stepsize = stepsize;
         }
         // resetting in either case
@@ -69,8 +111,109 @@ logit_igd_transition::run(AnyType &args) {
     tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
 
     // Now do the transition step
-    LogitIGDAlgorithm::transition(state, tuple);
-    LogitLossAlgorithm::transition(state, tuple);
+    if (state.task.batchSize <= 1) {
+        LogitIGDAlgorithm::transitionWithLoss(state, tuple);
+    } else {
+        // the loss of buffered tuples is computed at the model of the last
+        // iteration, since the incremental model is only updated per batch
+        LogitMiniBatchIGDAlgorithm::transition(state, tuple);
+        LogitLossAlgorithm::transition(state, tuple);
+    }
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the logistic regression transition step for sparse
+ *     independent variables
+ *
+ * Called for each tuple. The state is the same as for logit_igd_transition,
+ * so merge and final function are shared. The gradient step only touches the
+ * coefficients of nonzero independent variables. Mini-batches are not
+ * supported.
+ */
+AnyType
+logit_igd_sparse_transition::run(AnyType &args) {
+    GLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            GLMIGDState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            double stepsize = args[5].getAs<double>();
+
+            state.allocate(*this, dimension); // with zeros
+            state.task.stepsize = stepsize;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    SparseGLMTuple tuple;
+    tuple.indVar = args[1].getAs<SparseColumnVector>();
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LogitSparseIGDAlgorithm::transitionWithLoss(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the logistic regression transition step for single-precision
+ *     independent variables
+ *
+ * Called for each tuple. The independent variables are mapped as \c REAL[]
+ * without conversion, while the model and the state are kept in double
+ * precision. The state is the same as for logit_igd_transition, so merge and
+ * final function are shared. Mini-batches are not supported.
+ */
+AnyType
+logit_igd_float_transition::run(AnyType &args) {
+    GLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            GLMIGDState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            double stepsize = args[5].getAs<double>();
+
+            state.allocate(*this, dimension); // with zeros
+            state.task.stepsize = stepsize;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    FloatGLMTuple tuple;
+    tuple.indVar.rebind(
+        args[1].getAs<MappedFloatColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LogitFloatIGDAlgorithm::transitionWithLoss(state, tuple);
     state.algo.numRows ++;
 
     return state;
@@ -81,8 +224,10 @@ logit_igd_transition::run(AnyType &args) {
  */
 AnyType
 logit_igd_merge::run(AnyType &args) {
-    GLMIGDState<MutableArrayHandle<double> > stateLeft = args[0];
-    GLMIGDState<ArrayHandle<double> > stateRight = args[1];
+    GLMIGDState<MutableArrayHandle<double> > stateLeft
+        = denseState<GLMIGDState<ArrayHandle<double> > >(*this, args[0]);
+    GLMIGDState<ArrayHandle<double> > stateRight
+        = denseState<GLMIGDState<ArrayHandle<double> > >(*this, args[1]);
 
     // We first handle the trivial case where this function is called with one
     // of the states being the initial state
@@ -90,11 +235,14 @@ logit_igd_merge::run(AnyType &args) {
     else if (stateRight.algo.numRows == 0) { return stateLeft; }
 
     // Merge states together
+    LogitMiniBatchIGDAlgorithm::flush(stateLeft);
     LogitIGDAlgorithm::merge(stateLeft, stateRight);
     LogitLossAlgorithm::merge(stateLeft, stateRight);
     // The following numRows update, cannot be put above, because the model
     // averaging depends on their original values
     stateLeft.algo.numRows += stateRight.algo.numRows;
+    // Tuples still buffered on the right are applied to the merged model
+    LogitMiniBatchIGDAlgorithm::mergeBuffers(stateLeft, stateRight);
 
     return stateLeft;
 }
@@ -106,12 +254,14 @@ AnyType
 logit_igd_final::run(AnyType &args) {
     // We request a mutable object. Depending on the backend, this might perform
     // a deep copy.
-    GLMIGDState<MutableArrayHandle<double> > state = args[0];
+    GLMIGDState<MutableArrayHandle<double> > state
+        = denseState<GLMIGDState<ArrayHandle<double> > >(*this, args[0]);
 
     // Aggregates that haven't seen any data just return Null.
     if (state.algo.numRows == 0) { return Null(); }
 
     // finalizing
+    LogitMiniBatchIGDAlgorithm::flush(state);
     LogitIGDAlgorithm::final(state);
     // LogitLossAlgorithm::final(state); // empty function call causes a warning
     
@@ -121,6 +271,393 @@ logit_igd_final::run(AnyType &args) {
     return state;
 }
 
+/**
+ * @brief Encode a transition state compactly for shipping it between nodes
+ *
+ * Buffered tuples are applied first. The result is accepted by
+ * logit_igd_merge() and logit_igd_final().
+ */
+AnyType
+logit_igd_compact_state::run(AnyType &args) {
+    GLMIGDState<MutableArrayHandle<double> > state
+        = denseState<GLMIGDState<ArrayHandle<double> > >(*this, args[0]);
+
+    if (state.algo.numRows == 0) { return state; }
+
+    LogitMiniBatchIGDAlgorithm::flush(state);
+    return state.compact(*this);
+}
+
+/**
+ * @brief Perform the logistic regression transition step with per-coordinate
+ *     step sizes
+ *
+ * Called for each tuple. See AdaptiveIGD for the methods.
+ */
+AnyType
+logit_igd_adaptive_transition::run(AnyType &args) {
+    GLMAdaptiveIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            GLMAdaptiveIGDState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            int32_t method = args[6].getAs<int32_t>();
+            double beta1 = args[7].getAs<double>();
+            double beta2 = args[8].getAs<double>();
+            double epsilon = args[9].getAs<double>();
+            if (method != LogitAdaptiveIGDAlgorithm::AdaGrad
+                    && method != LogitAdaptiveIGDAlgorithm::Adam)
+                throw std::invalid_argument("Invalid parameter: Unknown "
+                    "method for per-coordinate step sizes.");
+            if (beta1 < 0. || beta1 >= 1. || beta2 < 0. || beta2 >= 1.)
+                throw std::invalid_argument("Invalid parameter: beta1 and "
+                    "beta2 must be in [0, 1).");
+            if (epsilon <= 0.)
+                throw std::invalid_argument("Invalid parameter: epsilon "
+                    "must be positive.");
+
+            state.allocate(*this, dimension); // with zeros
+            state.task.stepsize = args[5].getAs<double>();
+            state.task.method = static_cast<uint16_t>(method);
+            state.task.beta1 = beta1;
+            state.task.beta2 = beta2;
+            state.task.epsilon = epsilon;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LogitAdaptiveIGDAlgorithm::transitionWithLoss(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition
+ *     states with per-coordinate step sizes
+ */
+AnyType
+logit_igd_adaptive_merge::run(AnyType &args) {
+    GLMAdaptiveIGDState<MutableArrayHandle<double> > stateLeft = args[0];
+    GLMAdaptiveIGDState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    // Merge states together
+    LogitAdaptiveIGDAlgorithm::merge(stateLeft, stateRight);
+    stateLeft.algo.loss += stateRight.algo.loss;
+    // The following numRows update, cannot be put above, because the model
+    // averaging depends on their original values
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the logistic regression final step with per-coordinate step
+ *     sizes
+ */
+AnyType
+logit_igd_adaptive_final::run(AnyType &args) {
+    GLMAdaptiveIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    LogitAdaptiveIGDAlgorithm::final(state);
+    return state;
+}
+
+/**
+ * @brief Return the relative difference in loss between two states with
+ *     per-coordinate step sizes
+ */
+AnyType
+internal_logit_igd_adaptive_distance::run(AnyType &args) {
+    GLMAdaptiveIGDState<ArrayHandle<double> > stateLeft = args[0];
+    GLMAdaptiveIGDState<ArrayHandle<double> > stateRight = args[1];
+
+    return std::abs((stateLeft.algo.loss - stateRight.algo.loss)
+            / stateRight.algo.loss);
+}
+
+/**
+ * @brief Return the coefficients and loss of a state with per-coordinate
+ *     step sizes
+ */
+AnyType
+internal_logit_igd_adaptive_result::run(AnyType &args) {
+    GLMAdaptiveIGDState<ArrayHandle<double> > state = args[0];
+
+    AnyType tuple;
+    tuple << state.task.model
+        << static_cast<double>(state.algo.loss);
+
+    return tuple;
+}
+
+/**
+ * @brief Perform the logistic regression transition step through a shuffle
+ *     buffer
+ *
+ * Called for each tuple. The state is the same as for logit_igd_transition,
+ * with the buffer of batch_size tuples used as shuffle buffer (see
+ * ShuffleIGD). Merge and final function differ, since they flush the buffer
+ * tuple by tuple.
+ */
+AnyType
+logit_igd_shuffle_transition::run(AnyType &args) {
+    GLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        uint32_t shuffleSize = args[6].getAs<uint32_t>();
+        if (shuffleSize < 2)
+            throw std::invalid_argument("Invalid parameter: Size of the "
+                "shuffle buffer must be at least 2.");
+
+        if (!args[3].isNull()) {
+            GLMIGDState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension, shuffleSize);
+            state.task.stepsize = previousState.task.stepsize;
+            state.task.model = previousState.task.model;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            double stepsize = args[5].getAs<double>();
+
+            state.allocate(*this, dimension, shuffleSize); // with zeros
+            state.task.stepsize = stepsize;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    MappedColumnVector indVar = args[1].getAs<MappedColumnVector>();
+    if (indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // The generator is kept for all rows of the query
+    void *&cache = callSiteCache();
+    if (cache == NULL) {
+        void *memory = allocateCallSiteCache(
+            sizeof(PhiloxRandomNumberGenerator));
+        cache = new (memory) PhiloxRandomNumberGenerator;
+    }
+    PhiloxRandomNumberGenerator &rng
+        = *static_cast<PhiloxRandomNumberGenerator*>(cache);
+
+    LogitShuffleIGDAlgorithm::transition(state, indVar,
+        args[2].getAs<bool>() ? 1. : -1., rng);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition
+ *     states with shuffle buffers
+ */
+AnyType
+logit_igd_shuffle_merge::run(AnyType &args) {
+    GLMIGDState<MutableArrayHandle<double> > stateLeft = args[0];
+    GLMIGDState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    void *&cache = callSiteCache();
+    if (cache == NULL) {
+        void *memory = allocateCallSiteCache(
+            sizeof(PhiloxRandomNumberGenerator));
+        cache = new (memory) PhiloxRandomNumberGenerator;
+    }
+    PhiloxRandomNumberGenerator &rng
+        = *static_cast<PhiloxRandomNumberGenerator*>(cache);
+
+    // Merge states together
+    LogitShuffleIGDAlgorithm::flush(stateLeft, rng);
+    LogitIGDAlgorithm::merge(stateLeft, stateRight);
+    LogitLossAlgorithm::merge(stateLeft, stateRight);
+    // The following numRows update, cannot be put above, because the model
+    // averaging depends on their original values
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+    // Tuples still buffered on the right are applied to the merged model
+    LogitShuffleIGDAlgorithm::mergeBuffers(stateLeft, stateRight, rng);
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the logistic regression final step with a shuffle buffer
+ */
+AnyType
+logit_igd_shuffle_final::run(AnyType &args) {
+    GLMIGDState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    void *&cache = callSiteCache();
+    if (cache == NULL) {
+        void *memory = allocateCallSiteCache(
+            sizeof(PhiloxRandomNumberGenerator));
+        cache = new (memory) PhiloxRandomNumberGenerator;
+    }
+    PhiloxRandomNumberGenerator &rng
+        = *static_cast<PhiloxRandomNumberGenerator*>(cache);
+
+    LogitShuffleIGDAlgorithm::flush(state, rng);
+    LogitIGDAlgorithm::final(state);
+
+    return state;
+}
+
+/**
+ * @brief Buffer a tuple of a shard for logistic regression
+ *
+ * Called for each tuple. No gradient step is taken here: The tuples are
+ * appended to the state, and logit_igd_shard_final() makes several passes
+ * over them.
+ */
+AnyType
+logit_igd_shard_transition::run(AnyType &args) {
+    GLMIGDShardState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.task.dimension == 0) {
+        uint32_t dimension = args[4].getAs<uint32_t>();
+        int32_t numEpochs = args[6].getAs<int32_t>();
+        if (dimension == 0)
+            throw std::invalid_argument("Invalid parameter: Dimension must "
+                "be positive.");
+        if (numEpochs <= 0)
+            throw std::invalid_argument("Invalid parameter: Number of "
+                "epochs must be positive.");
+
+        state.allocate(*this, dimension, 16); // with zeros
+        state.task.stepsize = args[5].getAs<double>();
+        state.task.numEpochs = static_cast<uint32_t>(numEpochs);
+        state.task.seed = static_cast<double>(args[7].getAs<int64_t>());
+        if (!args[3].isNull()) {
+            GLMIGDState<ArrayHandle<double> > previousState = args[3];
+            if (previousState.task.dimension != dimension)
+                throw std::invalid_argument("Invalid parameter: Dimension "
+                    "of the previous state does not match.");
+            state.task.model = previousState.task.model;
+        }
+    }
+
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    MappedColumnVector indVar = args[1].getAs<MappedColumnVector>();
+    if (indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    state.reserve(*this, 1);
+    state.append(indVar, args[2].getAs<bool>() ? 1. : -1.);
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge the buffers of
+ *     two shard states
+ */
+AnyType
+logit_igd_shard_merge::run(AnyType &args) {
+    GLMIGDShardState<MutableArrayHandle<double> > stateLeft = args[0];
+    GLMIGDShardState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    stateLeft.reserve(*this, stateRight.algo.numRows);
+    stateLeft.append(stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Make numEpochs passes over the tuples of a shard
+ *
+ * Every pass visits the buffered tuples in a new random order. The result is
+ * a transition state of logit_igd_transition(), which is what
+ * logit_igd_merge() averages over shards. Its loss is that of the last pass.
+ */
+AnyType
+logit_igd_shard_final::run(AnyType &args) {
+    GLMIGDShardState<ArrayHandle<double> > shard = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (shard.algo.numRows == 0) { return Null(); }
+
+    GLMIGDState<MutableArrayHandle<double> > state = AnyType(
+        allocateArray<double>(
+            GLMIGDState<MutableArrayHandle<double> >::arraySize(0)));
+    state.allocate(*this, shard.task.dimension); // with zeros
+    state.task.stepsize = shard.task.stepsize;
+    state.task.model = shard.task.model;
+    state.reset();
+
+    uint32_t numRows = shard.algo.numRows;
+    std::vector<uint32_t> order(numRows);
+    for (uint32_t i = 0; i < numRows; ++i)
+        order[i] = i;
+
+    PhiloxRandomNumberGenerator rng;
+    rng.seed(shard.task.seed);
+    BufferedGLMTuple tuple;
+    for (uint32_t epoch = 1; epoch <= shard.task.numEpochs; ++epoch) {
+        // Fisher-Yates shuffle
+        for (uint32_t i = numRows - 1; i > 0; --i) {
+            uint32_t j = std::min(i, static_cast<uint32_t>(rng() * (i + 1)));
+            std::swap(order[i], order[j]);
+        }
+
+        bool lastEpoch = (epoch == shard.task.numEpochs);
+        for (uint32_t i = 0; i < numRows; ++i) {
+            const double *slot = shard.algo.tuples
+                + static_cast<size_t>(shard.tupleSize()) * order[i];
+            tuple.depVar = slot[0];
+            tuple.indVar.rebind(slot + 1, shard.task.dimension);
+            if (lastEpoch)
+                LogitBufferedIGDAlgorithm::transitionWithLoss(state, tuple);
+            else
+                LogitBufferedIGDAlgorithm::transition(state, tuple);
+        }
+    }
+    state.algo.numRows = numRows;
+
+    return state;
+}
+
 /**
  * @brief Return the difference in RMSE between two states
  */
@@ -147,13 +684,322 @@ internal_logit_igd_result::run(AnyType &args) {
     return tuple;
 }
 
+/**
+ * @brief Perform the transition step for a bundle of logistic regressions
+ *
+ * Called for each tuple. All models of the bundle are updated with this tuple.
+ */
+AnyType
+logit_igd_bundle_transition::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMIGDBundleState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            GLMIGDBundleState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.numModels);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            MappedColumnVector stepsize = args[5].getAs<MappedColumnVector>();
+            if (stepsize.size() == 0
+                || stepsize.size() > std::numeric_limits<uint32_t>::max())
+                throw std::invalid_argument("Invalid parameter: Number of "
+                    "step sizes must be positive.");
+
+            state.allocate(*this, dimension,
+                    static_cast<uint32_t>(stepsize.size())); // with zeros
+            state.task.stepsize = stepsize;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LogitBundleIGDAlgorithm::transitionWithLoss(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition
+ *     states of bundles
+ */
+AnyType
+logit_igd_bundle_merge::run(AnyType &args) {
+    GLMIGDBundleState<MutableArrayHandle<double> > stateLeft = args[0];
+    GLMIGDBundleState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    // Merge states together
+    LogitBundleIGDAlgorithm::merge(stateLeft, stateRight);
+    // The following numRows update, cannot be put above, because the model
+    // averaging depends on their original values
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step for a bundle of logistic regressions
+ */
+AnyType
+logit_igd_bundle_final::run(AnyType &args) {
+    GLMIGDBundleState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    LogitBundleIGDAlgorithm::final(state);
+    return state;
+}
+
+/**
+ * @brief Return the largest relative difference in loss between two bundle
+ *     states
+ *
+ * The bundle has converged only if every model has converged.
+ */
+AnyType
+internal_logit_igd_bundle_distance::run(AnyType &args) {
+    GLMIGDBundleState<ArrayHandle<double> > stateLeft = args[0];
+    GLMIGDBundleState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateLeft.task.numModels != stateRight.task.numModels)
+        throw std::logic_error("Internal error: Incompatible transition "
+            "states");
+
+    return ((stateLeft.algo.loss - stateRight.algo.loss).array()
+        / stateRight.algo.loss.array()).abs().maxCoeff();
+}
+
+/**
+ * @brief Return the coefficients and loss of one model of a bundle state
+ */
+AnyType
+internal_logit_igd_bundle_result::run(AnyType &args) {
+    GLMIGDBundleState<ArrayHandle<double> > state = args[0];
+    int32_t model = args[1].getAs<int32_t>();
+
+    if (model < 1 || static_cast<uint32_t>(model) > state.task.numModels)
+        throw std::invalid_argument("Invalid parameter: Model index is out "
+            "of range.");
+
+    ColumnVector coef = state.task.model.col(model - 1);
+    AnyType tuple;
+    tuple << coef
+        << static_cast<double>(state.algo.loss(model - 1));
+
+    return tuple;
+}
+
+/**
+ * @brief Perform the transition step for the fold models of a
+ *     cross-validation of logistic regression
+ *
+ * Called for each tuple. The state is a bundle state with one model per fold
+ * (all with the same step size). The tuple is assigned to a fold by the hash
+ * of its identifier (see crossValidationFold()), and updates the models of
+ * all other folds. Merging and finalizing are the same as for bundles.
+ */
+AnyType
+logit_igd_cv_transition::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMIGDBundleState<MutableArrayHandle<double> > state = args[0];
+    int32_t numFolds = args[7].getAs<int32_t>();
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[4].isNull()) {
+            GLMIGDBundleState<ArrayHandle<double> > previousState = args[4];
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.numModels);
+            state = previousState;
+        } else {
+            // configuration parameters
+            if (numFolds < 2)
+                throw std::invalid_argument("Invalid parameter: Number of "
+                    "folds must be at least 2.");
+
+            uint32_t dimension = args[5].getAs<uint32_t>();
+            state.allocate(*this, dimension,
+                    static_cast<uint32_t>(numFolds)); // with zeros
+            state.task.stepsize.fill(args[6].getAs<double>());
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    if (static_cast<uint32_t>(numFolds) != state.task.numModels)
+        throw std::invalid_argument("Invalid parameter: Number of folds "
+            "does not match.");
+
+    // tuple
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    uint32_t fold = crossValidationFold(
+            static_cast<uint64_t>(args[8].getAs<int64_t>()),
+            args[3].getAs<int64_t>(), state.task.numModels);
+
+    // Now do the transition step
+    LogitCrossValidationIGDAlgorithm::transitionWithLoss(state, tuple, fold);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the ADMM transition step for logistic regression
+ *
+ * Called for each tuple. Only the local model of the block of the tuple is
+ * updated.
+ */
+AnyType
+logit_admm_transition::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMADMMState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[4].isNull()) {
+            GLMADMMState<ArrayHandle<double> > previousState = args[4];
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.numBlocks);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[5].getAs<uint32_t>();
+            uint32_t numBlocks = args[6].getAs<uint32_t>();
+            if (numBlocks == 0)
+                throw std::invalid_argument("Invalid parameter: Number of "
+                    "blocks must be positive.");
+            double rho = args[8].getAs<double>();
+            if (rho <= 0)
+                throw std::invalid_argument("Invalid parameter: rho must be "
+                    "positive.");
+
+            state.allocate(*this, dimension, numBlocks); // with zeros
+            state.task.stepsize = args[7].getAs<double>();
+            state.task.rho = rho;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+    int32_t block = args[3].getAs<int32_t>();
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+    if (block < 0 || static_cast<uint32_t>(block) >= state.task.numBlocks)
+        throw std::invalid_argument("Invalid parameter: Block is out of "
+            "range.");
+
+    // Now do the transition step
+    LogitADMMAlgorithm::transitionWithLoss(state, tuple,
+            static_cast<uint32_t>(block));
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge ADMM transition
+ *     states
+ */
+AnyType
+logit_admm_merge::run(AnyType &args) {
+    GLMADMMState<MutableArrayHandle<double> > stateLeft = args[0];
+    GLMADMMState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    // Merge states together
+    LogitADMMAlgorithm::merge(stateLeft, stateRight);
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the consensus and dual update of an ADMM iteration
+ */
+AnyType
+logit_admm_final::run(AnyType &args) {
+    GLMADMMState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    LogitADMMAlgorithm::final(state);
+    return state;
+}
+
+/**
+ * @brief Return the larger of the primal and dual residual of an ADMM state
+ */
+AnyType
+internal_logit_admm_residual::run(AnyType &args) {
+    GLMADMMState<ArrayHandle<double> > state = args[0];
+
+    return std::max(static_cast<double>(state.task.primalResidual),
+        static_cast<double>(state.task.dualResidual));
+}
+
+/**
+ * @brief Return the consensus model and the loss of an ADMM state
+ *
+ * The loss is the sum of the losses of the local models, evaluated during the
+ * last iteration.
+ */
+AnyType
+internal_logit_admm_result::run(AnyType &args) {
+    GLMADMMState<ArrayHandle<double> > state = args[0];
+
+    AnyType tuple;
+    tuple << state.task.model
+        << static_cast<double>(state.algo.loss);
+
+    return tuple;
+}
+
 /**
  * @brief Return the prediction reselt
  */
 AnyType
 logit_igd_predict::run(AnyType &args) {
     using madlib::dbal::eigen_integration::MappedColumnVector;
-    MappedColumnVector model = args[0].getAs<MappedColumnVector>();
+    MappedColumnVector model(cachedArrayArgument(0));
     MappedColumnVector indVar = args[1].getAs<MappedColumnVector>();
 
     double p = Logit<MappedColumnVector, GLMTuple>::predict(model, indVar);
@@ -161,6 +1007,43 @@ logit_igd_predict::run(AnyType &args) {
     return (p > 0.5);
 }
 
+/**
+ * @brief Return the prediction result for sparse independent variables
+ */
+AnyType
+logit_igd_sparse_predict::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    MappedColumnVector model(cachedArrayArgument(0));
+    SparseColumnVector indVar = args[1].getAs<SparseColumnVector>();
+
+    if (indVar.size() != model.size())
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    double p = Logit<MappedColumnVector, SparseGLMTuple>::predict(model, indVar);
+
+    return (p > 0.5);
+}
+
+/**
+ * @brief Return the prediction result for single-precision independent
+ *     variables
+ */
+AnyType
+logit_igd_float_predict::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    MappedColumnVector model(cachedArrayArgument(0));
+    MappedFloatColumnVector indVar = args[1].getAs<MappedFloatColumnVector>();
+
+    if (indVar.size() != model.size())
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    double p = Logit<MappedColumnVector, FloatGLMTuple>::predict(model, indVar);
+
+    return (p > 0.5);
+}
+
 } // namespace convex
 
 } // namespace modules
@@ -9,6 +9,18 @@
  */
 DECLARE_UDF(convex, logit_igd_transition)
 
+/**
+ * @brief Logistic regression (incremental gradient): Transition function for
+ *     sparse independent variables
+ */
+DECLARE_UDF(convex, logit_igd_sparse_transition)
+
+/**
+ * @brief Logistic regression (incremental gradient): Transition function for
+ *     single-precision independent variables
+ */
+DECLARE_UDF(convex, logit_igd_float_transition)
+
 /**
  * @brief Logistic regression (incremental gradient): State merge function
  */
@@ -19,6 +31,79 @@ DECLARE_UDF(convex, logit_igd_merge)
  */
 DECLARE_UDF(convex, logit_igd_final)
 
+/**
+ * @brief Logistic regression (incremental gradient): Compact encoding of a
+ *     transition state
+ */
+DECLARE_UDF(convex, logit_igd_compact_state)
+
+/**
+ * @brief Logistic regression (incremental gradient): Transition function
+ *     with per-coordinate step sizes
+ */
+DECLARE_UDF(convex, logit_igd_adaptive_transition)
+
+/**
+ * @brief Logistic regression (incremental gradient): State merge function
+ *     with per-coordinate step sizes
+ */
+DECLARE_UDF(convex, logit_igd_adaptive_merge)
+
+/**
+ * @brief Logistic regression (incremental gradient): Final function with
+ *     per-coordinate step sizes
+ */
+DECLARE_UDF(convex, logit_igd_adaptive_final)
+
+/**
+ * @brief Logistic regression (incremental gradient): Difference in
+ *     log-likelihood between two transition states with per-coordinate step
+ *     sizes
+ */
+DECLARE_UDF(convex, internal_logit_igd_adaptive_distance)
+
+/**
+ * @brief Logistic regression (incremental gradient): Convert transition
+ *     state with per-coordinate step sizes to result tuple
+ */
+DECLARE_UDF(convex, internal_logit_igd_adaptive_result)
+
+/**
+ * @brief Logistic regression (incremental gradient): Transition function
+ *     with a shuffle buffer
+ */
+DECLARE_UDF(convex, logit_igd_shuffle_transition)
+
+/**
+ * @brief Logistic regression (incremental gradient): State merge function
+ *     with a shuffle buffer
+ */
+DECLARE_UDF(convex, logit_igd_shuffle_merge)
+
+/**
+ * @brief Logistic regression (incremental gradient): Final function with a
+ *     shuffle buffer
+ */
+DECLARE_UDF(convex, logit_igd_shuffle_final)
+
+/**
+ * @brief Logistic regression (incremental gradient): Transition function
+ *     buffering the tuples of a shard
+ */
+DECLARE_UDF(convex, logit_igd_shard_transition)
+
+/**
+ * @brief Logistic regression (incremental gradient): State merge function
+ *     for buffered shards
+ */
+DECLARE_UDF(convex, logit_igd_shard_merge)
+
+/**
+ * @brief Logistic regression (incremental gradient): Final function taking
+ *     several passes over a buffered shard
+ */
+DECLARE_UDF(convex, logit_igd_shard_final)
+
 /**
  * @brief Logistic regression (incremental gradient): Difference in
  *     log-likelihood between two transition states
@@ -36,3 +121,78 @@ DECLARE_UDF(convex, internal_logit_igd_result)
  */
 DECLARE_UDF(convex, logit_igd_predict)
 
+/**
+ * @brief Logistic regression (incremental gradient): Prediction for sparse
+ *     independent variables
+ */
+DECLARE_UDF(convex, logit_igd_sparse_predict)
+
+/**
+ * @brief Logistic regression (incremental gradient): Prediction for
+ *     single-precision independent variables
+ */
+DECLARE_UDF(convex, logit_igd_float_predict)
+
+
+/**
+ * @brief Logistic regression (incremental gradient), bundle of models:
+ *     Transition function
+ */
+DECLARE_UDF(convex, logit_igd_bundle_transition)
+
+/**
+ * @brief Logistic regression (incremental gradient), bundle of models:
+ *     State merge function
+ */
+DECLARE_UDF(convex, logit_igd_bundle_merge)
+
+/**
+ * @brief Logistic regression (incremental gradient), bundle of models:
+ *     Final function
+ */
+DECLARE_UDF(convex, logit_igd_bundle_final)
+
+/**
+ * @brief Logistic regression (incremental gradient), bundle of models:
+ *     Largest relative difference in loss between two transition states
+ */
+DECLARE_UDF(convex, internal_logit_igd_bundle_distance)
+
+/**
+ * @brief Logistic regression (incremental gradient), bundle of models:
+ *     Convert one model of the transition state to a result tuple
+ */
+DECLARE_UDF(convex, internal_logit_igd_bundle_result)
+
+/**
+ * @brief Logistic regression (incremental gradient), cross-validation:
+ *     Transition function
+ */
+DECLARE_UDF(convex, logit_igd_cv_transition)
+
+/**
+ * @brief Logistic regression (consensus ADMM): Transition function
+ */
+DECLARE_UDF(convex, logit_admm_transition)
+
+/**
+ * @brief Logistic regression (consensus ADMM): State merge function
+ */
+DECLARE_UDF(convex, logit_admm_merge)
+
+/**
+ * @brief Logistic regression (consensus ADMM): Final function
+ */
+DECLARE_UDF(convex, logit_admm_final)
+
+/**
+ * @brief Logistic regression (consensus ADMM): Larger of the primal and dual
+ *     residual of a transition state
+ */
+DECLARE_UDF(convex, internal_logit_admm_residual)
+
+/**
+ * @brief Logistic regression (consensus ADMM): Convert transition state to
+ *     result tuple
+ */
+DECLARE_UDF(convex, internal_logit_admm_result)
@@ -0,0 +1,199 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file logit_lbfgs.cpp
+ *
+ * @brief Logistic Regression functions
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include "logit_lbfgs.hpp"
+
+#include "task/logit.hpp"
+#include "algo/lbfgs.hpp"
+#include "algo/loss.hpp"
+
+#include "type/tuple.hpp"
+#include "type/model.hpp"
+#include "type/state.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace convex {
+
+// This 2 classes contain public static methods that can be called
+typedef LBFGS<GLMLBFGSState<MutableArrayHandle<double> >,
+        GLMLBFGSState<ArrayHandle<double> >, Logit<GLMModel, GLMTuple > >
+            LogitLBFGSAlgorithm;
+
+typedef Loss<GLMLBFGSState<MutableArrayHandle<double> >,
+        GLMLBFGSState<ArrayHandle<double> >, Logit<GLMModel, GLMTuple > >
+            LogitLossAlgorithm;
+
+/**
+ * @brief Perform the logistic regression transition step
+ *
+ * Called for each tuple.
+ */
+AnyType
+logit_lbfgs_transition::run(AnyType &args) {
+    // The real state.
+    // For the first tuple: args[0] is nothing more than a marker that
+    // indicates that we should do some initial operations.
+    // For other tuples: args[0] holds the computation state until last tuple
+    GLMLBFGSState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        if (!args[3].isNull()) {
+            GLMLBFGSState<ArrayHandle<double> > previousState = args[3];
+            state.allocate(*this, previousState.task.dimension,
+                    previousState.task.historySize);
+            state = previousState;
+        } else {
+            // configuration parameters
+            uint32_t dimension = args[4].getAs<uint32_t>();
+            uint32_t historySize = args[5].getAs<uint32_t>();
+            double stepsize = args[6].getAs<double>();
+
+            state.allocate(*this, dimension, historySize); // with zeros
+            state.task.stepsize = stepsize;
+        }
+        // resetting in either case
+        state.reset();
+    }
+
+    // tuple
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<bool>() ? 1. : -1.;
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    LogitLBFGSAlgorithm::transition(state, tuple);
+    LogitLossAlgorithm::transition(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+logit_lbfgs_merge::run(AnyType &args) {
+    GLMLBFGSState<MutableArrayHandle<double> > stateLeft = args[0];
+    GLMLBFGSState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.algo.numRows == 0) { return stateRight; }
+    else if (stateRight.algo.numRows == 0) { return stateLeft; }
+
+    // Merge states together
+    LogitLBFGSAlgorithm::merge(stateLeft, stateRight);
+    LogitLossAlgorithm::merge(stateLeft, stateRight);
+    stateLeft.algo.numRows += stateRight.algo.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the logistic regression final step
+ */
+AnyType
+logit_lbfgs_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    GLMLBFGSState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.algo.numRows == 0) { return Null(); }
+
+    // finalizing
+    LogitLBFGSAlgorithm::final(state);
+    state.task.iteration ++;
+
+    return state;
+}
+
+/**
+ * @brief Return the relative difference in loss between the last accepted
+ *     models of two states
+ *
+ * While a trial step is being backtracked, the accepted model does not
+ * change, so this returns infinity instead of 0. Once the step has become
+ * too small (LBFGS::minStep()), no further progress can be made along the
+ * direction, and this returns 0.
+ */
+AnyType
+internal_logit_lbfgs_distance::run(AnyType &args) {
+    GLMLBFGSState<ArrayHandle<double> > stateLeft = args[0];
+    GLMLBFGSState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateRight.task.step == 0)
+        return 0.;
+    else if (stateRight.task.step < 1)
+        return std::numeric_limits<double>::infinity();
+
+    return std::abs((stateLeft.task.lastLoss - stateRight.task.lastLoss)
+            / stateRight.task.lastLoss);
+}
+
+/**
+ * @brief Return the coefficients and diagnostic statistics of the state
+ *
+ * These are the last accepted coefficients and the loss at them.
+ */
+AnyType
+internal_logit_lbfgs_result::run(AnyType &args) {
+    GLMLBFGSState<ArrayHandle<double> > state = args[0];
+
+    AnyType tuple;
+    tuple << state.task.lastModel
+        << static_cast<double>(state.task.lastLoss);
+
+    return tuple;
+}
+
+/**
+ * @brief Return an initial state whose model is the given coefficients
+ *
+ * Passed as the previous state of logit_lbfgs_step(), L-BFGS starts from the
+ * coefficients found by another method, instead of from zero. Arguments are
+ * the coefficients, the history size, and the step size as for
+ * logit_lbfgs_step().
+ */
+AnyType
+internal_logit_lbfgs_state::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    MappedColumnVector coef = args[0].getAs<MappedColumnVector>();
+    int32_t historySize = args[1].getAs<int32_t>();
+    if (historySize < 1)
+        throw std::invalid_argument("Invalid parameter: History size must be "
+            "positive.");
+
+    GLMLBFGSState<MutableArrayHandle<double> > state = AnyType(
+        allocateArray<double>(
+            GLMLBFGSState<MutableArrayHandle<double> >::arraySize(0, 0)));
+    state.allocate(*this, static_cast<uint32_t>(coef.size()),
+        static_cast<uint32_t>(historySize)); // with zeros
+    state.task.stepsize = args[2].getAs<double>();
+    state.task.model = coef;
+
+    return state;
+}
+
+} // namespace convex
+
+} // namespace modules
+
+} // namespace madlib
+
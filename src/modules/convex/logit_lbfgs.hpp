@@ -0,0 +1,37 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file logit_lbfgs.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Logistic regression (L-BFGS): Transition function
+ */
+DECLARE_UDF(convex, logit_lbfgs_transition)
+
+/**
+ * @brief Logistic regression (L-BFGS): State merge function
+ */
+DECLARE_UDF(convex, logit_lbfgs_merge)
+
+/**
+ * @brief Logistic regression (L-BFGS): Final function
+ */
+DECLARE_UDF(convex, logit_lbfgs_final)
+
+/**
+ * @brief Logistic regression (L-BFGS): Difference in log-likelihood between
+ *     two transition states
+ */
+DECLARE_UDF(convex, internal_logit_lbfgs_distance)
+
+/**
+ * @brief Logistic regression (L-BFGS): Convert transition state to result
+ *     tuple
+ */
+DECLARE_UDF(convex, internal_logit_lbfgs_result)
+
+/**
+ * @brief Logistic regression (L-BFGS): Initial state with given coefficients
+ */
+DECLARE_UDF(convex, internal_logit_lbfgs_state)
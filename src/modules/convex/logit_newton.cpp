@@ -80,8 +80,10 @@ logit_newton_transition::run(AnyType &args) {
  */
 AnyType
 logit_newton_merge::run(AnyType &args) {
-    GLMNewtonState<MutableArrayHandle<double> > stateLeft = args[0];
-    GLMNewtonState<ArrayHandle<double> > stateRight = args[1];
+    GLMNewtonState<MutableArrayHandle<double> > stateLeft
+        = denseState<GLMNewtonState<ArrayHandle<double> > >(*this, args[0]);
+    GLMNewtonState<ArrayHandle<double> > stateRight
+        = denseState<GLMNewtonState<ArrayHandle<double> > >(*this, args[1]);
 
     // We first handle the trivial case where this function is called with one
     // of the states being the initial state
@@ -105,7 +107,8 @@ AnyType
 logit_newton_final::run(AnyType &args) {
     // We request a mutable object. Depending on the backend, this might perform
     // a deep copy.
-    GLMNewtonState<MutableArrayHandle<double> > state = args[0];
+    GLMNewtonState<MutableArrayHandle<double> > state
+        = denseState<GLMNewtonState<ArrayHandle<double> > >(*this, args[0]);
 
     // Aggregates that haven't seen any data just return Null.
     if (state.algo.numRows == 0) { return Null(); }
@@ -120,6 +123,22 @@ logit_newton_final::run(AnyType &args) {
     return state;
 }
 
+/**
+ * @brief Encode a transition state compactly for shipping it between nodes
+ *
+ * The result is accepted by logit_newton_merge() and logit_newton_final().
+ */
+AnyType
+logit_newton_compact_state::run(AnyType &args) {
+    GLMNewtonState<ArrayHandle<double> > state = args[0];
+
+    if (state.algo.numRows == 0 || GLMNewtonState<ArrayHandle<double> >
+            ::isCompact(args[0].getAs<ArrayHandle<double> >()))
+        return args[0];
+
+    return state.compact(*this);
+}
+
 /**
  * @brief Return the difference in RMSE between two states
  */
@@ -152,7 +171,7 @@ internal_logit_newton_result::run(AnyType &args) {
 AnyType
 logit_newton_predict::run(AnyType &args) {
     using madlib::dbal::eigen_integration::MappedColumnVector;
-    MappedColumnVector model = args[0].getAs<MappedColumnVector>();
+    MappedColumnVector model(cachedArrayArgument(0));
     MappedColumnVector indVar = args[1].getAs<MappedColumnVector>();
 
     double p = Logit<MappedColumnVector, GLMTuple>::predict(model, indVar);
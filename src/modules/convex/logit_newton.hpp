@@ -19,6 +19,12 @@ DECLARE_UDF(convex, logit_newton_merge)
  */
 DECLARE_UDF(convex, logit_newton_final)
 
+/**
+ * @brief Logistic regression (Newton's method): Compact encoding of a
+ *     transition state
+ */
+DECLARE_UDF(convex, logit_newton_compact_state)
+
 /**
  * @brief Logistic regression (Newton's method): Difference in
  *     log-likelihood between two transition states
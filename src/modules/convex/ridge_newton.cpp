@@ -128,13 +128,101 @@ internal_ridge_newton_result::run(AnyType &args) {
     return state.task.model;
 }
 
+/**
+ * @brief Perform the transition step of the ridge regularization path
+ *
+ * Called for each tuple. This only accumulates \f$ X^T X \f$ and
+ * \f$ -X^T y \f$ (the Hessian and the gradient of the least squares at
+ * coefficients 0), which do not depend on lambda.
+ */
+AnyType
+ridge_newton_path_transition::run(AnyType &args) {
+    GLMNewtonState<MutableArrayHandle<double> > state = args[0];
+
+    // initilize the state if first tuple
+    if (state.algo.numRows == 0) {
+        uint16_t dimension = args[3].getAs<uint16_t>();
+
+        state.allocate(*this, dimension); // with zeros
+        state.reset();
+    }
+
+    // tuple
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMTuple tuple;
+    tuple.indVar.rebind(args[1].getAs<MappedColumnVector>().memoryHandle());
+    tuple.depVar = args[2].getAs<double>();
+
+    if (tuple.indVar.size() != state.task.dimension)
+        throw std::invalid_argument("Invalid parameter: Dimension of "
+            "independent variables does not match.");
+
+    // Now do the transition step
+    OLSNewtonAlgorithm::transition(state, tuple);
+    state.algo.numRows ++;
+
+    return state;
+}
+
+/**
+ * @brief Return the ridge coefficients for each lambda of a grid
+ *
+ * With the eigen decomposition \f$ X^T X = V D V^T \f$, the coefficients
+ * are \f$ (X^T X + \lambda I)^{-1} X^T y
+ * = V (D + \lambda I)^{-1} V^T X^T y \f$. The decomposition is computed
+ * only once, after which each lambda costs \f$ O(p^2) \f$. As with the
+ * pseudo-inverse, directions in which \f$ X^T X + \lambda I \f$ is
+ * (numerically) singular do not contribute.
+ *
+ * @return The coefficients for all lambdas, concatenated in the order of the
+ *     grid
+ */
+AnyType
+internal_ridge_newton_path_result::run(AnyType &args) {
+    using madlib::dbal::eigen_integration::MappedColumnVector;
+    GLMNewtonState<ArrayHandle<double> > state = args[0];
+    MappedColumnVector lambdas = args[1].getAs<MappedColumnVector>();
+
+    Matrix hessian = state.algo.hessian;
+    if (!isfinite(hessian) || !isfinite(state.algo.gradient))
+        throw std::domain_error("Design matrix is not finite.");
+
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        hessian, ComputeEigenvectors);
+    const ColumnVector &eigenvalues = decomposition.eigenvalues();
+    const Matrix &eigenvectors = decomposition.eigenvectors();
+    ColumnVector projected = -trans(eigenvectors) * state.algo.gradient;
+    double threshold = std::numeric_limits<double>::epsilon()
+        * static_cast<double>(state.task.dimension)
+        * std::max(eigenvalues.cwiseAbs().maxCoeff(), 1.);
+
+    Index dimension = state.task.dimension;
+    MutableMappedColumnVector path(allocateArray<double>(
+        dimension * lambdas.size()));
+    for (Index k = 0; k < lambdas.size(); k ++) {
+        if (lambdas(k) < 0)
+            throw std::invalid_argument("Invalid parameter: lambda must be "
+                "non-negative.");
+
+        ColumnVector scaled(dimension);
+        for (Index i = 0; i < dimension; i ++) {
+            double denominator = eigenvalues(i) + lambdas(k);
+            scaled(i) = denominator > threshold
+                ? projected(i) / denominator : 0.;
+        }
+        path.segment(k * dimension, dimension) = eigenvectors * scaled;
+    }
+
+    return path;
+}
+
 /**
  * @brief Return the prediction reselt
  */
 AnyType
 ridge_newton_predict::run(AnyType &args) {
     using madlib::dbal::eigen_integration::MappedColumnVector;
-    MappedColumnVector model = args[0].getAs<MappedColumnVector>();
+    MappedColumnVector model(cachedArrayArgument(0));
     MappedColumnVector indVar = args[1].getAs<MappedColumnVector>();
 
     return OLS<MappedColumnVector, GLMTuple>::predict(model, indVar);
@@ -25,6 +25,17 @@ DECLARE_UDF(convex, ridge_newton_final)
  */
 DECLARE_UDF(convex, internal_ridge_newton_result)
 
+/**
+ * @brief Ridge regression (regularization path): Transition function
+ */
+DECLARE_UDF(convex, ridge_newton_path_transition)
+
+/**
+ * @brief Ridge regression (regularization path): Coefficients for a grid of
+ *     lambdas
+ */
+DECLARE_UDF(convex, internal_ridge_newton_path_result)
+
 /**
  * @brief Ridge regression (Newton's method): Prediction
  */
@@ -28,6 +28,13 @@ public:
             const double                        &lambda, 
             model_type                          &gradient);
 
+    template <class ModelType, class AppliedPenalty>
+    static void applyCumulativePenalty(
+            ModelType                           &model,
+            AppliedPenalty                      &applied,
+            const double                        &penalty,
+            const Index                         &i);
+
     static double loss(
             const model_type                    &model, 
             const double                        &lambda);
@@ -55,6 +62,35 @@ L1<Model>::gradient(
     }
 }
 
+/**
+ * @brief Bring coefficient \c i up to date with the cumulative L1 penalty
+ *
+ * This is the cumulative-penalty truncation of Tsuruoka et al., "Stochastic
+ * Gradient Descent Training for L1-regularized Log-linear Models with
+ * Cumulative Penalty", ACL 2009. \c penalty is the total penalty that each
+ * coefficient should have received so far (the sum of stepsize * lambda), and
+ * <tt>applied(i)</tt> is the penalty actually applied to coefficient \c i.
+ * The coefficient is moved towards zero by the difference, but never across
+ * zero. Since the penalty is only applied when needed, a gradient step only
+ * has to update the coefficients it touches.
+ */
+template <class Model>
+template <class ModelType, class AppliedPenalty>
+void
+L1<Model>::applyCumulativePenalty(
+        ModelType                           &model,
+        AppliedPenalty                      &applied,
+        const double                        &penalty,
+        const Index                         &i) {
+    double z = model(i);
+    if (z > 0.) {
+        model(i) = std::max(0., z - (penalty + applied(i)));
+    } else if (z < 0.) {
+        model(i) = std::min(0., z + (penalty - applied(i)));
+    }
+    applied(i) += model(i) - z;
+}
+
 template <class Model>
 double 
 L1<Model>::loss(
@@ -8,6 +8,7 @@
 #define MADLIB_MODULES_CONVEX_TASK_L2_HPP_
 
 #include <dbconnector/dbconnector.hpp>
+#include <modules/convex/type/independent_variables.hpp>
 
 namespace madlib {
 
@@ -34,6 +35,12 @@ public:
             const double                        &lambda, 
             hessian_type                        &hessian);
 
+    template <class ScaledModelType>
+    static void gradientInPlace(
+            ScaledModel<ScaledModelType>        &model,
+            const double                        &lambda,
+            const double                        &stepsize);
+
     static double loss(
             const model_type                    &model, 
             const double                        &lambda);
@@ -48,6 +55,26 @@ L2<Model, Hessian>::gradient(
     gradient += lambda * model;
 }
 
+/**
+ * @brief Regularization step <tt>model -= stepsize * lambda * model</tt> for a
+ *     scaled model
+ *
+ * This only updates the scale, so it takes constant time, and gradient steps
+ * for sparse independent variables may still only touch nonzeros. Once the
+ * scale gets small, it is folded into the model to avoid loss of precision.
+ */
+template <class Model, class Hessian>
+template <class ScaledModelType>
+void
+L2<Model, Hessian>::gradientInPlace(
+        ScaledModel<ScaledModelType>        &model,
+        const double                        &lambda,
+        const double                        &stepsize) {
+    model.scale *= 1. - stepsize * lambda;
+    if (std::fabs(model.scale) < 1e-6)
+        model.normalize();
+}
+
 template <class Model, class Hessian>
 void
 L2<Model, Hessian>::hessian(
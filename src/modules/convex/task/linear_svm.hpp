@@ -8,6 +8,7 @@
 #define MADLIB_MODULES_CONVEX_TASK_LINEAR_SVM_HPP_
 
 #include <dbconnector/dbconnector.hpp>
+#include <modules/convex/type/independent_variables.hpp>
 
 namespace madlib {
 
@@ -38,7 +39,39 @@ public:
             const independent_variables_type    &x,
             const dependent_variable_type       &y, 
             const double                        &stepsize);
-    
+
+    static double gradientInPlaceWithLoss(
+            model_type                          &model, 
+            const independent_variables_type    &x,
+            const dependent_variable_type       &y, 
+            const double                        &stepsize);
+
+    template <class Direction, class Stepsizes, class Losses,
+            class Derivatives, class Gradients>
+    static void lineSearchGradientWithLoss(
+            const model_type                    &model,
+            const Direction                     &direction,
+            const independent_variables_type    &x,
+            const dependent_variable_type       &y,
+            const Stepsizes                     &stepsizes,
+            Losses                              &losses,
+            Derivatives                         &derivatives,
+            Gradients                           &gradients);
+
+    template <class BatchIndVar, class BatchDepVar>
+    static void batchGradient(
+            const model_type                    &model,
+            const BatchIndVar                   &X,
+            const BatchDepVar                   &y,
+            model_type                          &gradient);
+
+    template <class BatchIndVar, class BatchDepVar>
+    static void batchGradientInPlace(
+            model_type                          &model,
+            const BatchIndVar                   &X,
+            const BatchDepVar                   &y,
+            const double                        &stepsize);
+
     static double loss(
             const model_type                    &model, 
             const independent_variables_type    &x, 
@@ -47,6 +80,13 @@ public:
     static dependent_variable_type predict(
             const model_type                    &model, 
             const independent_variables_type    &x);
+
+private:
+    template <class BatchIndVar, class BatchDepVar>
+    static ColumnVector batchCoefficients(
+            const model_type                    &model,
+            const BatchIndVar                   &X,
+            const BatchDepVar                   &y);
 };
 
 template <class Model, class Tuple>
@@ -56,10 +96,10 @@ LinearSVM<Model, Tuple>::gradient(
         const independent_variables_type    &x,
         const dependent_variable_type       &y,
         model_type                          &gradient) {
-    double wx = dot(model, x);
+    double wx = innerProduct(model, x);
     if (1 - wx * y > 0) {
         double c = -y; // minus for "-loglik"
-        gradient += c * x;
+        addScaled(gradient, c, x);
     } else { }
 }
 
@@ -70,20 +110,128 @@ LinearSVM<Model, Tuple>::gradientInPlace(
         const independent_variables_type    &x, 
         const dependent_variable_type       &y, 
         const double                        &stepsize) {
-    double wx = dot(model, x);
+    double wx = innerProduct(model, x);
     if (1. - wx * y > 0.) {
         double c = -y; // minus for "-loglik"
-        model -= stepsize * c * x;
+        addScaled(model, -stepsize * c, x);
     } else { }
 }
 
+/**
+ * @brief Gradient step as gradientInPlace(), returning the loss of the tuple
+ *     under the model before the step
+ *
+ * The inner product is shared between the gradient and the loss.
+ */
+template <class Model, class Tuple>
+double
+LinearSVM<Model, Tuple>::gradientInPlaceWithLoss(
+        model_type                          &model,
+        const independent_variables_type    &x, 
+        const dependent_variable_type       &y, 
+        const double                        &stepsize) {
+    double wx = innerProduct(model, x);
+    double distance = 1. - wx * y;
+    if (distance > 0.) {
+        double c = -y; // minus for "-loglik"
+        addScaled(model, -stepsize * c, x);
+        return distance;
+    }
+    return 0.;
+}
+
+/**
+ * @brief Loss, derivative along a direction, and gradient of a tuple for
+ *     several points on a line
+ *
+ * Point k is <tt>model + stepsizes(k) * direction</tt>. Both inner products
+ * are computed only once, so the cost beyond the gradients is constant per
+ * point. The loss, the derivative along \c direction, and the gradient at
+ * point k are added to <tt>losses(k)</tt>, <tt>derivatives(k)</tt>, and
+ * column k of \c gradients.
+ */
+template <class Model, class Tuple>
+template <class Direction, class Stepsizes, class Losses, class Derivatives,
+    class Gradients>
+void
+LinearSVM<Model, Tuple>::lineSearchGradientWithLoss(
+        const model_type                    &model,
+        const Direction                     &direction,
+        const independent_variables_type    &x,
+        const dependent_variable_type       &y,
+        const Stepsizes                     &stepsizes,
+        Losses                              &losses,
+        Derivatives                         &derivatives,
+        Gradients                           &gradients) {
+    double wx = innerProduct(model, x);
+    double dx = innerProduct(direction, x);
+    ColumnVector c(stepsizes.size());
+    for (Index k = 0; k < c.size(); k ++) {
+        double distance = 1. - (wx + stepsizes(k) * dx) * y;
+        c(k) = distance > 0. ? -y : 0.; // minus for "-loglik"
+        losses(k) += distance > 0. ? distance : 0.;
+        derivatives(k) += c(k) * dx;
+    }
+    gradients.noalias() += x * trans(c);
+}
+
+/**
+ * @brief Per-tuple scalar factors of the (sub)gradient for a batch of tuples
+ *
+ * The columns of \c X are the independent variables of the tuples in the
+ * batch. All inner products are computed in a single matrix-vector product.
+ */
+template <class Model, class Tuple>
+template <class BatchIndVar, class BatchDepVar>
+ColumnVector
+LinearSVM<Model, Tuple>::batchCoefficients(
+        const model_type                    &model,
+        const BatchIndVar                   &X,
+        const BatchDepVar                   &y) {
+    ColumnVector c = trans(X) * model;
+    for (Index i = 0; i < c.size(); i ++) {
+        c(i) = 1. - c(i) * y(i) > 0. ? -y(i) : 0.;
+    }
+    return c;
+}
+
+/**
+ * @brief Add the average (sub)gradient over a batch of tuples
+ */
+template <class Model, class Tuple>
+template <class BatchIndVar, class BatchDepVar>
+void
+LinearSVM<Model, Tuple>::batchGradient(
+        const model_type                    &model,
+        const BatchIndVar                   &X,
+        const BatchDepVar                   &y,
+        model_type                          &gradient) {
+    ColumnVector c = batchCoefficients(model, X, y);
+    gradient.noalias() += X * c / static_cast<double>(c.size());
+}
+
+/**
+ * @brief Take one gradient step using the average gradient over a batch
+ */
+template <class Model, class Tuple>
+template <class BatchIndVar, class BatchDepVar>
+void
+LinearSVM<Model, Tuple>::batchGradientInPlace(
+        model_type                          &model,
+        const BatchIndVar                   &X,
+        const BatchDepVar                   &y,
+        const double                        &stepsize) {
+    ColumnVector c = batchCoefficients(model, X, y);
+    model.noalias() -= (stepsize / static_cast<double>(c.size())) * X * c;
+}
+
 template <class Model, class Tuple>
 double 
 LinearSVM<Model, Tuple>::loss(
         const model_type                    &model, 
         const independent_variables_type    &x, 
         const dependent_variable_type       &y) {
-    double wx = dot(model, x);
+    double wx = innerProduct(model, x);
     double distance = 1. - wx * y;
     return distance > 0. ? distance : 0.;
 }
@@ -93,7 +241,7 @@ typename Tuple::dependent_variable_type
 LinearSVM<Model, Tuple>::predict(
         const model_type                    &model, 
         const independent_variables_type    &x) {
-    return dot(model, x);
+    return innerProduct(model, x);
 }
 
 } // namespace convex
@@ -41,6 +41,12 @@ public:
             const independent_variables_type    &x,
             const dependent_variable_type       &y, 
             const double                        &stepsize);
+
+    static double gradientInPlaceWithLoss(
+            model_type                          &model, 
+            const independent_variables_type    &x,
+            const dependent_variable_type       &y, 
+            const double                        &stepsize);
     
     static double loss(
             const model_type                    &model, 
@@ -70,11 +76,34 @@ LMF<Model, Tuple>::gradientInPlace(
         const dependent_variable_type       &y, 
         const double                        &stepsize) {
     // Please refer to the design document for an explanation of the following
-    double e = model.matrixU.row(x.i) * trans(model.matrixV.row(x.j)) - y;
-    RowVector temp = model.matrixU.row(x.i)
-        - stepsize * e * model.matrixV.row(x.j);
-    model.matrixV.row(x.j) -= stepsize * e * model.matrixU.row(x.i);
-    model.matrixU.row(x.i) = temp;
+    // Note: U and V are stored transposed (see LMFModel), so the factors of
+    // row i and column j are the contiguous columns i and j
+    double e = model.matrixU.col(x.i).dot(model.matrixV.col(x.j)) - y;
+    ColumnVector temp = model.matrixU.col(x.i)
+        - stepsize * e * model.matrixV.col(x.j);
+    model.matrixV.col(x.j) -= stepsize * e * model.matrixU.col(x.i);
+    model.matrixU.col(x.i) = temp;
+}
+
+/**
+ * @brief Gradient step as gradientInPlace(), returning the squared error of
+ *     the rating under the model before the step
+ *
+ * The residual e is shared between the gradient and the loss.
+ */
+template <class Model, class Tuple>
+double
+LMF<Model, Tuple>::gradientInPlaceWithLoss(
+        model_type                          &model,
+        const independent_variables_type    &x, 
+        const dependent_variable_type       &y, 
+        const double                        &stepsize) {
+    double e = model.matrixU.col(x.i).dot(model.matrixV.col(x.j)) - y;
+    ColumnVector temp = model.matrixU.col(x.i)
+        - stepsize * e * model.matrixV.col(x.j);
+    model.matrixV.col(x.j) -= stepsize * e * model.matrixU.col(x.i);
+    model.matrixU.col(x.i) = temp;
+    return e * e;
 }
 
 template <class Model, class Tuple>
@@ -83,13 +112,9 @@ LMF<Model, Tuple>::loss(
         const model_type                    &model, 
         const independent_variables_type    &x, 
         const dependent_variable_type       &y) {
-    // HAYING: A chance for improvement by reusing the e computed in gradient.
-    // Perhaps we can add a book-keeping data structure in the model...
-    // Note: the value of e is different from the e in gradient if the
-    // model passed in is different, which IS the case for IGD
-    // Note 2: this can actually be a problem of having the computation 
-    // around model (algo/ & task/) detached from the model classes 
-    double e = model.matrixU.row(x.i) * trans(model.matrixV.row(x.j)) - y;
+    // Note: IGD uses gradientInPlaceWithLoss() instead, which reuses the e
+    // computed for the gradient (evaluated at the incremental model)
+    double e = model.matrixU.col(x.i).dot(model.matrixV.col(x.j)) - y;
     return e * e;
 }
 
@@ -99,7 +124,7 @@ typename Tuple::dependent_variable_type
 LMF<Model, Tuple>::predict(
         const model_type                    &model, 
         const independent_variables_type    &x) {
-    return model.matrixU.row(x.i) * trasn(model.matrixV.row(x.j));
+    return model.matrixU.col(x.i).dot(model.matrixV.col(x.j));
 }
 
 } // namespace convex
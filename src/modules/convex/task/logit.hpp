@@ -8,6 +8,8 @@
 #define MADLIB_MODULES_CONVEX_TASK_LOGIT_HPP_
 
 #include <dbconnector/dbconnector.hpp>
+#include <modules/convex/type/independent_variables.hpp>
+#include <modules/shared/LogisticTerms.hpp>
 
 namespace madlib {
 
@@ -39,7 +41,47 @@ public:
             const independent_variables_type    &x,
             const dependent_variable_type       &y, 
             const double                        &stepsize);
-    
+
+    static double gradientInPlaceWithLoss(
+            model_type                          &model, 
+            const independent_variables_type    &x,
+            const dependent_variable_type       &y, 
+            const double                        &stepsize);
+
+    template <class Models, class Stepsizes, class Losses>
+    static void bundleGradientInPlaceWithLoss(
+            Models                              &models,
+            const independent_variables_type    &x,
+            const dependent_variable_type       &y,
+            const Stepsizes                     &stepsizes,
+            Losses                              &losses);
+
+    template <class Direction, class Stepsizes, class Losses,
+            class Derivatives, class Gradients>
+    static void lineSearchGradientWithLoss(
+            const model_type                    &model,
+            const Direction                     &direction,
+            const independent_variables_type    &x,
+            const dependent_variable_type       &y,
+            const Stepsizes                     &stepsizes,
+            Losses                              &losses,
+            Derivatives                         &derivatives,
+            Gradients                           &gradients);
+
+    template <class BatchIndVar, class BatchDepVar>
+    static void batchGradient(
+            const model_type                    &model,
+            const BatchIndVar                   &X,
+            const BatchDepVar                   &y,
+            model_type                          &gradient);
+
+    template <class BatchIndVar, class BatchDepVar>
+    static void batchGradientInPlace(
+            model_type                          &model,
+            const BatchIndVar                   &X,
+            const BatchDepVar                   &y,
+            const double                        &stepsize);
+
     static void hessian(
             const model_type                    &model,
             const independent_variables_type    &x,
@@ -56,9 +98,11 @@ public:
             const independent_variables_type    &x);
 
 private:
-    static double sigma(double x) {
-        return 1. / (1. + std::exp(-x));
-    }
+    template <class BatchIndVar, class BatchDepVar>
+    static ColumnVector batchCoefficients(
+            const model_type                    &model,
+            const BatchIndVar                   &X,
+            const BatchDepVar                   &y);
 };
 
 template <class Model, class Tuple, class Hessian>
@@ -68,10 +112,10 @@ Logit<Model, Tuple, Hessian>::gradient(
         const independent_variables_type    &x,
         const dependent_variable_type       &y,
         model_type                          &gradient) {
-    double wx = dot(model, x);
-    double sig = sigma(-wx * y);
+    double wx = innerProduct(model, x);
+    double sig = LogisticTerms(wx * y).sigmaOfNegative;
     double c = -sig * y; // minus for "-loglik"
-    gradient += c * x;
+    addScaled(gradient, c, x);
 }
 
 template <class Model, class Tuple, class Hessian>
@@ -81,10 +125,144 @@ Logit<Model, Tuple, Hessian>::gradientInPlace(
         const independent_variables_type    &x, 
         const dependent_variable_type       &y, 
         const double                        &stepsize) {
-    double wx = dot(model, x);
-    double sig = sigma(-wx * y);
+    double wx = innerProduct(model, x);
+    double sig = LogisticTerms(wx * y).sigmaOfNegative;
     double c = -sig * y; // minus for "-loglik"
-    model -= stepsize * c * x;
+    addScaled(model, -stepsize * c, x);
+}
+
+/**
+ * @brief Gradient step as gradientInPlace(), returning the loss of the tuple
+ *     under the model before the step
+ *
+ * The inner product and the exponential are shared between the gradient and
+ * the loss.
+ */
+template <class Model, class Tuple, class Hessian>
+double
+Logit<Model, Tuple, Hessian>::gradientInPlaceWithLoss(
+        model_type                          &model,
+        const independent_variables_type    &x, 
+        const dependent_variable_type       &y, 
+        const double                        &stepsize) {
+    double wx = innerProduct(model, x);
+    LogisticTerms terms(wx * y);
+    double c = -terms.sigmaOfNegative * y; // minus for "-loglik"
+    addScaled(model, -stepsize * c, x);
+    return terms.negativeLogLikelihood;
+}
+
+/**
+ * @brief Gradient step as gradientInPlaceWithLoss(), for all models of a
+ *     bundle at once
+ *
+ * The columns of \c models are models that differ only in their step size.
+ * The inner products with all models are one matrix-vector product, and the
+ * update of all models is one rank-one update. The loss of the tuple under
+ * each model (before its step) is added to the corresponding element of
+ * \c losses.
+ */
+template <class Model, class Tuple, class Hessian>
+template <class Models, class Stepsizes, class Losses>
+void
+Logit<Model, Tuple, Hessian>::bundleGradientInPlaceWithLoss(
+        Models                              &models,
+        const independent_variables_type    &x,
+        const dependent_variable_type       &y,
+        const Stepsizes                     &stepsizes,
+        Losses                              &losses) {
+    ColumnVector margins = trans(models) * x * y;
+    ColumnVector scale(margins.size());
+    for (Index k = 0; k < margins.size(); k ++) {
+        LogisticTerms terms(margins(k));
+        scale(k) = stepsizes(k) * terms.sigmaOfNegative * y;
+        losses(k) += terms.negativeLogLikelihood;
+    }
+    models.noalias() += x * trans(scale);
+}
+
+/**
+ * @brief Loss, derivative along a direction, and gradient of a tuple for
+ *     several points on a line
+ *
+ * Point k is <tt>model + stepsizes(k) * direction</tt>. Both inner products
+ * are computed only once, so the cost beyond the gradients is constant per
+ * point. The loss, the derivative along \c direction, and the gradient at
+ * point k are added to <tt>losses(k)</tt>, <tt>derivatives(k)</tt>, and
+ * column k of \c gradients.
+ */
+template <class Model, class Tuple, class Hessian>
+template <class Direction, class Stepsizes, class Losses, class Derivatives,
+    class Gradients>
+void
+Logit<Model, Tuple, Hessian>::lineSearchGradientWithLoss(
+        const model_type                    &model,
+        const Direction                     &direction,
+        const independent_variables_type    &x,
+        const dependent_variable_type       &y,
+        const Stepsizes                     &stepsizes,
+        Losses                              &losses,
+        Derivatives                         &derivatives,
+        Gradients                           &gradients) {
+    double wx = innerProduct(model, x);
+    double dx = innerProduct(direction, x);
+    ColumnVector c(stepsizes.size());
+    for (Index k = 0; k < c.size(); k ++) {
+        LogisticTerms terms((wx + stepsizes(k) * dx) * y);
+        c(k) = -terms.sigmaOfNegative * y; // minus for "-loglik"
+        losses(k) += terms.negativeLogLikelihood;
+        derivatives(k) += c(k) * dx;
+    }
+    gradients.noalias() += x * trans(c);
+}
+
+/**
+ * @brief Per-tuple scalar factors of the gradient for a batch of tuples
+ *
+ * The columns of \c X are the independent variables of the tuples in the
+ * batch. All inner products are computed in a single matrix-vector product.
+ */
+template <class Model, class Tuple, class Hessian>
+template <class BatchIndVar, class BatchDepVar>
+ColumnVector
+Logit<Model, Tuple, Hessian>::batchCoefficients(
+        const model_type                    &model,
+        const BatchIndVar                   &X,
+        const BatchDepVar                   &y) {
+    ColumnVector margins = (trans(X) * model).cwiseProduct(y);
+    ColumnVector c;
+    LogisticTerms::batch(margins, c);
+    return -c.cwiseProduct(y); // minus for "-loglik"
+}
+
+/**
+ * @brief Add the average gradient over a batch of tuples
+ */
+template <class Model, class Tuple, class Hessian>
+template <class BatchIndVar, class BatchDepVar>
+void
+Logit<Model, Tuple, Hessian>::batchGradient(
+        const model_type                    &model,
+        const BatchIndVar                   &X,
+        const BatchDepVar                   &y,
+        model_type                          &gradient) {
+    ColumnVector c = batchCoefficients(model, X, y);
+    gradient.noalias() += X * c / static_cast<double>(c.size());
+}
+
+/**
+ * @brief Take one gradient step using the average gradient over a batch
+ */
+template <class Model, class Tuple, class Hessian>
+template <class BatchIndVar, class BatchDepVar>
+void
+Logit<Model, Tuple, Hessian>::batchGradientInPlace(
+        model_type                          &model,
+        const BatchIndVar                   &X,
+        const BatchDepVar                   &y,
+        const double                        &stepsize) {
+    ColumnVector c = batchCoefficients(model, X, y);
+    model.noalias() -= (stepsize / static_cast<double>(c.size())) * X * c;
 }
 
 template <class Model, class Tuple, class Hessian>
@@ -94,9 +272,8 @@ Logit<Model, Tuple, Hessian>::hessian(
         const independent_variables_type    &x,
         const dependent_variable_type       & /* y */, 
         hessian_type                        &hessian) {
-    double wx = dot(model, x);
-    double sig = sigma(wx);
-    double a = sig * (1 - sig);
+    double wx = innerProduct(model, x);
+    double a = LogisticTerms(wx).weight;
     hessian += a * x * trans(x);
 }
 
@@ -106,8 +283,8 @@ Logit<Model, Tuple, Hessian>::loss(
         const model_type                    &model, 
         const independent_variables_type    &x, 
         const dependent_variable_type       &y) {
-    double wx = dot(model, x);
-    return log(1. + std::exp(-wx * y)); //  = -log(sigma(y * wx))
+    double wx = innerProduct(model, x);
+    return LogisticTerms(wx * y).negativeLogLikelihood; //  = -log(sigma(y * wx))
 }
 
 template <class Model, class Tuple, class Hessian>
@@ -115,8 +292,8 @@ typename Tuple::dependent_variable_type
 Logit<Model, Tuple, Hessian>::predict(
         const model_type                    &model, 
         const independent_variables_type    &x) {
-    double wx = dot(model, x);
-    return sigma(wx);
+    double wx = innerProduct(model, x);
+    return LogisticTerms(wx).sigma;
 }
 
 } // namespace convex
@@ -8,6 +8,7 @@
 #define MADLIB_MODULES_CONVEX_TASK_OLS_HPP_
 
 #include <dbconnector/dbconnector.hpp>
+#include <modules/convex/type/independent_variables.hpp>
 
 namespace madlib {
 
@@ -34,6 +35,19 @@ public:
             const dependent_variable_type       &y, 
             model_type                          &gradient);
 
+    static void gradientInPlace(
+            model_type                          &model,
+            const independent_variables_type    &x,
+            const dependent_variable_type       &y,
+            const double                        &stepsize);
+
+    template <class BatchIndVar, class BatchDepVar>
+    static void batchGradient(
+            const model_type                    &model,
+            const BatchIndVar                   &X,
+            const BatchDepVar                   &y,
+            model_type                          &gradient);
+
     static void hessian(
             const model_type                    & /* model */,
             const independent_variables_type    &x,
@@ -57,9 +71,39 @@ OLS<Model, Tuple, Hessian>::gradient(
         const independent_variables_type    &x,
         const dependent_variable_type       &y,
         model_type                          &gradient) {
-    double wx = dot(model, x);
+    double wx = innerProduct(model, x);
     double r = wx - y;
-    gradient += r * x;
+    addScaled(gradient, r, x);
+}
+
+template <class Model, class Tuple, class Hessian>
+void
+OLS<Model, Tuple, Hessian>::gradientInPlace(
+        model_type                          &model,
+        const independent_variables_type    &x,
+        const dependent_variable_type       &y,
+        const double                        &stepsize) {
+    double wx = innerProduct(model, x);
+    double r = wx - y;
+    addScaled(model, -stepsize * r, x);
+}
+
+/**
+ * @brief Add the average gradient over a batch of tuples
+ *
+ * The columns of \c X are the independent variables of the tuples in the
+ * batch. The residuals are computed in a single matrix-vector product.
+ */
+template <class Model, class Tuple, class Hessian>
+template <class BatchIndVar, class BatchDepVar>
+void
+OLS<Model, Tuple, Hessian>::batchGradient(
+        const model_type                    &model,
+        const BatchIndVar                   &X,
+        const BatchDepVar                   &y,
+        model_type                          &gradient) {
+    ColumnVector r = trans(X) * model - y;
+    gradient.noalias() += X * r / static_cast<double>(r.size());
 }
 
 template <class Model, class Tuple, class Hessian>
@@ -78,7 +122,7 @@ OLS<Model, Tuple, Hessian>::loss(
         const model_type                    &model, 
         const independent_variables_type    &x, 
         const dependent_variable_type       &y) {
-    double wx = dot(model, x);
+    double wx = innerProduct(model, x);
     return (wx - y) * (wx - y) / 2.;
 }
 
@@ -87,7 +131,7 @@ typename Tuple::dependent_variable_type
 OLS<Model, Tuple, Hessian>::predict(
         const model_type                    &model, 
         const independent_variables_type    &x) {
-    double wx = dot(model, x);
+    double wx = innerProduct(model, x);
     return wx;
 }
 
@@ -11,17 +11,153 @@
 #ifndef MADLIB_MODULES_CONVEX_TYPE_INDEPENDENT_VARIABLES_HPP_
 #define MADLIB_MODULES_CONVEX_TYPE_INDEPENDENT_VARIABLES_HPP_
 
+#include <dbconnector/dbconnector.hpp>
+
 namespace madlib {
 
 namespace modules {
 
 namespace convex {
 
+// use Eigen
+using namespace madlib::dbal::eigen_integration;
+
 struct MatrixIndex {
-    uint16_t i;
-    uint16_t j;
+    uint32_t i;
+    uint32_t j;
 };
 
+/**
+ * @brief A dense model stored as <tt>scale * model</tt>
+ *
+ * Scaling all coefficients (as, e.g., a step of L2 regularization does)
+ * then only takes constant time, so that a gradient step for sparse
+ * independent variables only has to touch the nonzero coefficients. Call
+ * normalize() to fold the scale back into the model.
+ */
+template <class Model>
+struct ScaledModel {
+    ScaledModel(Model &inModel, double &inScale)
+      : model(inModel), scale(inScale) { }
+
+    void normalize() {
+        model *= scale;
+        scale = 1.;
+    }
+
+    Model &model;
+    double &scale;
+};
+
+/**
+ * @brief Inner product of a model with dense independent variables
+ */
+template <class Model, class IndependentVariables>
+inline double
+innerProduct(const Model &model, const IndependentVariables &x) {
+    return dot(model, x);
+}
+
+/**
+ * @brief Inner product of a model with sparse independent variables
+ *
+ * Only the nonzero elements of \c x are visited.
+ */
+template <class Model>
+inline double
+innerProduct(const Model &model, const SparseColumnVector &x) {
+    double result = 0.;
+    for (SparseColumnVector::InnerIterator it(x); it; ++it)
+        result += model(it.index()) * it.value();
+    return result;
+}
+
+/**
+ * @brief Inner product of a model with single-precision independent variables
+ *
+ * The model stays in double precision, and each element of \c x is read only
+ * once and converted on the fly. Compared to converting a \c REAL[] column to
+ * <tt>DOUBLE PRECISION[]</tt> in SQL, this halves the memory traffic for the
+ * independent variables.
+ */
+template <class Model>
+inline double
+innerProduct(const Model &model, const MappedFloatColumnVector &x) {
+    return dot(model, x.cast<double>());
+}
+
+template <class Model, class IndependentVariables>
+inline double
+innerProduct(const ScaledModel<Model> &model, const IndependentVariables &x) {
+    return model.scale * innerProduct(model.model, x);
+}
+
+template <class Model>
+inline double
+innerProduct(const ScaledModel<Model> &model, const SparseColumnVector &x) {
+    return model.scale * innerProduct(model.model, x);
+}
+
+template <class Model>
+inline double
+innerProduct(const ScaledModel<Model> &model,
+        const MappedFloatColumnVector &x) {
+    return model.scale * innerProduct(model.model, x);
+}
+
+/**
+ * @brief Add a multiple of dense independent variables to a model,
+ *     <tt>model += alpha * x</tt>
+ */
+template <class Model, class IndependentVariables>
+inline void
+addScaled(Model &model, double alpha, const IndependentVariables &x) {
+    model += alpha * x;
+}
+
+/**
+ * @brief Add a multiple of sparse independent variables to a model
+ *
+ * Only the coefficients for nonzero elements of \c x are updated.
+ */
+template <class Model>
+inline void
+addScaled(Model &model, double alpha, const SparseColumnVector &x) {
+    for (SparseColumnVector::InnerIterator it(x); it; ++it)
+        model(it.index()) += alpha * it.value();
+}
+
+/**
+ * @brief Add a multiple of single-precision independent variables to a
+ *     (double-precision) model
+ */
+template <class Model>
+inline void
+addScaled(Model &model, double alpha, const MappedFloatColumnVector &x) {
+    model += alpha * x.cast<double>();
+}
+
+template <class Model, class IndependentVariables>
+inline void
+addScaled(ScaledModel<Model> &model, double alpha,
+        const IndependentVariables &x) {
+    addScaled(model.model, alpha / model.scale, x);
+}
+
+template <class Model>
+inline void
+addScaled(ScaledModel<Model> &model, double alpha,
+        const SparseColumnVector &x) {
+    addScaled(model.model, alpha / model.scale, x);
+}
+
+template <class Model>
+inline void
+addScaled(ScaledModel<Model> &model, double alpha,
+        const MappedFloatColumnVector &x) {
+    addScaled(model.model, alpha / model.scale, x);
+}
+
 } // namespace convex
 
 } // namespace modules
@@ -20,11 +20,30 @@ namespace modules {
 
 namespace convex {
 
+/**
+ * @brief Model of low-rank matrix factorization, A ~ UV'
+ *
+ * U and V are stored transposed, i.e., matrixU is (paddedRank x rowDim) and
+ * column i of matrixU is row i of U. With the column-major maps, the factors
+ * of a single row/column are therefore contiguous in memory, which is what the
+ * per-rating updates in LMF touch. The rank is padded to a multiple of
+ * kSIMDWidth; the padding entries are zero and stay zero during the updates,
+ * so they do not change any dot product.
+ */
 template <class Handle>
 struct LMFModel {
+    enum { kSIMDWidth = 4 };
+
     typename HandleTraits<Handle>::MatrixTransparentHandleMap matrixU;
     typename HandleTraits<Handle>::MatrixTransparentHandleMap matrixV;
 
+    /**
+     * @brief Number of stored factors per row/column (rank plus padding)
+     */
+    static inline uint32_t paddedRank(const uint32_t inMaxRank) {
+        return (inMaxRank + kSIMDWidth - 1) / kSIMDWidth * kSIMDWidth;
+    }
+
     /**
      * @brief Space needed.
      *
@@ -32,28 +51,37 @@ struct LMFModel {
      * necessary for a matrix, so that it can perform operations. These are
      * stored in the HandleMap.
      */
-    static inline uint32_t arraySize(const uint16_t inRowDim, 
-            const uint16_t inColDim, const uint16_t inMaxRank) {
-        return (inRowDim + inColDim) * inMaxRank;
+    static inline uint64_t arraySize(const uint32_t inRowDim, 
+            const uint32_t inColDim, const uint32_t inMaxRank) {
+        return (static_cast<uint64_t>(inRowDim) + inColDim)
+            * paddedRank(inMaxRank);
     }
 
     /**
      * @brief Initialize the model randomly with a user-provided scale factor
+     *
+     * Only the first inMaxRank factors are initialized, the padding is left
+     * as zero.
      */
-    void initialize(const double &inScaleFactor) {
-        // using madlib::dbconnector::$database::NativeRandomNumberGenerator
-        NativeRandomNumberGenerator rng;
-        int i, j, rr;
+    void initialize(const double &inScaleFactor, const uint32_t inMaxRank) {
+        // The factors are many, so use the counter-based RNG instead of
+        // calling into the backend for every number
+        PhiloxRandomNumberGenerator rng;
+        uint32_t i, j, rr;
         double base = rng.min();
         double span = rng.max() - base;
-        for (rr = 0; rr < matrixU.cols(); rr ++) {
-            for (i = 0; i < matrixU.rows(); i ++) {
-                matrixU(i, rr) = inScaleFactor * (rng() - base) / span;
+        for (i = 0; i < static_cast<uint32_t>(matrixU.cols()); i ++) {
+            double *factors = &matrixU(0, i);
+            rng.fill(factors, inMaxRank);
+            for (rr = 0; rr < inMaxRank; rr ++) {
+                factors[rr] = inScaleFactor * (factors[rr] - base) / span;
             }
         }
-        for (rr = 0; rr < matrixV.cols(); rr ++) {
-            for (j = 0; j < matrixV.rows(); j ++) {
-                matrixV(j, rr) = inScaleFactor * (rng() - base) / span;
+        for (j = 0; j < static_cast<uint32_t>(matrixV.cols()); j ++) {
+            double *factors = &matrixV(0, j);
+            rng.fill(factors, inMaxRank);
+            for (rr = 0; rr < inMaxRank; rr ++) {
+                factors[rr] = inScaleFactor * (factors[rr] - base) / span;
             }
         }
     }
@@ -12,6 +12,8 @@
 #include <dbconnector/dbconnector.hpp>
 #include "model.hpp"
 
+#include <algorithm>
+
 namespace madlib {
 
 namespace modules {
@@ -58,8 +60,8 @@ public:
     /**
      * @brief Allocating the incremental gradient state.
      */
-    inline void allocate(const Allocator &inAllocator, uint16_t inRowDim,
-            uint16_t inColDim, uint16_t inMaxRank) {
+    inline void allocate(const Allocator &inAllocator, uint32_t inRowDim,
+            uint32_t inColDim, uint32_t inMaxRank) {
         mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
                 dbal::DoZero, dbal::ThrowBadAlloc>(
                 arraySize(inRowDim, inColDim, inMaxRank));
@@ -108,8 +110,8 @@ public:
         task.RMSE = sqrt(algo.loss / static_cast<double>(algo.numRows));
     }
 
-    static inline uint32_t arraySize(const uint16_t inRowDim, 
-            const uint16_t inColDim, const uint16_t inMaxRank) {
+    static inline uint64_t arraySize(const uint32_t inRowDim, 
+            const uint32_t inColDim, const uint32_t inMaxRank) {
         return 8 + 2 * LMFModel<Handle>::arraySize(inRowDim, inColDim, inMaxRank);
     }
 
@@ -124,11 +126,13 @@ private:
      * - 2: maxRank (the rank of the low-rank assumption)
      * - 3: stepsize (step size of gradient steps)
      * - 4: initValue (value scale used to initialize the model)
-     * - 5: model (matrices U(rowDim x maxRank), V(colDim x maxRank), A ~ UV')
+     * - 5: model (matrices U(rowDim x maxRank), V(colDim x maxRank), A ~ UV',
+     *   both stored transposed with rank padded, see LMFModel)
      * - 5 + modelLength: RMSE (root mean squared error)
      *
      * Intra-iteration components (updated in transition step):
-     *   modelLength = (rowDim + colDim) * maxRank
+     *   paddedRank = maxRank rounded up to LMFModel::kSIMDWidth
+     *   modelLength = (rowDim + colDim) * paddedRank
      * - 6 + modelLength: numRows (number of rows processed in this iteration)
      * - 7 + modelLength: loss (sum of squared errors)
      * - 8 + modelLength: incrModel (volatile model for incrementally update)
@@ -139,28 +143,30 @@ private:
         task.maxRank.rebind(&mStorage[2]);
         task.stepsize.rebind(&mStorage[3]);
         task.scaleFactor.rebind(&mStorage[4]);
-        task.model.matrixU.rebind(&mStorage[5], task.rowDim, task.maxRank);
-        task.model.matrixV.rebind(&mStorage[5 + task.rowDim * task.maxRank],
-                task.colDim, task.maxRank);
-        uint32_t modelLength = LMFModel<Handle>::arraySize(task.rowDim,
+        uint32_t paddedRank = LMFModel<Handle>::paddedRank(task.maxRank);
+        size_t lengthU = static_cast<size_t>(task.rowDim) * paddedRank;
+        size_t modelLength = LMFModel<Handle>::arraySize(task.rowDim,
                 task.colDim, task.maxRank);
+        task.model.matrixU.rebind(&mStorage[5], paddedRank, task.rowDim);
+        task.model.matrixV.rebind(&mStorage[5 + lengthU],
+                paddedRank, task.colDim);
         task.RMSE.rebind(&mStorage[5 + modelLength]);
 
         algo.numRows.rebind(&mStorage[6 + modelLength]);
         algo.loss.rebind(&mStorage[7 + modelLength]);
         algo.incrModel.matrixU.rebind(&mStorage[8 + modelLength],
-                task.rowDim, task.maxRank);
-        algo.incrModel.matrixV.rebind(&mStorage[8 + modelLength +
-                task.rowDim * task.maxRank], task.colDim, task.maxRank);
+                paddedRank, task.rowDim);
+        algo.incrModel.matrixV.rebind(&mStorage[8 + modelLength + lengthU],
+                paddedRank, task.colDim);
     }
 
     Handle mStorage;
 
 public:
     struct TaskState {
-        typename HandleTraits<Handle>::ReferenceToUInt16 rowDim;
-        typename HandleTraits<Handle>::ReferenceToUInt16 colDim;
-        typename HandleTraits<Handle>::ReferenceToUInt16 maxRank;
+        typename HandleTraits<Handle>::ReferenceToUInt32 rowDim;
+        typename HandleTraits<Handle>::ReferenceToUInt32 colDim;
+        typename HandleTraits<Handle>::ReferenceToUInt32 maxRank;
         typename HandleTraits<Handle>::ReferenceToDouble stepsize;
         typename HandleTraits<Handle>::ReferenceToDouble scaleFactor;
         LMFModel<Handle> model;
@@ -186,7 +192,7 @@ public:
  * object containing scalars and vectors.
  *
  * Note: We assume that the DOUBLE PRECISION array is initialized by the
- * database with length at least 5, and at least first elemenet is 0
+ * database with length at least 7, and at least first 3 elemenets are 0
  * (exact values of other elements are ignored).
  *
  */
@@ -213,12 +219,16 @@ public:
     /**
      * @brief Allocating the incremental gradient state.
      */
-    inline void allocate(const Allocator &inAllocator, uint32_t inDimension) {
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension,
+            uint32_t inBatchSize = 1) {
         mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
-                dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inDimension));
+                dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inDimension, inBatchSize));
 
         task.dimension.rebind(&mStorage[0]);
         task.dimension = inDimension;
+        task.batchSize.rebind(&mStorage[2]);
+        task.batchSize = inBatchSize;
         
         rebind();
     }
@@ -241,11 +251,111 @@ public:
     inline void reset() {
         algo.numRows = 0;
         algo.loss = 0.;
+        algo.numBuffered = 0;
         algo.incrModel = task.model;
     }
 
-    static inline uint32_t arraySize(const uint32_t inDimension) {
-        return 4 + 2 * inDimension;
+    /**
+     * @brief Number of tuples the mini-batch buffer can hold
+     *
+     * A batch size of 1 (or 0) means plain incremental gradient, in which
+     * case no buffer is needed.
+     */
+    static inline uint32_t bufferSize(const uint32_t inBatchSize) {
+        return inBatchSize > 1 ? inBatchSize : 0;
+    }
+
+    static inline uint32_t arraySize(const uint32_t inDimension,
+            const uint32_t inBatchSize = 1) {
+        return 6 + 2 * inDimension
+            + (inDimension + 1) * bufferSize(inBatchSize);
+    }
+
+    /**
+     * @brief Whether the array is a compact encoding (see compact())
+     */
+    static inline bool isCompact(const ArrayHandle<double> &inArray) {
+        if (inArray.size() < 3)
+            return false;
+
+        uint32_t dimension = static_cast<uint32_t>(inArray[0]);
+        uint32_t batchSize = static_cast<uint32_t>(inArray[2]);
+        return dimension > 0
+            && inArray.size() < arraySize(dimension, batchSize);
+    }
+
+    /**
+     * @brief Encode the intra-iteration model as a sparse change of the model
+     *
+     * With sparse independent variables, the tuples of a segment only change
+     * few coordinates of incrModel. The compact encoding is meant for
+     * shipping a state between nodes. Its layout:
+     * - 0 to 5 + dimension: same as in the dense state
+     * - 6 + dimension: numChanged (number of coordinates of incrModel
+     *   different from model)
+     * - 7 + dimension: indices of these coordinates
+     * - 7 + dimension + numChanged: their values in incrModel
+     *
+     * The mini-batch buffer must be empty. If the encoding would not be
+     * smaller, the dense state is returned as is.
+     */
+    inline AnyType compact(const Allocator &inAllocator) const {
+        madlib_assert(algo.numBuffered == 0,
+            std::logic_error("Buffered tuples must be applied before "
+                "encoding a state."));
+
+        uint32_t numChanged = 0;
+        for (uint32_t i = 0; i < task.dimension; ++i)
+            if (algo.incrModel(i) != task.model(i))
+                ++numChanged;
+
+        size_t size = 7 + task.dimension + 2 * static_cast<size_t>(numChanged);
+        if (size >= mStorage.size())
+            return mStorage;
+
+        MutableArrayHandle<double> result = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(size);
+        std::copy(mStorage.ptr(), mStorage.ptr() + 6 + task.dimension,
+            result.ptr());
+        result[6 + task.dimension] = numChanged;
+        size_t k = 7 + task.dimension;
+        for (uint32_t i = 0; i < task.dimension; ++i) {
+            if (algo.incrModel(i) != task.model(i)) {
+                result[k] = i;
+                result[k + numChanged] = algo.incrModel(i);
+                ++k;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Decode a compact encoding into a dense state
+     */
+    static inline MutableArrayHandle<double> expand(
+            const Allocator &inAllocator, const ArrayHandle<double> &inArray) {
+
+        uint32_t dimension = static_cast<uint32_t>(inArray[0]);
+        uint32_t numChanged = static_cast<uint32_t>(inArray[6 + dimension]);
+        if (inArray.size() != 7 + dimension
+                + 2 * static_cast<size_t>(numChanged))
+            throw std::invalid_argument("Invalid compact state.");
+
+        MutableArrayHandle<double> result = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(dimension, static_cast<uint32_t>(inArray[2])));
+        std::copy(inArray.ptr(), inArray.ptr() + 6 + dimension, result.ptr());
+        // incrModel starts as a copy of model
+        std::copy(inArray.ptr() + 3, inArray.ptr() + 3 + dimension,
+            result.ptr() + 6 + dimension);
+        const double *indices = inArray.ptr() + 7 + dimension;
+        for (uint32_t k = 0; k < numChanged; ++k) {
+            uint32_t i = static_cast<uint32_t>(indices[k]);
+            if (i >= dimension)
+                throw std::invalid_argument("Invalid compact state.");
+            result[6 + dimension + i] = indices[k + numChanged];
+        }
+        return result;
     }
 
 protected:
@@ -256,21 +366,38 @@ protected:
      * Inter-iteration components (updated in final function):
      * - 0: dimension (dimension of the model)
      * - 1: stepsize (step size of gradient steps)
-     * - 2: model (coefficients)
+     * - 2: batchSize (number of tuples per gradient step)
+     * - 3: model (coefficients)
      *
      * Intra-iteration components (updated in transition step):
-     * - 2 + dimension: numRows (number of rows processed in this iteration)
-     * - 3 + dimension: loss (sum of loss for each rows)
-     * - 4 + dimension: incrModel (volatile model for incrementally update)
+     *   bufferSize = (batchSize > 1 ? batchSize : 0)
+     * - 3 + dimension: numRows (number of rows processed in this iteration)
+     * - 4 + dimension: loss (sum of loss for each rows)
+     * - 5 + dimension: numBuffered (number of tuples in the mini-batch buffer)
+     * - 6 + dimension: incrModel (volatile model for incrementally update)
+     * - 6 + 2 * dimension: batchIndVar (buffered independent variables,
+     *   dimension x bufferSize)
+     * - 6 + (2 + bufferSize) * dimension: batchDepVar (buffered dependent
+     *   variables)
      */
     void rebind() {
         task.dimension.rebind(&mStorage[0]);
         task.stepsize.rebind(&mStorage[1]);
-        task.model.rebind(&mStorage[2], task.dimension);
+        task.batchSize.rebind(&mStorage[2]);
+        task.model.rebind(&mStorage[3], task.dimension);
+
+        algo.numRows.rebind(&mStorage[3 + task.dimension]);
+        algo.loss.rebind(&mStorage[4 + task.dimension]);
+        algo.numBuffered.rebind(&mStorage[5 + task.dimension]);
+        algo.incrModel.rebind(&mStorage[6 + task.dimension], task.dimension);
 
-        algo.numRows.rebind(&mStorage[2 + task.dimension]);
-        algo.loss.rebind(&mStorage[3 + task.dimension]);
-        algo.incrModel.rebind(&mStorage[4 + task.dimension], task.dimension);
+        uint32_t batchLength = bufferSize(task.batchSize);
+        if (batchLength > 0) {
+            algo.batchIndVar.rebind(&mStorage[6 + 2 * task.dimension],
+                    task.dimension, batchLength);
+            algo.batchDepVar.rebind(&mStorage[6 + (2 + batchLength)
+                    * task.dimension], batchLength);
+        }
     }
 
     Handle mStorage;
@@ -279,24 +406,43 @@ public:
     struct TaskState {
         typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
         typename HandleTraits<Handle>::ReferenceToDouble stepsize;
+        typename HandleTraits<Handle>::ReferenceToUInt32 batchSize;
         typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap model;
     } task;
 
     struct AlgoState {
         typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
         typename HandleTraits<Handle>::ReferenceToDouble loss;
+        typename HandleTraits<Handle>::ReferenceToUInt32 numBuffered;
         typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
             incrModel;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap batchIndVar;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+            batchDepVar;
     } algo;
 };
 
+/**
+ * @brief Inter- (Task State) and intra-iteration (Algo State) state of
+ *        incremental gradient descent with per-coordinate step sizes for
+ *        generalized linear models
+ *
+ * The method is AdaGrad (method = 0) or Adam (method = 1), see AdaptiveIGD.
+ * The accumulators of the step sizes (for AdaGrad, the sum of squared
+ * gradients; for Adam, the moving averages of the gradient and its square)
+ * are carried over from one iteration to the next, like the model.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 11, and all elemenets are 0.
+ */
 template <class Handle>
-class RegularizedGLMIGDState {
+class GLMAdaptiveIGDState {
     template <class OtherHandle>
-    friend class RegularizedGLMIGDState;
+    friend class GLMAdaptiveIGDState;
 
 public:
-    RegularizedGLMIGDState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
+    GLMAdaptiveIGDState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
         rebind();
     }
 
@@ -319,7 +465,7 @@ public:
 
         task.dimension.rebind(&mStorage[0]);
         task.dimension = inDimension;
-        
+
         rebind();
     }
 
@@ -327,7 +473,8 @@ public:
      * @brief We need to support assigning the previous state
      */
     template <class OtherHandle>
-    RegularizedGLMIGDState &operator=(const RegularizedGLMIGDState<OtherHandle> &inOtherState) {
+    GLMAdaptiveIGDState &operator=(
+            const GLMAdaptiveIGDState<OtherHandle> &inOtherState) {
         for (size_t i = 0; i < mStorage.size(); i++) {
             mStorage[i] = inOtherState.mStorage[i];
         }
@@ -341,11 +488,14 @@ public:
     inline void reset() {
         algo.numRows = 0;
         algo.loss = 0.;
+        algo.incrNumSteps = task.numSteps;
         algo.incrModel = task.model;
+        algo.incrAccum = task.accum;
+        algo.incrMoment = task.moment;
     }
 
     static inline uint32_t arraySize(const uint32_t inDimension) {
-        return 6 + 3 * inDimension;
+        return 10 + 6 * inDimension;
     }
 
 protected:
@@ -355,28 +505,48 @@ protected:
      * Array layout (iteration refers to one aggregate-function call):
      * Inter-iteration components (updated in final function):
      * - 0: dimension (dimension of the model)
-     * - 1: stepsize (step size of gradient steps)
-     * - 2: lambda (regularization term)
-     * - 3: totalRows (needed for amortizing lambda)
-     * - 4: model (coefficients)
+     * - 1: stepsize (base step size)
+     * - 2: method (0 for AdaGrad, 1 for Adam)
+     * - 3: beta1 (Adam: decay of the moving average of the gradient)
+     * - 4: beta2 (Adam: decay of the moving average of the squared gradient)
+     * - 5: epsilon (added to the denominator of the step sizes)
+     * - 6: numSteps (number of gradient steps taken so far)
+     * - 7: model (coefficients)
+     * - 7 + dimension: accum (AdaGrad: sum of squared gradients; Adam:
+     *   moving average of the squared gradient)
+     * - 7 + 2 * dimension: moment (Adam: moving average of the gradient)
      *
      * Intra-iteration components (updated in transition step):
-     * - 4 + dimension: numRows (number of rows processed in this iteration)
-     * - 5 + dimension: loss (sum of loss for each rows)
-     * - 6 + dimension: incrModel (volatile model for incrementally update)
-     * - 6 + 2 * dimension: gradient (volatile temp variable to have model type)
+     * - 7 + 3 * dimension: numRows (number of rows processed in this
+     *   iteration)
+     * - 8 + 3 * dimension: loss (sum of loss for each rows)
+     * - 9 + 3 * dimension: incrNumSteps (volatile numSteps)
+     * - 10 + 3 * dimension: incrModel (volatile model for incrementally
+     *   update)
+     * - 10 + 4 * dimension: incrAccum (volatile accum)
+     * - 10 + 5 * dimension: incrMoment (volatile moment)
      */
     void rebind() {
         task.dimension.rebind(&mStorage[0]);
         task.stepsize.rebind(&mStorage[1]);
-        task.lambda.rebind(&mStorage[2]);
-        task.totalRows.rebind(&mStorage[3]);
-        task.model.rebind(&mStorage[4], task.dimension);
-
-        algo.numRows.rebind(&mStorage[4 + task.dimension]);
-        algo.loss.rebind(&mStorage[5 + task.dimension]);
-        algo.incrModel.rebind(&mStorage[6 + task.dimension], task.dimension);
-        algo.gradient.rebind(&mStorage[6 + 2 * task.dimension], task.dimension);
+        task.method.rebind(&mStorage[2]);
+        task.beta1.rebind(&mStorage[3]);
+        task.beta2.rebind(&mStorage[4]);
+        task.epsilon.rebind(&mStorage[5]);
+        task.numSteps.rebind(&mStorage[6]);
+        task.model.rebind(&mStorage[7], task.dimension);
+        task.accum.rebind(&mStorage[7 + task.dimension], task.dimension);
+        task.moment.rebind(&mStorage[7 + 2 * task.dimension], task.dimension);
+
+        algo.numRows.rebind(&mStorage[7 + 3 * task.dimension]);
+        algo.loss.rebind(&mStorage[8 + 3 * task.dimension]);
+        algo.incrNumSteps.rebind(&mStorage[9 + 3 * task.dimension]);
+        algo.incrModel.rebind(&mStorage[10 + 3 * task.dimension],
+                task.dimension);
+        algo.incrAccum.rebind(&mStorage[10 + 4 * task.dimension],
+                task.dimension);
+        algo.incrMoment.rebind(&mStorage[10 + 5 * task.dimension],
+                task.dimension);
     }
 
     Handle mStorage;
@@ -385,44 +555,230 @@ public:
     struct TaskState {
         typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
         typename HandleTraits<Handle>::ReferenceToDouble stepsize;
-        typename HandleTraits<Handle>::ReferenceToDouble lambda;
-        typename HandleTraits<Handle>::ReferenceToUInt64 totalRows;
+        typename HandleTraits<Handle>::ReferenceToUInt16 method;
+        typename HandleTraits<Handle>::ReferenceToDouble beta1;
+        typename HandleTraits<Handle>::ReferenceToDouble beta2;
+        typename HandleTraits<Handle>::ReferenceToDouble epsilon;
+        typename HandleTraits<Handle>::ReferenceToUInt64 numSteps;
         typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap model;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap accum;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap moment;
     } task;
 
     struct AlgoState {
         typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
         typename HandleTraits<Handle>::ReferenceToDouble loss;
+        typename HandleTraits<Handle>::ReferenceToUInt64 incrNumSteps;
         typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
             incrModel;
         typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
-            gradient;
+            incrAccum;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+            incrMoment;
     } algo;
 };
 
 /**
- * @brief Inter- (Task State) and intra-iteration (Algo State) state of
- *        Conjugate Gradient for generalized linear models
- * 
- * Generalized Linear Models (GLMs): Logistic regression, Linear SVM
+ * @brief Transition state of incremental gradient descent over a buffered
+ *        shard of tuples, for generalized linear models
  *
- * TransitionState encapsualtes the transition state during the
- * aggregate function during an iteration. To the database, the state is
- * exposed as a single DOUBLE PRECISION array, to the C++ code it is a proper
- * object containing scalars and vectors.
+ * Instead of taking a gradient step per tuple, the transition function only
+ * appends the tuple to a buffer in the state. The final function then takes
+ * numEpochs passes over the buffer, each in a different random order, and
+ * returns a GLMIGDState. This way, one scan of a shard that fits into memory
+ * makes the progress of several iterations. The capacity of the buffer is
+ * doubled whenever it is exhausted.
  *
  * Note: We assume that the DOUBLE PRECISION array is initialized by the
- * database with length at least 5, and at least first elemenet is 0
- * (exact values of other elements are ignored).
+ * database with length 6, and all elemenets are 0.
+ */
+template <class Handle>
+class GLMIGDShardState {
+    template <class OtherHandle>
+    friend class GLMIGDShardState;
+
+public:
+    GLMIGDShardState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocating the state, with an empty buffer
+     */
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension,
+            uint32_t inCapacity) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+                dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inDimension, inCapacity));
+
+        task.dimension.rebind(&mStorage[0]);
+        task.dimension = inDimension;
+        mStorage[5 + inDimension] = inCapacity;
+
+        rebind();
+    }
+
+    /**
+     * @brief Make sure that inNumNewTuples more tuples can be appended
+     */
+    void reserve(const Allocator &inAllocator, uint64_t inNumNewTuples) {
+        uint64_t required = static_cast<uint64_t>(algo.numRows)
+            + inNumNewTuples;
+        if (required <= algo.capacity)
+            return;
+
+        uint64_t cap = std::max<uint64_t>(algo.capacity, 16);
+        while (cap < required)
+            cap *= 2;
+        // Arrays (and memory allocations) are limited to 1 GB by the backend
+        if (cap > std::numeric_limits<uint32_t>::max()
+                || arraySize(task.dimension, cap) * sizeof(double)
+                    >= (static_cast<uint64_t>(1) << 30))
+            throw std::runtime_error("The tuples of a shard do not fit into "
+                "the transition state. Use more shards.");
+
+        // Save our current state, so we can subsequently restore it with the
+        // new storage
+        GLMIGDShardState oldSelf = *this;
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(oldSelf.task.dimension, cap));
+        std::copy(oldSelf.mStorage.ptr(), oldSelf.mStorage.ptr()
+            + arraySize(oldSelf.task.dimension, oldSelf.algo.numRows),
+            mStorage.ptr());
+        mStorage[5 + oldSelf.task.dimension] = static_cast<double>(cap);
+        rebind();
+    }
+
+    /**
+     * @brief Append a tuple. The caller has to reserve() space beforehand.
+     */
+    template <class IndependentVariables>
+    void append(const IndependentVariables &inIndVar, double inDepVar) {
+        madlib_assert(algo.numRows < algo.capacity,
+            std::logic_error("Buffer of the shard state is full."));
+        double *slot = algo.tuples + tupleSize() * algo.numRows;
+        slot[0] = inDepVar;
+        for (uint32_t i = 0; i < task.dimension; ++i)
+            slot[1 + i] = inIndVar(i);
+        algo.numRows = algo.numRows + 1;
+    }
+
+    /**
+     * @brief Append all tuples of another state. The caller has to reserve()
+     *     space beforehand.
+     */
+    template <class OtherHandle>
+    void append(const GLMIGDShardState<OtherHandle> &inOtherState) {
+        madlib_assert(static_cast<uint64_t>(algo.numRows)
+                + inOtherState.algo.numRows <= algo.capacity,
+            std::logic_error("Buffer of the shard state is full."));
+        std::copy(inOtherState.algo.tuples, inOtherState.algo.tuples
+            + tupleSize() * inOtherState.algo.numRows,
+            algo.tuples + tupleSize() * algo.numRows);
+        algo.numRows = algo.numRows + inOtherState.algo.numRows;
+    }
+
+    /**
+     * @brief Number of array elements per buffered tuple: the dependent
+     *     variable, followed by the independent variables
+     */
+    inline uint32_t tupleSize() const {
+        return task.dimension + 1;
+    }
+
+    static inline uint64_t arraySize(const uint32_t inDimension,
+            const uint64_t inCapacity) {
+        return 6 + inDimension
+            + (static_cast<uint64_t>(inDimension) + 1) * inCapacity;
+    }
+
+protected:
+    /**
+     * @brief Rebind to a new storage array.
+     *
+     * Array layout:
+     * Inter-iteration components (set by the first transition):
+     * - 0: dimension (dimension of the model)
+     * - 1: stepsize (step size of gradient steps)
+     * - 2: numEpochs (number of passes over the buffer)
+     * - 3: seed (seed for the order of the passes)
+     * - 4: model (coefficients at the beginning of this iteration)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 4 + dimension: numRows (number of buffered tuples)
+     * - 5 + dimension: capacity (number of tuples the buffer can hold)
+     * - 6 + dimension: tuples (numRows tuples of size dimension + 1, see
+     *   tupleSize())
+     */
+    void rebind() {
+        task.dimension.rebind(&mStorage[0]);
+        uint32_t dimension = task.dimension;
+        madlib_assert(mStorage.size() >= arraySize(dimension,
+                static_cast<uint64_t>(mStorage[5 + dimension])),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        task.stepsize.rebind(&mStorage[1]);
+        task.numEpochs.rebind(&mStorage[2]);
+        task.seed.rebind(&mStorage[3]);
+        task.model.rebind(&mStorage[4], dimension);
+
+        algo.numRows.rebind(&mStorage[4 + dimension]);
+        algo.capacity.rebind(&mStorage[5 + dimension]);
+        algo.tuples = mStorage.ptr() + 6 + dimension;
+    }
+
+    Handle mStorage;
+
+public:
+    struct TaskState {
+        typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+        typename HandleTraits<Handle>::ReferenceToDouble stepsize;
+        typename HandleTraits<Handle>::ReferenceToUInt32 numEpochs;
+        typename HandleTraits<Handle>::ReferenceToDouble seed;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap model;
+    } task;
+
+    struct AlgoState {
+        typename HandleTraits<Handle>::ReferenceToUInt32 numRows;
+        typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+        typename HandleTraits<Handle>::DoublePtr tuples;
+    } algo;
+};
+
+
+/**
+ * @brief Inter- (Task State) and intra-iteration (Algo State) state of
+ *        incremental gradient descent for a bundle of generalized linear
+ *        models
  *
+ * The bundle trains numModels models of the same dimension on the same
+ * tuples, each with its own step size. The models are stored as the columns
+ * of a dimension x numModels matrix, so that one pass over the data (and one
+ * decoding of each tuple) suffices for all of them.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 4, and all elemenets are 0.
  */
 template <class Handle>
-class GLMCGState {
+class GLMIGDBundleState {
     template <class OtherHandle>
-    friend class GLMCGState;
+    friend class GLMIGDBundleState;
 
 public:
-    GLMCGState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
+    GLMIGDBundleState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
         rebind();
     }
 
@@ -439,13 +795,17 @@ public:
     /**
      * @brief Allocating the incremental gradient state.
      */
-    inline void allocate(const Allocator &inAllocator, uint32_t inDimension) {
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension,
+            uint32_t inNumModels) {
         mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
-                dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inDimension));
+                dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inDimension, inNumModels));
 
         task.dimension.rebind(&mStorage[0]);
         task.dimension = inDimension;
-        
+        task.numModels.rebind(&mStorage[1]);
+        task.numModels = inNumModels;
+
         rebind();
     }
 
@@ -453,7 +813,8 @@ public:
      * @brief We need to support assigning the previous state
      */
     template <class OtherHandle>
-    GLMCGState &operator=(const GLMCGState<OtherHandle> &inOtherState) {
+    GLMIGDBundleState &operator=(
+            const GLMIGDBundleState<OtherHandle> &inOtherState) {
         for (size_t i = 0; i < mStorage.size(); i++) {
             mStorage[i] = inOtherState.mStorage[i];
         }
@@ -466,92 +827,89 @@ public:
      */
     inline void reset() {
         algo.numRows = 0;
-        algo.loss = 0.;
-        algo.incrGradient = ColumnVector::Zero(task.dimension);
+        algo.loss.fill(0);
+        algo.incrModel = task.model;
     }
 
-    static inline uint32_t arraySize(const uint32_t inDimension) {
-        return 5 + 4 * inDimension;
+    static inline uint64_t arraySize(const uint32_t inDimension,
+            const uint32_t inNumModels) {
+        return 3 + 2 * static_cast<uint64_t>(inNumModels)
+            + 2 * static_cast<uint64_t>(inDimension) * inNumModels;
     }
 
-private:
+protected:
     /**
      * @brief Rebind to a new storage array.
      *
      * Array layout (iteration refers to one aggregate-function call):
      * Inter-iteration components (updated in final function):
-     * - 0: dimension (dimension of the model)
-     * - 1: iteration (current number of iterations executed)
-     * - 2: stepsize (step size of gradient steps)
-     * - 3: model (coefficients)
-     * - 3 + dimension: direction (conjugate direction)
-     * - 3 + 2 * dimension: gradient (gradient of loss functions)
+     *   modelLength = dimension * numModels
+     * - 0: dimension (dimension of each model)
+     * - 1: numModels (number of models in the bundle)
+     * - 2: stepsize (step sizes, one per model)
+     * - 2 + numModels: model (coefficients, dimension x numModels)
      *
      * Intra-iteration components (updated in transition step):
-     * - 3 + 3 * dimension: numRows (number of rows processed in this iteration)
-     * - 4 + 3 * dimension: loss (sum of loss for each rows)
-     * - 5 + 3 * dimension: incrGradient (volatile gradient for update)
+     * - 2 + numModels + modelLength: numRows (number of rows processed in
+     *   this iteration)
+     * - 3 + numModels + modelLength: loss (sum of loss for each row, one per
+     *   model)
+     * - 3 + 2 * numModels + modelLength: incrModel (volatile models for
+     *   incrementally update, dimension x numModels)
      */
     void rebind() {
         task.dimension.rebind(&mStorage[0]);
-        task.iteration.rebind(&mStorage[1]);
-        task.stepsize.rebind(&mStorage[2]);
-        task.model.rebind(&mStorage[3], task.dimension);
-        task.direction.rebind(&mStorage[3 + task.dimension], task.dimension);
-        task.gradient.rebind(&mStorage[3 + 2 * task.dimension], task.dimension);
-
-        algo.numRows.rebind(&mStorage[3 + 3 * task.dimension]);
-        algo.loss.rebind(&mStorage[4 + 3 * task.dimension]);
-        algo.incrGradient.rebind(&mStorage[5 + 3 * task.dimension],
-                task.dimension);
+        task.numModels.rebind(&mStorage[1]);
+        size_t numModels = task.numModels;
+        size_t modelLength = static_cast<size_t>(task.dimension) * numModels;
+        task.stepsize.rebind(&mStorage[2], task.numModels);
+        task.model.rebind(&mStorage[2 + numModels], task.dimension,
+                task.numModels);
+
+        algo.numRows.rebind(&mStorage[2 + numModels + modelLength]);
+        algo.loss.rebind(&mStorage[3 + numModels + modelLength],
+                task.numModels);
+        algo.incrModel.rebind(&mStorage[3 + 2 * numModels + modelLength],
+                task.dimension, task.numModels);
     }
 
     Handle mStorage;
 
 public:
-    typedef typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
-        TransparentColumnVector;
-
     struct TaskState {
         typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
-        typename HandleTraits<Handle>::ReferenceToUInt32 iteration;
-        typename HandleTraits<Handle>::ReferenceToDouble stepsize;
-        TransparentColumnVector model;
-        TransparentColumnVector direction;
-        TransparentColumnVector gradient;
+        typename HandleTraits<Handle>::ReferenceToUInt32 numModels;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+            stepsize;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap model;
     } task;
 
     struct AlgoState {
         typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
-        typename HandleTraits<Handle>::ReferenceToDouble loss;
-        TransparentColumnVector incrGradient;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap loss;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap incrModel;
     } algo;
 };
 
 /**
  * @brief Inter- (Task State) and intra-iteration (Algo State) state of
- *        Newton's method for generic objective functions (any tasks)
+ *        consensus ADMM for generalized linear models
  *
- * This class assumes that the coefficients are of type vector. Low-rank 
- * matrix factorization, neural networks would not be able to use this.
- * 
- * TransitionState encapsualtes the transition state during the
- * aggregate function during an iteration. To the database, the state is
- * exposed as a single DOUBLE PRECISION array, to the C++ code it is a proper
- * object containing scalars and vectors.
+ * The rows are split into numBlocks blocks. Each block k has a local model
+ * \f$ x_k \f$ and a scaled dual variable \f$ u_k \f$, and all blocks agree on
+ * the consensus model \f$ z \f$ (see ADMM). Local models and dual variables
+ * are stored as the columns of dimension x numBlocks matrices.
  *
  * Note: We assume that the DOUBLE PRECISION array is initialized by the
- * database with length at least 5, and at least first elemenet is 0
- * (exact values of other elements are ignored).
- *
+ * database with length at least 9, and all elemenets are 0.
  */
 template <class Handle>
-class GLMNewtonState {
+class GLMADMMState {
     template <class OtherHandle>
-    friend class GLMNewtonState;
+    friend class GLMADMMState;
 
 public:
-    GLMNewtonState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
+    GLMADMMState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
         rebind();
     }
 
@@ -566,15 +924,19 @@ public:
     }
 
     /**
-     * @brief Allocating the incremental gradient state.
+     * @brief Allocating the ADMM state.
      */
-    inline void allocate(const Allocator &inAllocator, uint16_t inDimension) {
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension,
+            uint32_t inNumBlocks) {
         mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
-                dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inDimension));
+                dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inDimension, inNumBlocks));
 
         task.dimension.rebind(&mStorage[0]);
         task.dimension = inDimension;
-        
+        task.numBlocks.rebind(&mStorage[1]);
+        task.numBlocks = inNumBlocks;
+
         rebind();
     }
 
@@ -582,7 +944,7 @@ public:
      * @brief We need to support assigning the previous state
      */
     template <class OtherHandle>
-    GLMNewtonState &operator=(const GLMNewtonState<OtherHandle> &inOtherState) {
+    GLMADMMState &operator=(const GLMADMMState<OtherHandle> &inOtherState) {
         for (size_t i = 0; i < mStorage.size(); i++) {
             mStorage[i] = inOtherState.mStorage[i];
         }
@@ -592,60 +954,1088 @@ public:
 
     /**
      * @brief Reset the intra-iteration fields.
+     *
+     * The local subproblems are warm-started from the local models of the
+     * last iteration.
      */
     inline void reset() {
         algo.numRows = 0;
         algo.loss = 0.;
-        algo.gradient = ColumnVector::Zero(task.dimension);
-        algo.hessian = Matrix::Zero(task.dimension, task.dimension);
+        algo.blockRows.fill(0);
+        algo.incrModel = task.localModel;
     }
 
-    static inline uint32_t arraySize(const uint16_t inDimension) {
-        return 3 + (inDimension + 2) * inDimension;
+    static inline uint64_t arraySize(const uint32_t inDimension,
+            const uint32_t inNumBlocks) {
+        return 8 + inDimension + 2 * static_cast<uint64_t>(inNumBlocks)
+            + 3 * static_cast<uint64_t>(inDimension) * inNumBlocks;
     }
 
-private:
+protected:
     /**
      * @brief Rebind to a new storage array.
      *
      * Array layout (iteration refers to one aggregate-function call):
      * Inter-iteration components (updated in final function):
+     *   blockLength = dimension * numBlocks
      * - 0: dimension (dimension of the model)
-     * - 1: model (coefficients)
+     * - 1: numBlocks (number of blocks of rows)
+     * - 2: stepsize (step size of gradient steps)
+     * - 3: rho (penalty parameter of the augmented Lagrangian)
+     * - 4: primalResidual (norm of the disagreement of the local models)
+     * - 5: dualResidual (norm of the change of the consensus model)
+     * - 6: model (consensus model z)
+     * - 6 + dimension: localModel (local models x, dimension x numBlocks)
+     * - 6 + dimension + blockLength: dual (scaled dual variables u,
+     *   dimension x numBlocks)
+     * - 6 + dimension + 2 * blockLength: lastBlockRows (number of rows per
+     *   block in the last iteration)
      *
      * Intra-iteration components (updated in transition step):
-     * - 1 + dimension: numRows (number of rows processed in this iteration)
-     * - 2 + dimension: loss (sum of loss for each rows)
-     * - 3 + dimension: gradient (volatile gradient for update)
-     * - 3 + 2 * dimension: hessian (volatile hessian for update)
+     * - 6 + dimension + 2 * blockLength + numBlocks: numRows (number of rows
+     *   processed in this iteration)
+     * - 7 + dimension + 2 * blockLength + numBlocks: loss (sum of loss for
+     *   each rows)
+     * - 8 + dimension + 2 * blockLength + numBlocks: blockRows (number of
+     *   rows processed per block in this iteration)
+     * - 8 + dimension + 2 * blockLength + 2 * numBlocks: incrModel (volatile
+     *   local models for incrementally update, dimension x numBlocks)
      */
     void rebind() {
         task.dimension.rebind(&mStorage[0]);
-        task.model.rebind(&mStorage[1], task.dimension);
-
-        algo.numRows.rebind(&mStorage[1 + task.dimension]);
-        algo.loss.rebind(&mStorage[2 + task.dimension]);
-        algo.gradient.rebind(&mStorage[3 + task.dimension], task.dimension);
-        algo.hessian.rebind(&mStorage[3 + 2 * task.dimension], task.dimension,
-                task.dimension);
+        task.numBlocks.rebind(&mStorage[1]);
+        size_t dimension = task.dimension;
+        size_t numBlocks = task.numBlocks;
+        size_t blockLength = dimension * numBlocks;
+        task.stepsize.rebind(&mStorage[2]);
+        task.rho.rebind(&mStorage[3]);
+        task.primalResidual.rebind(&mStorage[4]);
+        task.dualResidual.rebind(&mStorage[5]);
+        task.model.rebind(&mStorage[6], task.dimension);
+        task.localModel.rebind(&mStorage[6 + dimension], task.dimension,
+                task.numBlocks);
+        task.dual.rebind(&mStorage[6 + dimension + blockLength],
+                task.dimension, task.numBlocks);
+        task.lastBlockRows.rebind(&mStorage[6 + dimension + 2 * blockLength],
+                task.numBlocks);
+
+        size_t algoBegin = 6 + dimension + 2 * blockLength + numBlocks;
+        algo.numRows.rebind(&mStorage[algoBegin]);
+        algo.loss.rebind(&mStorage[algoBegin + 1]);
+        algo.blockRows.rebind(&mStorage[algoBegin + 2], task.numBlocks);
+        algo.incrModel.rebind(&mStorage[algoBegin + 2 + numBlocks],
+                task.dimension, task.numBlocks);
     }
 
     Handle mStorage;
 
 public:
     struct TaskState {
-        typename HandleTraits<Handle>::ReferenceToUInt16 dimension;
+        typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+        typename HandleTraits<Handle>::ReferenceToUInt32 numBlocks;
+        typename HandleTraits<Handle>::ReferenceToDouble stepsize;
+        typename HandleTraits<Handle>::ReferenceToDouble rho;
+        typename HandleTraits<Handle>::ReferenceToDouble primalResidual;
+        typename HandleTraits<Handle>::ReferenceToDouble dualResidual;
         typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap model;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap localModel;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap dual;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+            lastBlockRows;
     } task;
 
     struct AlgoState {
         typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
         typename HandleTraits<Handle>::ReferenceToDouble loss;
-        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap gradient;
-        typename HandleTraits<Handle>::MatrixTransparentHandleMap hessian;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+            blockRows;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap incrModel;
     } algo;
 };
 
+template <class Handle>
+class RegularizedGLMIGDState {
+    template <class OtherHandle>
+    friend class RegularizedGLMIGDState;
+
+public:
+    RegularizedGLMIGDState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocating the incremental gradient state.
+     */
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension,
+            uint32_t inBatchSize = 1) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+                dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inDimension, inBatchSize));
+
+        task.dimension.rebind(&mStorage[0]);
+        task.dimension = inDimension;
+        task.batchSize.rebind(&mStorage[4]);
+        task.batchSize = inBatchSize;
+        
+        rebind();
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    RegularizedGLMIGDState &operator=(const RegularizedGLMIGDState<OtherHandle> &inOtherState) {
+        for (size_t i = 0; i < mStorage.size(); i++) {
+            mStorage[i] = inOtherState.mStorage[i];
+        }
+
+        return *this;
+    }
+
+    /**
+     * @brief Reset the intra-iteration fields.
+     */
+    inline void reset() {
+        algo.numRows = 0;
+        algo.loss = 0.;
+        algo.numBuffered = 0;
+        algo.penalty = 0.;
+        algo.incrModel = task.model;
+        algo.gradient.setZero();
+    }
+
+    /**
+     * @brief Number of tuples the mini-batch buffer can hold
+     */
+    static inline uint32_t bufferSize(const uint32_t inBatchSize) {
+        return inBatchSize > 1 ? inBatchSize : 0;
+    }
+
+    static inline uint32_t arraySize(const uint32_t inDimension,
+            const uint32_t inBatchSize = 1) {
+        return 9 + 3 * inDimension
+            + (inDimension + 1) * bufferSize(inBatchSize);
+    }
+
+protected:
+    /**
+     * @brief Rebind to a new storage array.
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     * - 0: dimension (dimension of the model)
+     * - 1: stepsize (step size of gradient steps)
+     * - 2: lambda (regularization term)
+     * - 3: totalRows (needed for amortizing lambda)
+     * - 4: batchSize (number of tuples per gradient step)
+     * - 5: model (coefficients)
+     *
+     * Intra-iteration components (updated in transition step):
+     *   bufferSize = (batchSize > 1 ? batchSize : 0)
+     * - 5 + dimension: numRows (number of rows processed in this iteration)
+     * - 6 + dimension: loss (sum of loss for each rows)
+     * - 7 + dimension: numBuffered (number of tuples in the mini-batch buffer)
+     * - 8 + dimension: penalty (cumulative regularization penalty per
+     *   coefficient, only used by LazyRegularizedIGD)
+     * - 9 + dimension: incrModel (volatile model for incrementally update)
+     * - 9 + 2 * dimension: gradient (volatile temp variable to have model
+     *   type; LazyRegularizedIGD keeps the penalty applied so far to each
+     *   coefficient here)
+     * - 9 + 3 * dimension: batchIndVar (buffered independent variables,
+     *   dimension x bufferSize)
+     * - 9 + (3 + bufferSize) * dimension: batchDepVar (buffered dependent
+     *   variables)
+     */
+    void rebind() {
+        task.dimension.rebind(&mStorage[0]);
+        task.stepsize.rebind(&mStorage[1]);
+        task.lambda.rebind(&mStorage[2]);
+        task.totalRows.rebind(&mStorage[3]);
+        task.batchSize.rebind(&mStorage[4]);
+        task.model.rebind(&mStorage[5], task.dimension);
+
+        algo.numRows.rebind(&mStorage[5 + task.dimension]);
+        algo.loss.rebind(&mStorage[6 + task.dimension]);
+        algo.numBuffered.rebind(&mStorage[7 + task.dimension]);
+        algo.penalty.rebind(&mStorage[8 + task.dimension]);
+        algo.incrModel.rebind(&mStorage[9 + task.dimension], task.dimension);
+        algo.gradient.rebind(&mStorage[9 + 2 * task.dimension], task.dimension);
+
+        uint32_t batchLength = bufferSize(task.batchSize);
+        if (batchLength > 0) {
+            algo.batchIndVar.rebind(&mStorage[9 + 3 * task.dimension],
+                    task.dimension, batchLength);
+            algo.batchDepVar.rebind(&mStorage[9 + (3 + batchLength)
+                    * task.dimension], batchLength);
+        }
+    }
+
+    Handle mStorage;
+
+public:
+    struct TaskState {
+        typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+        typename HandleTraits<Handle>::ReferenceToDouble stepsize;
+        typename HandleTraits<Handle>::ReferenceToDouble lambda;
+        typename HandleTraits<Handle>::ReferenceToUInt64 totalRows;
+        typename HandleTraits<Handle>::ReferenceToUInt32 batchSize;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap model;
+    } task;
+
+    struct AlgoState {
+        typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+        typename HandleTraits<Handle>::ReferenceToDouble loss;
+        typename HandleTraits<Handle>::ReferenceToUInt32 numBuffered;
+        typename HandleTraits<Handle>::ReferenceToDouble penalty;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+            incrModel;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+            gradient;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap batchIndVar;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+            batchDepVar;
+    } algo;
+};
+
+/**
+ * @brief Inter- (Task State) and intra-iteration (Algo State) state of
+ *        Conjugate Gradient for generalized linear models
+ * 
+ * Generalized Linear Models (GLMs): Logistic regression, Linear SVM
+ *
+ * TransitionState encapsualtes the transition state during the
+ * aggregate function during an iteration. To the database, the state is
+ * exposed as a single DOUBLE PRECISION array, to the C++ code it is a proper
+ * object containing scalars and vectors.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 5, and at least first elemenet is 0
+ * (exact values of other elements are ignored).
+ *
+ */
+template <class Handle>
+class GLMCGState {
+    template <class OtherHandle>
+    friend class GLMCGState;
+
+public:
+    GLMCGState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocating the incremental gradient state.
+     */
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+                dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inDimension));
+
+        task.dimension.rebind(&mStorage[0]);
+        task.dimension = inDimension;
+        
+        rebind();
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    GLMCGState &operator=(const GLMCGState<OtherHandle> &inOtherState) {
+        for (size_t i = 0; i < mStorage.size(); i++) {
+            mStorage[i] = inOtherState.mStorage[i];
+        }
+
+        return *this;
+    }
+
+    /**
+     * @brief Reset the intra-iteration fields.
+     */
+    inline void reset() {
+        algo.numRows = 0;
+        algo.loss = 0.;
+        algo.incrGradient = ColumnVector::Zero(task.dimension);
+    }
+
+    static inline uint32_t arraySize(const uint32_t inDimension) {
+        return 5 + 4 * inDimension;
+    }
+
+private:
+    /**
+     * @brief Rebind to a new storage array.
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     * - 0: dimension (dimension of the model)
+     * - 1: iteration (current number of iterations executed)
+     * - 2: stepsize (step size of gradient steps)
+     * - 3: model (coefficients)
+     * - 3 + dimension: direction (conjugate direction)
+     * - 3 + 2 * dimension: gradient (gradient of loss functions)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 3 + 3 * dimension: numRows (number of rows processed in this iteration)
+     * - 4 + 3 * dimension: loss (sum of loss for each rows)
+     * - 5 + 3 * dimension: incrGradient (volatile gradient for update)
+     */
+    void rebind() {
+        task.dimension.rebind(&mStorage[0]);
+        task.iteration.rebind(&mStorage[1]);
+        task.stepsize.rebind(&mStorage[2]);
+        task.model.rebind(&mStorage[3], task.dimension);
+        task.direction.rebind(&mStorage[3 + task.dimension], task.dimension);
+        task.gradient.rebind(&mStorage[3 + 2 * task.dimension], task.dimension);
+
+        algo.numRows.rebind(&mStorage[3 + 3 * task.dimension]);
+        algo.loss.rebind(&mStorage[4 + 3 * task.dimension]);
+        algo.incrGradient.rebind(&mStorage[5 + 3 * task.dimension],
+                task.dimension);
+    }
+
+    Handle mStorage;
+
+public:
+    typedef typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+        TransparentColumnVector;
+
+    struct TaskState {
+        typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+        typename HandleTraits<Handle>::ReferenceToUInt32 iteration;
+        typename HandleTraits<Handle>::ReferenceToDouble stepsize;
+        TransparentColumnVector model;
+        TransparentColumnVector direction;
+        TransparentColumnVector gradient;
+    } task;
+
+    struct AlgoState {
+        typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+        typename HandleTraits<Handle>::ReferenceToDouble loss;
+        TransparentColumnVector incrGradient;
+    } algo;
+};
+
+/**
+ * @brief Inter- (Task State) and intra-iteration (Algo State) state of
+ *        conjugate gradient with a fused line search for generalized linear
+ *        models
+ *
+ * Along the search direction, numCandidates step sizes are tried in the same
+ * pass: For each candidate, the transition step accumulates the loss, its
+ * derivative along the direction, and the gradient. The first candidate is
+ * always the step size 0, i.e., the current model.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 7, and all elemenets are 0.
+ */
+template <class Handle>
+class GLMCGLineSearchState {
+    template <class OtherHandle>
+    friend class GLMCGLineSearchState;
+
+public:
+    GLMCGLineSearchState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocating the line-search state.
+     */
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension,
+            uint32_t inNumCandidates) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+                dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inDimension, inNumCandidates));
+
+        task.dimension.rebind(&mStorage[0]);
+        task.dimension = inDimension;
+        task.numCandidates.rebind(&mStorage[1]);
+        task.numCandidates = inNumCandidates;
+
+        rebind();
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    GLMCGLineSearchState &operator=(
+            const GLMCGLineSearchState<OtherHandle> &inOtherState) {
+        for (size_t i = 0; i < mStorage.size(); i++) {
+            mStorage[i] = inOtherState.mStorage[i];
+        }
+
+        return *this;
+    }
+
+    /**
+     * @brief Reset the intra-iteration fields.
+     */
+    inline void reset() {
+        algo.numRows = 0;
+        algo.loss.fill(0);
+        algo.derivative.fill(0);
+        algo.incrGradient.fill(0);
+    }
+
+    static inline uint64_t arraySize(const uint32_t inDimension,
+            const uint32_t inNumCandidates) {
+        return 6 + 3 * static_cast<uint64_t>(inDimension)
+            + 3 * static_cast<uint64_t>(inNumCandidates)
+            + static_cast<uint64_t>(inDimension) * inNumCandidates;
+    }
+
+private:
+    /**
+     * @brief Rebind to a new storage array.
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     * - 0: dimension (dimension of the model)
+     * - 1: numCandidates (number of step sizes tried per iteration)
+     * - 2: iteration (current number of iterations executed)
+     * - 3: stepsize (center of the candidate step sizes)
+     * - 4: loss (sum of loss for each row, at model)
+     * - 5: model (coefficients)
+     * - 5 + dimension: direction (conjugate direction)
+     * - 5 + 2 * dimension: gradient (gradient of loss functions, at model)
+     * - 5 + 3 * dimension: candidate (step sizes tried in this iteration)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 5 + 3 * dimension + numCandidates: numRows (number of rows processed
+     *   in this iteration)
+     * - 6 + 3 * dimension + numCandidates: loss (sum of loss for each row,
+     *   one per candidate)
+     * - 6 + 3 * dimension + 2 * numCandidates: derivative (derivative of
+     *   the loss along the direction, one per candidate)
+     * - 6 + 3 * dimension + 3 * numCandidates: incrGradient (gradients,
+     *   dimension x numCandidates)
+     */
+    void rebind() {
+        task.dimension.rebind(&mStorage[0]);
+        task.numCandidates.rebind(&mStorage[1]);
+        size_t dimension = task.dimension;
+        size_t numCandidates = task.numCandidates;
+        task.iteration.rebind(&mStorage[2]);
+        task.stepsize.rebind(&mStorage[3]);
+        task.loss.rebind(&mStorage[4]);
+        task.model.rebind(&mStorage[5], task.dimension);
+        task.direction.rebind(&mStorage[5 + dimension], task.dimension);
+        task.gradient.rebind(&mStorage[5 + 2 * dimension], task.dimension);
+        task.candidate.rebind(&mStorage[5 + 3 * dimension],
+                task.numCandidates);
+
+        algo.numRows.rebind(&mStorage[5 + 3 * dimension + numCandidates]);
+        algo.loss.rebind(&mStorage[6 + 3 * dimension + numCandidates],
+                task.numCandidates);
+        algo.derivative.rebind(
+                &mStorage[6 + 3 * dimension + 2 * numCandidates],
+                task.numCandidates);
+        algo.incrGradient.rebind(
+                &mStorage[6 + 3 * dimension + 3 * numCandidates],
+                task.dimension, task.numCandidates);
+    }
+
+    Handle mStorage;
+
+public:
+    typedef typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+        TransparentColumnVector;
+
+    struct TaskState {
+        typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+        typename HandleTraits<Handle>::ReferenceToUInt32 numCandidates;
+        typename HandleTraits<Handle>::ReferenceToUInt32 iteration;
+        typename HandleTraits<Handle>::ReferenceToDouble stepsize;
+        typename HandleTraits<Handle>::ReferenceToDouble loss;
+        TransparentColumnVector model;
+        TransparentColumnVector direction;
+        TransparentColumnVector gradient;
+        TransparentColumnVector candidate;
+    } task;
+
+    struct AlgoState {
+        typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+        TransparentColumnVector loss;
+        TransparentColumnVector derivative;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap
+            incrGradient;
+    } algo;
+};
+
+/**
+ * @brief Inter- (Task State) and intra-iteration (Algo State) state of
+ *        L-BFGS for generalized linear models
+ *
+ * Each iteration (one aggregate-function call) only accumulates the loss and
+ * the gradient at task.model, so the intra-iteration state has length
+ * O(dimension). The last historySize correction pairs of L-BFGS are kept in
+ * the inter-iteration state, as the columns of two dimension x historySize
+ * matrices, oldest first.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 10, and all elemenets are 0.
+ */
+template <class Handle>
+class GLMLBFGSState {
+    template <class OtherHandle>
+    friend class GLMLBFGSState;
+
+public:
+    GLMLBFGSState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocating the L-BFGS state.
+     */
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension,
+            uint32_t inHistorySize) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+                dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inDimension, inHistorySize));
+
+        task.dimension.rebind(&mStorage[0]);
+        task.dimension = inDimension;
+        task.historySize.rebind(&mStorage[1]);
+        task.historySize = inHistorySize;
+
+        rebind();
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    GLMLBFGSState &operator=(const GLMLBFGSState<OtherHandle> &inOtherState) {
+        for (size_t i = 0; i < mStorage.size(); i++) {
+            mStorage[i] = inOtherState.mStorage[i];
+        }
+
+        return *this;
+    }
+
+    /**
+     * @brief Reset the intra-iteration fields.
+     */
+    inline void reset() {
+        algo.numRows = 0;
+        algo.loss = 0.;
+        algo.incrGradient = ColumnVector::Zero(task.dimension);
+    }
+
+    static inline uint64_t arraySize(const uint32_t inDimension,
+            const uint32_t inHistorySize) {
+        return 9 + 5 * static_cast<uint64_t>(inDimension)
+            + 2 * static_cast<uint64_t>(inDimension) * inHistorySize;
+    }
+
+private:
+    /**
+     * @brief Rebind to a new storage array.
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     *   historyLength = dimension * historySize
+     * - 0: dimension (dimension of the model)
+     * - 1: historySize (maximum number of correction pairs)
+     * - 2: iteration (current number of iterations executed)
+     * - 3: numPairs (number of correction pairs stored)
+     * - 4: stepsize (length of the first, steepest-descent step)
+     * - 5: step (fraction of the direction in the current trial step)
+     * - 6: lastLoss (loss at lastModel)
+     * - 7: model (coefficients at which the gradient is computed)
+     * - 7 + dimension: lastModel (last accepted coefficients)
+     * - 7 + 2 * dimension: lastGradient (gradient at lastModel)
+     * - 7 + 3 * dimension: direction (search direction from lastModel)
+     * - 7 + 4 * dimension: s (differences of accepted coefficients,
+     *   dimension x historySize)
+     * - 7 + 4 * dimension + historyLength: y (differences of gradients,
+     *   dimension x historySize)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 7 + 4 * dimension + 2 * historyLength: numRows (number of rows
+     *   processed in this iteration)
+     * - 8 + 4 * dimension + 2 * historyLength: loss (sum of loss for each
+     *   rows)
+     * - 9 + 4 * dimension + 2 * historyLength: incrGradient (volatile
+     *   gradient for update)
+     */
+    void rebind() {
+        task.dimension.rebind(&mStorage[0]);
+        task.historySize.rebind(&mStorage[1]);
+        size_t dimension = task.dimension;
+        size_t historyLength = dimension * task.historySize;
+        task.iteration.rebind(&mStorage[2]);
+        task.numPairs.rebind(&mStorage[3]);
+        task.stepsize.rebind(&mStorage[4]);
+        task.step.rebind(&mStorage[5]);
+        task.lastLoss.rebind(&mStorage[6]);
+        task.model.rebind(&mStorage[7], task.dimension);
+        task.lastModel.rebind(&mStorage[7 + dimension], task.dimension);
+        task.lastGradient.rebind(&mStorage[7 + 2 * dimension],
+                task.dimension);
+        task.direction.rebind(&mStorage[7 + 3 * dimension], task.dimension);
+        task.s.rebind(&mStorage[7 + 4 * dimension], task.dimension,
+                task.historySize);
+        task.y.rebind(&mStorage[7 + 4 * dimension + historyLength],
+                task.dimension, task.historySize);
+
+        algo.numRows.rebind(&mStorage[7 + 4 * dimension + 2 * historyLength]);
+        algo.loss.rebind(&mStorage[8 + 4 * dimension + 2 * historyLength]);
+        algo.incrGradient.rebind(
+                &mStorage[9 + 4 * dimension + 2 * historyLength],
+                task.dimension);
+    }
+
+    Handle mStorage;
+
+public:
+    typedef typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+        TransparentColumnVector;
+    typedef typename HandleTraits<Handle>::MatrixTransparentHandleMap
+        TransparentMatrix;
+
+    struct TaskState {
+        typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+        typename HandleTraits<Handle>::ReferenceToUInt32 historySize;
+        typename HandleTraits<Handle>::ReferenceToUInt32 iteration;
+        typename HandleTraits<Handle>::ReferenceToUInt32 numPairs;
+        typename HandleTraits<Handle>::ReferenceToDouble stepsize;
+        typename HandleTraits<Handle>::ReferenceToDouble step;
+        typename HandleTraits<Handle>::ReferenceToDouble lastLoss;
+        TransparentColumnVector model;
+        TransparentColumnVector lastModel;
+        TransparentColumnVector lastGradient;
+        TransparentColumnVector direction;
+        TransparentMatrix s;
+        TransparentMatrix y;
+    } task;
+
+    struct AlgoState {
+        typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+        typename HandleTraits<Handle>::ReferenceToDouble loss;
+        TransparentColumnVector incrGradient;
+    } algo;
+};
+
+/**
+ * @brief Inter- (Task State) and intra-iteration (Algo State) state of
+ *        Newton's method for generic objective functions (any tasks)
+ *
+ * This class assumes that the coefficients are of type vector. Low-rank 
+ * matrix factorization, neural networks would not be able to use this.
+ * 
+ * TransitionState encapsualtes the transition state during the
+ * aggregate function during an iteration. To the database, the state is
+ * exposed as a single DOUBLE PRECISION array, to the C++ code it is a proper
+ * object containing scalars and vectors.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 5, and at least first elemenet is 0
+ * (exact values of other elements are ignored).
+ *
+ */
+template <class Handle>
+class GLMNewtonState {
+    template <class OtherHandle>
+    friend class GLMNewtonState;
+
+public:
+    GLMNewtonState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocating the incremental gradient state.
+     */
+    inline void allocate(const Allocator &inAllocator, uint16_t inDimension) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+                dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inDimension));
+
+        task.dimension.rebind(&mStorage[0]);
+        task.dimension = inDimension;
+        
+        rebind();
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    GLMNewtonState &operator=(const GLMNewtonState<OtherHandle> &inOtherState) {
+        for (size_t i = 0; i < mStorage.size(); i++) {
+            mStorage[i] = inOtherState.mStorage[i];
+        }
+
+        return *this;
+    }
+
+    /**
+     * @brief Reset the intra-iteration fields.
+     */
+    inline void reset() {
+        algo.numRows = 0;
+        algo.loss = 0.;
+        algo.gradient = ColumnVector::Zero(task.dimension);
+        algo.hessian = Matrix::Zero(task.dimension, task.dimension);
+    }
+
+    static inline uint32_t arraySize(const uint16_t inDimension) {
+        return 3 + (inDimension + 2) * inDimension;
+    }
+
+    /**
+     * @brief Whether the array is a compact encoding (see compact())
+     */
+    static inline bool isCompact(const ArrayHandle<double> &inArray) {
+        if (inArray.size() < 1)
+            return false;
+
+        uint16_t dimension = static_cast<uint16_t>(inArray[0]);
+        return dimension > 0 && inArray.size() < arraySize(dimension);
+    }
+
+    /**
+     * @brief Encode the gradient and the hessian as sparse vector
+     *
+     * With sparse independent variables, the gradient and the hessian
+     * accumulated by a segment have few nonzero coordinates. The compact
+     * encoding is meant for shipping a state between nodes. Its layout:
+     * - 0 to 2 + dimension: same as in the dense state
+     * - 3 + dimension: numNonZeros (number of nonzero coordinates of the
+     *   gradient followed by the hessian, as one vector)
+     * - 4 + dimension: indices of these coordinates
+     * - 4 + dimension + numNonZeros: their values
+     *
+     * If the encoding would not be smaller, the dense state is returned as is.
+     */
+    inline AnyType compact(const Allocator &inAllocator) const {
+        const double *intra = mStorage.ptr() + 3 + task.dimension;
+        size_t intraSize = mStorage.size() - 3 - task.dimension;
+
+        size_t numNonZeros = 0;
+        for (size_t i = 0; i < intraSize; ++i)
+            if (intra[i] != 0)
+                ++numNonZeros;
+
+        size_t size = 4 + task.dimension + 2 * numNonZeros;
+        if (size >= mStorage.size())
+            return mStorage;
+
+        MutableArrayHandle<double> result = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(size);
+        std::copy(mStorage.ptr(), intra, result.ptr());
+        result[3 + task.dimension] = static_cast<double>(numNonZeros);
+        size_t k = 4 + task.dimension;
+        for (size_t i = 0; i < intraSize; ++i) {
+            if (intra[i] != 0) {
+                result[k] = static_cast<double>(i);
+                result[k + numNonZeros] = intra[i];
+                ++k;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Decode a compact encoding into a dense state
+     */
+    static inline MutableArrayHandle<double> expand(
+            const Allocator &inAllocator, const ArrayHandle<double> &inArray) {
+
+        uint16_t dimension = static_cast<uint16_t>(inArray[0]);
+        size_t numNonZeros = static_cast<size_t>(inArray[3 + dimension]);
+        if (inArray.size() != 4 + dimension + 2 * numNonZeros)
+            throw std::invalid_argument("Invalid compact state.");
+
+        size_t denseSize = arraySize(dimension);
+        MutableArrayHandle<double> result = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                denseSize);
+        std::copy(inArray.ptr(), inArray.ptr() + 3 + dimension, result.ptr());
+        const double *indices = inArray.ptr() + 4 + dimension;
+        for (size_t k = 0; k < numNonZeros; ++k) {
+            size_t i = 3 + dimension + static_cast<size_t>(indices[k]);
+            if (i >= denseSize)
+                throw std::invalid_argument("Invalid compact state.");
+            result[i] = indices[k + numNonZeros];
+        }
+        return result;
+    }
+
+private:
+    /**
+     * @brief Rebind to a new storage array.
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     * - 0: dimension (dimension of the model)
+     * - 1: model (coefficients)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 1 + dimension: numRows (number of rows processed in this iteration)
+     * - 2 + dimension: loss (sum of loss for each rows)
+     * - 3 + dimension: gradient (volatile gradient for update)
+     * - 3 + 2 * dimension: hessian (volatile hessian for update)
+     */
+    void rebind() {
+        task.dimension.rebind(&mStorage[0]);
+        task.model.rebind(&mStorage[1], task.dimension);
+
+        algo.numRows.rebind(&mStorage[1 + task.dimension]);
+        algo.loss.rebind(&mStorage[2 + task.dimension]);
+        algo.gradient.rebind(&mStorage[3 + task.dimension], task.dimension);
+        algo.hessian.rebind(&mStorage[3 + 2 * task.dimension], task.dimension,
+                task.dimension);
+    }
+
+    Handle mStorage;
+
+public:
+    struct TaskState {
+        typename HandleTraits<Handle>::ReferenceToUInt16 dimension;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap model;
+    } task;
+
+    struct AlgoState {
+        typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+        typename HandleTraits<Handle>::ReferenceToDouble loss;
+        typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap gradient;
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap hessian;
+    } algo;
+};
+
+/**
+ * @brief Inter- (Task State) and intra-iteration (Algo State) state of
+ *        the conjugate gradient method for linear systems
+ *
+ * The system is \f$ A X = B \f$, where \f$ A \f$ is a symmetric positive
+ * definite dimension x dimension matrix, and \f$ B \f$ has numRHS columns
+ * (right-hand sides). Each iteration (one aggregate-function call) only
+ * computes \f$ A P \f$ for the current directions \f$ P \f$, so the
+ * intra-iteration state has length O(dimension * numRHS).
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 6, and all elemenets are 0.
+ */
+template <class Handle>
+class LinearCGState {
+    template <class OtherHandle>
+    friend class LinearCGState;
+
+public:
+    LinearCGState(const AnyType &inArray) : mStorage(inArray.getAs<Handle>()) {
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocating the conjugate gradient state.
+     */
+    inline void allocate(const Allocator &inAllocator, uint32_t inDimension,
+            uint32_t inNumRHS) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+                dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inDimension, inNumRHS));
+
+        task.dimension.rebind(&mStorage[0]);
+        task.dimension = inDimension;
+        task.numRHS.rebind(&mStorage[1]);
+        task.numRHS = inNumRHS;
+
+        rebind();
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    LinearCGState &operator=(const LinearCGState<OtherHandle> &inOtherState) {
+        for (size_t i = 0; i < mStorage.size(); i++) {
+            mStorage[i] = inOtherState.mStorage[i];
+        }
+
+        return *this;
+    }
+
+    /**
+     * @brief Reset the intra-iteration fields.
+     */
+    inline void reset() {
+        algo.numRows = 0;
+        algo.incrDirection.fill(0);
+        algo.incrDiagonal.fill(0);
+    }
+
+    static inline uint64_t arraySize(const uint32_t inDimension,
+            const uint32_t inNumRHS) {
+        return 5 + 2 * static_cast<uint64_t>(inNumRHS)
+            + 2 * static_cast<uint64_t>(inDimension)
+            + 4 * static_cast<uint64_t>(inDimension) * inNumRHS;
+    }
+
+private:
+    /**
+     * @brief Rebind to a new storage array.
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     *   blockLength = dimension * numRHS
+     * - 0: dimension (number of rows and columns of A)
+     * - 1: numRHS (number of right-hand sides)
+     * - 2: iteration (current number of iterations executed)
+     * - 3: preconditioned (whether to use the Jacobi preconditioner)
+     * - 4: rz (r^T M^{-1} r for each right-hand side)
+     * - 4 + numRHS: residualNorm (r^T r for each right-hand side)
+     * - 4 + 2 * numRHS: diagonal (diagonal of A, known after iteration 0)
+     * - 4 + 2 * numRHS + dimension: model (current solutions X,
+     *   dimension x numRHS)
+     * - 4 + 2 * numRHS + dimension + blockLength: residual (B - A X)
+     * - 4 + 2 * numRHS + dimension + 2 * blockLength: direction (P)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 4 + 2 * numRHS + dimension + 3 * blockLength: numRows (number of
+     *   rows processed in this iteration)
+     * - 5 + 2 * numRHS + dimension + 3 * blockLength: incrDirection (A P)
+     * - 5 + 2 * numRHS + dimension + 4 * blockLength: incrDiagonal
+     *   (diagonal of A, only accumulated in iteration 0)
+     */
+    void rebind() {
+        task.dimension.rebind(&mStorage[0]);
+        task.numRHS.rebind(&mStorage[1]);
+        size_t dimension = task.dimension;
+        size_t numRHS = task.numRHS;
+        size_t blockLength = dimension * numRHS;
+        task.iteration.rebind(&mStorage[2]);
+        task.preconditioned.rebind(&mStorage[3]);
+        task.rz.rebind(&mStorage[4], task.numRHS);
+        task.residualNorm.rebind(&mStorage[4 + numRHS], task.numRHS);
+        task.diagonal.rebind(&mStorage[4 + 2 * numRHS], task.dimension);
+        task.model.rebind(&mStorage[4 + 2 * numRHS + dimension],
+                task.dimension, task.numRHS);
+        task.residual.rebind(
+                &mStorage[4 + 2 * numRHS + dimension + blockLength],
+                task.dimension, task.numRHS);
+        task.direction.rebind(
+                &mStorage[4 + 2 * numRHS + dimension + 2 * blockLength],
+                task.dimension, task.numRHS);
+
+        algo.numRows.rebind(
+                &mStorage[4 + 2 * numRHS + dimension + 3 * blockLength]);
+        algo.incrDirection.rebind(
+                &mStorage[5 + 2 * numRHS + dimension + 3 * blockLength],
+                task.dimension, task.numRHS);
+        algo.incrDiagonal.rebind(
+                &mStorage[5 + 2 * numRHS + dimension + 4 * blockLength],
+                task.dimension);
+    }
+
+    Handle mStorage;
+
+public:
+    typedef typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+        TransparentColumnVector;
+    typedef typename HandleTraits<Handle>::MatrixTransparentHandleMap
+        TransparentMatrix;
+
+    struct TaskState {
+        typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+        typename HandleTraits<Handle>::ReferenceToUInt32 numRHS;
+        typename HandleTraits<Handle>::ReferenceToUInt32 iteration;
+        typename HandleTraits<Handle>::ReferenceToBool preconditioned;
+        TransparentColumnVector rz;
+        TransparentColumnVector residualNorm;
+        TransparentColumnVector diagonal;
+        TransparentMatrix model;
+        TransparentMatrix residual;
+        TransparentMatrix direction;
+    } task;
+
+    struct AlgoState {
+        typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+        TransparentMatrix incrDirection;
+        TransparentColumnVector incrDiagonal;
+    } algo;
+};
+
+/**
+ * @brief Return a state argument in dense form
+ *
+ * States shipped between nodes may use the compact encoding of State (see,
+ * e.g., GLMNewtonState::compact()). They are decoded here, so that merge and
+ * final functions accept both encodings.
+ */
+template <class State>
+inline
+AnyType
+denseState(const Allocator &inAllocator, const AnyType &inState) {
+    ArrayHandle<double> array = inState.getAs<ArrayHandle<double> >();
+    if (State::isCompact(array))
+        return State::expand(inAllocator, array);
+    return inState;
+}
+
 } // namespace convex
 
 } // namespace modules
@@ -11,6 +11,7 @@
 #define MADLIB_MODULES_CONVEX_TYPE_TUPLE_HPP_
 
 #include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
 #include "independent_variables.hpp"
 
 #include "dependent_variable.hpp"
@@ -53,9 +54,26 @@ using madlib::dbal::eigen_integration::MappedColumnVector;
 // Generalized Linear Models (GLMs): Logistic regression, Linear SVM
 typedef ExampleTuple<MappedColumnVector, double> GLMTuple;
 
+using madlib::dbal::eigen_integration::SparseColumnVector;
+// GLMs with sparse independent variables (e.g., svec)
+typedef ExampleTuple<SparseColumnVector, double> SparseGLMTuple;
+
+using madlib::dbal::eigen_integration::MappedFloatColumnVector;
+// GLMs with single-precision independent variables (REAL[])
+typedef ExampleTuple<MappedFloatColumnVector, double> FloatGLMTuple;
+
+// GLMs with tuples buffered in a transition state (see GLMIGDShardState)
+typedef ExampleTuple<
+    HandleTraits<ArrayHandle<double> >::ColumnVectorTransparentHandleMap,
+    double> BufferedGLMTuple;
+
 // madlib::modules::convex::MatrixIndex
 typedef ExampleTuple<MatrixIndex, double> LMFTuple;
 
+// Rows of a dense matrix, with the 0-based row number as id. The dependent
+// variable is not used.
+typedef ExampleTuple<MappedColumnVector, double> MatrixRowTuple;
+
 } // namespace convex
 
 } // namespace modules
@@ -6,9 +6,14 @@
  *
  *//* ----------------------------------------------------------------------- */
 
+#include "ann/ann.hpp"
+#include "assoc_rules/assoc_rules.hpp"
+#include "bayes/bayes.hpp"
+#include "lda/lda.hpp"
 #include "linalg/linalg.hpp"
 #include "prob/prob.hpp"
 #include "regress/regress.hpp"
 #include "sample/sample.hpp"
 #include "stats/stats.hpp"
+#include "utilities/utilities.hpp"
 #include "convex/convex.hpp"
@@ -0,0 +1,9 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file lda.hpp
+ *
+ * @brief Umbrella header that includes all LDA headers
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include "online_vb.hpp"
@@ -0,0 +1,503 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file online_vb.cpp
+ *
+ * @brief Online variational Bayes for Latent Dirichlet Allocation
+ *
+ * This is the algorithm of Hoffman, Blei and Bach, "Online Learning for
+ * Latent Dirichlet Allocation", NIPS 2010. The model is the variational
+ * parameter \f$ \lambda \f$ of the topic-word distributions. For every
+ * mini-batch of documents, the E-step infers the variational topic
+ * distribution \f$ \gamma_d \f$ of each document given
+ * \f$ \exp(E[\log \beta]) \f$, and aggregates the expected word-topic counts.
+ * The M-step then moves \f$ \lambda \f$ towards the estimate obtained from
+ * these counts, with step size \f$ \rho_t = (\tau_0 + t)^{-\kappa} \f$.
+ * Neither \f$ \gamma_d \f$ nor any per-word state is kept between
+ * mini-batches, so the state is of size \f$ K V \f$, independent of the size
+ * of the corpus.
+ *
+ * All \f$ K \times V \f$ arrays are stored word-major, i.e., the entry of word
+ * \f$ w \f$ (1-based) and topic \f$ k \f$ (0-based) is at position
+ * \f$ (w - 1) K + k \f$, like the word-topic counts of the plda module.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <boost/math/special_functions/digamma.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "online_vb.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace lda {
+
+/**
+ * @brief Maximum number of fixed-point iterations of the E-step per document
+ */
+static const int kMaxDocIterations = 100;
+
+/**
+ * @brief The E-step of a document stops once the mean absolute change of
+ *     \f$ \gamma_d \f$ is below this threshold
+ */
+static const double kMeanChangeThreshold = 0.001;
+
+/**
+ * @brief Added to the normalizers of the word-topic responsibilities, which
+ *     may underflow
+ */
+static const double kNormalizerEpsilon = 1e-100;
+
+static void
+checkNumTopics(int32_t inNumTopics) {
+    if (inNumTopics < 1)
+        throw std::invalid_argument("Number of topics must be positive.");
+}
+
+/**
+ * @brief Return the vocabulary size of a word-major \f$ K \times V \f$ array
+ */
+static int32_t
+vocabularySize(const ArrayHandle<double> &inArray, int32_t inNumTopics) {
+    checkNumTopics(inNumTopics);
+    if (inArray.size() == 0
+        || inArray.size() % static_cast<size_t>(inNumTopics) != 0)
+        throw std::invalid_argument("Length of topic-word array must be a "
+            "positive multiple of the number of topics.");
+    return static_cast<int32_t>(inArray.size()
+        / static_cast<size_t>(inNumTopics));
+}
+
+/**
+ * @brief Variational inference of the topic distribution of a document
+ *
+ * After infer(), gamma holds the variational Dirichlet parameters of the
+ * topic distribution of the document, and the expected number of times each
+ * distinct word of the document is assigned to topic k is
+ * <tt>expElogtheta[k] * expElogbeta[(words[i] - 1) * K + k] * ratios[i]</tt>.
+ */
+class DocumentInference {
+public:
+    DocumentInference(const double *inExpElogbeta, int32_t inNumTopics,
+        int32_t inVocabSize, double inAlpha)
+      : expElogbeta(inExpElogbeta), numTopics(inNumTopics),
+        vocabSize(inVocabSize), alpha(inAlpha),
+        gamma(static_cast<size_t>(inNumTopics)),
+        expElogtheta(static_cast<size_t>(inNumTopics)),
+        lastGamma(static_cast<size_t>(inNumTopics)),
+        dots(static_cast<size_t>(inNumTopics)) {
+
+        if (!(alpha > 0))
+            throw std::invalid_argument("Parameter alpha of the topic "
+                "Dirichlet prior must be positive.");
+    }
+
+    void infer(const ArrayHandle<int32_t> &inDoc) {
+        size_t K = static_cast<size_t>(numTopics);
+
+        // Distinct words of the document and their counts
+        words.assign(inDoc.ptr(), inDoc.ptr() + inDoc.size());
+        std::sort(words.begin(), words.end());
+        counts.clear();
+        size_t numWords = 0;
+        for (size_t i = 0; i < words.size(); i++) {
+            if (words[i] < 1 || words[i] > vocabSize)
+                throw std::invalid_argument("Word index out of range "
+                    "[1, vocabulary size].");
+            if (numWords > 0 && words[numWords - 1] == words[i]) {
+                counts[numWords - 1] += 1.;
+            } else {
+                words[numWords++] = words[i];
+                counts.push_back(1.);
+            }
+        }
+        words.resize(numWords);
+        ratios.resize(numWords);
+
+        std::fill(gamma.begin(), gamma.end(), numWords == 0 ? alpha : 1.);
+        updateExpElogtheta();
+        updateRatios();
+        if (numWords == 0)
+            return;
+
+        for (int iter = 0; iter < kMaxDocIterations; iter++) {
+            lastGamma = gamma;
+            std::fill(dots.begin(), dots.end(), 0.);
+            for (size_t i = 0; i < numWords; i++) {
+                const double *row = wordRow(i);
+                for (size_t k = 0; k < K; k++)
+                    dots[k] += ratios[i] * row[k];
+            }
+            double change = 0;
+            for (size_t k = 0; k < K; k++) {
+                gamma[k] = alpha + expElogtheta[k] * dots[k];
+                change += std::fabs(gamma[k] - lastGamma[k]);
+            }
+            updateExpElogtheta();
+            updateRatios();
+            if (change / static_cast<double>(K) < kMeanChangeThreshold)
+                break;
+        }
+    }
+
+    /**
+     * @brief Add the expected word-topic counts of the document (without the
+     *     factor expElogbeta) to a word-major array
+     */
+    void addStatistics(double *ioStats) const {
+        size_t K = static_cast<size_t>(numTopics);
+        for (size_t i = 0; i < words.size(); i++) {
+            double *row = ioStats + static_cast<size_t>(words[i] - 1) * K;
+            for (size_t k = 0; k < K; k++)
+                row[k] += expElogtheta[k] * ratios[i];
+        }
+    }
+
+    const std::vector<double> &topics() const { return gamma; }
+
+private:
+    const double *wordRow(size_t inIndex) const {
+        return expElogbeta + static_cast<size_t>(words[inIndex] - 1)
+            * static_cast<size_t>(numTopics);
+    }
+
+    void updateExpElogtheta() {
+        double sum = 0;
+        for (size_t k = 0; k < gamma.size(); k++)
+            sum += gamma[k];
+        double psiSum = boost::math::digamma(sum);
+        for (size_t k = 0; k < gamma.size(); k++)
+            expElogtheta[k] = std::exp(boost::math::digamma(gamma[k])
+                - psiSum);
+    }
+
+    /**
+     * @brief Word counts divided by the normalizers of the responsibilities
+     */
+    void updateRatios() {
+        for (size_t i = 0; i < words.size(); i++) {
+            const double *row = wordRow(i);
+            double norm = kNormalizerEpsilon;
+            for (size_t k = 0; k < expElogtheta.size(); k++)
+                norm += expElogtheta[k] * row[k];
+            ratios[i] = counts[i] / norm;
+        }
+    }
+
+    const double *expElogbeta;
+    int32_t numTopics;
+    int32_t vocabSize;
+    double alpha;
+
+    std::vector<int32_t> words;
+    std::vector<double> counts;
+    std::vector<double> ratios;
+    std::vector<double> gamma;
+    std::vector<double> expElogtheta;
+    std::vector<double> lastGamma;
+    std::vector<double> dots;
+};
+
+/**
+ * @brief Transition state for the E-step of a mini-batch
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * numTopics, vocabSize, numDocs, followed by the numTopics * vocabSize
+ * expected word-topic counts (word-major), without the factor
+ * \f$ \exp(E[\log \beta]) \f$, which is applied by the M-step.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elements are 0.
+ */
+template <class Handle>
+class VBEStepState {
+    template <class OtherHandle>
+    friend class VBEStepState;
+
+public:
+    VBEStepState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]),
+            static_cast<uint32_t>(mStorage[1]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator,
+        uint32_t inNumTopics, uint32_t inVocabSize) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inNumTopics, inVocabSize));
+        rebind(inNumTopics, inVocabSize);
+        numTopics = inNumTopics;
+        vocabSize = inVocabSize;
+    }
+
+    bool isInitialized() const {
+        return numTopics > 0;
+    }
+
+    size_t numStats() const {
+        return static_cast<size_t>(numTopics) * vocabSize;
+    }
+
+    /**
+     * @brief Add the statistics of another state
+     */
+    template <class OtherHandle>
+    void add(const VBEStepState<OtherHandle> &inOther) {
+        if (inOther.numTopics != numTopics || inOther.vocabSize != vocabSize)
+            throw std::invalid_argument("Number of topics and vocabulary "
+                "size must be the same in all rows.");
+
+        numDocs = numDocs + inOther.numDocs;
+        for (size_t i = 0; i < numStats(); i++)
+            stats[i] += inOther.stats[i];
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inNumTopics,
+        uint32_t inVocabSize) {
+
+        return 3 + static_cast<size_t>(inNumTopics) * inVocabSize;
+    }
+
+    void rebind(uint32_t inNumTopics, uint32_t inVocabSize) {
+        madlib_assert(mStorage.size() >= arraySize(inNumTopics, inVocabSize),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        numTopics.rebind(&mStorage[0]);
+        vocabSize.rebind(&mStorage[1]);
+        numDocs.rebind(&mStorage[2]);
+        stats = mStorage.ptr() + 3;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numTopics;
+    typename HandleTraits<Handle>::ReferenceToUInt32 vocabSize;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numDocs;
+    typename HandleTraits<Handle>::DoublePtr stats;
+};
+
+/**
+ * @brief Draw the initial topic-word parameters
+ *
+ * As in [Hoffman et al.], every entry is drawn from Gamma(100, 1/100), i.e.,
+ * it is close to 1 with a little noise that breaks the symmetry between the
+ * topics. Gamma variates are drawn with the method of Marsaglia and Tsang,
+ * "A Simple Method for Generating Gamma Variables", ACM TOMS 26(3), 2000.
+ */
+AnyType
+vb_random_lambda::run(AnyType &args) {
+    int32_t numTopics = args[0].getAs<int32_t>();
+    int32_t numWords = args[1].getAs<int32_t>();
+
+    checkNumTopics(numTopics);
+    if (numWords < 1)
+        throw std::invalid_argument("Vocabulary size must be positive.");
+
+    const double shape = 100.;
+    const double d = shape - 1. / 3.;
+    const double c = 1. / std::sqrt(9. * d);
+
+    PhiloxRandomNumberGenerator generator;
+    size_t size = static_cast<size_t>(numTopics) * numWords;
+    MutableArrayHandle<double> lambda = allocateArray<double>(size);
+    for (size_t i = 0; i < size; i++) {
+        for (;;) {
+            // Box-Muller: 1 - generator() is uniform on (0, 1]
+            double x = std::sqrt(-2. * std::log(1. - generator()))
+                * std::cos(2. * M_PI * generator());
+            double v = 1. + c * x;
+            if (v <= 0)
+                continue;
+            v = v * v * v;
+            double u = 1. - generator();
+            if (std::log(u) < 0.5 * x * x + d - d * v + d * std::log(v)) {
+                lambda[i] = d * v / shape;
+                break;
+            }
+        }
+    }
+    return lambda;
+}
+
+/**
+ * @brief Compute \f$ \exp(E[\log \beta_{kw}]) = \exp(\Psi(\lambda_{kw})
+ *     - \Psi(\sum_w \lambda_{kw})) \f$
+ */
+AnyType
+vb_exp_elog_beta::run(AnyType &args) {
+    ArrayHandle<double> lambda = args[0].getAs<ArrayHandle<double> >();
+    int32_t numTopics = args[1].getAs<int32_t>();
+    int32_t numWords = vocabularySize(lambda, numTopics);
+
+    size_t K = static_cast<size_t>(numTopics);
+    std::vector<double> psiSums(K, 0.);
+    for (size_t w = 0; w < static_cast<size_t>(numWords); w++)
+        for (size_t k = 0; k < K; k++) {
+            double value = lambda[w * K + k];
+            if (!(value > 0) || !std::isfinite(value))
+                throw std::invalid_argument("Topic-word parameters must be "
+                    "positive and finite.");
+            psiSums[k] += value;
+        }
+    for (size_t k = 0; k < K; k++)
+        psiSums[k] = boost::math::digamma(psiSums[k]);
+
+    MutableArrayHandle<double> result = allocateArray<double>(lambda.size());
+    for (size_t w = 0; w < static_cast<size_t>(numWords); w++)
+        for (size_t k = 0; k < K; k++)
+            result[w * K + k] = std::exp(
+                boost::math::digamma(lambda[w * K + k]) - psiSums[k]);
+    return result;
+}
+
+/**
+ * @brief Infer the topic distribution of a document and add its expected
+ *     word-topic counts to the state
+ *
+ * The array \f$ \exp(E[\log \beta]) \f$ is the same for all rows, so it is
+ * obtained with UDF::cachedArrayArgument().
+ */
+AnyType
+vb_estep_transition::run(AnyType &args) {
+    VBEStepState<MutableArrayHandle<double> > state = args[0];
+    ArrayHandle<int32_t> doc = args[1].getAs<ArrayHandle<int32_t> >();
+    ArrayHandle<double> expElogbeta = cachedArrayArgument(2);
+    int32_t numTopics = args[3].getAs<int32_t>();
+    double alpha = args[4].getAs<double>();
+    int32_t numWords = vocabularySize(expElogbeta, numTopics);
+
+    if (!state.isInitialized())
+        state.initialize(*this, static_cast<uint32_t>(numTopics),
+            static_cast<uint32_t>(numWords));
+    else if (state.numTopics != static_cast<uint32_t>(numTopics)
+        || state.vocabSize != static_cast<uint32_t>(numWords))
+        throw std::invalid_argument("Number of topics and vocabulary size "
+            "must be the same in all rows.");
+
+    DocumentInference inference(expElogbeta.ptr(), numTopics, numWords,
+        alpha);
+    inference.infer(doc);
+    inference.addStatistics(state.stats);
+    state.numDocs = state.numDocs + 1;
+    return state;
+}
+
+/**
+ * @brief Perform the preliminary aggregation function: Merge transition states
+ */
+AnyType
+vb_estep_merge_states::run(AnyType &args) {
+    VBEStepState<MutableArrayHandle<double> > stateLeft = args[0];
+    VBEStepState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+
+    stateLeft.add(stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Return the word-topic statistics and the number of documents of the
+ *     mini-batch
+ */
+AnyType
+vb_estep_final::run(AnyType &args) {
+    VBEStepState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    MutableArrayHandle<double> stats = allocateArray<double>(
+        state.numStats());
+    std::copy(state.stats, state.stats + state.numStats(), stats.ptr());
+
+    AnyType tuple;
+    return tuple << stats << static_cast<int64_t>(state.numDocs);
+}
+
+/**
+ * @brief Compute \f$ (1 - \rho) \lambda + \rho (\eta + s\, \hat n) \f$
+ *
+ * Here \f$ \hat n \f$ are the expected word-topic counts of the mini-batch,
+ * i.e., the statistics of the E-step times \f$ \exp(E[\log \beta]) \f$, and
+ * the scale \f$ s \f$ is the number of documents of the corpus divided by
+ * the number of documents of the mini-batch.
+ */
+AnyType
+vb_mstep::run(AnyType &args) {
+    ArrayHandle<double> lambda = args[0].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> expElogbeta = args[1].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> stats = args[2].getAs<ArrayHandle<double> >();
+    double eta = args[3].getAs<double>();
+    double rho = args[4].getAs<double>();
+    double scale = args[5].getAs<double>();
+
+    if (expElogbeta.size() != lambda.size() || stats.size() != lambda.size())
+        throw std::invalid_argument("Topic-word arrays must have the same "
+            "length.");
+    if (!(eta > 0))
+        throw std::invalid_argument("Parameter eta of the topic-word "
+            "Dirichlet prior must be positive.");
+    if (!(rho > 0 && rho <= 1))
+        throw std::invalid_argument("Step size must be in (0, 1].");
+    if (!(scale >= 0) || !std::isfinite(scale))
+        throw std::invalid_argument("Scale of the mini-batch statistics must "
+            "be non-negative and finite.");
+
+    MutableArrayHandle<double> result = allocateArray<double>(lambda.size());
+    for (size_t i = 0; i < lambda.size(); i++)
+        result[i] = (1. - rho) * lambda[i]
+            + rho * (eta + scale * stats[i] * expElogbeta[i]);
+    return result;
+}
+
+/**
+ * @brief Infer the variational Dirichlet parameters of the topic
+ *     distribution of a document
+ */
+AnyType
+vb_doc_topics::run(AnyType &args) {
+    ArrayHandle<int32_t> doc = args[0].getAs<ArrayHandle<int32_t> >();
+    ArrayHandle<double> expElogbeta = cachedArrayArgument(1);
+    int32_t numTopics = args[2].getAs<int32_t>();
+    double alpha = args[3].getAs<double>();
+    int32_t numWords = vocabularySize(expElogbeta, numTopics);
+
+    DocumentInference inference(expElogbeta.ptr(), numTopics, numWords,
+        alpha);
+    inference.infer(doc);
+
+    const std::vector<double> &gamma = inference.topics();
+    MutableArrayHandle<double> result = allocateArray<double>(gamma.size());
+    std::copy(gamma.begin(), gamma.end(), result.ptr());
+    return result;
+}
+
+} // namespace lda
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,46 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file online_vb.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Online variational Bayes LDA: Draw the initial topic-word parameters
+ */
+DECLARE_UDF(lda, vb_random_lambda)
+
+/**
+ * @brief Online variational Bayes LDA: Compute exp(E[log beta]) of the
+ *     topic-word parameters
+ */
+DECLARE_UDF(lda, vb_exp_elog_beta)
+
+/**
+ * @brief Online variational Bayes LDA: Transition function for the E-step of
+ *     a mini-batch
+ */
+DECLARE_UDF(lda, vb_estep_transition)
+
+/**
+ * @brief Online variational Bayes LDA: State merge function for the E-step of
+ *     a mini-batch
+ */
+DECLARE_UDF(lda, vb_estep_merge_states)
+
+/**
+ * @brief Online variational Bayes LDA: Final function for the E-step of a
+ *     mini-batch
+ */
+DECLARE_UDF(lda, vb_estep_final)
+
+/**
+ * @brief Online variational Bayes LDA: Update the topic-word parameters with
+ *     the statistics of a mini-batch
+ */
+DECLARE_UDF(lda, vb_mstep)
+
+/**
+ * @brief Online variational Bayes LDA: Infer the topic parameters of a
+ *     document
+ */
+DECLARE_UDF(lda, vb_doc_topics)
@@ -6,4 +6,9 @@
  *
  *//* ----------------------------------------------------------------------- */
 
+#include "matrix_agg.hpp"
+#include "matrix_blocks.hpp"
 #include "metric.hpp"
+#include "sparse.hpp"
+#include "svd.hpp"
+#include "threads.hpp"
@@ -0,0 +1,292 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file matrix_agg.cpp
+ *
+ * @brief Aggregate rows into a two-dimensional array
+ *
+ * A block of rows is a DOUBLE PRECISION[][] with one inner array per row. As
+ * PostgreSQL represents a matrix as an array of columns (see
+ * EigenIntegration_impl.hpp), a block of \f$ n \f$ rows of width \f$ p \f$
+ * maps without copying to a \f$ p \times n \f$ MappedMatrix whose columns are
+ * the rows of the block.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+
+#include "matrix_agg.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace linalg {
+
+/**
+ * @brief Transition state for collecting the rows of a block
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * width, number of rows, followed by the rows. The array has room for more
+ * rows than it holds: Whenever it is full, it is replaced by one of twice the
+ * capacity, so that appending a row takes amortized constant time.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 2, and all elemenets are 0.
+ */
+template <class Handle>
+class MatrixAggTransitionState {
+    template <class OtherHandle>
+    friend class MatrixAggTransitionState;
+
+public:
+    MatrixAggTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind();
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inWidth) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inWidth, kInitialCapacity));
+        rebind();
+        width = inWidth;
+        numRows = 0;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return width > 0;
+    }
+
+    /**
+     * @brief Make sure there is room for the given number of additional rows
+     */
+    void reserve(const Allocator &inAllocator, uint64_t inNumAdditionalRows) {
+        uint64_t required = numRows + inNumAdditionalRows;
+        if (required <= capacity())
+            return;
+
+        uint64_t newCapacity = std::max<uint64_t>(2 * capacity(), required);
+        Handle newStorage = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(width, newCapacity));
+        std::copy(mStorage.ptr(), row(numRows), newStorage.ptr());
+        mStorage = newStorage;
+        rebind();
+    }
+
+    /**
+     * @brief Append a row. There must be room for it, see reserve().
+     */
+    void append(const double *inRow) {
+        std::copy(inRow, inRow + static_cast<uint32_t>(width), row(numRows));
+        ++numRows;
+    }
+
+    /**
+     * @brief Append all rows of another state. There must be room for them.
+     */
+    template <class OtherHandle>
+    void append(const MatrixAggTransitionState<OtherHandle> &inOtherState) {
+        if (width != inOtherState.width)
+            throw std::invalid_argument("Rows of a block must have the same "
+                "length.");
+
+        std::copy(inOtherState.row(0), inOtherState.row(inOtherState.numRows),
+            row(numRows));
+        numRows += inOtherState.numRows;
+    }
+
+    /**
+     * @brief Pointer to the first element of the given row
+     */
+    typename HandleTraits<Handle>::DoublePtr row(uint64_t inRow) const {
+        return const_cast<typename HandleTraits<Handle>::DoublePtr>(
+            mStorage.ptr() + 2 + inRow * static_cast<uint32_t>(width));
+    }
+
+private:
+    enum { kInitialCapacity = 16 };
+
+    static inline size_t arraySize(uint32_t inWidth, uint64_t inCapacity) {
+        return 2 + static_cast<size_t>(inWidth) * inCapacity;
+    }
+
+    uint64_t capacity() const {
+        return width == 0 ? 0 : (mStorage.size() - 2) / width;
+    }
+
+    void rebind() {
+        madlib_assert(mStorage.size() >= 2,
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        width.rebind(&mStorage[0]);
+        numRows.rebind(&mStorage[1]);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 width;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+};
+
+/**
+ * @brief Append a row to the block
+ */
+AnyType
+matrix_agg_transition::run(AnyType &args) {
+    MatrixAggTransitionState<MutableArrayHandle<double> > state = args[0];
+    MappedColumnVector row = args[1].getAs<MappedColumnVector>();
+
+    if (!state.isInitialized()) {
+        if (row.size() == 0)
+            throw std::invalid_argument("Rows of a block must not be empty.");
+        state.initialize(*this, static_cast<uint32_t>(row.size()));
+    } else if (static_cast<uint32_t>(row.size()) != state.width)
+        throw std::invalid_argument("Rows of a block must have the same "
+            "length.");
+
+    state.reserve(*this, 1);
+    state.append(row.data());
+    return state;
+}
+
+/**
+ * @brief Concatenate two blocks
+ */
+AnyType
+matrix_agg_merge::run(AnyType &args) {
+    MatrixAggTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    MatrixAggTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    else if (!stateRight.isInitialized())
+        return stateLeft;
+
+    stateLeft.reserve(*this, stateRight.numRows);
+    stateLeft.append(stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Return the block as two-dimensional array with one inner array per
+ *     row
+ */
+AnyType
+matrix_agg_final::run(AnyType &args) {
+    MatrixAggTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    MutableArrayHandle<double> result = allocateArray<double>(
+        state.numRows, state.width);
+    std::copy(state.row(0), state.row(state.numRows), result.ptr());
+    return result;
+}
+
+/**
+ * @brief Transition state of matrix_agg() when it is an internal state
+ *
+ * The storage holds room for \c capacity rows of \c width elements, of which
+ * the first \c numRows are used. As for MatrixAggTransitionState, the
+ * capacity doubles whenever the storage is full.
+ */
+struct MatrixAggInternalState {
+    enum { kInitialCapacity = 16 };
+
+    uint32_t width;
+    uint64_t numRows;
+    uint64_t capacity;
+
+    static std::size_t storageSize(uint32_t inWidth, uint64_t inCapacity) {
+        return static_cast<std::size_t>(inWidth) * inCapacity * sizeof(double);
+    }
+};
+
+/**
+ * @brief Append a row to the block held in an internal state
+ *
+ * The function is not strict, because the state is NULL before the first
+ * row. NULL rows are skipped.
+ */
+AnyType
+matrix_agg_internal_transition::run(AnyType &args) {
+    if (args[1].isNull())
+        return args[0];
+
+    MappedColumnVector row = args[1].getAs<MappedColumnVector>();
+    InternalState<MatrixAggInternalState> state;
+
+    if (args[0].isNull()) {
+        if (row.size() == 0)
+            throw std::invalid_argument("Rows of a block must not be empty.");
+
+        uint32_t width = static_cast<uint32_t>(row.size());
+        state = allocateInternalState<MatrixAggInternalState>(
+            MatrixAggInternalState::storageSize(width,
+                MatrixAggInternalState::kInitialCapacity));
+        state->width = width;
+        state->numRows = 0;
+        state->capacity = MatrixAggInternalState::kInitialCapacity;
+    } else {
+        state = args[0].getAs<InternalState<MatrixAggInternalState> >();
+        if (static_cast<uint32_t>(row.size()) != state->width)
+            throw std::invalid_argument("Rows of a block must have the same "
+                "length.");
+    }
+
+    if (state->numRows == state->capacity) {
+        uint64_t newCapacity = 2 * state->capacity;
+        state = reallocateInternalState(state,
+            MatrixAggInternalState::storageSize(state->width, newCapacity));
+        state->capacity = newCapacity;
+    }
+
+    std::copy(row.data(), row.data() + state->width,
+        state.storage<double>() + state->numRows * state->width);
+    ++state->numRows;
+    return state;
+}
+
+/**
+ * @brief Return the block held in an internal state as two-dimensional array
+ */
+AnyType
+matrix_agg_internal_final::run(AnyType &args) {
+    if (args[0].isNull())
+        return Null();
+
+    InternalState<MatrixAggInternalState> state
+        = args[0].getAs<InternalState<MatrixAggInternalState> >();
+    MutableArrayHandle<double> result = allocateArray<double>(
+        state->numRows, state->width);
+    std::copy(state.storage<double>(),
+        state.storage<double>() + state->numRows * state->width,
+        result.ptr());
+    return result;
+}
+
+} // namespace linalg
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,32 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file matrix_agg.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Aggregate rows into a two-dimensional array: Transition function
+ */
+DECLARE_UDF(linalg, matrix_agg_transition)
+
+/**
+ * @brief Aggregate rows into a two-dimensional array: State merge function
+ */
+DECLARE_UDF(linalg, matrix_agg_merge)
+
+/**
+ * @brief Aggregate rows into a two-dimensional array: Final function
+ */
+DECLARE_UDF(linalg, matrix_agg_final)
+
+/**
+ * @brief Aggregate rows into a two-dimensional array: Transition function for
+ *     an internal state
+ */
+DECLARE_UDF(linalg, matrix_agg_internal_transition)
+
+/**
+ * @brief Aggregate rows into a two-dimensional array: Final function for an
+ *     internal state
+ */
+DECLARE_UDF(linalg, matrix_agg_internal_final)
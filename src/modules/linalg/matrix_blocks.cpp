@@ -0,0 +1,276 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file matrix_blocks.cpp
+ *
+ * @brief Blocked matrices: Assembling and multiplying blocks
+ *
+ * A blocked matrix is a table with one dense DOUBLE PRECISION[][] block per
+ * (row_id, col_id) tile, with one inner array per row of the tile. As for
+ * matrix_agg(), a block of \f$ r \f$ rows and \f$ c \f$ columns maps without
+ * copying to the \f$ c \times r \f$ transpose. The product \f$ AB \f$ of two
+ * blocks therefore is the transpose of \f$ B^T A^T \f$, which Eigen computes
+ * with a single matrix-matrix product (GEMM).
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+
+#include "matrix_blocks.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace linalg {
+
+/**
+ * @brief Transition state for assembling a block, or for the sum of products
+ *     of blocks
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * numRows, numCols, followed by the entries of the block in row-major order
+ * (that is, its transpose in column-major order).
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 2, and all elemenets are 0.
+ */
+template <class Handle>
+class MatrixBlockTransitionState {
+    template <class OtherHandle>
+    friend class MatrixBlockTransitionState;
+
+public:
+    MatrixBlockTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]),
+            static_cast<uint32_t>(mStorage[1]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inNumRows,
+        uint32_t inNumCols) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inNumRows, inNumCols));
+        rebind(inNumRows, inNumCols);
+        numRows = inNumRows;
+        numCols = inNumCols;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return numRows > 0;
+    }
+
+    /**
+     * @brief Make sure that the dimensions of the block are the given ones
+     */
+    void initializeOrCheck(const Allocator &inAllocator, int32_t inNumRows,
+        int32_t inNumCols) {
+
+        if (!isInitialized()) {
+            if (inNumRows < 1 || inNumCols < 1)
+                throw std::invalid_argument("Dimensions of a block must be "
+                    "positive.");
+            initialize(inAllocator, static_cast<uint32_t>(inNumRows),
+                static_cast<uint32_t>(inNumCols));
+        } else if (static_cast<uint32_t>(inNumRows) != numRows
+            || static_cast<uint32_t>(inNumCols) != numCols)
+            throw std::invalid_argument("Dimensions of a block must be the "
+                "same for all rows.");
+    }
+
+    /**
+     * @brief Merge with another state object
+     */
+    template <class OtherHandle>
+    MatrixBlockTransitionState &operator+=(
+        const MatrixBlockTransitionState<OtherHandle> &inOtherState) {
+
+        if (numRows != inOtherState.numRows || numCols != inOtherState.numCols)
+            throw std::invalid_argument("Dimensions of a block must be the "
+                "same for all rows.");
+
+        blockTransp += inOtherState.blockTransp;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inNumRows, uint32_t inNumCols) {
+        return 2 + static_cast<size_t>(inNumRows) * inNumCols;
+    }
+
+    void rebind(uint32_t inNumRows, uint32_t inNumCols) {
+        madlib_assert(mStorage.size() >= arraySize(inNumRows, inNumCols),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        numRows.rebind(&mStorage[0]);
+        numCols.rebind(&mStorage[1]);
+        // The block is empty before the first row, so compute the pointer
+        // without going through the bounds-checked Handle::operator[]
+        blockTransp.rebind(mStorage.ptr() + 2, inNumCols, inNumRows);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numCols;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap blockTransp;
+};
+
+/**
+ * @brief Map a block to its transpose
+ */
+inline
+MappedMatrix
+transposedBlock(const ArrayHandle<double> &inBlock) {
+    if (inBlock.dims() != 2)
+        throw std::invalid_argument("Blocks must be two-dimensional arrays.");
+
+    return MappedMatrix(inBlock, static_cast<Index>(inBlock.sizeOfDim(1)),
+        static_cast<Index>(inBlock.sizeOfDim(0)));
+}
+
+/**
+ * @brief Add a cell to a block
+ *
+ * Row and column are 1-based positions within the block. Cells that occur
+ * more than once are summed.
+ */
+AnyType
+matrix_block_cell_transition::run(AnyType &args) {
+    MatrixBlockTransitionState<MutableArrayHandle<double> > state = args[0];
+    int32_t row = args[1].getAs<int32_t>();
+    int32_t col = args[2].getAs<int32_t>();
+    double value = args[3].getAs<double>();
+
+    state.initializeOrCheck(*this, args[4].getAs<int32_t>(),
+        args[5].getAs<int32_t>());
+    if (row < 1 || static_cast<uint32_t>(row) > state.numRows
+        || col < 1 || static_cast<uint32_t>(col) > state.numCols)
+        throw std::invalid_argument("Cell is outside of its block.");
+
+    state.blockTransp(col - 1, row - 1) += value;
+    return state;
+}
+
+/**
+ * @brief Add a slice of a row to a block
+ *
+ * The slice starts at the 1-based position (row, col) within the block.
+ * Entries that occur more than once are summed.
+ */
+AnyType
+matrix_block_slice_transition::run(AnyType &args) {
+    MatrixBlockTransitionState<MutableArrayHandle<double> > state = args[0];
+    int32_t row = args[1].getAs<int32_t>();
+    int32_t col = args[2].getAs<int32_t>();
+    MappedColumnVector slice = args[3].getAs<MappedColumnVector>();
+
+    state.initializeOrCheck(*this, args[4].getAs<int32_t>(),
+        args[5].getAs<int32_t>());
+    if (row < 1 || static_cast<uint32_t>(row) > state.numRows
+        || col < 1 || col - 1 + slice.size() > state.numCols)
+        throw std::invalid_argument("Row slice is outside of its block.");
+
+    state.blockTransp.col(row - 1).segment(col - 1, slice.size()) += slice;
+    return state;
+}
+
+/**
+ * @brief Add the product of two blocks
+ */
+AnyType
+matrix_block_mult_transition::run(AnyType &args) {
+    MatrixBlockTransitionState<MutableArrayHandle<double> > state = args[0];
+    MappedMatrix aTransp = transposedBlock(
+        args[1].getAs<ArrayHandle<double> >());
+    MappedMatrix bTransp = transposedBlock(
+        args[2].getAs<ArrayHandle<double> >());
+
+    if (aTransp.rows() != bTransp.cols())
+        throw std::invalid_argument("Blocks have incompatible dimensions for "
+            "multiplication.");
+    state.initializeOrCheck(*this, static_cast<int32_t>(aTransp.cols()),
+        static_cast<int32_t>(bTransp.rows()));
+
+    // (A B)^T = B^T A^T
+    state.blockTransp.noalias() += bTransp * aTransp;
+    return state;
+}
+
+/**
+ * @brief Merge two blocks
+ */
+AnyType
+matrix_block_merge::run(AnyType &args) {
+    MatrixBlockTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    MatrixBlockTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    else if (!stateRight.isInitialized())
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Return the block as two-dimensional array with one inner array per
+ *     row
+ */
+AnyType
+matrix_block_final::run(AnyType &args) {
+    MatrixBlockTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    MutableArrayHandle<double> result = allocateArray<double>(
+        state.numRows, state.numCols);
+    std::copy(state.blockTransp.data(),
+        state.blockTransp.data() + state.blockTransp.size(), result.ptr());
+    return result;
+}
+
+/**
+ * @brief Return the row of a block with the given 1-based index
+ */
+AnyType
+matrix_block_row::run(AnyType &args) {
+    MappedMatrix blockTransp = transposedBlock(
+        args[0].getAs<ArrayHandle<double> >());
+    int32_t row = args[1].getAs<int32_t>();
+
+    if (row < 1 || row > blockTransp.cols())
+        throw std::invalid_argument("Row is outside of the block.");
+
+    MutableMappedColumnVector result(
+        allocateArray<double>(blockTransp.rows()));
+    result = blockTransp.col(row - 1);
+    return result;
+}
+
+} // namespace linalg
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,35 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file matrix_blocks.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Assemble a block from cells: Transition function
+ */
+DECLARE_UDF(linalg, matrix_block_cell_transition)
+
+/**
+ * @brief Assemble a block from row slices: Transition function
+ */
+DECLARE_UDF(linalg, matrix_block_slice_transition)
+
+/**
+ * @brief Sum of products of blocks: Transition function
+ */
+DECLARE_UDF(linalg, matrix_block_mult_transition)
+
+/**
+ * @brief Assemble or multiply blocks: State merge function
+ */
+DECLARE_UDF(linalg, matrix_block_merge)
+
+/**
+ * @brief Assemble or multiply blocks: Final function
+ */
+DECLARE_UDF(linalg, matrix_block_final)
+
+/**
+ * @brief Extract a row of a block
+ */
+DECLARE_UDF(linalg, matrix_block_row)
@@ -8,7 +8,11 @@
 
 #include <dbconnector/dbconnector.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 #include "metric.hpp"
+#include "metric_impl.hpp"
 
 namespace madlib {
 
@@ -19,28 +23,6 @@ namespace modules {
 
 namespace linalg {
 
-template <class Derived, class OtherDerived>
-std::tuple<Index, double>
-closestColumnAndDistance(
-    const Eigen::MatrixBase<Derived>& inMatrix,
-    const Eigen::MatrixBase<OtherDerived>& inVector,
-    FunctionHandle& inMetric) {
-
-    Index closestColumn = 0;
-    double minDist = std::numeric_limits<double>::infinity();
-
-    for (Index i = 0; i < inMatrix.cols(); ++i) {
-        double currentDist
-            = inMetric(inMatrix.col(i), inVector).template getAs<double>();
-        if (currentDist < minDist) {
-            closestColumn = i;
-            minDist = currentDist;
-        }
-    }
-
-    return std::tuple<Index, double>(closestColumn, minDist);
-}
-
 /**
  * @brief Compute the minimum distance between a vector and any column of a
  *     matrix
@@ -59,6 +41,35 @@ closest_column::run(AnyType& args) {
         << std::get<1>(result);
 }
 
+/**
+ * @brief Compute the k columns of a matrix that are closest to a vector
+ */
+AnyType
+closest_columns::run(AnyType& args) {
+    MappedMatrix M = args[0].getAs<MappedMatrix>();
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+    int32_t k = args[2].getAs<int32_t>();
+    FunctionHandle dist = args[3].getAs<FunctionHandle>();
+
+    if (k < 1)
+        throw std::invalid_argument("Number of closest columns must be "
+            "positive.");
+
+    std::vector<std::pair<double, Index> > closest
+        = closestColumnsAndDistances(M, x, dist, static_cast<std::size_t>(k));
+
+    MutableArrayHandle<int32_t> columnIds
+        = allocateArray<int32_t>(closest.size());
+    MutableMappedColumnVector distances(
+        allocateArray<double>(closest.size()));
+    for (std::size_t i = 0; i < closest.size(); ++i) {
+        columnIds[i] = static_cast<int32_t>(closest[i].second);
+        distances(i) = closest[i].first;
+    }
+
+    AnyType tuple;
+    return tuple << columnIds << distances;
+}
 
 AnyType
 norm2::run(AnyType& args) {
@@ -115,6 +126,257 @@ squared_dist_norm1::run(AnyType& args) {
     return l1norm * l1norm;
 }
 
+AnyType
+dist_cosine::run(AnyType& args) {
+    MappedColumnVector x = args[0].getAs<MappedColumnVector>();
+    MappedColumnVector y = args[1].getAs<MappedColumnVector>();
+
+    if (x.size() != y.size())
+        throw std::invalid_argument("Invalid arguments: Vectors must have "
+            "the same length.");
+    double normProduct = x.norm() * y.norm();
+    if (normProduct == 0)
+        throw std::invalid_argument("Cosine distance is undefined for zero "
+            "vectors.");
+
+    return 1. - x.dot(y) / normProduct;
+}
+
+namespace {
+
+/**
+ * @brief Verify that two single-precision vectors have the same length
+ *
+ * The metrics for \c REAL[] load single-precision values but convert each
+ * element to double precision before accumulating, so that results for long
+ * vectors are as accurate as with <tt>DOUBLE PRECISION[]</tt> input.
+ */
+void
+checkSameLength(const MappedFloatColumnVector& inX,
+    const MappedFloatColumnVector& inY) {
+
+    if (inX.size() != inY.size())
+        throw std::invalid_argument("Invalid arguments: Vectors must have "
+            "the same length.");
+}
+
+} // anonymous namespace
+
+AnyType
+norm2_float::run(AnyType& args) {
+    return static_cast<double>(
+        args[0].getAs<MappedFloatColumnVector>().cast<double>().norm());
+}
+
+AnyType
+norm1_float::run(AnyType& args) {
+    return static_cast<double>(
+        args[0].getAs<MappedFloatColumnVector>().cast<double>().lpNorm<1>());
+}
+
+AnyType
+dist_norm2_float::run(AnyType& args) {
+    MappedFloatColumnVector x = args[0].getAs<MappedFloatColumnVector>();
+    MappedFloatColumnVector y = args[1].getAs<MappedFloatColumnVector>();
+    checkSameLength(x, y);
+
+    return static_cast<double>( (x.cast<double>() - y.cast<double>()).norm() );
+}
+
+AnyType
+dist_norm1_float::run(AnyType& args) {
+    MappedFloatColumnVector x = args[0].getAs<MappedFloatColumnVector>();
+    MappedFloatColumnVector y = args[1].getAs<MappedFloatColumnVector>();
+    checkSameLength(x, y);
+
+    return static_cast<double>(
+        (x.cast<double>() - y.cast<double>()).lpNorm<1>() );
+}
+
+AnyType
+squared_dist_norm2_float::run(AnyType& args) {
+    MappedFloatColumnVector x = args[0].getAs<MappedFloatColumnVector>();
+    MappedFloatColumnVector y = args[1].getAs<MappedFloatColumnVector>();
+    checkSameLength(x, y);
+
+    return static_cast<double>(
+        (x.cast<double>() - y.cast<double>()).squaredNorm() );
+}
+
+AnyType
+squared_dist_norm1_float::run(AnyType& args) {
+    MappedFloatColumnVector x = args[0].getAs<MappedFloatColumnVector>();
+    MappedFloatColumnVector y = args[1].getAs<MappedFloatColumnVector>();
+    checkSameLength(x, y);
+    double l1norm = (x.cast<double>() - y.cast<double>()).lpNorm<1>();
+
+    return l1norm * l1norm;
+}
+
+namespace {
+
+/**
+ * @brief Number of points per tile in pairwise_distances()
+ *
+ * A tile of the result and the two sets of points it is computed from then
+ * fit into the L2 cache for up to a few hundred dimensions.
+ */
+const Index kPairwiseTileSize = 64;
+
+/**
+ * @brief Map a two-dimensional array with one inner array per point to the
+ *     matrix whose columns are the points
+ */
+MappedMatrix
+pointsOfArray(const ArrayHandle<double>& inArray) {
+    if (inArray.dims() != 2)
+        throw std::invalid_argument("Invalid arguments: Points must be given "
+            "as two-dimensional array.");
+
+    return MappedMatrix(inArray, static_cast<Index>(inArray.sizeOfDim(1)),
+        static_cast<Index>(inArray.sizeOfDim(0)));
+}
+
+/**
+ * @brief Compute a tile of the distances between the columns of two matrices
+ *
+ * The tile (which has been resized by the caller) contains the distances \f$ \operatorname{dist}(a_i, b_j) \f$ for
+ * columns \f$ a_i \f$ of \c inA and \f$ b_j \f$ of \c inB, where
+ * \f$ b_j \f$ varies along the rows of the tile. For the Euclidean and cosine
+ * distances, the bulk of the work is the GEMM \f$ B^T A \f$ of the tile,
+ * using the precomputed norms of all columns. As in columnDistances(), the
+ * Euclidean distances are therefore not bit-for-bit identical to
+ * dist_norm2(); negative squared distances due to cancellation are set to 0.
+ */
+void
+pairwiseDistanceTile(BuiltinMetric inMetric, const MappedMatrix& inA,
+    const MappedMatrix& inB, const ColumnVector& inNormsA,
+    const ColumnVector& inNormsB, Index inFirstA, Index inFirstB,
+    Matrix& outTile) {
+
+    Index numA = outTile.cols();
+    Index numB = outTile.rows();
+
+    switch (inMetric) {
+        case kDistNorm1:
+        case kSquaredDistNorm1:
+            // The columns of A in this tile remain in cache while the columns
+            // of B are swept. Eigen vectorizes the inner expression.
+            for (Index i = 0; i < numA; ++i)
+                for (Index j = 0; j < numB; ++j) {
+                    double l1norm = (inA.col(inFirstA + i)
+                        - inB.col(inFirstB + j)).cwiseAbs().sum();
+                    outTile(j, i) = inMetric == kDistNorm1
+                        ? l1norm : l1norm * l1norm;
+                }
+            break;
+        case kDistNorm2:
+        case kSquaredDistNorm2:
+            outTile.noalias() = trans(inB.middleCols(inFirstB, numB))
+                * inA.middleCols(inFirstA, numA);
+            for (Index i = 0; i < numA; ++i)
+                for (Index j = 0; j < numB; ++j) {
+                    double squaredDist = inNormsA(inFirstA + i)
+                        + inNormsB(inFirstB + j) - 2 * outTile(j, i);
+                    squaredDist = std::max(squaredDist, 0.);
+                    outTile(j, i) = inMetric == kDistNorm2
+                        ? std::sqrt(squaredDist) : squaredDist;
+                }
+            break;
+        case kDistCosine:
+            outTile.noalias() = trans(inB.middleCols(inFirstB, numB))
+                * inA.middleCols(inFirstA, numA);
+            for (Index i = 0; i < numA; ++i)
+                for (Index j = 0; j < numB; ++j)
+                    outTile(j, i) = 1. - outTile(j, i)
+                        / (inNormsA(inFirstA + i) * inNormsB(inFirstB + j));
+            break;
+        default:
+            throw std::logic_error("Unknown built-in metric in "
+                "pairwiseDistanceTile().");
+    }
+}
+
+/**
+ * @brief Norms of the columns of a matrix as needed by pairwiseDistanceTile()
+ */
+ColumnVector
+columnNormsForMetric(BuiltinMetric inMetric, const MappedMatrix& inMatrix) {
+    switch (inMetric) {
+        case kDistNorm2:
+        case kSquaredDistNorm2:
+            return inMatrix.colwise().squaredNorm().transpose();
+        case kDistCosine: {
+            ColumnVector norms = inMatrix.colwise().norm().transpose();
+            if (norms.minCoeff() == 0)
+                throw std::invalid_argument("Cosine distance is undefined "
+                    "for zero vectors.");
+            return norms;
+        }
+        default:
+            return ColumnVector();
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Compute the distances between all points of two sets
+ *
+ * Both sets are two-dimensional arrays with one inner array per point. The
+ * result has one inner array per point of the first set, containing the
+ * distances to all points of the second set. For the built-in metrics, the
+ * distances are computed in tiles of kPairwiseTileSize x kPairwiseTileSize
+ * pairs. Other metrics are called once per pair, but without any detoasting
+ * or conversion of the points beyond the first call.
+ */
+AnyType
+pairwise_distances::run(AnyType& args) {
+    MappedMatrix A = pointsOfArray(args[0].getAs<ArrayHandle<double> >());
+    MappedMatrix B = pointsOfArray(args[1].getAs<ArrayHandle<double> >());
+    FunctionHandle dist = args[2].getAs<FunctionHandle>();
+
+    if (A.rows() != B.rows())
+        throw std::invalid_argument("Invalid arguments: Points must have the "
+            "same number of dimensions.");
+
+    MutableArrayHandle<double> result = allocateArray<double>(
+        A.cols(), B.cols());
+    // Column i of distTransp holds the distances of point i of A
+    MutableMappedMatrix distTransp(result, B.cols(), A.cols());
+
+    PreparedFunctionCall metricCall(dist, 2);
+    metricCall.setArgument(0, A.col(0));
+    metricCall.setArgument(1, B.col(0));
+    distTransp(0, 0) = metricCall.invoke().getAs<double>();
+
+    // After the first call, we know whether the metric is built-in
+    BuiltinMetric metric = builtinMetric(dist);
+    if (metric != kUnknownMetric) {
+        ColumnVector normsA = columnNormsForMetric(metric, A);
+        ColumnVector normsB = columnNormsForMetric(metric, B);
+        Matrix tile;
+
+        for (Index i = 0; i < A.cols(); i += kPairwiseTileSize)
+            for (Index j = 0; j < B.cols(); j += kPairwiseTileSize) {
+                tile.resize(std::min(kPairwiseTileSize, B.cols() - j),
+                    std::min(kPairwiseTileSize, A.cols() - i));
+                pairwiseDistanceTile(metric, A, B, normsA, normsB, i, j, tile);
+                distTransp.block(j, i, tile.rows(), tile.cols()) = tile;
+            }
+    } else {
+        for (Index i = 0; i < A.cols(); ++i) {
+            metricCall.setArgument(0, A.col(i));
+            for (Index j = i == 0 ? 1 : 0; j < B.cols(); ++j) {
+                metricCall.setArgument(1, B.col(j));
+                distTransp(j, i) = metricCall.invoke().getAs<double>();
+            }
+        }
+    }
+
+    return result;
+}
+
 } // namespace linalg
 
 } // namespace modules
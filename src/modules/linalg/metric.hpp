@@ -9,6 +9,11 @@
  */
 DECLARE_UDF(linalg, closest_column)
 
+/**
+ * @brief Find the k columns in a matrix that are closest to a vector
+ */
+DECLARE_UDF(linalg, closest_columns)
+
 
 /**
  * @brief Compute the 2-norm
@@ -40,6 +45,48 @@ DECLARE_UDF(linalg, squared_dist_norm2)
  */
 DECLARE_UDF(linalg, squared_dist_norm1)
 
+/**
+ * @brief Compute the cosine distance between two dense vectors
+ */
+DECLARE_UDF(linalg, dist_cosine)
+
+/**
+ * @brief Compute the distances between all pairs of columns of two matrices
+ */
+DECLARE_UDF(linalg, pairwise_distances)
+
+/**
+ * @brief Compute the 2-norm of a single-precision vector
+ */
+DECLARE_UDF(linalg, norm2_float)
+
+/**
+ * @brief Compute the 1-norm of a single-precision vector
+ */
+DECLARE_UDF(linalg, norm1_float)
+
+/**
+ * @brief Compute the Euclidean distance between two single-precision vectors
+ */
+DECLARE_UDF(linalg, dist_norm2_float)
+
+/**
+ * @brief Compute the Manhattan distance between two single-precision vectors
+ */
+DECLARE_UDF(linalg, dist_norm1_float)
+
+/**
+ * @brief Compute the squared Euclidean distance between two single-precision
+ *     vectors
+ */
+DECLARE_UDF(linalg, squared_dist_norm2_float)
+
+/**
+ * @brief Compute the squared Manhattan distance between two single-precision
+ *     vectors
+ */
+DECLARE_UDF(linalg, squared_dist_norm1_float)
+
 
 #ifndef MADLIB_MODULES_LINALG_LINALG_HPP
 #define MADLIB_MODULES_LINALG_LINALG_HPP
@@ -55,6 +102,12 @@ std::tuple<dbal::eigen_integration::Index, double>
 closestColumnAndDistance(const Eigen::MatrixBase<Derived>& inMatrix,
     const Eigen::MatrixBase<OtherDerived>& inVector, FunctionHandle& inMetric);
 
+template <typename Derived, typename OtherDerived>
+std::vector<std::pair<double, dbal::eigen_integration::Index> >
+closestColumnsAndDistances(const Eigen::MatrixBase<Derived>& inMatrix,
+    const Eigen::MatrixBase<OtherDerived>& inVector, FunctionHandle& inMetric,
+    std::size_t inNumClosest);
+
 } // namespace linalg
 
 } // namespace modules
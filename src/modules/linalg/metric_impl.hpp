@@ -0,0 +1,245 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file metric_impl.hpp
+ *
+ * @brief Closest-column kernels, shared with modules that search columns of a
+ *     matrix
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_MODULES_LINALG_METRIC_IMPL_HPP
+#define MADLIB_MODULES_LINALG_METRIC_IMPL_HPP
+
+#include <algorithm>
+#include <vector>
+
+namespace madlib {
+
+namespace modules {
+
+namespace linalg {
+
+using dbal::eigen_integration::ColumnVector;
+using dbal::eigen_integration::Index;
+using dbal::eigen_integration::trans;
+
+/**
+ * @brief Metrics for which closestColumnAndDistance() has a native kernel
+ */
+enum BuiltinMetric {
+    kUnknownMetric = 0,
+    kDistNorm1,
+    kDistNorm2,
+    kSquaredDistNorm1,
+    kSquaredDistNorm2,
+    kDistCosine
+};
+
+/**
+ * @brief Determine whether a function handle refers to a built-in metric
+ *
+ * The C++ function behind a handle is only known after the function has been
+ * called through the backend once. Callers should therefore invoke the handle
+ * at least once before calling this function.
+ */
+inline
+BuiltinMetric
+builtinMetric(const FunctionHandle& inMetric) {
+    typedef dbconnector::postgres::UDF UDF;
+
+    FunctionHandle::Pointer func = inMetric.funcPtr();
+    if (func == NULL)
+        return kUnknownMetric;
+    else if (func == &UDF::invoke<dist_norm1>)
+        return kDistNorm1;
+    else if (func == &UDF::invoke<dist_norm2>)
+        return kDistNorm2;
+    else if (func == &UDF::invoke<squared_dist_norm1>)
+        return kSquaredDistNorm1;
+    else if (func == &UDF::invoke<squared_dist_norm2>)
+        return kSquaredDistNorm2;
+    else if (func == &UDF::invoke<dist_cosine>)
+        return kDistCosine;
+
+    return kUnknownMetric;
+}
+
+/**
+ * @brief Compute the distances between a vector and all columns of a matrix
+ *
+ * For the (squared) Euclidean distance, we use
+ * \f$ \| c - x \|^2 = \| c \|^2 - 2 c^T x + \| x \|^2 \f$, so that the
+ * bulk of the work is a single matrix-vector product. The result is therefore
+ * not bit-for-bit identical to squared_dist_norm2() (and may even be slightly
+ * negative due to cancellation). It should only be used for finding the
+ * minimum.
+ */
+template <class Derived, class OtherDerived>
+ColumnVector
+columnDistances(BuiltinMetric inMetric,
+    const Eigen::MatrixBase<Derived>& inMatrix,
+    const Eigen::MatrixBase<OtherDerived>& inVector) {
+
+    ColumnVector dist;
+
+    switch (inMetric) {
+        case kDistNorm1:
+        case kSquaredDistNorm1:
+            dist = (inMatrix.colwise() - inVector).cwiseAbs().colwise().sum()
+                .transpose();
+            break;
+        case kDistNorm2:
+        case kSquaredDistNorm2:
+            dist = inMatrix.colwise().squaredNorm().transpose();
+            dist.noalias() -= 2 * trans(inMatrix) * inVector;
+            dist.array() += inVector.squaredNorm();
+            break;
+        case kDistCosine: {
+            ColumnVector norms = inMatrix.colwise().norm().transpose();
+            double vectorNorm = inVector.norm();
+            if (vectorNorm == 0 || norms.minCoeff() == 0)
+                throw std::invalid_argument("Cosine distance is undefined "
+                    "for zero vectors.");
+            dist.noalias() = trans(inMatrix) * inVector;
+            dist.array() /= norms.array() * vectorNorm;
+            dist.array() = -dist.array() + 1.;
+            break;
+        }
+        default:
+            throw std::logic_error("Unknown built-in metric in "
+                "columnDistances().");
+    }
+    return dist;
+}
+
+typedef std::pair<double, Index> DistanceAndColumn;
+
+/**
+ * @brief Insert a candidate into a max-heap that holds at most inMaxSize
+ *     elements
+ *
+ * The heap keeps the inMaxSize smallest candidates seen so far. Since pairs
+ * are compared lexicographically, ties are broken in favor of the smaller
+ * column index.
+ */
+inline
+void
+pushBounded(std::vector<DistanceAndColumn>& ioHeap, std::size_t inMaxSize,
+    const DistanceAndColumn& inCandidate) {
+
+    if (ioHeap.size() < inMaxSize) {
+        ioHeap.push_back(inCandidate);
+        std::push_heap(ioHeap.begin(), ioHeap.end());
+    } else if (inCandidate < ioHeap.front()) {
+        std::pop_heap(ioHeap.begin(), ioHeap.end());
+        ioHeap.back() = inCandidate;
+        std::push_heap(ioHeap.begin(), ioHeap.end());
+    }
+}
+
+/**
+ * @brief Find the column of a matrix closest to a vector
+ *
+ * If the metric is one of the built-in distance functions, all distances are
+ * computed at once with Eigen instead of calling the metric through the
+ * backend once per column.
+ */
+template <class Derived, class OtherDerived>
+std::tuple<Index, double>
+closestColumnAndDistance(
+    const Eigen::MatrixBase<Derived>& inMatrix,
+    const Eigen::MatrixBase<OtherDerived>& inVector,
+    FunctionHandle& inMetric) {
+
+    Index closestColumn = 0;
+    double minDist = std::numeric_limits<double>::infinity();
+
+    // The vector is the same in all calls, so it is converted only once
+    PreparedFunctionCall metricCall(inMetric, 2);
+    metricCall.setArgument(1, inVector);
+
+    for (Index i = 0; i < inMatrix.cols(); ++i) {
+        metricCall.setArgument(0, inMatrix.col(i));
+        double currentDist = metricCall.invoke().template getAs<double>();
+        if (currentDist < minDist) {
+            closestColumn = i;
+            minDist = currentDist;
+        }
+
+        // After the first call, we know whether the metric is built-in
+        BuiltinMetric metric = i == 0 ? builtinMetric(inMetric)
+                                      : kUnknownMetric;
+        if (metric != kUnknownMetric && inMatrix.cols() > 1) {
+            columnDistances(metric, inMatrix, inVector)
+                .minCoeff(&closestColumn);
+
+            // Recompute the exact distance for the closest column, so that
+            // the result agrees with calling the metric directly
+            metricCall.setArgument(0, inMatrix.col(closestColumn));
+            minDist = metricCall.invoke().template getAs<double>();
+            break;
+        }
+    }
+
+    return std::tuple<Index, double>(closestColumn, minDist);
+}
+
+/**
+ * @brief Find the inNumClosest columns of a matrix closest to a vector
+ *
+ * All columns are scanned once, keeping the closest columns in a bounded
+ * heap. The result is sorted by increasing distance (and column index in case
+ * of ties). It contains fewer than inNumClosest elements if the matrix has
+ * fewer columns.
+ */
+template <class Derived, class OtherDerived>
+std::vector<std::pair<double, Index> >
+closestColumnsAndDistances(
+    const Eigen::MatrixBase<Derived>& inMatrix,
+    const Eigen::MatrixBase<OtherDerived>& inVector,
+    FunctionHandle& inMetric,
+    std::size_t inNumClosest) {
+
+    std::vector<DistanceAndColumn> closest;
+    closest.reserve(std::min(inNumClosest,
+        static_cast<std::size_t>(inMatrix.cols())));
+
+    // The vector is the same in all calls, so it is converted only once
+    PreparedFunctionCall metricCall(inMetric, 2);
+    metricCall.setArgument(1, inVector);
+
+    for (Index i = 0; i < inMatrix.cols(); ++i) {
+        metricCall.setArgument(0, inMatrix.col(i));
+        double currentDist = metricCall.invoke().template getAs<double>();
+        pushBounded(closest, inNumClosest, DistanceAndColumn(currentDist, i));
+
+        // After the first call, we know whether the metric is built-in
+        BuiltinMetric metric = i == 0 ? builtinMetric(inMetric)
+                                      : kUnknownMetric;
+        if (metric != kUnknownMetric && inMatrix.cols() > 1) {
+            ColumnVector dist = columnDistances(metric, inMatrix, inVector);
+            closest.clear();
+            for (Index j = 0; j < dist.size(); ++j)
+                pushBounded(closest, inNumClosest, DistanceAndColumn(dist(j), j));
+
+            // Recompute the exact distances for the closest columns, so that
+            // the result agrees with calling the metric directly
+            for (std::size_t j = 0; j < closest.size(); ++j) {
+                metricCall.setArgument(0, inMatrix.col(closest[j].second));
+                closest[j].first = metricCall.invoke().template getAs<double>();
+            }
+            break;
+        }
+    }
+
+    std::sort(closest.begin(), closest.end());
+    return closest;
+}
+
+} // namespace linalg
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_MODULES_LINALG_METRIC_IMPL_HPP)
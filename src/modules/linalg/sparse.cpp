@@ -0,0 +1,140 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file sparse.cpp
+ *
+ * @brief Compressed sparse matrices
+ *
+ * A sparse matrix is stored as a byte string that C++ functions map without
+ * copying as a MappedSparseMatrix (see SparseHandleMap_proto.hpp). As for
+ * dense matrices, the rows of the matrix in the database are the columns of
+ * the Eigen matrix.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "sparse.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace linalg {
+
+/**
+ * @brief Construct a sparse matrix from the coordinates of its nonzeros
+ *
+ * Row and column ids are 1-based. Values of duplicate coordinates are added.
+ */
+AnyType
+sparse_matrix::run(AnyType& args) {
+    int32_t numRows = args[0].getAs<int32_t>();
+    int32_t numCols = args[1].getAs<int32_t>();
+    ArrayHandle<int32_t> rowIds = args[2].getAs<ArrayHandle<int32_t> >();
+    ArrayHandle<int32_t> colIds = args[3].getAs<ArrayHandle<int32_t> >();
+    MappedColumnVector values = args[4].getAs<MappedColumnVector>();
+
+    if (numRows < 0 || numCols < 0)
+        throw std::invalid_argument("Dimensions of sparse matrix must not be "
+            "negative.");
+    if (rowIds.size() != colIds.size()
+        || rowIds.size() != static_cast<std::size_t>(values.size()))
+        throw std::invalid_argument("Row ids, column ids, and values must "
+            "have the same length.");
+
+    // Sort by row of the database (column of Eigen), then by column
+    std::vector<std::pair<std::pair<int32_t, int32_t>, double> > entries;
+    entries.reserve(rowIds.size());
+    for (std::size_t i = 0; i < rowIds.size(); ++i) {
+        if (rowIds[i] < 1 || rowIds[i] > numRows
+            || colIds[i] < 1 || colIds[i] > numCols)
+            throw std::invalid_argument("Coordinates of sparse matrix out of "
+                "range.");
+        entries.push_back(std::make_pair(
+            std::make_pair(rowIds[i] - 1, colIds[i] - 1), values(i)));
+    }
+    std::sort(entries.begin(), entries.end());
+
+    SparseMatrix matrix(numCols, numRows);
+    matrix.reserve(static_cast<Index>(entries.size()));
+    std::size_t pos = 0;
+    for (int32_t j = 0; j < numRows; ++j) {
+        matrix.startVec(j);
+        while (pos < entries.size() && entries[pos].first.first == j) {
+            std::pair<int32_t, int32_t> coords = entries[pos].first;
+            double value = 0;
+            for (; pos < entries.size() && entries[pos].first == coords; ++pos)
+                value += entries[pos].second;
+            if (value != 0)
+                matrix.insertBack(coords.second, j) = value;
+        }
+    }
+    matrix.finalize();
+    return matrix;
+}
+
+/**
+ * @brief Convert a sparse vector to a sparse matrix with one row
+ */
+AnyType
+svec_to_sparse_matrix::run(AnyType& args) {
+    SparseColumnVector vec = args[0].getAs<SparseColumnVector>();
+
+    SparseMatrix matrix(vec.size(), 1);
+    matrix.reserve(vec.nonZeros());
+    matrix.startVec(0);
+    for (SparseColumnVector::InnerIterator it(vec); it; ++it)
+        matrix.insertBack(it.index(), 0) = it.value();
+    matrix.finalize();
+    return matrix;
+}
+
+/**
+ * @brief Convert a sparse matrix to a two-dimensional array
+ */
+AnyType
+sparse_matrix_to_dense::run(AnyType& args) {
+    MappedSparseMatrix matrix = args[0].getAs<MappedSparseMatrix>();
+
+    if (matrix.rows() == 0 || matrix.cols() == 0)
+        return Null();
+
+    // Same layout as the arguments of type MappedMatrix
+    MutableMappedMatrix dense(allocateArray<double>(matrix.cols(),
+        matrix.rows()));
+    dense = matrix.toDense();
+    return dense;
+}
+
+/**
+ * @brief Multiply a sparse matrix with a vector
+ *
+ * Element i of the result is the dot product of row i of the matrix with the
+ * vector.
+ */
+AnyType
+sparse_matrix_vector_product::run(AnyType& args) {
+    MappedSparseMatrix matrix = args[0].getAs<MappedSparseMatrix>();
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+
+    if (x.size() != matrix.rows())
+        throw std::invalid_argument("Dimensions of sparse matrix and vector "
+            "do not match.");
+
+    MutableMappedColumnVector product(allocateArray<double>(matrix.cols()));
+    product = matrix.transpose() * x;
+    return product;
+}
+
+} // namespace linalg
+
+} // namespace modules
+
+} // namespace madlib
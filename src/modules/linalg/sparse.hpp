@@ -0,0 +1,25 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file sparse.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Construct a compressed sparse matrix from coordinates and values
+ */
+DECLARE_UDF(linalg, sparse_matrix)
+
+/**
+ * @brief Convert a sparse vector to a compressed sparse matrix with one row
+ */
+DECLARE_UDF(linalg, svec_to_sparse_matrix)
+
+/**
+ * @brief Convert a compressed sparse matrix to a two-dimensional array
+ */
+DECLARE_UDF(linalg, sparse_matrix_to_dense)
+
+/**
+ * @brief Multiply a compressed sparse matrix with a dense vector
+ */
+DECLARE_UDF(linalg, sparse_matrix_vector_product)
@@ -0,0 +1,423 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file svd.cpp
+ *
+ * @brief Building blocks for a randomized block SVD of a sparse matrix
+ *
+ * A sparse matrix \f$ A \f$ is stored as a table of cells (row, column,
+ * value), and a dense block of \f$ l \f$ vectors (an \f$ m \times l \f$
+ * matrix) as a table with one DOUBLE PRECISION[] of length \f$ l \f$ per row.
+ * The block product \f$ A Z \f$ is then a join of the cells with the block,
+ * aggregated by svd_block_sum(). Orthonormalization and the final SVD only
+ * need the small \f$ l \times l \f$ Gram matrix of a block, which
+ * svd_gram() aggregates and decomposes with Eigen. All steps therefore take a
+ * single scan over the data, independent of \f$ l \f$.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <new>
+
+#include "svd.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace linalg {
+
+/**
+ * @brief Transition state for the sum of scaled rows of a block
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * width, followed by width sums.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 1, and all elemenets are 0.
+ */
+template <class Handle>
+class SVDBlockSumTransitionState {
+    template <class OtherHandle>
+    friend class SVDBlockSumTransitionState;
+
+public:
+    SVDBlockSumTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inWidth) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inWidth));
+        rebind(inWidth);
+        width = inWidth;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return width > 0;
+    }
+
+    /**
+     * @brief Merge with another state object
+     */
+    template <class OtherHandle>
+    SVDBlockSumTransitionState &operator+=(
+        const SVDBlockSumTransitionState<OtherHandle> &inOtherState) {
+
+        if (width != inOtherState.width)
+            throw std::invalid_argument("Rows of a block must have the same "
+                "length.");
+
+        sum += inOtherState.sum;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inWidth) {
+        return 1 + inWidth;
+    }
+
+    void rebind(uint32_t inWidth) {
+        madlib_assert(mStorage.size() >= arraySize(inWidth),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        width.rebind(&mStorage[0]);
+        // The sum is empty before the first row, so compute the pointer
+        // without going through the bounds-checked Handle::operator[]
+        sum.rebind(mStorage.ptr() + 1, inWidth);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 width;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap sum;
+};
+
+/**
+ * @brief Transition state for the Gram matrix of a block
+ *
+ * For rows \f$ z_1, \dots, z_m \f$ of a block \f$ Z \f$, the Gram matrix is
+ * \f$ Z^T Z = \sum_i z_i z_i^T \f$. Only its lower triangle is accumulated.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * width, followed by the width x width Gram matrix in column-major order.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 1, and all elemenets are 0.
+ */
+template <class Handle>
+class SVDGramTransitionState {
+    template <class OtherHandle>
+    friend class SVDGramTransitionState;
+
+public:
+    SVDGramTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inWidth) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inWidth));
+        rebind(inWidth);
+        width = inWidth;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return width > 0;
+    }
+
+    /**
+     * @brief Merge with another state object
+     */
+    template <class OtherHandle>
+    SVDGramTransitionState &operator+=(
+        const SVDGramTransitionState<OtherHandle> &inOtherState) {
+
+        if (width != inOtherState.width)
+            throw std::invalid_argument("Rows of a block must have the same "
+                "length.");
+
+        gram += inOtherState.gram;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inWidth) {
+        return 1 + static_cast<size_t>(inWidth) * inWidth;
+    }
+
+    void rebind(uint32_t inWidth) {
+        madlib_assert(mStorage.size() >= arraySize(inWidth),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        width.rebind(&mStorage[0]);
+        gram.rebind(mStorage.ptr() + 1, inWidth, inWidth);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 width;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap gram;
+};
+
+/**
+ * @brief Add a row of a block, multiplied by a matrix cell
+ */
+AnyType
+svd_block_sum_transition::run(AnyType &args) {
+    SVDBlockSumTransitionState<MutableArrayHandle<double> > state = args[0];
+    MappedColumnVector block = args[1].getAs<MappedColumnVector>();
+    double scale = args[2].getAs<double>();
+
+    if (!state.isInitialized()) {
+        if (block.size() == 0)
+            throw std::invalid_argument("Rows of a block must not be empty.");
+        state.initialize(*this, static_cast<uint32_t>(block.size()));
+    } else if (block.size() != state.sum.size())
+        throw std::invalid_argument("Rows of a block must have the same "
+            "length.");
+
+    state.sum += scale * block;
+    return state;
+}
+
+/**
+ * @brief Merge two block sums
+ */
+AnyType
+svd_block_sum_merge::run(AnyType &args) {
+    SVDBlockSumTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    SVDBlockSumTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    else if (!stateRight.isInitialized())
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Return the block sum
+ */
+AnyType
+svd_block_sum_final::run(AnyType &args) {
+    SVDBlockSumTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    MutableMappedColumnVector result(allocateArray<double>(state.sum.size()));
+    result = state.sum;
+    return result;
+}
+
+/**
+ * @brief Add a row of a block to the Gram matrix
+ */
+AnyType
+svd_gram_transition::run(AnyType &args) {
+    SVDGramTransitionState<MutableArrayHandle<double> > state = args[0];
+    MappedColumnVector block = args[1].getAs<MappedColumnVector>();
+
+    if (!state.isInitialized()) {
+        if (block.size() == 0)
+            throw std::invalid_argument("Rows of a block must not be empty.");
+        state.initialize(*this, static_cast<uint32_t>(block.size()));
+    } else if (block.size() != state.gram.rows())
+        throw std::invalid_argument("Rows of a block must have the same "
+            "length.");
+
+    state.gram.selfadjointView<Eigen::Lower>().rankUpdate(block);
+    return state;
+}
+
+/**
+ * @brief Merge two Gram matrices
+ */
+AnyType
+svd_gram_merge::run(AnyType &args) {
+    SVDGramTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    SVDGramTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    else if (!stateRight.isInitialized())
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Return the eigendecomposition of the Gram matrix
+ *
+ * The result is an array with the width \f$ l \f$, followed by the
+ * \f$ l \f$ eigenvalues in descending order, followed by the corresponding
+ * eigenvectors as an \f$ l \times l \f$ matrix in column-major order. It is
+ * meant as argument to svd_block_transform().
+ */
+AnyType
+svd_gram_final::run(AnyType &args) {
+    SVDGramTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    Index width = state.gram.rows();
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        state.gram, ComputeEigenvectors);
+
+    MutableArrayHandle<double> result = allocateArray<double>(
+        static_cast<size_t>(1 + width + width * width));
+    HandleTraits<MutableArrayHandle<double> >::ColumnVectorTransparentHandleMap
+        eigenvalues(result.ptr() + 1, width);
+    HandleTraits<MutableArrayHandle<double> >::MatrixTransparentHandleMap
+        eigenvectors(result.ptr() + 1 + width, width, width);
+
+    // Eigen returns the eigenvalues in ascending order
+    result[0] = static_cast<double>(width);
+    eigenvalues = decomposition.eigenvalues().reverse();
+    eigenvectors = decomposition.eigenvectors().rowwise().reverse();
+    return result;
+}
+
+/**
+ * @brief Apply the eigenvectors of a Gram matrix to a row of a block
+ *
+ * With the eigendecomposition \f$ Z^T Z = W \Lambda W^T \f$ (as returned by
+ * svd_gram()), a row \f$ z \f$ of \f$ Z \f$ is mapped to the row
+ * \f$ z^T W_k \Lambda_k^p \f$, where \f$ W_k \f$ are the first \f$ k \f$
+ * eigenvectors and \f$ \Lambda_k \f$ the \f$ k \f$ largest eigenvalues. In
+ * particular:
+ *
+ * - With \f$ p = -1/2 \f$ and \f$ k = l \f$, the block is orthonormalized.
+ * - If \f$ Z = A^T Q \f$ for a block \f$ Q \f$ with orthonormal columns, then
+ *   \f$ A \approx Q Z^T = (Q W \Lambda^{1/4}) (Z W \Lambda^{-1/4})^T \f$ is
+ *   the SVD of \f$ Q Q^T A \f$ with the singular values absorbed in both
+ *   factors.
+ *
+ * Eigenvalues that are zero up to rounding errors are treated as zero, and
+ * the corresponding entries of the result are zero for negative \f$ p \f$.
+ */
+AnyType
+svd_block_transform::run(AnyType &args) {
+    MappedColumnVector block = args[0].getAs<MappedColumnVector>();
+    ArrayHandle<double> decomposition = args[1].getAs<ArrayHandle<double> >();
+    double power = args[2].getAs<double>();
+    int32_t k = args[3].getAs<int32_t>();
+
+    if (decomposition.size() == 0)
+        throw std::invalid_argument("Invalid decomposition. Decompositions "
+            "must be obtained from the svd_gram aggregate.");
+
+    Index width = static_cast<Index>(decomposition[0]);
+    if (width < 1 || decomposition.size()
+            != static_cast<size_t>(1 + width + width * width))
+        throw std::invalid_argument("Invalid decomposition. Decompositions "
+            "must be obtained from the svd_gram aggregate.");
+    if (block.size() != width)
+        throw std::invalid_argument("Row of block and decomposition have "
+            "incompatible widths.");
+    if (k < 1 || k > width)
+        throw std::invalid_argument("Number of components must be between 1 "
+            "and the width of the block.");
+
+    HandleTraits<ArrayHandle<double> >::ColumnVectorTransparentHandleMap
+        eigenvalues(decomposition.ptr() + 1, width);
+    HandleTraits<ArrayHandle<double> >::MatrixTransparentHandleMap
+        eigenvectors(decomposition.ptr() + 1 + width, width, width);
+
+    double threshold = static_cast<double>(width)
+        * std::numeric_limits<double>::epsilon()
+        * std::max(eigenvalues(0), 0.);
+    MutableMappedColumnVector result(
+        allocateArray<double>(static_cast<size_t>(k)));
+    result = trans(eigenvectors.leftCols(k)) * block;
+    for (Index j = 0; j < k; j++) {
+        if (eigenvalues(j) > threshold)
+            result(j) *= std::pow(eigenvalues(j), power);
+        else if (power < 0)
+            result(j) = 0;
+        else if (power > 0)
+            result(j) *= std::pow(std::max(eigenvalues(j), 0.), power);
+    }
+    return result;
+}
+
+/**
+ * @brief Draw a row of a Gaussian random block
+ *
+ * The entries are independent standard normal variates, obtained with the
+ * Box-Muller transform from a PhiloxRandomNumberGenerator that is kept for
+ * all rows of the query.
+ */
+AnyType
+svd_gaussian_block::run(AnyType &args) {
+    int32_t width = args[0].getAs<int32_t>();
+
+    if (width < 1)
+        throw std::invalid_argument("Width of a block must be positive.");
+
+    void *&cache = callSiteCache();
+    if (cache == NULL) {
+        void *memory = allocateCallSiteCache(
+            sizeof(PhiloxRandomNumberGenerator));
+        cache = new (memory) PhiloxRandomNumberGenerator;
+    }
+    PhiloxRandomNumberGenerator &generator
+        = *static_cast<PhiloxRandomNumberGenerator*>(cache);
+
+    MutableArrayHandle<double> result
+        = allocateArray<double>(static_cast<size_t>(width));
+    for (int32_t i = 0; i < width; i += 2) {
+        // 1 - generator() is uniform on (0, 1]
+        double radius = std::sqrt(-2. * std::log(1. - generator()));
+        double angle = 2. * M_PI * generator();
+        result[i] = radius * std::cos(angle);
+        if (i + 1 < width)
+            result[i + 1] = radius * std::sin(angle);
+    }
+    return result;
+}
+
+} // namespace linalg
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,45 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file svd.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Block sparse matrix-vector product: Transition function
+ */
+DECLARE_UDF(linalg, svd_block_sum_transition)
+
+/**
+ * @brief Block sparse matrix-vector product: State merge function
+ */
+DECLARE_UDF(linalg, svd_block_sum_merge)
+
+/**
+ * @brief Block sparse matrix-vector product: Final function
+ */
+DECLARE_UDF(linalg, svd_block_sum_final)
+
+/**
+ * @brief Gram matrix of a block of vectors: Transition function
+ */
+DECLARE_UDF(linalg, svd_gram_transition)
+
+/**
+ * @brief Gram matrix of a block of vectors: State merge function
+ */
+DECLARE_UDF(linalg, svd_gram_merge)
+
+/**
+ * @brief Gram matrix of a block of vectors: Final function
+ */
+DECLARE_UDF(linalg, svd_gram_final)
+
+/**
+ * @brief Apply the eigenvectors of a Gram matrix to a row of a block
+ */
+DECLARE_UDF(linalg, svd_block_transform)
+
+/**
+ * @brief Draw a row of a Gaussian random block
+ */
+DECLARE_UDF(linalg, svd_gaussian_block)
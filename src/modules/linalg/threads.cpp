@@ -0,0 +1,33 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file threads.cpp
+ *
+ * @brief Number of threads used by parallelFor()
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include "threads.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace linalg {
+
+/**
+ * @brief Set the number of threads and return the previous one
+ *
+ * The setting is per backend process and lasts until it ends.
+ */
+AnyType
+set_num_threads::run(AnyType &args) {
+    return dbconnector::postgres::setNumThreads(args[0].getAs<int32_t>());
+}
+
+} // namespace linalg
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,10 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file threads.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Set the number of threads for the final functions of linear models
+ */
+DECLARE_UDF(linalg, set_num_threads)
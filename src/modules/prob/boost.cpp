@@ -8,6 +8,8 @@
 
 #include <dbconnector/dbconnector.hpp>
 
+#include <new>
+
 #include "boost.hpp"
 
 namespace madlib {
@@ -16,44 +18,115 @@ namespace modules {
 
 namespace prob {
 
+namespace {
+// No need to make this visable beyond this translation unit.
+
+/**
+ * @brief Distribution object kept in the call-site cache
+ *
+ * Constructing a boost distribution object validates its parameters. Since
+ * queries typically pass the same parameters for all rows, we keep the last
+ * distribution object and only construct a new one if the parameters change.
+ * Unused parameters are stored as 0. A NaN parameter never matches, so the
+ * distribution object is then constructed for every call (as before).
+ */
+template <class Distribution>
+struct CachedDistribution {
+    CachedDistribution(const Distribution& inDist) : distribution(inDist) { }
+
+    bool matches(double inParam1, double inParam2 = 0, double inParam3 = 0)
+        const {
+
+        return param[0] == inParam1 && param[1] == inParam2
+            && param[2] == inParam3;
+    }
+
+    void remember(double inParam1, double inParam2 = 0, double inParam3 = 0) {
+        param[0] = inParam1;
+        param[1] = inParam2;
+        param[2] = inParam3;
+    }
+
+    Distribution distribution;
+    double param[3];
+};
+
+} // anonymous namespace
+
+// Defines the local reference "distribution" to the cached distribution object.
+// The parenthesized list params holds the arguments of the constructor.
+#define CACHED_DISTRIBUTION(dist, params) \
+    void *&cache = callSiteCache(); \
+    CachedDistribution<dist> *cached \
+        = static_cast<CachedDistribution<dist>*>(cache); \
+    if (cached == NULL || !cached->matches params) { \
+        dist newDist params; \
+        if (cached == NULL) \
+            cache = cached = new (allocateCallSiteCache( \
+                sizeof(CachedDistribution<dist>))) \
+                    CachedDistribution<dist>(newDist); \
+        else \
+            cached->distribution = newDist; \
+        cached->remember params; \
+    } \
+    const dist& distribution = cached->distribution;
+
 #define DEFINE_PROBABILITY_FUNCTION_1(dist, what, boost_what, rvtype, argtype1) \
     AnyType \
     dist ## _ ## what::run(AnyType &args) { \
-        return prob::boost_what( \
-                dist( \
-                    args[1].getAs< argtype1 >() \
-                ), \
-                static_cast<double>(args[0].getAs< rvtype >()) \
-            ); \
+        argtype1 param1 = args[1].getAs< argtype1 >(); \
+        CACHED_DISTRIBUTION(dist, (param1)) \
+        return prob::boost_what(distribution, \
+            static_cast<double>(args[0].getAs< rvtype >())); \
     }
 
 #define DEFINE_PROBABILITY_FUNCTION_2(dist, what, boost_what, rvtype, \
     argtype1, argtype2) \
     AnyType \
     dist ## _ ## what::run(AnyType &args) { \
-        return prob::boost_what( \
-                dist( \
-                    args[1].getAs< argtype1 >(), \
-                    args[2].getAs< argtype2 >() \
-                ), \
-                static_cast<double>(args[0].getAs< rvtype >()) \
-            ); \
+        argtype1 param1 = args[1].getAs< argtype1 >(); \
+        argtype2 param2 = args[2].getAs< argtype2 >(); \
+        CACHED_DISTRIBUTION(dist, (param1, param2)) \
+        return prob::boost_what(distribution, \
+            static_cast<double>(args[0].getAs< rvtype >())); \
     }
 
 #define DEFINE_PROBABILITY_FUNCTION_3(dist, what, boost_what, rvtype, \
     argtype1, argtype2, argtype3) \
     AnyType \
     dist ## _ ## what::run(AnyType &args) { \
-        return prob::boost_what( \
-                dist( \
-                    args[1].getAs< argtype1 >(), \
-                    args[2].getAs< argtype1 >(), \
-                    args[3].getAs< argtype2 >() \
-                ), \
-                static_cast<double>(args[0].getAs< rvtype >()) \
-            ); \
+        argtype1 param1 = args[1].getAs< argtype1 >(); \
+        argtype2 param2 = args[2].getAs< argtype2 >(); \
+        argtype3 param3 = args[3].getAs< argtype3 >(); \
+        CACHED_DISTRIBUTION(dist, (param1, param2, param3)) \
+        return prob::boost_what(distribution, \
+            static_cast<double>(args[0].getAs< rvtype >())); \
     }
 
+// The distribution object is constructed only once for the whole array
+#define DEFINE_VECTORIZED_PROBABILITY_FUNCTION(dist, what, boost_what, params) \
+    AnyType \
+    dist ## _ ## what ## _vector::run(AnyType &args) { \
+        ArrayHandle<double> x = args[0].getAs<ArrayHandle<double> >(); \
+        dist distribution params; \
+        MutableArrayHandle<double> result = allocateArray<double>(x.size()); \
+        for (size_t i = 0; i < x.size(); ++i) \
+            result[i] = prob::boost_what(distribution, x[i]); \
+        return result; \
+    }
+
+#define DEFINE_VECTORIZED_PROB_DISTR(dist, params) \
+    DEFINE_VECTORIZED_PROBABILITY_FUNCTION(dist, cdf, cdf, params) \
+    DEFINE_VECTORIZED_PROBABILITY_FUNCTION(dist, pdf, pdf, params) \
+    DEFINE_VECTORIZED_PROBABILITY_FUNCTION(dist, quantile, quantile, params)
+
+#define DEFINE_VECTORIZED_PROB_DISTR_1(dist) \
+    DEFINE_VECTORIZED_PROB_DISTR(dist, (args[1].getAs<double>()))
+
+#define DEFINE_VECTORIZED_PROB_DISTR_2(dist) \
+    DEFINE_VECTORIZED_PROB_DISTR(dist, \
+        (args[1].getAs<double>(), args[2].getAs<double>()))
+
 #define DEFINE_PROBABILITY_DISTR_1(dist, pdf_or_pmf, rvtype, argtype1) \
     DEFINE_PROBABILITY_FUNCTION_1(dist, cdf, cdf, double, argtype1) \
     DEFINE_PROBABILITY_FUNCTION_1(dist, pdf_or_pmf, pdf, rvtype, argtype1) \
@@ -131,6 +204,10 @@ DEFINE_DISCRETE_PROB_DISTR_3(hypergeometric, int32_t, uint32_t, uint32_t,
 DEFINE_DISCRETE_PROB_DISTR_2(negative_binomial, int32_t, double, double)
 DEFINE_DISCRETE_PROB_DISTR_1(poisson, int32_t, double)
 
+DEFINE_VECTORIZED_PROB_DISTR_1(chi_squared)
+DEFINE_VECTORIZED_PROB_DISTR_2(fisher_f)
+DEFINE_VECTORIZED_PROB_DISTR_2(normal)
+
 } // namespace prob
 
 } // namespace modules
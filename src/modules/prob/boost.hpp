@@ -60,6 +60,22 @@ LIST_DISCRETE_PROB_DISTR
 
 #undef MADLIB_ITEM
 
+// Distributions of test statistics additionally come with functions that
+// evaluate a whole array of random variates (or probabilities) at once
+#define LIST_VECTORIZED_PROB_DISTR \
+    MADLIB_ITEM(chi_squared) \
+    MADLIB_ITEM(fisher_f) \
+    MADLIB_ITEM(normal)
+
+#define MADLIB_ITEM(dist) \
+    DECLARE_UDF(prob, dist ## _cdf_vector) \
+    DECLARE_UDF(prob, dist ## _pdf_vector) \
+    DECLARE_UDF(prob, dist ## _quantile_vector)
+
+LIST_VECTORIZED_PROB_DISTR
+
+#undef MADLIB_ITEM
+
 
 #ifndef MADLIB_MODULES_PROB_BOOST_HPP
 #define MADLIB_MODULES_PROB_BOOST_HPP
@@ -9,10 +9,18 @@
  */
 DECLARE_UDF(prob, kolmogorov_cdf)
 
+/**
+ * @brief Kolmogorov cumulative distribution function, evaluated for an array
+ *     of random variates
+ */
+DECLARE_UDF(prob, kolmogorov_cdf_vector)
+
 
 #ifndef MADLIB_MODULES_PROB_KOLMOGOROV_HPP
 #define MADLIB_MODULES_PROB_KOLMOGOROV_HPP
 
+#include <cmath>
+
 #include <boost/math/policies/policy.hpp>
 #include <boost/math/distributions/complement.hpp>
 #include <boost/math/distributions/detail/common_error_handling.hpp>
@@ -23,13 +31,49 @@ namespace modules {
 
 namespace prob {
 
-// CERN ROOT namespace. We use this namespace, so that the original
-// implementation could be copied as is, without any modification.
-namespace TMath {
-    // CERN ROOT type definitions in: core/base/inc/Rtypes.h
-    typedef int32_t Int_t;
-    typedef double Double_t;
-    Double_t KolmogorovProb(Double_t z);
+/**
+ * @brief Kolmogorov distribution function or its complement
+ *
+ * For \f$ x < 0.755 \f$ we use the theta function inversion formula
+ * \f[
+ *     \Pr[K \leq x] = \frac{\sqrt{2 \pi}}x
+ *         \sum_{k=1}^\infty e^{-(2k-1)^2 \pi^2 / (8 x^2)},
+ * \f]
+ * and otherwise Kolmogorov's series
+ * \f[
+ *     \Pr[K > x] = 2 \sum_{k=1}^\infty (-1)^{k-1} e^{-2 k^2 x^2}.
+ * \f]
+ * As in PROBKL from CERNLIB (routine G102), we truncate each series after at
+ * most four terms, which is accurate to machine precision. All terms are
+ * powers of the first one, so we need only a single call to \c exp(). The
+ * smaller of the two probabilities is always computed directly, the other one
+ * as its complement.
+ */
+template <class RealType>
+inline
+RealType
+kolmogorovProb(const RealType& x, bool complement) {
+    // sqrt(2 pi) and -pi^2 / 8
+    const RealType w = static_cast<RealType>(2.5066282746310002);
+    const RealType c1 = static_cast<RealType>(-1.2337005501361697);
+
+    if (x <= 0)
+        return complement ? 1 : 0;
+    if (x < static_cast<RealType>(0.755)) {
+        // Terms e^(c1/x^2), e^(9 c1/x^2), e^(25 c1/x^2)
+        RealType e = std::exp(c1 / (x * x));
+        RealType e8 = e * e; e8 *= e8; e8 *= e8;
+        RealType e9 = e8 * e;
+        RealType p = w * (e + e9 + e9 * e8 * e8) / x;
+        return complement ? 1 - p : p;
+    }
+
+    // Terms e^(-2 x^2), e^(-8 x^2), e^(-18 x^2), e^(-32 x^2)
+    RealType r = std::exp(-2 * x * x);
+    RealType r4 = r * r; r4 *= r4;
+    RealType r8 = r4 * r4;
+    RealType q = 2 * (r - r4 + r8 * r - r8 * r8);
+    return complement ? q : 1 - q;
 }
 
 template <
@@ -85,8 +129,7 @@ cdf(const kolmogorov_distribution<RealType, Policy>&, const RealType& x) {
     if (boost::math::detail::check_x(function, x, &result, Policy()) == false)
         return result;
 
-    // FIXME: Numerically questionable if t is close to 1.
-    return 1. - TMath::KolmogorovProb(x);
+    return kolmogorovProb(x, false);
 }
 
 template <class RealType, class Policy>
@@ -110,7 +153,7 @@ cdf(
     if (boost::math::detail::check_x(function, x, &result, Policy()) == false)
         return result;
 
-    return TMath::KolmogorovProb(x);
+    return kolmogorovProb(x, true);
 }
 
 } // namespace prob
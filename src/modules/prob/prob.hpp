@@ -8,4 +8,5 @@
 
 #include "boost.hpp"
 #include "kolmogorov.hpp"
+#include "random.hpp"
 #include "student.hpp"
@@ -0,0 +1,151 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file random.cpp
+ *
+ * @brief Bulk generation of random variates
+ *
+ * Each call fills a whole array from one PhiloxRandomNumberGenerator, with
+ * direct sampling methods instead of one quantile-function call per variate.
+ * Without a seed argument, the generator takes its key from the backend's
+ * random number generator (so that setseed() applies, and every segment has
+ * its own stream). With a seed argument, the result only depends on the
+ * seed and the parameters.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include "random.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace prob {
+
+namespace {
+// No need to make this visable beyond this translation unit.
+
+/**
+ * @brief Allocate the result for the number of variates in argument 0, and
+ *     seed the generator with argument <tt>inSeedArg</tt> if it exists
+ */
+inline
+MutableArrayHandle<double>
+prepareVariates(const Allocator& inAllocator, AnyType& args,
+    uint16_t inSeedArg, PhiloxRandomNumberGenerator& outGenerator) {
+
+    int32_t numVariates = args[0].getAs<int32_t>();
+    if (numVariates < 1)
+        throw std::invalid_argument("Number of variates must be positive.");
+    if (args.numFields() > inSeedArg)
+        outGenerator.seed(args[inSeedArg].getAs<int32_t>());
+
+    return inAllocator.allocateArray<double, dbal::FunctionContext,
+        dbal::DoNotZero, dbal::ThrowBadAlloc>(numVariates);
+}
+
+inline
+void
+checkPositive(double inValue, const char* inMessage) {
+    if (!(inValue > 0) || !boost::math::isfinite(inValue))
+        throw std::domain_error(inMessage);
+}
+
+/**
+ * @brief Gamma variates with the given shape and scale
+ */
+inline
+AnyType
+gammaVariates(const Allocator& inAllocator, AnyType& args, double inShape,
+    double inScale, uint16_t inSeedArg) {
+
+    PhiloxRandomNumberGenerator generator;
+    MutableArrayHandle<double> variates = prepareVariates(inAllocator, args,
+        inSeedArg, generator);
+    StandardGammaGenerator gamma(inShape);
+    for (size_t i = 0; i < variates.size(); ++i)
+        variates[i] = inScale * gamma(generator);
+    return variates;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Normal random variates: In-database interface
+ *
+ * Arguments are the number of variates, the mean, the standard deviation,
+ * and optionally the seed.
+ */
+AnyType
+normal_random_vector::run(AnyType& args) {
+    double mean = args[1].getAs<double>();
+    double sd = args[2].getAs<double>();
+    if (!boost::math::isfinite(mean))
+        throw std::domain_error("Mean must be finite.");
+    checkPositive(sd, "Standard deviation must be positive and finite.");
+
+    PhiloxRandomNumberGenerator generator;
+    MutableArrayHandle<double> variates = prepareVariates(*this, args, 3,
+        generator);
+    for (size_t i = 0; i < variates.size(); ++i)
+        variates[i] = mean + sd * standardNormalVariate(generator);
+    return variates;
+}
+
+/**
+ * @brief Exponential random variates: In-database interface
+ *
+ * Arguments are the number of variates, the rate, and optionally the seed.
+ * Variates are obtained by inversion, which only takes a logarithm.
+ */
+AnyType
+exponential_random_vector::run(AnyType& args) {
+    double lambda = args[1].getAs<double>();
+    checkPositive(lambda, "Rate must be positive and finite.");
+
+    PhiloxRandomNumberGenerator generator;
+    MutableArrayHandle<double> variates = prepareVariates(*this, args, 2,
+        generator);
+    generator.fill(variates.ptr(), variates.size());
+    for (size_t i = 0; i < variates.size(); ++i)
+        variates[i] = -std::log(1. - variates[i]) / lambda;
+    return variates;
+}
+
+/**
+ * @brief Gamma random variates: In-database interface
+ *
+ * Arguments are the number of variates, the shape, the scale, and optionally
+ * the seed.
+ */
+AnyType
+gamma_random_vector::run(AnyType& args) {
+    double shape = args[1].getAs<double>();
+    double scale = args[2].getAs<double>();
+    checkPositive(shape, "Shape must be positive and finite.");
+    checkPositive(scale, "Scale must be positive and finite.");
+
+    return gammaVariates(*this, args, shape, scale, 3);
+}
+
+/**
+ * @brief Chi-squared random variates: In-database interface
+ *
+ * Arguments are the number of variates, the degrees of freedom, and
+ * optionally the seed. A chi-squared variate with \f$ \nu \f$ degrees of
+ * freedom is a gamma variate with shape \f$ \nu / 2 \f$ and scale 2.
+ */
+AnyType
+chi_squared_random_vector::run(AnyType& args) {
+    double df = args[1].getAs<double>();
+    checkPositive(df, "Degrees of freedom must be positive and finite.");
+
+    return gammaVariates(*this, args, df / 2, 2, 2);
+}
+
+} // namespace prob
+
+} // namespace modules
+
+} // namespace madlib
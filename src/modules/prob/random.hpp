@@ -0,0 +1,186 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file random.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Array of normally distributed random variates
+ */
+DECLARE_UDF(prob, normal_random_vector)
+
+/**
+ * @brief Array of exponentially distributed random variates
+ */
+DECLARE_UDF(prob, exponential_random_vector)
+
+/**
+ * @brief Array of gamma distributed random variates
+ */
+DECLARE_UDF(prob, gamma_random_vector)
+
+/**
+ * @brief Array of chi-squared distributed random variates
+ */
+DECLARE_UDF(prob, chi_squared_random_vector)
+
+
+#ifndef MADLIB_MODULES_PROB_RANDOM_HPP
+#define MADLIB_MODULES_PROB_RANDOM_HPP
+
+#include <cmath>
+
+namespace madlib {
+
+namespace modules {
+
+namespace prob {
+
+/**
+ * @brief Tables of the ziggurat method for the standard normal distribution
+ *
+ * The right half of the density is covered by 128 layers of equal area
+ * \f$ v \f$. For \f$ i \geq 1 \f$, layer \f$ i \f$ is the rectangle
+ * \f$ [0, x_i] \times [f(x_i), f(x_{i+1})] \f$ (with \f$ x_{128} = 0 \f$).
+ * Layer 0 is the strip \f$ [0, r] \times [0, f(r)] \f$ together with the
+ * tail beyond \f$ x_1 = r \f$, and \f$ x_0 = v / f(r) \f$ is the width of a
+ * rectangle with the same area. The constants \f$ r \f$ and \f$ v \f$ are
+ * those of Marsaglia and Tsang, "The Ziggurat Method for Generating Random
+ * Variables", Journal of Statistical Software 5(8), 2000.
+ */
+struct NormalZiggurat {
+    static const int numLayers = 128;
+
+    NormalZiggurat() {
+        const double r = 3.442619855899;
+        const double v = 9.91256303526217e-3;
+        double f = std::exp(-0.5 * r * r);
+
+        x[0] = v / f;
+        x[1] = r;
+        x[numLayers] = 0;
+        for (int i = 2; i < numLayers; ++i) {
+            x[i] = std::sqrt(-2. * std::log(v / x[i - 1] + f));
+            f = std::exp(-0.5 * x[i] * x[i]);
+        }
+        for (int i = 0; i < numLayers; ++i)
+            ratio[i] = x[i + 1] / x[i];
+    }
+
+    double x[numLayers + 1];
+    double ratio[numLayers];
+};
+
+/**
+ * @brief Standard normal variate from the tail beyond <tt>inMin</tt>
+ *
+ * This is Marsaglia's method for the tail, with the sign given by
+ * <tt>inNegative</tt>.
+ */
+template <class Engine>
+inline
+double
+normalTailVariate(Engine& inEngine, double inMin, bool inNegative) {
+    double x;
+    double y;
+    do {
+        // 1 - inEngine() is uniform on (0, 1]
+        x = std::log(1. - inEngine()) / inMin;
+        y = std::log(1. - inEngine());
+    } while (-2. * y < x * x);
+    return inNegative ? x - inMin : inMin - x;
+}
+
+/**
+ * @brief Standard normal variate, with the ziggurat method
+ *
+ * We follow the variant ZIGNOR of Doornik, "An Improved Ziggurat Method to
+ * Generate Normal Random Samples", 2005, which works with uniform doubles.
+ * About 98.8% of all variates only take one uniform, one comparison, and
+ * one multiplication. The 7 high-order bits of the uniform select the layer,
+ * the remaining (at least 46) bits the position within it.
+ *
+ * @param inEngine Engine returning uniform doubles in \f$ [0, 1) \f$, e.g.,
+ *     a PhiloxRandomNumberGenerator
+ */
+template <class Engine>
+inline
+double
+standardNormalVariate(Engine& inEngine) {
+    static const NormalZiggurat zig;
+
+    for (;;) {
+        double u = inEngine() * NormalZiggurat::numLayers;
+        int i = static_cast<int>(u);
+        double w = 2. * (u - i) - 1.;
+
+        if (std::fabs(w) < zig.ratio[i])
+            return w * zig.x[i];
+        if (i == 0)
+            return normalTailVariate(inEngine, zig.x[1], w < 0);
+
+        // Between the inner rectangle and the layer: Accept if below the
+        // density
+        double x = w * zig.x[i];
+        double f0 = std::exp(-0.5 * (zig.x[i] * zig.x[i] - x * x));
+        double f1 = std::exp(-0.5 * (zig.x[i + 1] * zig.x[i + 1] - x * x));
+        if (f1 + inEngine() * (f0 - f1) < 1.)
+            return x;
+    }
+}
+
+/**
+ * @brief Gamma variates with unit scale, with the method of Marsaglia and Tsang
+ *
+ * See Marsaglia and Tsang, "A Simple Method for Generating Gamma Variables",
+ * ACM Transactions on Mathematical Software 26(3), 2000. For shape
+ * \f$ k \geq 1 \f$, a variate takes a little more than one normal and one
+ * uniform variate on average, and usually no logarithm. For \f$ k < 1 \f$,
+ * we use that \f$ X U^{1/k} \f$ is gamma distributed with shape \f$ k \f$
+ * if \f$ X \f$ has shape \f$ k + 1 \f$ and \f$ U \f$ is uniform.
+ */
+class StandardGammaGenerator {
+public:
+    StandardGammaGenerator(double inShape)
+      : mInverseShape(inShape < 1 ? 1. / inShape : 0),
+        mD((inShape < 1 ? inShape + 1 : inShape) - 1. / 3.),
+        mC(1. / std::sqrt(9. * mD)) { }
+
+    template <class Engine>
+    double operator()(Engine& inEngine) const {
+        double x;
+        double v;
+        double u;
+
+        for (;;) {
+            do {
+                x = standardNormalVariate(inEngine);
+                v = 1. + mC * x;
+            } while (v <= 0);
+            v = v * v * v;
+            u = 1. - inEngine();
+
+            double xSquared = x * x;
+            if (u < 1. - 0.0331 * xSquared * xSquared
+                || std::log(u) < 0.5 * xSquared
+                    + mD * (1. - v + std::log(v)))
+                break;
+        }
+        return mInverseShape == 0
+            ? mD * v
+            : mD * v * std::pow(1. - inEngine(), mInverseShape);
+    }
+
+private:
+    double mInverseShape;
+    double mD;
+    double mC;
+};
+
+} // namespace prob
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_MODULES_PROB_RANDOM_HPP)
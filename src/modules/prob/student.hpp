@@ -53,6 +53,12 @@
  *
  * [10] Gaver and Kafadar, A Retrievable Recipe for Inverse t, The American
  *      Statistician, Vol. 38, No. 4, 1984
+ *
+ * [11] Hill, Algorithm 395: Student's t-distribution, Communications of the
+ *      ACM, Vol. 13, No. 10, 1970
+ *
+ * [12] Hill, Algorithm 396: Student's t-quantiles, Communications of the ACM,
+ *      Vol. 13, No. 10, 1970
  */
 
 /**
@@ -69,6 +75,12 @@ DECLARE_UDF(prob, students_t_quantile)
 #include <boost/math/distributions/detail/common_error_handling.hpp>
 #include <boost/math/distributions/normal.hpp>
 #include <boost/math/distributions/students_t.hpp>
+#include <boost/math/special_functions/expm1.hpp>
+#include <boost/math/special_functions/gamma.hpp>
+#include <boost/math/special_functions/log1p.hpp>
+
+#include <algorithm>
+#include <limits>
 
 namespace madlib {
 
@@ -81,6 +93,65 @@ typedef boost::math::students_t_distribution<double, boost_mathkit_policy>
 
 namespace {
 
+/**
+ * @brief Degree of freedom from which on Hill's normal approximation is used
+ *
+ * Below, the series expansions from [1] take at most nu/2 terms.
+ */
+const uint64_t kStudentsTSeriesMaxDF = 100;
+
+/**
+ * @brief Two-sided tail probability below which the tail is not computed as
+ *     complement of \f$ \Pr[|T| \leq t] \f$
+ */
+const double kStudentsTTailSeriesThreshold = 1e-3;
+
+/**
+ * @brief Coefficients of the series expansions for the Student's t CDF
+ *
+ * The series expansions 26.7.3 and 26.7.4 from [1] are polynomials in
+ * 1/z (see oneSidedStudentsT_CDF()), and their coefficients
+ * @verbatim
+ *    1 * 3 * ... * (2i - 1)                2 * 4 * ... * (2i)
+ *   ------------------------   and   ------------------------
+ *      2 * 4 * ... * (2i)             3 * 5 * ... * (2i + 1)
+ * @endverbatim
+ * (for even and odd nu, respectively) do not depend on nu. We tabulate them
+ * once, so that the series can be evaluated with Horner's scheme instead of a
+ * division per term. Coefficients beyond the table are computed from the gamma
+ * function.
+ *
+ * @param inOdd Whether to return the coefficient for odd nu
+ * @param inIndex Index \f$ i \f$ of the coefficient
+ */
+template <class RealType>
+inline
+RealType
+studentsTSeriesCoefficient(bool inOdd, uint64_t inIndex) {
+    static const uint64_t kTableSize = kStudentsTSeriesMaxDF / 2;
+    static RealType sCoefficients[2][kTableSize];
+    static bool sInitialized = false;
+
+    if (!sInitialized) {
+        sCoefficients[0][0] = sCoefficients[1][0] = 1.;
+        for (uint64_t i = 1; i < kTableSize; ++i) {
+            sCoefficients[0][i] = sCoefficients[0][i - 1]
+                * static_cast<RealType>(2 * i - 1) / static_cast<RealType>(2 * i);
+            sCoefficients[1][i] = sCoefficients[1][i - 1]
+                * static_cast<RealType>(2 * i) / static_cast<RealType>(2 * i + 1);
+        }
+        sInitialized = true;
+    }
+
+    if (inIndex < kTableSize)
+        return sCoefficients[inOdd ? 1 : 0][inIndex];
+
+    RealType i = static_cast<RealType>(inIndex);
+    return inOdd
+        ? std::sqrt(M_PI) / 2. * boost::math::tgamma_delta_ratio(i + 1., 0.5)
+        : boost::math::tgamma_delta_ratio(i + 0.5, 0.5) / std::sqrt(M_PI);
+}
+
 /**
  * @brief Compute one-sided Student's t cumulative distribution function
  *
@@ -110,53 +181,37 @@ namespace {
  * @endverbatim
  *
  * @param t
- * @param nu Degree of freedom \f$ \nu > 0 \f$
+ * @param nu Degree of freedom \f$ 0 < \nu < \f$ kStudentsTSeriesMaxDF
  * @return \f$ \Pr[|T| < t] \f$ where \f$ t \geq 0 \f$, \f$ T \f$ is a Student's
  *     T-distributed random variable with \f$ \nu \f$ degrees of
  *     freedom.
  *
  * Note: The running time of calculating the series is proportional to nu.
- * We therefore use the normal distribution as an approximation for large nu.
- * Another idea for handling this case can be found in reference [8].
+ * We therefore use a normal approximation for nu >= kStudentsTSeriesMaxDF.
  */
 template <class RealType>
 inline
 RealType
 oneSidedStudentsT_CDF(const RealType& t,  uint64_t nu) {
-    RealType    z,
-                t_by_sqrt_nu;
+    RealType    t_by_sqrt_nu,
+                w;  /* w = 1/z */
     RealType    A, /* contains A(t|nu) */
-                prod = 1.,
-                sum = 1.;
+                sum = 0.;
+    bool        odd = nu & 1;
 
-    /* Handle main case (nu \in {1, ..., 200}) in the rest of the function. */
-    z = 1. + t * t / static_cast<double>(nu);
     t_by_sqrt_nu = std::fabs(t) / std::sqrt(static_cast<double>(nu));
+    w = 1. / (1. + t_by_sqrt_nu * t_by_sqrt_nu);
 
-    if (nu == 1)
-    {
-        A = 2. / M_PI * std::atan(t_by_sqrt_nu);
-    }
-    else if (nu & 1) /* odd nu > 1 */
-    {
-        for (uint64_t j = 2; j + 3 <= nu; j += 2)
-        {
-            prod = prod * static_cast<double>(j)
-                 / (static_cast<double>(j + 1) * z);
-            sum = sum + prod;
-        }
-        A = 2 / M_PI * ( std::atan(t_by_sqrt_nu) + t_by_sqrt_nu / z * sum );
-    }
-    else /* even nu */
-    {
-        for (uint64_t j = 2; j + 2 <= nu; j += 2)
-        {
-            prod = prod * static_cast<double>(j - 1)
-                 / (static_cast<double>(j) * z);
-            sum = sum + prod;
-        }
-        A = t_by_sqrt_nu / std::sqrt(z) * sum;
-    }
+    /* Both sums have nu/2 terms (none for nu = 1). Note that
+     * t/sqrt(nu * z) = t_by_sqrt_nu * sqrt(w), which, unlike sqrt(1 - w), is
+     * accurate also for small t. */
+    for (uint64_t i = nu / 2; i-- > 0; )
+        sum = sum * w + studentsTSeriesCoefficient<RealType>(odd, i);
+
+    if (odd)
+        A = 2. / M_PI * ( std::atan(t_by_sqrt_nu) + t_by_sqrt_nu * w * sum );
+    else
+        A = t_by_sqrt_nu * std::sqrt(w) * sum;
 
     /* A should obviously be within the interval [0,1] plus minus (hopefully
      * small) rounding errors. */
@@ -169,14 +224,61 @@ oneSidedStudentsT_CDF(const RealType& t,  uint64_t nu) {
 }
 
 /**
- * @brief Compute parameter for normal CDF for approximating the Student's T CDF
+ * @brief Compute the two-sided tail of Student's t-distribution
  *
- * Gleason suggested a formula for approximating the Student's
- * t-distribution [9], which goes back to an approximation suggested in [10].
+ * Computing \f$ 1 - A(t|\nu) \f$ (see oneSidedStudentsT_CDF()) suffers from
+ * cancellation if the result is small. Since the series in
+ * oneSidedStudentsT_CDF() would give exactly 1 if continued indefinitely, the
+ * tail is instead the (positive) remainder series, starting with the term
+ * \f$ i = \lfloor \nu/2 \rfloor \f$. It converges like a geometric series with
+ * ratio 1/z, so it is only used when the tail is small.
+ *
+ * @param t
+ * @param nu Degree of freedom \f$ \nu > 0 \f$
+ * @return \f$ \Pr[|T| > t] \f$ where \f$ t > 0 \f$, \f$ T \f$ is a Student's
+ *     T-distributed random variable with \f$ \nu \f$ degrees of freedom.
+ */
+template <class RealType>
+inline
+RealType
+twoSidedStudentsT_Tail(const RealType& t, uint64_t nu) {
+    RealType    t_by_sqrt_nu = std::fabs(t)
+                    / std::sqrt(static_cast<double>(nu)),
+                w = 1. / (1. + t_by_sqrt_nu * t_by_sqrt_nu);
+    bool        odd = nu & 1;
+    uint64_t    i = nu / 2;
+
+    if (nu == 1)
+        return 2. / M_PI * std::atan(1. / t_by_sqrt_nu);
+
+    RealType    term = studentsTSeriesCoefficient<RealType>(odd, i)
+                    * std::pow(w, static_cast<RealType>(i)),
+                sum = 0.;
+    for (; term > std::numeric_limits<RealType>::epsilon() * sum; ++i) {
+        sum += term;
+        term *= odd
+            ? w * static_cast<RealType>(2 * i + 2)
+                / static_cast<RealType>(2 * i + 3)
+            : w * static_cast<RealType>(2 * i + 1)
+                / static_cast<RealType>(2 * i + 2);
+    }
+
+    return odd
+        ? 2. / M_PI * t_by_sqrt_nu * w * sum
+        : t_by_sqrt_nu * std::sqrt(w) * sum;
+}
+
+/**
+ * @brief Compute parameter for normal CDF for approximating the Student's T CDF
  *
- * Compared to the series expansion, this approximation satisfies
- * rel_error < 0.0001 || abs_error < 0.00000001
- * for all nu >= 200. (Tested on Mac OS X 10.6, gcc-4.2.)
+ * Hill's asymptotic expansion [11] of the normal deviate that has the same
+ * tail probability. Compared to boost's implementation (with extended
+ * precision), the relative error of both tails is less than 1.5e-8 for all
+ * nu >= kStudentsTSeriesMaxDF and \f$ t^2 \leq \nu \f$. It decreases quickly
+ * with nu (below 1e-12 for nu >= 10000). The error grows for larger
+ * \f$ t^2 / \nu \f$, so we use it only within this range. (In comparison,
+ * the approximation by Gleason [9] that was used before has a relative error
+ * of the tails of up to 0.4% for nu = 200.)
  *
  * @param t
  * @param nu Degree of freedom \f$ \nu > 0 \f$
@@ -188,9 +290,13 @@ oneSidedStudentsT_CDF(const RealType& t,  uint64_t nu) {
 template <class RealType>
 inline
 RealType
-GleasonsNormalApproxForStudentsT(const RealType& t, const RealType& nu) {
-    double  g = (nu - 1.5) / ((nu - 1) * (nu - 1)),
-            z = std::sqrt( std::log(1. + t * t / nu) / g );
+HillsNormalApproxForStudentsT(const RealType& t, const RealType& nu) {
+    RealType    a = nu - 0.5,
+                b = 48. * a * a,
+                y = a * boost::math::log1p(t * t / nu),
+                z = (((((-0.4 * y - 3.3) * y - 24.) * y - 85.5)
+                        / (0.8 * y * y + 100. + b) + y + 3.) / b + 1.)
+                    * std::sqrt(y);
 
     if (t < 0)
         z *= -1.;
@@ -198,31 +304,173 @@ GleasonsNormalApproxForStudentsT(const RealType& t, const RealType& nu) {
     return z;
 }
 
-} // anonymous namespace
+/**
+ * @brief Approximate the quantile function of Student's t-distribution
+ *
+ * This is Hill's algorithm [12]. Its relative error is below 1.5e-5
+ * (exact for nu in {1, 2}). We use it as starting point for Newton's method.
+ *
+ * @param p Two-sided tail probability \f$ p \in (0, 1] \f$
+ * @param nu Degree of freedom \f$ \nu \geq 1 \f$
+ * @returns The value \f$ t \geq 0 \f$ with \f$ \Pr[|T| > t] \approx p \f$.
+ */
+template <class RealType, class Policy>
+inline
+RealType
+HillsStudentsT_QuantileApprox(RealType p, const RealType& nu) {
+    if (nu == 2)
+        return std::sqrt(2. / (p * (2. - p)) - 2.);
+    if (nu == 1) {
+        p *= M_PI / 2.;
+        return std::cos(p) / std::sin(p);
+    }
+
+    RealType    a = 1. / (nu - 0.5),
+                b = 48. / (a * a),
+                c = ((20700. * a / b - 98.) * a - 16.) * a + 96.36,
+                d = ((94.5 / (b + c) - 3.) / b + 1.) * std::sqrt(a * M_PI / 2.)
+                    * nu,
+                x = d * p,
+                y = std::pow(x, 2. / nu);
+
+    if (y > 0.05 + a) {
+        // Asymptotic inverse expansion about the normal
+        x = boost::math::quantile(
+            boost::math::normal_distribution<RealType, Policy>(), 0.5 * p);
+        y = x * x;
+        if (nu < 5)
+            c += 0.3 * (nu - 4.5) * (x + 0.6);
+        c = (((0.05 * d * x - 5.) * x - 7.) * x - 2.) * x + b + c;
+        y = (((((0.4 * y + 6.3) * y + 36.) * y + 94.5) / c - y - 3.) / b + 1.)
+            * x;
+        y = boost::math::expm1(a * y * y);
+    } else {
+        y = ((1. / (((nu + 6.) / (nu * y) - 0.089 * d - 0.822) * (nu + 2.) * 3.)
+            + 0.5 / (nu + 4.)) * y - 1.) * (nu + 1.) / (nu + 2.) + 1. / y;
+    }
+    return std::sqrt(nu * y);
+}
 
 /**
- * @brief Compute Student's cumulative distribution function
+ * @brief Compute the upper tail of Student's t-distribution
+ *
+ * For nu >= kStudentsTSeriesMaxDF and \f$ t^2 \leq \nu \f$, we use Hill's
+ * normal approximation [11]. If nu is a natural number (for
+ * nu < kStudentsTSeriesMaxDF: within 1% of one, and we round down), we
+ * otherwise use the series expansions from [1]. In all other cases, we call
+ * boost.
+ *
+ * @param dist A Student's t-distribution object with finite and valid degree
+ *     of freedom \f$ \nu \f$
+ * @param t A finite value \f$ t \geq 0 \f$
+ * @return \f$ \Pr[T > t] \f$
+ */
+template <class RealType, class Policy>
+inline
+RealType
+upperStudentsT_Tail(
+    const boost::math::students_t_distribution<RealType, Policy>& dist,
+    const RealType& t) {
+
+    RealType df = dist.degrees_of_freedom();
+
+    if (df >= kStudentsTSeriesMaxDF && t * t <= df)
+        return boost::math::cdf(boost::math::complement(
+            boost::math::normal_distribution<RealType, Policy>(),
+            HillsNormalApproxForStudentsT(t, df)));
+
+    // FIXME: Add some justification/do some tests.
+    if (df < kStudentsTSeriesMaxDF
+        ? std::fabs(df - std::floor(df))/df > 0.01
+        : df != std::floor(df))
+        return boost::math::cdf(boost::math::complement(dist, t));
+
+    uint64_t nu = static_cast<uint64_t>(df);
+    if (nu >= kStudentsTSeriesMaxDF)
+        // Here t^2 > nu, so the series converges quickly
+        return .5 * twoSidedStudentsT_Tail(t, nu);
+
+    RealType twoSidedTail = 1. - oneSidedStudentsT_CDF(t, nu);
+    if (twoSidedTail < kStudentsTTailSeriesThreshold)
+        twoSidedTail = twoSidedStudentsT_Tail(t, nu);
+
+    return .5 * twoSidedTail;
+}
+
+/**
+ * @brief Compute the upper quantile of Student's t-distribution
  *
- * For nu >= 1000000, we just use the normal distribution as an approximation.
- * For 1000000 >= nu >= 200, we use a simple approximation from [9].
- * If nu is not within 0.01 of a natural number, we will call the student-t
- * CDF from boost. Otherwise, our approach should be much more precise than
- * using the incomplete beta function as boost does (see the references).
+ * We refine the approximation from [12] with (at most three) Newton steps
+ * on upperStudentsT_Tail(). Compared to boost's implementation (with extended
+ * precision), the relative error is below 1e-8 for all
+ * \f$ q \geq 10^{-300} \f$ (and below 1e-10 for nu >= 7).
  *
- * We are much more cautious than usual here (it is folklore that the normal
- * distribution is a "good" estimate for Student-T if nu >= 30), but we can
- * afford the extra work as this function is not designed to be called from
- * inner loops. Performance should still be reasonably good, with at most ~100
- * iterations in any case (just one if nu >= 200).
+ * @param dist A Student's t-distribution object with finite degree of
+ *     freedom \f$ \nu \geq 1 \f$
+ * @param q Upper tail probability \f$ q \in (0, 0.5] \f$
+ * @return \f$ t \geq 0 \f$ such that \f$ \Pr[T > t] = q \f$
+ */
+template <class RealType, class Policy>
+inline
+RealType
+upperStudentsT_Quantile(
+    const boost::math::students_t_distribution<RealType, Policy>& dist,
+    const RealType& q) {
+
+    if (q >= 0.5)
+        return 0;
+
+    RealType nu = dist.degrees_of_freedom();
+    RealType t = HillsStudentsT_QuantileApprox<RealType, Policy>(2. * q, nu);
+
+    // The density is c * (1 + t^2/nu)^(-(nu + 1)/2) with
+    // c = Gamma((nu + 1)/2) / (sqrt(nu * pi) * Gamma(nu/2))
+    RealType c = 1. / (std::sqrt(nu * M_PI)
+        * boost::math::tgamma_delta_ratio(nu / 2., RealType(0.5), Policy()));
+
+    for (int i = 0; i < 3; ++i) {
+        RealType tail = upperStudentsT_Tail(dist, t);
+        RealType density = c * std::exp(-(nu + 1.) / 2.
+            * boost::math::log1p(t * t / nu, Policy()));
+        RealType delta = (tail - q) / density;
+
+        // In the far tails, tail and density may underflow
+        if (!(tail > 0 && density > 0) || !boost::math::isfinite(delta))
+            break;
+
+        t = std::max(t + delta, RealType(0));
+        if (std::fabs(delta) <= 64 * std::numeric_limits<RealType>::epsilon()
+            * t)
+            break;
+    }
+    return t;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Compute Student's cumulative distribution function
  *
- * For nu < 200, we use the series expansions 26.7.3 and 26.7.4 from [1] and
- * substitute sin(theta) = t/sqrt(n * z), where z = 1 + t^2/nu (using
- * oneSidedStudentsT_CDF()).
+ * For nu >= 100, we use Hill's asymptotic normal approximation [11] if
+ * \f$ t^2 \leq \nu \f$. Otherwise, if nu is within 0.01 of a natural number
+ * (for nu >= 100: if nu is a natural number), we use the series expansions
+ * 26.7.3 and 26.7.4 from [1], substituting sin(theta) = t/sqrt(n * z), where
+ * z = 1 + t^2/nu (using oneSidedStudentsT_CDF()). Small tails are computed
+ * directly, without cancellation (using twoSidedStudentsT_Tail()). In all
+ * other cases, we call the student-t CDF from boost. Our approach should be
+ * much more precise than using the incomplete beta function as boost does
+ * (see the references), and it is considerably faster.
+ *
+ * Compared to boost's implementation (with extended precision), the relative
+ * error of the result (and of its complement) is below 1e-12 for natural
+ * nu < 100, and below 1.5e-8 for nu >= 100. The running time is at most ~50
+ * multiply-adds for \f$ \Pr[|T| > t] \geq 10^{-3} \f$ and roughly
+ * \f$ 37 / \log(1 + t^2/\nu) \f$ multiply-adds for smaller tails.
  *
  * @param dist A Student's t-distribution object, containing the degree of
  *     freedom \f$ \nu \f$
  * @param t
- * @return \f$ \Pr[T < t] \f$ where \f$ t \geq 0 \f$, \f$ T \f$ is a Student's
+ * @return \f$ \Pr[T < t] \f$ where \f$ T \f$ is a Student's
  *     T-distributed random variable with \f$ \nu \f$ degrees of
  *     freedom.
  */
@@ -234,8 +482,7 @@ cdf(const boost::math::students_t_distribution<RealType, Policy>& dist,
 
     RealType df = dist.degrees_of_freedom();
 
-    // FIXME: Add some justification/do some tests.
-    if (!std::isfinite(df) || std::fabs(df - std::floor(df))/df > 0.01)
+    if (!std::isfinite(df) || boost::math::isnan(t))
         return boost::math::cdf(dist, t);
 
     static const char* function = "madlib::modules::prob::cdf("
@@ -245,28 +492,16 @@ cdf(const boost::math::students_t_distribution<RealType, Policy>& dist,
     if (!boost::math::detail::check_df(function, df, &result, Policy()))
         return result;
 
-    if (df >= 200)
-        return
-            boost::math::cdf(
-                boost::math::normal_distribution<RealType, Policy>(),
-                df >= 1000000
-                    ? t
-                    : GleasonsNormalApproxForStudentsT(t, df)
-            );
-
-    // We first compute A = Pr[|T| < t]
-    RealType A = oneSidedStudentsT_CDF(t, static_cast<uint64_t>(df));
+    if (boost::math::isinf(t))
+        return t < 0 ? 0 : 1;
 
     /* The Student-T distribution is obviously symmetric around t=0... */
     if (t < 0)
-        /* FIXME: If A is approximately 1, we will face a loss of significance.
-         *  */
-        return .5 * (1. - A);
+        return upperStudentsT_Tail(dist, -t);
     else
-        /* While we only know A in [0,1] here, the end result will be in
-         * [0.5, 1]. Hence, there is no problem with adding 1 and A, even if
-         * A << 1. */
-        return .5 * (1. + A);
+        /* The upper tail is in [0, 0.5] here, so there is no loss of
+         * significance. */
+        return 1. - upperStudentsT_Tail(dist, t);
 }
 
 /**
@@ -281,24 +516,6 @@ cdf(
         RealType
     >& c
 ) {
-    RealType df = c.dist.degrees_of_freedom();
-    if (df >= 200) {
-        static const char* function = "madlib::modules::prob::cdf("
-            "const complement(students_t_distribution<%1%>&), %1%)";
-
-        RealType result;
-        if (!boost::math::detail::check_df(function, df, &result, Policy()))
-            return result;
-
-        return
-            boost::math::cdf(complement(
-                boost::math::normal_distribution<RealType, Policy>(),
-                df >= 1000000
-                    ? c.param
-                    : GleasonsNormalApproxForStudentsT(c.param, df)
-            ));
-    }
-
     return prob::cdf(c.dist, -c.param);
 }
 
@@ -322,6 +539,12 @@ pdf(
     return boost::math::pdf(c);
 }
 
+/**
+ * @brief Compute the quantile function of Student's t-distribution
+ *
+ * If nu >= 100 or nu is a natural number, we use upperStudentsT_Quantile(),
+ * which is considerably faster than boost. Otherwise, we call boost.
+ */
 template <class RealType, class Policy>
 inline
 RealType
@@ -342,7 +565,18 @@ quantile(const boost::math::students_t_distribution<RealType, Policy>& dist,
         || !detail::check_probability(function, p, &result, Policy()))
         return result;
 
-    return boost::math::quantile(dist, p);
+    if (!std::isfinite(df)
+        || (df < kStudentsTSeriesMaxDF && df != std::floor(df)))
+        return boost::math::quantile(dist, p);
+
+    if (p == 0)
+        return -std::numeric_limits<RealType>::infinity();
+    else if (p == 1)
+        return std::numeric_limits<RealType>::infinity();
+
+    return p < 0.5
+        ? -upperStudentsT_Quantile(dist, p)
+        : upperStudentsT_Quantile(dist, RealType(1. - p));
 }
 
 template <class RealType, class Policy>
@@ -354,7 +588,7 @@ quantile(
         RealType
     >& c
 ) {
-    return boost::math::quantile(c);
+    return -prob::quantile(c.dist, c.param);
 }
 
 } // namespace prob
@@ -9,6 +9,9 @@
 
 #include <boost/math/distributions.hpp>
 #include <modules/prob/student.hpp>
+#include <modules/shared/FixedWidth.hpp>
+
+#include <limits>
 
 namespace madlib {
 
@@ -41,21 +44,49 @@ inline
 void
 LinearRegressionAccumulator<Container>::bind(ByteStream_type& inStream) {
     inStream
-        >> numRows >> widthOfX >> y_sum >> y_square_sum;
-    uint16_t actualWidthOfX = widthOfX.isNull()
+        >> numRows >> widthOfX >> numBufferedRows >> y_sum >> y_square_sum;
+    uint32_t actualWidthOfX = widthOfX.isNull()
         ? 0
-        : static_cast<uint16_t>(widthOfX);
+        : static_cast<uint32_t>(widthOfX);
     inStream
         >> X_transp_Y.rebind(actualWidthOfX)
-        >> X_transp_X.rebind(actualWidthOfX, actualWidthOfX);
+        >> X_transp_X_packed.rebind(packedSize(actualWidthOfX))
+        >> X_panel.rebind(actualWidthOfX, panelRows(actualWidthOfX))
+        >> y_panel.rebind(panelRows(actualWidthOfX));
+}
+
+/**
+ * @brief Return the number of rows buffered before updating \f$ X^T X \f$
+ *
+ * For small widths, the panel would take more space than it saves in
+ * computation, so it never has more rows than columns.
+ */
+template <class Container>
+inline
+Index
+LinearRegressionAccumulator<Container>::panelRows(uint32_t inWidthOfX) {
+    return std::min<Index>(kMaxPanelRows, inWidthOfX);
+}
+
+/**
+ * @brief Return the number of entries in the packed upper triangle of a
+ *     symmetric matrix with the given number of columns
+ */
+template <class Container>
+inline
+Index
+LinearRegressionAccumulator<Container>::packedSize(uint32_t inWidthOfX) {
+    return static_cast<Index>(inWidthOfX)
+        * (static_cast<Index>(inWidthOfX) + 1) / 2;
 }
 
 /**
  * @brief Update the accumulation state
  *
  * We update the number of rows \f$ n \f$, the partial
- * sums \f$ \sum_{i=1}^n y_i \f$ and \f$ \sum_{i=1}^n y_i^2 \f$, the matrix
- * \f$ X^T X \f$, and the vector \f$ X^T \boldsymbol y \f$.
+ * sums \f$ \sum_{i=1}^n y_i \f$ and \f$ \sum_{i=1}^n y_i^2 \f$, and buffer
+ * the row. Once the panel is full, it is added to the matrix \f$ X^T X \f$
+ * and the vector \f$ X^T \boldsymbol y \f$.
  */
 template <class Container>
 inline
@@ -70,18 +101,18 @@ LinearRegressionAccumulator<Container>::operator<<(const tuple_type& inTuple) {
         throw std::domain_error("Dependent variables are not finite.");
     else if (!isfinite(x))
         throw std::domain_error("Design matrix is not finite.");
-    else if (x.size() > std::numeric_limits<uint16_t>::max())
+    else if (x.size() > std::numeric_limits<uint32_t>::max())
         throw std::domain_error("Number of independent variables cannot be "
-            "larger than 65535.");
+            "larger than 4294967295.");
 
     // Initialize in first iteration
     if (numRows == 0) {
-        widthOfX = static_cast<uint16_t>(x.size());
+        widthOfX = static_cast<uint32_t>(x.size());
         this->resize();
     }
 
     // dimension check
-    if (widthOfX != static_cast<uint16_t>(x.size())) {
+    if (widthOfX != static_cast<uint32_t>(x.size())) {
         throw std::runtime_error("Inconsistent numbers of independent "
             "variables.");
     }
@@ -89,16 +120,209 @@ LinearRegressionAccumulator<Container>::operator<<(const tuple_type& inTuple) {
     numRows++;
     y_sum += y;
     y_square_sum += y * y;
-    X_transp_Y.noalias() += x * y;
 
-    // X^T X is symmetric, so it is sufficient to only fill a triangular part
-    // of the matrix
-    triangularView<Lower>(X_transp_X) += x * trans(x);
+    if (x.isAligned())
+        X_panel.col(numBufferedRows) = x.aligned();
+    else
+        X_panel.col(numBufferedRows) = x;
+    y_panel(numBufferedRows) = y;
+    numBufferedRows++;
+    if (numBufferedRows == panelRows(widthOfX))
+        flush();
+    return *this;
+}
+
+/**
+ * @brief Update the accumulation state with a block of rows
+ *
+ * The columns of the first element of \c inBlock are the rows of the design
+ * matrix (which is how a two-dimensional array with one inner array per row
+ * is mapped, see matrix_agg()), and the second element holds the dependent
+ * variables. The whole block is added to \f$ X^T X \f$ and
+ * \f$ X^T \boldsymbol y \f$ with a single rank-k update.
+ */
+template <class Container>
+inline
+LinearRegressionAccumulator<Container>&
+LinearRegressionAccumulator<Container>::operator<<(const block_type& inBlock) {
+    const MappedMatrix& X_transp = std::get<0>(inBlock);
+    const MappedColumnVector& y = std::get<1>(inBlock);
+
+    if (X_transp.cols() != y.size())
+        throw std::invalid_argument("Invalid block of rows. Numbers of "
+            "dependent and independent variables differ.");
+    else if (!isfinite(y))
+        throw std::domain_error("Dependent variables are not finite.");
+    else if (!isfinite(X_transp))
+        throw std::domain_error("Design matrix is not finite.");
+    else if (X_transp.rows() > std::numeric_limits<uint32_t>::max())
+        throw std::domain_error("Number of independent variables cannot be "
+            "larger than 4294967295.");
+
+    if (y.size() == 0)
+        return *this;
+
+    // Initialize in first iteration
+    if (numRows == 0) {
+        widthOfX = static_cast<uint32_t>(X_transp.rows());
+        this->resize();
+    }
+
+    // dimension check
+    if (widthOfX != static_cast<uint32_t>(X_transp.rows())) {
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+    }
+
+    numRows += y.size();
+    y_sum += y.sum();
+    y_square_sum += y.squaredNorm();
+    addPanel(X_transp, y, y.size());
     return *this;
 }
 
+/**
+ * @brief Add all buffered rows to \f$ X^T X \f$ and \f$ X^T \boldsymbol y \f$
+ */
+template <class Container>
+inline
+void
+LinearRegressionAccumulator<Container>::flush() {
+    if (numBufferedRows == 0)
+        return;
+
+    addPanel(X_panel, y_panel, numBufferedRows);
+    numBufferedRows = 0;
+}
+
+/**
+ * @brief Rank-k update of the packed upper triangle for a fixed width
+ *
+ * The panel of a state with \f$ \mathit{widthOfX} = \mathit{Width} \f$ is
+ * contiguous, so it can be mapped as a matrix with a fixed number of rows.
+ * The full product \f$ P P^T \f$ is then a small fixed-size matrix that Eigen
+ * computes without any loops of runtime length other than over the rows of
+ * the panel.
+ */
+template <class VectorType>
+struct LinearRegressionPanelKernel {
+    LinearRegressionPanelKernel(const double* inPanel, const double* inPanelY,
+        Index inNumRows, VectorType& inX_transp_X_packed,
+        VectorType& inX_transp_Y)
+      : panel(inPanel), panelY(inPanelY), numRows(inNumRows),
+        X_transp_X_packed(inX_transp_X_packed), X_transp_Y(inX_transp_Y) { }
+
+    template <int Width>
+    void run() {
+        Eigen::Map<const Eigen::Matrix<double, Width, Eigen::Dynamic> >
+            P(panel, Width, numRows);
+        Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 1> >
+            y(panelY, numRows);
+
+        Eigen::Matrix<double, Width, Width> gram;
+        gram.noalias() = P * P.transpose();
+        Index offset = 0;
+        for (Index j = 0; j < Width; ++j) {
+            X_transp_X_packed.segment(offset, j + 1) += gram.col(j).head(j + 1);
+            offset += j + 1;
+        }
+
+        Eigen::Matrix<double, Width, 1> Py;
+        Py.noalias() = P * y;
+        X_transp_Y += Py;
+    }
+
+    const double* panel;
+    const double* panelY;
+    Index numRows;
+    VectorType& X_transp_X_packed;
+    VectorType& X_transp_Y;
+};
+
+/**
+ * @brief Rank-k update of the packed upper triangle
+ *
+ * The first \c inNumRows columns of \c inPanel are rows of the design matrix.
+ * Each column of the upper triangle of \f$ X^T X \f$ is updated with a single
+ * matrix-vector product, which is what a symmetric rank-k update (SYRK)
+ * amounts to when only one triangle is stored. For small widths, the update
+ * is done by a LinearRegressionPanelKernel instead.
+ */
+template <class Container>
+template <class PanelType, class PanelYType>
+inline
+void
+LinearRegressionAccumulator<Container>::addPanel(const PanelType& inPanel,
+    const PanelYType& inPanelY, Index inNumRows) {
+
+    Index width = widthOfX;
+    LinearRegressionPanelKernel<MappedColumnVector_type> kernel(
+        inPanel.data(), inPanelY.data(), inNumRows, X_transp_X_packed,
+        X_transp_Y);
+    if (dispatchFixedWidth(width, kernel))
+        return;
+
+    Index offset = 0;
+    for (Index j = 0; j < width; ++j) {
+        X_transp_X_packed.segment(offset, j + 1).noalias()
+            += inPanel.topLeftCorner(j + 1, inNumRows)
+             * trans(inPanel.row(j).head(inNumRows));
+        offset += j + 1;
+    }
+    X_transp_Y.noalias() += inPanel.leftCols(inNumRows)
+        * inPanelY.head(inNumRows);
+}
+
+/**
+ * @brief Expand a packed upper triangle into the upper triangle of a matrix
+ *
+ * The strictly lower triangle of \c outMatrix is left uninitialized.
+ */
+template <class PackedType>
+inline
+void
+unpackUpperTriangle(const PackedType& inPacked, Index inWidth,
+    Matrix& outMatrix) {
+
+    outMatrix.resize(inWidth, inWidth);
+    Index offset = 0;
+    for (Index j = 0; j < inWidth; ++j) {
+        outMatrix.col(j).head(j + 1) = inPacked.segment(offset, j + 1);
+        offset += j + 1;
+    }
+}
+
+/**
+ * @brief Expand the state into a full \f$ X^T X \f$ and \f$ X^T \boldsymbol y \f$
+ *
+ * Buffered rows that have not been flushed yet are included. Both triangles
+ * of \c outX_transp_X are filled.
+ */
+template <class Container>
+inline
+void
+LinearRegressionAccumulator<Container>::unpack(Matrix& outX_transp_X,
+    ColumnVector& outX_transp_Y) const {
+
+    Index buffered = numBufferedRows;
+
+    unpackUpperTriangle(X_transp_X_packed, widthOfX, outX_transp_X);
+    outX_transp_Y = X_transp_Y;
+    if (buffered > 0) {
+        outX_transp_X.triangularView<Eigen::Upper>()
+            += X_panel.leftCols(buffered) * trans(X_panel.leftCols(buffered));
+        outX_transp_Y.noalias() += X_panel.leftCols(buffered)
+            * y_panel.head(buffered);
+    }
+    outX_transp_X.triangularView<Eigen::StrictlyLower>()
+        = trans(outX_transp_X);
+}
+
 /**
  * @brief Merge with another accumulation state
+ *
+ * The rows buffered in either state are flushed into this state. Both states
+ * must have the same number of independent variables.
  */
 template <class Container>
 template <class OtherContainer>
@@ -107,11 +331,18 @@ LinearRegressionAccumulator<Container>&
 LinearRegressionAccumulator<Container>::operator<<(
     const LinearRegressionAccumulator<OtherContainer>& inOther) {
 
+    if (widthOfX != static_cast<uint32_t>(inOther.widthOfX))
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+
+    flush();
     numRows += inOther.numRows;
     y_sum += inOther.y_sum;
     y_square_sum += inOther.y_square_sum;
     X_transp_Y.noalias() += inOther.X_transp_Y;
-    triangularView<Lower>(X_transp_X) += inOther.X_transp_X;
+    X_transp_X_packed.noalias() += inOther.X_transp_X_packed;
+    if (inOther.numBufferedRows > 0)
+        addPanel(inOther.X_panel, inOther.y_panel, inOther.numBufferedRows);
     return *this;
 }
 
@@ -127,6 +358,60 @@ LinearRegressionAccumulator<Container>::operator=(
 }
 
 
+/**
+ * @brief Compute the standard errors, t-statistics, and p-values
+ *
+ * The coefficients have to be computed already. The variance of coefficient
+ * \f$ i \f$ is \f$ \sigma^2 \cdot \left( (X^T X)^+ \right)_{ii} \f$.
+ */
+inline
+void
+LinearRegression::computeStatistics(uint64_t inNumRows, uint32_t inWidthOfX,
+    double inVariance, const ColumnVector& inDiagonalOfInverse) {
+
+    Allocator& allocator = defaultAllocator();
+
+    // Vector of standard errors and t-statistics: For efficiency reasons, we
+    // want to return these by reference, so we need to bind to db memory
+    stdErr.rebind(allocator.allocateArray<double>(inWidthOfX));
+    tStats.rebind(allocator.allocateArray<double>(inWidthOfX));
+    for (Index i = 0; i < static_cast<Index>(inWidthOfX); i++) {
+        // In an abundance of caution, we see a tiny possibility that numerical
+        // instabilities in the pinv operation can lead to negative values on
+        // the main diagonal of even a SPD matrix
+        if (inDiagonalOfInverse(i) < 0) {
+            stdErr(i) = 0;
+        } else {
+            stdErr(i) = std::sqrt(
+                inVariance * inDiagonalOfInverse(i) );
+        }
+
+        if (coef(i) == 0 && stdErr(i) == 0) {
+            // In this special case, 0/0 should be interpreted as 0:
+            // We know that 0 is the exact value for the coefficient, so
+            // the t-value should be 0 (corresponding to a p-value of 1)
+            tStats(i) = 0;
+        } else {
+            // If stdErr(i) == 0 then abs(tStats(i)) will be infinity, which
+            // is what we need.
+            tStats(i) = coef(i) / stdErr(i);
+        }
+    }
+
+    // Vector of p-values: For efficiency reasons, we want to return this
+    // by reference, so we need to bind to db memory
+    pValues.rebind(allocator.allocateArray<double>(inWidthOfX));
+    if (inNumRows > inWidthOfX)
+        for (Index i = 0; i < static_cast<Index>(inWidthOfX); i++)
+            pValues(i) = 2. * prob::cdf(
+                boost::math::complement(
+                    prob::students_t(
+                        static_cast<double>(inNumRows - inWidthOfX)
+                    ),
+                    std::fabs(tStats(i))
+                ));
+}
+
 template <class Container>
 LinearRegression::LinearRegression(
     const LinearRegressionAccumulator<Container>& inState) {
@@ -137,8 +422,9 @@ LinearRegression::LinearRegression(
 /**
  * @brief Transform a linear-regression accumulation state into a result
  *
- * The result of the accumulation phase is \f$ X^T X \f$ and
- * \f$ X^T \boldsymbol y \f$. We first compute the pseudo-inverse, then the
+ * The result of the accumulation phase is \f$ X^T X \f$ (packed, plus the rows
+ * still buffered in the panel) and \f$ X^T \boldsymbol y \f$. We first unpack
+ * the state, compute the pseudo-inverse, then the
  * regression coefficients, the model statistics, etc.
  *
  * @sa For the mathematical description, see \ref grp_linreg.
@@ -153,23 +439,29 @@ LinearRegression::compute(
 
     // The following checks were introduced with MADLIB-138. It still seems
     // useful to have clear error messages in case of infinite input values.
-    if (!isfinite(inState.X_transp_X) || !isfinite(inState.X_transp_Y))
+    Matrix X_transp_X;
+    ColumnVector X_transp_Y;
+    inState.unpack(X_transp_X, X_transp_Y);
+    if (!isfinite(X_transp_X) || !isfinite(X_transp_Y))
         throw std::domain_error("Design matrix is not finite.");
 
+    // We only need the coefficients (X^T X)^+ X^T Y and the diagonal of
+    // (X^T X)^+, so there is no need to form the pseudo-inverse. Unless the
+    // matrix is ill-conditioned, there is no need for the eigen decomposition
+    // either.
     SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
-        inState.X_transp_X, EigenvaluesOnly, ComputePseudoInverse);
-
-    // Precompute (X^T * X)^+
-    Matrix inverse_of_X_transp_X = decomposition.pseudoInverse();
+        X_transp_X, EigenvaluesOnly, ComputeSolver | EstimateConditionNo);
+    const ColumnVector& diagonal_of_inverse_of_X_transp_X
+        = decomposition.pseudoInverseDiagonal();
     conditionNo = decomposition.conditionNo();
 
     // Vector of coefficients: For efficiency reasons, we want to return this
     // by reference, so we need to bind to db memory
     coef.rebind(allocator.allocateArray<double>(inState.widthOfX));
-    coef.noalias() = inverse_of_X_transp_X * inState.X_transp_Y;
+    coef = decomposition.solve(X_transp_Y);
 
     // explained sum of squares (regression sum of squares)
-    double ess = dot(inState.X_transp_Y, coef)
+    double ess = dot(X_transp_Y, coef)
         - (inState.y_sum * inState.y_sum / static_cast<double>(inState.numRows));
 
     // total sum of squares
@@ -203,37 +495,470 @@ LinearRegression::compute(
     // Variance is also called the mean square error
 	double variance = rss / static_cast<double>(inState.numRows - inState.widthOfX);
 
-    // Vector of standard errors and t-statistics: For efficiency reasons, we
-    // want to return these by reference, so we need to bind to db memory
-    stdErr.rebind(allocator.allocateArray<double>(inState.widthOfX));
-    tStats.rebind(allocator.allocateArray<double>(inState.widthOfX));
-    for (int i = 0; i < inState.widthOfX; i++) {
-        // In an abundance of caution, we see a tiny possibility that numerical
-        // instabilities in the pinv operation can lead to negative values on
-        // the main diagonal of even a SPD matrix
-        if (inverse_of_X_transp_X(i,i) < 0) {
-            stdErr(i) = 0;
-        } else {
-            stdErr(i) = std::sqrt( variance * inverse_of_X_transp_X(i,i) );
-        }
+    computeStatistics(inState.numRows, inState.widthOfX, variance,
+        diagonal_of_inverse_of_X_transp_X);
+    return *this;
+}
 
-        if (coef(i) == 0 && stdErr(i) == 0) {
-            // In this special case, 0/0 should be interpreted as 0:
-            // We know that 0 is the exact value for the coefficient, so
-            // the t-value should be 0 (corresponding to a p-value of 1)
-            tStats(i) = 0;
-        } else {
-            // If stdErr(i) == 0 then abs(tStats(i)) will be infinity, which
-            // is what we need.
-            tStats(i) = coef(i) / stdErr(i);
-        }
+template <class Container>
+inline
+QRLinearRegressionAccumulator<Container>::QRLinearRegressionAccumulator(
+    Init_type& inInitialization)
+  : Base(inInitialization) {
+
+    this->initialize();
+}
+
+/**
+ * @brief Bind all elements of the state to the data in the stream
+ *
+ * See LinearRegressionAccumulator::bind().
+ */
+template <class Container>
+inline
+void
+QRLinearRegressionAccumulator<Container>::bind(ByteStream_type& inStream) {
+    inStream
+        >> numRows >> widthOfX >> numBufferedRows >> y_sum >> y_square_sum;
+    uint32_t actualWidthOfX = widthOfX.isNull()
+        ? 0
+        : static_cast<uint32_t>(widthOfX);
+    Index augmentedWidth = widthOfX.isNull() ? 0 : actualWidthOfX + 1;
+    inStream
+        >> R.rebind(augmentedWidth, augmentedWidth)
+        >> panel.rebind(augmentedWidth,
+            widthOfX.isNull() ? 0 : panelRows(actualWidthOfX));
+}
+
+/**
+ * @brief Return the number of rows buffered before updating \f$ R \f$
+ *
+ * Every reduction also has to process the rows of \f$ R \f$, so the panel
+ * has at least as many rows as \f$ R \f$.
+ */
+template <class Container>
+inline
+Index
+QRLinearRegressionAccumulator<Container>::panelRows(uint32_t inWidthOfX) {
+    return std::max<Index>(kMinPanelRows, inWidthOfX + 1);
+}
+
+/**
+ * @brief Update the accumulation state
+ *
+ * The row \f$ (\boldsymbol x^T, y) \f$ is buffered. Once the panel is full, it
+ * is reduced into \f$ R \f$.
+ */
+template <class Container>
+inline
+QRLinearRegressionAccumulator<Container>&
+QRLinearRegressionAccumulator<Container>::operator<<(
+    const tuple_type& inTuple) {
+
+    const MappedColumnVector& x = std::get<0>(inTuple);
+    const double& y = std::get<1>(inTuple);
+
+    if (!std::isfinite(y))
+        throw std::domain_error("Dependent variables are not finite.");
+    else if (!isfinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+    else if (x.size() >= std::numeric_limits<uint32_t>::max())
+        throw std::domain_error("Number of independent variables cannot be "
+            "larger than 4294967294.");
+
+    // Initialize in first iteration
+    if (numRows == 0) {
+        widthOfX = static_cast<uint32_t>(x.size());
+        this->resize();
+    }
+
+    // dimension check
+    if (widthOfX != static_cast<uint32_t>(x.size())) {
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+    }
+
+    numRows++;
+    y_sum += y;
+    y_square_sum += y * y;
+
+    panel.col(numBufferedRows).head(widthOfX) = x;
+    panel(widthOfX, numBufferedRows) = y;
+    numBufferedRows++;
+    if (numBufferedRows == panelRows(widthOfX))
+        flush();
+    return *this;
+}
+
+/**
+ * @brief Return the triangular factor of a matrix stacked below another
+ *     triangular factor
+ *
+ * This is the reduction step of TSQR: The triangular factor of the stacked
+ * matrix is the triangular factor of all rows that went into both parts.
+ */
+inline
+void
+reduceTriangularFactor(const Matrix& inStacked, Index inWidth,
+    Matrix& outR) {
+
+    Eigen::HouseholderQR<Matrix> qr(inStacked);
+    outR = qr.matrixQR().topRows(inWidth).triangularView<Eigen::Upper>();
+}
+
+/**
+ * @brief Reduce all buffered rows into \f$ R \f$
+ */
+template <class Container>
+inline
+void
+QRLinearRegressionAccumulator<Container>::flush() {
+    if (numBufferedRows == 0)
+        return;
+
+    Matrix R_new;
+    triangularFactor(R_new);
+    R = R_new;
+    numBufferedRows = 0;
+}
+
+/**
+ * @brief Return \f$ R \f$ including the buffered rows, without modifying the
+ *     state
+ */
+template <class Container>
+inline
+void
+QRLinearRegressionAccumulator<Container>::triangularFactor(Matrix& outR)
+    const {
+
+    Index width = static_cast<Index>(widthOfX) + 1;
+    Index buffered = numBufferedRows;
+    if (buffered == 0) {
+        outR = R;
+        return;
+    }
+
+    Matrix stacked(width + buffered, width);
+    stacked.topRows(width) = R;
+    stacked.bottomRows(buffered) = trans(panel.leftCols(buffered));
+    reduceTriangularFactor(stacked, width, outR);
+}
+
+/**
+ * @brief Merge with another accumulation state
+ *
+ * The factors of both states and the rows buffered in the other state are
+ * reduced with a single QR factorization.
+ */
+template <class Container>
+template <class OtherContainer>
+inline
+QRLinearRegressionAccumulator<Container>&
+QRLinearRegressionAccumulator<Container>::operator<<(
+    const QRLinearRegressionAccumulator<OtherContainer>& inOther) {
+
+    if (widthOfX != static_cast<uint32_t>(inOther.widthOfX))
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+
+    Index width = static_cast<Index>(widthOfX) + 1;
+    Index buffered = numBufferedRows;
+    Index otherBuffered = inOther.numBufferedRows;
+    Matrix stacked(2 * width + buffered + otherBuffered, width);
+    stacked.topRows(width) = R;
+    stacked.middleRows(width, width) = inOther.R;
+    if (buffered > 0)
+        stacked.middleRows(2 * width, buffered)
+            = trans(panel.leftCols(buffered));
+    if (otherBuffered > 0)
+        stacked.bottomRows(otherBuffered)
+            = trans(inOther.panel.leftCols(otherBuffered));
+
+    Matrix R_new;
+    reduceTriangularFactor(stacked, width, R_new);
+    R = R_new;
+    numBufferedRows = 0;
+    numRows += inOther.numRows;
+    y_sum += inOther.y_sum;
+    y_square_sum += inOther.y_square_sum;
+    return *this;
+}
+
+template <class Container>
+template <class OtherContainer>
+inline
+QRLinearRegressionAccumulator<Container>&
+QRLinearRegressionAccumulator<Container>::operator=(
+    const QRLinearRegressionAccumulator<OtherContainer>& inOther) {
+
+    this->copy(inOther);
+    return *this;
+}
+
+
+template <class Container>
+LinearRegression::LinearRegression(
+    const QRLinearRegressionAccumulator<Container>& inState) {
+
+    compute(inState);
+}
+
+/**
+ * @brief Transform a TSQR accumulation state into a result
+ *
+ * With the triangular factor
+ * \f$ R = \begin{pmatrix} R_{11} & \boldsymbol r_{12} \\ 0 & r_{22}
+ * \end{pmatrix} \f$ of \f$ [X \; \boldsymbol y] \f$, the coefficients are
+ * \f$ R_{11}^{-1} \boldsymbol r_{12} \f$, found by back substitution, and
+ * \f$ RSS = r_{22}^2 \f$. The diagonal of \f$ (X^T X)^{-1} \f$ consists of
+ * the squared norms of the rows of \f$ R_{11}^{-1} \f$. If \f$ R_{11} \f$ is
+ * numerically singular, its pseudo-inverse is used instead, as in linregr().
+ * The condition number is that of \f$ X^T X \f$, i.e., the square of the
+ * condition number of \f$ R_{11} \f$.
+ */
+template <class Container>
+inline
+LinearRegression&
+LinearRegression::compute(
+    const QRLinearRegressionAccumulator<Container>& inState) {
+
+    Allocator& allocator = defaultAllocator();
+
+    Matrix R_aug;
+    inState.triangularFactor(R_aug);
+    if (!isfinite(R_aug))
+        throw std::domain_error("Design matrix is not finite.");
+
+    Index width = inState.widthOfX;
+    Matrix R_11 = R_aug.topLeftCorner(width, width);
+    ColumnVector r_12 = R_aug.col(width).head(width);
+
+    Eigen::JacobiSVD<Matrix> singularValues(R_11);
+    const ColumnVector& sigma = singularValues.singularValues();
+    double sigmaMax = width > 0 ? sigma(0) : 0;
+    double sigmaMin = width > 0 ? sigma(width - 1) : 0;
+    conditionNo = sigmaMin > 0
+        ? (sigmaMax / sigmaMin) * (sigmaMax / sigmaMin)
+        : std::numeric_limits<double>::infinity();
+
+    coef.rebind(allocator.allocateArray<double>(inState.widthOfX));
+    ColumnVector diagonal_of_inverse_of_X_transp_X;
+    double threshold = sigmaMax * static_cast<double>(width)
+        * std::numeric_limits<double>::epsilon();
+    if (sigmaMin > threshold) {
+        coef = R_11.triangularView<Eigen::Upper>().solve(r_12);
+        Matrix R_11_inverse = R_11.triangularView<Eigen::Upper>().solve(
+            Matrix::Identity(width, width));
+        diagonal_of_inverse_of_X_transp_X
+            = R_11_inverse.rowwise().squaredNorm();
+    } else {
+        Eigen::JacobiSVD<Matrix> svd(R_11,
+            Eigen::ComputeFullU | Eigen::ComputeFullV);
+        ColumnVector sigmaInverse(width);
+        for (Index i = 0; i < width; ++i)
+            sigmaInverse(i) = sigma(i) > threshold ? 1. / sigma(i) : 0;
+        Matrix V_scaled = svd.matrixV() * sigmaInverse.asDiagonal();
+        coef = V_scaled * (trans(svd.matrixU()) * r_12);
+        diagonal_of_inverse_of_X_transp_X = V_scaled.rowwise().squaredNorm();
+    }
+
+    // The residual of the rank-deficient case is not only r_22
+    double rss = R_aug(width, width) * R_aug(width, width)
+        + (r_12 - R_11 * coef).squaredNorm();
+    double tss = inState.y_square_sum
+        - (inState.y_sum * inState.y_sum / static_cast<double>(inState.numRows));
+    // See compute() for LinearRegressionAccumulator
+    if (tss < 0)
+        tss = 0;
+    if (rss > tss)
+        rss = tss;
+    r2 = (tss == 0 ? 1 : 1. - rss / tss);
+
+    double variance
+        = rss / static_cast<double>(inState.numRows - inState.widthOfX);
+    computeStatistics(inState.numRows, inState.widthOfX, variance,
+        diagonal_of_inverse_of_X_transp_X);
+    return *this;
+}
+
+
+template <class Container>
+inline
+RobustLinearRegressionAccumulator<Container>::RobustLinearRegressionAccumulator(
+    Init_type& inInitialization)
+  : Base(inInitialization) {
+
+    this->initialize();
+}
+
+/**
+ * @brief Bind all elements of the state to the data in the stream
+ *
+ * See LinearRegressionAccumulator::bind().
+ */
+template <class Container>
+inline
+void
+RobustLinearRegressionAccumulator<Container>::bind(ByteStream_type& inStream) {
+    inStream >> numRows >> widthOfX;
+    uint32_t actualWidthOfX = widthOfX.isNull()
+        ? 0
+        : static_cast<uint32_t>(widthOfX);
+    inStream
+        >> coef.rebind(actualWidthOfX)
+        >> X_transp_X_packed.rebind(
+            LinearRegressionAccumulator<Container>::packedSize(actualWidthOfX))
+        >> meat_packed.rebind(
+            LinearRegressionAccumulator<Container>::packedSize(actualWidthOfX));
+}
+
+/**
+ * @brief Update the accumulation state
+ *
+ * The coefficients are taken from the first row. They are the same for all
+ * rows (typically the result of a scalar subquery), so for later rows only
+ * their number is checked.
+ */
+template <class Container>
+inline
+RobustLinearRegressionAccumulator<Container>&
+RobustLinearRegressionAccumulator<Container>::operator<<(
+    const tuple_type& inTuple) {
+
+    const MappedColumnVector& x = std::get<0>(inTuple);
+    const double& y = std::get<1>(inTuple);
+    const MappedColumnVector& inCoef = std::get<2>(inTuple);
+
+    if (!std::isfinite(y))
+        throw std::domain_error("Dependent variables are not finite.");
+    else if (!isfinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+    else if (x.size() > std::numeric_limits<uint32_t>::max())
+        throw std::domain_error("Number of independent variables cannot be "
+            "larger than 4294967295.");
+
+    // Initialize in first iteration
+    if (numRows == 0) {
+        if (!isfinite(inCoef))
+            throw std::domain_error("Coefficients are not finite.");
+
+        widthOfX = static_cast<uint32_t>(x.size());
+        this->resize();
+        coef = inCoef;
+    }
+
+    // dimension check
+    if (widthOfX != static_cast<uint32_t>(x.size())
+        || widthOfX != static_cast<uint32_t>(inCoef.size())) {
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables or coefficients.");
+    }
+
+    numRows++;
+
+    // e_i = y_i - c^T x_i
+    double residual = y - dot(x, coef);
+    double squaredResidual = residual * residual;
+    Index width = widthOfX;
+    Index offset = 0;
+    for (Index j = 0; j < width; ++j) {
+        X_transp_X_packed.segment(offset, j + 1).noalias()
+            += x(j) * x.head(j + 1);
+        meat_packed.segment(offset, j + 1).noalias()
+            += (squaredResidual * x(j)) * x.head(j + 1);
+        offset += j + 1;
+    }
+    return *this;
+}
+
+/**
+ * @brief Merge with another accumulation state
+ */
+template <class Container>
+template <class OtherContainer>
+inline
+RobustLinearRegressionAccumulator<Container>&
+RobustLinearRegressionAccumulator<Container>::operator<<(
+    const RobustLinearRegressionAccumulator<OtherContainer>& inOther) {
+
+    if (widthOfX != static_cast<uint32_t>(inOther.widthOfX))
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+
+    numRows += inOther.numRows;
+    X_transp_X_packed.noalias() += inOther.X_transp_X_packed;
+    meat_packed.noalias() += inOther.meat_packed;
+    return *this;
+}
+
+template <class Container>
+template <class OtherContainer>
+inline
+RobustLinearRegressionAccumulator<Container>&
+RobustLinearRegressionAccumulator<Container>::operator=(
+    const RobustLinearRegressionAccumulator<OtherContainer>& inOther) {
+
+    this->copy(inOther);
+    return *this;
+}
+
+
+template <class Container>
+RobustLinearRegression::RobustLinearRegression(
+    const RobustLinearRegressionAccumulator<Container>& inState) {
+
+    compute(inState);
+}
+
+/**
+ * @brief Transform a robust-variance accumulation state into a result
+ *
+ * The heteroskedasticity-consistent (HC0, or White) estimate of the
+ * covariance matrix of the coefficients is
+ * \f$ (X^T X)^+ \left( \sum_i e_i^2 \boldsymbol x_i \boldsymbol x_i^T
+ * \right) (X^T X)^+ \f$. As in linregr(), the p-values are those of a
+ * Student's t-distribution with \f$ n - k \f$ degrees of freedom.
+ */
+template <class Container>
+inline
+RobustLinearRegression&
+RobustLinearRegression::compute(
+    const RobustLinearRegressionAccumulator<Container>& inState) {
+
+    Allocator& allocator = defaultAllocator();
+
+    Matrix X_transp_X;
+    Matrix meat;
+    unpackUpperTriangle(inState.X_transp_X_packed, inState.widthOfX,
+        X_transp_X);
+    unpackUpperTriangle(inState.meat_packed, inState.widthOfX, meat);
+    X_transp_X.triangularView<Eigen::StrictlyLower>() = trans(X_transp_X);
+    meat.triangularView<Eigen::StrictlyLower>() = trans(meat);
+    if (!isfinite(X_transp_X) || !isfinite(meat))
+        throw std::domain_error("Design matrix is not finite.");
+
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        X_transp_X, EigenvaluesOnly, ComputePseudoInverse);
+    const Matrix& bread = decomposition.pseudoInverse();
+    ColumnVector variance = (bread * meat * bread).diagonal();
+
+    Index width = inState.widthOfX;
+    coef.rebind(allocator.allocateArray<double>(width));
+    stdErr.rebind(allocator.allocateArray<double>(width));
+    tStats.rebind(allocator.allocateArray<double>(width));
+    pValues.rebind(allocator.allocateArray<double>(width));
+    coef = inState.coef;
+    for (Index i = 0; i < width; i++) {
+        // See LinearRegression::compute()
+        stdErr(i) = variance(i) < 0 ? 0 : std::sqrt(variance(i));
+        tStats(i) = coef(i) == 0 && stdErr(i) == 0
+            ? 0
+            : coef(i) / stdErr(i);
     }
 
-    // Vector of p-values: For efficiency reasons, we want to return this
-    // by reference, so we need to bind to db memory
-    pValues.rebind(allocator.allocateArray<double>(inState.widthOfX));
     if (inState.numRows > inState.widthOfX)
-        for (int i = 0; i < inState.widthOfX; i++)
+        for (Index i = 0; i < width; i++)
             pValues(i) = 2. * prob::cdf(
                 boost::math::complement(
                     prob::students_t(
@@ -17,12 +17,25 @@ namespace regress {
 using namespace dbal;
 using namespace dbal::eigen_integration;
 
+/**
+ * @brief Transition state for linear regression
+ *
+ * Only the upper triangle of the symmetric matrix \f$ X^T X \f$ is stored,
+ * packed column by column (i.e., column \f$ j \f$ contributes the
+ * \f$ j + 1 \f$ entries \f$ (X^T X)_{0,j}, \dots, (X^T X)_{j,j} \f$). Rows
+ * are not added to \f$ X^T X \f$ one by one. Instead, they are first buffered
+ * in a panel of at most \c kMaxPanelRows rows, which is then added with a
+ * single rank-k update. A block of rows (see block_type) is added the same
+ * way, without going through the panel.
+ */
 template <class Container>
 class LinearRegressionAccumulator
   : public DynamicStruct<LinearRegressionAccumulator<Container>, Container> {
 public:
     enum { isMutable = Container::isMutable };
+    enum { kMaxPanelRows = 16 };
     typedef std::tuple<MappedColumnVector, double> tuple_type;
+    typedef std::tuple<MappedMatrix, MappedColumnVector> block_type;
 
     MADLIB_DYNAMIC_STRUCT_TYPEDEFS(LinearRegressionAccumulator, Container)
 
@@ -30,25 +43,46 @@ public:
     void bind(ByteStream_type& inStream);
 
     LinearRegressionAccumulator& operator<<(const tuple_type& inTuple);
+    LinearRegressionAccumulator& operator<<(const block_type& inBlock);
     template <class OtherContainer> LinearRegressionAccumulator& operator<<(
         const LinearRegressionAccumulator<OtherContainer>& inOther);
     template <class OtherContainer> LinearRegressionAccumulator& operator=(
         const LinearRegressionAccumulator<OtherContainer>& inOther);
 
+    void flush();
+    void unpack(Matrix& outX_transp_X, ColumnVector& outX_transp_Y) const;
+
+    static Index panelRows(uint32_t inWidthOfX);
+    static Index packedSize(uint32_t inWidthOfX);
+
     uint64_type numRows;
-    uint16_type widthOfX;
+    uint32_type widthOfX;
+    uint32_type numBufferedRows;
     double_type y_sum;
     double_type y_square_sum;
     MappedColumnVector_type X_transp_Y;
-    MappedMatrix_type X_transp_X;
+    MappedColumnVector_type X_transp_X_packed;
+    MappedMatrix_type X_panel;
+    MappedColumnVector_type y_panel;
+
+private:
+    template <class PanelType, class PanelYType>
+    void addPanel(const PanelType& inPanel, const PanelYType& inPanelY,
+        Index inNumRows);
 };
 
+template <class Container> class QRLinearRegressionAccumulator;
+
 class LinearRegression {
 public:
     template <class Container> LinearRegression(
         const LinearRegressionAccumulator<Container>& inState);
+    template <class Container> LinearRegression(
+        const QRLinearRegressionAccumulator<Container>& inState);
     template <class Container> LinearRegression& compute(
         const LinearRegressionAccumulator<Container>& inState);
+    template <class Container> LinearRegression& compute(
+        const QRLinearRegressionAccumulator<Container>& inState);
 
     MutableMappedColumnVector coef;
     double r2;
@@ -56,6 +90,111 @@ public:
     MutableMappedColumnVector tStats;
     MutableMappedColumnVector pValues;
     double conditionNo;
+
+private:
+    void computeStatistics(uint64_t inNumRows, uint32_t inWidthOfX,
+        double inVariance, const ColumnVector& inDiagonalOfInverse);
+};
+
+/**
+ * @brief Transition state for linear regression by a tall-skinny QR
+ *     factorization (TSQR)
+ *
+ * Instead of \f$ X^T X \f$, the state holds the upper-triangular factor
+ * \f$ R \f$ of the QR factorization of the augmented design matrix
+ * \f$ [X \; \boldsymbol y] \f$, so that
+ * \f$ R^T R = [X \; \boldsymbol y]^T [X \; \boldsymbol y] \f$ without
+ * ever forming the product (which would square the condition number). Rows
+ * are buffered in a panel, which is then reduced together with \f$ R \f$ by
+ * a single Householder QR. Merging two states is a QR of the two stacked
+ * factors, so a merged state is still a \f$ (k + 1) \times (k + 1) \f$
+ * triangle.
+ */
+template <class Container>
+class QRLinearRegressionAccumulator
+  : public DynamicStruct<QRLinearRegressionAccumulator<Container>, Container> {
+public:
+    enum { isMutable = Container::isMutable };
+    enum { kMinPanelRows = 16 };
+    typedef std::tuple<MappedColumnVector, double> tuple_type;
+
+    MADLIB_DYNAMIC_STRUCT_TYPEDEFS(QRLinearRegressionAccumulator, Container)
+
+    QRLinearRegressionAccumulator(Init_type& inInitialization);
+    void bind(ByteStream_type& inStream);
+
+    QRLinearRegressionAccumulator& operator<<(const tuple_type& inTuple);
+    template <class OtherContainer> QRLinearRegressionAccumulator& operator<<(
+        const QRLinearRegressionAccumulator<OtherContainer>& inOther);
+    template <class OtherContainer> QRLinearRegressionAccumulator& operator=(
+        const QRLinearRegressionAccumulator<OtherContainer>& inOther);
+
+    void flush();
+    void triangularFactor(Matrix& outR) const;
+
+    static Index panelRows(uint32_t inWidthOfX);
+
+    uint64_type numRows;
+    uint32_type widthOfX;
+    uint32_type numBufferedRows;
+    double_type y_sum;
+    double_type y_square_sum;
+    MappedMatrix_type R;
+    MappedMatrix_type panel;
+};
+
+/**
+ * @brief Transition state for robust (sandwich) standard errors of linear
+ *     regression
+ *
+ * Given the coefficients \f$ \boldsymbol c \f$ of a previous linregr()
+ * pass, a single scan accumulates the "bread" \f$ X^T X \f$ and the "meat"
+ * \f$ \sum_i e_i^2 \boldsymbol x_i \boldsymbol x_i^T \f$, where
+ * \f$ e_i = y_i - \boldsymbol c^T \boldsymbol x_i \f$ is the residual.
+ * Both symmetric matrices are stored as packed upper triangles, as in
+ * LinearRegressionAccumulator.
+ */
+template <class Container>
+class RobustLinearRegressionAccumulator
+  : public DynamicStruct<RobustLinearRegressionAccumulator<Container>,
+        Container> {
+public:
+    enum { isMutable = Container::isMutable };
+    typedef std::tuple<MappedColumnVector, double, MappedColumnVector>
+        tuple_type;
+
+    MADLIB_DYNAMIC_STRUCT_TYPEDEFS(RobustLinearRegressionAccumulator,
+        Container)
+
+    RobustLinearRegressionAccumulator(Init_type& inInitialization);
+    void bind(ByteStream_type& inStream);
+
+    RobustLinearRegressionAccumulator& operator<<(const tuple_type& inTuple);
+    template <class OtherContainer> RobustLinearRegressionAccumulator&
+        operator<<(const RobustLinearRegressionAccumulator<OtherContainer>&
+            inOther);
+    template <class OtherContainer> RobustLinearRegressionAccumulator&
+        operator=(const RobustLinearRegressionAccumulator<OtherContainer>&
+            inOther);
+
+    uint64_type numRows;
+    uint32_type widthOfX;
+    MappedColumnVector_type coef;
+    MappedColumnVector_type X_transp_X_packed;
+    MappedColumnVector_type meat_packed;
+};
+
+class RobustLinearRegression {
+public:
+    template <class Container> RobustLinearRegression(
+        const RobustLinearRegressionAccumulator<Container>& inState);
+    template <class Container> RobustLinearRegression& compute(
+        const RobustLinearRegressionAccumulator<Container>& inState);
+
+    MutableMappedColumnVector coef;
+    MutableMappedColumnVector stdErr;
+    MutableMappedColumnVector tStats;
+    MutableMappedColumnVector pValues;
 };
 
 } // namespace regress
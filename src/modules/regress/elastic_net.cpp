@@ -0,0 +1,228 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file elastic_net.cpp
+ *
+ * @brief Elastic-net regularization path from the sufficient statistics of
+ *     linear regression
+ *
+ * The elastic-net objective only depends on the data through \f$ X^T X \f$,
+ * \f$ X^T \boldsymbol y \f$, and the sums of \f$ \boldsymbol y \f$. All of
+ * these are in the state of linregr_state(), so the whole regularization path
+ * is computed in memory after a single scan, by coordinate descent with
+ * covariance updates (as in glmnet).
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include "LinearRegression_proto.hpp"
+#include "LinearRegression_impl.hpp"
+#include "elastic_net.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace regress {
+
+typedef LinearRegressionAccumulator<RootContainer> LinRegrState;
+
+namespace {
+
+inline
+double
+softThreshold(double inValue, double inThreshold) {
+    if (inValue > inThreshold)
+        return inValue - inThreshold;
+    else if (inValue < -inThreshold)
+        return inValue + inThreshold;
+    return 0;
+}
+
+/**
+ * @brief One sweep of coordinate descent over the standardized coefficients
+ *
+ * The gradient \f$ \boldsymbol r = \boldsymbol g - G \boldsymbol b \f$ is
+ * kept up to date: Changing coefficient \f$ j \f$ only costs one column of
+ * \f$ G \f$, and no pass over the data. If \c inActiveOnly is true, only the
+ * nonzero coefficients are updated.
+ *
+ * @return The largest squared change of a coefficient
+ */
+double
+coordinateDescentSweep(const Matrix& inGram, const ColumnVector& inPenalized,
+    double inL1, double inL2, bool inActiveOnly, ColumnVector& ioCoef,
+    ColumnVector& ioGradient) {
+
+    double maxChange = 0;
+    for (Index j = 0; j < ioCoef.size(); ++j) {
+        if (inPenalized(j) == 0 || (inActiveOnly && ioCoef(j) == 0))
+            continue;
+
+        // The diagonal of the standardized Gram matrix is 1
+        double updated = softThreshold(ioGradient(j) + ioCoef(j), inL1)
+            / (1. + inL2);
+        double delta = updated - ioCoef(j);
+        if (delta == 0)
+            continue;
+
+        ioGradient -= delta * inGram.col(j);
+        ioCoef(j) = updated;
+        maxChange = std::max(maxChange, delta * delta);
+    }
+    return maxChange;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Compute the elastic-net regularization path of a linear regression
+ *     state
+ *
+ * The first independent variable must be the constant 1. Its coefficient is
+ * the intercept, which is not penalized. The other variables are centered and
+ * scaled to unit variance, for which
+ * \f[
+ *     \frac{1}{2n} \| \boldsymbol y - b_0 - X \boldsymbol b \|_2^2
+ *     + \lambda \left( \frac{1 - \alpha}2 \| \boldsymbol b \|_2^2
+ *     + \alpha \| \boldsymbol b \|_1 \right)
+ * \f]
+ * is minimized at a log-spaced grid of \f$ \lambda \f$, from the smallest
+ * \f$ \lambda \f$ with all coefficients zero down to
+ * \f$ \lambda_{\max} \cdot \mathit{lambdaMinRatio} \f$. Each solution is the
+ * warm start of the next. Variables with zero variance are not in the model.
+ *
+ * Returns the composite elastic_net_path_result: the grid of \f$ \lambda \f$,
+ * the coefficients on the original scale as a two-dimensional array with one
+ * inner array per \f$ \lambda \f$ (the intercept first), and the coefficients
+ * of determination \f$ R^2 \f$ of all models.
+ */
+AnyType
+elastic_net_path_final::run(AnyType& args) {
+    LinRegrState state = args[0].getAs<ByteString>();
+    double alpha = args[1].getAs<double>();
+    int32_t numLambdas = args[2].getAs<int32_t>();
+    double lambdaMinRatio = args[3].getAs<double>();
+    int32_t maxNumIterations = args[4].getAs<int32_t>();
+    double tolerance = args[5].getAs<double>();
+
+    if (alpha < 0 || alpha > 1)
+        throw std::invalid_argument("Elastic-net mixing parameter must be in "
+            "[0, 1].");
+    if (numLambdas < 1)
+        throw std::invalid_argument("Number of lambdas must be positive.");
+    if (!(lambdaMinRatio > 0) || lambdaMinRatio > 1)
+        throw std::invalid_argument("Ratio of smallest to largest lambda "
+            "must be in (0, 1].");
+    if (maxNumIterations < 1)
+        throw std::invalid_argument("Maximum number of iterations must be "
+            "positive.");
+
+    if (state.numRows.isNull() || state.numRows == 0)
+        return Null();
+
+    double n = static_cast<double>(state.numRows);
+    Index k = static_cast<Index>(state.widthOfX);
+
+    Matrix X_transp_X;
+    ColumnVector X_transp_Y;
+    state.unpack(X_transp_X, X_transp_Y);
+    if (!isfinite(X_transp_X) || !isfinite(X_transp_Y))
+        throw std::domain_error("Design matrix is not finite.");
+    if (std::fabs(X_transp_X(0, 0) - n) > 1e-8 * n
+        || std::fabs(X_transp_Y(0) - state.y_sum)
+            > 1e-8 * (std::fabs(state.y_sum) + n))
+        throw std::invalid_argument("First independent variable must be the "
+            "constant 1 (for the intercept).");
+
+    // Covariances of the variables (excluding the intercept)
+    Index p = k - 1;
+    double yMean = state.y_sum / n;
+    double yVariance = std::max(state.y_square_sum / n - yMean * yMean, 0.);
+    ColumnVector mean = X_transp_X.row(0).tail(p).transpose() / n;
+    Matrix gram = X_transp_X.bottomRightCorner(p, p) / n
+        - mean * trans(mean);
+    ColumnVector grad = X_transp_Y.tail(p) / n - yMean * mean;
+
+    // Standardize. Rounding errors may make variances slightly negative.
+    ColumnVector scale(p);
+    ColumnVector penalized(p);
+    for (Index j = 0; j < p; ++j) {
+        double variance = gram(j, j);
+        if (variance > 1e-12 * X_transp_X(j + 1, j + 1) / n && variance > 0) {
+            scale(j) = std::sqrt(variance);
+            penalized(j) = 1;
+        } else {
+            scale(j) = 1;
+            penalized(j) = 0;
+        }
+    }
+    for (Index j = 0; j < p; ++j) {
+        gram.col(j) /= scale(j);
+        gram.row(j) /= scale(j);
+        grad(j) = grad(j) / scale(j) * penalized(j);
+    }
+    ColumnVector g = grad;
+
+    // As in glmnet, the grid of a ridge regression starts at the lambda_max
+    // of alpha = 0.001
+    double lambdaMax = (p > 0 ? g.cwiseAbs().maxCoeff() : 0)
+        / std::max(alpha, 1e-3);
+
+    Allocator& allocator = defaultAllocator();
+    MutableMappedColumnVector lambdas(
+        allocator.allocateArray<double>(numLambdas));
+    MutableArrayHandle<double> coef = allocator.allocateArray<double>(
+        numLambdas, k);
+    MutableMappedColumnVector r2(allocator.allocateArray<double>(numLambdas));
+
+    ColumnVector b = ColumnVector::Zero(p);
+    for (int32_t l = 0; l < numLambdas; ++l) {
+        double lambda = numLambdas > 1
+            ? lambdaMax * std::pow(lambdaMinRatio,
+                static_cast<double>(l) / (numLambdas - 1))
+            : lambdaMax;
+        double l1 = lambda * alpha;
+        double l2 = lambda * (1. - alpha);
+
+        // Full sweeps settle the active set, sweeps over the active set then
+        // converge on it
+        for (int32_t iteration = 0; iteration < maxNumIterations; ) {
+            ++iteration;
+            if (coordinateDescentSweep(gram, penalized, l1, l2, false, b, grad)
+                < tolerance)
+                break;
+            while (iteration < maxNumIterations) {
+                ++iteration;
+                if (coordinateDescentSweep(gram, penalized, l1, l2, true, b,
+                    grad) < tolerance)
+                    break;
+            }
+        }
+
+        // Fraction of variance explained: 1 - RSS / TSS, where
+        // RSS / n = Var(y) - 2 b^T g + b^T G b = Var(y) - b^T (g + r)
+        lambdas(l) = lambda;
+        r2(l) = yVariance > 0
+            ? std::max(dot(b, g + grad), 0.) / yVariance
+            : 1.;
+
+        Eigen::Map<ColumnVector> c(coef.ptr() + static_cast<size_t>(l) * k,
+            k);
+        c.tail(p) = b.cwiseQuotient(scale);
+        c(0) = yMean - dot(mean, c.tail(p));
+    }
+
+    AnyType tuple;
+    tuple << lambdas << coef << r2;
+    return tuple;
+}
+
+} // namespace regress
+
+} // namespace modules
+
+} // namespace madlib
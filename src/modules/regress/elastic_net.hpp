@@ -0,0 +1,11 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file elastic_net.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Elastic-net regularization path: Final function on a linear
+ *     regression state
+ */
+DECLARE_UDF(regress, elastic_net_path_final)
@@ -20,6 +20,12 @@ namespace regress {
 
 typedef LinearRegressionAccumulator<RootContainer> LinRegrState;
 typedef LinearRegressionAccumulator<MutableRootContainer> MutableLinRegrState;
+typedef QRLinearRegressionAccumulator<RootContainer> QRLinRegrState;
+typedef QRLinearRegressionAccumulator<MutableRootContainer>
+    MutableQRLinRegrState;
+typedef RobustLinearRegressionAccumulator<RootContainer> RobustLinRegrState;
+typedef RobustLinearRegressionAccumulator<MutableRootContainer>
+    MutableRobustLinRegrState;
 
 AnyType
 linregr_transition::run(AnyType& args) {
@@ -31,17 +37,73 @@ linregr_transition::run(AnyType& args) {
     return state.storage();
 }
 
+/**
+ * @brief Add a block of rows to the linear-regression state
+ *
+ * The independent variables are a two-dimensional array with one inner array
+ * per row, as produced by matrix_agg() or pack_rows(). The whole block is
+ * added to the state with a single matrix-matrix product.
+ */
+AnyType
+linregr_block_transition::run(AnyType& args) {
+    MutableLinRegrState state = args[0].getAs<MutableByteString>();
+    MappedColumnVector y = args[1].getAs<MappedColumnVector>();
+    ArrayHandle<double> xHandle = args[2].getAs<ArrayHandle<double> >();
+
+    if (xHandle.dims() != 2)
+        throw std::invalid_argument("Invalid block of rows. Independent "
+            "variables must be a two-dimensional array.");
+
+    MappedMatrix X_transp(xHandle);
+    state << MutableLinRegrState::block_type(X_transp, y);
+    return state.storage();
+}
+
+/**
+ * @brief Add a row to a previously computed state
+ *
+ * The previous state (as returned by the aggregate linregr_state()) is only
+ * used for the first row. Since arguments other than
+ * the transition state are never modified in place, we obtain a copy of it
+ * that then becomes the transition state.
+ */
+AnyType
+linregr_update_transition::run(AnyType& args) {
+    MutableLinRegrState state = args[0].getAs<MutableByteString>();
+
+    // This function is not strict because the previous state may be NULL.
+    // Rows with NULL values are ignored, as in linregr_transition().
+    if (args[2].isNull() || args[3].isNull())
+        return state.storage();
+
+    double y = args[2].getAs<double>();
+    MappedColumnVector x = args[3].getAs<MappedColumnVector>();
+
+    if (state.numRows == 0 && !args[1].isNull()) {
+        MutableLinRegrState previousState
+            = args[1].getAs<MutableByteString>();
+        if (previousState.numRows > 0) {
+            previousState << MutableLinRegrState::tuple_type(x, y);
+            return previousState.storage();
+        }
+    }
+
+    state << MutableLinRegrState::tuple_type(x, y);
+    return state.storage();
+}
+
 AnyType
 linregr_merge_states::run(AnyType& args) {
     MutableLinRegrState stateLeft = args[0].getAs<MutableByteString>();
     LinRegrState stateRight = args[1].getAs<ByteString>();
 
     // We first handle the trivial case where this function is called with one
-    // of the states being the initial state
-    if (stateLeft.numRows == 0) {
-        return stateRight.storage();
-    } else if (stateRight.numRows == 0) {
+    // of the states being the initial state. Persisted states may also be
+    // initial states that were never initialized (i.e., empty byte strings).
+    if (stateRight.numRows.isNull() || stateRight.numRows == 0) {
         return stateLeft.storage();
+    } else if (stateLeft.numRows == 0) {
+        return stateRight.storage();
     }
 
     stateLeft << stateRight;
@@ -68,6 +130,103 @@ linregr_final::run(AnyType& args) {
     return tuple;
 }
 
+AnyType
+linregr_qr_transition::run(AnyType& args) {
+    MutableQRLinRegrState state = args[0].getAs<MutableByteString>();
+    double y = args[1].getAs<double>();
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+
+    state << MutableQRLinRegrState::tuple_type(x, y);
+    return state.storage();
+}
+
+AnyType
+linregr_qr_merge_states::run(AnyType& args) {
+    MutableQRLinRegrState stateLeft = args[0].getAs<MutableByteString>();
+    QRLinRegrState stateRight = args[1].getAs<ByteString>();
+
+    // See linregr_merge_states()
+    if (stateRight.numRows.isNull() || stateRight.numRows == 0) {
+        return stateLeft.storage();
+    } else if (stateLeft.numRows == 0) {
+        return stateRight.storage();
+    }
+
+    stateLeft << stateRight;
+    return stateLeft.storage();
+}
+
+/**
+ * @brief Compute the linear regression result of a TSQR state
+ *
+ * The result has the same type as that of linregr_final().
+ */
+AnyType
+linregr_qr_final::run(AnyType& args) {
+    QRLinRegrState state = args[0].getAs<ByteString>();
+
+    if (state.numRows == 0)
+        return Null();
+
+    AnyType tuple;
+    LinearRegression result(state);
+    tuple << result.coef << result.r2 << result.stdErr << result.tStats
+        << (state.numRows > state.widthOfX
+            ? result.pValues
+            : Null())
+        << result.conditionNo;
+    return tuple;
+}
+
+/**
+ * @brief Add a row to the robust-variance state
+ *
+ * The third argument are the coefficients of a previous linear regression,
+ * from which the residual of the row is computed.
+ */
+AnyType
+robust_linregr_transition::run(AnyType& args) {
+    MutableRobustLinRegrState state = args[0].getAs<MutableByteString>();
+    double y = args[1].getAs<double>();
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+    MappedColumnVector coef = args[3].getAs<MappedColumnVector>();
+
+    state << MutableRobustLinRegrState::tuple_type(x, y, coef);
+    return state.storage();
+}
+
+AnyType
+robust_linregr_merge_states::run(AnyType& args) {
+    MutableRobustLinRegrState stateLeft = args[0].getAs<MutableByteString>();
+    RobustLinRegrState stateRight = args[1].getAs<ByteString>();
+
+    // See linregr_merge_states()
+    if (stateRight.numRows.isNull() || stateRight.numRows == 0) {
+        return stateLeft.storage();
+    } else if (stateLeft.numRows == 0) {
+        return stateRight.storage();
+    }
+
+    stateLeft << stateRight;
+    return stateLeft.storage();
+}
+
+AnyType
+robust_linregr_final::run(AnyType& args) {
+    RobustLinRegrState state = args[0].getAs<ByteString>();
+
+    if (state.numRows == 0)
+        return Null();
+
+    AnyType tuple;
+    RobustLinearRegression result(state);
+    tuple << result.coef << result.stdErr << result.tStats
+        << (state.numRows > state.widthOfX
+            ? result.pValues
+            : Null());
+    return tuple;
+}
+
 } // namespace regress
 
 } // namespace modules
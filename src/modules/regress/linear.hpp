@@ -9,6 +9,16 @@
  */
 DECLARE_UDF(regress, linregr_transition)
 
+/**
+ * @brief Linear regression: Transition function for a block of rows
+ */
+DECLARE_UDF(regress, linregr_block_transition)
+
+/**
+ * @brief Linear regression: Transition function starting from a previous state
+ */
+DECLARE_UDF(regress, linregr_update_transition)
+
 /**
  * @brief Linear regression: State merge function
  */
@@ -19,3 +29,34 @@ DECLARE_UDF(regress, linregr_merge_states)
  */
 DECLARE_UDF(regress, linregr_final)
 
+
+/**
+ * @brief Linear regression (TSQR): Transition function
+ */
+DECLARE_UDF(regress, linregr_qr_transition)
+
+/**
+ * @brief Linear regression (TSQR): State merge function
+ */
+DECLARE_UDF(regress, linregr_qr_merge_states)
+
+/**
+ * @brief Linear regression (TSQR): Final function
+ */
+DECLARE_UDF(regress, linregr_qr_final)
+
+
+/**
+ * @brief Robust variance of linear regression: Transition function
+ */
+DECLARE_UDF(regress, robust_linregr_transition)
+
+/**
+ * @brief Robust variance of linear regression: State merge function
+ */
+DECLARE_UDF(regress, robust_linregr_merge_states)
+
+/**
+ * @brief Robust variance of linear regression: Final function
+ */
+DECLARE_UDF(regress, robust_linregr_final)
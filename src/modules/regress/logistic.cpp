@@ -5,14 +5,19 @@
  * @brief Logistic-Regression functions
  *
  * We implement the conjugate-gradient method and the iteratively-reweighted-
- * least-squares method.
+ * least-squares method. Multinomial logistic regression uses the latter.
  *
  *//* ----------------------------------------------------------------------- */
 
 #include <dbconnector/dbconnector.hpp>
+#include <modules/shared/FixedWidth.hpp>
 #include <modules/shared/HandleTraits.hpp>
+#include <modules/shared/LogisticTerms.hpp>
+#include <modules/shared/RowHash.hpp>
 #include <modules/prob/boost.hpp>
 
+#include <cstring>
+
 #include "logistic.hpp"
 
 namespace madlib {
@@ -34,6 +39,67 @@ AnyType stateToResult(const Allocator &inAllocator,
     double logLikelihood,
     double conditionNo);
 
+/**
+ * @brief Number of elements of the lower triangle of a square matrix
+ */
+inline size_t packedSize(const uint16_t inWidth) {
+    return static_cast<size_t>(inWidth) * (static_cast<size_t>(inWidth) + 1)
+        / 2;
+}
+
+/**
+ * @brief Rank-one update of a packed symmetric matrix
+ *
+ * The matrix is stored as its lower triangle in column-major order, i.e.,
+ * column j consists of the (width - j) elements starting at row j (the packed
+ * storage format of LAPACK). We compute \f$ A \leftarrow A + \alpha x x^T \f$,
+ * which only touches \f$ n(n+1)/2 \f$ elements.
+ */
+template <class PackedType, class VectorType>
+inline void
+packedSymmetricRankOneUpdate(PackedType &ioPacked, const VectorType &inX,
+    double inAlpha) {
+
+    Index width = inX.size();
+    Index pos = 0;
+    for (Index j = 0; j < width; pos += width - j, ++j)
+        ioPacked.segment(pos, width - j) += (inAlpha * inX(j))
+            * inX.tail(width - j);
+}
+
+/**
+ * @brief Unpack a packed symmetric matrix into a dense matrix
+ */
+template <class PackedType>
+inline Matrix
+unpackSymmetric(const PackedType &inPacked, uint16_t inWidth) {
+    Index width = inWidth;
+    Matrix result(width, width);
+    Index pos = 0;
+    for (Index j = 0; j < width; pos += width - j, ++j) {
+        result.col(j).tail(width - j) = inPacked.segment(pos, width - j);
+        result.row(j).tail(width - j)
+            = trans(inPacked.segment(pos, width - j));
+    }
+    return result;
+}
+
+/**
+ * @brief Quadratic form \f$ v^T A v \f$ of a packed symmetric matrix
+ */
+template <class PackedType, class VectorType>
+inline double
+packedQuadraticForm(const PackedType &inPacked, const VectorType &inV) {
+    Index width = inV.size();
+    Index pos = 0;
+    double result = 0;
+    for (Index j = 0; j < width; pos += width - j, ++j)
+        result += inV(j) * (inPacked(pos) * inV(j)
+            + 2. * dot(inPacked.segment(pos + 1, width - j - 1),
+                inV.tail(width - j - 1)));
+    return result;
+}
+
 /**
  * @brief Inter- and intra-iteration state for conjugate-gradient method for
  *        logistic regression
@@ -125,7 +191,7 @@ public:
 
 private:
     static inline size_t arraySize(const uint16_t inWidthOfX) {
-        return 5 + inWidthOfX * inWidthOfX + 4 * inWidthOfX;
+        return 5 + packedSize(inWidthOfX) + 4 * inWidthOfX;
     }
 
     /**
@@ -145,8 +211,10 @@ private:
      * Intra-iteration components (updated in transition step):
      * - 3 + 3 * widthOfX: numRows (number of rows already processed in this iteration)
      * - 4 + 3 * widthOfX: gradNew (intermediate value for gradient)
-     * - 4 + 4 * widthOfX: X_transp_AX (X^T A X)
-     * - 4 + widthOfX * widthOfX + 4 * widthOfX: logLikelihood ( ln(l(c)) )
+     * - 4 + 4 * widthOfX: X_transp_AX (X^T A X, lower triangle in packed
+     *   column-major order, see packedSymmetricRankOneUpdate())
+     * - 4 + widthOfX * (widthOfX + 1) / 2 + 4 * widthOfX: logLikelihood
+     *   ( ln(l(c)) )
      */
     void rebind(uint16_t inWidthOfX) {
         iteration.rebind(&mStorage[0]);
@@ -157,8 +225,10 @@ private:
         beta.rebind(&mStorage[2 + 3 * inWidthOfX]);
         numRows.rebind(&mStorage[3 + 3 * inWidthOfX]);
         gradNew.rebind(&mStorage[4 + 3 * inWidthOfX], inWidthOfX);
-        X_transp_AX.rebind(&mStorage[4 + 4 * inWidthOfX], inWidthOfX, inWidthOfX);
-        logLikelihood.rebind(&mStorage[4 + inWidthOfX * inWidthOfX + 4 * inWidthOfX]);
+        X_transp_AX.rebind(&mStorage[4 + 4 * inWidthOfX],
+            packedSize(inWidthOfX));
+        logLikelihood.rebind(
+            &mStorage[4 + packedSize(inWidthOfX) + 4 * inWidthOfX]);
     }
 
     Handle mStorage;
@@ -173,17 +243,10 @@ public:
 
     typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap gradNew;
-    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_AX;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap X_transp_AX;
     typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
 };
 
-/**
- * @brief Logistic function
- */
-inline double sigma(double x) {
-	return 1. / (1. + std::exp(-x));
-}
-
 /**
  * @brief Perform the logistic-regression transition step
  */
@@ -214,19 +277,18 @@ logregr_cg_step_transition::run(AnyType &args) {
     // Now do the transition step
     state.numRows++;
     double xc = dot(x, state.coef);
-    state.gradNew.noalias() += sigma(-y * xc) * y * trans(x);
+    LogisticTerms terms(y * xc);
+    state.gradNew.noalias() += terms.sigmaOfNegative * y * trans(x);
 
-    // Note: sigma(-x) = 1 - sigma(x).
     // a_i = sigma(x_i c) sigma(-x_i c)
-    double a = sigma(xc) * sigma(-xc);
-    triangularView<Lower>(state.X_transp_AX) += x * trans(x) * a;
+    packedSymmetricRankOneUpdate(state.X_transp_AX, x, terms.weight);
 
     //          n
     //         --
     // l(c) = -\  log(1 + exp(-y_i * c^T x_i))
     //         /_
     //         i=1
-    state.logLikelihood -= std::log( 1. + std::exp(-y * xc) );
+    state.logLikelihood -= terms.negativeLogLikelihood;
 
     return state;
 }
@@ -311,7 +373,7 @@ logregr_cg_step_final::run(AnyType &args) {
     //
     // c_k = c_{k-1} - alpha_k * d_k
     state.coef += dot(state.grad, state.dir) /
-        as_scalar(trans(state.dir) * state.X_transp_AX * state.dir)
+        packedQuadraticForm(state.X_transp_AX, state.dir)
         * state.dir;
 
     if(!state.coef.is_finite())
@@ -342,7 +404,8 @@ internal_logregr_cg_result::run(AnyType &args) {
     LogRegrCGTransitionState<ArrayHandle<double> > state = args[0];
 
     SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
-        state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+        unpackSymmetric(state.X_transp_AX, state.widthOfX), EigenvaluesOnly,
+        ComputePseudoInverse | EstimateConditionNo);
 
     return stateToResult(*this, state.coef,
         decomposition.pseudoInverse().diagonal(), state.logLikelihood,
@@ -359,7 +422,7 @@ internal_logregr_cg_result::run(AnyType &args) {
  * object containing scalars, a vector, and a matrix.
  *
  * Note: We assume that the DOUBLE PRECISION array is initialized by the
- * database with length at least 4, and all elemenets are 0.
+ * database with length at least 5, and all elemenets are 0.
  */
 template <class Handle>
 class LogRegrIRLSTransitionState {
@@ -424,6 +487,8 @@ public:
         X_transp_Az += inOtherState.X_transp_Az;
         X_transp_AX += inOtherState.X_transp_AX;
         logLikelihood += inOtherState.logLikelihood;
+        numValidationRows += inOtherState.numValidationRows;
+        validationLoss += inOtherState.validationLoss;
         return *this;
     }
 
@@ -435,11 +500,13 @@ public:
         X_transp_Az.fill(0);
         X_transp_AX.fill(0);
         logLikelihood = 0;
+        numValidationRows = 0;
+        validationLoss = 0;
     }
 
 private:
-    static inline uint32_t arraySize(const uint16_t inWidthOfX) {
-        return 3 + inWidthOfX * inWidthOfX + 2 * inWidthOfX;
+    static inline size_t arraySize(const uint16_t inWidthOfX) {
+        return 5 + packedSize(inWidthOfX) + 2 * inWidthOfX;
     }
 
     /**
@@ -453,18 +520,31 @@ private:
      * - 1: coef (vector of coefficients)
      *
      * Intra-iteration components (updated in transition step):
-     * - 1 + widthOfX: numRows (number of rows already processed in this iteration)
+     * - 1 + widthOfX: numRows (number of rows already processed in this
+     *   iteration, including holdout rows)
      * - 2 + widthOfX: X_transp_Az (X^T A z)
-     * - 2 + 2 * widthOfX: X_transp_AX (X^T A X)
-     * - 2 + widthOfX^2 + 2 * widthOfX: logLikelihood ( ln(l(c)) )
+     * - 2 + 2 * widthOfX: X_transp_AX (X^T A X, lower triangle in packed
+     *   column-major order, see packedSymmetricRankOneUpdate())
+     * - 2 + widthOfX * (widthOfX + 1) / 2 + 2 * widthOfX: logLikelihood
+     *   ( ln(l(c)) )
+     * - 3 + widthOfX * (widthOfX + 1) / 2 + 2 * widthOfX: numValidationRows
+     *   (number of holdout rows already processed in this iteration)
+     * - 4 + widthOfX * (widthOfX + 1) / 2 + 2 * widthOfX: validationLoss
+     *   (negative log-likelihood of the holdout rows, -ln(l(c)))
      */
     void rebind(uint16_t inWidthOfX = 0) {
         widthOfX.rebind(&mStorage[0]);
         coef.rebind(&mStorage[1], inWidthOfX);
         numRows.rebind(&mStorage[1 + inWidthOfX]);
         X_transp_Az.rebind(&mStorage[2 + inWidthOfX], inWidthOfX);
-        X_transp_AX.rebind(&mStorage[2 + 2 * inWidthOfX], inWidthOfX, inWidthOfX);
-        logLikelihood.rebind(&mStorage[2 + inWidthOfX * inWidthOfX + 2 * inWidthOfX]);
+        X_transp_AX.rebind(&mStorage[2 + 2 * inWidthOfX],
+            packedSize(inWidthOfX));
+        logLikelihood.rebind(
+            &mStorage[2 + packedSize(inWidthOfX) + 2 * inWidthOfX]);
+        numValidationRows.rebind(
+            &mStorage[3 + packedSize(inWidthOfX) + 2 * inWidthOfX]);
+        validationLoss.rebind(
+            &mStorage[4 + packedSize(inWidthOfX) + 2 * inWidthOfX]);
     }
 
     Handle mStorage;
@@ -475,13 +555,136 @@ public:
 
     typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap X_transp_Az;
-    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_AX;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap X_transp_AX;
     typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numValidationRows;
+    typename HandleTraits<Handle>::ReferenceToDouble validationLoss;
 };
 
-AnyType
-logregr_irls_step_transition::run(AnyType &args) {
-    LogRegrIRLSTransitionState<MutableArrayHandle<double> > state = args[0];
+/**
+ * @brief Add a single row to the intra-iteration fields of the IRLS state
+ *
+ * The gradient part of \f$ X^T A z \f$ is always added. The row's
+ * contribution to the Hessian \f$ X^T A X \f$, and the corresponding part
+ * \f$ X^T A X c \f$ of \f$ X^T A z \f$, are scaled by \c inHessianWeight and
+ * skipped if it is 0. Hence, the Newton step of the final function is
+ * \f$ c + (X^T A X)^+ \nabla l(c) \f$ also if the Hessian is only estimated
+ * from a subsample of the rows (see logregrIRLSTransition()).
+ *
+ * @return The negative log-likelihood of the row
+ */
+template <class XType, class CoefType, class AzType, class PackedType>
+inline double
+logregrIRLSRowUpdate(const XType &inX, double y, const CoefType &inCoef,
+    AzType &ioX_transp_Az, PackedType &ioX_transp_AX,
+    double inHessianWeight = 1.) {
+
+    // xc = x^T_i c
+    double xc = dot(inX, inCoef);
+    LogisticTerms terms(y * xc);
+
+    // a_i = sigma(x_i c) sigma(-x_i c)
+    double a = terms.weight;
+
+    // Note: sigma(-x) = 1 - sigma(x).
+    //
+    //             sigma(-y_i x_i c) y_i
+    // z = x_i c + ---------------------
+    //                     a_i
+    //
+    // To avoid overflows if a_i is close to 0, we do not compute z directly,
+    // but instead compute a * z.
+    double az = inHessianWeight * xc * a + terms.sigmaOfNegative * y;
+
+    ioX_transp_Az.noalias() += inX * az;
+    if (inHessianWeight > 0)
+        packedSymmetricRankOneUpdate(ioX_transp_AX, inX, inHessianWeight * a);
+    return terms.negativeLogLikelihood;
+}
+
+/**
+ * @brief Run logregrIRLSRowUpdate() with vectors of fixed size
+ *
+ * Used with dispatchFixedWidth() so that for few independent variables, the
+ * dot product and the rank-one update are fully unrolled.
+ */
+template <class State>
+struct LogRegrIRLSRowKernel {
+    LogRegrIRLSRowKernel(State &inState, const double *inX, double inY,
+        double inHessianWeight)
+      : state(inState), x(inX), y(inY), hessianWeight(inHessianWeight),
+        negativeLogLikelihood(0) { }
+
+    template <int Width>
+    void run() {
+        typedef Eigen::Matrix<double, Width, 1> FixedVector;
+
+        Eigen::Map<const FixedVector> xFixed(x);
+        Eigen::Map<const FixedVector> coefFixed(state.coef.data());
+        Eigen::Map<FixedVector> X_transp_AzFixed(state.X_transp_Az.data());
+        negativeLogLikelihood = logregrIRLSRowUpdate(xFixed, y, coefFixed,
+            X_transp_AzFixed, state.X_transp_AX, hessianWeight);
+    }
+
+    State &state;
+    const double *x;
+    double y;
+    double hessianWeight;
+    double negativeLogLikelihood;
+};
+
+/**
+ * @brief Whether a row belongs to the subsample for the Hessian
+ *
+ * The decision is a deterministic function of the row and the seed, so that
+ * it does not depend on the order of the rows or on how they are distributed
+ * over segments. Different seeds (e.g., the number of the iteration) give
+ * independent subsamples.
+ */
+template <class XType>
+inline bool
+isInHessianSample(const XType &inX, double y, int32_t inSeed,
+    double inSampleRate) {
+
+    uint64_t h = static_cast<uint32_t>(inSeed);
+    h = h * 0x9E3779B97F4A7C15ULL + (y > 0 ? 1 : 0);
+    for (Index i = 0; i < inX.size(); ++i) {
+        // -0.0 and 0.0 must be the same
+        double value = inX(i) == 0 ? 0. : inX(i);
+        uint64_t valueBits;
+        std::memcpy(&valueBits, &value, sizeof(valueBits));
+        h = h * 0x9E3779B97F4A7C15ULL + valueBits;
+    }
+    // Finalizer of MurmurHash3, so that the high bits depend on all bits
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    // Uniform in [0, 1) with 53 bits of precision
+    return static_cast<double>(h >> 11) * (1. / 9007199254740992.)
+        < inSampleRate;
+}
+
+/**
+ * @brief Transition step of IRLS, with the Hessian estimated from the subset
+ *     of rows sampled with the given rate
+ *
+ * For a rate of 1, this is the usual IRLS step. Otherwise, the gradient is
+ * still computed from all rows, but the Hessian only from the rows for which
+ * isInHessianSample() is true, each weighted by the inverse of the rate (the
+ * sub-sampled Newton method). With \f$ p \f$ independent variables, the
+ * per-row cost then drops from \f$ O(p^2) \f$ to \f$ O(p) \f$ for all rows
+ * outside the sample.
+ */
+inline AnyType
+logregrIRLSTransition(const Allocator &inAllocator, AnyType &args,
+    double inHessianSampleRate, int32_t inSeed, bool inIsHoldout = false) {
+
+    typedef LogRegrIRLSTransitionState<MutableArrayHandle<double> > State;
+
+    State state = args[0];
     double y = args[1].getAs<bool>() ? 1. : -1.;
     MappedColumnVector x = args[2].getAs<MappedColumnVector>();
 
@@ -494,7 +697,7 @@ logregr_irls_step_transition::run(AnyType &args) {
             throw std::domain_error("Number of independent variables cannot be "
                 "larger than 65535.");
 
-        state.initialize(*this, static_cast<uint16_t>(x.size()));
+        state.initialize(inAllocator, static_cast<uint16_t>(x.size()));
         if (!args[3].isNull()) {
             LogRegrIRLSTransitionState<ArrayHandle<double> > previousState = args[3];
 
@@ -506,34 +709,82 @@ logregr_irls_step_transition::run(AnyType &args) {
     // Now do the transition step
     state.numRows++;
 
-    // xc = x^T_i c
-    double xc = dot(x, state.coef);
-
-    // a_i = sigma(x_i c) sigma(-x_i c)
-    double a = sigma(xc) * sigma(-xc);
-
-    // Note: sigma(-x) = 1 - sigma(x).
-    //
-    //             sigma(-y_i x_i c) y_i
-    // z = x_i c + ---------------------
-    //                     a_i
-    //
-    // To avoid overflows if a_i is close to 0, we do not compute z directly,
-    // but instead compute a * z.
-    double az = xc * a + sigma(-y * xc) * y;
+    // Holdout rows only contribute to the validation loss, which is computed
+    // with the same coefficients as the log-likelihood of the training rows
+    if (inIsHoldout) {
+        state.numValidationRows++;
+        state.validationLoss += LogisticTerms(y * dot(x, state.coef))
+            .negativeLogLikelihood;
+        return state;
+    }
 
-    state.X_transp_Az.noalias() += x * az;
-    triangularView<Lower>(state.X_transp_AX) += x * trans(x) * a;
+    double hessianWeight = inHessianSampleRate >= 1.
+        ? 1.
+        : isInHessianSample(x, y, inSeed, inHessianSampleRate)
+            ? 1. / inHessianSampleRate
+            : 0.;
+    LogRegrIRLSRowKernel<State> kernel(state, x.data(), y, hessianWeight);
+    double negativeLogLikelihood = dispatchFixedWidth(x.size(), kernel)
+        ? kernel.negativeLogLikelihood
+        : logregrIRLSRowUpdate(x, y, state.coef, state.X_transp_Az,
+            state.X_transp_AX, hessianWeight);
 
     //          n
     //         --
     // l(c) = -\  ln(1 + exp(-y_i * c^T x_i))
     //         /_
     //         i=1
-    state.logLikelihood -= std::log( 1. + std::exp(-y * xc) );
+    state.logLikelihood -= negativeLogLikelihood;
     return state;
 }
 
+AnyType
+logregr_irls_step_transition::run(AnyType &args) {
+    return logregrIRLSTransition(*this, args, 1., 0);
+}
+
+/**
+ * @brief Transition function of IRLS with a subsampled Hessian
+ *
+ * Arguments 4 and 5 are the sampling rate in (0, 1] and the seed of the
+ * subsample, see logregrIRLSTransition().
+ */
+AnyType
+logregr_irls_subsampled_step_transition::run(AnyType &args) {
+    double sampleRate = args[4].getAs<double>();
+    if (!(sampleRate > 0 && sampleRate <= 1))
+        throw std::domain_error("Hessian sampling rate must be in (0, 1].");
+
+    return logregrIRLSTransition(*this, args, sampleRate,
+        args[5].getAs<int32_t>());
+}
+
+/**
+ * @brief Transition function of IRLS with a holdout set for validation
+ *
+ * Arguments 4 and 5 are as for logregr_irls_subsampled_step_transition().
+ * Argument 6 is the row identifier, and argument 7 the fraction of rows, in
+ * [0, 1), that are held out. A row is held out if the hash of its
+ * identifier (see rowHashUniform()) is below the fraction. Holdout rows only
+ * add their negative log-likelihood under the current coefficients to the
+ * validation loss, so the validation loss of the coefficients of an
+ * iteration is available after the next iteration, without a separate scan.
+ */
+AnyType
+logregr_irls_holdout_step_transition::run(AnyType &args) {
+    double sampleRate = args[4].getAs<double>();
+    if (!(sampleRate > 0 && sampleRate <= 1))
+        throw std::domain_error("Hessian sampling rate must be in (0, 1].");
+    double holdoutFraction = args[7].getAs<double>();
+    if (!(holdoutFraction >= 0 && holdoutFraction < 1))
+        throw std::domain_error("Holdout fraction must be in [0, 1).");
+
+    bool isHoldout = rowHashUniform(0, args[6].getAs<int64_t>())
+        < holdoutFraction;
+    return logregrIRLSTransition(*this, args, sampleRate,
+        args[5].getAs<int32_t>(), isHoldout);
+}
+
 /**
  * @brief Perform the perliminary aggregation function: Merge transition states
  */
@@ -575,7 +826,8 @@ logregr_irls_step_final::run(AnyType &args) {
             "calulation. Input data is likely of poor numerical condition.");
 
     SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
-        state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+        unpackSymmetric(state.X_transp_AX, state.widthOfX), EigenvaluesOnly,
+        ComputePseudoInverse | EstimateConditionNo);
 
     // Precompute (X^T * A * X)^+
     Matrix inverse_of_X_transp_AX = decomposition.pseudoInverse();
@@ -591,7 +843,7 @@ logregr_irls_step_final::run(AnyType &args) {
     // Likewise, we store the condition number.
     // FIXME: This feels a bit like a hack.
     state.X_transp_Az = inverse_of_X_transp_AX.diagonal();
-    state.X_transp_AX(0,0) = decomposition.conditionNo();
+    state.X_transp_AX(0) = decomposition.conditionNo();
 
     return state;
 }
@@ -607,6 +859,24 @@ internal_logregr_irls_step_distance::run(AnyType &args) {
     return std::abs(stateLeft.logLikelihood - stateRight.logLikelihood);
 }
 
+/**
+ * @brief Return the mean validation loss of a state
+ *
+ * This is the mean negative log-likelihood of the holdout rows under the
+ * coefficients of the previous iteration, or NULL if there are no holdout
+ * rows.
+ */
+AnyType
+internal_logregr_irls_validation_loss::run(AnyType &args) {
+    LogRegrIRLSTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (state.numValidationRows == 0)
+        return Null();
+
+    return state.validationLoss
+        / static_cast<double>(state.numValidationRows);
+}
+
 /**
  * @brief Return the coefficients and diagnostic statistics of the state
  */
@@ -615,7 +885,29 @@ internal_logregr_irls_result::run(AnyType &args) {
     LogRegrIRLSTransitionState<ArrayHandle<double> > state = args[0];
 
     return stateToResult(*this, state.coef,
-        state.X_transp_Az, state.logLikelihood, state.X_transp_AX(0,0));
+        state.X_transp_Az, state.logLikelihood, state.X_transp_AX(0));
+}
+
+/**
+ * @brief Return a state whose coefficients are the given ones
+ *
+ * Passed as the previous state of logregr_irls_step(), IRLS continues from
+ * the coefficients found by another method, instead of starting from zero.
+ */
+AnyType
+internal_logregr_irls_state::run(AnyType &args) {
+    MappedColumnVector coef = args[0].getAs<MappedColumnVector>();
+    if (coef.size() > std::numeric_limits<uint16_t>::max())
+        throw std::domain_error("Number of independent variables cannot be "
+            "larger than 65535.");
+
+    // Start from the initial state of logregr_irls_step(), see INITCOND
+    LogRegrIRLSTransitionState<MutableArrayHandle<double> > state
+        = AnyType(allocateArray<double>(5));
+    state.initialize(*this, static_cast<uint16_t>(coef.size()));
+    state.coef = coef;
+
+    return state;
 }
 
 /**
@@ -791,7 +1083,7 @@ logregr_igd_step_transition::run(AnyType &args) {
 
     // xc = x^T_i c
     double xc = dot(x, state.coef);
-    double scale = state.stepsize * sigma(-xc * y) * y;
+    double scale = state.stepsize * LogisticTerms(xc * y).sigmaOfNegative * y;
 	state.coef += scale * x;
 
     // Note: previous coefficients are used for Hessian and log likelihood
@@ -799,13 +1091,13 @@ logregr_igd_step_transition::run(AnyType &args) {
 		LogRegrIGDTransitionState<ArrayHandle<double> > previousState = args[3];
 
 		double previous_xc = dot(x, previousState.coef);
+		LogisticTerms terms(y * previous_xc);
 
         // a_i = sigma(x_i c) sigma(-x_i c)
-		double a = sigma(previous_xc) * sigma(-previous_xc);
-		triangularView<Lower>(state.X_transp_AX) += x * trans(x) * a;
+		triangularView<Lower>(state.X_transp_AX) += x * trans(x) * terms.weight;
 
 		// l_i(c) = - ln(1 + exp(-y_i * c^T x_i))
-		state.logLikelihood -= std::log( 1. + std::exp(-y * previous_xc) );
+		state.logLikelihood -= terms.negativeLogLikelihood;
 	}
 
     return state;
@@ -872,18 +1164,381 @@ internal_logregr_igd_result::run(AnyType &args) {
     LogRegrIGDTransitionState<ArrayHandle<double> > state = args[0];
 
     SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
-        state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+        state.X_transp_AX, EigenvaluesOnly,
+        ComputePseudoInverse | EstimateConditionNo);
 
     return stateToResult(*this, state.coef,
         decomposition.pseudoInverse().diagonal(), state.logLikelihood,
         decomposition.conditionNo());
 }
 
+/**
+ * @brief Kronecker-product update of a packed symmetric matrix
+ *
+ * For a symmetric \f$ k \times k \f$ matrix \f$ W \f$ and a vector \f$ x \f$
+ * of length \f$ p \f$, we compute
+ * \f$ A \leftarrow A + W \otimes x x^T \f$, where \f$ A \f$ is a
+ * \f$ kp \times kp \f$ matrix in the packed storage format of
+ * packedSymmetricRankOneUpdate(). Column \f$ (b, j) \f$ of \f$ A \f$, i.e.,
+ * column \f$ j \f$ of block column \f$ b \f$, is updated block by block, so
+ * that we only touch the lower triangle and never form \f$ x x^T \f$.
+ */
+template <class PackedType, class WeightType, class VectorType>
+inline void
+packedSymmetricKroneckerUpdate(PackedType &ioPacked, const WeightType &inW,
+    const VectorType &inX) {
+
+    Index numBlocks = inW.rows();
+    Index width = inX.size();
+    Index size = numBlocks * width;
+    Index pos = 0;
+    for (Index b = 0; b < numBlocks; ++b) {
+        for (Index j = 0; j < width; pos += size - b * width - j, ++j) {
+            ioPacked.segment(pos, width - j) += (inW(b, b) * inX(j))
+                * inX.tail(width - j);
+
+            Index blockPos = pos + width - j;
+            for (Index l = b + 1; l < numBlocks; blockPos += width, ++l)
+                ioPacked.segment(blockPos, width) += (inW(l, b) * inX(j))
+                    * inX;
+        }
+    }
+}
+
+/**
+ * @brief Inter- and intra-iteration state for iteratively-reweighted-least-
+ *        squares method for multinomial logistic regression
+ *
+ * With \f$ K \f$ categories, category 0 is the reference category, and there
+ * is one block of \f$ p \f$ coefficients for each of the other \f$ K - 1 \f$
+ * categories. All blocks are fitted jointly, so each iteration takes a single
+ * scan of the data, regardless of the number of categories. The state has the
+ * same structure as LogRegrIRLSTransitionState, with the vectors and the
+ * (packed) matrix being of size \f$ (K - 1) p \f$.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 4, and all elemenets are 0.
+ */
+template <class Handle>
+class MLogRegrIRLSTransitionState {
+    template <class OtherHandle>
+    friend class MLogRegrIRLSTransitionState;
+
+public:
+    MLogRegrIRLSTransitionState(const AnyType &inArray)
+        : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint16_t>(mStorage[0]),
+            static_cast<uint16_t>(mStorage[1]));
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the iteratively-reweighted-least-squares state.
+     *
+     * This function is only called for the first iteration, for the first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint16_t inWidthOfX,
+        uint16_t inNumCategories) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inWidthOfX, inNumCategories));
+        rebind(inWidthOfX, inNumCategories);
+        widthOfX = inWidthOfX;
+        numCategories = inNumCategories;
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    MLogRegrIRLSTransitionState &operator=(
+        const MLogRegrIRLSTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            widthOfX != inOtherState.widthOfX ||
+            numCategories != inOtherState.numCategories)
+            throw std::invalid_argument("Previous state does not match the "
+                "number of independent variables or categories.");
+
+        for (size_t i = 0; i < mStorage.size(); i++)
+            mStorage[i] = inOtherState.mStorage[i];
+        return *this;
+    }
+
+    /**
+     * @brief Merge with another State object by copying the intra-iteration
+     *     fields
+     */
+    template <class OtherHandle>
+    MLogRegrIRLSTransitionState &operator+=(
+        const MLogRegrIRLSTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            widthOfX != inOtherState.widthOfX ||
+            numCategories != inOtherState.numCategories)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        X_transp_Az += inOtherState.X_transp_Az;
+        X_transp_AX += inOtherState.X_transp_AX;
+        logLikelihood += inOtherState.logLikelihood;
+        return *this;
+    }
+
+    /**
+     * @brief Reset the inter-iteration fields.
+     */
+    inline void reset() {
+        numRows = 0;
+        X_transp_Az.fill(0);
+        X_transp_AX.fill(0);
+        logLikelihood = 0;
+    }
+
+    /**
+     * @brief Number of coefficients, i.e., \f$ (K - 1) p \f$
+     */
+    static inline uint16_t numCoef(uint16_t inWidthOfX,
+        uint16_t inNumCategories) {
+
+        return static_cast<uint16_t>(
+            inNumCategories > 0 ? inWidthOfX * (inNumCategories - 1) : 0);
+    }
+
+private:
+    static inline size_t arraySize(uint16_t inWidthOfX,
+        uint16_t inNumCategories) {
+
+        uint16_t n = numCoef(inWidthOfX, inNumCategories);
+        return 4 + packedSize(n) + 2 * n;
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inWidthOfX The number of independent variables.
+     * @param inNumCategories The number of categories of the dependent
+     *     variable.
+     *
+     * Array layout (iteration refers to one aggregate-function call), where
+     * n denotes the number of coefficients (widthOfX * (numCategories - 1)):
+     * Inter-iteration components (updated in final function):
+     * - 0: widthOfX (number of independent variables)
+     * - 1: numCategories (number of categories, including the reference
+     *   category 0)
+     * - 2: coef (coefficients, one block of widthOfX coefficients per
+     *   category 1, ..., numCategories - 1)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 2 + n: numRows (number of rows already processed in this iteration)
+     * - 3 + n: X_transp_Az (X^T A z)
+     * - 3 + 2 * n: X_transp_AX (X^T A X, lower triangle in packed
+     *   column-major order, see packedSymmetricKroneckerUpdate())
+     * - 3 + n * (n + 1) / 2 + 2 * n: logLikelihood ( ln(l(c)) )
+     */
+    void rebind(uint16_t inWidthOfX = 0, uint16_t inNumCategories = 0) {
+        uint16_t n = numCoef(inWidthOfX, inNumCategories);
+
+        widthOfX.rebind(&mStorage[0]);
+        numCategories.rebind(&mStorage[1]);
+        coef.rebind(&mStorage[2], n);
+        numRows.rebind(&mStorage[2 + n]);
+        X_transp_Az.rebind(&mStorage[3 + n], n);
+        X_transp_AX.rebind(&mStorage[3 + 2 * n], packedSize(n));
+        logLikelihood.rebind(&mStorage[3 + packedSize(n) + 2 * n]);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt16 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToUInt16 numCategories;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap coef;
+
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap X_transp_Az;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap X_transp_AX;
+    typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
+};
+
+AnyType
+mlogregr_irls_step_transition::run(AnyType &args) {
+    typedef MLogRegrIRLSTransitionState<MutableArrayHandle<double> > State;
+
+    State state = args[0];
+    int32_t y = args[1].getAs<int32_t>();
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+    int32_t numCategories = args[3].getAs<int32_t>();
+
+    // The following check was added with MADLIB-138.
+    if (!x.is_finite())
+        throw std::domain_error("Design matrix is not finite.");
+
+    if (state.numRows == 0) {
+        if (numCategories < 2)
+            throw std::domain_error("Number of categories must be at least "
+                "2.");
+        if (x.size() == 0 || static_cast<uint64_t>(x.size())
+                * static_cast<uint64_t>(numCategories - 1)
+                > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of independent variables times "
+                "number of categories minus 1 cannot be larger than 65535.");
+
+        state.initialize(*this, static_cast<uint16_t>(x.size()),
+            static_cast<uint16_t>(numCategories));
+        if (!args[4].isNull()) {
+            MLogRegrIRLSTransitionState<ArrayHandle<double> > previousState
+                = args[4];
+
+            state = previousState;
+            state.reset();
+        }
+    } else if (x.size() != state.widthOfX)
+        throw std::invalid_argument("Inconsistent number of independent "
+            "variables.");
+
+    if (y < 0 || y >= numCategories)
+        throw std::domain_error("Dependent variable must be between 0 and "
+            "the number of categories minus 1.");
+
+    // Now do the transition step
+    state.numRows++;
+
+    Index width = state.widthOfX;
+    Index numBlocks = state.numCategories - 1;
+
+    // eta_k = c_k^T x (the linear predictor of category k; 0 for the
+    // reference category)
+    Eigen::Map<const Matrix> coefBlocks(state.coef.data(), width, numBlocks);
+    ColumnVector eta = trans(coefBlocks) * x;
+
+    // pi_k = exp(eta_k) / (1 + sum_l exp(eta_l)), computed without overflow
+    double maxEta = std::max(0., eta.maxCoeff());
+    ColumnVector pi = (eta.array() - maxEta).exp();
+    double logNormalizer = maxEta + std::log(std::exp(-maxEta) + pi.sum());
+    pi /= std::exp(logNormalizer - maxEta);
+
+    // The Hessian is -X^T A X with the (K-1)p x (K-1)p matrix
+    // X^T A X = sum_i W_i (Kronecker product) x_i x_i^T, where
+    // W_i = diag(pi) - pi pi^T. We accumulate X^T A z = X^T A X c + gradient,
+    // so that the Newton step in the final function becomes
+    // c <- (X^T A X)^+ X^T A z, as for binary logistic regression. Block k
+    // of X^T A z for row i is
+    //     x_i * (pi_k (eta_k - pi^T eta) + [y_i = k] - pi_k).
+    Matrix W = -pi * trans(pi);
+    W.diagonal() += pi;
+    double piEta = dot(pi, eta);
+    for (Index k = 0; k < numBlocks; ++k) {
+        double az = pi(k) * (eta(k) - piEta) + (y == k + 1 ? 1. : 0.) - pi(k);
+        state.X_transp_Az.segment(k * width, width).noalias() += x * az;
+    }
+    packedSymmetricKroneckerUpdate(state.X_transp_AX, W, x);
+
+    // l(c) = sum_i (eta_{y_i} - ln(1 + sum_k exp(eta_k)))
+    state.logLikelihood += (y > 0 ? eta(y - 1) : 0.) - logNormalizer;
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+mlogregr_irls_step_merge_states::run(AnyType &args) {
+    MLogRegrIRLSTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    MLogRegrIRLSTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+
+    // Merge states together and return
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the multinomial logistic-regression final step
+ */
+AnyType
+mlogregr_irls_step_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    MLogRegrIRLSTransitionState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.numRows == 0)
+        return Null();
+
+    // See logregr_irls_step_final
+    if (!state.X_transp_AX.is_finite() || !state.X_transp_Az.is_finite())
+        throw NoSolutionFoundException("Over- or underflow in intermediate "
+            "calulation. Input data is likely of poor numerical condition.");
+
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        unpackSymmetric(state.X_transp_AX, static_cast<uint16_t>(
+            state.coef.size())),
+        EigenvaluesOnly, ComputePseudoInverse);
+
+    // Precompute (X^T * A * X)^+
+    Matrix inverse_of_X_transp_AX = decomposition.pseudoInverse();
+
+    state.coef.noalias() = inverse_of_X_transp_AX * state.X_transp_Az;
+    if(!state.coef.is_finite())
+        throw NoSolutionFoundException("Over- or underflow in Newton step, "
+            "while updating coefficients. Input data is likely of poor "
+            "numerical condition.");
+
+    // As in logregr_irls_step_final, we store the diagonal of the inverse and
+    // the condition number in the intra-iteration fields.
+    state.X_transp_Az = inverse_of_X_transp_AX.diagonal();
+    state.X_transp_AX(0) = decomposition.conditionNo();
+
+    return state;
+}
+
+/**
+ * @brief Return the difference in log-likelihood between two states
+ */
+AnyType
+internal_mlogregr_irls_step_distance::run(AnyType &args) {
+    MLogRegrIRLSTransitionState<ArrayHandle<double> > stateLeft = args[0];
+    MLogRegrIRLSTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    return std::abs(stateLeft.logLikelihood - stateRight.logLikelihood);
+}
+
+/**
+ * @brief Return the coefficients and diagnostic statistics of the state
+ */
+AnyType
+internal_mlogregr_irls_result::run(AnyType &args) {
+    MLogRegrIRLSTransitionState<ArrayHandle<double> > state = args[0];
+
+    return stateToResult(*this, state.coef,
+        state.X_transp_Az, state.logLikelihood, state.X_transp_AX(0));
+}
+
 /**
  * @brief Compute the diagnostic statistics
  *
- * This function wraps the common parts of computing the results for both the
- * CG and the IRLS method.
+ * This function wraps the common parts of computing the results for the CG
+ * and the IRLS method, and for multinomial logistic regression.
  */
 AnyType stateToResult(
     const Allocator &inAllocator,
@@ -38,6 +38,18 @@ DECLARE_UDF(regress, internal_logregr_cg_result)
  */
 DECLARE_UDF(regress, logregr_irls_step_transition)
 
+/**
+ * @brief Logistic regression (iteratively-reweighted-lest-squares step with
+ *     subsampled Hessian): Transition function
+ */
+DECLARE_UDF(regress, logregr_irls_subsampled_step_transition)
+
+/**
+ * @brief Logistic regression (iteratively-reweighted-lest-squares step with
+ *     holdout rows): Transition function
+ */
+DECLARE_UDF(regress, logregr_irls_holdout_step_transition)
+
 /**
  * @brief Logistic regression (iteratively-reweighted-lest-squares step):
  *     State merge function
@@ -56,12 +68,24 @@ DECLARE_UDF(regress, logregr_irls_step_final)
  */
 DECLARE_UDF(regress, internal_logregr_irls_step_distance)
 
+/**
+ * @brief Logistic regression (iteratively-reweighted-lest-squares step):
+ *     Mean validation loss of the holdout rows
+ */
+DECLARE_UDF(regress, internal_logregr_irls_validation_loss)
+
 /**
  * @brief Logistic regression (iteratively-reweighted-lest-squares step):
  *     Convert transition state to result tuple
  */
 DECLARE_UDF(regress, internal_logregr_irls_result)
 
+/**
+ * @brief Logistic regression (iteratively-reweighted-lest-squares step):
+ *     Previous state with given coefficients
+ */
+DECLARE_UDF(regress, internal_logregr_irls_state)
+
 
 /**
  * @brief Logistic regression (incremetal-gradient step): Transition function
@@ -89,3 +113,34 @@ DECLARE_UDF(regress, internal_logregr_igd_step_distance)
  *     Convert transition state to result tuple
  */
 DECLARE_UDF(regress, internal_logregr_igd_result)
+
+
+/**
+ * @brief Multinomial logistic regression (iteratively-reweighted-lest-squares
+ *     step): Transition function
+ */
+DECLARE_UDF(regress, mlogregr_irls_step_transition)
+
+/**
+ * @brief Multinomial logistic regression (iteratively-reweighted-lest-squares
+ *     step): State merge function
+ */
+DECLARE_UDF(regress, mlogregr_irls_step_merge_states)
+
+/**
+ * @brief Multinomial logistic regression (iteratively-reweighted-lest-squares
+ *     step): Final function
+ */
+DECLARE_UDF(regress, mlogregr_irls_step_final)
+
+/**
+ * @brief Multinomial logistic regression (iteratively-reweighted-lest-squares
+ *     step): Difference in log-likelihood between two transition states
+ */
+DECLARE_UDF(regress, internal_mlogregr_irls_step_distance)
+
+/**
+ * @brief Multinomial logistic regression (iteratively-reweighted-lest-squares
+ *     step): Convert transition state to result tuple
+ */
+DECLARE_UDF(regress, internal_mlogregr_irls_result)
@@ -0,0 +1,172 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file predict.cpp
+ *
+ * @brief Scoring with the coefficients of linear models
+ *
+ * All functions take the coefficients as first argument. These are typically
+ * the same for all rows of a query (e.g., when joining with a model table),
+ * so they are obtained with UDF::cachedArrayArgument() and detoasted only
+ * once per call site.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <cmath>
+#include <limits>
+
+#include "predict.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace regress {
+
+namespace {
+
+inline
+void
+checkDimensions(Index inNumCoef, Index inNumIndepVars) {
+    if (inNumCoef != inNumIndepVars)
+        throw std::invalid_argument("Coefficients and independent variables "
+            "are of incompatible length.");
+}
+
+/**
+ * @brief Inner product of coefficients and dense independent variables
+ */
+template <class CoefType>
+inline
+double
+linearPredictor(const CoefType& inCoef, const MappedColumnVector& inX) {
+    checkDimensions(inCoef.size(), inX.size());
+    return dot(inCoef, inX);
+}
+
+/**
+ * @brief Inner product of coefficients and sparse independent variables
+ *
+ * Only the nonzero elements of \c inX are visited.
+ */
+template <class CoefType>
+inline
+double
+linearPredictor(const CoefType& inCoef, const SparseColumnVector& inX) {
+    checkDimensions(inCoef.size(), inX.size());
+    double result = 0.;
+    for (SparseColumnVector::InnerIterator it(inX); it; ++it)
+        result += inCoef(it.index()) * it.value();
+    return result;
+}
+
+/**
+ * @brief 0-based index of the model with the largest linear predictor
+ *
+ * The coefficients are a two-dimensional array with one row per model, i.e.,
+ * the columns of the mapped matrix. In case of ties, the first such index is
+ * returned.
+ */
+template <class IndepVarType>
+inline
+int32_t
+oneVsRestClass(const ArrayHandle<double>& inCoef, const IndepVarType& inX) {
+    if (inCoef.dims() != 2)
+        throw std::invalid_argument("Coefficients must be a two-dimensional "
+            "array with one row per class.");
+
+    MappedMatrix coef(inCoef, static_cast<Index>(inCoef.sizeOfDim(1)),
+        static_cast<Index>(inCoef.sizeOfDim(0)));
+    int32_t result = 0;
+    double maxPredictor = -std::numeric_limits<double>::infinity();
+    for (Index c = 0; c < coef.cols(); ++c) {
+        double predictor = linearPredictor(coef.col(c), inX);
+        if (predictor > maxPredictor) {
+            maxPredictor = predictor;
+            result = static_cast<int32_t>(c);
+        }
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+AnyType
+linregr_predict::run(AnyType& args) {
+    MappedColumnVector coef(cachedArrayArgument(0));
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+
+    return linearPredictor(coef, x);
+}
+
+AnyType
+linregr_sparse_predict::run(AnyType& args) {
+    MappedColumnVector coef(cachedArrayArgument(0));
+    SparseColumnVector x = args[1].getAs<SparseColumnVector>();
+
+    return linearPredictor(coef, x);
+}
+
+/**
+ * @brief Return whether the predicted probability is at least 0.5
+ *
+ * This is the case if and only if the linear predictor is non-negative, so
+ * there is no need to evaluate the logistic function.
+ */
+AnyType
+logregr_predict::run(AnyType& args) {
+    MappedColumnVector coef(cachedArrayArgument(0));
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+
+    return linearPredictor(coef, x) >= 0;
+}
+
+AnyType
+logregr_sparse_predict::run(AnyType& args) {
+    MappedColumnVector coef(cachedArrayArgument(0));
+    SparseColumnVector x = args[1].getAs<SparseColumnVector>();
+
+    return linearPredictor(coef, x) >= 0;
+}
+
+AnyType
+logregr_predict_prob::run(AnyType& args) {
+    MappedColumnVector coef(cachedArrayArgument(0));
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+
+    return 1. / (1. + std::exp(-linearPredictor(coef, x)));
+}
+
+AnyType
+logregr_sparse_predict_prob::run(AnyType& args) {
+    MappedColumnVector coef(cachedArrayArgument(0));
+    SparseColumnVector x = args[1].getAs<SparseColumnVector>();
+
+    return 1. / (1. + std::exp(-linearPredictor(coef, x)));
+}
+
+AnyType
+ovr_predict::run(AnyType& args) {
+    ArrayHandle<double> coef = cachedArrayArgument(0);
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+
+    return oneVsRestClass(coef, x);
+}
+
+AnyType
+ovr_sparse_predict::run(AnyType& args) {
+    ArrayHandle<double> coef = cachedArrayArgument(0);
+    SparseColumnVector x = args[1].getAs<SparseColumnVector>();
+
+    return oneVsRestClass(coef, x);
+}
+
+} // namespace regress
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,48 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file predict.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Linear regression: Prediction
+ */
+DECLARE_UDF(regress, linregr_predict)
+
+/**
+ * @brief Linear regression: Prediction for sparse independent variables
+ */
+DECLARE_UDF(regress, linregr_sparse_predict)
+
+/**
+ * @brief Logistic regression: Prediction of the class
+ */
+DECLARE_UDF(regress, logregr_predict)
+
+/**
+ * @brief Logistic regression: Prediction of the class for sparse independent
+ *     variables
+ */
+DECLARE_UDF(regress, logregr_sparse_predict)
+
+/**
+ * @brief Logistic regression: Prediction of the probability
+ */
+DECLARE_UDF(regress, logregr_predict_prob)
+
+/**
+ * @brief Logistic regression: Prediction of the probability for sparse
+ *     independent variables
+ */
+DECLARE_UDF(regress, logregr_sparse_predict_prob)
+
+/**
+ * @brief One-vs-rest classification with several linear models: Prediction
+ */
+DECLARE_UDF(regress, ovr_predict)
+
+/**
+ * @brief One-vs-rest classification with several linear models: Prediction
+ *     for sparse independent variables
+ */
+DECLARE_UDF(regress, ovr_sparse_predict)
@@ -6,5 +6,7 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include "elastic_net.hpp"
 #include "linear.hpp"
 #include "logistic.hpp"
+#include "predict.hpp"
@@ -0,0 +1,185 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file reservoir_impl.hpp
+ *
+ * @brief Weighted reservoir of algorithm A-ExpJ, shared by the sampling
+ *     aggregates
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_MODULES_SAMPLE_RESERVOIR_IMPL_HPP
+#define MADLIB_MODULES_SAMPLE_RESERVOIR_IMPL_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace madlib {
+
+namespace modules {
+
+namespace sample {
+
+/**
+ * @brief Reservoir for a weighted sample of k rows without replacement
+ *
+ * This is the reservoir of algorithm A-ExpJ by Efraimidis and Spirakis,
+ * "Weighted random sampling with a reservoir", Information Processing Letters
+ * 97(5), 2006. Every row with weight w is given the key <tt>u^(1/w)</tt>,
+ * where u is uniform on (0, 1], and the sample consists of the k rows with
+ * the largest keys. Keys are stored as logarithms <tt>log(u)/w</tt>, which do
+ * not underflow for small weights.
+ *
+ * Once the reservoir is full, a single random number determines how much
+ * weight may be skipped before a row enters the reservoir, so only
+ * O(k log(n/k)) random numbers are drawn for n rows. Since the keys are
+ * distributed as if each row had been given a key, reservoirs of different
+ * segments are merged by keeping the k largest keys of both.
+ *
+ * The object does not own any storage: It refers to the size, the skip
+ * weight, and a min-heap (ordered by key) of k pairs (logKey, identifier),
+ * all of which are part of a transition state.
+ */
+template <class SizeType, class WeightType>
+class WeightedReservoir {
+public:
+    WeightedReservoir(uint32_t inK, SizeType &inSize, WeightType &inSkipWeight,
+        double *inHeap)
+      : k(inK), size(inSize), skipWeight(inSkipWeight), heap(inHeap) { }
+
+    /**
+     * @brief Process a row with positive weight
+     */
+    template <class RNG>
+    void add(double inIdentifier, double inWeight, RNG &inGenerator) {
+        if (static_cast<uint32_t>(size) < k) {
+            push(std::log(1. - inGenerator()) / inWeight, inIdentifier);
+            if (static_cast<uint32_t>(size) == k)
+                drawSkipWeight(inGenerator);
+            return;
+        }
+
+        skipWeight = skipWeight - inWeight;
+        if (skipWeight > 0)
+            return;
+
+        // The new key is conditioned on exceeding the smallest key in the
+        // reservoir: With t = (smallest key)^w, it is r^(1/w) where r is
+        // uniform on (t, 1].
+        double t = std::exp(inWeight * heap[0]);
+        double r = t + (1. - t) * (1. - inGenerator());
+        replaceMin(std::log(r) / inWeight, inIdentifier);
+        drawSkipWeight(inGenerator);
+    }
+
+    /**
+     * @brief Merge with another reservoir of the same k
+     */
+    template <class RNG>
+    void add(const double *inOtherHeap, uint32_t inOtherSize,
+        RNG &inGenerator) {
+
+        for (uint32_t i = 0; i < inOtherSize; i++) {
+            double logKey = inOtherHeap[2 * i];
+            double identifier = inOtherHeap[2 * i + 1];
+            if (static_cast<uint32_t>(size) < k)
+                push(logKey, identifier);
+            else if (logKey > heap[0])
+                replaceMin(logKey, identifier);
+        }
+        // The skip weight is memoryless, so we can simply draw a new one for
+        // the merged reservoir
+        if (static_cast<uint32_t>(size) == k)
+            drawSkipWeight(inGenerator);
+    }
+
+    /**
+     * @brief Return the identifiers in a reservoir, by descending key
+     */
+    static void sample(const double *inHeap, uint32_t inSize,
+        std::vector<int64_t> &outIdentifiers) {
+
+        std::vector<std::pair<double, double> > entries(inSize);
+        for (uint32_t i = 0; i < inSize; i++)
+            entries[i] = std::make_pair(-inHeap[2 * i], inHeap[2 * i + 1]);
+        std::sort(entries.begin(), entries.end());
+
+        outIdentifiers.resize(inSize);
+        for (uint32_t i = 0; i < inSize; i++)
+            outIdentifiers[i] = static_cast<int64_t>(entries[i].second);
+    }
+
+private:
+    /**
+     * @brief Draw the weight to skip until a row enters the full reservoir
+     *
+     * With T the smallest key in the reservoir, a row with weight w has a
+     * larger key with probability 1 - T^w. The total weight skipped is
+     * therefore log(r)/log(T), for r uniform on (0, 1].
+     */
+    template <class RNG>
+    void drawSkipWeight(RNG &inGenerator) {
+        skipWeight = heap[0] < 0
+            ? std::log(1. - inGenerator()) / heap[0]
+            : 0.;
+    }
+
+    void push(double inLogKey, double inIdentifier) {
+        uint32_t i = static_cast<uint32_t>(size);
+        size = i + 1;
+        while (i > 0) {
+            uint32_t parent = (i - 1) / 2;
+            if (heap[2 * parent] <= inLogKey)
+                break;
+            heap[2 * i] = heap[2 * parent];
+            heap[2 * i + 1] = heap[2 * parent + 1];
+            i = parent;
+        }
+        heap[2 * i] = inLogKey;
+        heap[2 * i + 1] = inIdentifier;
+    }
+
+    void replaceMin(double inLogKey, double inIdentifier) {
+        uint32_t n = static_cast<uint32_t>(size);
+        uint32_t i = 0;
+        while (2 * i + 1 < n) {
+            uint32_t child = 2 * i + 1;
+            if (child + 1 < n && heap[2 * (child + 1)] < heap[2 * child])
+                child++;
+            if (heap[2 * child] >= inLogKey)
+                break;
+            heap[2 * i] = heap[2 * child];
+            heap[2 * i + 1] = heap[2 * child + 1];
+            i = child;
+        }
+        heap[2 * i] = inLogKey;
+        heap[2 * i + 1] = inIdentifier;
+    }
+
+    uint32_t k;
+    SizeType &size;
+    WeightType &skipWeight;
+    double *heap;
+};
+
+/**
+ * @brief Create a WeightedReservoir, deducing the types of its references
+ */
+template <class SizeType, class WeightType>
+inline
+WeightedReservoir<SizeType, WeightType>
+weightedReservoir(uint32_t inK, SizeType &inSize, WeightType &inSkipWeight,
+    double *inHeap) {
+
+    return WeightedReservoir<SizeType, WeightType>(inK, inSize, inSkipWeight,
+        inHeap);
+}
+
+} // namespace sample
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_MODULES_SAMPLE_RESERVOIR_IMPL_HPP)
@@ -6,4 +6,5 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include "stratified_sample.hpp"
 #include "weighted_sample.hpp"
@@ -0,0 +1,351 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file stratified_sample.cpp
+ *
+ * @brief Generate stratified random samples in a single pass
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#include "reservoir_impl.hpp"
+#include "stratified_sample.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace sample {
+
+/**
+ * @brief Transition state for a sample of k rows per stratum
+ *
+ * Every stratum has its own WeightedReservoir. The reservoirs are found by an
+ * open-addressing hash table (with linear probing) that is part of the
+ * state, so that looking up the stratum of a row takes constant time, no
+ * matter how many strata there are. Whenever all stratum slots are used, the
+ * state is replaced by one with twice as many slots (and a hash table of
+ * twice the size), just like MatrixAggTransitionState grows.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * k, numStrata, capacity, followed by the hash table of 2 * capacity entries
+ * (0 for an empty entry, otherwise 1 + the index of the stratum), followed by
+ * capacity stratum slots. Each stratum slot consists of stratum, size,
+ * skipWeight, and the min-heap of k pairs (logKey, identifier).
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0.
+ */
+template <class Handle>
+class StratifiedReservoirTransitionState {
+    template <class OtherHandle>
+    friend class StratifiedReservoirTransitionState;
+
+public:
+    StratifiedReservoirTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]),
+            static_cast<uint32_t>(mStorage[2]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inK) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inK, kInitialCapacity));
+        rebind(inK, kInitialCapacity);
+        k = inK;
+        numStrata = 0;
+        capacity = kInitialCapacity;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return k > 0;
+    }
+
+    /**
+     * @brief Process a row with positive weight
+     */
+    template <class RNG>
+    void add(const Allocator &inAllocator, int64_t inStratum,
+        int64_t inIdentifier, double inWeight, RNG &inGenerator) {
+
+        double *slot = findOrInsert(inAllocator, inStratum);
+        weightedReservoir(static_cast<uint32_t>(k), slot[1], slot[2],
+            slot + 3).add(static_cast<double>(inIdentifier), inWeight,
+                inGenerator);
+    }
+
+    /**
+     * @brief Merge with the reservoirs of another state
+     */
+    template <class OtherHandle, class RNG>
+    void add(const Allocator &inAllocator,
+        const StratifiedReservoirTransitionState<OtherHandle> &inOther,
+        RNG &inGenerator) {
+
+        for (uint32_t i = 0; i < inOther.numStrata; i++) {
+            const double *otherSlot = inOther.slot(i);
+            double *slot = findOrInsert(inAllocator,
+                static_cast<int64_t>(otherSlot[0]));
+            weightedReservoir(static_cast<uint32_t>(k), slot[1], slot[2],
+                slot + 3).add(otherSlot + 3,
+                    static_cast<uint32_t>(otherSlot[1]), inGenerator);
+        }
+    }
+
+    /**
+     * @brief Return the pairs (stratum, identifier) of all samples, by
+     *     ascending stratum and, within each stratum, by descending key
+     */
+    void sample(std::vector<std::pair<int64_t, int64_t> > &outSample) const {
+        std::vector<int64_t> strata(numStrata);
+        for (uint32_t i = 0; i < numStrata; i++)
+            strata[i] = static_cast<int64_t>(slot(i)[0]);
+        std::vector<uint32_t> order(numStrata);
+        for (uint32_t i = 0; i < numStrata; i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), StratumLess(strata));
+
+        outSample.clear();
+        std::vector<int64_t> identifiers;
+        for (uint32_t i = 0; i < numStrata; i++) {
+            const double *stratumSlot = slot(order[i]);
+            WeightedReservoir<uint32_t, double>::sample(stratumSlot + 3,
+                static_cast<uint32_t>(stratumSlot[1]), identifiers);
+            for (size_t j = 0; j < identifiers.size(); j++)
+                outSample.push_back(std::make_pair(strata[order[i]],
+                    identifiers[j]));
+        }
+    }
+
+private:
+    enum { kInitialCapacity = 8 };
+
+    struct StratumLess {
+        StratumLess(const std::vector<int64_t> &inStrata)
+          : strata(inStrata) { }
+
+        bool operator()(uint32_t inLeft, uint32_t inRight) const {
+            return strata[inLeft] < strata[inRight];
+        }
+
+        const std::vector<int64_t> &strata;
+    };
+
+    static inline size_t slotSize(uint32_t inK) {
+        return 3 + 2 * static_cast<size_t>(inK);
+    }
+
+    static inline size_t arraySize(uint32_t inK, uint32_t inCapacity) {
+        return 3 + 2 * static_cast<size_t>(inCapacity)
+            + inCapacity * slotSize(inK);
+    }
+
+    /**
+     * @brief Position of a stratum in the hash table (before probing)
+     */
+    static inline uint32_t hash(int64_t inStratum, uint32_t inTableSize) {
+        // Fibonacci hashing: The table size is a power of 2, and the high
+        // bits of the product depend on all bits of the stratum
+        uint64_t product = static_cast<uint64_t>(inStratum)
+            * 0x9E3779B97F4A7C15ULL;
+        return static_cast<uint32_t>((product >> 32) & (inTableSize - 1));
+    }
+
+    const double *slot(uint32_t inIndex) const {
+        return slots + inIndex * slotSize(k);
+    }
+
+    double *slot(uint32_t inIndex) {
+        return slots + inIndex * slotSize(k);
+    }
+
+    /**
+     * @brief Return the slot of a stratum, inserting an empty one if the
+     *     stratum is new
+     */
+    double *findOrInsert(const Allocator &inAllocator, int64_t inStratum) {
+        uint32_t tableSize = 2 * static_cast<uint32_t>(capacity);
+        uint32_t pos = hash(inStratum, tableSize);
+        while (table[pos] != 0) {
+            double *stratumSlot = slot(static_cast<uint32_t>(table[pos]) - 1);
+            if (static_cast<int64_t>(stratumSlot[0]) == inStratum)
+                return stratumSlot;
+            pos = (pos + 1) & (tableSize - 1);
+        }
+
+        if (numStrata == capacity) {
+            grow(inAllocator);
+            return findOrInsert(inAllocator, inStratum);
+        }
+
+        uint32_t index = numStrata;
+        numStrata = index + 1;
+        table[pos] = index + 1;
+        double *stratumSlot = slot(index);
+        stratumSlot[0] = static_cast<double>(inStratum);
+        return stratumSlot;
+    }
+
+    /**
+     * @brief Double the number of stratum slots and rebuild the hash table
+     */
+    void grow(const Allocator &inAllocator) {
+        uint32_t newCapacity = 2 * static_cast<uint32_t>(capacity);
+        uint32_t n = numStrata;
+        const double *oldSlots = slots;
+
+        Handle newStorage = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(k, newCapacity));
+        std::copy(mStorage.ptr(), mStorage.ptr() + 3, newStorage.ptr());
+        double *newSlots = newStorage.ptr() + 3 + 2 * newCapacity;
+        std::copy(oldSlots, oldSlots + n * slotSize(k), newSlots);
+
+        uint32_t inK = k;
+        mStorage = newStorage;
+        rebind(inK, newCapacity);
+        capacity = newCapacity;
+
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t pos = hash(static_cast<int64_t>(slot(i)[0]),
+                2 * newCapacity);
+            while (table[pos] != 0)
+                pos = (pos + 1) & (2 * newCapacity - 1);
+            table[pos] = i + 1;
+        }
+    }
+
+    void rebind(uint32_t inK, uint32_t inCapacity) {
+        madlib_assert(mStorage.size() >= arraySize(inK, inCapacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        k.rebind(&mStorage[0]);
+        numStrata.rebind(&mStorage[1]);
+        capacity.rebind(&mStorage[2]);
+        // The table is empty before the first row, so compute the pointers
+        // without going through the bounds-checked Handle::operator[]
+        table = mStorage.ptr() + 3;
+        slots = table + 2 * static_cast<size_t>(inCapacity);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 k;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numStrata;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+
+private:
+    typename HandleTraits<Handle>::DoublePtr table;
+    typename HandleTraits<Handle>::DoublePtr slots;
+};
+
+/**
+ * @brief Perform the stratified-sample transition step
+ *
+ * The weight argument is optional: Without it, all rows have weight 1.
+ */
+AnyType
+stratified_sample_transition::run(AnyType &args) {
+    StratifiedReservoirTransitionState<MutableArrayHandle<double> > state
+        = args[0];
+    int64_t stratum = args[1].getAs<int64_t>();
+    int64_t identifier = args[2].getAs<int64_t>();
+    bool weighted = args.numFields() >= 5;
+    double weight = weighted ? args[3].getAs<double>() : 1.;
+    int32_t k = args[weighted ? 4 : 3].getAs<int32_t>();
+
+    if (!state.isInitialized()) {
+        if (k < 1)
+            throw std::invalid_argument("Sample size must be positive.");
+        state.initialize(*this, static_cast<uint32_t>(k));
+    } else if (static_cast<uint32_t>(k) != state.k)
+        throw std::invalid_argument("Sample size must not change during "
+            "aggregation.");
+
+    // As for weighted_sample(), rows with a non-positive weight are ignored
+    if (weight > 0.) {
+        // The generator is kept for all rows of the query
+        void *&cache = callSiteCache();
+        if (cache == NULL) {
+            void *memory = allocateCallSiteCache(
+                sizeof(PhiloxRandomNumberGenerator));
+            cache = new (memory) PhiloxRandomNumberGenerator;
+        }
+        PhiloxRandomNumberGenerator &generator
+            = *static_cast<PhiloxRandomNumberGenerator*>(cache);
+        state.add(*this, stratum, identifier, weight, generator);
+    }
+
+    return state;
+}
+
+/**
+ * @brief Perform the merging of two stratified-sample transition states
+ */
+AnyType
+stratified_sample_merge::run(AnyType &args) {
+    StratifiedReservoirTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    StratifiedReservoirTransitionState<ArrayHandle<double> > stateRight
+        = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    if (stateLeft.k != stateRight.k)
+        throw std::invalid_argument("Sample size must not change during "
+            "aggregation.");
+
+    // Note that a NativeRandomNumberGenerator object is stateless, so it
+    // is not a problem to instantiate an object for each RN generation...
+    NativeRandomNumberGenerator generator;
+    stateLeft.add(*this, stateRight, generator);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the stratified-sample final step
+ */
+AnyType
+stratified_sample_final::run(AnyType &args) {
+    StratifiedReservoirTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized() || state.numStrata == 0)
+        return Null();
+
+    std::vector<std::pair<int64_t, int64_t> > sample;
+    state.sample(sample);
+
+    MutableArrayHandle<int64_t> result = allocateArray<int64_t>(
+        sample.size(), 2);
+    for (size_t i = 0; i < sample.size(); i++) {
+        result[2 * i] = sample[i].first;
+        result[2 * i + 1] = sample[i].second;
+    }
+    return result;
+}
+
+} // namespace sample
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file stratified_sample.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Random sample of k rows per stratum: Transition function
+ */
+DECLARE_UDF(sample, stratified_sample_transition)
+
+/**
+ * @brief Random sample of k rows per stratum: State merge function
+ */
+DECLARE_UDF(sample, stratified_sample_merge)
+
+/**
+ * @brief Random sample of k rows per stratum: Final function
+ */
+DECLARE_UDF(sample, stratified_sample_final)
@@ -2,7 +2,7 @@
  *
  * @file weighted_sample.cpp
  *
- * @brief Generate a single weighted random sample
+ * @brief Generate weighted random samples
  *
  *//* ----------------------------------------------------------------------- */
 
@@ -11,6 +11,13 @@
 
 #include <boost/tr1/random.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "reservoir_impl.hpp"
 #include "weighted_sample.hpp"
 
 // Import TR1 names (currently used from boost). This can go away once we make
@@ -65,9 +72,15 @@ weighted_sample_transition::run(AnyType& args) {
     if (weight > 0.) {
         state.weight_sum += weight;
         std::bernoulli_distribution success(weight / state.weight_sum);
-        // Note that a NativeRandomNumberGenerator object is stateless, so it
-        // is not a problem to instantiate an object for each RN generation...
-        NativeRandomNumberGenerator generator;
+        // The generator is kept for all rows of the query
+        void *&cache = callSiteCache();
+        if (cache == NULL) {
+            void *memory = allocateCallSiteCache(
+                sizeof(PhiloxRandomNumberGenerator));
+            cache = new (memory) PhiloxRandomNumberGenerator;
+        }
+        PhiloxRandomNumberGenerator &generator
+            = *static_cast<PhiloxRandomNumberGenerator*>(cache);
         if (success(generator))
             state.sample_id = identifier;
     }
@@ -108,7 +121,186 @@ weighted_sample_final::run(AnyType &args) {
     return static_cast<int64_t>(state.sample_id);
 }
 
-} // namespace stats
+/**
+ * @brief Transition state for a weighted sample of k rows without replacement
+ *
+ * See WeightedReservoir for the algorithm.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * k, size, skipWeight, followed by a min-heap (ordered by key) of k pairs
+ * (logKey, identifier), of which the first size are used.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0. Handle::operator[] will
+ * perform bounds checking.
+ */
+template <class Handle>
+class WeightedReservoirTransitionState {
+    template <class OtherHandle>
+    friend class WeightedReservoirTransitionState;
+
+public:
+    WeightedReservoirTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inK) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inK));
+        rebind(inK);
+        k = inK;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return k > 0;
+    }
+
+    /**
+     * @brief Process a row with positive weight
+     */
+    template <class RNG>
+    void add(int64_t inIdentifier, double inWeight, RNG &inGenerator) {
+        weightedReservoir(k, size, skipWeight, reservoir).add(
+            static_cast<double>(inIdentifier), inWeight, inGenerator);
+    }
+
+    /**
+     * @brief Merge with the reservoir of another state
+     */
+    template <class OtherHandle, class RNG>
+    void add(const WeightedReservoirTransitionState<OtherHandle> &inOther,
+        RNG &inGenerator) {
+        weightedReservoir(k, size, skipWeight, reservoir).add(
+            inOther.reservoir, inOther.size, inGenerator);
+    }
+
+    /**
+     * @brief Return the identifiers in the reservoir, by descending key
+     */
+    void sample(std::vector<int64_t> &outIdentifiers) const {
+        WeightedReservoir<uint32_t, double>::sample(reservoir, size,
+            outIdentifiers);
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inK) {
+        return 3 + 2 * static_cast<size_t>(inK);
+    }
+
+    void rebind(uint32_t inK) {
+        madlib_assert(mStorage.size() >= arraySize(inK),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        k.rebind(&mStorage[0]);
+        size.rebind(&mStorage[1]);
+        skipWeight.rebind(&mStorage[2]);
+        // The reservoir is empty before the first row, so compute the pointer
+        // without going through the bounds-checked Handle::operator[]
+        reservoir = mStorage.ptr() + 3;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 k;
+    typename HandleTraits<Handle>::ReferenceToUInt32 size;
+    typename HandleTraits<Handle>::ReferenceToDouble skipWeight;
+    typename HandleTraits<Handle>::DoublePtr reservoir;
+};
+
+/**
+ * @brief Perform the weighted-reservoir transition step
+ */
+AnyType
+weighted_reservoir_transition::run(AnyType &args) {
+    WeightedReservoirTransitionState<MutableArrayHandle<double> > state
+        = args[0];
+    int64_t identifier = args[1].getAs<int64_t>();
+    double weight = args[2].getAs<double>();
+    int32_t k = args[3].getAs<int32_t>();
+
+    if (!state.isInitialized()) {
+        if (k < 1)
+            throw std::invalid_argument("Sample size must be positive.");
+        state.initialize(*this, static_cast<uint32_t>(k));
+    } else if (static_cast<uint32_t>(k) != state.k)
+        throw std::invalid_argument("Sample size must not change during "
+            "aggregation.");
+
+    // As for a single sample, rows with a non-positive weight are ignored
+    if (weight > 0.) {
+        // The generator is kept for all rows of the query
+        void *&cache = callSiteCache();
+        if (cache == NULL) {
+            void *memory = allocateCallSiteCache(
+                sizeof(PhiloxRandomNumberGenerator));
+            cache = new (memory) PhiloxRandomNumberGenerator;
+        }
+        PhiloxRandomNumberGenerator &generator
+            = *static_cast<PhiloxRandomNumberGenerator*>(cache);
+        state.add(identifier, weight, generator);
+    }
+
+    return state;
+}
+
+/**
+ * @brief Perform the merging of two weighted-reservoir transition states
+ */
+AnyType
+weighted_reservoir_merge::run(AnyType &args) {
+    WeightedReservoirTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    WeightedReservoirTransitionState<ArrayHandle<double> > stateRight
+        = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    if (stateLeft.k != stateRight.k)
+        throw std::invalid_argument("Sample size must not change during "
+            "aggregation.");
+
+    // Note that a NativeRandomNumberGenerator object is stateless, so it
+    // is not a problem to instantiate an object for each RN generation...
+    NativeRandomNumberGenerator generator;
+    stateLeft.add(stateRight, generator);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the weighted-reservoir final step
+ */
+AnyType
+weighted_reservoir_final::run(AnyType &args) {
+    WeightedReservoirTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (state.size == 0)
+        return Null();
+
+    std::vector<int64_t> identifiers;
+    state.sample(identifiers);
+
+    MutableArrayHandle<int64_t> result = allocateArray<int64_t>(
+        identifiers.size());
+    std::copy(identifiers.begin(), identifiers.end(), result.ptr());
+    return result;
+}
+
+} // namespace sample
 
 } // namespace modules
 
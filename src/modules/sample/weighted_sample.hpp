@@ -18,3 +18,18 @@ DECLARE_UDF(sample, weighted_sample_merge)
  * @brief Weighted random sample: Final function
  */
 DECLARE_UDF(sample, weighted_sample_final)
+
+/**
+ * @brief Weighted random sample of k rows: Transition function
+ */
+DECLARE_UDF(sample, weighted_reservoir_transition)
+
+/**
+ * @brief Weighted random sample of k rows: State merge function
+ */
+DECLARE_UDF(sample, weighted_reservoir_merge)
+
+/**
+ * @brief Weighted random sample of k rows: Final function
+ */
+DECLARE_UDF(sample, weighted_reservoir_final)
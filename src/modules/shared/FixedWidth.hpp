@@ -0,0 +1,67 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file FixedWidth.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_SHARED_FIXED_WIDTH_HPP_
+#define MADLIB_SHARED_FIXED_WIDTH_HPP_
+
+#include <dbconnector/dbconnector.hpp>
+
+namespace madlib {
+
+namespace modules {
+
+/**
+ * @brief Largest width for which dispatchFixedWidth() instantiates a kernel
+ */
+enum { kMaxFixedWidth = 16 };
+
+/**
+ * @brief Run a kernel specialized for the given width at compile time
+ *
+ * Transition functions typically operate on vectors and matrices whose size
+ * is only known at runtime (e.g., the number of independent variables). For
+ * small sizes, the overhead of dynamically sized Eigen objects dominates.
+ * With fixed-size objects instead, Eigen and the compiler can fully unroll
+ * all loops and keep the operands in registers.
+ *
+ * This function calls <tt>ioKernel.run<Width>()</tt> with
+ * <tt>Width == inWidth</tt> if \f$ 1 \leq \mathit{inWidth} \leq
+ * \mathit{kMaxFixedWidth} \f$.
+ *
+ * @return \c true if a fixed-width kernel was run, \c false if the caller has
+ *     to fall back to its dynamically sized code
+ */
+template <class Kernel>
+inline
+bool
+dispatchFixedWidth(dbal::eigen_integration::Index inWidth,
+    Kernel& ioKernel) {
+    switch (inWidth) {
+        case 1: ioKernel.template run<1>(); return true;
+        case 2: ioKernel.template run<2>(); return true;
+        case 3: ioKernel.template run<3>(); return true;
+        case 4: ioKernel.template run<4>(); return true;
+        case 5: ioKernel.template run<5>(); return true;
+        case 6: ioKernel.template run<6>(); return true;
+        case 7: ioKernel.template run<7>(); return true;
+        case 8: ioKernel.template run<8>(); return true;
+        case 9: ioKernel.template run<9>(); return true;
+        case 10: ioKernel.template run<10>(); return true;
+        case 11: ioKernel.template run<11>(); return true;
+        case 12: ioKernel.template run<12>(); return true;
+        case 13: ioKernel.template run<13>(); return true;
+        case 14: ioKernel.template run<14>(); return true;
+        case 15: ioKernel.template run<15>(); return true;
+        case 16: ioKernel.template run<16>(); return true;
+        default: return false;
+    }
+}
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_SHARED_FIXED_WIDTH_HPP_)
@@ -0,0 +1,125 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file LogisticTerms.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_SHARED_LOGISTIC_TERMS_HPP_
+#define MADLIB_SHARED_LOGISTIC_TERMS_HPP_
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <cmath>
+
+namespace madlib {
+
+namespace modules {
+
+/**
+ * @brief Per-row terms of logistic regression, computed from a single
+ *     exponential
+ *
+ * All logistic-regression transition functions need some of
+ * \f$ \sigma(t) \f$, \f$ \sigma(-t) \f$, \f$ \sigma(t) \sigma(-t) \f$, and
+ * \f$ \ln(1 + e^{-t}) \f$ for the margin \f$ t = y \cdot x^T c \f$ of a row.
+ * Evaluating each of them separately takes one call to <tt>exp()</tt> per
+ * term. With \f$ e = e^{-|t|} \in (0, 1] \f$, all of them follow from
+ * \f$ e \f$ alone:
+ *
+ * - \f$ \sigma(|t|) = 1 / (1 + e) \f$ and \f$ \sigma(-|t|) = e / (1 + e) \f$
+ * - \f$ \sigma(t) \sigma(-t) = e / (1 + e)^2 \f$
+ * - \f$ \ln(1 + e^{-t}) = \max(-t, 0) + \mathrm{log1p}(e) \f$
+ *
+ * Since \f$ e \f$ never overflows, this is also numerically stable for large
+ * \f$ |t| \f$, where <tt>log(1 + exp(-t))</tt> would overflow to infinity.
+ *
+ * @note The dependent variable \f$ y \f$ must be -1 or 1. Then
+ *     \f$ \sigma(x^T c) \sigma(-x^T c) = \sigma(t) \sigma(-t) \f$, so the
+ *     weight of the Hessian can be taken from the margin, too.
+ */
+struct LogisticTerms {
+    /**
+     * @param inMargin The margin \f$ t = y \cdot x^T c \f$
+     */
+    explicit LogisticTerms(double inMargin) {
+        double e = std::exp(-std::fabs(inMargin));
+        double reciprocal = 1. / (1. + e);
+
+        if (inMargin >= 0) {
+            sigma = reciprocal;
+            sigmaOfNegative = e * reciprocal;
+            negativeLogLikelihood = log1p(e);
+        } else {
+            sigma = e * reciprocal;
+            sigmaOfNegative = reciprocal;
+            negativeLogLikelihood = log1p(e) - inMargin;
+        }
+        weight = e * reciprocal * reciprocal;
+    }
+
+    /**
+     * @brief \f$ \sigma(t) \f$
+     */
+    double sigma;
+
+    /**
+     * @brief \f$ \sigma(-t) = 1 - \sigma(t) \f$
+     */
+    double sigmaOfNegative;
+
+    /**
+     * @brief \f$ a = \sigma(t) \sigma(-t) \f$, the weight of the row in the
+     *     Hessian
+     */
+    double weight;
+
+    /**
+     * @brief \f$ \ln(1 + e^{-t}) = -\ln \sigma(t) \f$
+     */
+    double negativeLogLikelihood;
+
+    /**
+     * @brief Terms for a batch of margins
+     *
+     * The exponentials are computed as one Eigen array expression, which
+     * Eigen vectorizes where the platform supports it.
+     *
+     * @param inMargins Vector of margins \f$ t_i \f$
+     * @param outSigmaOfNegative Is set to \f$ \sigma(-t_i) \f$
+     * @param outWeight If not \c NULL, is set to
+     *     \f$ \sigma(t_i) \sigma(-t_i) \f$
+     * @return The sum of \f$ \ln(1 + e^{-t_i}) \f$
+     */
+    template <class Derived>
+    static double batch(const Eigen::MatrixBase<Derived> &inMargins,
+        dbal::eigen_integration::ColumnVector &outSigmaOfNegative,
+        dbal::eigen_integration::ColumnVector *outWeight = NULL) {
+
+        using dbal::eigen_integration::ColumnVector;
+        using dbal::eigen_integration::Index;
+
+        ColumnVector e = (-inMargins.array().abs()).exp().matrix();
+        ColumnVector reciprocal = (1. + e.array()).inverse().matrix();
+
+        outSigmaOfNegative.resize(inMargins.size());
+        double negativeLogLikelihood = 0;
+        for (Index i = 0; i < inMargins.size(); ++i) {
+            if (inMargins(i) >= 0) {
+                outSigmaOfNegative(i) = e(i) * reciprocal(i);
+                negativeLogLikelihood += log1p(e(i));
+            } else {
+                outSigmaOfNegative(i) = reciprocal(i);
+                negativeLogLikelihood += log1p(e(i)) - inMargins(i);
+            }
+        }
+        if (outWeight)
+            *outWeight = (e.array() * reciprocal.array().square()).matrix();
+        return negativeLogLikelihood;
+    }
+};
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_SHARED_LOGISTIC_TERMS_HPP_)
@@ -0,0 +1,172 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file Moments.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_SHARED_MOMENTS_HPP_
+#define MADLIB_SHARED_MOMENTS_HPP_
+
+#include <cmath>
+#include <limits>
+
+namespace madlib {
+
+namespace modules {
+
+/**
+ * @brief Streaming and mergeable accumulator for the first four moments
+ *
+ * For numerical stability, we should not compute central moments from power
+ * sums in the naive way. The literature has many examples where this gives
+ * bad results even with moderately sized inputs. Instead, we keep the count,
+ * the mean, and the sums \f$ M_k = \sum_i (x_i - \bar x)^k \f$ of centered
+ * powers for \f$ k = 2, 3, 4 \f$, and update them with each value. Two
+ * accumulators (e.g., of different segments) can be merged in any order.
+ *
+ * See:
+ *
+ * B. P. Welford (1962). "Note on a method for calculating corrected sums of
+ * squares and products". Technometrics 4(3):419–420.
+ *
+ * Chan, Tony F.; Golub, Gene H.; LeVeque, Randall J. (1979), "Updating
+ * Formulae and a Pairwise Algorithm for Computing Sample Variances.", Technical
+ * Report STAN-CS-79-773, Department of Computer Science, Stanford University.
+ * ftp://reports.stanford.edu/pub/cstr/reports/cs/tr/79/773/CS-TR-79-773.pdf
+ *
+ * P. Pébay (2008). "Formulas for Robust, One-Pass Parallel Computation of
+ * Covariances and Arbitrary-Order Statistical Moments". Technical Report
+ * SAND2008-6212, Sandia National Laboratories.
+ */
+struct Moments {
+    Moments()
+      : numValues(0), mean(0), M2(0), M3(0), M4(0) { }
+
+    Moments(double inNumValues, double inMean, double inM2, double inM3,
+        double inM4)
+      : numValues(inNumValues), mean(inMean), M2(inM2), M3(inM3), M4(inM4) { }
+
+    /**
+     * @brief Add a single value
+     */
+    Moments& operator<<(double inValue) {
+        double n1 = numValues;
+        numValues += 1;
+        double n = numValues;
+        double delta = inValue - mean;
+        double deltaN = delta / n;
+        double deltaN2 = deltaN * deltaN;
+        double term1 = delta * deltaN * n1;
+
+        mean += deltaN;
+        M4 += term1 * deltaN2 * (n * n - 3 * n + 3)
+            + 6 * deltaN2 * M2 - 4 * deltaN * M3;
+        M3 += term1 * deltaN * (n - 2) - 3 * deltaN * M2;
+        M2 += term1;
+        return *this;
+    }
+
+    /**
+     * @brief Merge with another accumulator
+     */
+    Moments& operator+=(const Moments& inOther) {
+        if (inOther.numValues <= 0)
+            return *this;
+        if (numValues <= 0)
+            return *this = inOther;
+
+        double na = numValues;
+        double nb = inOther.numValues;
+        double n = na + nb;
+        double delta = inOther.mean - mean;
+        double delta2 = delta * delta;
+
+        double newM4 = M4 + inOther.M4
+            + delta2 * delta2 * na * nb * (na * na - na * nb + nb * nb)
+                / (n * n * n)
+            + 6 * delta2 * (na * na * inOther.M2 + nb * nb * M2) / (n * n)
+            + 4 * delta * (na * inOther.M3 - nb * M3) / n;
+        double newM3 = M3 + inOther.M3
+            + delta * delta2 * na * nb * (na - nb) / (n * n)
+            + 3 * delta * (na * inOther.M2 - nb * M2) / n;
+        M2 += inOther.M2 + delta2 * na * nb / n;
+        M3 = newM3;
+        M4 = newM4;
+        mean += delta * nb / n;
+        numValues = n;
+        return *this;
+    }
+
+    double sum() const {
+        return numValues * mean;
+    }
+
+    /**
+     * @brief Sample variance \f$ \frac{M_2}{n - 1} \f$
+     */
+    double sampleVariance() const {
+        return numValues > 1 ? M2 / (numValues - 1)
+            : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    /**
+     * @brief Sample skewness \f$ g_1 = \frac{\sqrt n M_3}{M_2^{3/2}} \f$
+     */
+    double skewness() const {
+        return std::sqrt(numValues) * M3 / std::pow(M2, 1.5);
+    }
+
+    /**
+     * @brief Sample excess kurtosis \f$ g_2 = \frac{n M_4}{M_2^2} - 3 \f$
+     */
+    double excessKurtosis() const {
+        return numValues * M4 / (M2 * M2) - 3;
+    }
+
+    double numValues;
+    double mean;
+    double M2;
+    double M3;
+    double M4;
+};
+
+/**
+ * @brief Update the corrected sum of squares
+ *
+ * This is the second-order case of Moments::operator+=() for transition
+ * states that keep the sum instead of the mean of their values, i.e.,
+ * the triple \f$ (n, \sum_i x_i, M_2) \f$. Adding a single value \f$ x \f$
+ * amounts to merging with \f$ (1, x, 0) \f$, which is Welford's update.
+ */
+inline
+void
+updateCorrectedSumOfSquares(double &ioLeftWeight, double &ioLeftSum,
+    double &ioLeftCorrectedSumSquares, double inRightWeight, double inRightSum,
+    double inRightCorrectedSumSquares) {
+
+    if (inRightWeight <= 0)
+        return;
+
+    // FIXME: Use compensated sums for numerical stability
+    // http://jira.madlib.net/browse/MADLIB-500
+    // See Ogita et al., "Accurate Sum and Dot Product", SIAM Journal on
+    // Scientific Computing (SISC), 26(6):1955-1988, 2005.
+    if (ioLeftWeight <= 0)
+        ioLeftCorrectedSumSquares = inRightCorrectedSumSquares;
+    else {
+        double diff = inRightWeight / ioLeftWeight * ioLeftSum - inRightSum;
+        ioLeftCorrectedSumSquares
+               += inRightCorrectedSumSquares
+                + ioLeftWeight / (inRightWeight * (ioLeftWeight + inRightWeight))
+                    * diff * diff;
+    }
+
+    ioLeftSum += inRightSum;
+    ioLeftWeight += inRightWeight;
+}
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_SHARED_MOMENTS_HPP_)
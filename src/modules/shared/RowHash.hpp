@@ -0,0 +1,66 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file RowHash.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_SHARED_ROW_HASH_HPP_
+#define MADLIB_SHARED_ROW_HASH_HPP_
+
+#include <stdint.h>
+
+namespace madlib {
+
+namespace modules {
+
+/**
+ * @brief Finalizer of the SplitMix64 generator
+ *
+ * A bijection on 64-bit integers of which every output bit depends on every
+ * input bit.
+ */
+inline
+uint64_t
+mix64(uint64_t inValue) {
+    uint64_t z = inValue + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Return the cross-validation fold of a row, in [0, inNumFolds)
+ *
+ * The fold only depends on the seed and the row identifier, so it is the same
+ * in every scan, independently of the order of rows and of how they are
+ * distributed among segments. The upper 32 bits of the hash are scaled to the
+ * number of folds, which avoids the bias of taking the remainder.
+ */
+inline
+uint32_t
+crossValidationFold(uint64_t inSeed, int64_t inIdentifier,
+    uint32_t inNumFolds) {
+
+    uint64_t hash = mix64(inSeed ^ mix64(static_cast<uint64_t>(inIdentifier)));
+    return static_cast<uint32_t>(((hash >> 32) * inNumFolds) >> 32);
+}
+
+/**
+ * @brief Return a uniform number in [0, 1) derived from the hash of a row
+ *
+ * Rows for which the number is below a given fraction form a holdout set
+ * that is the same in every scan, like the folds of crossValidationFold().
+ */
+inline
+double
+rowHashUniform(uint64_t inSeed, int64_t inIdentifier) {
+    uint64_t hash = mix64(inSeed ^ mix64(static_cast<uint64_t>(inIdentifier)));
+    // 53 bits of precision
+    return static_cast<double>(hash >> 11) * (1. / 9007199254740992.);
+}
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_SHARED_ROW_HASH_HPP_)
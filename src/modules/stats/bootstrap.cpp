@@ -0,0 +1,477 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file bootstrap.cpp
+ *
+ * @brief Poisson bootstrap of mergeable accumulators in a single pass
+ *
+ * Instead of resampling with replacement, which needs one query per
+ * replicate, every row is given an independent Poisson(1) weight in every
+ * replicate. For large samples, the weighted replicates are distributed like
+ * the usual multinomial ones, but all of them can be accumulated in one scan,
+ * and the transition states of different segments remain mergeable.
+ *
+ * The weights are derived from a hash of the seed, the row identifier, and the
+ * replicate number. The result therefore does not depend on the order of the
+ * rows or on how they are distributed among segments.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <modules/shared/Moments.hpp>
+#include <modules/shared/RowHash.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "bootstrap.hpp"
+#include "linregr_replicate.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace stats {
+
+/**
+ * @brief Return the Poisson(1) weight of a row in a replicate
+ *
+ * A uniform number in [0, 1) is derived from the hash of the arguments, and
+ * then transformed by the inverse of the Poisson(1) distribution function.
+ * The mean number of iterations is 1.
+ */
+inline
+uint32_t
+poissonWeight(uint64_t inSeed, int64_t inIdentifier, uint32_t inReplicate) {
+    uint64_t hash = mix64(mix64(inSeed ^ mix64(
+        static_cast<uint64_t>(inIdentifier))) + inReplicate);
+    double u = static_cast<double>(hash >> 11) * (1. / 9007199254740992.);
+
+    uint32_t k = 0;
+    double p = std::exp(-1.);
+    double cdf = p;
+    while (u >= cdf && k < 32) {
+        k++;
+        p /= k;
+        cdf += p;
+    }
+    return k;
+}
+
+/**
+ * @brief Transition state keeping one accumulator per bootstrap replicate
+ *
+ * The template argument Replicate defines the accumulator: Its size for a
+ * given width, how a row with integer weight is added, how two accumulators
+ * are merged, and the statistics computed from it. Replicate 0 is the
+ * accumulator of the original sample (all weights are 1), which gives the
+ * point estimates.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * numReplicates, seed, width, followed by numReplicates + 1 accumulators.
+ * The width is the number of independent variables where applicable, and 0
+ * otherwise.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0.
+ */
+template <class Handle, class Replicate>
+class BootstrapTransitionState {
+    template <class OtherHandle, class OtherReplicate>
+    friend class BootstrapTransitionState;
+
+public:
+    BootstrapTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]),
+            static_cast<uint32_t>(mStorage[2]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator,
+        uint32_t inNumReplicates, double inSeed, uint32_t inWidth) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inNumReplicates, inWidth));
+        rebind(inNumReplicates, inWidth);
+        numReplicates = inNumReplicates;
+        seed = inSeed;
+        width = inWidth;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return numReplicates > 0;
+    }
+
+    /**
+     * @brief Make sure that the parameters are the same as for all other rows
+     */
+    void initializeOrCheck(const Allocator &inAllocator,
+        int32_t inNumReplicates, int64_t inSeed, uint32_t inWidth) {
+
+        if (!isInitialized()) {
+            if (inNumReplicates < 1)
+                throw std::invalid_argument("Number of replicates must be "
+                    "positive.");
+            initialize(inAllocator, static_cast<uint32_t>(inNumReplicates),
+                static_cast<double>(inSeed), inWidth);
+        } else if (static_cast<uint32_t>(inNumReplicates) != numReplicates
+            || static_cast<double>(inSeed) != seed)
+            throw std::invalid_argument("Number of replicates and seed must "
+                "not change during aggregation.");
+        else if (inWidth != width)
+            throw std::invalid_argument("Inconsistent numbers of independent "
+                "variables.");
+    }
+
+    /**
+     * @brief Add a row to all replicates, with its Poisson(1) weights
+     */
+    void add(int64_t inIdentifier, const typename Replicate::row_type &inRow) {
+        uint64_t hashSeed = static_cast<uint64_t>(static_cast<int64_t>(seed));
+        Replicate::add(replicate(0), width, 1, inRow);
+        for (uint32_t b = 1; b <= numReplicates; b++) {
+            uint32_t weight = poissonWeight(hashSeed, inIdentifier, b);
+            if (weight > 0)
+                Replicate::add(replicate(b), width, weight, inRow);
+        }
+    }
+
+    /**
+     * @brief Merge with another state object
+     */
+    template <class OtherHandle>
+    BootstrapTransitionState &operator+=(
+        const BootstrapTransitionState<OtherHandle, Replicate> &inOther) {
+
+        if (numReplicates != inOther.numReplicates
+            || seed != inOther.seed)
+            throw std::invalid_argument("Number of replicates and seed must "
+                "not change during aggregation.");
+        if (width != inOther.width)
+            throw std::invalid_argument("Inconsistent numbers of independent "
+                "variables.");
+
+        for (uint32_t b = 0; b <= numReplicates; b++)
+            Replicate::merge(replicate(b), width, inOther.replicate(b));
+        return *this;
+    }
+
+    const double *replicate(uint32_t inIndex) const {
+        return replicates + inIndex * Replicate::size(width);
+    }
+
+    double *replicate(uint32_t inIndex) {
+        return replicates + inIndex * Replicate::size(width);
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inNumReplicates,
+        uint32_t inWidth) {
+
+        return 3 + (static_cast<size_t>(inNumReplicates) + 1)
+            * Replicate::size(inWidth);
+    }
+
+    void rebind(uint32_t inNumReplicates, uint32_t inWidth) {
+        madlib_assert(mStorage.size() >= arraySize(inNumReplicates, inWidth)
+            || inNumReplicates == 0,
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        numReplicates.rebind(&mStorage[0]);
+        seed.rebind(&mStorage[1]);
+        width.rebind(&mStorage[2]);
+        // The state has no replicates before the first row, so compute the
+        // pointer without going through the bounds-checked
+        // Handle::operator[]
+        replicates = mStorage.ptr() + 3;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numReplicates;
+    typename HandleTraits<Handle>::ReferenceToDouble seed;
+    typename HandleTraits<Handle>::ReferenceToUInt32 width;
+
+private:
+    typename HandleTraits<Handle>::DoublePtr replicates;
+};
+
+/**
+ * @brief Replicate accumulator for the first four moments
+ *
+ * The accumulator is the same as the state of moments(). A row with weight
+ * \f$ w \f$ is merged as \f$ w \f$ equal values, i.e., as a Moments object
+ * with count \f$ w \f$ and no spread.
+ *
+ * Statistics: mean, sample variance, skewness, and excess kurtosis.
+ */
+struct MomentsReplicate {
+    typedef double row_type;
+    enum { kNumStatistics = 4 };
+
+    static size_t size(uint32_t /* inWidth */) {
+        return 5;
+    }
+
+    static uint32_t numStatistics(uint32_t /* inWidth */) {
+        return kNumStatistics;
+    }
+
+    static Moments moments(const double *inReplicate) {
+        return Moments(inReplicate[0], inReplicate[1], inReplicate[2],
+            inReplicate[3], inReplicate[4]);
+    }
+
+    static void store(const Moments &inMoments, double *outReplicate) {
+        outReplicate[0] = inMoments.numValues;
+        outReplicate[1] = inMoments.mean;
+        outReplicate[2] = inMoments.M2;
+        outReplicate[3] = inMoments.M3;
+        outReplicate[4] = inMoments.M4;
+    }
+
+    static void add(double *ioReplicate, uint32_t /* inWidth */,
+        uint32_t inWeight, const row_type &inValue) {
+
+        Moments m = moments(ioReplicate);
+        if (inWeight == 1)
+            m << inValue;
+        else
+            m += Moments(inWeight, inValue, 0, 0, 0);
+        store(m, ioReplicate);
+    }
+
+    static void merge(double *ioReplicate, uint32_t /* inWidth */,
+        const double *inOther) {
+
+        Moments m = moments(ioReplicate);
+        m += moments(inOther);
+        store(m, ioReplicate);
+    }
+
+    static void statistics(const double *inReplicate, uint32_t /* inWidth */,
+        double *outStatistics) {
+
+        Moments m = moments(inReplicate);
+        double nan = std::numeric_limits<double>::quiet_NaN();
+        bool hasSpread = m.M2 > 0;
+        outStatistics[0] = m.numValues > 0 ? m.mean : nan;
+        outStatistics[1] = m.sampleVariance();
+        outStatistics[2] = hasSpread ? m.skewness() : nan;
+        outStatistics[3] = hasSpread ? m.excessKurtosis() : nan;
+    }
+};
+
+/**
+ * @brief Return the linearly interpolated quantile of sorted values
+ */
+inline
+double
+sortedQuantile(const std::vector<double> &inSorted, double inProbability) {
+    double position = inProbability * static_cast<double>(inSorted.size() - 1);
+    size_t lower = static_cast<size_t>(std::floor(position));
+    size_t upper = std::min(lower + 1, inSorted.size() - 1);
+    double fraction = position - static_cast<double>(lower);
+    return inSorted[lower] + fraction * (inSorted[upper] - inSorted[lower]);
+}
+
+/**
+ * @brief Summarize the replicates of a bootstrap state
+ *
+ * Returns the composite bootstrap_result: the point estimates (from the
+ * original sample), the bootstrap standard errors, the bounds of the 95%
+ * percentile intervals, the number of replicates, and the statistics of all
+ * replicates as a two-dimensional array with one inner array per replicate.
+ * Replicates with undefined statistics (e.g., a variance computed from less
+ * than two rows) are excluded from the standard error and the interval of
+ * that statistic.
+ */
+template <class Replicate, class State>
+AnyType
+bootstrapResult(const State &inState) {
+    uint32_t B = inState.numReplicates;
+    uint32_t k = Replicate::numStatistics(inState.width);
+    Allocator &allocator = defaultAllocator();
+
+    MutableMappedColumnVector estimate(allocator.allocateArray<double>(k));
+    Replicate::statistics(inState.replicate(0), inState.width, estimate.data());
+
+    MutableArrayHandle<double> replicates = allocator.allocateArray<double>(
+        B, k);
+    for (uint32_t b = 0; b < B; b++)
+        Replicate::statistics(inState.replicate(b + 1), inState.width,
+            replicates.ptr() + static_cast<size_t>(b) * k);
+
+    MutableMappedColumnVector stdErr(allocator.allocateArray<double>(k));
+    MutableMappedColumnVector ciLower(allocator.allocateArray<double>(k));
+    MutableMappedColumnVector ciUpper(allocator.allocateArray<double>(k));
+    std::vector<double> values;
+    for (uint32_t j = 0; j < k; j++) {
+        values.clear();
+        for (uint32_t b = 0; b < B; b++) {
+            double value = replicates[static_cast<size_t>(b) * k + j];
+            if (std::isfinite(value))
+                values.push_back(value);
+        }
+
+        double nan = std::numeric_limits<double>::quiet_NaN();
+        if (values.empty()) {
+            stdErr(j) = ciLower(j) = ciUpper(j) = nan;
+            continue;
+        }
+
+        Moments m;
+        for (size_t i = 0; i < values.size(); i++)
+            m << values[i];
+        stdErr(j) = values.size() > 1 ? std::sqrt(m.sampleVariance()) : nan;
+
+        std::sort(values.begin(), values.end());
+        ciLower(j) = sortedQuantile(values, 0.025);
+        ciUpper(j) = sortedQuantile(values, 0.975);
+    }
+
+    AnyType tuple;
+    tuple
+        << estimate
+        << stdErr
+        << ciLower
+        << ciUpper
+        << static_cast<int32_t>(B)
+        << replicates;
+    return tuple;
+}
+
+typedef BootstrapTransitionState<MutableArrayHandle<double>, MomentsReplicate>
+    MutableMomentsBootstrapState;
+typedef BootstrapTransitionState<ArrayHandle<double>, MomentsReplicate>
+    MomentsBootstrapState;
+typedef BootstrapTransitionState<MutableArrayHandle<double>,
+    LinearRegressionReplicate> MutableLinRegrBootstrapState;
+typedef BootstrapTransitionState<ArrayHandle<double>,
+    LinearRegressionReplicate> LinRegrBootstrapState;
+
+/**
+ * @brief Perform the transition step of the bootstrap of moments
+ */
+AnyType
+bootstrap_moments_transition::run(AnyType &args) {
+    MutableMomentsBootstrapState state = args[0];
+    double x = args[1].getAs<double>();
+    int64_t identifier = args[2].getAs<int64_t>();
+
+    state.initializeOrCheck(*this, args[3].getAs<int32_t>(),
+        args[4].getAs<int64_t>(), 0);
+    state.add(identifier, x);
+    return state;
+}
+
+/**
+ * @brief Merge two transition states of the bootstrap of moments
+ */
+AnyType
+bootstrap_moments_merge_states::run(AnyType &args) {
+    MutableMomentsBootstrapState stateLeft = args[0];
+    MomentsBootstrapState stateRight = args[1];
+
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    else if (!stateRight.isInitialized())
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step of the bootstrap of moments
+ */
+AnyType
+bootstrap_moments_final::run(AnyType &args) {
+    MomentsBootstrapState state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    return bootstrapResult<MomentsReplicate>(state);
+}
+
+/**
+ * @brief Perform the transition step of the bootstrap of linear regression
+ */
+AnyType
+bootstrap_linregr_transition::run(AnyType &args) {
+    MutableLinRegrBootstrapState state = args[0];
+    double y = args[1].getAs<double>();
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+    int64_t identifier = args[3].getAs<int64_t>();
+
+    if (!std::isfinite(y))
+        throw std::domain_error("Dependent variables are not finite.");
+    else if (!isfinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+    else if (x.size() == 0)
+        throw std::invalid_argument("Number of independent variables must be "
+            "positive.");
+
+    state.initializeOrCheck(*this, args[4].getAs<int32_t>(),
+        args[5].getAs<int64_t>(), static_cast<uint32_t>(x.size()));
+
+    ColumnVector contributions;
+    linregrContributions(y, x, contributions);
+    state.add(identifier, contributions);
+    return state;
+}
+
+/**
+ * @brief Merge two transition states of the bootstrap of linear regression
+ */
+AnyType
+bootstrap_linregr_merge_states::run(AnyType &args) {
+    MutableLinRegrBootstrapState stateLeft = args[0];
+    LinRegrBootstrapState stateRight = args[1];
+
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    else if (!stateRight.isInitialized())
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step of the bootstrap of linear regression
+ */
+AnyType
+bootstrap_linregr_final::run(AnyType &args) {
+    LinRegrBootstrapState state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    return bootstrapResult<LinearRegressionReplicate>(state);
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,35 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file bootstrap.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Bootstrap of moments: Transition function
+ */
+DECLARE_UDF(stats, bootstrap_moments_transition)
+
+/**
+ * @brief Bootstrap of moments: State merge function
+ */
+DECLARE_UDF(stats, bootstrap_moments_merge_states)
+
+/**
+ * @brief Bootstrap of moments: Final function
+ */
+DECLARE_UDF(stats, bootstrap_moments_final)
+
+/**
+ * @brief Bootstrap of linear-regression coefficients: Transition function
+ */
+DECLARE_UDF(stats, bootstrap_linregr_transition)
+
+/**
+ * @brief Bootstrap of linear-regression coefficients: State merge function
+ */
+DECLARE_UDF(stats, bootstrap_linregr_merge_states)
+
+/**
+ * @brief Bootstrap of linear-regression coefficients: Final function
+ */
+DECLARE_UDF(stats, bootstrap_linregr_final)
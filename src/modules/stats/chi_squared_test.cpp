@@ -2,7 +2,7 @@
  *
  * @file chi_squared_test.cpp
  *
- * @brief Wilcoxon-Signed-Rank-test functions
+ * @brief Pearson's chi-squared test functions
  *
  *//* ----------------------------------------------------------------------- */
 
@@ -10,6 +10,10 @@
 #include <modules/shared/HandleTraits.hpp>
 #include <modules/prob/boost.hpp>
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include "chi_squared_test.hpp"
 
 namespace madlib {
@@ -175,6 +179,312 @@ chi2_gof_test_final::run(AnyType &args) {
     return tuple;
 }
 
+/**
+ * @brief Transition state for the chi-squared independence test
+ *
+ * The state is a sparse contingency table: It holds one observation count for
+ * each cell (i.e., pair of row and column category) that has been seen. Cells
+ * are numbered in the order in which they are first seen. An open-addressing
+ * hash table (with linear probing and a load factor of at most 1/2) maps
+ * pairs of categories to these numbers.
+ *
+ * The storage array is laid out as follows, where \f$ r \f$ is the number of
+ * cells reserved:
+ * - 0: Number of cells
+ * - 1: Number of cells reserved (\f$ r \f$, zero or a power of 2)
+ * - \f$ 2, \dots, 2r + 1 \f$: Hash table. Each slot holds one plus the number
+ *   of a cell, or 0 if the slot is empty.
+ * - \f$ 2r + 2, \dots \f$: Row categories, column categories, and observation
+ *   counts, with \f$ r \f$ elements each.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 2, and all elements are 0. Handle::operator[] will
+ * perform bounds checking.
+ */
+template <class Handle>
+class Chi2IndependenceTransitionState {
+public:
+    Chi2IndependenceTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[1]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Return the index (in the rowValues, colValues, and observed
+     *     fields) of a cell
+     *
+     * If a cell is not found, we add it to the transition state. Since we do
+     * not want to reallocate too often, we reserve some buffer space in the
+     * storage array. So we need to reallocate and copy memory only whenever
+     * the number of cells hits a power of 2.
+     */
+    uint32_t idxOfCell(const Allocator& inAllocator, int32_t inRow,
+        int32_t inCol);
+
+private:
+    static inline size_t arraySize(uint32_t inNumCellsReserved) {
+        return 2 + 5 * static_cast<size_t>(inNumCellsReserved);
+    }
+
+    /**
+     * @brief Return the first hash-table slot to probe for a cell
+     *
+     * We use Fibonacci hashing on the 64-bit concatenation of the categories.
+     */
+    static inline uint32_t initialSlot(int32_t inRow, int32_t inCol,
+        uint32_t inNumSlots) {
+
+        uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(inRow))
+            << 32) | static_cast<uint32_t>(inCol);
+        return static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ULL) >> 32)
+            & (inNumSlots - 1);
+    }
+
+    /**
+     * @brief Return the hash-table slot of a cell
+     *
+     * If the cell is not in the hash table, return the empty slot where it
+     * would have to be inserted.
+     */
+    uint32_t slotOfCell(int32_t inRow, int32_t inCol) const {
+        uint32_t numSlots = 2 * static_cast<uint32_t>(numCellsReserved);
+        uint32_t slot = initialSlot(inRow, inCol, numSlots);
+        while (slots[slot] != 0) {
+            uint32_t idx = static_cast<uint32_t>(slots[slot]) - 1;
+            if (static_cast<int32_t>(rowValues[idx]) == inRow
+                && static_cast<int32_t>(colValues[idx]) == inCol)
+                break;
+            slot = (slot + 1) & (numSlots - 1);
+        }
+        return slot;
+    }
+
+    void rebind(uint32_t inNumCellsReserved) {
+        madlib_assert(mStorage.size() >= arraySize(inNumCellsReserved),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        // With no cells reserved, the offsets below point just past the end
+        // of the array, so we must not use operator[] for them
+        numCells.rebind(&mStorage[0]);
+        numCellsReserved.rebind(&mStorage[1]);
+        slots = mStorage.ptr() + 2;
+        rowValues = mStorage.ptr() + 2 + 2 * inNumCellsReserved;
+        colValues = mStorage.ptr() + 2 + 3 * inNumCellsReserved;
+        observed = mStorage.ptr() + 2 + 4 * inNumCellsReserved;
+    }
+
+    Handle mStorage;
+
+    typename HandleTraits<Handle>::DoublePtr slots;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numCells;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numCellsReserved;
+    typename HandleTraits<Handle>::DoublePtr rowValues;
+    typename HandleTraits<Handle>::DoublePtr colValues;
+    typename HandleTraits<Handle>::DoublePtr observed;
+};
+
+template <>
+uint32_t
+Chi2IndependenceTransitionState<MutableArrayHandle<double> >::idxOfCell(
+    const Allocator& inAllocator, int32_t inRow, int32_t inCol) {
+
+    if (numCellsReserved > 0) {
+        uint32_t slot = slotOfCell(inRow, inCol);
+        if (slots[slot] != 0)
+            return static_cast<uint32_t>(slots[slot]) - 1;
+
+        if (numCells < numCellsReserved) {
+            // We have enough reserve space allocated.
+            uint32_t idx = numCells++;
+            rowValues[idx] = inRow;
+            colValues[idx] = inCol;
+            slots[slot] = idx + 1;
+            return idx;
+        }
+    }
+
+    // Did not find this cell, and we need to reallocate storage for the
+    // transition state. Save our current state, so we can subsequently restore
+    // it with the new storage.
+    Chi2IndependenceTransitionState oldSelf = *this;
+    uint32_t newNumCellsReserved;
+    if (oldSelf.numCellsReserved == 0)
+        newNumCellsReserved = 1;
+    else {
+        // Besides the 32-bit cell numbers, the hash table (with twice as many
+        // slots as cells) must be addressable with 32-bit integers.
+        if (static_cast<uint64_t>(4) * oldSelf.numCellsReserved >
+            std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Too many cells in contingency table.");
+
+        newNumCellsReserved = 2U * oldSelf.numCellsReserved;
+    }
+    mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+        dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(newNumCellsReserved));
+    rebind(newNumCellsReserved);
+    numCellsReserved = newNumCellsReserved;
+
+    uint32_t oldNumCells = oldSelf.numCells;
+    std::copy(oldSelf.rowValues, oldSelf.rowValues + oldNumCells, rowValues);
+    std::copy(oldSelf.colValues, oldSelf.colValues + oldNumCells, colValues);
+    std::copy(oldSelf.observed, oldSelf.observed + oldNumCells, observed);
+
+    // Rebuild the hash table, then insert the new cell
+    numCells = oldNumCells + 1;
+    rowValues[oldNumCells] = inRow;
+    colValues[oldNumCells] = inCol;
+    for (uint32_t idx = 0; idx < numCells; idx++)
+        slots[slotOfCell(static_cast<int32_t>(rowValues[idx]),
+            static_cast<int32_t>(colValues[idx]))] = idx + 1;
+
+    return oldNumCells;
+}
+
+AnyType
+chi2_independence_test_transition::run(AnyType &args) {
+    Chi2IndependenceTransitionState<MutableArrayHandle<double> > state
+        = args[0];
+    int32_t row = args[1].getAs<int32_t>();
+    int32_t col = args[2].getAs<int32_t>();
+    int64_t observed = args.numFields() <= 3 ? 1 : args[3].getAs<int64_t>();
+
+    if (observed < 0)
+        throw std::invalid_argument("Number of observations must be "
+            "nonnegative.");
+    // Cells without observations do not contribute to the contingency table.
+    // In particular, they must not introduce categories with zero marginals.
+    if (observed == 0)
+        return state;
+
+    state.observed[state.idxOfCell(*this, row, col)]
+        += static_cast<double>(observed);
+
+    return state;
+}
+
+AnyType
+chi2_independence_test_merge_states::run(AnyType &args) {
+    Chi2IndependenceTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    Chi2IndependenceTransitionState<ArrayHandle<double> > stateRight
+        = args[1];
+
+    // Merge states together and return
+    for (uint32_t idxRight = 0; idxRight < stateRight.numCells; idxRight++) {
+        uint32_t idxLeft = stateLeft.idxOfCell(*this,
+            static_cast<int32_t>(stateRight.rowValues[idxRight]),
+            static_cast<int32_t>(stateRight.colValues[idxRight]));
+        stateLeft.observed[idxLeft] += stateRight.observed[idxRight];
+    }
+
+    return stateLeft;
+}
+
+namespace {
+
+/**
+ * @brief Order cell indices by row category, then column category
+ */
+class CellLess {
+public:
+    CellLess(const double* inRowValues, const double* inColValues)
+      : mRowValues(inRowValues), mColValues(inColValues) { }
+
+    bool operator()(uint32_t inLeft, uint32_t inRight) const {
+        return mRowValues[inLeft] < mRowValues[inRight]
+            || (mRowValues[inLeft] == mRowValues[inRight]
+                && mColValues[inLeft] < mColValues[inRight]);
+    }
+
+private:
+    const double* mRowValues;
+    const double* mColValues;
+};
+
+} // anonymous namespace
+
+AnyType
+chi2_independence_test_final::run(AnyType &args) {
+    using boost::math::complement;
+
+    Chi2IndependenceTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.numCells == 0)
+        return Null();
+
+    // Cells are numbered in the order in which they were first seen, which
+    // depends on the data distribution. For reproducible results, we
+    // accumulate over the cells in the order of their categories.
+    std::vector<uint32_t> sortedIndices(state.numCells);
+    for (uint32_t idx = 0; idx < state.numCells; idx++)
+        sortedIndices[idx] = idx;
+    std::sort(sortedIndices.begin(), sortedIndices.end(),
+        CellLess(state.rowValues, state.colValues));
+
+    std::map<int32_t, double> rowTotals;
+    std::map<int32_t, double> colTotals;
+    double total = 0;
+    for (std::vector<uint32_t>::const_iterator it = sortedIndices.begin();
+        it != sortedIndices.end(); ++it) {
+
+        rowTotals[static_cast<int32_t>(state.rowValues[*it])]
+            += state.observed[*it];
+        colTotals[static_cast<int32_t>(state.colValues[*it])]
+            += state.observed[*it];
+        total += state.observed[*it];
+    }
+
+    // Cells that have not been seen have an observed count of 0, so they
+    // contribute their expected count to the statistic. Since the expected
+    // counts of all cells sum up to the total, we account for all these cells
+    // at once.
+    double statistic = 0;
+    double sum_expected_seen = 0;
+    for (std::vector<uint32_t>::const_iterator it = sortedIndices.begin();
+        it != sortedIndices.end(); ++it) {
+
+        double expected
+            = rowTotals[static_cast<int32_t>(state.rowValues[*it])]
+            * colTotals[static_cast<int32_t>(state.colValues[*it])] / total;
+        double diff = state.observed[*it] - expected;
+        statistic += diff * diff / expected;
+        sum_expected_seen += expected;
+    }
+    statistic += std::max(total - sum_expected_seen, 0.);
+
+    int64_t degreeOfFreedom
+        = static_cast<int64_t>(rowTotals.size() - 1)
+        * static_cast<int64_t>(colTotals.size() - 1);
+
+    // Phi coefficient
+    double phi = std::sqrt(statistic / total);
+
+    // Contingency coefficient
+    double C = std::sqrt(statistic / (total + statistic));
+
+    AnyType tuple;
+    tuple
+        << statistic
+        << (degreeOfFreedom > 0
+            ? prob::cdf(complement(prob::chi_squared(
+                static_cast<double>(degreeOfFreedom)), statistic))
+            : Null())
+        << degreeOfFreedom
+        << phi
+        << C;
+    return tuple;
+}
+
 } // namespace stats
 
 } // namespace modules
@@ -18,3 +18,18 @@ DECLARE_UDF(stats, chi2_gof_test_merge_states)
  * @brief Pearson's chi-squared test: Final function
  */
 DECLARE_UDF(stats, chi2_gof_test_final)
+
+/**
+ * @brief Pearson's chi-squared independence test: Transition function
+ */
+DECLARE_UDF(stats, chi2_independence_test_transition)
+
+/**
+ * @brief Pearson's chi-squared independence test: State merge function
+ */
+DECLARE_UDF(stats, chi2_independence_test_merge_states)
+
+/**
+ * @brief Pearson's chi-squared independence test: Final function
+ */
+DECLARE_UDF(stats, chi2_independence_test_final)
@@ -0,0 +1,118 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file covariance.cpp
+ *
+ * @brief Aggregates computing covariance and correlation matrices in a single
+ *     pass
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include "covariance_state.hpp"
+#include "covariance.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace stats {
+
+typedef CovarianceAccumulator<RootContainer> CovState;
+typedef CovarianceAccumulator<MutableRootContainer> MutableCovState;
+
+/**
+ * @brief Return a matrix as two-dimensional array
+ */
+static
+MutableArrayHandle<double>
+matrixToArray(const Allocator& inAllocator, const Matrix& inMatrix) {
+    MutableArrayHandle<double> result = inAllocator.allocateArray<double>(
+        inMatrix.cols(), inMatrix.rows());
+    std::copy(inMatrix.data(), inMatrix.data() + inMatrix.size(),
+        result.ptr());
+    return result;
+}
+
+AnyType
+covariance_transition::run(AnyType& args) {
+    MutableCovState state = args[0].getAs<MutableByteString>();
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+
+    state << x;
+    return state.storage();
+}
+
+AnyType
+covariance_merge_states::run(AnyType& args) {
+    MutableCovState stateLeft = args[0].getAs<MutableByteString>();
+    CovState stateRight = args[1].getAs<ByteString>();
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateRight.empty())
+        return stateLeft.storage();
+    else if (stateLeft.empty())
+        return stateRight.storage();
+
+    stateLeft << stateRight;
+    return stateLeft.storage();
+}
+
+/**
+ * @brief Return the sample covariance matrix
+ *
+ * As for covar_samp(), the result is NULL if there are fewer than two rows.
+ */
+AnyType
+covariance_matrix_final::run(AnyType& args) {
+    CovState state = args[0].getAs<ByteString>();
+
+    if (state.empty())
+        return Null();
+
+    ColumnVector mean;
+    Matrix M;
+    uint64_t n = state.unpack(mean, M);
+    if (n < 2)
+        return Null();
+
+    return matrixToArray(*this, M / static_cast<double>(n - 1));
+}
+
+/**
+ * @brief Return the correlation matrix
+ *
+ * As for corr(), the result is NULL if there are fewer than two rows. Entries
+ * in the row and column of a variable with zero variance are NaN.
+ */
+AnyType
+correlation_matrix_final::run(AnyType& args) {
+    CovState state = args[0].getAs<ByteString>();
+
+    if (state.empty())
+        return Null();
+
+    ColumnVector mean;
+    Matrix M;
+    uint64_t n = state.unpack(mean, M);
+    if (n < 2)
+        return Null();
+
+    ColumnVector scale(M.cols());
+    for (Index i = 0; i < M.cols(); ++i)
+        scale(i) = M(i, i) > 0
+            ? 1. / std::sqrt(M(i, i))
+            : std::numeric_limits<double>::quiet_NaN();
+    Matrix corr = scale.asDiagonal() * M * scale.asDiagonal();
+    for (Index i = 0; i < M.cols(); ++i)
+        if (M(i, i) > 0)
+            corr(i, i) = 1;
+    return matrixToArray(*this, corr);
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
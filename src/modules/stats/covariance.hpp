@@ -0,0 +1,25 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file covariance.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Covariance and correlation matrices: Transition function
+ */
+DECLARE_UDF(stats, covariance_transition)
+
+/**
+ * @brief Covariance and correlation matrices: State merge function
+ */
+DECLARE_UDF(stats, covariance_merge_states)
+
+/**
+ * @brief Covariance matrix: Final function
+ */
+DECLARE_UDF(stats, covariance_matrix_final)
+
+/**
+ * @brief Correlation matrix: Final function
+ */
+DECLARE_UDF(stats, correlation_matrix_final)
@@ -0,0 +1,255 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file covariance_state.hpp
+ *
+ * @brief Transition state for covariance matrices and PCA
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_MODULES_STATS_COVARIANCE_STATE_HPP
+#define MADLIB_MODULES_STATS_COVARIANCE_STATE_HPP
+
+#include <dbconnector/dbconnector.hpp>
+
+namespace madlib {
+
+namespace modules {
+
+namespace stats {
+
+// Use Eigen
+using namespace dbal;
+using namespace dbal::eigen_integration;
+
+/**
+ * @brief Transition state for covariance and correlation matrices
+ *
+ * The state keeps the number of rows \f$ n \f$, the mean
+ * \f$ \bar{\boldsymbol x} \f$, and the matrix of centered cross products
+ * \f$ M = \sum_{i=1}^n (\boldsymbol x_i - \bar{\boldsymbol x})
+ * (\boldsymbol x_i - \bar{\boldsymbol x})^T \f$, so the result remains
+ * accurate even if the means are large compared to the standard deviations.
+ * As in LinearRegressionAccumulator, only the upper triangle of \f$ M \f$ is
+ * stored (packed column by column), and rows are first buffered in a panel of
+ * at most \c kMaxPanelRows rows. A full panel is centered at its own mean and
+ * added with a single rank-k update, followed by the pairwise merge
+ * \f$ M \gets M + M_P + \frac{n k}{n + k} \boldsymbol\delta
+ * \boldsymbol\delta^T \f$, where \f$ M_P \f$ and \f$ k \f$ are the centered
+ * cross products and the number of rows of the panel, and
+ * \f$ \boldsymbol\delta \f$ is the difference of the means. States of
+ * different segments are merged in the same way.
+ */
+template <class Container>
+class CovarianceAccumulator
+  : public DynamicStruct<CovarianceAccumulator<Container>, Container> {
+public:
+    enum { isMutable = Container::isMutable };
+    enum { kMaxPanelRows = 16 };
+
+    MADLIB_DYNAMIC_STRUCT_TYPEDEFS(CovarianceAccumulator, Container)
+
+    CovarianceAccumulator(Init_type& inInitialization)
+      : Base(inInitialization) {
+
+        this->initialize();
+    }
+
+    /**
+     * @brief Bind all elements of the state to the data in the stream
+     *
+     * See LinearRegressionAccumulator::bind().
+     */
+    void bind(ByteStream_type& inStream) {
+        inStream >> numRows >> widthOfX >> numBufferedRows;
+        uint32_t actualWidthOfX = widthOfX.isNull()
+            ? 0
+            : static_cast<uint32_t>(widthOfX);
+        inStream
+            >> mean.rebind(actualWidthOfX)
+            >> M_packed.rebind(packedSize(actualWidthOfX))
+            >> X_panel.rebind(actualWidthOfX, panelRows(actualWidthOfX));
+    }
+
+    /**
+     * @brief Whether no row has been added yet
+     */
+    bool empty() const {
+        return widthOfX.isNull() || widthOfX == 0;
+    }
+
+    /**
+     * @brief Buffer a row, and add the panel once it is full
+     */
+    CovarianceAccumulator& operator<<(const MappedColumnVector& inX) {
+        if (!isfinite(inX))
+            throw std::domain_error("Input vector is not finite.");
+        else if (inX.size() == 0)
+            throw std::invalid_argument("Input vector must not be empty.");
+        else if (inX.size() > std::numeric_limits<uint32_t>::max())
+            throw std::domain_error("Number of variables cannot be larger "
+                "than 4294967295.");
+
+        // Initialize in first iteration
+        if (empty()) {
+            widthOfX = static_cast<uint32_t>(inX.size());
+            this->resize();
+        }
+
+        if (widthOfX != static_cast<uint32_t>(inX.size()))
+            throw std::invalid_argument("Inconsistent numbers of variables.");
+
+        X_panel.col(numBufferedRows) = inX;
+        numBufferedRows++;
+        if (numBufferedRows == panelRows(widthOfX))
+            flush();
+        return *this;
+    }
+
+    /**
+     * @brief Merge with another accumulation state
+     *
+     * The rows buffered in either state are added to this state. Both states
+     * must have the same number of variables.
+     */
+    template <class OtherContainer>
+    CovarianceAccumulator& operator<<(
+        const CovarianceAccumulator<OtherContainer>& inOther) {
+
+        if (widthOfX != static_cast<uint32_t>(inOther.widthOfX))
+            throw std::invalid_argument("Inconsistent numbers of variables.");
+
+        flush();
+        if (inOther.numRows > 0)
+            addCentered(inOther.numRows, inOther.mean, inOther.M_packed);
+        if (inOther.numBufferedRows > 0)
+            addPanel(inOther.X_panel, inOther.numBufferedRows);
+        return *this;
+    }
+
+    template <class OtherContainer>
+    CovarianceAccumulator& operator=(
+        const CovarianceAccumulator<OtherContainer>& inOther) {
+
+        this->copy(inOther);
+        return *this;
+    }
+
+    /**
+     * @brief Add all buffered rows to the mean and the cross products
+     */
+    void flush() {
+        if (numBufferedRows == 0)
+            return;
+
+        addPanel(X_panel, numBufferedRows);
+        numBufferedRows = 0;
+    }
+
+    /**
+     * @brief Expand the state into the mean and the full matrix of centered
+     *     cross products
+     *
+     * Buffered rows that have not been flushed yet are included.
+     *
+     * @return The total number of rows
+     */
+    uint64_t unpack(ColumnVector& outMean, Matrix& outM) const {
+        Index width = widthOfX;
+        uint64_t n = numRows;
+        uint32_t k = numBufferedRows;
+
+        outM.resize(width, width);
+        Index offset = 0;
+        for (Index j = 0; j < width; ++j) {
+            outM.col(j).head(j + 1) = M_packed.segment(offset, j + 1);
+            offset += j + 1;
+        }
+        outMean = mean;
+        if (k > 0) {
+            ColumnVector panelMean = X_panel.leftCols(k).rowwise().sum()
+                / static_cast<double>(k);
+            Matrix centered = X_panel.leftCols(k).colwise() - panelMean;
+            ColumnVector delta = panelMean - mean;
+            outM.triangularView<Eigen::Upper>()
+                += centered * trans(centered)
+                 + (static_cast<double>(n) * k / (n + k)) * delta
+                    * trans(delta);
+            outMean += (static_cast<double>(k) / (n + k)) * delta;
+        }
+        outM.triangularView<Eigen::StrictlyLower>() = trans(outM);
+        return n + k;
+    }
+
+    static Index panelRows(uint32_t inWidthOfX) {
+        return std::min<Index>(kMaxPanelRows, inWidthOfX);
+    }
+
+    static Index packedSize(uint32_t inWidthOfX) {
+        return static_cast<Index>(inWidthOfX)
+            * (static_cast<Index>(inWidthOfX) + 1) / 2;
+    }
+
+    uint64_type numRows;
+    uint32_type widthOfX;
+    uint32_type numBufferedRows;
+    MappedColumnVector_type mean;
+    MappedColumnVector_type M_packed;
+    MappedMatrix_type X_panel;
+
+private:
+    /**
+     * @brief Pairwise merge with the statistics of another set of rows
+     */
+    template <class MeanType, class PackedType>
+    void addCentered(uint64_t inNumRows, const MeanType& inMean,
+        const PackedType& inM_packed) {
+
+        Index width = widthOfX;
+        ColumnVector delta = inMean - mean;
+        double weight = static_cast<double>(numRows) * inNumRows
+            / (numRows + inNumRows);
+
+        M_packed.noalias() += inM_packed;
+        Index offset = 0;
+        for (Index j = 0; j < width; ++j) {
+            M_packed.segment(offset, j + 1) += (weight * delta(j))
+                * delta.head(j + 1);
+            offset += j + 1;
+        }
+        mean += (static_cast<double>(inNumRows) / (numRows + inNumRows))
+            * delta;
+        numRows += inNumRows;
+    }
+
+    /**
+     * @brief Add the first \c inNumRows columns of a panel
+     *
+     * The panel is centered at its own mean, and each column of the upper
+     * triangle of its cross products is computed with a single matrix-vector
+     * product, see LinearRegressionAccumulator::addPanel().
+     */
+    template <class PanelType>
+    void addPanel(const PanelType& inPanel, Index inNumRows) {
+        Index width = widthOfX;
+        ColumnVector panelMean = inPanel.leftCols(inNumRows).rowwise().sum()
+            / static_cast<double>(inNumRows);
+        Matrix centered = inPanel.leftCols(inNumRows).colwise() - panelMean;
+
+        ColumnVector panelM_packed(packedSize(width));
+        Index offset = 0;
+        for (Index j = 0; j < width; ++j) {
+            panelM_packed.segment(offset, j + 1).noalias()
+                = centered.topRows(j + 1) * trans(centered.row(j));
+            offset += j + 1;
+        }
+        addCentered(inNumRows, panelMean, panelM_packed);
+    }
+};
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_MODULES_STATS_COVARIANCE_STATE_HPP)
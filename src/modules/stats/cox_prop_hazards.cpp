@@ -32,23 +32,6 @@ AnyType stateToResult(const Allocator &inAllocator,
     double logLikelihood,
     double conditionNo);
 
-// Internal functions
-AnyType intermediate_stateToResult(
-		const HandleMap<const ColumnVector, TransparentHandle<double> >
-												& x,
-		const double inTimeDeath,
-		const double inExp_coef_x,
-		const HandleMap<const ColumnVector, TransparentHandle<double> >
-												& inCoef,
-		const HandleMap<const ColumnVector, TransparentHandle<double> >
-												& inX_exp_coef_x,
-		const HandleMap<const Matrix, TransparentHandle<double> >
-												& inX_xTrans_exp_coef_x
-		);
-
-
-
-
 /**
  * @brief Transition state for the Cox Proportional Hazards
  *
@@ -226,10 +209,13 @@ public:
  * Arguments (Matched with PSQL wrapped)
  * - 0: Current State
  * - 1: x
- * - 2: exp_coef_x
- * - 3: x_exp_coef_x value (Column Vector)
- * - 4: x_xTrans_exp_coef_x value (Matrix)
- * - 5: Previous State
+ * - 2: y
+ * - 3: Previous State
+ *
+ * Rows must be passed in descending order of y. The state then accumulates
+ * the sums over the risk set (all rows with time at least y) as it goes, and
+ * the terms exp(coef * x), x * exp(coef * x) and x * x^T * exp(coef * x) are
+ * computed from the coefficients of the previous state on the fly.
 */
 
 AnyType cox_prop_hazards_step_transition::run(AnyType &args) {
@@ -238,26 +224,34 @@ AnyType cox_prop_hazards_step_transition::run(AnyType &args) {
 		CoxPropHazardsTransitionState<MutableArrayHandle<double> > state = args[0];
     MappedColumnVector x = args[1].getAs<MappedColumnVector>();
     double y = args[2].getAs<double>();
-		
-		/** Note: These precomputations come from "intermediate_cox_prop_hazards".
-			They are precomputed and stored in a temporary table.
-		*/
-    double exp_coef_x = args[3].getAs<double>();
-    MappedColumnVector x_exp_coef_x = args[4].getAs<MappedColumnVector>();
-    MappedMatrix x_xTrans_exp_coef_x = args[5].getAs<MappedMatrix>();
-		
+
+    // The following check was added with MADLIB-138.
+    if (!isfinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+
     if (state.numRows == 0) {
+        if (x.size() > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of independent variables cannot be "
+                "larger than 65535.");
+
 			state.initialize(*this, static_cast<uint16_t>(x.size()));
 			
-			if (!args[6].isNull()) {
+			if (!args[3].isNull()) {
 					CoxPropHazardsTransitionState<ArrayHandle<double> > previousState
-																																		= args[6];
+																																		= args[3];
 					state = previousState;
 					state.reset();
 					
 			}
 						
-		}
+		} else if (x.size() != state.widthOfX) {
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+    }
+
+    // The coefficients are those of the previous iteration (or 0 in the first
+    // iteration)
+    double exp_coef_x = std::exp(trans(state.coef) * x);
 
     state.numRows++;
 		
@@ -292,8 +286,9 @@ AnyType cox_prop_hazards_step_transition::run(AnyType &args) {
 				Note: See design documentation for details on the implementation.
 		*/
 		state.S += exp_coef_x;
-		state.H += x_exp_coef_x;
-		state.V += x_xTrans_exp_coef_x;
+		state.H += exp_coef_x * x;
+		// Only the lower triangle of V is used for the hessian
+		triangularView<Lower>(state.V) += x * trans(x) * exp_coef_x;
 		state.grad += x;
 		state.logLikelihood += std::log(exp_coef_x);
 		state.y_previous = y;
@@ -302,6 +297,226 @@ AnyType cox_prop_hazards_step_transition::run(AnyType &args) {
 }
 
 
+/**
+ * @brief Transition state for the per-time sums of Cox Proportional Hazards
+ *
+ * A bucket holds the sums over all rows with the same time of death. Unlike
+ * the risk-set sums in CoxPropHazardsTransitionState, these sums do not depend
+ * on the order of the rows, so buckets can be computed on all segments in
+ * parallel (e.g., with <tt>GROUP BY</tt> time) and merged by simple addition.
+ *
+ * Array layout:
+ * - 0: numRows (number of rows in the bucket, i.e., number of deaths)
+ * - 1: widthOfX (number of features)
+ * - 2: S (sum of exp(coef * x))
+ * - 3: coef (coefficients of the previous iteration)
+ * - 3 + widthOfX: sumX (sum of x)
+ * - 3 + 2*widthOfX: H (sum of x * exp(coef * x))
+ * - 3 + 3*widthOfX: V (sum of x * x^T * exp(coef * x), lower triangle only)
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 3, and all elements are 0.
+ */
+template <class Handle>
+class CoxPropHazardsBucketState {
+
+    template <class OtherHandle>
+    friend class CoxPropHazardsBucketState;
+
+public:
+    CoxPropHazardsBucketState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint16_t>(mStorage[1]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the bucket. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint16_t inWidthOfX) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inWidthOfX));
+        rebind(inWidthOfX);
+        widthOfX = inWidthOfX;
+    }
+
+    /**
+     * @brief Merge with another bucket of the same time
+     */
+    template <class OtherHandle>
+    CoxPropHazardsBucketState &operator+=(
+        const CoxPropHazardsBucketState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            widthOfX != inOtherState.widthOfX)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        S += inOtherState.S;
+        sumX += inOtherState.sumX;
+        H += inOtherState.H;
+        V += inOtherState.V;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(const uint16_t inWidthOfX) {
+        return 3 + 3 * inWidthOfX + inWidthOfX * inWidthOfX;
+    }
+
+    void rebind(uint16_t inWidthOfX) {
+        numRows.rebind(&mStorage[0]);
+        widthOfX.rebind(&mStorage[1]);
+        S.rebind(&mStorage[2]);
+        coef.rebind(&mStorage[3], inWidthOfX);
+        sumX.rebind(&mStorage[3 + inWidthOfX], inWidthOfX);
+        H.rebind(&mStorage[3 + 2 * inWidthOfX], inWidthOfX);
+        V.rebind(&mStorage[3 + 3 * inWidthOfX], inWidthOfX, inWidthOfX);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt16 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToDouble S;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap coef;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap sumX;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap H;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap V;
+};
+
+/**
+ * @brief Transition step for the per-time sums of Cox Proportional Hazards
+ *
+ * Arguments (Matched with PSQL wrapped)
+ * - 0: Current State
+ * - 1: x
+ * - 2: Previous State (of the Newton iteration)
+ */
+AnyType cox_prop_hazards_bucket_transition::run(AnyType &args) {
+    CoxPropHazardsBucketState<MutableArrayHandle<double> > state = args[0];
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+
+    // The following check was added with MADLIB-138.
+    if (!isfinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+
+    if (state.numRows == 0) {
+        if (x.size() > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of independent variables cannot be "
+                "larger than 65535.");
+
+        state.initialize(*this, static_cast<uint16_t>(x.size()));
+        if (!args[2].isNull()) {
+            CoxPropHazardsTransitionState<ArrayHandle<double> > previousState
+                = args[2];
+            state.coef = previousState.coef;
+        }
+    } else if (x.size() != state.widthOfX) {
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+    }
+
+    double exp_coef_x = std::exp(trans(state.coef) * x);
+
+    state.numRows++;
+    state.S += exp_coef_x;
+    state.sumX += x;
+    state.H += exp_coef_x * x;
+    triangularView<Lower>(state.V) += x * trans(x) * exp_coef_x;
+
+    return state;
+}
+
+/**
+ * @brief Merge the per-time sums computed on different segments
+ */
+AnyType cox_prop_hazards_bucket_merge_states::run(AnyType &args) {
+    CoxPropHazardsBucketState<MutableArrayHandle<double> > stateLeft = args[0];
+    CoxPropHazardsBucketState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Newton method transition step for Cox Proportional Hazards over
+ *     per-time sums
+ *
+ * Arguments (Matched with PSQL wrapped)
+ * - 0: Current State
+ * - 1: Bucket (per-time sums, see CoxPropHazardsBucketState)
+ * - 2: y (time of death of the bucket)
+ * - 3: Previous State
+ *
+ * Buckets must be passed in descending order of y. This is the same as
+ * cox_prop_hazards_step_transition with all rows of a bucket passed at once:
+ * The running sums of the state are the prefix offsets that turn the
+ * per-time sums into risk-set sums. Since there is only one bucket per
+ * distinct time, this ordered step is cheap even on large inputs.
+ */
+AnyType cox_prop_hazards_step_bucketed_transition::run(AnyType &args) {
+    CoxPropHazardsTransitionState<MutableArrayHandle<double> > state = args[0];
+    CoxPropHazardsBucketState<ArrayHandle<double> > bucket = args[1];
+    double y = args[2].getAs<double>();
+
+    if (bucket.numRows == 0)
+        return state;
+
+    if (state.numRows == 0) {
+        state.initialize(*this, bucket.widthOfX);
+
+        if (!args[3].isNull()) {
+            CoxPropHazardsTransitionState<ArrayHandle<double> > previousState
+                = args[3];
+            state = previousState;
+            state.reset();
+        }
+    } else if (bucket.widthOfX != state.widthOfX) {
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+    }
+
+    bool isFirst = (state.numRows == 0);
+    state.numRows += bucket.numRows;
+
+    // Same handling of ties as in cox_prop_hazards_step_transition, with a
+    // bucket counting as bucket.numRows rows of the same time
+    if (std::abs(y - state.y_previous) < 1.0e-6 || isFirst) {
+        state.multiplier += static_cast<double>(bucket.numRows);
+    } else {
+        state.grad -= state.multiplier*state.H/state.S;
+        triangularView<Lower>(state.hessian) -=
+            ((state.H*trans(state.H))/(state.S*state.S)
+                - state.V/state.S)*state.multiplier;
+        state.logLikelihood -= state.multiplier*std::log(state.S);
+        state.multiplier = static_cast<double>(bucket.numRows);
+    }
+
+    state.S += bucket.S;
+    state.H += bucket.H;
+    state.V += bucket.V;
+    state.grad += bucket.sumX;
+    // Sum of log(exp(coef * x)) over all rows of the bucket
+    state.logLikelihood += state.coef.dot(bucket.sumX);
+    state.y_previous = y;
+
+    return state;
+}
+
 /**
  * @brief Newton method final step for Cox Proportional Hazards
  *
@@ -401,58 +616,6 @@ AnyType stateToResult(
 
 
 
-/**
- * @brief Newton method transition step for Cox Proportional Hazards
- *
- * @param args
- *
- * Arguments (Matched with PSQL wrapped)
- * - 1: X value (Column Vector)
- * - 2: coef value (Column Vector)
-*/
-
-AnyType intermediate_cox_prop_hazards::run(AnyType &args) {
-
-    MappedColumnVector x = args[0].getAs<MappedColumnVector>();
-		MutableMappedColumnVector coef(allocateArray<double>(x.size()));
-		
-    // The following check was added with MADLIB-138.
-    if (!isfinite(x))
-        throw std::domain_error("Design matrix is not finite.");
-
-		if (x.size() > std::numeric_limits<uint16_t>::max())
-				throw std::domain_error("Number of independent variables cannot be "
-						"larger than 65535.");
-
-		if (args[1].isNull()) {
-			for (int i=0; i<x.size() ; i++)
-				coef(i) = 0;
-		}
-		else {
-			coef = args[1].getAs<MappedColumnVector>();
-		}
-		
-		double exp_coef_x;
-		MutableMappedColumnVector
-			x_exp_coef_x(allocateArray<double>(x.size()));
-		MutableMappedMatrix
-			x_xTrans_exp_coef_x(allocateArray<double>(x.size(), x.size()));							
-
-		exp_coef_x = std::exp(trans(coef)*x);
-		x_exp_coef_x = exp_coef_x*x;
-		x_xTrans_exp_coef_x = x * trans(x) * exp_coef_x;
-		
-    AnyType tuple;
-		tuple << x
-					<< exp_coef_x
-					<< x_exp_coef_x
-					<< x_xTrans_exp_coef_x;
-		
-    return tuple;
-
-}
-
-
 } // namespace stats
 
 } // namespace modules
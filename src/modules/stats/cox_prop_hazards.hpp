@@ -9,6 +9,21 @@
  */
 DECLARE_UDF(stats, cox_prop_hazards_step_transition)
 
+/**
+ * @brief Cox Proportional Hazards: Transition function for per-time sums
+ */
+DECLARE_UDF(stats, cox_prop_hazards_bucket_transition)
+
+/**
+ * @brief Cox Proportional Hazards: Merge function for per-time sums
+ */
+DECLARE_UDF(stats, cox_prop_hazards_bucket_merge_states)
+
+/**
+ * @brief Cox Proportional Hazards: Transition function over per-time sums
+ */
+DECLARE_UDF(stats, cox_prop_hazards_step_bucketed_transition)
+
 /**
  * @brief Cox proportional Hazards: Final function
  */
@@ -23,8 +38,3 @@ DECLARE_UDF(stats, internal_cox_prop_hazards_result)
  * @brief Cox proportional Hazards: Step Distance
  */
 DECLARE_UDF(stats, internal_cox_prop_hazards_step_distance)
-
-/**
- * @brief Intermadiate Cox Proportional Hazard computation: Intermadiate Results
- */
-DECLARE_UDF(stats, intermediate_cox_prop_hazards)
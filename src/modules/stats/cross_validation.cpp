@@ -0,0 +1,313 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file cross_validation.cpp
+ *
+ * @brief K-fold cross-validation of linear regression in a single pass
+ *
+ * Every row is assigned to one of K folds by a hash of the seed and the row
+ * identifier. The transition state keeps the sufficient statistics of every
+ * fold separately. The training statistics of fold k are those of all rows
+ * minus those of fold k, and the holdout error of fold k follows from the
+ * sums of fold k alone. K-fold cross-validation therefore takes one scan,
+ * instead of K training runs on materialized fold tables.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <modules/shared/RowHash.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cross_validation.hpp"
+#include "linregr_replicate.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace stats {
+
+/**
+ * @brief Transition state keeping one accumulator per cross-validation fold
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * numFolds, seed, width, followed by numFolds accumulators of type
+ * LinearRegressionReplicate.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0.
+ */
+template <class Handle>
+class CrossValidationTransitionState {
+    template <class OtherHandle>
+    friend class CrossValidationTransitionState;
+
+public:
+    CrossValidationTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]),
+            static_cast<uint32_t>(mStorage[2]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return numFolds > 0;
+    }
+
+    /**
+     * @brief Make sure that the parameters are the same as for all other rows
+     */
+    void initializeOrCheck(const Allocator &inAllocator, int32_t inNumFolds,
+        int64_t inSeed, uint32_t inWidth) {
+
+        if (!isInitialized()) {
+            if (inNumFolds < 2)
+                throw std::invalid_argument("Number of folds must be at "
+                    "least 2.");
+            mStorage = inAllocator.allocateArray<double,
+                dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                    arraySize(static_cast<uint32_t>(inNumFolds), inWidth));
+            rebind(static_cast<uint32_t>(inNumFolds), inWidth);
+            numFolds = static_cast<uint32_t>(inNumFolds);
+            seed = static_cast<double>(inSeed);
+            width = inWidth;
+        } else if (static_cast<uint32_t>(inNumFolds) != numFolds
+            || static_cast<double>(inSeed) != seed)
+            throw std::invalid_argument("Number of folds and seed must not "
+                "change during aggregation.");
+        else if (inWidth != width)
+            throw std::invalid_argument("Inconsistent numbers of independent "
+                "variables.");
+    }
+
+    /**
+     * @brief Add a row to the accumulator of its fold
+     */
+    void add(int64_t inIdentifier, const ColumnVector &inContributions) {
+        uint32_t k = crossValidationFold(
+            static_cast<uint64_t>(static_cast<int64_t>(seed)), inIdentifier,
+            numFolds);
+        LinearRegressionReplicate::add(fold(k), width, 1, inContributions);
+    }
+
+    /**
+     * @brief Merge with another state object
+     */
+    template <class OtherHandle>
+    CrossValidationTransitionState &operator+=(
+        const CrossValidationTransitionState<OtherHandle> &inOther) {
+
+        if (numFolds != inOther.numFolds || seed != inOther.seed)
+            throw std::invalid_argument("Number of folds and seed must not "
+                "change during aggregation.");
+        if (width != inOther.width)
+            throw std::invalid_argument("Inconsistent numbers of independent "
+                "variables.");
+
+        for (uint32_t k = 0; k < numFolds; k++)
+            LinearRegressionReplicate::merge(fold(k), width,
+                inOther.fold(k));
+        return *this;
+    }
+
+    const double *fold(uint32_t inIndex) const {
+        return folds + inIndex * LinearRegressionReplicate::size(width);
+    }
+
+    double *fold(uint32_t inIndex) {
+        return folds + inIndex * LinearRegressionReplicate::size(width);
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inNumFolds, uint32_t inWidth) {
+        return 3 + static_cast<size_t>(inNumFolds)
+            * LinearRegressionReplicate::size(inWidth);
+    }
+
+    void rebind(uint32_t inNumFolds, uint32_t inWidth) {
+        madlib_assert(mStorage.size() >= arraySize(inNumFolds, inWidth)
+            || inNumFolds == 0,
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        numFolds.rebind(&mStorage[0]);
+        seed.rebind(&mStorage[1]);
+        width.rebind(&mStorage[2]);
+        // See BootstrapTransitionState::rebind()
+        folds = mStorage.ptr() + 3;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numFolds;
+    typename HandleTraits<Handle>::ReferenceToDouble seed;
+    typename HandleTraits<Handle>::ReferenceToUInt32 width;
+
+private:
+    typename HandleTraits<Handle>::DoublePtr folds;
+};
+
+typedef CrossValidationTransitionState<MutableArrayHandle<double> >
+    MutableLinRegrCVState;
+typedef CrossValidationTransitionState<ArrayHandle<double> >
+    LinRegrCVState;
+
+/**
+ * @brief Return the fold of a row, as used by all cross-validation functions
+ *
+ * Folds are numbered from 1, like the inner arrays of the results.
+ */
+AnyType
+cross_validation_fold::run(AnyType &args) {
+    int64_t identifier = args[0].getAs<int64_t>();
+    int32_t numFolds = args[1].getAs<int32_t>();
+    int64_t seed = args[2].getAs<int64_t>();
+
+    if (numFolds < 2)
+        throw std::invalid_argument("Number of folds must be at least 2.");
+
+    return static_cast<int32_t>(crossValidationFold(
+        static_cast<uint64_t>(seed), identifier,
+        static_cast<uint32_t>(numFolds)) + 1);
+}
+
+/**
+ * @brief Perform the transition step of the cross-validation of linear
+ *     regression
+ */
+AnyType
+linregr_cv_transition::run(AnyType &args) {
+    MutableLinRegrCVState state = args[0];
+    double y = args[1].getAs<double>();
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+    int64_t identifier = args[3].getAs<int64_t>();
+
+    if (!std::isfinite(y))
+        throw std::domain_error("Dependent variables are not finite.");
+    else if (!isfinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+    else if (x.size() == 0)
+        throw std::invalid_argument("Number of independent variables must be "
+            "positive.");
+
+    state.initializeOrCheck(*this, args[4].getAs<int32_t>(),
+        args[5].getAs<int64_t>(), static_cast<uint32_t>(x.size()));
+
+    ColumnVector contributions;
+    linregrContributions(y, x, contributions);
+    state.add(identifier, contributions);
+    return state;
+}
+
+/**
+ * @brief Merge two transition states of the cross-validation of linear
+ *     regression
+ */
+AnyType
+linregr_cv_merge_states::run(AnyType &args) {
+    MutableLinRegrCVState stateLeft = args[0];
+    LinRegrCVState stateRight = args[1];
+
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    else if (!stateRight.isInitialized())
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step of the cross-validation of linear regression
+ *
+ * The model of fold \f$ k \f$ is fitted to the sums of all other folds. Its
+ * holdout sum of squared errors follows from the sums of fold \f$ k \f$:
+ * \f$ \boldsymbol y_k^T \boldsymbol y_k - 2 \boldsymbol c^T X_k^T
+ * \boldsymbol y_k + \boldsymbol c^T X_k^T X_k \boldsymbol c \f$.
+ *
+ * Returns the composite linregr_cv_result: the coefficients of all fold
+ * models as a two-dimensional array with one inner array per fold, the
+ * holdout mean squared errors of all folds, the overall cross-validation
+ * mean squared error (the total holdout squared error divided by the number
+ * of rows), and the number of folds. Folds without rows have an undefined
+ * holdout error and do not count for the overall error.
+ */
+AnyType
+linregr_cv_final::run(AnyType &args) {
+    LinRegrCVState state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    uint32_t K = state.numFolds;
+    uint32_t p = state.width;
+    Index size = static_cast<Index>(LinearRegressionReplicate::size(p));
+    Index packedSize = static_cast<Index>(
+        regress::LinearRegressionAccumulator<RootContainer>::packedSize(p));
+
+    ColumnVector total = ColumnVector::Zero(size);
+    for (uint32_t k = 0; k < K; k++)
+        total += Eigen::Map<const ColumnVector>(state.fold(k), size);
+
+    Allocator &allocator = defaultAllocator();
+    MutableArrayHandle<double> coef = allocator.allocateArray<double>(K, p);
+    MutableMappedColumnVector mse(allocator.allocateArray<double>(K));
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    double totalSquaredError = 0;
+    double totalNumRows = 0;
+    ColumnVector training(size);
+    Matrix X_transp_X;
+    for (uint32_t k = 0; k < K; k++) {
+        Eigen::Map<const ColumnVector> holdout(state.fold(k), size);
+        training = total - holdout;
+        Eigen::Map<ColumnVector> c(coef.ptr() + static_cast<size_t>(k) * p,
+            p);
+        LinearRegressionReplicate::statistics(training.data(), p, c.data());
+
+        if (holdout(0) <= 0 || !isfinite(c)) {
+            mse(k) = nan;
+            continue;
+        }
+
+        regress::unpackUpperTriangle(holdout.segment(3 + p, packedSize), p,
+            X_transp_X);
+        X_transp_X.triangularView<Eigen::StrictlyLower>()
+            = trans(X_transp_X);
+        double squaredError = holdout(2)
+            - 2 * dot(c, holdout.segment(3, p))
+            + dot(c, X_transp_X * c);
+        // Rounding errors may make the difference slightly negative
+        squaredError = std::max(squaredError, 0.);
+
+        mse(k) = squaredError / holdout(0);
+        totalSquaredError += squaredError;
+        totalNumRows += holdout(0);
+    }
+
+    AnyType tuple;
+    tuple
+        << coef
+        << mse
+        << (totalNumRows > 0 ? totalSquaredError / totalNumRows : nan)
+        << static_cast<int32_t>(K);
+    return tuple;
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,25 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file cross_validation.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Cross-validation: Fold of a row
+ */
+DECLARE_UDF(stats, cross_validation_fold)
+
+/**
+ * @brief Cross-validation of linear regression: Transition function
+ */
+DECLARE_UDF(stats, linregr_cv_transition)
+
+/**
+ * @brief Cross-validation of linear regression: State merge function
+ */
+DECLARE_UDF(stats, linregr_cv_merge_states)
+
+/**
+ * @brief Cross-validation of linear regression: Final function
+ */
+DECLARE_UDF(stats, linregr_cv_final)
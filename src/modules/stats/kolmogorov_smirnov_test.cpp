@@ -11,6 +11,7 @@
 #include <modules/prob/kolmogorov.hpp>
 
 #include "kolmogorov_smirnov_test.hpp"
+#include "sorted_runs.hpp"
 
 namespace madlib {
 
@@ -52,53 +53,39 @@ public:
 };
 
 /**
- * @brief Perform the Kolmogorov-Smirnov-test transition step
+ * @brief Update the state with the next value in ascending order
  */
-AnyType
-ks_test_transition::run(AnyType &args) {
-    KSTestTransitionState<MutableArrayHandle<double> > state = args[0];
-    int sample = args[1].getAs<bool>() ? 0 : 1;
-    double value = args[2].getAs<double>();
-    Eigen::Vector2d expectedNum;
-        expectedNum << static_cast<double>(args[3].getAs<int64_t>()),
-                       static_cast<double>(args[4].getAs<int64_t>());
-
-    if (state.expectedNum != expectedNum) {
-        if (state.num.sum() > 0)
-            throw std::invalid_argument("Number of samples must be constant "
-                "parameters.");
-
-        state.expectedNum = expectedNum;
-    }
+template <class Handle>
+void
+ksTestAdvance(KSTestTransitionState<Handle> &ioState, int inSample,
+    double inValue) {
 
-    if (state.num.sum() > 0) {
-        // It might actually be faster if (state.num.sum() > 0) was instead moved
-        // to the end of both of the following two if-clauses (as it is a rare
-        // condition). But we go for readability here.
+    if (ioState.num.sum() > 0) {
+        // It might actually be faster if (ioState.num.sum() > 0) was instead
+        // moved to the end of both of the following two if-clauses (as it is a
+        // rare condition). But we go for readability here.
 
-        if (state.last > value)
+        if (ioState.last > inValue)
             throw std::invalid_argument("Must be used as an ordered "
                 "aggregate, in ascending order of the second argument.");
-        else if (state.last < value && state.maxDiff < state.lastDiff)
+        else if (ioState.last < inValue && ioState.maxDiff < ioState.lastDiff)
             // We have seen the end of a group of ties, so we may now compare
             // the empirical distribution functions (conceptually, we are
             // evaluating the two empricical distribution functions at
-            // state.last).
+            // ioState.last).
             // Note: We must wait till we have seen all rows of a group of ties.
             // (See also MADLIB-554).
-            state.maxDiff = state.lastDiff;
+            ioState.maxDiff = ioState.lastDiff;
     }
-    state.num(sample)++;
-    state.last = value;
+    ioState.num(inSample)++;
+    ioState.last = inValue;
 
-    state.lastDiff = std::fabs(state.num(0) / state.expectedNum(0)
-                    - state.num(1) / state.expectedNum(1));
-
-    return state;
+    ioState.lastDiff = std::fabs(ioState.num(0) / ioState.expectedNum(0)
+                    - ioState.num(1) / ioState.expectedNum(1));
 }
 
 /**
- * @brief Perform the Kolmogorov-Smirnov-test final step
+ * @brief Compute the test result from a state that has seen all values
  *
  * Define \f$ N := \frac{n_1 n_2}{n_1 + n_2} \f$ and
  * \f$ D := \max_x |F_1(x) - F_2(x)| \f$ where
@@ -117,36 +104,128 @@ ks_test_transition::run(AnyType &args) {
  * Statistics Without Extensive Tables", Journal of the Royal Statistical
  * Society. Series B (Methodological), Vol. 32, No. 1. (1970), pp. 115-122.
  */
+template <class Handle>
 AnyType
-ks_test_final::run(AnyType &args) {
+ksTestResult(const KSTestTransitionState<Handle> &inState) {
     using boost::math::complement;
 
-    KSTestTransitionState<ArrayHandle<double> > state = args[0];
-
-    if (state.num != state.expectedNum) {
+    if (inState.num != inState.expectedNum) {
         std::stringstream tmp;
         tmp << "Actual sample sizes differ from specified sizes. "
                 "Actual/specified: "
-            << uint64_t(state.num(0)) << "/" << uint64_t(state.expectedNum(0))
+            << uint64_t(inState.num(0)) << "/"
+            << uint64_t(inState.expectedNum(0))
             << " and "
-            << uint64_t(state.num(1)) << "/" << uint64_t(state.expectedNum(1));
+            << uint64_t(inState.num(1)) << "/"
+            << uint64_t(inState.expectedNum(1));
         throw std::invalid_argument(tmp.str());
     }
 
-    // Note that at this point we also have state.lastDiff == 0 and thus
-    // state.lastDiff <= state.maxDiff.
+    // Note that at this point we also have inState.lastDiff == 0 and thus
+    // inState.lastDiff <= inState.maxDiff.
 
-    double root = std::sqrt(state.num.prod() / state.num.sum());
-    double kolmogorov_statistic = (root + 0.12 + 0.11 / root) * state.maxDiff;
+    double root = std::sqrt(inState.num.prod() / inState.num.sum());
+    double kolmogorov_statistic
+        = (root + 0.12 + 0.11 / root) * inState.maxDiff;
 
     AnyType tuple;
     tuple
-        << static_cast<double>(state.maxDiff) // The Kolmogorov-Smirnov statistic
+        << static_cast<double>(inState.maxDiff) // The Kolmogorov-Smirnov statistic
         << kolmogorov_statistic
         << prob::cdf(complement(prob::kolmogorov(), kolmogorov_statistic));
     return tuple;
 }
 
+/**
+ * @brief Perform the Kolmogorov-Smirnov-test transition step
+ */
+AnyType
+ks_test_transition::run(AnyType &args) {
+    KSTestTransitionState<MutableArrayHandle<double> > state = args[0];
+    int sample = args[1].getAs<bool>() ? 0 : 1;
+    double value = args[2].getAs<double>();
+    Eigen::Vector2d expectedNum;
+        expectedNum << static_cast<double>(args[3].getAs<int64_t>()),
+                       static_cast<double>(args[4].getAs<int64_t>());
+
+    if (state.expectedNum != expectedNum) {
+        if (state.num.sum() > 0)
+            throw std::invalid_argument("Number of samples must be constant "
+                "parameters.");
+
+        state.expectedNum = expectedNum;
+    }
+
+    ksTestAdvance(state, sample, value);
+    return state;
+}
+
+/**
+ * @brief Perform the Kolmogorov-Smirnov-test final step
+ *
+ * @see ksTestResult()
+ */
+AnyType
+ks_test_final::run(AnyType &args) {
+    KSTestTransitionState<ArrayHandle<double> > state = args[0];
+
+    return ksTestResult(state);
+}
+
+/**
+ * @brief Perform the transition step of the Kolmogorov-Smirnov test on
+ *     unordered input
+ *
+ * Each record consists of the value and the sample (0 for the first, 1 for
+ * the second sample).
+ */
+AnyType
+ks_test_parallel_transition::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 2> state = args[0];
+    double record[2] = {
+        args[2].getAs<double>(),
+        args[1].getAs<bool>() ? 0. : 1.
+    };
+
+    state.append(*this, record);
+    return state;
+}
+
+/**
+ * @brief Merge the sorted runs of two transition states
+ */
+AnyType
+ks_test_parallel_merge_states::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 2> stateLeft
+        = args[0];
+    SortedRunsTransitionState<ArrayHandle<double>, 2> stateRight = args[1];
+
+    stateLeft.merge(*this, stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step of the Kolmogorov-Smirnov test on unordered
+ *     input
+ *
+ * Once all records are sorted, we know the sample sizes and can simply replay
+ * the records through the ordered transition step.
+ */
+AnyType
+ks_test_parallel_final::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 2> runs = args[0];
+    runs.sort();
+
+    KSTestTransitionState<MutableArrayHandle<double> > state
+        = AnyType(allocateArray<double>(7));
+    for (uint64_t i = 0; i < runs.numRecords; i++)
+        state.expectedNum(static_cast<int>(runs[i][1]))++;
+    for (uint64_t i = 0; i < runs.numRecords; i++)
+        ksTestAdvance(state, static_cast<int>(runs[i][1]), runs[i][0]);
+
+    return ksTestResult(state);
+}
+
 } // namespace stats
 
 } // namespace modules
@@ -13,3 +13,18 @@ DECLARE_UDF(stats, ks_test_transition)
  * @brief Kolmogorov-Smirnov Test: Final function
  */
 DECLARE_UDF(stats, ks_test_final)
+
+/**
+ * @brief Kolmogorov-Smirnov Test on unordered input: Transition function
+ */
+DECLARE_UDF(stats, ks_test_parallel_transition)
+
+/**
+ * @brief Kolmogorov-Smirnov Test on unordered input: Merge function
+ */
+DECLARE_UDF(stats, ks_test_parallel_merge_states)
+
+/**
+ * @brief Kolmogorov-Smirnov Test on unordered input: Final function
+ */
+DECLARE_UDF(stats, ks_test_parallel_final)
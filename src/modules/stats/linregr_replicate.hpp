@@ -0,0 +1,123 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file linregr_replicate.hpp
+ *
+ * @brief Sufficient statistics of linear regression, with integer row weights
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_MODULES_STATS_LINREGR_REPLICATE_HPP
+#define MADLIB_MODULES_STATS_LINREGR_REPLICATE_HPP
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/regress/LinearRegression_proto.hpp>
+#include <modules/regress/LinearRegression_impl.hpp>
+
+#include <limits>
+
+namespace madlib {
+
+namespace modules {
+
+namespace stats {
+
+// Use Eigen
+using namespace dbal;
+using namespace dbal::eigen_integration;
+
+/**
+ * @brief Replicate accumulator for the coefficients of linear regression
+ *
+ * The accumulator holds the same sums as LinearRegressionAccumulator: the
+ * (weighted) number of rows, \f$ \sum_i y_i \f$, \f$ \sum_i y_i^2 \f$,
+ * \f$ X^T \boldsymbol y \f$, and the packed upper triangle of \f$ X^T X \f$.
+ * All of them are linear in the weights, so a row is first expanded into
+ * the vector of its contributions (see linregrContributions()), which is then
+ * added with the weight of each replicate. The outer product of a row is
+ * thus computed only once, not once per replicate.
+ *
+ * Statistics: the regression coefficients.
+ */
+struct LinearRegressionReplicate {
+    typedef ColumnVector row_type;
+
+    static size_t size(uint32_t inWidth) {
+        return 3 + inWidth + static_cast<size_t>(
+            regress::LinearRegressionAccumulator<RootContainer>::packedSize(
+                inWidth));
+    }
+
+    static uint32_t numStatistics(uint32_t inWidth) {
+        return inWidth;
+    }
+
+    static void add(double *ioReplicate, uint32_t inWidth, uint32_t inWeight,
+        const row_type &inContributions) {
+
+        Eigen::Map<ColumnVector> replicate(ioReplicate,
+            static_cast<Index>(size(inWidth)));
+        replicate += static_cast<double>(inWeight) * inContributions;
+    }
+
+    static void merge(double *ioReplicate, uint32_t inWidth,
+        const double *inOther) {
+
+        Index n = static_cast<Index>(size(inWidth));
+        Eigen::Map<ColumnVector>(ioReplicate, n)
+            += Eigen::Map<const ColumnVector>(inOther, n);
+    }
+
+    static void statistics(const double *inReplicate, uint32_t inWidth,
+        double *outStatistics) {
+
+        Index p = inWidth;
+        Eigen::Map<ColumnVector> coef(outStatistics, p);
+        if (inReplicate[0] <= 0) {
+            coef.fill(std::numeric_limits<double>::quiet_NaN());
+            return;
+        }
+
+        Eigen::Map<const ColumnVector> X_transp_Y(inReplicate + 3, p);
+        Eigen::Map<const ColumnVector> X_transp_X_packed(inReplicate + 3 + p,
+            regress::LinearRegressionAccumulator<RootContainer>::packedSize(
+                inWidth));
+        Matrix X_transp_X;
+        regress::unpackUpperTriangle(X_transp_X_packed, p, X_transp_X);
+        X_transp_X.triangularView<Eigen::StrictlyLower>()
+            = trans(X_transp_X);
+
+        SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+            X_transp_X, EigenvaluesOnly, ComputeSolver);
+        coef = decomposition.solve(X_transp_Y);
+    }
+};
+
+/**
+ * @brief Expand a row into its contributions to a LinearRegressionReplicate
+ */
+inline
+void
+linregrContributions(double inY, const MappedColumnVector &inX,
+    ColumnVector &outContributions) {
+
+    Index p = inX.size();
+    outContributions.resize(LinearRegressionReplicate::size(
+        static_cast<uint32_t>(p)));
+    outContributions(0) = 1;
+    outContributions(1) = inY;
+    outContributions(2) = inY * inY;
+    outContributions.segment(3, p) = inY * inX;
+    Index offset = 3 + p;
+    for (Index j = 0; j < p; ++j) {
+        outContributions.segment(offset, j + 1) = inX(j) * inX.head(j + 1);
+        offset += j + 1;
+    }
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_MODULES_STATS_LINREGR_REPLICATE_HPP)
@@ -12,6 +12,7 @@
 #include <utils/Math.hpp>
 
 #include "mann_whitney_test.hpp"
+#include "sorted_runs.hpp"
 
 namespace madlib {
 
@@ -51,55 +52,57 @@ public:
 };
 
 /**
- * @brief Perform the Mann-Whitney-test transition step
+ * @brief Update the state with the next value in ascending order
+ *
+ * Ties are assigned the average of their ranks.
  */
-AnyType
-mw_test_transition::run(AnyType &args) {
-    MWTestTransitionState<MutableArrayHandle<double> > state = args[0];
-    int sample = args[1].getAs<bool>() ? 0 : 1;
-    double value = args[2].getAs<double>();
+template <class Handle>
+void
+mwTestAdvance(MWTestTransitionState<Handle> &ioState, int inSample,
+    double inValue) {
 
     // For almostEqual, we choose a precision of 2 * 1 units in the last place.
     // This is because we assume that value is original data, so the only
     // precision loss is due to representation as floating-point number.
-    if (utils::almostEqual(static_cast<double>(state.last), value, 2)) {
+    if (utils::almostEqual(static_cast<double>(ioState.last), inValue, 2)) {
         for (int i = 0; i <= 1; i++)
-            state.rankSum(i) += state.numTies(i) * 0.5;
-    } else if (state.last < value) {
-        state.numTies.setZero();
-    } else if (std::isnan(value)) {
+            ioState.rankSum(i) += ioState.numTies(i) * 0.5;
+    } else if (ioState.last < inValue) {
+        ioState.numTies.setZero();
+    } else if (std::isnan(inValue)) {
         // If the input contains NaN, we'll have it propagate
-        state.rankSum(0) = state.rankSum(1)
+        ioState.rankSum(0) = ioState.rankSum(1)
             = std::numeric_limits<double>::quiet_NaN();
-    } else if (state.num.sum() > 0) {
-        // also satisfied here: state.last > value
+    } else if (ioState.num.sum() > 0) {
+        // also satisfied here: ioState.last > inValue
         throw std::invalid_argument("Must be used as an ordered aggregate, "
             "in ascending order of the second argument.");
     }
 
-    state.num(sample)++;
-    state.rankSum(sample) += (2. * state.num.sum() - state.numTies.sum()) / 2.;
-    state.numTies(sample)++;
-    state.last = value;
-
-    return state;
+    ioState.num(inSample)++;
+    ioState.rankSum(inSample)
+        += (2. * ioState.num.sum() - ioState.numTies.sum()) / 2.;
+    ioState.numTies(inSample)++;
+    ioState.last = inValue;
 }
 
+/**
+ * @brief Compute the test result from a state that has seen all values
+ */
+template <class Handle>
 AnyType
-mw_test_final::run(AnyType &args) {
+mwTestResult(const MWTestTransitionState<Handle> &inState) {
     using boost::math::complement;
 
-    MWTestTransitionState<ArrayHandle<double> > state = args[0];
-
     Eigen::Vector2d U;
-    double numProd = state.num.prod();
+    double numProd = inState.num.prod();
 
-    U(0) = state.rankSum(1) - state.num(1) * (state.num(1) + 1.) / 2.;
+    U(0) = inState.rankSum(1) - inState.num(1) * (inState.num(1) + 1.) / 2.;
     U(1) = numProd - U(0);
 
     double u_statistic = U.minCoeff();
     double z_statistic = (u_statistic - (numProd / 2.))
-                       / (std::sqrt( numProd * (state.num.sum() + 1) / 12. ));
+                       / (std::sqrt( numProd * (inState.num.sum() + 1) / 12. ));
 
     AnyType tuple;
     tuple
@@ -110,6 +113,78 @@ mw_test_final::run(AnyType &args) {
     return tuple;
 }
 
+/**
+ * @brief Perform the Mann-Whitney-test transition step
+ */
+AnyType
+mw_test_transition::run(AnyType &args) {
+    MWTestTransitionState<MutableArrayHandle<double> > state = args[0];
+    int sample = args[1].getAs<bool>() ? 0 : 1;
+    double value = args[2].getAs<double>();
+
+    mwTestAdvance(state, sample, value);
+    return state;
+}
+
+AnyType
+mw_test_final::run(AnyType &args) {
+    MWTestTransitionState<ArrayHandle<double> > state = args[0];
+
+    return mwTestResult(state);
+}
+
+/**
+ * @brief Perform the transition step of the Mann-Whitney test on unordered
+ *     input
+ *
+ * Each record consists of the value and the sample (0 for the first, 1 for
+ * the second sample). The records of each segment form a local sorted run.
+ */
+AnyType
+mw_test_parallel_transition::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 2> state = args[0];
+    double record[2] = {
+        args[2].getAs<double>(),
+        args[1].getAs<bool>() ? 0. : 1.
+    };
+
+    state.append(*this, record);
+    return state;
+}
+
+/**
+ * @brief Merge the sorted runs of two transition states
+ */
+AnyType
+mw_test_parallel_merge_states::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 2> stateLeft
+        = args[0];
+    SortedRunsTransitionState<ArrayHandle<double>, 2> stateRight = args[1];
+
+    stateLeft.merge(*this, stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step of the Mann-Whitney test on unordered input
+ *
+ * The merged runs are in ascending order, so replaying them through the
+ * ordered transition step assigns exact (average) ranks, and the U statistic
+ * is the same as for the ordered aggregate.
+ */
+AnyType
+mw_test_parallel_final::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 2> runs = args[0];
+    runs.sort();
+
+    MWTestTransitionState<MutableArrayHandle<double> > state
+        = AnyType(allocateArray<double>(7));
+    for (uint64_t i = 0; i < runs.numRecords; i++)
+        mwTestAdvance(state, static_cast<int>(runs[i][1]), runs[i][0]);
+
+    return mwTestResult(state);
+}
+
 } // namespace stats
 
 } // namespace modules
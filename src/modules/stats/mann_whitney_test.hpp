@@ -13,3 +13,18 @@ DECLARE_UDF(stats, mw_test_transition)
  * @brief Mann-Whitney U Test: Final function
  */
 DECLARE_UDF(stats, mw_test_final)
+
+/**
+ * @brief Mann-Whitney U Test on unordered input: Transition function
+ */
+DECLARE_UDF(stats, mw_test_parallel_transition)
+
+/**
+ * @brief Mann-Whitney U Test on unordered input: Merge function
+ */
+DECLARE_UDF(stats, mw_test_parallel_merge_states)
+
+/**
+ * @brief Mann-Whitney U Test on unordered input: Final function
+ */
+DECLARE_UDF(stats, mw_test_parallel_final)
@@ -0,0 +1,135 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file moments.cpp
+ *
+ * @brief Aggregate computing the first four moments in a single pass
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <modules/shared/Moments.hpp>
+
+#include "moments.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace stats {
+
+/**
+ * @brief Transition state for the moments aggregate
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 5, and all elements are 0.
+ */
+template <class Handle>
+class MomentsTransitionState {
+public:
+    MomentsTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()),
+        numValues(&mStorage[0]),
+        mean(&mStorage[1]),
+        M2(&mStorage[2]),
+        M3(&mStorage[3]),
+        M4(&mStorage[4]) { }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Return a copy as a Moments accumulator
+     */
+    Moments moments() const {
+        return Moments(numValues, mean, M2, M3, M4);
+    }
+
+    /**
+     * @brief Store a Moments accumulator
+     */
+    MomentsTransitionState &operator=(const Moments &inMoments) {
+        numValues = inMoments.numValues;
+        mean = inMoments.mean;
+        M2 = inMoments.M2;
+        M3 = inMoments.M3;
+        M4 = inMoments.M4;
+        return *this;
+    }
+
+private:
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToDouble numValues;
+    typename HandleTraits<Handle>::ReferenceToDouble mean;
+    typename HandleTraits<Handle>::ReferenceToDouble M2;
+    typename HandleTraits<Handle>::ReferenceToDouble M3;
+    typename HandleTraits<Handle>::ReferenceToDouble M4;
+};
+
+/**
+ * @brief Perform the moments transition step
+ */
+AnyType
+moments_transition::run(AnyType &args) {
+    MomentsTransitionState<MutableArrayHandle<double> > state = args[0];
+    double x = args[1].getAs<double>();
+
+    Moments moments = state.moments();
+    moments << x;
+    state = moments;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+moments_merge_states::run(AnyType &args) {
+    MomentsTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    MomentsTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    Moments moments = stateLeft.moments();
+    moments += stateRight.moments();
+    stateLeft = moments;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the moments final step
+ */
+AnyType
+moments_final::run(AnyType &args) {
+    MomentsTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.numValues == 0)
+        return Null();
+
+    Moments moments = state.moments();
+    bool hasSpread = moments.M2 > 0;
+
+    AnyType tuple;
+    tuple
+        << static_cast<int64_t>(moments.numValues)
+        << moments.mean
+        << (moments.numValues > 1 ? moments.sampleVariance() : Null())
+        << (hasSpread ? moments.skewness() : Null())
+        << (hasSpread ? moments.excessKurtosis() : Null())
+        << moments.M2
+        << moments.M3
+        << moments.M4;
+    return tuple;
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file moments.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Moments: Transition function
+ */
+DECLARE_UDF(stats, moments_transition)
+
+/**
+ * @brief Moments: State merge function
+ */
+DECLARE_UDF(stats, moments_merge_states)
+
+/**
+ * @brief Moments: Final function
+ */
+DECLARE_UDF(stats, moments_final)
@@ -9,7 +9,10 @@
 #include <dbconnector/dbconnector.hpp>
 #include <modules/prob/boost.hpp>
 #include <modules/shared/HandleTraits.hpp>
-#include <utils/Math.hpp>
+#include <modules/shared/Moments.hpp>
+
+#include <algorithm>
+#include <vector>
 
 #include "one_way_anova.hpp"
 
@@ -22,6 +25,20 @@ namespace stats {
 /**
  * @brief Transition state for one-way ANOVA functions
  *
+ * Groups are numbered in the order in which they are first seen. An
+ * open-addressing hash table (with linear probing and a load factor of at most
+ * 1/2) maps group values to these numbers, so that looking up a group takes
+ * expected constant time, independent of the number of groups.
+ *
+ * The storage array is laid out as follows, where \f$ r \f$ is the number of
+ * groups reserved:
+ * - 0: Number of groups
+ * - 1: Number of groups reserved (\f$ r \f$, zero or a power of 2)
+ * - \f$ 2, \dots, 2r + 1 \f$: Hash table. Each slot holds one plus the number
+ *   of a group, or 0 if the slot is empty.
+ * - \f$ 2r + 2, \dots \f$: Group values, num, sum, and corrected_square_sum,
+ *   with \f$ r \f$ elements each.
+ *
  * Note: We assume that the DOUBLE PRECISION array is initialized by the
  * database with length 2, and all elemenets are 0. Handle::operator[] will
  * perform bounds checking.
@@ -32,7 +49,7 @@ public:
     OWATransitionState(const AnyType &inArray)
       : mStorage(inArray.getAs<Handle>()) {
 
-        rebind(utils::nextPowerOfTwo(static_cast<uint32_t>(mStorage[0])));
+        rebind(static_cast<uint32_t>(mStorage[1]));
     }
 
     /**
@@ -46,40 +63,76 @@ public:
     }
 
     /**
-     * @brief Return the index (in the num, sum, and corrected_square_sum
-     *     fields) of a group value
+     * @brief Return the index (in the groupValues, num, sum, and
+     *     corrected_square_sum fields) of a group value
      *
      * If a value is not found, we add a new group to the transition state.
      * Since we do not want to reallocate too often, we reserve some buffer
      * space in the storage array. So we need to reallocate and copy memory only
      * whenever the number of groups hits a power of 2.
      */
-    uint32_t idxOfGroup(const Allocator& inAllocator, uint32_t inValue);
+    uint32_t idxOfGroup(const Allocator& inAllocator, int32_t inValue);
 
 private:
     static inline size_t arraySize(uint32_t inNumGroupsReserved) {
-        return 1 + 5 * inNumGroupsReserved;
+        return 2 + 6 * static_cast<size_t>(inNumGroupsReserved);
+    }
+
+    /**
+     * @brief Return the first hash-table slot to probe for a group value
+     *
+     * We use Fibonacci hashing, i.e., multiplicative hashing with the golden
+     * ratio, which spreads consecutive group values evenly.
+     */
+    static inline uint32_t initialSlot(int32_t inValue,
+        uint32_t inNumSlots) {
+
+        return static_cast<uint32_t>(
+            static_cast<uint32_t>(inValue) * 2654435769U) & (inNumSlots - 1);
+    }
+
+    /**
+     * @brief Return the hash-table slot of a group value
+     *
+     * If the group value is not in the hash table, return the empty slot
+     * where it would have to be inserted.
+     */
+    uint32_t slotOfGroup(int32_t inValue) const {
+        uint32_t numSlots = 2 * static_cast<uint32_t>(numGroupsReserved);
+        uint32_t slot = initialSlot(inValue, numSlots);
+        while (slots[slot] != 0 && static_cast<int32_t>(
+                groupValues[static_cast<uint32_t>(slots[slot]) - 1])
+            != inValue)
+            slot = (slot + 1) & (numSlots - 1);
+        return slot;
     }
 
     void rebind(uint32_t inNumGroupsReserved) {
         madlib_assert(mStorage.size() >= arraySize(inNumGroupsReserved),
             std::runtime_error("Out-of-bounds array access detected."));
 
+        // With no groups reserved, the offsets below point just past the end
+        // of the array, so we must not use operator[] for them
         numGroups.rebind(&mStorage[0]);
-        groupValues = &mStorage[1];
-        posToIndices = &mStorage[1 + inNumGroupsReserved];
-        num.rebind(&mStorage[1 + 2 * inNumGroupsReserved], inNumGroupsReserved);
-        sum.rebind(&mStorage[1 + 3 * inNumGroupsReserved], inNumGroupsReserved);
+        numGroupsReserved.rebind(&mStorage[1]);
+        slots = mStorage.ptr() + 2;
+        groupValues = mStorage.ptr() + 2 + 2 * inNumGroupsReserved;
+        num.rebind(mStorage.ptr() + 2 + 3 * inNumGroupsReserved,
+            inNumGroupsReserved);
+        sum.rebind(mStorage.ptr() + 2 + 4 * inNumGroupsReserved,
+            inNumGroupsReserved);
         corrected_square_sum.rebind(
-            &mStorage[1 + 4 * inNumGroupsReserved], inNumGroupsReserved);
+            mStorage.ptr() + 2 + 5 * inNumGroupsReserved, inNumGroupsReserved);
     }
 
     Handle mStorage;
 
+    typename HandleTraits<Handle>::DoublePtr slots;
+
 public:
     typename HandleTraits<Handle>::ReferenceToUInt32 numGroups;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numGroupsReserved;
     typename HandleTraits<Handle>::DoublePtr groupValues;
-    typename HandleTraits<Handle>::DoublePtr posToIndices;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap num;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap sum;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap corrected_square_sum;
@@ -88,127 +141,70 @@ public:
 template <>
 uint32_t
 OWATransitionState<ArrayHandle<double> >::idxOfGroup(
-    const Allocator&, uint32_t inValue) {
-
-    std::ptrdiff_t pos = std::lower_bound(
-        groupValues, groupValues + numGroups, inValue) - groupValues;
-
-    if (static_cast<uint64_t>(pos) >= numGroups
-        || groupValues[pos] != inValue) {
-        // Did not find this group value. We have to start a new group.
+    const Allocator&, int32_t inValue) {
 
+    uint32_t slot = numGroupsReserved == 0 ? 0 : slotOfGroup(inValue);
+    if (numGroupsReserved == 0 || slots[slot] == 0)
         throw std::runtime_error("Could not find a grouping value during "
             "one-way ANOVA.");
-    }
-    return static_cast<uint32_t>(pos);
+    return static_cast<uint32_t>(slots[slot]) - 1;
 }
 
 template <>
 uint32_t
 OWATransitionState<MutableArrayHandle<double> >::idxOfGroup(
-    const Allocator& inAllocator, uint32_t inValue) {
-
-    // FIXME: Think of using proper iterators. Add some safety. Overflow checks.
-    // http://jira.madlib.net/browse/MADLIB-499
-    std::ptrdiff_t pos = std::lower_bound(
-        groupValues, groupValues + numGroups, inValue) - groupValues;
+    const Allocator& inAllocator, int32_t inValue) {
 
-    if (static_cast<uint64_t>(pos) >= numGroups
-        || groupValues[pos] != inValue) {
-        // Did not find this group value. We have to start a new group.
+    if (numGroupsReserved > 0) {
+        uint32_t slot = slotOfGroup(inValue);
+        if (slots[slot] != 0)
+            return static_cast<uint32_t>(slots[slot]) - 1;
 
-        uint32_t numGroupsReserved = utils::nextPowerOfTwo(
-            static_cast<uint32_t>(numGroups));
-        if (numGroupsReserved > numGroups) {
+        if (numGroups < numGroupsReserved) {
             // We have enough reserve space allocated.
-            std::copy(groupValues + pos, groupValues + numGroups,
-                groupValues + pos + 1);
-            groupValues[pos] = inValue;
-
-            std::copy(posToIndices + pos, posToIndices + numGroups,
-                posToIndices + pos + 1);
-            posToIndices[pos] = numGroups++;
-        } else {
-            // We need to reallocate storage for the transition state
-            // Save our current state, so we can subsequently restore it
-            // with the new storage
-            OWATransitionState oldSelf = *this;
-            if (numGroupsReserved == 0)
-                numGroupsReserved = 1;
-            else {
-                if (static_cast<uint64_t>(2) * numGroupsReserved >
-                    std::numeric_limits<uint32_t>::max())
-                    throw std::runtime_error("Too many groups.");
-
-                numGroupsReserved = 2U * numGroupsReserved;
-            }
-            mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
-                dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(numGroupsReserved));
-            rebind(numGroupsReserved);
-
-            numGroups = oldSelf.numGroups + 1;
-            std::copy(oldSelf.groupValues, oldSelf.groupValues + pos, groupValues);
-            std::copy(oldSelf.groupValues + pos,
-                oldSelf.groupValues + oldSelf.numGroups, groupValues + pos + 1);
-            groupValues[pos] = inValue;
-
-            std::copy(oldSelf.posToIndices, oldSelf.posToIndices + pos, posToIndices);
-            std::copy(oldSelf.posToIndices + pos,
-                oldSelf.posToIndices + oldSelf.numGroups, posToIndices + pos + 1);
-            posToIndices[pos] = oldSelf.numGroups;
-
-            num.segment(0, oldSelf.numGroups) << oldSelf.num;
-            sum.segment(0, oldSelf.numGroups) << oldSelf.sum;
-            corrected_square_sum.segment(0, oldSelf.numGroups) << oldSelf.corrected_square_sum;
+            uint32_t idx = numGroups++;
+            groupValues[idx] = inValue;
+            slots[slot] = idx + 1;
+            return idx;
         }
     }
-    return static_cast<uint32_t>(posToIndices[pos]);
-}
 
-// FIXME: Same function used for t_test. Factor out.
-// http://jira.madlib.net/browse/MADLIB-500
-/**
- * @brief Update the corrected sum of squares
- *
- * For numerical stability, we should not compute the sample variance in the
- * naive way. The literature has many examples where this gives bad results
- * even with moderately sized inputs.
- *
- * See:
- *
- * B. P. Welford (1962). "Note on a method for calculating corrected sums of
- * squares and products". Technometrics 4(3):419–420.
- *
- * Chan, Tony F.; Golub, Gene H.; LeVeque, Randall J. (1979), "Updating
- * Formulae and a Pairwise Algorithm for Computing Sample Variances.", Technical
- * Report STAN-CS-79-773, Department of Computer Science, Stanford University.
- * ftp://reports.stanford.edu/pub/cstr/reports/cs/tr/79/773/CS-TR-79-773.pdf
- */
-inline
-void
-updateCorrectedSumOfSquares(double &ioLeftWeight, double &ioLeftSum,
-    double &ioLeftCorrectedSumSquares, double inRightWeight, double inRightSum,
-    double inRightCorrectedSumSquares) {
-
-    if (inRightWeight <= 0)
-        return;
-
-    // FIXME: Use compensated sums for numerical stability
-    // http://jira.madlib.net/browse/MADLIB-500
-    // See Ogita et al., "Accurate Sum and Dot Product", SIAM Journal on
-    // Scientific Computing (SISC), 26(6):1955-1988, 2005.
-    if (ioLeftWeight <= 0)
-        ioLeftCorrectedSumSquares = inRightCorrectedSumSquares;
+    // Did not find this group value, and we need to reallocate storage for
+    // the transition state. Save our current state, so we can subsequently
+    // restore it with the new storage.
+    OWATransitionState oldSelf = *this;
+    uint32_t newNumGroupsReserved;
+    if (oldSelf.numGroupsReserved == 0)
+        newNumGroupsReserved = 1;
     else {
-        double diff = inRightWeight / ioLeftWeight * ioLeftSum - inRightSum;
-        ioLeftCorrectedSumSquares
-               += inRightCorrectedSumSquares
-                + ioLeftWeight / (inRightWeight * (ioLeftWeight + inRightWeight))
-                    * diff * diff;
-    }
+        // Besides the 32-bit group numbers, the hash table (with twice as
+        // many slots as groups) must be addressable with 32-bit integers.
+        if (static_cast<uint64_t>(4) * oldSelf.numGroupsReserved >
+            std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Too many groups.");
 
-    ioLeftSum += inRightSum;
-    ioLeftWeight += inRightWeight;
+        newNumGroupsReserved = 2U * oldSelf.numGroupsReserved;
+    }
+    mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+        dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(newNumGroupsReserved));
+    rebind(newNumGroupsReserved);
+    numGroupsReserved = newNumGroupsReserved;
+
+    uint32_t oldNumGroups = oldSelf.numGroups;
+    std::copy(oldSelf.groupValues, oldSelf.groupValues + oldNumGroups,
+        groupValues);
+    num.segment(0, oldNumGroups) << oldSelf.num;
+    sum.segment(0, oldNumGroups) << oldSelf.sum;
+    corrected_square_sum.segment(0, oldNumGroups)
+        << oldSelf.corrected_square_sum;
+
+    // Rebuild the hash table, then insert the new group
+    numGroups = oldNumGroups + 1;
+    groupValues[oldNumGroups] = inValue;
+    for (uint32_t idx = 0; idx < numGroups; idx++)
+        slots[slotOfGroup(static_cast<int32_t>(groupValues[idx]))] = idx + 1;
+
+    return oldNumGroups;
 }
 
 /**
@@ -237,10 +233,9 @@ one_way_anova_merge_states::run(AnyType &args) {
     OWATransitionState<ArrayHandle<double> > stateRight = args[1];
 
     // Merge states together and return
-    for (uint64_t posRight = 0; posRight < stateRight.numGroups; posRight++) {
-        uint32_t value
-            = static_cast<uint32_t>(stateRight.groupValues[posRight]);
-        uint32_t idxRight = stateRight.idxOfGroup(*this, value);
+    for (uint32_t idxRight = 0; idxRight < stateRight.numGroups; idxRight++) {
+        int32_t value
+            = static_cast<int32_t>(stateRight.groupValues[idxRight]);
         uint32_t idxLeft = stateLeft.idxOfGroup(*this, value);
         updateCorrectedSumOfSquares(
             stateLeft.num(idxLeft), stateLeft.sum(idxLeft),
@@ -252,8 +247,28 @@ one_way_anova_merge_states::run(AnyType &args) {
     return stateLeft;
 }
 
+namespace {
+
+/**
+ * @brief Order group indices by their group values
+ */
+class GroupValueLess {
+public:
+    GroupValueLess(const double* inGroupValues)
+      : mGroupValues(inGroupValues) { }
+
+    bool operator()(uint32_t inLeft, uint32_t inRight) const {
+        return mGroupValues[inLeft] < mGroupValues[inRight];
+    }
+
+private:
+    const double* mGroupValues;
+};
+
+} // anonymous namespace
+
 /**
- * @brief Perform the one-sided t-Test final step
+ * @brief Perform the one-way ANOVA final step
  */
 AnyType
 one_way_anova_final::run(AnyType &args) {
@@ -267,17 +282,37 @@ one_way_anova_final::run(AnyType &args) {
     if (state.numGroups == 0)
         return Null();
 
-    double grand_mean = state.sum.sum() / state.num.sum();
+    // Groups are numbered in the order in which they were first seen, which
+    // depends on the data distribution. For reproducible results, we
+    // accumulate over the groups in the order of their values.
+    std::vector<uint32_t> sortedIndices(state.numGroups);
+    for (uint32_t idx = 0; idx < state.numGroups; idx++)
+        sortedIndices[idx] = idx;
+    std::sort(sortedIndices.begin(), sortedIndices.end(),
+        GroupValueLess(state.groupValues));
+
+    double total_num = 0;
+    double total_sum = 0;
+    double sum_squares_within = 0;
+    for (std::vector<uint32_t>::const_iterator it = sortedIndices.begin();
+        it != sortedIndices.end(); ++it) {
+
+        total_num += state.num(*it);
+        total_sum += state.sum(*it);
+        sum_squares_within += state.corrected_square_sum(*it);
+    }
+
+    double grand_mean = total_sum / total_num;
     double sum_squares_between = 0;
 
-    for (uint64_t idx = 0; idx < state.numGroups; idx++)
-        sum_squares_between += state.num(idx)
-                             * std::pow(state.sum(idx) / state.num(idx)
+    for (std::vector<uint32_t>::const_iterator it = sortedIndices.begin();
+        it != sortedIndices.end(); ++it)
+        sum_squares_between += state.num(*it)
+                             * std::pow(state.sum(*it) / state.num(*it)
                                         - grand_mean, 2);
 
-    double sum_squares_within = state.corrected_square_sum.sum();
     double df_between = state.numGroups - 1;
-    double df_within = state.num.sum() - state.numGroups;
+    double df_within = total_num - state.numGroups;
     double mean_square_between = sum_squares_between / df_between;
     double mean_square_within = sum_squares_within / df_within;
     double statistic = mean_square_between / mean_square_within;
@@ -0,0 +1,567 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file pca.cpp
+ *
+ * @brief Principal component analysis
+ *
+ * A PCA model is a DOUBLE PRECISION[] with the layout
+ * \f$ (p, k, n, \mathit{totalVariance}, \bar{\boldsymbol x}, V,
+ * \boldsymbol\lambda) \f$, where \f$ p \f$ is the number of variables,
+ * \f$ k \f$ the number of components, \f$ n \f$ the number of rows,
+ * \f$ \bar{\boldsymbol x} \f$ the mean, \f$ V \f$ the \f$ p \times k \f$
+ * matrix of components (in column-major order), and
+ * \f$ \boldsymbol\lambda \f$ the variances along the components. Bases of the
+ * randomized range finder use the same layout, with the basis vectors as
+ * components.
+ *
+ * For a moderate number of variables, the model is the eigendecomposition of
+ * the covariance matrix returned by the covariance aggregate. For many
+ * variables, the randomized range finder of Halko et al. [1] multiplies the
+ * (centered) covariance matrix with a block of \f$ l \ge k \f$ vectors in each
+ * scan, i.e., the covariance matrix is never formed. The final step is the
+ * eigendecomposition of the small \f$ l \times l \f$ matrix
+ * \f$ Q^T C Q \f$.
+ *
+ * [1] N. Halko, P. G. Martinsson, J. A. Tropp: <em>Finding Structure with
+ *     Randomness: Probabilistic Algorithms for Constructing Approximate
+ *     Matrix Decompositions</em>, SIAM Review 53(2):217-288, 2011
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <cmath>
+#include <limits>
+
+#include "covariance_state.hpp"
+#include "pca.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace stats {
+
+/**
+ * @brief Accessor for a PCA model
+ */
+template <class Handle>
+class PCAModel {
+public:
+    PCAModel(const Handle &inArray)
+      : mStorage(inArray) {
+
+        if (mStorage.size() < 4
+            || mStorage.size() != arraySize(
+                static_cast<uint32_t>(mStorage[0]),
+                static_cast<uint32_t>(mStorage[1])))
+            throw std::invalid_argument("Invalid PCA model. Models must be "
+                "obtained from pca_train().");
+        rebind();
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocate a model. All elements but the dimensions are zero.
+     */
+    static Handle allocate(const Allocator &inAllocator, uint32_t inWidthOfX,
+        uint32_t inNumComponents) {
+
+        Handle storage = inAllocator.allocateArray<double>(
+            arraySize(inWidthOfX, inNumComponents));
+        storage[0] = inWidthOfX;
+        storage[1] = inNumComponents;
+        return storage;
+    }
+
+    static inline size_t arraySize(uint32_t inWidthOfX,
+        uint32_t inNumComponents) {
+
+        return 4 + inWidthOfX + static_cast<size_t>(inWidthOfX)
+            * inNumComponents + inNumComponents;
+    }
+
+private:
+    void rebind() {
+        uint32_t p = static_cast<uint32_t>(mStorage[0]);
+        uint32_t k = static_cast<uint32_t>(mStorage[1]);
+
+        widthOfX.rebind(&mStorage[0]);
+        numComponents.rebind(&mStorage[1]);
+        numRows.rebind(&mStorage[2]);
+        totalVariance.rebind(&mStorage[3]);
+        mean.rebind(mStorage.ptr() + 4, p);
+        components.rebind(mStorage.ptr() + 4 + p, p, k);
+        eigenvalues.rebind(mStorage.ptr() + 4 + p + p * k, k);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numComponents;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToDouble totalVariance;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap mean;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap components;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+        eigenvalues;
+};
+
+/**
+ * @brief Transition state for the product of the centered covariance matrix
+ *     with a basis
+ *
+ * Rows are centered at the mean \f$ \boldsymbol\mu \f$ of the basis (zero for
+ * the initial random basis), which need not be the mean of the data. With
+ * \f$ \boldsymbol y_i = \boldsymbol x_i - \boldsymbol\mu \f$, the state
+ * accumulates \f$ \sum_i \boldsymbol y_i \f$, \f$ \sum_i \|\boldsymbol y_i\|^2
+ * \f$, and \f$ \sum_i \boldsymbol y_i \boldsymbol y_i^T Q \f$, from which
+ * centeredProduct() obtains the product for the mean of the data.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * widthOfX, numVectors, numRows, sumOfSquares, sum, product.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 4, and all elemenets are 0.
+ */
+template <class Handle>
+class PCABlockProductState {
+    template <class OtherHandle>
+    friend class PCABlockProductState;
+
+public:
+    PCABlockProductState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]),
+            static_cast<uint32_t>(mStorage[1]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inWidthOfX,
+        uint32_t inNumVectors) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inWidthOfX, inNumVectors));
+        rebind(inWidthOfX, inNumVectors);
+        widthOfX = inWidthOfX;
+        numVectors = inNumVectors;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return widthOfX > 0;
+    }
+
+    /**
+     * @brief Merge with another state object
+     */
+    template <class OtherHandle>
+    PCABlockProductState &operator+=(
+        const PCABlockProductState<OtherHandle> &inOtherState) {
+
+        if (widthOfX != inOtherState.widthOfX
+            || numVectors != inOtherState.numVectors)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        sumOfSquares += inOtherState.sumOfSquares;
+        sum += inOtherState.sum;
+        product += inOtherState.product;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inWidthOfX,
+        uint32_t inNumVectors) {
+
+        return 4 + inWidthOfX + static_cast<size_t>(inWidthOfX)
+            * inNumVectors;
+    }
+
+    void rebind(uint32_t inWidthOfX, uint32_t inNumVectors) {
+        madlib_assert(mStorage.size() >= arraySize(inWidthOfX, inNumVectors),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        widthOfX.rebind(&mStorage[0]);
+        numVectors.rebind(&mStorage[1]);
+        numRows.rebind(&mStorage[2]);
+        sumOfSquares.rebind(&mStorage[3]);
+        sum.rebind(mStorage.ptr() + 4, inWidthOfX);
+        product.rebind(mStorage.ptr() + 4 + inWidthOfX, inWidthOfX,
+            inNumVectors);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numVectors;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToDouble sumOfSquares;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap sum;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap product;
+};
+
+namespace {
+
+/**
+ * @brief Make the largest entry (in absolute value) of each column positive
+ *
+ * Eigenvectors are only unique up to sign. Fixing the sign makes the
+ * components independent of the method and of rounding errors.
+ */
+template <class MatrixType>
+void
+normalizeSigns(MatrixType &ioComponents) {
+    for (Index j = 0; j < ioComponents.cols(); ++j) {
+        Index i;
+        ioComponents.col(j).cwiseAbs().maxCoeff(&i);
+        if (ioComponents(i, j) < 0)
+            ioComponents.col(j) *= -1;
+    }
+}
+
+/**
+ * @brief Return an orthonormal basis of the column space of a matrix
+ */
+Matrix
+orthonormalBasis(const Matrix &inMatrix) {
+    Eigen::HouseholderQR<Matrix> qr(inMatrix);
+    return qr.householderQ()
+        * Matrix::Identity(inMatrix.rows(), inMatrix.cols());
+}
+
+/**
+ * @brief Return the product of the centered covariance matrix (times
+ *     \f$ n - 1 \f$) with the basis
+ *
+ * With \f$ \boldsymbol d = \frac 1n \sum_i \boldsymbol y_i \f$, the mean of
+ * the data is \f$ \bar{\boldsymbol x} = \boldsymbol\mu + \boldsymbol d \f$
+ * and \f$ \sum_i (\boldsymbol x_i - \bar{\boldsymbol x})
+ * (\boldsymbol x_i - \bar{\boldsymbol x})^T Q = \sum_i \boldsymbol y_i
+ * \boldsymbol y_i^T Q - n \boldsymbol d \boldsymbol d^T Q \f$.
+ *
+ * @return The number of rows
+ */
+template <class ProductHandle, class BasisHandle>
+uint64_t
+centeredProduct(const PCABlockProductState<ProductHandle> &inProduct,
+    const PCAModel<BasisHandle> &inBasis, ColumnVector &outMean,
+    Matrix &outProduct, double &outSumOfSquares) {
+
+    if (!inProduct.isInitialized() || inProduct.numRows < 2)
+        throw std::domain_error("PCA requires at least two rows.");
+    if (inProduct.widthOfX != inBasis.widthOfX
+        || inProduct.numVectors != inBasis.numComponents)
+        throw std::invalid_argument("Block product and basis have "
+            "incompatible dimensions.");
+
+    double n = static_cast<double>(inProduct.numRows);
+    ColumnVector d = inProduct.sum / n;
+    ColumnVector projectedD = trans(inBasis.components) * d;
+    outMean = inBasis.mean + d;
+    outProduct = inProduct.product;
+    outProduct.noalias() -= n * d * trans(projectedD);
+    outSumOfSquares = std::max(
+        inProduct.sumOfSquares - n * d.squaredNorm(), 0.);
+    return inProduct.numRows;
+}
+
+} // anonymous namespace
+
+typedef CovarianceAccumulator<RootContainer> CovState;
+
+/**
+ * @brief Return the PCA model with all components of the covariance state
+ */
+AnyType
+pca_exact_final::run(AnyType &args) {
+    CovState state = args[0].getAs<ByteString>();
+
+    if (state.empty())
+        return Null();
+
+    ColumnVector mean;
+    Matrix M;
+    uint64_t n = state.unpack(mean, M);
+    if (n < 2)
+        return Null();
+
+    uint32_t width = static_cast<uint32_t>(M.rows());
+    Matrix covariance = M / static_cast<double>(n - 1);
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        covariance, ComputeEigenvectors);
+
+    PCAModel<MutableArrayHandle<double> > model(
+        PCAModel<MutableArrayHandle<double> >::allocate(*this, width, width));
+    model.numRows = n;
+    model.totalVariance = covariance.trace();
+    model.mean = mean;
+    // Eigen returns the eigenvalues in ascending order
+    model.eigenvalues = decomposition.eigenvalues().reverse().cwiseMax(
+        ColumnVector::Zero(width));
+    model.components = decomposition.eigenvectors().rowwise().reverse();
+    normalizeSigns(model.components);
+    return model;
+}
+
+/**
+ * @brief Keep only the leading components of a PCA model
+ */
+AnyType
+pca_truncate::run(AnyType &args) {
+    PCAModel<ArrayHandle<double> > model(
+        args[0].getAs<ArrayHandle<double> >());
+    int32_t k = args[1].getAs<int32_t>();
+
+    if (k < 1 || static_cast<uint32_t>(k) > model.numComponents)
+        throw std::invalid_argument("Number of components must be between 1 "
+            "and the number of components of the model.");
+
+    PCAModel<MutableArrayHandle<double> > result(
+        PCAModel<MutableArrayHandle<double> >::allocate(*this,
+            model.widthOfX, static_cast<uint32_t>(k)));
+    result.numRows = model.numRows;
+    result.totalVariance = model.totalVariance;
+    result.mean = model.mean;
+    result.components = model.components.leftCols(k);
+    result.eigenvalues = model.eigenvalues.head(k);
+    return result;
+}
+
+/**
+ * @brief Return a random orthonormal basis, the start of the range finder
+ *
+ * The basis vectors are orthonormalized standard normal vectors, drawn from a
+ * PhiloxRandomNumberGenerator with the given seed. The mean of the basis is
+ * zero.
+ */
+AnyType
+pca_random_basis::run(AnyType &args) {
+    int32_t width = args[0].getAs<int32_t>();
+    int32_t numVectors = args[1].getAs<int32_t>();
+    double seed = args[2].getAs<int32_t>();
+
+    if (width < 1)
+        throw std::invalid_argument("Number of variables must be positive.");
+    if (numVectors < 1 || numVectors > width)
+        throw std::invalid_argument("Number of basis vectors must be between "
+            "1 and the number of variables.");
+
+    PhiloxRandomNumberGenerator generator;
+    generator.seed(seed);
+    Matrix gaussian(width, numVectors);
+    double *ptr = gaussian.data();
+    for (Index i = 0; i < gaussian.size(); i += 2) {
+        // 1 - generator() is uniform on (0, 1]
+        double radius = std::sqrt(-2. * std::log(1. - generator()));
+        double angle = 2. * M_PI * generator();
+        ptr[i] = radius * std::cos(angle);
+        if (i + 1 < gaussian.size())
+            ptr[i + 1] = radius * std::sin(angle);
+    }
+
+    PCAModel<MutableArrayHandle<double> > basis(
+        PCAModel<MutableArrayHandle<double> >::allocate(*this,
+            static_cast<uint32_t>(width), static_cast<uint32_t>(numVectors)));
+    basis.components = orthonormalBasis(gaussian);
+    return basis;
+}
+
+/**
+ * @brief Add a row to the product of the covariance matrix with a basis
+ *
+ * The basis is the same for all rows, so it is obtained with
+ * UDF::cachedArrayArgument().
+ */
+AnyType
+pca_block_product_transition::run(AnyType &args) {
+    PCABlockProductState<MutableArrayHandle<double> > state = args[0];
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+    PCAModel<ArrayHandle<double> > basis(cachedArrayArgument(2));
+
+    if (!isfinite(x))
+        throw std::domain_error("Input vector is not finite.");
+    if (static_cast<uint32_t>(x.size()) != basis.widthOfX)
+        throw std::invalid_argument("Input vector and basis have "
+            "incompatible dimensions.");
+
+    if (!state.isInitialized())
+        state.initialize(*this, basis.widthOfX, basis.numComponents);
+    else if (state.numVectors != basis.numComponents)
+        throw std::invalid_argument("Basis must be the same for all rows.");
+
+    ColumnVector y = x - basis.mean;
+    ColumnVector projected = trans(basis.components) * y;
+    state.numRows++;
+    state.sumOfSquares += y.squaredNorm();
+    state.sum += y;
+    state.product.noalias() += y * trans(projected);
+    return state;
+}
+
+/**
+ * @brief Merge two block products
+ */
+AnyType
+pca_block_product_merge::run(AnyType &args) {
+    PCABlockProductState<MutableArrayHandle<double> > stateLeft = args[0];
+    PCABlockProductState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateLeft.isInitialized())
+        return stateRight;
+    else if (!stateRight.isInitialized())
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Return the orthonormalized block product as the next basis
+ *
+ * This is one step of subspace iteration: The columns of the new basis are
+ * an orthonormal basis of \f$ C Q \f$. The mean of the new basis is the mean
+ * of the data, so subsequent scans center the rows exactly.
+ */
+AnyType
+pca_orthonormalize::run(AnyType &args) {
+    PCABlockProductState<ArrayHandle<double> > product = args[0];
+    PCAModel<ArrayHandle<double> > basis(
+        args[1].getAs<ArrayHandle<double> >());
+
+    ColumnVector mean;
+    Matrix Z;
+    double sumOfSquares;
+    uint64_t n = centeredProduct(product, basis, mean, Z, sumOfSquares);
+
+    PCAModel<MutableArrayHandle<double> > result(
+        PCAModel<MutableArrayHandle<double> >::allocate(*this,
+            basis.widthOfX, basis.numComponents));
+    result.numRows = n;
+    result.totalVariance = sumOfSquares / static_cast<double>(n - 1);
+    result.mean = mean;
+    result.components = orthonormalBasis(Z);
+    return result;
+}
+
+/**
+ * @brief Return the PCA model obtained from a basis and its block product
+ *
+ * With the orthonormal basis \f$ Q \f$ and \f$ Z = (n - 1) C Q \f$, the
+ * eigendecomposition \f$ Q^T Z = W \Lambda W^T \f$ of the small matrix gives
+ * the approximate components \f$ Q W \f$ and variances
+ * \f$ \Lambda / (n - 1) \f$ (Rayleigh-Ritz).
+ */
+AnyType
+pca_rayleigh_ritz::run(AnyType &args) {
+    PCABlockProductState<ArrayHandle<double> > product = args[0];
+    PCAModel<ArrayHandle<double> > basis(
+        args[1].getAs<ArrayHandle<double> >());
+    int32_t k = args[2].getAs<int32_t>();
+
+    if (k < 1 || static_cast<uint32_t>(k) > basis.numComponents)
+        throw std::invalid_argument("Number of components must be between 1 "
+            "and the number of basis vectors.");
+
+    ColumnVector mean;
+    Matrix Z;
+    double sumOfSquares;
+    uint64_t n = centeredProduct(product, basis, mean, Z, sumOfSquares);
+
+    Matrix B = trans(basis.components) * Z;
+    B = (B + trans(B)) / 2.;
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        B, ComputeEigenvectors);
+
+    PCAModel<MutableArrayHandle<double> > result(
+        PCAModel<MutableArrayHandle<double> >::allocate(*this,
+            basis.widthOfX, static_cast<uint32_t>(k)));
+    result.numRows = n;
+    result.totalVariance = sumOfSquares / static_cast<double>(n - 1);
+    result.mean = mean;
+    // Eigen returns the eigenvalues in ascending order
+    result.eigenvalues = (decomposition.eigenvalues().reverse().head(k)
+        / static_cast<double>(n - 1)).cwiseMax(ColumnVector::Zero(k));
+    result.components = basis.components
+        * decomposition.eigenvectors().rowwise().reverse().leftCols(k);
+    normalizeSigns(result.components);
+    return result;
+}
+
+/**
+ * @brief Project a row onto the components of a PCA model
+ *
+ * The model is the same for all rows, so it is obtained with
+ * UDF::cachedArrayArgument(), i.e., it is detoasted only once per query.
+ */
+AnyType
+pca_project::run(AnyType &args) {
+    MappedColumnVector x = args[0].getAs<MappedColumnVector>();
+    PCAModel<ArrayHandle<double> > model(cachedArrayArgument(1));
+
+    if (static_cast<uint32_t>(x.size()) != model.widthOfX)
+        throw std::invalid_argument("Input vector and PCA model have "
+            "incompatible dimensions.");
+
+    MutableMappedColumnVector scores(
+        allocateArray<double>(model.numComponents));
+    scores.noalias() = trans(model.components) * (x - model.mean);
+    return scores;
+}
+
+/**
+ * @brief Return the parts of a PCA model as composite value
+ */
+AnyType
+internal_pca_result::run(AnyType &args) {
+    PCAModel<ArrayHandle<double> > model(
+        args[0].getAs<ArrayHandle<double> >());
+    uint32_t p = model.widthOfX;
+    uint32_t k = model.numComponents;
+
+    MutableMappedColumnVector mean(allocateArray<double>(p));
+    mean = model.mean;
+
+    // The components are contiguous columns, which become the inner arrays
+    // of a two-dimensional array
+    MutableArrayHandle<double> components = allocateArray<double>(k, p);
+    std::copy(model.components.data(), model.components.data() + k * p,
+        components.ptr());
+
+    MutableMappedColumnVector eigenvalues(allocateArray<double>(k));
+    eigenvalues = model.eigenvalues;
+
+    MutableMappedColumnVector varianceRatio(allocateArray<double>(k));
+    if (model.totalVariance > 0)
+        varianceRatio = model.eigenvalues / model.totalVariance;
+    else
+        varianceRatio.fill(std::numeric_limits<double>::quiet_NaN());
+
+    AnyType tuple;
+    tuple << static_cast<int64_t>(model.numRows) << mean << components
+        << eigenvalues << varianceRatio;
+    return tuple;
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
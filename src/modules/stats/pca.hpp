@@ -0,0 +1,50 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file pca.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief PCA: Final function of the exact (covariance-based) aggregate
+ */
+DECLARE_UDF(stats, pca_exact_final)
+
+/**
+ * @brief PCA: Keep only the leading components of a model
+ */
+DECLARE_UDF(stats, pca_truncate)
+
+/**
+ * @brief PCA: Random orthonormal basis to start the range finder
+ */
+DECLARE_UDF(stats, pca_random_basis)
+
+/**
+ * @brief PCA: Transition function of the block product with a basis
+ */
+DECLARE_UDF(stats, pca_block_product_transition)
+
+/**
+ * @brief PCA: State merge function of the block product with a basis
+ */
+DECLARE_UDF(stats, pca_block_product_merge)
+
+/**
+ * @brief PCA: Next basis of the range finder
+ */
+DECLARE_UDF(stats, pca_orthonormalize)
+
+/**
+ * @brief PCA: Model from a basis and its block product
+ */
+DECLARE_UDF(stats, pca_rayleigh_ritz)
+
+/**
+ * @brief PCA: Project a row onto the components
+ */
+DECLARE_UDF(stats, pca_project)
+
+/**
+ * @brief PCA: Parts of a model as composite value
+ */
+DECLARE_UDF(stats, internal_pca_result)
@@ -0,0 +1,328 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file quantile_bracket.cpp
+ *
+ * @brief Histogram of a bracket of values, for exact quantiles
+ *
+ * One pass of the exact-quantile driver (see quantile.py_in) counts the
+ * values below, inside, and above a bracket \f$ [lo, hi] \f$, builds an
+ * equi-width histogram of the values inside, and collects the values inside
+ * as long as there are at most \c maxValues of them. The driver then either
+ * selects the quantile from the collected values, or narrows the bracket to
+ * the histogram bins that contain the wanted ranks.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+
+#include "quantile_bracket.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace stats {
+
+/**
+ * @brief Transition state for the bracket histogram
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * lo, hi, numBins, maxValues, capacity, numBelow, numInside, numAbove,
+ * numValues, overflowed, followed by numBins counts, numBins minimums,
+ * numBins maximums, and room for capacity collected values. As in
+ * MatrixAggTransitionState, the room for values doubles whenever it is full
+ * (up to maxValues), so that small brackets do not cost memory.
+ *
+ * The minimum and maximum of each bin are exact values of the column, so that
+ * a bracket narrowed to some bins contains all of their values, no matter how
+ * the bin boundaries round.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 10, and all elemenets are 0.
+ */
+template <class Handle>
+class QuantileBracketState {
+    template <class OtherHandle>
+    friend class QuantileBracketState;
+
+public:
+    QuantileBracketState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[2]),
+            static_cast<uint32_t>(mStorage[4]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator, double inLo,
+        double inHi, uint32_t inNumBins, uint32_t inMaxValues) {
+
+        uint32_t cap = std::min<uint32_t>(kInitialCapacity, inMaxValues);
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inNumBins, cap));
+        rebind(inNumBins, cap);
+        lo = inLo;
+        hi = inHi;
+        numBins = inNumBins;
+        maxValues = inMaxValues;
+        capacity = cap;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return numBins > 0;
+    }
+
+    /**
+     * @brief Add a value
+     */
+    void add(const Allocator &inAllocator, double inValue) {
+        if (inValue < lo) {
+            numBelow = numBelow + 1;
+            return;
+        } else if (inValue > hi) {
+            numAbove = numAbove + 1;
+            return;
+        }
+
+        addToBin(bin(inValue), 1, inValue, inValue);
+        numInside = numInside + 1;
+        if (!overflowed)
+            append(inAllocator, &inValue, 1);
+    }
+
+    /**
+     * @brief Add all counts and values of another state for the same bracket
+     */
+    template <class OtherHandle>
+    void add(const Allocator &inAllocator,
+        const QuantileBracketState<OtherHandle> &inOther) {
+
+        if (lo != inOther.lo || hi != inOther.hi
+            || numBins != inOther.numBins || maxValues != inOther.maxValues)
+            throw std::invalid_argument("Quantile brackets of all rows must "
+                "be the same.");
+
+        for (uint32_t i = 0; i < numBins; i++)
+            if (inOther.counts[i] > 0)
+                addToBin(i, inOther.counts[i], inOther.binMin[i],
+                    inOther.binMax[i]);
+        numBelow += inOther.numBelow;
+        numInside += inOther.numInside;
+        numAbove += inOther.numAbove;
+        if (inOther.overflowed)
+            overflowed = true;
+        if (!overflowed)
+            append(inAllocator, inOther.values, inOther.numValues);
+    }
+
+    /**
+     * @brief Sort the collected values
+     */
+    void sortValues() {
+        std::sort(values, values + static_cast<uint32_t>(numValues));
+    }
+
+    /**
+     * @brief Array with numBelow, numInside, numAbove, overflowed, numBins,
+     *     the counts, minimums, and maximums of the bins, and the collected
+     *     values (none if overflowed)
+     */
+    MutableArrayHandle<double> result(const Allocator &inAllocator) const {
+        uint32_t n = static_cast<uint32_t>(numBins);
+        uint32_t m = overflowed ? 0 : static_cast<uint32_t>(numValues);
+        MutableArrayHandle<double> result
+            = inAllocator.allocateArray<double>(5 + 3 * n + m);
+        double *ptr = result.ptr();
+        *ptr++ = numBelow;
+        *ptr++ = numInside;
+        *ptr++ = numAbove;
+        *ptr++ = overflowed ? 1 : 0;
+        *ptr++ = n;
+        ptr = std::copy(counts, counts + n, ptr);
+        ptr = std::copy(binMin, binMin + n, ptr);
+        ptr = std::copy(binMax, binMax + n, ptr);
+        std::copy(values, values + m, ptr);
+        return result;
+    }
+
+private:
+    enum { kInitialCapacity = 64 };
+
+    static inline size_t arraySize(uint32_t inNumBins, uint32_t inCapacity) {
+        return 10 + 3 * static_cast<size_t>(inNumBins) + inCapacity;
+    }
+
+    uint32_t bin(double inValue) const {
+        if (!(hi > lo))
+            return 0;
+
+        double pos = (inValue - lo) / (hi - lo) * numBins;
+        return pos >= numBins
+            ? static_cast<uint32_t>(numBins) - 1
+            : static_cast<uint32_t>(std::max(pos, 0.));
+    }
+
+    void addToBin(uint32_t inBin, double inCount, double inMin, double inMax) {
+        if (counts[inBin] == 0) {
+            binMin[inBin] = inMin;
+            binMax[inBin] = inMax;
+        } else {
+            if (inMin < binMin[inBin]) binMin[inBin] = inMin;
+            if (inMax > binMax[inBin]) binMax[inBin] = inMax;
+        }
+        counts[inBin] += inCount;
+    }
+
+    /**
+     * @brief Append values, or give up collecting if there would be more than
+     *     maxValues
+     */
+    void append(const Allocator &inAllocator,
+        const double *inValues, uint32_t inNumValues) {
+
+        uint64_t required = static_cast<uint64_t>(numValues) + inNumValues;
+        if (required > maxValues) {
+            overflowed = true;
+            numValues = 0;
+            return;
+        }
+        if (required > capacity) {
+            uint32_t newCapacity = static_cast<uint32_t>(std::min<uint64_t>(
+                std::max<uint64_t>(2 * capacity, required), maxValues));
+            Handle newStorage = inAllocator.allocateArray<double,
+                dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                    arraySize(numBins, newCapacity));
+            std::copy(mStorage.ptr(), values + static_cast<uint32_t>(numValues),
+                newStorage.ptr());
+            mStorage = newStorage;
+            rebind(numBins, newCapacity);
+            capacity = newCapacity;
+        }
+        std::copy(inValues, inValues + inNumValues,
+            values + static_cast<uint32_t>(numValues));
+        numValues += inNumValues;
+    }
+
+    void rebind(uint32_t inNumBins, uint32_t inCapacity) {
+        madlib_assert(mStorage.size() >= arraySize(inNumBins, inCapacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        lo.rebind(&mStorage[0]);
+        hi.rebind(&mStorage[1]);
+        numBins.rebind(&mStorage[2]);
+        maxValues.rebind(&mStorage[3]);
+        capacity.rebind(&mStorage[4]);
+        numBelow.rebind(&mStorage[5]);
+        numInside.rebind(&mStorage[6]);
+        numAbove.rebind(&mStorage[7]);
+        numValues.rebind(&mStorage[8]);
+        overflowed.rebind(&mStorage[9]);
+        // The bins and values may be empty, so compute the pointers without
+        // going through the bounds-checked Handle::operator[]
+        counts = mStorage.ptr() + 10;
+        binMin = counts + inNumBins;
+        binMax = binMin + inNumBins;
+        values = binMax + inNumBins;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToDouble lo;
+    typename HandleTraits<Handle>::ReferenceToDouble hi;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numBins;
+    typename HandleTraits<Handle>::ReferenceToUInt32 maxValues;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numBelow;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numInside;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numAbove;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numValues;
+    typename HandleTraits<Handle>::ReferenceToBool overflowed;
+    typename HandleTraits<Handle>::DoublePtr counts;
+    typename HandleTraits<Handle>::DoublePtr binMin;
+    typename HandleTraits<Handle>::DoublePtr binMax;
+    typename HandleTraits<Handle>::DoublePtr values;
+};
+
+/**
+ * @brief Perform the bracket-histogram transition step
+ */
+AnyType
+quantile_bracket_transition::run(AnyType &args) {
+    QuantileBracketState<MutableArrayHandle<double> > state = args[0];
+    double value = args[1].getAs<double>();
+
+    if (!state.isInitialized()) {
+        double lo = args[2].getAs<double>();
+        double hi = args[3].getAs<double>();
+        int32_t numBins = args[4].getAs<int32_t>();
+        int32_t maxValues = args[5].getAs<int32_t>();
+
+        if (!std::isfinite(lo) || !std::isfinite(hi) || lo > hi)
+            throw std::invalid_argument("Quantile bracket must be a finite "
+                "interval.");
+        if (numBins < 1 || numBins > 1000000)
+            throw std::invalid_argument("Number of bins must be between 1 "
+                "and 1000000.");
+        if (maxValues < 0)
+            throw std::invalid_argument("Maximum number of values must not "
+                "be negative.");
+        state.initialize(*this, lo, hi, static_cast<uint32_t>(numBins),
+            static_cast<uint32_t>(maxValues));
+    }
+    if (std::isnan(value))
+        throw std::invalid_argument("Quantile input must not be NaN.");
+
+    state.add(*this, value);
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+quantile_bracket_merge_states::run(AnyType &args) {
+    QuantileBracketState<MutableArrayHandle<double> > stateLeft = args[0];
+    QuantileBracketState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+
+    stateLeft.add(*this, stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the bracket-histogram final step
+ */
+AnyType
+quantile_bracket_final::run(AnyType &args) {
+    // We request a mutable object, because we sort the values in place
+    QuantileBracketState<MutableArrayHandle<double> > state = args[0];
+
+    if (!state.isInitialized())
+        return Null();
+
+    state.sortValues();
+    return state.result(*this);
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file quantile_bracket.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Bracket histogram for exact quantiles: Transition function
+ */
+DECLARE_UDF(stats, quantile_bracket_transition)
+
+/**
+ * @brief Bracket histogram for exact quantiles: State merge function
+ */
+DECLARE_UDF(stats, quantile_bracket_merge_states)
+
+/**
+ * @brief Bracket histogram for exact quantiles: Final function
+ */
+DECLARE_UDF(stats, quantile_bracket_final)
@@ -0,0 +1,201 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file sorted_runs.hpp
+ *
+ * @brief Transition state for rank-based tests on unordered input
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_MODULES_STATS_SORTED_RUNS_HPP
+#define MADLIB_MODULES_STATS_SORTED_RUNS_HPP
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace madlib {
+
+namespace modules {
+
+namespace stats {
+
+/**
+ * @brief Record of a SortedRunsTransitionState
+ *
+ * Records are ordered by their first element (the key). As with
+ * <tt>ORDER BY</tt>, NaN is greater than all other values.
+ */
+template <unsigned int Width>
+struct SortedRunsRecord {
+    double element[Width];
+
+    bool operator<(const SortedRunsRecord &inOther) const {
+        return element[0] < inOther.element[0]
+            || (std::isnan(inOther.element[0]) && !std::isnan(element[0]));
+    }
+};
+
+/**
+ * @brief Transition state that collects records and sorts them in runs
+ *
+ * Rank-based tests like the Kolmogorov-Smirnov test or the Wilcoxon
+ * signed-rank test need to see their input in ascending order. Instead of
+ * having the database sort all input on a single node (as an ordered aggregate
+ * does), transition functions append records in arbitrary order. Before two
+ * states are merged, each sorts its unsorted tail and merges it into its sorted
+ * prefix. So every segment only sorts its own rows, and combining segments
+ * only merges sorted runs. The final function then sees all records in
+ * ascending order of the key.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * capacity, numRecords, numSorted, followed by capacity records of Width
+ * elements each.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0. The capacity grows
+ * geometrically as records are appended.
+ */
+template <class Handle, unsigned int Width>
+class SortedRunsTransitionState {
+    template <class OtherHandle, unsigned int OtherWidth>
+    friend class SortedRunsTransitionState;
+
+public:
+    typedef SortedRunsRecord<Width> Record;
+
+    SortedRunsTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind();
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Append a record of Width elements
+     */
+    void append(const Allocator &inAllocator, const double *inRecord) {
+        if (numRecords >= capacity)
+            reserve(inAllocator, std::max<uint64_t>(2 * capacity, 16));
+
+        std::copy(inRecord, inRecord + Width,
+            records()[static_cast<uint64_t>(numRecords)].element);
+        numRecords++;
+    }
+
+    /**
+     * @brief Sort the unsorted tail and merge it into the sorted prefix
+     */
+    void sort() {
+        Record *begin = records();
+        Record *middle = begin + static_cast<uint64_t>(numSorted);
+        Record *end = begin + static_cast<uint64_t>(numRecords);
+
+        if (middle == end)
+            return;
+        std::sort(middle, end);
+        std::inplace_merge(begin, middle, end);
+        numSorted = numRecords;
+    }
+
+    /**
+     * @brief Merge all records of another state into this state
+     *
+     * Afterwards, this state is completely sorted.
+     */
+    template <class OtherHandle>
+    void merge(const Allocator &inAllocator,
+        const SortedRunsTransitionState<OtherHandle, Width> &inOther) {
+
+        sort();
+        if (inOther.numRecords == 0)
+            return;
+
+        uint64_t n = numRecords;
+        uint64_t total = n + inOther.numRecords;
+        if (total > capacity)
+            reserve(inAllocator, total);
+
+        const Record *otherBegin = inOther.records();
+        Record *begin = records();
+        std::copy(otherBegin, otherBegin
+            + static_cast<uint64_t>(inOther.numRecords), begin + n);
+        if (inOther.numSorted < inOther.numRecords)
+            std::sort(begin + n, begin + total);
+        std::inplace_merge(begin, begin + n, begin + total);
+        numRecords = total;
+        numSorted = total;
+    }
+
+    /**
+     * @brief Whether all records are sorted
+     */
+    bool isSorted() const {
+        return numSorted == numRecords;
+    }
+
+    /**
+     * @brief The i-th record, i.e., a pointer to Width elements
+     */
+    const double *operator[](uint64_t inIndex) const {
+        return records()[inIndex].element;
+    }
+
+private:
+    static inline size_t arraySize(uint64_t inCapacity) {
+        return static_cast<size_t>(3 + inCapacity * Width);
+    }
+
+    void rebind() {
+        madlib_assert(mStorage.size() >= 3
+                && mStorage.size() >= arraySize(
+                    static_cast<uint64_t>(mStorage[0])),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        capacity.rebind(&mStorage[0]);
+        numRecords.rebind(&mStorage[1]);
+        numSorted.rebind(&mStorage[2]);
+    }
+
+    /**
+     * @brief Reallocate the storage so that it can hold inCapacity records
+     */
+    void reserve(const Allocator &inAllocator, uint64_t inCapacity) {
+        Handle newStorage = inAllocator.allocateArray<double,
+            dbal::AggregateContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inCapacity));
+        std::copy(mStorage.ptr(), mStorage.ptr()
+            + arraySize(static_cast<uint64_t>(numRecords)), newStorage.ptr());
+
+        mStorage = newStorage;
+        rebind();
+        capacity = inCapacity;
+    }
+
+    Record *records() {
+        return reinterpret_cast<Record*>(mStorage.ptr() + 3);
+    }
+
+    const Record *records() const {
+        return reinterpret_cast<const Record*>(mStorage.ptr() + 3);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt64 capacity;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRecords;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numSorted;
+};
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
+
+#endif // defined(MADLIB_MODULES_STATS_SORTED_RUNS_HPP)
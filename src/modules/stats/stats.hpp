@@ -6,11 +6,18 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include "bootstrap.hpp"
 #include "chi_squared_test.hpp"
+#include "covariance.hpp"
+#include "cross_validation.hpp"
 #include "kolmogorov_smirnov_test.hpp"
 #include "mann_whitney_test.hpp"
+#include "moments.hpp"
 #include "one_way_anova.hpp"
+#include "pca.hpp"
+#include "quantile_bracket.hpp"
 #include "t_test.hpp"
+#include "tdigest.hpp"
 #include "wilcoxon_signed_rank_test.hpp"
 #include "cox_prop_hazards.hpp"
 
@@ -10,6 +10,7 @@
 #include <modules/prob/boost.hpp>
 #include <modules/prob/student.hpp>
 #include <modules/shared/HandleTraits.hpp>
+#include <modules/shared/Moments.hpp>
 
 #include "t_test.hpp"
 
@@ -64,49 +65,6 @@ public:
     typename HandleTraits<Handle>::ReferenceToDouble correctedY_square_sum;
 };
 
-/**
- * @brief Update the corrected sum of squares
- *
- * For numerical stability, we should not compute the sample variance in the
- * naive way. The literature has many examples where this gives bad results
- * even with moderately sized inputs.
- *
- * See:
- *
- * B. P. Welford (1962). "Note on a method for calculating corrected sums of
- * squares and products". Technometrics 4(3):419–420.
- *
- * Chan, Tony F.; Golub, Gene H.; LeVeque, Randall J. (1979), "Updating
- * Formulae and a Pairwise Algorithm for Computing Sample Variances.", Technical
- * Report STAN-CS-79-773, Department of Computer Science, Stanford University.
- * ftp://reports.stanford.edu/pub/cstr/reports/cs/tr/79/773/CS-TR-79-773.pdf
- */
-inline
-void
-updateCorrectedSumOfSquares(double &ioLeftWeight, double &ioLeftSum,
-    double &ioLeftCorrectedSumSquares, double inRightWeight, double inRightSum,
-    double inRightCorrectedSumSquares) {
-
-    if (inRightWeight <= 0)
-        return;
-
-    // FIXME: Use compensated sums for numerical stability
-    // See Ogita et al., "Accurate Sum and Dot Product", SIAM Journal on
-    // Scientific Computing (SISC), 26(6):1955-1988, 2005.
-    if (ioLeftWeight <= 0)
-        ioLeftCorrectedSumSquares = inRightCorrectedSumSquares;
-    else {
-        double diff = inRightWeight / ioLeftWeight * ioLeftSum - inRightSum;
-        ioLeftCorrectedSumSquares
-               += inRightCorrectedSumSquares
-                + ioLeftWeight / (inRightWeight * (ioLeftWeight + inRightWeight))
-                    * diff * diff;
-    }
-
-    ioLeftSum += inRightSum;
-    ioLeftWeight += inRightWeight;
-}
-
 /**
  * @brief Perform the one-sample t-test transition step
  */
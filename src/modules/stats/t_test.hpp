@@ -9,6 +9,11 @@
  */
 DECLARE_UDF(stats, t_test_one_transition)
 
+/**
+ * @brief One-sample t-Test: Transition function for a block of rows
+ */
+DECLARE_BLOCK_UDF(stats, t_test_one_block_transition, t_test_one_transition)
+
 /**
  * @brief Two-sample t-Test: Transition function
  */
@@ -0,0 +1,427 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file tdigest.cpp
+ *
+ * @brief t-digest functions for approximate quantiles
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "tdigest.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace stats {
+
+/**
+ * @brief Transition state for t-digest functions
+ *
+ * A t-digest summarizes a distribution by a sorted list of centroids (mean and
+ * weight). Centroids near the tails hold few values and centroids near the
+ * median hold many, so the relative error on extreme quantiles stays small.
+ * New values are appended to a buffer, which is merged into the centroids
+ * whenever it is full. We use the "merging" variant with scale function
+ * \f$ k(q) = \frac{\delta}{2\pi} \arcsin(2q - 1) \f$, where \f$ \delta \f$ is
+ * the compression. Merging guarantees that no centroid spans more than one
+ * unit of \f$ k \f$, so there are at most \f$ \delta + 1 \f$ centroids.
+ *
+ * The layout of the DOUBLE PRECISION array is:
+ * compression, capacity, bufferCapacity, numCentroids, numBuffered,
+ * totalWeight, min, max, followed by capacity means, capacity weights,
+ * bufferCapacity buffered values and bufferCapacity buffered weights.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 8, and all elemenets are 0. Handle::operator[] will
+ * perform bounds checking.
+ *
+ * See:
+ *
+ * T. Dunning and O. Ertl, "Computing Extremely Accurate Quantiles Using
+ * t-Digests", 2019. https://arxiv.org/abs/1902.04023
+ */
+template <class Handle>
+class TDigestTransitionState {
+    template <class OtherHandle>
+    friend class TDigestTransitionState;
+
+public:
+    TDigestTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[1]),
+            static_cast<uint32_t>(mStorage[2]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     *
+     * @param inAllocator Allocator for the memory transition state. Must fill
+     *     the memory block with zeros.
+     * @param inCompression The compression \f$ \delta \f$
+     * @param inWithBuffer Whether to reserve space for buffered values
+     */
+    inline void initialize(const Allocator &inAllocator, double inCompression,
+        bool inWithBuffer = true) {
+
+        uint32_t cap = capacityFor(inCompression);
+        uint32_t bufferCap = inWithBuffer ? 4 * cap : 0;
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(cap, bufferCap));
+        rebind(cap, bufferCap);
+        compression = inCompression;
+        capacity = cap;
+        bufferCapacity = bufferCap;
+    }
+
+    /**
+     * @brief Whether the state has been initialized by a first row
+     */
+    bool isInitialized() const {
+        return capacity > 0;
+    }
+
+    /**
+     * @brief Add a value (or centroid) with the given weight
+     */
+    void add(double inValue, double inWeight) {
+        if (numBuffered >= bufferCapacity)
+            compress();
+
+        if (totalWeight == 0) {
+            min = inValue;
+            max = inValue;
+        } else {
+            if (inValue < min) min = inValue;
+            if (inValue > max) max = inValue;
+        }
+        bufferMeans[numBuffered] = inValue;
+        bufferWeights[numBuffered] = inWeight;
+        numBuffered = numBuffered + 1;
+        totalWeight += inWeight;
+    }
+
+    /**
+     * @brief Add all centroids and buffered values of another state
+     */
+    template <class OtherHandle>
+    void add(const TDigestTransitionState<OtherHandle> &inOther) {
+        if (inOther.totalWeight == 0)
+            return;
+
+        double otherMin = inOther.min;
+        double otherMax = inOther.max;
+        for (uint32_t i = 0; i < inOther.numCentroids; i++)
+            add(inOther.means[i], inOther.weights[i]);
+        for (uint32_t i = 0; i < inOther.numBuffered; i++)
+            add(inOther.bufferMeans[i], inOther.bufferWeights[i]);
+        if (otherMin < min) min = otherMin;
+        if (otherMax > max) max = otherMax;
+    }
+
+    /**
+     * @brief Copy another state, compressing its buffered values
+     */
+    template <class OtherHandle>
+    void assignCompressed(const TDigestTransitionState<OtherHandle> &inOther) {
+        compress(inOther.means, inOther.weights, inOther.numCentroids,
+            inOther.bufferMeans, inOther.bufferWeights, inOther.numBuffered,
+            inOther.totalWeight);
+        min = inOther.min;
+        max = inOther.max;
+    }
+
+    /**
+     * @brief Merge the buffered values into the centroids
+     */
+    void compress() {
+        compress(means, weights, numCentroids, bufferMeans, bufferWeights,
+            numBuffered, totalWeight);
+    }
+
+    /**
+     * @brief Estimate the quantile \f$ q \in [0,1] \f$
+     *
+     * The buffer must be empty. Each centroid is taken to be centered at
+     * its cumulative weight, and we interpolate linearly between the centers
+     * of adjacent centroids. Below the first and above the last center, we
+     * interpolate towards the minimum and maximum.
+     */
+    double quantile(double inQ) const {
+        madlib_assert(numBuffered == 0,
+            std::logic_error("t-digest quantile of an uncompressed state."));
+
+        uint32_t n = numCentroids;
+        double target = inQ * totalWeight;
+
+        if (n == 1 || max == min)
+            return means[0];
+        if (target < weights[0] / 2)
+            return min + (means[0] - min) * target / (weights[0] / 2);
+        if (target > totalWeight - weights[n - 1] / 2)
+            return means[n - 1] + (max - means[n - 1])
+                * (target - (totalWeight - weights[n - 1] / 2))
+                / (weights[n - 1] / 2);
+
+        double center = weights[0] / 2;
+        for (uint32_t i = 0; i + 1 < n; i++) {
+            double nextCenter = center + (weights[i] + weights[i + 1]) / 2;
+            if (target <= nextCenter)
+                return means[i] + (means[i + 1] - means[i])
+                    * (target - center) / (nextCenter - center);
+            center = nextCenter;
+        }
+        return means[n - 1];
+    }
+
+    static uint32_t capacityFor(double inCompression) {
+        return static_cast<uint32_t>(std::ceil(inCompression)) + 2;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inCapacity,
+        uint32_t inBufferCapacity) {
+
+        return 8 + 2 * inCapacity + 2 * inBufferCapacity;
+    }
+
+    void rebind(uint32_t inCapacity, uint32_t inBufferCapacity) {
+        madlib_assert(mStorage.size()
+                >= arraySize(inCapacity, inBufferCapacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        compression.rebind(&mStorage[0]);
+        capacity.rebind(&mStorage[1]);
+        bufferCapacity.rebind(&mStorage[2]);
+        numCentroids.rebind(&mStorage[3]);
+        numBuffered.rebind(&mStorage[4]);
+        totalWeight.rebind(&mStorage[5]);
+        min.rebind(&mStorage[6]);
+        max.rebind(&mStorage[7]);
+        // The buffer may be empty, so compute the pointers without going
+        // through the bounds-checked Handle::operator[]
+        means = mStorage.ptr() + 8;
+        weights = mStorage.ptr() + 8 + inCapacity;
+        bufferMeans = mStorage.ptr() + 8 + 2 * inCapacity;
+        bufferWeights = mStorage.ptr() + 8 + 2 * inCapacity + inBufferCapacity;
+    }
+
+    /**
+     * @brief Merge centroids and buffered values into the centroids of this
+     *     state
+     *
+     * All input is copied before anything is written, so the input may be
+     * this state's own centroids and buffer.
+     */
+    void compress(const double *inMeans, const double *inWeights,
+        uint32_t inNumCentroids, const double *inBufferMeans,
+        const double *inBufferWeights, uint32_t inNumBuffered,
+        double inTotalWeight) {
+
+        std::vector<std::pair<double, double> > points;
+        points.reserve(inNumCentroids + inNumBuffered);
+        for (uint32_t i = 0; i < inNumCentroids; i++)
+            points.push_back(std::make_pair(inMeans[i], inWeights[i]));
+        for (uint32_t i = 0; i < inNumBuffered; i++)
+            points.push_back(std::make_pair(inBufferMeans[i],
+                inBufferWeights[i]));
+        // Centroids are already sorted, so only the buffer really needs
+        // sorting. A plain sort is simpler and the buffer dominates anyway.
+        std::sort(points.begin(), points.end());
+
+        numBuffered = 0;
+        totalWeight = inTotalWeight;
+        if (points.empty()) {
+            numCentroids = 0;
+            return;
+        }
+
+        double normalizer = compression / (2 * M_PI);
+        double weightSoFar = 0;
+        double weightLimit = inTotalWeight * qLimit(0, normalizer);
+        uint32_t n = 0;
+        double curMean = points[0].first;
+        double curWeight = points[0].second;
+
+        for (size_t i = 1; i < points.size(); i++) {
+            double proposed = curWeight + points[i].second;
+            if (weightSoFar + proposed <= weightLimit) {
+                // Merge into the current centroid, updating the mean
+                // incrementally for numerical stability
+                curMean += (points[i].first - curMean)
+                    * points[i].second / proposed;
+                curWeight = proposed;
+            } else {
+                madlib_assert(n < capacity,
+                    std::logic_error("t-digest capacity exceeded."));
+                means[n] = curMean;
+                weights[n] = curWeight;
+                n++;
+                weightSoFar += curWeight;
+                weightLimit = inTotalWeight
+                    * qLimit(weightSoFar / inTotalWeight, normalizer);
+                curMean = points[i].first;
+                curWeight = points[i].second;
+            }
+        }
+        madlib_assert(n < capacity,
+            std::logic_error("t-digest capacity exceeded."));
+        means[n] = curMean;
+        weights[n] = curWeight;
+        numCentroids = n + 1;
+    }
+
+    /**
+     * @brief The quantile at which a centroid starting at quantile inQ has
+     *     to end, i.e., \f$ k^{-1}(k(q) + 1) \f$
+     */
+    static double qLimit(double inQ, double inNormalizer) {
+        double k = inNormalizer * std::asin(2 * inQ - 1) + 1;
+        if (k >= inNormalizer * M_PI / 2)
+            return 1;
+        return (std::sin(k / inNormalizer) + 1) / 2;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToDouble compression;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::ReferenceToUInt32 bufferCapacity;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numCentroids;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numBuffered;
+    typename HandleTraits<Handle>::ReferenceToDouble totalWeight;
+    typename HandleTraits<Handle>::ReferenceToDouble min;
+    typename HandleTraits<Handle>::ReferenceToDouble max;
+    typename HandleTraits<Handle>::DoublePtr means;
+    typename HandleTraits<Handle>::DoublePtr weights;
+    typename HandleTraits<Handle>::DoublePtr bufferMeans;
+    typename HandleTraits<Handle>::DoublePtr bufferWeights;
+};
+
+/**
+ * @brief Perform the t-digest transition step
+ */
+AnyType
+tdigest_transition::run(AnyType &args) {
+    TDigestTransitionState<MutableArrayHandle<double> > state = args[0];
+    double value = args[1].getAs<double>();
+    double compression = args.numFields() >= 3
+        ? args[2].getAs<double>()
+        : 100;
+
+    if (!state.isInitialized()) {
+        if (!std::isfinite(compression) || compression < 10
+            || compression > 10000)
+            throw std::invalid_argument("Compression of t-digest must be "
+                "between 10 and 10000.");
+        state.initialize(*this, compression);
+    }
+    if (std::isnan(value))
+        throw std::invalid_argument("t-digest input must not be NaN.");
+
+    state.add(value, 1);
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+tdigest_merge_states::run(AnyType &args) {
+    TDigestTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    TDigestTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (!stateRight.isInitialized())
+        return stateLeft;
+    if (!stateLeft.isInitialized())
+        return stateRight;
+
+    stateLeft.add(stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the t-digest final step
+ *
+ * Returns the digest with all buffered values merged into the centroids,
+ * and without space for a buffer.
+ */
+AnyType
+tdigest_final::run(AnyType &args) {
+    TDigestTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.totalWeight == 0)
+        return Null();
+
+    // Allocate a new state without a buffer, and fill it with the merged
+    // centroids
+    TDigestTransitionState<MutableArrayHandle<double> > digest = args[0];
+    digest.initialize(*this, state.compression, false);
+    digest.assignCompressed(state);
+    return digest;
+}
+
+/**
+ * @brief Check that a digest was produced by tdigest_final()
+ */
+static void
+checkDigest(const TDigestTransitionState<ArrayHandle<double> > &inDigest) {
+    if (!inDigest.isInitialized() || inDigest.numBuffered != 0)
+        throw std::invalid_argument("Invalid t-digest. Digests must be "
+            "obtained from the tdigest aggregate.");
+}
+
+/**
+ * @brief Estimate a quantile from a digest
+ */
+AnyType
+tdigest_quantile::run(AnyType &args) {
+    TDigestTransitionState<ArrayHandle<double> > digest = args[0];
+    double q = args[1].getAs<double>();
+
+    checkDigest(digest);
+    if (!(q >= 0 && q <= 1))
+        throw std::invalid_argument("Quantile must be between 0 and 1.");
+
+    return digest.quantile(q);
+}
+
+/**
+ * @brief Estimate several quantiles from a digest
+ */
+AnyType
+tdigest_quantiles::run(AnyType &args) {
+    TDigestTransitionState<ArrayHandle<double> > digest = args[0];
+    MappedColumnVector q = args[1].getAs<MappedColumnVector>();
+
+    checkDigest(digest);
+    MutableMappedColumnVector result(allocateArray<double>(q.size()));
+    for (Index i = 0; i < q.size(); i++) {
+        if (!(q(i) >= 0 && q(i) <= 1))
+            throw std::invalid_argument("Quantile must be between 0 and 1.");
+        result(i) = digest.quantile(q(i));
+    }
+    return result;
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,30 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file tdigest.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief t-digest: Transition function
+ */
+DECLARE_UDF(stats, tdigest_transition)
+
+/**
+ * @brief t-digest: State merge function
+ */
+DECLARE_UDF(stats, tdigest_merge_states)
+
+/**
+ * @brief t-digest: Final function
+ */
+DECLARE_UDF(stats, tdigest_final)
+
+/**
+ * @brief t-digest: Estimate a quantile from a digest
+ */
+DECLARE_UDF(stats, tdigest_quantile)
+
+/**
+ * @brief t-digest: Estimate several quantiles from a digest
+ */
+DECLARE_UDF(stats, tdigest_quantiles)
@@ -12,6 +12,7 @@
 #include <utils/Math.hpp>
 
 #include "wilcoxon_signed_rank_test.hpp"
+#include "sorted_runs.hpp"
 
 namespace madlib {
 
@@ -55,98 +56,180 @@ public:
 
 
 /**
- * @brief Perform the Wilcoxon-Signed-Rank-test transition step
+ * @brief Update the state with the next value in ascending order of absolute
+ *     values
  *
  * Index 0 always refers to the positive values and index 1 refers to
  * the negative values.
  */
-AnyType
-wsr_test_transition::run(AnyType &args) {
-    WSRTestTransitionState<MutableArrayHandle<double> > state = args[0];
-    double value = args[1].getAs<double>();
-    double precision = args.numFields() >= 3
-        ? args[2].getAs<double>()
-        : -1;
+template <class Handle>
+void
+wsrTestAdvance(WSRTestTransitionState<Handle> &ioState, double inValue,
+    double inPrecision) {
 
-    if (!std::isfinite(precision))
+    if (!std::isfinite(inPrecision))
         throw std::invalid_argument((boost::format(
-            "Precision must be finite, but got %1%.") % precision).str());
-    else if (precision < 0)
-        precision = value * std::numeric_limits<double>::epsilon();
+            "Precision must be finite, but got %1%.") % inPrecision).str());
+    else if (inPrecision < 0)
+        inPrecision = inValue * std::numeric_limits<double>::epsilon();
 
     // Ignore values of zero.
-    if (value == 0)
-        return state;
+    if (inValue == 0)
+        return;
 
-    double absValue = std::fabs(value);
-    int sample = value > 0 ? 0 : 1;
+    double absValue = std::fabs(inValue);
+    int sample = inValue > 0 ? 0 : 1;
 
-    if (state.num.sum() > 0) {
-        if (absValue < state.lastAbs)
+    if (ioState.num.sum() > 0) {
+        if (absValue < ioState.lastAbs)
             throw std::invalid_argument("Must be used as an ordered aggregate, "
                 "in ascending order of the absolute value of the first "
                 "argument.");
-        else if (absValue - precision <= state.lastAbsUpperBound) {
+        else if (absValue - inPrecision <= ioState.lastAbsUpperBound) {
             for (int i = 0; i <= 1; i++)
-                state.rankSum(i) += state.numTies(i) * 0.5;
+                ioState.rankSum(i) += ioState.numTies(i) * 0.5;
 
             // Hollander, Wolfe ("Nonparametric statistical methods", 2nd ed.,
             // p. 38, 1999) suggest the following:
             //
-            // For each *group*, add (t^3 - t)/48 to state.reduceVariance where
-            // t denotes the number of ties in that group.
+            // For each *group*, add (t^3 - t)/48 to ioState.reduceVariance
+            // where t denotes the number of ties in that group.
             // Note that t^3 - t == 0 if t = 0 or t = 1. So it is sufficient
-            // to modify state.reduceVariance only in the current case of the
+            // to modify ioState.reduceVariance only in the current case of the
             // if-else block.
             //
-            // Instead of modifying state.reduceVariance only once per group,
+            // Instead of modifying ioState.reduceVariance only once per group,
             // we modify it for each repeated occurrence. In detail, we add
-            // [ ((t+1)^3 - (t+1)) - (t^3 - t) ]/48 to state.reduceVariance.
+            // [ ((t+1)^3 - (t+1)) - (t^3 - t) ]/48 to ioState.reduceVariance.
             // This is equal to t * (t + 1) / 16.
-            double t = state.numTies.sum();
-            state.reduceVariance += 1./16. * t * (t + 1);
+            double t = ioState.numTies.sum();
+            ioState.reduceVariance += 1./16. * t * (t + 1);
         } else {
             // We have here:
-            // state.lastAbs <= state.lastAbsUpperBound < absValue - precision
-            //               <= absValue
-            state.numTies.setZero();
+            // ioState.lastAbs <= ioState.lastAbsUpperBound
+            //     < absValue - inPrecision <= absValue
+            ioState.numTies.setZero();
         }
     }
 
-    state.num(sample)++;
-    state.rankSum(sample) += (2. * state.num.sum() - state.numTies.sum()) / 2.;
-    state.numTies(sample)++;
-    state.lastAbs = absValue;
-    if (absValue + precision > state.lastAbsUpperBound)
-        state.lastAbsUpperBound = absValue + precision;
-
-    return state;
+    ioState.num(sample)++;
+    ioState.rankSum(sample)
+        += (2. * ioState.num.sum() - ioState.numTies.sum()) / 2.;
+    ioState.numTies(sample)++;
+    ioState.lastAbs = absValue;
+    if (absValue + inPrecision > ioState.lastAbsUpperBound)
+        ioState.lastAbsUpperBound = absValue + inPrecision;
 }
 
+/**
+ * @brief Compute the test result from a state that has seen all values
+ */
+template <class Handle>
 AnyType
-wsr_test_final::run(AnyType &args) {
+wsrTestResult(const WSRTestTransitionState<Handle> &inState) {
     using boost::math::complement;
 
-    WSRTestTransitionState<ArrayHandle<double> > state = args[0];
-
-    double n_n1 = state.num.sum() * (state.num.sum() + 1);
-    double statistic = state.rankSum.minCoeff();
-    double z_statistic = (state.rankSum(0) - n_n1 / 4.)
-                       / std::sqrt(n_n1 * (2 * state.num.sum() + 1.) / 24.
-                            - state.reduceVariance);
+    double n_n1 = inState.num.sum() * (inState.num.sum() + 1);
+    double statistic = inState.rankSum.minCoeff();
+    double z_statistic = (inState.rankSum(0) - n_n1 / 4.)
+                       / std::sqrt(n_n1 * (2 * inState.num.sum() + 1.) / 24.
+                            - inState.reduceVariance);
 
     AnyType tuple;
     tuple
         << statistic
-        << static_cast<double>(state.rankSum(0))
-        << static_cast<double>(state.rankSum(1))
-        << static_cast<int64_t>(state.num.sum())
+        << static_cast<double>(inState.rankSum(0))
+        << static_cast<double>(inState.rankSum(1))
+        << static_cast<int64_t>(inState.num.sum())
         << z_statistic
         << prob::cdf(complement(prob::normal(), z_statistic))
         << 2. * prob::cdf(complement(prob::normal(), std::fabs(z_statistic)));
     return tuple;
 }
 
+/**
+ * @brief Perform the Wilcoxon-Signed-Rank-test transition step
+ */
+AnyType
+wsr_test_transition::run(AnyType &args) {
+    WSRTestTransitionState<MutableArrayHandle<double> > state = args[0];
+    double value = args[1].getAs<double>();
+    double precision = args.numFields() >= 3
+        ? args[2].getAs<double>()
+        : -1;
+
+    wsrTestAdvance(state, value, precision);
+    return state;
+}
+
+AnyType
+wsr_test_final::run(AnyType &args) {
+    WSRTestTransitionState<ArrayHandle<double> > state = args[0];
+
+    return wsrTestResult(state);
+}
+
+/**
+ * @brief Perform the transition step of the Wilcoxon-Signed-Rank test on
+ *     unordered input
+ *
+ * Each record consists of the absolute value (the sort key), the value, and
+ * the precision.
+ */
+AnyType
+wsr_test_parallel_transition::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 3> state = args[0];
+    double value = args[1].getAs<double>();
+    double precision = args.numFields() >= 3
+        ? args[2].getAs<double>()
+        : -1;
+
+    if (!std::isfinite(precision))
+        throw std::invalid_argument((boost::format(
+            "Precision must be finite, but got %1%.") % precision).str());
+
+    // Ignore values of zero. No need to keep them around.
+    if (value == 0)
+        return state;
+
+    double record[3] = { std::fabs(value), value, precision };
+    state.append(*this, record);
+    return state;
+}
+
+/**
+ * @brief Merge the sorted runs of two transition states
+ */
+AnyType
+wsr_test_parallel_merge_states::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 3> stateLeft
+        = args[0];
+    SortedRunsTransitionState<ArrayHandle<double>, 3> stateRight = args[1];
+
+    stateLeft.merge(*this, stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the final step of the Wilcoxon-Signed-Rank test on unordered
+ *     input
+ *
+ * Once all records are sorted by absolute value, we replay them through the
+ * ordered transition step.
+ */
+AnyType
+wsr_test_parallel_final::run(AnyType &args) {
+    SortedRunsTransitionState<MutableArrayHandle<double>, 3> runs = args[0];
+    runs.sort();
+
+    WSRTestTransitionState<MutableArrayHandle<double> > state
+        = AnyType(allocateArray<double>(9));
+    for (uint64_t i = 0; i < runs.numRecords; i++)
+        wsrTestAdvance(state, runs[i][1], runs[i][2]);
+
+    return wsrTestResult(state);
+}
+
 } // namespace stats
 
 } // namespace modules
@@ -13,3 +13,18 @@ DECLARE_UDF(stats, wsr_test_transition)
  * @brief Wilcoxon-Signed-Rank Test: Final function
  */
 DECLARE_UDF(stats, wsr_test_final)
+
+/**
+ * @brief Wilcoxon-Signed-Rank Test on unordered input: Transition function
+ */
+DECLARE_UDF(stats, wsr_test_parallel_transition)
+
+/**
+ * @brief Wilcoxon-Signed-Rank Test on unordered input: Merge function
+ */
+DECLARE_UDF(stats, wsr_test_parallel_merge_states)
+
+/**
+ * @brief Wilcoxon-Signed-Rank Test on unordered input: Final function
+ */
+DECLARE_UDF(stats, wsr_test_parallel_final)
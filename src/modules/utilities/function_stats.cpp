@@ -0,0 +1,80 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file function_stats.cpp
+ *
+ * @brief Call counters and CPU-time histograms of the C++ AL functions
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include "function_stats.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace utilities {
+
+using dbconnector::postgres::FunctionStatistics;
+
+/**
+ * @brief Return the statistics of the current backend as two-dimensional array
+ *
+ * There is one inner array per function: OID, number of calls, number of
+ * timed calls, CPU time of the timed calls (in seconds), followed by the
+ * FunctionStatistics::kNumBuckets buckets of the CPU-time histogram. The
+ * result is NULL if no function has been called yet.
+ */
+AnyType
+internal_function_stats::run(AnyType & /* args */) {
+    std::vector<FunctionStatistics> stats
+        = dbconnector::postgres::allFunctionStatistics();
+    if (stats.empty())
+        return Null();
+
+    const size_t width = 4 + FunctionStatistics::kNumBuckets;
+    MutableArrayHandle<double> result
+        = allocateArray<double>(stats.size(), width);
+    for (size_t i = 0; i < stats.size(); ++i) {
+        double* row = result.ptr() + i * width;
+        row[0] = stats[i].oid;
+        row[1] = static_cast<double>(stats[i].numCalls);
+        row[2] = static_cast<double>(stats[i].numTimedCalls);
+        row[3] = static_cast<double>(stats[i].cpuTime) * 1e-9;
+        for (int k = 0; k < FunctionStatistics::kNumBuckets; ++k)
+            row[4 + k] = static_cast<double>(stats[i].histogram[k]);
+    }
+    return result;
+}
+
+/**
+ * @brief Set all counters of the current backend to zero
+ *
+ * This includes the memory statistics (see internal_memory_stats()) and the
+ * counters of the model cache (see internal_model_cache_stats()).
+ */
+AnyType
+reset_function_stats::run(AnyType & /* args */) {
+    dbconnector::postgres::resetFunctionStatistics();
+    dbconnector::postgres::MemoryStatistics::get().reset();
+    dbconnector::postgres::resetModelCacheStatistics();
+    return Null();
+}
+
+/**
+ * @brief Set the sampling interval and return the previous one
+ *
+ * The setting is per backend process and lasts until it ends.
+ */
+AnyType
+set_function_stats_sampling::run(AnyType &args) {
+    return dbconnector::postgres::setSamplingInterval(
+        args[0].getAs<int32_t>());
+}
+
+} // namespace utilities
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file function_stats.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Call counters and CPU-time histograms of all functions called so far
+ */
+DECLARE_UDF(utilities, internal_function_stats)
+
+/**
+ * @brief Reset the call counters and CPU-time histograms
+ */
+DECLARE_UDF(utilities, reset_function_stats)
+
+/**
+ * @brief Set the sampling interval of the CPU time of function calls
+ */
+DECLARE_UDF(utilities, set_function_stats_sampling)
@@ -0,0 +1,64 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file memory_stats.cpp
+ *
+ * @brief Accounting of the memory requested through the C++ AL
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include "memory_stats.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace utilities {
+
+using dbconnector::postgres::MemoryStatistics;
+
+/**
+ * @brief Return the memory statistics of the current backend as
+ *     two-dimensional array
+ *
+ * There is one inner array per memory context (function, aggregate,
+ * scratch): number of allocations, bytes requested, largest request.
+ */
+AnyType
+internal_memory_stats::run(AnyType & /* args */) {
+    const MemoryStatistics& stats = MemoryStatistics::get();
+
+    MutableArrayHandle<double> result
+        = allocateArray<double>(MemoryStatistics::kNumContexts, 3);
+    for (int i = 0; i < MemoryStatistics::kNumContexts; ++i) {
+        result[3 * i] = static_cast<double>(stats.contexts[i].numAllocations);
+        result[3 * i + 1] = static_cast<double>(stats.contexts[i].numBytes);
+        result[3 * i + 2]
+            = static_cast<double>(stats.contexts[i].maxAllocation);
+    }
+    return result;
+}
+
+/**
+ * @brief Set the soft limit and return the previous one
+ *
+ * The setting is per backend process and lasts until it ends.
+ */
+AnyType
+set_memory_limit::run(AnyType &args) {
+    int64_t limit = args[0].getAs<int64_t>();
+    if (limit < 0)
+        throw std::invalid_argument("Memory limit must not be negative.");
+
+    MemoryStatistics& stats = MemoryStatistics::get();
+    int64_t previous = static_cast<int64_t>(stats.limit);
+    stats.limit = static_cast<uint64_t>(limit);
+    return previous;
+}
+
+} // namespace utilities
+
+} // namespace modules
+
+} // namespace madlib
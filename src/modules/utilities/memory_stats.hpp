@@ -0,0 +1,15 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file memory_stats.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Memory requested through the C++ AL, per memory context
+ */
+DECLARE_UDF(utilities, internal_memory_stats)
+
+/**
+ * @brief Set the soft limit for single memory requests
+ */
+DECLARE_UDF(utilities, set_memory_limit)
@@ -0,0 +1,61 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file model_cache.cpp
+ *
+ * @brief Counters and capacity of the per-backend model cache
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include "model_cache.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace utilities {
+
+using dbconnector::postgres::ModelCacheStatistics;
+
+/**
+ * @brief Return the model-cache counters of the current backend as array
+ *
+ * The elements are: number of entries, bytes used, capacity in bytes, number
+ * of hits, number of misses, number of evictions.
+ */
+AnyType
+internal_model_cache_stats::run(AnyType & /* args */) {
+    ModelCacheStatistics stats
+        = dbconnector::postgres::modelCacheStatistics();
+
+    MutableArrayHandle<double> result = allocateArray<double>(6);
+    result[0] = static_cast<double>(stats.numEntries);
+    result[1] = static_cast<double>(stats.numBytes);
+    result[2] = static_cast<double>(stats.capacity);
+    result[3] = static_cast<double>(stats.numHits);
+    result[4] = static_cast<double>(stats.numMisses);
+    result[5] = static_cast<double>(stats.numEvictions);
+    return result;
+}
+
+/**
+ * @brief Set the capacity (in bytes) and return the previous one
+ *
+ * The setting is per backend process and lasts until it ends.
+ */
+AnyType
+set_model_cache_size::run(AnyType &args) {
+    int64_t capacity = args[0].getAs<int64_t>();
+    if (capacity < 0)
+        throw std::invalid_argument("Model cache size must not be negative.");
+
+    return static_cast<int64_t>(dbconnector::postgres::setModelCacheCapacity(
+        static_cast<size_t>(capacity)));
+}
+
+} // namespace utilities
+
+} // namespace modules
+
+} // namespace madlib
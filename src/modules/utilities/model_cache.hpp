@@ -0,0 +1,15 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file model_cache.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Counters of the per-backend model cache
+ */
+DECLARE_UDF(utilities, internal_model_cache_stats)
+
+/**
+ * @brief Set the capacity of the per-backend model cache
+ */
+DECLARE_UDF(utilities, set_model_cache_size)
@@ -0,0 +1,11 @@
+/* -----------------------------------------------------------------------------
+ *
+ * @file utilities.hpp
+ *
+ * @brief Umbrella header that includes all utility headers
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "function_stats.hpp"
+#include "memory_stats.hpp"
+#include "model_cache.hpp"
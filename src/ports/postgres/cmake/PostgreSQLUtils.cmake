@@ -4,6 +4,12 @@ function(define_postgresql_features IN_VERSION OUT_FEATURES)
     if(NOT ${IN_VERSION} VERSION_LESS "9.0")
         list(APPEND ${OUT_FEATURES} __HAS_ORDERED_AGGREGATES__)
     endif()
+    if(NOT ${IN_VERSION} VERSION_LESS "9.1")
+        list(APPEND ${OUT_FEATURES} __HAS_UNLOGGED_TABLES__)
+    endif()
+    if(NOT ${IN_VERSION} VERSION_LESS "9.6")
+        list(APPEND ${OUT_FEATURES} __HAS_PARALLEL_AGGREGATES__)
+    endif()
     
     # Pass values to caller
     set(${OUT_FEATURES} "${${OUT_FEATURES}}" PARENT_SCOPE)
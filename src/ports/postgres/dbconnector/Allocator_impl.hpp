@@ -19,6 +19,13 @@ namespace postgres {
  * This calls allocate() to allocate a block of memory and then initializes
  * PostgreSQL meta information.
  *
+ * The elements of the array are 32-byte aligned, so that HandleMap::aligned()
+ * can be used for them (e.g., for transition states). Since the header of an
+ * array without null bitmap has size <tt>ARR_OVERHEAD_NONULLS(Dimensions)</tt>,
+ * this requires shifting the start of the array by up to 24 bytes. The array
+ * itself therefore remains only <tt>MAXIMUM_ALIGNOF</tt>-aligned, which is all
+ * that PostgreSQL requires.
+ *
  * @note
  *     There is a template-overloaded version with defaults
  *     <tt>MC = dbal::FunctionContext</tt>, <tt>ZM = dbal::DoZero</tt>,
@@ -41,8 +48,10 @@ Allocator::internalAllocateArray(
      * ((std::numeric_limits<std::size_t>::max()
      *     - ARR_OVERHEAD_NONULLS(Dimensions)) / inElementSize >= numElements)
      */
+    const std::size_t kDataAlignment = 32;
     if ((std::numeric_limits<std::size_t>::max()
-        - ARR_OVERHEAD_NONULLS(Dimensions)) / sizeof(T) < numElements)
+        - ARR_OVERHEAD_NONULLS(Dimensions) - kDataAlignment) / sizeof(T)
+        < numElements)
         throw std::bad_alloc();
 
     std::size_t size = sizeof(T) * numElements
@@ -54,7 +63,17 @@ Allocator::internalAllocateArray(
 
     // PostgreSQL requires that all memory is overwritten with zeros. So
     // we ingore ZM here
-    array = static_cast<ArrayType*>(allocate<MC, dbal::DoZero, F>(size));
+    char *block = static_cast<char*>(
+        allocate<MC, dbal::DoZero, F>(size + kDataAlignment - MAXIMUM_ALIGNOF));
+    if (block == NULL)
+        return MutableArrayHandle<T>(NULL);
+
+    // The block is at least MAXIMUM_ALIGNOF-aligned, and so is the size of the
+    // header. Hence, so is the shift.
+    std::size_t shift = (kDataAlignment
+        - (reinterpret_cast<uintptr_t>(block) + ARR_OVERHEAD_NONULLS(Dimensions))
+            % kDataAlignment) % kDataAlignment;
+    array = reinterpret_cast<ArrayType*>(block + shift);
 
     SET_VARSIZE(array, size);
     array->ndim = Dimensions;
@@ -115,6 +134,66 @@ Allocator::allocateByteString(std::size_t inSize) const {
     return byteString;
 }
 
+/**
+ * @brief Construct the transition state of an aggregate with
+ *     <tt>STYPE=internal</tt>
+ *
+ * Unlike all other allocations, the object is allocated in the memory
+ * context of the aggregate, so that it survives until the final function has
+ * been called. The object is value-initialized, and the storage that follows
+ * it is zeroed.
+ *
+ * @param inStorageSize Size (in bytes) of the storage following the object,
+ *     see InternalState::storage()
+ */
+template <class T>
+inline
+InternalState<T>
+Allocator::allocateInternalState(std::size_t inStorageSize) const {
+    // The backend frees the memory without calling a destructor
+    BOOST_STATIC_ASSERT(boost::has_trivial_destructor<T>::value);
+
+    MemoryContext aggContext = NULL;
+    // BACKEND: AggCheckCallContext currently will never raise an exception
+    if (!AggCheckCallContext(fcinfo, &aggContext) || aggContext == NULL)
+        throw std::logic_error("Transition states of type internal can only "
+            "be allocated by functions called by an aggregate.");
+
+    MemoryContext oldContext = MemoryContextSwitchTo(aggContext);
+    void *memory;
+    try {
+        memory = allocate<dbal::AggregateContext, dbal::DoZero,
+            dbal::ThrowBadAlloc>(InternalState<T>::headerSize()
+                + inStorageSize);
+    } catch (...) {
+        MemoryContextSwitchTo(oldContext);
+        throw;
+    }
+    MemoryContextSwitchTo(oldContext);
+    return new (memory) T();
+}
+
+/**
+ * @brief Change the size of the storage of an internal transition state
+ *
+ * The object and the first \c inStorageSize bytes of its storage are
+ * preserved, any additional storage is not initialized. The state stays in
+ * the aggregate memory context, but it may move: The returned state has to be
+ * returned to the backend instead of \c inState.
+ */
+template <class T>
+inline
+InternalState<T>
+Allocator::reallocateInternalState(const InternalState<T>& inState,
+    std::size_t inStorageSize) const {
+
+    // repalloc() keeps the block in its memory context
+    return static_cast<T*>(
+        reallocate<dbal::AggregateContext, dbal::DoNotZero,
+            dbal::ThrowBadAlloc>(inState.ptr(), InternalState<T>::headerSize()
+                + inStorageSize));
+}
+
 /**
  * @brief Allocate a block of memory
  *
@@ -180,6 +259,16 @@ Allocator::free(void *inPtr) const {
     if (inPtr == NULL)
         return;
 
+    // Worker threads use the system allocator, see internalAllocate()
+    if (isWorkerThread()) {
+        std::free(static_cast<char*>(inPtr) - 16);
+        return;
+    }
+
+    // Memory in the scratch context is reclaimed when the UDF call returns
+    if (MC == dbal::ScratchContext)
+        return;
+
     /*
      * See allocate(const size_t, const std::nothrow_t&) why we disable
      * processing of interrupts.
@@ -265,6 +354,47 @@ Allocator::internalRePalloc(void *inPtr, size_t inSize) const {
 #endif
 }
 
+/**
+ * @internal
+ * @brief Allocate or reallocate a 16-byte-aligned block with the system
+ *     allocator
+ *
+ * This is used in worker threads (see ThreadPool.cpp), which must not call
+ * into the backend. The size of the block is stored in the 16 bytes in front
+ * of it, so that reallocations can copy the contents.
+ *
+ * @param inPtr Block to reallocate, or NULL for a new allocation
+ * @param inZero Overwrite the part of the block beyond the old size with
+ *     zeros?
+ *
+ * @return The new block, or NULL if the allocation failed
+ */
+inline
+void *
+Allocator::internalSystemAllocate(void *inPtr, size_t inSize, bool inZero)
+    const {
+
+    if (inSize > std::numeric_limits<size_t>::max() - 16)
+        return NULL;
+
+    void *raw;
+    if (posix_memalign(&raw, 16, inSize + 16) != 0)
+        return NULL;
+    *static_cast<size_t*>(raw) = inSize;
+    char *block = static_cast<char*>(raw) + 16;
+
+    size_t oldSize = 0;
+    if (inPtr != NULL) {
+        char *oldRaw = static_cast<char*>(inPtr) - 16;
+        oldSize = std::min(*reinterpret_cast<size_t*>(oldRaw), inSize);
+        std::memcpy(block, inPtr, oldSize);
+        std::free(oldRaw);
+    }
+    if (inZero)
+        std::memset(block + oldSize, 0, inSize - oldSize);
+    return block;
+}
+
 /**
  * @internal
  * @brief Return next 16-byte boundary after inPtr and store inPtr in word
@@ -354,6 +484,28 @@ Allocator::internalAllocate(void *inPtr, const size_t inSize) const {
     // Avoid warning that inPtr is not used if R == NewAllocation
     (void) inPtr;
 
+    // Worker threads must not call into the backend. There is no memory
+    // context for them, so all their memory comes from the system allocator.
+    if (isWorkerThread()) {
+        void *ptr = internalSystemAllocate(R ? inPtr : NULL, inSize,
+            ZM == dbal::DoZero);
+        if (!ptr && F == dbal::ThrowBadAlloc)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    MemoryStatistics& stats = MemoryStatistics::get();
+    if (stats.limit > 0 && inSize > stats.limit) {
+        if (F == dbal::ReturnNULL)
+            return NULL;
+
+        std::stringstream errorMsg;
+        errorMsg << "Memory request of " << inSize << " bytes exceeds the "
+            "limit of " << stats.limit << " bytes (see set_memory_limit()).";
+        throw std::length_error(errorMsg.str());
+    }
+    stats.record(MC, inSize);
+
     void *ptr;
     bool errorOccurred = false;
 
@@ -380,8 +532,13 @@ Allocator::internalAllocate(void *inPtr, const size_t inSize) const {
          *
          * See also: MADLIB-606 (issue that triggered this code change).
          */
-        ptr = R ? internalRePalloc<ZM>(inPtr, inSize)
-                : internalPalloc<ZM>(inSize);
+        if (MC == dbal::ScratchContext)
+            ptr = R ? ScratchArena::get().reallocate(inPtr, inSize,
+                        ZM == dbal::DoZero)
+                    : ScratchArena::get().allocate(inSize, ZM == dbal::DoZero);
+        else
+            ptr = R ? internalRePalloc<ZM>(inPtr, inSize)
+                    : internalPalloc<ZM>(inSize);
     } PG_CATCH(); {
         if (F == dbal::ReturnNULL) {
             /*
@@ -419,6 +576,199 @@ Allocator::internalAllocate(void *inPtr, const size_t inSize) const {
     return ptr;
 }
 
+/**
+ * @brief Get the memory statistics of the current backend
+ */
+inline
+MemoryStatistics&
+MemoryStatistics::get() {
+    static MemoryStatistics sStatistics;
+    return sStatistics;
+}
+
+/**
+ * @brief Account for a request of \c inSize bytes
+ */
+inline
+void
+MemoryStatistics::record(dbal::MemoryContext inContext, size_t inSize) {
+    Context& context = contexts[inContext];
+    ++context.numAllocations;
+    context.numBytes += inSize;
+    if (inSize > context.maxAllocation)
+        context.maxAllocation = inSize;
+}
+
+/**
+ * @brief Set all counters to zero. The limit is kept.
+ */
+inline
+void
+MemoryStatistics::reset() {
+    for (int i = 0; i < kNumContexts; ++i) {
+        contexts[i].numAllocations = 0;
+        contexts[i].numBytes = 0;
+        contexts[i].maxAllocation = 0;
+    }
+}
+
+/**
+ * @brief Get the scratch arena of the current backend
+ */
+inline
+ScratchArena&
+ScratchArena::get() {
+    static ScratchArena sArena;
+    return sArena;
+}
+
+/**
+ * @internal
+ * @brief Round up to the next multiple of 16
+ */
+inline
+size_t
+ScratchArena::roundUp(size_t inSize) {
+    return (inSize + 15) & ~size_t(15);
+}
+
+/**
+ * @internal
+ * @brief Return the size that a block was allocated with
+ */
+inline
+size_t
+ScratchArena::blockSize(void *inPtr) {
+    return *reinterpret_cast<size_t*>(static_cast<char*>(inPtr) - kHeaderSize);
+}
+
+/**
+ * @brief Allocate a 16-byte aligned block of memory
+ *
+ * New chunks are allocated with MemoryContextAlloc(), which might throw a
+ * PostgreSQL exception. Thus, this function should only be used inside a
+ * \c PG_TRY() block.
+ *
+ * @return The address of the block, or NULL if \c inSize is too large
+ */
+inline
+void *
+ScratchArena::allocate(size_t inSize, bool inZero) {
+    if (inSize > std::numeric_limits<size_t>::max() - 4 * kMinChunkSize)
+        return NULL;
+
+    size_t size = kHeaderSize + roundUp(inSize);
+    if (mCurrent == NULL || static_cast<size_t>(mEnd - mCurrent) < size) {
+        // Reserve room for the chunk header and for aligning the first block
+        size_t chunkSize = std::max<size_t>(size, kMinChunkSize)
+            + 2 * kHeaderSize;
+        Chunk *chunk = static_cast<Chunk*>(
+            MemoryContextAlloc(TopMemoryContext, chunkSize));
+        chunk->next = mChunks;
+        chunk->size = chunkSize;
+        mChunks = chunk;
+        mCurrent = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(chunk)
+            + kHeaderSize + 15) & ~uintptr_t(15));
+        mEnd = reinterpret_cast<char*>(chunk) + chunkSize;
+    }
+
+    *reinterpret_cast<size_t*>(mCurrent) = inSize;
+    void *block = mCurrent + kHeaderSize;
+    mCurrent += size;
+    mLast = block;
+
+    if (inZero)
+        std::memset(block, 0, inSize);
+    return block;
+}
+
+/**
+ * @brief Change the size of a block previously allocated in the arena
+ *
+ * The most recently allocated block grows in-place if the current chunk is
+ * large enough. Otherwise, a new block is allocated and the contents are
+ * copied. The same precautions as for allocate() apply.
+ *
+ * @param inZero Overwrite the part of the block beyond the old size with
+ *     zeros?
+ */
+inline
+void *
+ScratchArena::reallocate(void *inPtr, size_t inSize, bool inZero) {
+    if (inPtr == NULL)
+        return allocate(inSize, inZero);
+    if (inSize > std::numeric_limits<size_t>::max() - 4 * kMinChunkSize)
+        return NULL;
+
+    size_t oldSize = blockSize(inPtr);
+    char *block = static_cast<char*>(inPtr);
+
+    if (inPtr == mLast
+        && static_cast<size_t>(mEnd - block) >= roundUp(inSize)) {
+
+        *reinterpret_cast<size_t*>(block - kHeaderSize) = inSize;
+        mCurrent = block + roundUp(inSize);
+    } else {
+        block = static_cast<char*>(allocate(inSize, false));
+        if (block == NULL)
+            return NULL;
+        std::memcpy(block, inPtr, std::min(oldSize, inSize));
+    }
+
+    if (inZero && inSize > oldSize)
+        std::memset(block + oldSize, 0, inSize - oldSize);
+    return block;
+}
+
+/**
+ * @brief Return whether a pointer points into one of the chunks of the arena
+ */
+inline
+bool
+ScratchArena::contains(const void *inPtr) const {
+    const char *ptr = static_cast<const char*>(inPtr);
+    for (const Chunk *chunk = mChunks; chunk; chunk = chunk->next)
+        if (ptr >= reinterpret_cast<const char*>(chunk)
+            && ptr < reinterpret_cast<const char*>(chunk) + chunk->size)
+            return true;
+    return false;
+}
+
+/**
+ * @internal
+ * @brief Release all blocks
+ *
+ * We keep the oldest chunk for the next call, unless it is large. Like
+ * Allocator::free(), this function must not throw.
+ */
+inline
+void
+ScratchArena::reset() {
+    HOLD_INTERRUPTS();
+    PG_TRY(); {
+        while (mChunks && (mChunks->next
+            || mChunks->size > kMaxRetainedChunkSize)) {
+
+            Chunk *next = mChunks->next;
+            pfree(mChunks);
+            mChunks = next;
+        }
+    } PG_CATCH(); {
+        FlushErrorState();
+    } PG_END_TRY();
+    RESUME_INTERRUPTS();
+
+    if (mChunks) {
+        mCurrent = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(mChunks)
+            + kHeaderSize + 15) & ~uintptr_t(15));
+        mEnd = reinterpret_cast<char*>(mChunks) + mChunks->size;
+    } else {
+        mCurrent = NULL;
+        mEnd = NULL;
+    }
+    mLast = NULL;
+}
+
 /**
  * @brief Get the default allocator
  */
@@ -18,6 +18,9 @@ class MutableArrayHandle;
 
 class MutableByteString;
 
+template <class T>
+class InternalState;
+
 /**
  * @brief PostgreSQL memory allocator
  *
@@ -63,6 +66,14 @@ public:
         dbal::OnMemoryAllocationFailure F>
     MutableByteString allocateByteString(std::size_t inSize) const;
 
+    template <class T>
+    InternalState<T> allocateInternalState(std::size_t inStorageSize = 0)
+        const;
+
+    template <class T>
+    InternalState<T> reallocateInternalState(const InternalState<T>& inState,
+        std::size_t inStorageSize) const;
+
     template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
         dbal::OnMemoryAllocationFailure F>
     void *allocate(const size_t inSize) const;
@@ -97,6 +108,9 @@ protected:
     void *makeAligned(void *inPtr) const;
     void *unaligned(void *inPtr) const;
 
+    void *internalSystemAllocate(void *inPtr, size_t inSize, bool inZero)
+        const;
+
     template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
         dbal::OnMemoryAllocationFailure F, Allocator::ReallocateMemory R>
     void *internalAllocate(void *inPtr, const size_t inSize) const;
@@ -113,6 +127,126 @@ protected:
 
 Allocator& defaultAllocator();
 
+/**
+ * @brief Bump-pointer arena for allocations in dbal::ScratchContext
+ *
+ * There is one arena per backend. Memory is handed out from large chunks
+ * allocated in \c TopMemoryContext. Individual blocks are never freed.
+ * Instead, once the outermost C++ AL function call returns (see Scope), the
+ * arena is reset: All chunks but the first are freed, and the first chunk is
+ * reused by the next call.
+ *
+ * Each block is preceded by a 16-byte header holding its size, so that blocks
+ * stay 16-byte aligned and can be reallocated.
+ */
+class ScratchArena {
+public:
+    /**
+     * @brief Reset the arena when the outermost scope is left
+     *
+     * UDF::call() puts a Scope on the stack. Calls into the C++ AL nested
+     * within (e.g., via FunctionHandle) therefore do not reset the arena.
+     */
+    class Scope {
+    public:
+        Scope() { ++get().mDepth; }
+        ~Scope() {
+            if (--get().mDepth == 0)
+                get().reset();
+        }
+    };
+
+    static ScratchArena& get();
+
+    void *allocate(size_t inSize, bool inZero);
+    void *reallocate(void *inPtr, size_t inSize, bool inZero);
+    bool contains(const void *inPtr) const;
+
+protected:
+    /**
+     * @brief Header of a chunk. Must be a multiple of 16 bytes.
+     */
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+    };
+
+    enum {
+        kHeaderSize = 16,
+        kMinChunkSize = 64 * 1024,
+        kMaxRetainedChunkSize = 1024 * 1024
+    };
+
+    ScratchArena()
+      : mChunks(NULL), mCurrent(NULL), mEnd(NULL), mLast(NULL), mDepth(0) { }
+
+    static size_t roundUp(size_t inSize);
+    static size_t blockSize(void *inPtr);
+    void reset();
+
+    /**
+     * @brief Linked list of all chunks, the most recent one first
+     */
+    Chunk *mChunks;
+
+    /**
+     * @brief Free region of the most recent chunk
+     */
+    char *mCurrent;
+    char *mEnd;
+
+    /**
+     * @brief The most recently allocated block (which can grow in-place)
+     */
+    void *mLast;
+
+    /**
+     * @brief Number of nested Scope objects
+     */
+    unsigned int mDepth;
+};
+
+/**
+ * @brief Per-backend accounting of the memory requested through Allocator
+ *
+ * For each dbal::MemoryContext, we count the allocations (including
+ * reallocations), the bytes requested, and the largest single request. Memory
+ * is released when PostgreSQL resets its memory context, so freed memory is
+ * not accounted for. Allocations of worker threads are not counted either.
+ *
+ * A request larger than the soft limit raises a std::length_error instead of
+ * being passed on to PostgreSQL. A transition state that grows too large thus
+ * fails with an error naming the function, instead of an out-of-memory error
+ * (or swapping) once the whole segment runs out of memory.
+ *
+ * @note
+ *     This is a plain-old data (POD) type with static storage duration, so it
+ *     is zero-initialized before any code runs.
+ */
+struct MemoryStatistics {
+    enum { kNumContexts = 3 };
+
+    struct Context {
+        uint64_t numAllocations;
+        uint64_t numBytes;
+        uint64_t maxAllocation;
+    };
+
+    /**
+     * Indexed by dbal::MemoryContext
+     */
+    Context contexts[kNumContexts];
+
+    /**
+     * Largest request allowed, in bytes. 0 means no limit.
+     */
+    uint64_t limit;
+
+    static MemoryStatistics& get();
+    void record(dbal::MemoryContext inContext, size_t inSize);
+    void reset();
+};
+
 } // namespace postgres
 
 } // namespace dbconnector
@@ -42,9 +42,10 @@ public:
 
 protected:
     // UDF and FunctionHandle access getAsDatum(), which is not part of the
-    // public API
+    // public API. BlockUDF needs to pass on the transition state as mutable.
     friend class UDF;
     friend class FunctionHandle;
+    template <class RowFunction> friend class BlockUDF;
 
     /**
      * @brief Type of the value of the current AnyType object
@@ -28,6 +28,9 @@ MADLIB_WRAP_PG_FUNC(
     void*, MemoryContextAllocZero, (MemoryContext context, Size size),
     (context, size))
 
+MADLIB_WRAP_VOID_PG_FUNC(
+    pfree, (void* pointer), (pointer))
+
 MADLIB_WRAP_PG_FUNC(
     char*, format_procedure, (Oid procedure_oid), (procedure_oid))
 
@@ -72,6 +75,12 @@ MADLIB_WRAP_PG_FUNC(
         bool* foundPtr),
     (hashp, keyPtr, action, foundPtr))
 
+MADLIB_WRAP_VOID_PG_FUNC(
+    hash_seq_init, (HASH_SEQ_STATUS* status, HTAB* hashp), (status, hashp))
+
+MADLIB_WRAP_PG_FUNC(
+    void*, hash_seq_search, (HASH_SEQ_STATUS* status), (status))
+
 // Calls to SearchSysCache and related functions have been wrapped using macros
 // with commit e26c539e by Robert Haas <rhaas@postgresql.org>
 // on Sun, 14 Feb 2010 18:42:19 UTC. First release: PG9.0.
@@ -93,6 +102,22 @@ MADLIB_WRAP_PG_FUNC(
 MADLIB_WRAP_PG_FUNC(
     struct varlena*, pg_detoast_datum, (struct varlena* datum), (datum))
 
+MADLIB_WRAP_VOID_PG_FUNC(
+    CacheRegisterSyscacheCallback, (int cacheid, SyscacheCallbackFunction func,
+        Datum arg),
+    (cacheid, func, arg))
+
+inline
+MemoryContext
+madlib_AllocSetContextCreate(MemoryContext parent, const char* name) {
+    MemoryContext result = NULL;
+    MADLIB_PG_TRY {
+        result = AllocSetContextCreate(parent, name, ALLOCSET_DEFAULT_MINSIZE,
+            ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
+    } MADLIB_PG_DEFAULT_CATCH_AND_END_TRY;
+    return result;
+}
+
 
 inline
 void
@@ -123,6 +148,48 @@ madlib_detoast_verlena_datum_if_necessary(Datum inDatum) {
         return reinterpret_cast<T*>(madlib_pg_detoast_datum(ptr));
 }
 
+/**
+ * @brief Detoast all compressed or out-of-line arguments of a call at once
+ *
+ * Detoasting may raise a PostgreSQL error, so each call of
+ * madlib_pg_detoast_datum() costs a PG_TRY block (i.e., a sigsetjmp()).
+ * Instead of paying this once per toasted argument when the arguments are
+ * fetched, this function replaces all toasted arguments by their detoasted
+ * values within a single PG_TRY block. If no argument is toasted (the common
+ * case), no PG_TRY block is entered at all.
+ *
+ * Arguments that only have a short varlena header are left alone, because
+ * mapForReadOnlyAccess() unpacks them more cheaply.
+ *
+ * @param fcinfo The call whose arguments are detoasted in place
+ * @param inVarlenaArgs Bit mask of the arguments that may be toasted (see
+ *     FunctionInformation::varlenaArgs)
+ */
+inline
+void
+madlib_detoast_arguments(FunctionCallInfo fcinfo, uint64_t inVarlenaArgs) {
+    uint64_t toasted = 0;
+    for (uint16_t i = 0; i < fcinfo->nargs && i < 64; ++i) {
+        if (!(inVarlenaArgs & (uint64_t(1) << i)) || fcinfo->argnull[i])
+            continue;
+
+        varlena* ptr = reinterpret_cast<varlena*>(
+            DatumGetPointer(fcinfo->arg[i]));
+        if (VARATT_IS_EXTERNAL(ptr) || VARATT_IS_COMPRESSED(ptr))
+            toasted |= uint64_t(1) << i;
+    }
+    if (toasted == 0)
+        return;
+
+    MADLIB_PG_TRY {
+        for (uint16_t i = 0; i < fcinfo->nargs && i < 64; ++i)
+            if (toasted & (uint64_t(1) << i))
+                fcinfo->arg[i] = PointerGetDatum(pg_detoast_datum(
+                    reinterpret_cast<varlena*>(
+                        DatumGetPointer(fcinfo->arg[i]))));
+    } MADLIB_PG_DEFAULT_CATCH_AND_END_TRY;
+}
+
 /**
  * @brief Convert a Datum into a bytea
  *
@@ -147,6 +214,38 @@ madlib_DatumGetArrayTypeP(Datum inDatum) {
     return madlib_detoast_verlena_datum_if_necessary<ArrayType>(inDatum);
 }
 
+/**
+ * @brief Report (at log level DEBUG1) how many arguments had to be copied
+ *
+ * @see cloneForMutableAccess()
+ */
+inline
+void
+madlib_reportMutableClones(Oid inFuncID, uint64_t inNumClones) {
+    MADLIB_PG_TRY {
+        elog(DEBUG1, "Function \"%s\": Copied mutable arguments "
+            UINT64_FORMAT " times", format_procedure(inFuncID), inNumClones);
+    } MADLIB_PG_DEFAULT_CATCH_AND_END_TRY;
+}
+
+/**
+ * @brief Report (at log level DEBUG2) how many array arguments were used
+ *     without a palloc() copy
+ *
+ * @see mapForReadOnlyAccess()
+ */
+inline
+void
+madlib_reportArrayCopiesAvoided(Oid inFuncID, uint64_t inNumMappedInPlace,
+    uint64_t inNumUnpacked) {
+    MADLIB_PG_TRY {
+        elog(DEBUG2, "Function \"%s\": Mapped array arguments in place "
+            UINT64_FORMAT " times and unpacked short arrays without copy "
+            UINT64_FORMAT " times", format_procedure(inFuncID),
+            inNumMappedInPlace, inNumUnpacked);
+    } MADLIB_PG_DEFAULT_CATCH_AND_END_TRY;
+}
+
 } // namespace
 
 } // namespace postgres
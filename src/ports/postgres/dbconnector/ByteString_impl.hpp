@@ -63,6 +63,17 @@ MutableByteString::byteString() {
     return const_cast<bytea*>(Base::mByteString);
 }
 
+/**
+ * @brief Change the size of the byte string without reallocating it
+ *
+ * The memory block of the byte string must be large enough.
+ */
+inline
+void
+MutableByteString::setSize(size_t inSize) {
+    SET_VARSIZE(byteString(), kEffectiveHeaderSize + inSize);
+}
+
 inline
 ByteString::char_type&
 MutableByteString::operator[](size_t inIndex) {
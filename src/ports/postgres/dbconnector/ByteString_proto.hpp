@@ -49,6 +49,7 @@ public:
 
     char_type* ptr();
     bytea* byteString();
+    void setSize(size_t inSize);
     char_type& operator[](size_t inIndex);
 };
 
@@ -16,10 +16,22 @@ namespace postgres {
 namespace {
 // No need to make these function accessible outside of the postgres namespace.
 
+#ifndef FLOAT4ARRAYOID
+    #define FLOAT4ARRAYOID 1021
+#endif
+
 #ifndef FLOAT8ARRAYOID
     #define FLOAT8ARRAYOID 1022
 #endif
 
+#ifndef INT4ARRAYOID
+    #define INT4ARRAYOID 1007
+#endif
+
+#ifndef INT8ARRAYOID
+    #define INT8ARRAYOID 1016
+#endif
+
 #ifndef PG_GET_COLLATION
 // See madlib_InitFunctionCallInfoData()
 #define PG_GET_COLLATION()	InvalidOid
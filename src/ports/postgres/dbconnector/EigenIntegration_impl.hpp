@@ -94,6 +94,79 @@ HandleMap<Matrix, MutableArrayHandle<double> >::rebind(
     return rebind(inHandle, inHandle.sizeOfDim(1), inHandle.sizeOfDim(0));
 }
 
+/**
+ * @brief Initialize HandleMap backed by the given single-precision handle
+ *
+ * Same layout as for double precision: Index 0 is the number of columns, and
+ * index 1 is the number of rows.
+ */
+template <>
+inline
+HandleMap<const FloatMatrix, ArrayHandle<float> >::HandleMap(
+    const ArrayHandle<float>& inHandle)
+  : Base(const_cast<float*>(inHandle.ptr()), inHandle.sizeOfDim(1),
+        inHandle.sizeOfDim(0)),
+    mMemoryHandle(inHandle) { }
+
+/**
+ * @brief Initialize HandleMap backed by the given single-precision handle
+ */
+template <>
+inline
+HandleMap<FloatMatrix, MutableArrayHandle<float> >::HandleMap(
+    const MutableArrayHandle<float>& inHandle)
+  : Base(const_cast<float*>(inHandle.ptr()), inHandle.sizeOfDim(1),
+        inHandle.sizeOfDim(0)),
+    mMemoryHandle(inHandle) { }
+
+/**
+ * @brief Rebind HandleMap to a different one-dimensional array
+ */
+template <>
+inline
+HandleMap<const FloatColumnVector, ArrayHandle<float> >&
+HandleMap<const FloatColumnVector, ArrayHandle<float> >::rebind(
+    const ArrayHandle<float>& inHandle) {
+
+    return rebind(inHandle, inHandle.sizeOfDim(0));
+}
+
+/**
+ * @brief Rebind HandleMap to a different one-dimensional array
+ */
+template <>
+inline
+HandleMap<FloatColumnVector, MutableArrayHandle<float> >&
+HandleMap<FloatColumnVector, MutableArrayHandle<float> >::rebind(
+    const MutableArrayHandle<float>& inHandle) {
+
+    return rebind(inHandle, inHandle.sizeOfDim(0));
+}
+
+/**
+ * @brief Rebind HandleMap to a different two-dimensional array
+ */
+template <>
+inline
+HandleMap<const FloatMatrix, ArrayHandle<float> >&
+HandleMap<const FloatMatrix, ArrayHandle<float> >::rebind(
+    const ArrayHandle<float>& inHandle) {
+
+    return rebind(inHandle, inHandle.sizeOfDim(1), inHandle.sizeOfDim(0));
+}
+
+/**
+ * @brief Rebind HandleMap to a different two-dimensional array
+ */
+template <>
+inline
+HandleMap<FloatMatrix, MutableArrayHandle<float> >&
+HandleMap<FloatMatrix, MutableArrayHandle<float> >::rebind(
+    const MutableArrayHandle<float>& inHandle) {
+
+    return rebind(inHandle, inHandle.sizeOfDim(1), inHandle.sizeOfDim(0));
+}
+
 } // namespace eigen_integration
 
 } // namespace dbal
@@ -103,6 +176,8 @@ namespace dbconnector {
 
 namespace postgres {
 
+#if !defined(MADLIB_NO_LEGACY_SVEC)
+
 /**
  * @brief Convert a run-length encoded Greenplum sparse vector to an Eigen
  *     sparse vector
@@ -205,6 +280,26 @@ SparseColumnVectorToLegacySparseVector(
     return svec_from_sparsedata(sdata, true /* trim */);
 }
 
+#endif // !defined(MADLIB_NO_LEGACY_SVEC)
+
+/**
+ * @brief Convert an Eigen sparse matrix to a byte string that can be read
+ *     with MappedSparseMatrix
+ */
+inline
+bytea*
+SparseMatrixToNativeByteString(
+    const dbal::eigen_integration::SparseMatrix &inMatrix) {
+
+    MutableByteString byteString = defaultAllocator().allocateByteString<
+        dbal::FunctionContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+            dbal::eigen_integration::MappedSparseMatrix::storageSize(
+                inMatrix.rows(), inMatrix.cols(), inMatrix.nonZeros()));
+    dbal::eigen_integration::writeCompressedSparseMatrix(inMatrix,
+        byteString.ptr());
+    return byteString.byteString();
+}
+
 /**
  * @brief Convert an Eigen row or column vector to a one-dimensional
  *     PostgreSQL array
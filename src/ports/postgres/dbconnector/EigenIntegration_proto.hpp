@@ -29,6 +29,24 @@ typedef HandleMap<ColumnVector, MutableArrayHandle<double> >
 typedef HandleMap<const Matrix, ArrayHandle<double> > MappedMatrix;
 typedef HandleMap<Matrix, MutableArrayHandle<double> > MutableMappedMatrix;
 
+template <>
+HandleMap<const FloatMatrix, ArrayHandle<float> >::HandleMap(
+    const ArrayHandle<float>& inHandle);
+
+template <>
+HandleMap<FloatMatrix, MutableArrayHandle<float> >::HandleMap(
+    const MutableArrayHandle<float>& inHandle);
+
+typedef HandleMap<const FloatColumnVector, ArrayHandle<float> >
+    MappedFloatColumnVector;
+typedef HandleMap<FloatColumnVector, MutableArrayHandle<float> >
+    MutableMappedFloatColumnVector;
+typedef HandleMap<const FloatMatrix, ArrayHandle<float> > MappedFloatMatrix;
+typedef HandleMap<FloatMatrix, MutableArrayHandle<float> >
+    MutableMappedFloatMatrix;
+
+typedef SparseHandleMap<ByteString> MappedSparseMatrix;
+
 } // namespace dbal
 
 } // namespace eigen_integration
@@ -38,11 +56,18 @@ namespace dbconnector {
 
 namespace postgres {
 
+// Legacy sparse vectors are only available inside the backend (see
+// src/bench for a connector without them)
+#if !defined(MADLIB_NO_LEGACY_SVEC)
 Eigen::SparseVector<double> LegacySparseVectorToSparseColumnVector(
     SvecType* inVec);
 
 SvecType* SparseColumnVectorToLegacySparseVector(
     const Eigen::SparseVector<double> &inVec);
+#endif // !defined(MADLIB_NO_LEGACY_SVEC)
+
+bytea* SparseMatrixToNativeByteString(
+    const dbal::eigen_integration::SparseMatrix &inMatrix);
 
 template <typename Derived>
 ArrayType* VectorToNativeArray(const Eigen::MatrixBase<Derived>& inVector);
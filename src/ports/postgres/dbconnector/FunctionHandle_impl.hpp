@@ -28,6 +28,19 @@ FunctionHandle::funcID() const {
     return mFuncInfo->oid;
 }
 
+/**
+ * @brief Return the C++ function implementing this function, if known
+ *
+ * The pointer is cached as soon as the function has been called through the
+ * backend once (see UDF::call()). It is NULL if the function is not
+ * implemented on top of the C++ AL or has not yet been called.
+ */
+inline
+FunctionHandle::Pointer
+FunctionHandle::funcPtr() const {
+    return mFuncInfo->cxx_func;
+}
+
 inline
 void
 FunctionHandle::setFunctionCallOptions(uint32_t inFlags) {
@@ -153,6 +166,133 @@ FunctionHandle::getSysInfo() const {
     return mSysInfo;
 }
 
+/**
+ * @brief Set up a call of a function with the given number of arguments
+ *
+ * The arguments are initialized to Null.
+ */
+inline
+PreparedFunctionCall::PreparedFunctionCall(const FunctionHandle& inFunction,
+    uint16_t inNumArgs)
+  : mSysInfo(inFunction.mSysInfo),
+    mFuncInfo(inFunction.mFuncInfo),
+    mReturnTypeInfo(mSysInfo->typeInformation(mFuncInfo->rettype)),
+    mCallContext(NULL) {
+
+    if (inNumArgs > mFuncInfo->nargs)
+        throw std::invalid_argument(std::string("More arguments given than "
+            "expected by '") + functionName() + "'.");
+
+    madlib_InitFunctionCallInfoData(mCallInfo, mFuncInfo->getFuncMgrInfo(),
+        inNumArgs, mSysInfo->collationOID, NULL, NULL);
+
+    for (uint16_t i = 0; i < inNumArgs; ++i) {
+        mArgTypes[i] = mFuncInfo->getArgumentType(i);
+        mArgs[i] = 0;
+        mCallInfo.argnull[i] = true;
+    }
+
+    if (inFunction.mFuncCallOptions & FunctionHandle::GarbageCollectionAfterCall)
+        mCallContext = madlib_AllocSetContextCreate(CurrentMemoryContext,
+            "C++ AL / PreparedFunctionCall memory context");
+}
+
+inline
+PreparedFunctionCall::~PreparedFunctionCall() {
+    if (mCallContext)
+        MemoryContextDelete(mCallContext);
+}
+
+/**
+ * @brief Set an argument, converting it to the argument type of the function
+ */
+inline
+void
+PreparedFunctionCall::setArgument(uint16_t inArgID, const AnyType& inValue) {
+    madlib_assert(inArgID < mCallInfo.nargs, std::logic_error(
+        "PreparedFunctionCall::setArgument() called with invalid argument "
+        "index."));
+
+    mArgs[inArgID] = inValue.getAsDatum(&mCallInfo, mArgTypes[inArgID]);
+    mCallInfo.argnull[inArgID] = inValue.isNull();
+}
+
+/**
+ * @brief Set a DOUBLE PRECISION argument without going through AnyType
+ */
+inline
+void
+PreparedFunctionCall::setArgument(uint16_t inArgID, double inValue) {
+    madlib_assert(inArgID < mCallInfo.nargs, std::logic_error(
+        "PreparedFunctionCall::setArgument() called with invalid argument "
+        "index."));
+
+    if (mArgTypes[inArgID] != FLOAT8OID) {
+        setArgument(inArgID, AnyType(inValue));
+        return;
+    }
+
+    // BACKEND: Float8GetDatum() only palloc's if FLOAT8 is not passed by
+    // value, and palloc raises an error only if out of memory
+    mArgs[inArgID] = Float8GetDatum(inValue);
+    mCallInfo.argnull[inArgID] = false;
+}
+
+/**
+ * @brief Call the function with the current arguments
+ *
+ * The result is copied to the memory context that is current when calling
+ * invoke(). All other memory allocated by the function is freed before
+ * returning (unless garbage collection has been disabled for the
+ * FunctionHandle).
+ */
+inline
+AnyType
+PreparedFunctionCall::invoke() {
+    // If function is strict, we must not call the function at all
+    if (mFuncInfo->isstrict)
+        for (uint16_t i = 0; i < mCallInfo.nargs; ++i)
+            if (mCallInfo.argnull[i])
+                return AnyType();
+
+    std::copy(mArgs, mArgs + mCallInfo.nargs, mCallInfo.arg);
+
+    // The called function may set these fields
+    mCallInfo.isnull = false;
+    mCallInfo.resultinfo = NULL;
+
+    MemoryContext oldContext = NULL;
+    if (mCallContext)
+        oldContext = MemoryContextSwitchTo(mCallContext);
+
+    Datum result = 0;
+    MADLIB_PG_TRY {
+        result = FunctionCallInvoke(&mCallInfo);
+    } MADLIB_PG_CATCH {
+        throw std::runtime_error(std::string("Exception while invoking '")
+            + functionName() + "'. Error was:\n"
+            + MADLIB_PG_ERROR_DATA()->message);
+    } MADLIB_PG_END_TRY;
+
+    if (oldContext) {
+        MemoryContextSwitchTo(oldContext);
+        if (!mCallInfo.isnull)
+            result = datumCopy(result, mReturnTypeInfo->isByValue(),
+                mReturnTypeInfo->getLen());
+        MemoryContextReset(mCallContext);
+    }
+
+    return mCallInfo.isnull
+        ? AnyType()
+        : AnyType(mSysInfo, result, mFuncInfo->rettype, /* isMutable */ true);
+}
+
+inline
+std::string
+PreparedFunctionCall::functionName() const {
+    return mSysInfo->functionInformation(mFuncInfo->oid)->getFullName();
+}
+
 } // namespace postgres
 
 } // namespace dbconnector
@@ -15,11 +15,15 @@ namespace postgres {
 
 struct SystemInformation;
 struct FunctionInformation;
+struct TypeInformation;
 
 class FunctionHandle {
 public:
     enum { isMutable = false };
 
+    // Same as UDF::Pointer, which is not yet declared at this point
+    typedef AnyType (*Pointer)(FunctionCallInfo, AnyType&);
+
     enum FunctionCallOption {
         GarbageCollectionAfterCall = 0x01
     };
@@ -27,6 +31,7 @@ public:
     FunctionHandle(SystemInformation* inSysInfo, Oid inFuncID);
 
     Oid funcID() const;
+    Pointer funcPtr() const;
     void setFunctionCallOptions(uint32_t inFlags);
     uint32_t getFunctionCallOptions() const;
     AnyType invoke(AnyType& args);
@@ -42,6 +47,7 @@ public:
 protected:
     template <typename T>
     friend struct TypeTraits;
+    friend class PreparedFunctionCall;
 
     SystemInformation* getSysInfo() const;
 
@@ -50,6 +56,56 @@ protected:
     uint32_t mFuncCallOptions;
 };
 
+/**
+ * @brief A call of a FunctionHandle that is set up once and invoked many times
+ *
+ * FunctionHandle::invoke() looks up the argument types, initializes the call
+ * information, and creates (and deletes) a memory context each time. When the
+ * same function is called repeatedly within one UDF (e.g., a metric that is
+ * called once per column of a matrix), all of this only needs to be done
+ * once: Each invocation then only consists of storing the arguments that have
+ * changed, calling the function through its FmgrInfo, and resetting the
+ * memory context.
+ *
+ * Arguments keep their value between invocations, so arguments that do not
+ * change only need to be converted to a Datum once.
+ *
+ * @note
+ *     Arguments are converted in the memory context that is current when
+ *     calling setArgument(), so they live as long as the calling UDF does.
+ */
+class PreparedFunctionCall {
+public:
+    PreparedFunctionCall(const FunctionHandle& inFunction, uint16_t inNumArgs);
+    ~PreparedFunctionCall();
+
+    void setArgument(uint16_t inArgID, const AnyType& inValue);
+    void setArgument(uint16_t inArgID, double inValue);
+    AnyType invoke();
+
+private:
+    // Not copyable: The call information is referenced by the arguments
+    PreparedFunctionCall(const PreparedFunctionCall&);
+    PreparedFunctionCall& operator=(const PreparedFunctionCall&);
+
+    std::string functionName() const;
+
+    SystemInformation* mSysInfo;
+    FunctionInformation* mFuncInfo;
+    TypeInformation* mReturnTypeInfo;
+    MemoryContext mCallContext;
+    FunctionCallInfoData mCallInfo;
+    Oid mArgTypes[FUNC_MAX_ARGS];
+
+    /**
+     * The arguments as set by setArgument(). The called function may replace
+     * the arguments in mCallInfo (e.g., by detoasted copies that do not
+     * survive the reset of the memory context), so they are copied before
+     * each call.
+     */
+    Datum mArgs[FUNC_MAX_ARGS];
+};
+
 } // namespace postgres
 
 } // namespace dbconnector
@@ -0,0 +1,152 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file FunctionStatistics.cpp
+ *
+ * @brief Per-backend call counters and CPU-time histograms of the C++ AL
+ *
+ * The statistics are kept in a hash table that lives in its own memory
+ * context below \c TopMemoryContext, i.e., as long as the backend. Each
+ * backend (and, on Greenplum, each segment) only sees its own calls.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+// We do not write #include "dbconnector.hpp" here because we want to rely on
+// the search paths, which might point to a port-specific dbconnector.hpp
+#include <dbconnector/dbconnector.hpp>
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+namespace {
+
+/**
+ * @brief Upper limit for setSamplingInterval()
+ */
+enum { kMaxSamplingInterval = 1000000 };
+
+/**
+ * @brief One in sSamplingInterval calls of each function is timed
+ *
+ * The default keeps the overhead well below one percent even for functions
+ * that take only a few hundred nanoseconds, such as transition functions.
+ */
+int sSamplingInterval = 64;
+
+HTAB* sFunctionStatistics = NULL;
+
+HTAB*
+functionStatisticsTable() {
+    if (sFunctionStatistics == NULL) {
+        HASHCTL ctl;
+        ctl.keysize = sizeof(Oid);
+        ctl.entrysize = sizeof(FunctionStatistics);
+        ctl.hash = oid_hash;
+        ctl.hcxt = madlib_AllocSetContextCreate(TopMemoryContext,
+            "C++ AL / FunctionStatistics");
+        sFunctionStatistics = madlib_hash_create(
+            "C++ AL function statistics", 128, &ctl,
+            HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+    }
+    return sFunctionStatistics;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Return the statistics of a function, creating an empty entry if
+ *     there is none yet
+ */
+FunctionStatistics*
+FunctionStatistics::get(Oid inFuncID) {
+    bool found;
+    FunctionStatistics* entry = static_cast<FunctionStatistics*>(
+        madlib_hash_search(functionStatisticsTable(), &inFuncID, HASH_ENTER,
+            &found));
+    if (!found) {
+        // entry->oid is already set
+        entry->numCalls = 0;
+        entry->numTimedCalls = 0;
+        entry->cpuTime = 0;
+        entry->numCallsUntilSample = 0;
+        std::fill(entry->histogram, entry->histogram + kNumBuckets, 0);
+    }
+    return entry;
+}
+
+/**
+ * @brief Return a copy of the statistics of all functions called so far
+ */
+std::vector<FunctionStatistics>
+allFunctionStatistics() {
+    std::vector<FunctionStatistics> result;
+    HASH_SEQ_STATUS status;
+    madlib_hash_seq_init(&status, functionStatisticsTable());
+    while (FunctionStatistics* entry = static_cast<FunctionStatistics*>(
+            madlib_hash_seq_search(&status)))
+        result.push_back(*entry);
+    return result;
+}
+
+/**
+ * @brief Set all counters to zero
+ *
+ * Entries are not removed, because call sites hold pointers to them.
+ */
+void
+resetFunctionStatistics() {
+    HASH_SEQ_STATUS status;
+    madlib_hash_seq_init(&status, functionStatisticsTable());
+    while (FunctionStatistics* entry = static_cast<FunctionStatistics*>(
+            madlib_hash_seq_search(&status))) {
+        entry->numCalls = 0;
+        entry->numTimedCalls = 0;
+        entry->cpuTime = 0;
+        entry->numCallsUntilSample = 0;
+        std::fill(entry->histogram,
+            entry->histogram + FunctionStatistics::kNumBuckets, 0);
+    }
+}
+
+/**
+ * @brief Return the sampling interval of the CPU time (0 if not timed)
+ */
+int
+samplingInterval() {
+    return sSamplingInterval;
+}
+
+/**
+ * @brief Set the sampling interval of the CPU time
+ *
+ * @param inInterval Time one in \c inInterval calls of each function. 0
+ *     disables timing, but calls are still counted.
+ * @return The previous sampling interval
+ */
+int
+setSamplingInterval(int inInterval) {
+    if (inInterval < 0 || inInterval > kMaxSamplingInterval)
+        throw std::invalid_argument("Sampling interval must be between 0 and "
+            "1000000.");
+
+    int previous = sSamplingInterval;
+    sSamplingInterval = inInterval;
+
+    // The next call of each function is timed (or sets the countdown of the
+    // new interval)
+    HASH_SEQ_STATUS status;
+    madlib_hash_seq_init(&status, functionStatisticsTable());
+    while (FunctionStatistics* entry = static_cast<FunctionStatistics*>(
+            madlib_hash_seq_search(&status)))
+        entry->numCallsUntilSample = 0;
+
+    return previous;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
@@ -0,0 +1,74 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file FunctionStatistics_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_FUNCTIONSTATISTICS_IMPL_HPP
+#define MADLIB_POSTGRES_FUNCTIONSTATISTICS_IMPL_HPP
+
+#include <ctime>
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Count a call and return whether it is to be timed
+ */
+inline
+bool
+FunctionStatistics::beginCall() {
+    ++numCalls;
+    if (numCallsUntilSample > 0) {
+        --numCallsUntilSample;
+        return false;
+    }
+
+    // A sampling interval of 0 disables timing until setSamplingInterval()
+    // resets the countdown of all entries
+    int interval = samplingInterval();
+    numCallsUntilSample = interval > 0
+        ? static_cast<uint64_t>(interval - 1)
+        : std::numeric_limits<uint64_t>::max();
+    return interval > 0;
+}
+
+/**
+ * @brief Add the CPU time (in nanoseconds) of a timed call
+ */
+inline
+void
+FunctionStatistics::endTimedCall(uint64_t inCPUTime) {
+    ++numTimedCalls;
+    cpuTime += inCPUTime;
+
+    int bucket = 0;
+    for (uint64_t micros = inCPUTime / 2000; micros > 0 && bucket
+            < kNumBuckets - 1; micros >>= 1)
+        ++bucket;
+    ++histogram[bucket];
+}
+
+/**
+ * @brief CPU time of this process (all threads), in nanoseconds
+ */
+inline
+uint64_t
+FunctionStatistics::cpuClock() {
+    struct timespec now;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) != 0)
+        return 0;
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000
+        + static_cast<uint64_t>(now.tv_nsec);
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_FUNCTIONSTATISTICS_IMPL_HPP)
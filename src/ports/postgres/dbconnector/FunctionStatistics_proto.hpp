@@ -0,0 +1,78 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file FunctionStatistics_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_FUNCTIONSTATISTICS_PROTO_HPP
+#define MADLIB_POSTGRES_FUNCTIONSTATISTICS_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Per-backend call counter and CPU-time histogram of a function
+ *
+ * UDF::call() counts every call of a function implemented on top of the C++
+ * AL. Only one in samplingInterval() calls is timed, so that the statistics
+ * can stay enabled in production: Reading the CPU clock costs more than
+ * counting. The CPU time includes the worker threads of parallelFor().
+ *
+ * Entries live as long as the backend and never move, so call sites keep a
+ * pointer to them (see FunctionInformation::statistics).
+ *
+ * @note
+ *     This is a plain-old data (POD) type. It is stored in a dynahash table.
+ */
+struct FunctionStatistics {
+    /**
+     * Number of histogram buckets. Bucket \f$ k > 0 \f$ counts timed calls
+     * that took between \f$ 2^k \f$ and \f$ 2^{k+1} \f$ microseconds of CPU
+     * time, bucket 0 those below 2 microseconds, and the last bucket all
+     * longer calls.
+     */
+    enum { kNumBuckets = 20 };
+
+    /**
+     * OID and hash key. Must be the first element.
+     */
+    Oid oid;
+
+    uint64_t numCalls;
+    uint64_t numTimedCalls;
+
+    /**
+     * Total CPU time of the timed calls, in nanoseconds
+     */
+    uint64_t cpuTime;
+
+    /**
+     * Number of calls until the next timed call
+     */
+    uint64_t numCallsUntilSample;
+
+    uint64_t histogram[kNumBuckets];
+
+    static FunctionStatistics* get(Oid inFuncID);
+
+    bool beginCall();
+    void endTimedCall(uint64_t inCPUTime);
+
+    static uint64_t cpuClock();
+};
+
+std::vector<FunctionStatistics> allFunctionStatistics();
+void resetFunctionStatistics();
+int samplingInterval();
+int setSamplingInterval(int inInterval);
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_FUNCTIONSTATISTICS_PROTO_HPP)
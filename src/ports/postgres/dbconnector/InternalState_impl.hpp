@@ -0,0 +1,69 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file InternalState_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_INTERNALSTATE_IMPL_HPP
+#define MADLIB_POSTGRES_INTERNALSTATE_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+template <class T>
+inline
+InternalState<T>::InternalState(T* inPtr)
+  : mPtr(inPtr) { }
+
+template <class T>
+inline
+T*
+InternalState<T>::ptr() const {
+    return mPtr;
+}
+
+template <class T>
+inline
+T*
+InternalState<T>::operator->() const {
+    return mPtr;
+}
+
+template <class T>
+inline
+T&
+InternalState<T>::operator*() const {
+    return *mPtr;
+}
+
+/**
+ * @brief Return the (16-byte aligned) storage following the object
+ */
+template <class T>
+template <class U>
+inline
+U*
+InternalState<T>::storage() const {
+    return reinterpret_cast<U*>(reinterpret_cast<char*>(mPtr) + headerSize());
+}
+
+/**
+ * @brief Size of the object, rounded up so that the storage is 16-byte aligned
+ */
+template <class T>
+inline
+std::size_t
+InternalState<T>::headerSize() {
+    return (sizeof(T) + 15) & ~static_cast<std::size_t>(15);
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_INTERNALSTATE_IMPL_HPP)
@@ -0,0 +1,68 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file InternalState_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_INTERNALSTATE_PROTO_HPP
+#define MADLIB_POSTGRES_INTERNALSTATE_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Handle of a C++ object that is the transition state of an aggregate
+ *     with <tt>STYPE=internal</tt>
+ *
+ * Transition states that are SQL values (e.g., <tt>DOUBLE PRECISION[]</tt>)
+ * have to store all fields as elements of the array. An internal state is a
+ * plain C++ object, allocated once in the aggregate memory context (see
+ * Allocator::allocateInternalState()), and the backend only passes around a
+ * pointer to it. Fields keep their native types, and there is no array header
+ * to check on each call.
+ *
+ * The object may be followed by storage of variable size (e.g., for a matrix
+ * whose dimensions are only known once the first row has been seen). Since
+ * the storage is part of the same memory block, it must be accessed through
+ * storage() and never through a pointer kept in the object.
+ *
+ * @tparam T A type with a trivial destructor: The memory is freed by the
+ *     backend when the aggregate context is reset, without calling any
+ *     destructor. In particular, T must not hold Eigen matrices or other
+ *     members that allocate memory themselves.
+ *
+ * @note
+ *     A state of type internal cannot leave the backend process. It can
+ *     therefore only be used where the DBMS never merges transition states
+ *     computed in different processes.
+ */
+template <class T>
+class InternalState {
+public:
+    enum { isMutable = dbal::Mutable };
+
+    InternalState(T* inPtr = NULL);
+
+    T* ptr() const;
+    T* operator->() const;
+    T& operator*() const;
+
+    template <class U>
+    U* storage() const;
+
+    static std::size_t headerSize();
+
+protected:
+    T* mPtr;
+};
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_INTERNALSTATE_PROTO_HPP)
@@ -0,0 +1,184 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ModelCache.cpp
+ *
+ * @brief Per-backend cache of detoasted model arrays
+ *
+ * Scoring queries that are issued many times per second (e.g., one row at a
+ * time) spend most of their time fetching the model from the TOAST table and
+ * decompressing it, once per query. The cache keeps the detoasted arrays of
+ * the most recently used toasted arguments, keyed by their stored
+ * representation, in its own memory context below \c TopMemoryContext. A
+ * TOAST pointer identifies the value it points to (by the OID of the TOAST
+ * table and the OID of the value), so an updated model has a different key,
+ * and stale entries are simply never found again before they are evicted.
+ *
+ * Each backend (and, on Greenplum, each segment) has its own cache. There is
+ * no cache in shared memory, because that would require MADlib to be loaded
+ * with \c shared_preload_libraries.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+// We do not write #include "dbconnector.hpp" here because we want to rely on
+// the search paths, which might point to a port-specific dbconnector.hpp
+#include <dbconnector/dbconnector.hpp>
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+namespace {
+
+/**
+ * @brief Maximum number of entries, so that a lookup stays cheap
+ */
+enum { kMaxEntries = 32 };
+
+/**
+ * @brief One cached model
+ *
+ * The struct is followed by the stored representation (the key) and the
+ * detoasted array, in a single block of the cache's memory context.
+ */
+struct ModelCacheEntry {
+    size_t storedSize;
+    size_t numBytes;
+    uint64_t lastUse;
+    ArrayType* array;
+};
+
+MemoryContext sContext = NULL;
+ModelCacheEntry* sEntries[kMaxEntries];
+int sNumEntries = 0;
+uint64_t sClock = 0;
+
+/**
+ * @brief Default capacity of 64 MB (per backend)
+ */
+ModelCacheStatistics sStatistics = { 0, 0, 64 << 20, 0, 0, 0 };
+
+void
+removeEntry(int inIndex) {
+    sStatistics.numBytes -= sEntries[inIndex]->numBytes;
+    madlib_pfree(sEntries[inIndex]);
+    sEntries[inIndex] = sEntries[--sNumEntries];
+    sStatistics.numEntries = static_cast<uint64_t>(sNumEntries);
+}
+
+/**
+ * @brief Evict the least-recently used entry
+ */
+void
+evictOldest() {
+    int oldest = 0;
+    for (int i = 1; i < sNumEntries; ++i)
+        if (sEntries[i]->lastUse < sEntries[oldest]->lastUse)
+            oldest = i;
+    removeEntry(oldest);
+    ++sStatistics.numEvictions;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Return the cached detoasted array of a stored (toasted) argument, or
+ *     NULL if it is not cached
+ *
+ * The array is only valid until the next call of cacheModel() or
+ * setModelCacheCapacity(), so callers copy it (see
+ * UDF::cachedArrayArgument()).
+ */
+const ArrayType*
+findCachedModel(const void* inStored, size_t inStoredSize) {
+    for (int i = 0; i < sNumEntries; ++i) {
+        ModelCacheEntry* entry = sEntries[i];
+        if (entry->storedSize == inStoredSize
+            && std::memcmp(entry + 1, inStored, inStoredSize) == 0) {
+
+            entry->lastUse = ++sClock;
+            ++sStatistics.numHits;
+            return entry->array;
+        }
+    }
+    ++sStatistics.numMisses;
+    return NULL;
+}
+
+/**
+ * @brief Add the detoasted array of a stored argument to the cache
+ *
+ * Arrays larger than the capacity are not cached.
+ */
+void
+cacheModel(const void* inStored, size_t inStoredSize,
+    const ArrayType* inArray) {
+
+    size_t arrayOffset = MAXALIGN(sizeof(ModelCacheEntry) + inStoredSize);
+    size_t numBytes = arrayOffset + VARSIZE(inArray);
+    if (numBytes > sStatistics.capacity)
+        return;
+
+    if (sContext == NULL)
+        sContext = madlib_AllocSetContextCreate(TopMemoryContext,
+            "C++ AL / ModelCache");
+    while (sNumEntries > 0 && (sNumEntries == kMaxEntries
+            || sStatistics.numBytes + numBytes > sStatistics.capacity))
+        evictOldest();
+
+    ModelCacheEntry* entry = static_cast<ModelCacheEntry*>(
+        madlib_MemoryContextAlloc(sContext, numBytes));
+    entry->storedSize = inStoredSize;
+    entry->numBytes = numBytes;
+    entry->lastUse = ++sClock;
+    std::memcpy(entry + 1, inStored, inStoredSize);
+    entry->array = reinterpret_cast<ArrayType*>(
+        reinterpret_cast<char*>(entry) + arrayOffset);
+    std::memcpy(entry->array, inArray, VARSIZE(inArray));
+
+    sEntries[sNumEntries++] = entry;
+    sStatistics.numEntries = static_cast<uint64_t>(sNumEntries);
+    sStatistics.numBytes += numBytes;
+}
+
+/**
+ * @brief Return a copy of the counters
+ */
+ModelCacheStatistics
+modelCacheStatistics() {
+    return sStatistics;
+}
+
+/**
+ * @brief Set the hit, miss, and eviction counters to zero
+ *
+ * The cached models are kept.
+ */
+void
+resetModelCacheStatistics() {
+    sStatistics.numHits = 0;
+    sStatistics.numMisses = 0;
+    sStatistics.numEvictions = 0;
+}
+
+/**
+ * @brief Set the capacity (in bytes) and return the previous one
+ *
+ * Entries are evicted until the cache fits. A capacity of 0 disables the
+ * cache.
+ */
+size_t
+setModelCacheCapacity(size_t inBytes) {
+    size_t previous = static_cast<size_t>(sStatistics.capacity);
+    sStatistics.capacity = inBytes;
+    while (sNumEntries > 0 && sStatistics.numBytes > sStatistics.capacity)
+        evictOldest();
+    return previous;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
@@ -0,0 +1,43 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ModelCache_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_MODELCACHE_PROTO_HPP
+#define MADLIB_POSTGRES_MODELCACHE_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Counters of the per-backend model cache
+ *
+ * See findCachedModel().
+ */
+struct ModelCacheStatistics {
+    uint64_t numEntries;
+    uint64_t numBytes;
+    uint64_t capacity;
+    uint64_t numHits;
+    uint64_t numMisses;
+    uint64_t numEvictions;
+};
+
+const ArrayType* findCachedModel(const void* inStored, size_t inStoredSize);
+void cacheModel(const void* inStored, size_t inStoredSize,
+    const ArrayType* inArray);
+ModelCacheStatistics modelCacheStatistics();
+void resetModelCacheStatistics();
+size_t setModelCacheCapacity(size_t inBytes);
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_MODELCACHE_PROTO_HPP)
@@ -37,6 +37,21 @@ NativeRandomNumberGenerator::operator()() {
     return DatumGetFloat8(DirectFunctionCall1(drandom, Datum(0)));
 }
 
+/**
+ * @brief Generate inNumValues values, as if by calling operator() repeatedly
+ *
+ * This calls into the backend for every value. Use PhiloxRandomNumberGenerator
+ * where many values are needed.
+ */
+inline
+void
+NativeRandomNumberGenerator::fill(result_type* outValues,
+    std::size_t inNumValues) {
+
+    for (std::size_t i = 0; i < inNumValues; i++)
+        outValues[i] = (*this)();
+}
+
 /**
  * @brief Return tight lower bound on the set of all values returned by
  *     <tt>operator()</tt>
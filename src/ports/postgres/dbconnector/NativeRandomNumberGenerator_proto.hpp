@@ -27,6 +27,7 @@ public:
     NativeRandomNumberGenerator();
     void seed(result_type inSeed);
     result_type operator()();
+    void fill(result_type* outValues, std::size_t inNumValues);
     static result_type min();
     static result_type max();
 };
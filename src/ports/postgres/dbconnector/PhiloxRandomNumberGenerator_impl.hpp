@@ -0,0 +1,143 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file PhiloxRandomNumberGenerator_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_PHILOXRANDOMNUMBERGENERATOR_IMPL_HPP
+#define MADLIB_POSTGRES_PHILOXRANDOMNUMBERGENERATOR_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Construct an engine with a key drawn from the backend's RNG
+ */
+inline
+PhiloxRandomNumberGenerator::PhiloxRandomNumberGenerator() {
+    NativeRandomNumberGenerator native;
+    // drandom() has (at least) 31 random high-order bits
+    uint64_t high = static_cast<uint64_t>(native() * 4294967296.0);
+    uint64_t low = static_cast<uint64_t>(native() * 4294967296.0);
+    setKey((high << 32) | low);
+}
+
+/**
+ * @brief Sets the current state of the engine
+ *
+ * Engines seeded with the same value generate the same sequence.
+ */
+inline
+void
+PhiloxRandomNumberGenerator::seed(result_type inSeed) {
+    uint64_t bits;
+    std::memcpy(&bits, &inSeed, sizeof(bits));
+    setKey(bits);
+}
+
+/**
+ * @brief Advances the engine's state and returns the generated value
+ */
+inline
+PhiloxRandomNumberGenerator::result_type
+PhiloxRandomNumberGenerator::operator()() {
+    if (mBufferPos == 2) {
+        nextBlock(mBuffer);
+        mBufferPos = 0;
+    }
+    return mBuffer[mBufferPos++];
+}
+
+/**
+ * @brief Generate inNumValues values, as if by calling operator() repeatedly
+ */
+inline
+void
+PhiloxRandomNumberGenerator::fill(result_type* outValues,
+    std::size_t inNumValues) {
+
+    result_type* end = outValues + inNumValues;
+    while (outValues < end && mBufferPos < 2)
+        *outValues++ = mBuffer[mBufferPos++];
+    for (; end - outValues >= 2; outValues += 2)
+        nextBlock(outValues);
+    if (outValues < end)
+        *outValues = (*this)();
+}
+
+/**
+ * @brief Return tight lower bound on the set of all values returned by
+ *     <tt>operator()</tt>
+ */
+inline
+PhiloxRandomNumberGenerator::result_type
+PhiloxRandomNumberGenerator::min() {
+    return 0.0;
+}
+
+/**
+ * @brief Return smallest representable number larger than maximum of all values
+ *     returned by <tt>operator()</tt>
+ *
+ * See NativeRandomNumberGenerator::max().
+ */
+inline
+PhiloxRandomNumberGenerator::result_type
+PhiloxRandomNumberGenerator::max() {
+    return 1.0;
+}
+
+inline
+void
+PhiloxRandomNumberGenerator::setKey(uint64_t inKey) {
+    mKey[0] = static_cast<uint32_t>(inKey);
+    mKey[1] = static_cast<uint32_t>(inKey >> 32);
+    mCounter = 0;
+    mBufferPos = 2;
+}
+
+/**
+ * @brief Encrypt the next counter value, and turn the 128 bits into two
+ *     numbers in [0, 1) with 53 random bits each
+ */
+inline
+void
+PhiloxRandomNumberGenerator::nextBlock(result_type* outValues) {
+    uint32_t ctr[4] = {
+        static_cast<uint32_t>(mCounter),
+        static_cast<uint32_t>(mCounter >> 32),
+        0, 0
+    };
+    uint32_t key[2] = { mKey[0], mKey[1] };
+    mCounter++;
+
+    for (int round = 0; round < 10; round++) {
+        uint64_t prod0 = static_cast<uint64_t>(0xD2511F53u) * ctr[0];
+        uint64_t prod1 = static_cast<uint64_t>(0xCD9E8D57u) * ctr[2];
+        uint32_t next[4] = {
+            static_cast<uint32_t>(prod1 >> 32) ^ ctr[1] ^ key[0],
+            static_cast<uint32_t>(prod1),
+            static_cast<uint32_t>(prod0 >> 32) ^ ctr[3] ^ key[1],
+            static_cast<uint32_t>(prod0)
+        };
+        std::copy(next, next + 4, ctr);
+        key[0] += 0x9E3779B9u;
+        key[1] += 0xBB67AE85u;
+    }
+
+    for (int i = 0; i < 2; i++)
+        outValues[i] = (static_cast<double>(ctr[2 * i] >> 5) * 67108864.0
+            + static_cast<double>(ctr[2 * i + 1] >> 6))
+            / 9007199254740992.0;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_PHILOXRANDOMNUMBERGENERATOR_IMPL_HPP)
@@ -0,0 +1,60 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file PhiloxRandomNumberGenerator_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_PHILOXRANDOMNUMBERGENERATOR_PROTO_HPP
+#define MADLIB_POSTGRES_PHILOXRANDOMNUMBERGENERATOR_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Counter-based pseudo-RNG, seeded from the RDBMS random number
+ *     generator
+ *
+ * This is Philox4x32-10 by Salmon et al., "Parallel random numbers: As easy
+ * as 1, 2, 3", SC 2011. The n-th block of random bits is a keyed bijection of
+ * n, so generating numbers costs a few multiplications instead of a call into
+ * the backend per number.
+ *
+ * Unlike NativeRandomNumberGenerator, this RNG has its own state, and it can
+ * be used in place of NativeRandomNumberGenerator where many numbers are
+ * needed. A default-constructed object takes its key from the backend's
+ * random number generator. Since every database process (i.e., every segment
+ * on Greenplum) has its own backend state, and a new key is drawn for every
+ * object, streams of different segments and queries are independent. The
+ * state is plain-old data and may be kept in a UDF's call-site cache.
+ */
+class PhiloxRandomNumberGenerator {
+public:
+    typedef double result_type;
+
+    PhiloxRandomNumberGenerator();
+    void seed(result_type inSeed);
+    result_type operator()();
+    void fill(result_type* outValues, std::size_t inNumValues);
+    static result_type min();
+    static result_type max();
+
+private:
+    void setKey(uint64_t inKey);
+    void nextBlock(result_type* outValues);
+
+    uint32_t mKey[2];
+    uint64_t mCounter;
+    result_type mBuffer[2];
+    uint32_t mBufferPos;
+};
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_PHILOXRANDOMNUMBERGENERATOR_PROTO_HPP)
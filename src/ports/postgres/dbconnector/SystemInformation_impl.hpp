@@ -127,89 +127,270 @@ SystemInformation::get(FunctionCallInfo fcinfo) {
     return sysInfo;
 }
 
+/**
+ * @brief Get the catalog cache of the current backend
+ *
+ * On first use, this creates the memory context and registers the
+ * invalidation callbacks.
+ */
+inline
+CatalogCache&
+CatalogCache::get() {
+    static CatalogCache sCache;
+
+    if (sCache.context == NULL) {
+        MemoryContext context = madlib_AllocSetContextCreate(
+            CacheMemoryContext, "C++ AL / CatalogCache");
+        madlib_CacheRegisterSyscacheCallback(TYPEOID, invalidate, 0);
+        madlib_CacheRegisterSyscacheCallback(PROCOID, invalidate, 0);
+        sCache.context = context;
+    }
+    return sCache;
+}
+
+/**
+ * @brief Syscache callback: Invalidate all entries
+ *
+ * This may be called during any catalog access (when invalidation messages are
+ * processed), so we must not free or allocate anything here.
+ */
+inline
+void
+#if PG_VERSION_NUM >= 90200
+CatalogCache::invalidate(Datum, int, uint32) {
+#else
+CatalogCache::invalidate(Datum, int, ItemPointer) {
+#endif
+    ++get().generation;
+}
+
 /**
  * @brief Get (and cache) information about a PostgreSQL type
  *
- * @param inPGInfo An PGInformation structure containing all cached information
  * @param inTypeID The OID of the type of interest
  */
 inline
 TypeInformation*
-SystemInformation::typeInformation(Oid inTypeID) {
-    TypeInformation* cachedTypeInfo = NULL;
+CatalogCache::typeInformation(Oid inTypeID) {
+    TypeEntry* cachedEntry = NULL;
     bool found = true;
     MemoryContext oldContext;
     HeapTuple tup;
     Form_pg_type pgType;
 
-    // We arrange to look up info about types only once per series of
-    // calls, assuming the type info doesn't change underneath us.
-    initializeOidHashTable(types, cacheContext,
-        sizeof(TypeInformation),
-        "C++ AL / TypeInformation hash table",
-        12);
+    initializeOidHashTable(types, context,
+        sizeof(TypeEntry),
+        "C++ AL / CatalogCache / TypeInformation hash table",
+        64);
 
     // BACKEND: Since we pass HASH_FIND, this function call will never perform
     // an allocation. There is nothing in the code path that would raise an
     // exception (including oid_hash()), so we are *not* wrapping in a PG_TRY()
     // block for performance reasons.
-    cachedTypeInfo = static_cast<TypeInformation*>(
+    cachedEntry = static_cast<TypeEntry*>(
         hash_search(types, &inTypeID, HASH_FIND, &found));
 
+    if (found && cachedEntry->generation == generation) {
+        ++numHits;
+        return &cachedEntry->info;
+    }
+
+    ++numMisses;
+    // Invalidation messages might arrive while we access the syscache. In
+    // that case, this entry will be refreshed once more on the next access.
+    uint64_t currentGeneration = generation;
     if (!found) {
-        cachedTypeInfo = static_cast<TypeInformation*>(
+        cachedEntry = static_cast<TypeEntry*>(
             madlib_hash_search(types, &inTypeID, HASH_ENTER, &found));
-        // cachedTypeInfo.oid is already set
-        tup = madlib_SearchSysCache1(TYPEOID, ObjectIdGetDatum(inTypeID));
-        // BACKEND: HeapTupleIsValid is just a macro
-        if (!HeapTupleIsValid(tup)) {
-            throw std::runtime_error("Error while looking up a type in the "
-                "system catalog.");
-        } else {
-            // BACKEND: GETSTRUCT is just a macro
-            pgType = reinterpret_cast<Form_pg_type>(GETSTRUCT(tup));
-            std::strncpy(cachedTypeInfo->name, pgType->typname.data,
-                NAMEDATALEN);
-            cachedTypeInfo->len = pgType->typlen;
-            cachedTypeInfo->byval = pgType->typbyval;
-            cachedTypeInfo->type = pgType->typtype;
-
-            if (cachedTypeInfo->type == TYPTYPE_COMPOSITE) {
-                // BACKEND: MemoryContextSwitchTo just changes a global
-                // variable
-                oldContext = MemoryContextSwitchTo(cacheContext);
-                // Since type ID != RECORDOID, typmod will not be used and
-                // we can set it to -1
-                // (RECORDOID is a pseudo type and used for transient record
-                // types. They are identified by an index in array
-                // RecordCacheArray defined in typcache.c.)
+        // cachedEntry->info.oid is already set
+    }
+    // Mark as invalid until all fields are filled
+    cachedEntry->generation = currentGeneration - 1;
+
+    TypeInformation* cachedTypeInfo = &cachedEntry->info;
+    tup = madlib_SearchSysCache1(TYPEOID, ObjectIdGetDatum(inTypeID));
+    // BACKEND: HeapTupleIsValid is just a macro
+    if (!HeapTupleIsValid(tup)) {
+        throw std::runtime_error("Error while looking up a type in the "
+            "system catalog.");
+    } else {
+        // BACKEND: GETSTRUCT is just a macro
+        pgType = reinterpret_cast<Form_pg_type>(GETSTRUCT(tup));
+        std::strncpy(cachedTypeInfo->name, pgType->typname.data,
+            NAMEDATALEN);
+        cachedTypeInfo->len = pgType->typlen;
+        cachedTypeInfo->byval = pgType->typbyval;
+        cachedTypeInfo->type = pgType->typtype;
+
+        // If the entry is refreshed, a previous tuple description is not
+        // freed, since there might still be references to it.
+        if (cachedTypeInfo->type == TYPTYPE_COMPOSITE) {
+            // BACKEND: MemoryContextSwitchTo just changes a global
+            // variable
+            oldContext = MemoryContextSwitchTo(context);
+            // Since type ID != RECORDOID, typmod will not be used and
+            // we can set it to -1
+            // (RECORDOID is a pseudo type and used for transient record
+            // types. They are identified by an index in array
+            // RecordCacheArray defined in typcache.c.)
+            try {
                 cachedTypeInfo->tupdesc = madlib_lookup_rowtype_tupdesc_copy(
                     /* type_id */ inTypeID,
                     /* typmod */ -1);
+            } catch (...) {
                 MemoryContextSwitchTo(oldContext);
-            } else {
-                cachedTypeInfo->tupdesc = NULL;
+                madlib_ReleaseSysCache(tup);
+                throw;
             }
-            madlib_ReleaseSysCache(tup);
+            MemoryContextSwitchTo(oldContext);
+        } else {
+            cachedTypeInfo->tupdesc = NULL;
         }
+        madlib_ReleaseSysCache(tup);
     }
 
+    cachedEntry->generation = currentGeneration;
     return cachedTypeInfo;
 }
 
+/**
+ * @brief Get (and cache) catalog information about a PostgreSQL function
+ *
+ * @param inFuncID The OID of the function of interest
+ */
+inline
+const CatalogCache::FunctionEntry*
+CatalogCache::functionEntry(Oid inFuncID) {
+    FunctionEntry* cachedEntry = NULL;
+    bool found = true;
+    HeapTuple tup;
+    Form_pg_proc pgFunc;
+
+    initializeOidHashTable(functions, context,
+        sizeof(FunctionEntry),
+        "C++ AL / CatalogCache / FunctionInformation hash table",
+        64);
+
+    // BACKEND: See typeInformation() why we do not wrap this in PG_TRY()
+    cachedEntry = static_cast<FunctionEntry*>(
+        hash_search(functions, &inFuncID, HASH_FIND, &found));
+
+    if (found && cachedEntry->generation == generation) {
+        ++numHits;
+        return cachedEntry;
+    }
+
+    ++numMisses;
+    uint64_t currentGeneration = generation;
+    if (!found) {
+        cachedEntry = static_cast<FunctionEntry*>(
+            madlib_hash_search(functions, &inFuncID, HASH_ENTER, &found));
+        // cachedEntry->oid is already set
+    }
+    cachedEntry->generation = currentGeneration - 1;
+
+    tup = madlib_SearchSysCache1(PROCOID, ObjectIdGetDatum(inFuncID));
+    if (!HeapTupleIsValid(tup)) {
+        throw std::runtime_error("Error while looking up a function in the "
+            "system catalog.");
+    } else {
+        // BACKEND: GETSTRUCT is just a macro
+        pgFunc = reinterpret_cast<Form_pg_proc>(GETSTRUCT(tup));
+        // The number of arguments (excluding OUT params)
+        cachedEntry->nargs
+            = static_cast<uint16_t>(pgFunc->proargtypes.dim1);
+        cachedEntry->polymorphic = false;
+        cachedEntry->isstrict = pgFunc->proisstrict;
+        cachedEntry->secdef = pgFunc->prosecdef;
+
+        Oid* allargs;
+        // We could use get_func_arg_info() but unfortunately that also
+        // copied names and modes
+        bool onlyINArguments = false;
+        Datum allargtypes = madlib_SysCacheGetAttr(PROCOID, tup,
+            Anum_pg_proc_proallargtypes, &onlyINArguments);
+
+        if (onlyINArguments) {
+            allargs = pgFunc->proargtypes.values;
+        } else {
+            // See get_func_arg_info(). We expect the arrays to be 1-D
+            // arrays of the right types; verify that.
+            // Ensure that array is not toasted. We do not worry about
+            // a possible memory leak here. This code will be run only
+            // once per function and backend (unless the catalog changes),
+            // and memory will already be garbage collected once the current
+            // entry point is left.
+            ArrayType* arr = madlib_DatumGetArrayTypeP(allargtypes);
+            int numargs = ARR_DIMS(arr)[0];
+            madlib_assert(ARR_NDIM(arr) == 1 && ARR_DIMS(arr)[0] >= 0 &&
+                !ARR_HASNULL(arr) && ARR_ELEMTYPE(arr) == OIDOID &&
+                numargs >= pgFunc->pronargs,
+                std::runtime_error("In CatalogCache::"
+                    "functionEntry(): proallargtypes is not a vaid "
+                    "one-dimensional Oid array"));
+            allargs = reinterpret_cast<Oid*>(ARR_DATA_PTR(arr));
+        }
+
+        for (int i = 0; i < pgFunc->pronargs; ++i) {
+            // Note that pgFunc->pronargs is the number of all arguments
+            // (including OUT params)
+            if (typeInformation(allargs[i])->getType()
+                == TYPTYPE_PSEUDO) {
+
+                cachedEntry->polymorphic = true;
+                break;
+            }
+        }
+
+        // If the entry is refreshed, the previous array is not freed, since
+        // there might still be references to it.
+        if (cachedEntry->nargs == 0) {
+            cachedEntry->argtypes = NULL;
+        } else {
+            cachedEntry->argtypes = static_cast<Oid*>(
+                madlib_MemoryContextAlloc(context,
+                    cachedEntry->nargs * sizeof(Oid)));
+            std::memcpy(cachedEntry->argtypes,
+                pgFunc->proargtypes.values,
+                cachedEntry->nargs * sizeof(Oid));
+        }
+
+        cachedEntry->rettype = pgFunc->prorettype;
+        madlib_ReleaseSysCache(tup);
+    }
+
+    cachedEntry->generation = currentGeneration;
+    return cachedEntry;
+}
+
+/**
+ * @brief Get (and cache) information about a PostgreSQL type
+ *
+ * Type information does not depend on the call site, so we directly use the
+ * per-backend cache.
+ *
+ * @param inTypeID The OID of the type of interest
+ */
+inline
+TypeInformation*
+SystemInformation::typeInformation(Oid inTypeID) {
+    return CatalogCache::get().typeInformation(inTypeID);
+}
+
 /**
  * @brief Get (and cache) information about a PostgreSQL function
  *
+ * The catalog information is taken from the per-backend CatalogCache. Only
+ * information that is specific to the current call site (such as the
+ * FmgrInfo) is kept here.
+ *
  * @param inFuncID The OID of the function of interest
- * @return
  */
 inline
 FunctionInformation*
 SystemInformation::functionInformation(Oid inFuncID) {
     FunctionInformation* cachedFuncInfo = NULL;
     bool found = true;
-    HeapTuple tup;
-    Form_pg_proc pgFunc;
 
     // We arrange to look up info about functions only once per series of
     // calls, assuming the function info doesn't change underneath us.
@@ -226,87 +407,36 @@ SystemInformation::functionInformation(Oid inFuncID) {
         hash_search(functions, &inFuncID, HASH_FIND, &found));
 
     if (!found) {
+        const CatalogCache::FunctionEntry* entry
+            = CatalogCache::get().functionEntry(inFuncID);
+
         cachedFuncInfo = static_cast<FunctionInformation*>(
             madlib_hash_search(functions, &inFuncID, HASH_ENTER, &found));
         // cachedFuncInfo.oid is already set
         cachedFuncInfo->mSysInfo = this;
-        tup = madlib_SearchSysCache1(PROCOID, ObjectIdGetDatum(inFuncID));
-        if (!HeapTupleIsValid(tup)) {
-            throw std::runtime_error("Error while looking up a function in the "
-                "system catalog.");
-        } else {
-            // BACKEND: GETSTRUCT is just a macro
-            pgFunc = reinterpret_cast<Form_pg_proc>(GETSTRUCT(tup));
-            cachedFuncInfo->cxx_func = NULL;
-            cachedFuncInfo->flinfo.fn_oid = InvalidOid;
-            // The number of arguments (excluding OUT params)
-            cachedFuncInfo->nargs
-                = static_cast<uint16_t>(pgFunc->proargtypes.dim1);
-            cachedFuncInfo->polymorphic = false;
-            cachedFuncInfo->isstrict = pgFunc->proisstrict;
-            cachedFuncInfo->secdef = pgFunc->prosecdef;
-
-            Oid* allargs;
-            // We could use get_func_arg_info() but unfortunately that also
-            // copied names and modes
-            bool onlyINArguments = false;
-            Datum allargtypes = madlib_SysCacheGetAttr(PROCOID, tup,
-                Anum_pg_proc_proallargtypes, &onlyINArguments);
-
-            if (onlyINArguments) {
-                allargs = pgFunc->proargtypes.values;
-            } else {
-                // See get_func_arg_info(). We expect the arrays to be 1-D
-                // arrays of the right types; verify that.
-                // Ensure that array is not toasted. We do not worry about
-                // a possible memory leak here. This code will be run only
-                // once per entry function (into the C++ AL) and query, and
-                // memory will already be garbage collected once the currenty
-                // entry point is left.
-                ArrayType* arr = madlib_DatumGetArrayTypeP(allargtypes);
-                int numargs = ARR_DIMS(arr)[0];
-                madlib_assert(ARR_NDIM(arr) == 1 && ARR_DIMS(arr)[0] >= 0 &&
-                    !ARR_HASNULL(arr) && ARR_ELEMTYPE(arr) == OIDOID &&
-                    numargs >= pgFunc->pronargs,
-                    std::runtime_error("In SystemInformation::"
-                        "functionInformation(): proallargtypes is not a vaid "
-                        "one-dimensional Oid array"));
-                allargs = reinterpret_cast<Oid*>(ARR_DATA_PTR(arr));
-            }
-
-            for (int i = 0; i < pgFunc->pronargs; ++i) {
-                // Note that pgFunc->pronargs is the number of all arguments
-                // (including OUT params)
-                if (typeInformation(allargs[i])->getType()
-                    == TYPTYPE_PSEUDO) {
-
-                    cachedFuncInfo->polymorphic = true;
-                    break;
-                }
-            }
-
-            if (cachedFuncInfo->nargs == 0) {
-                cachedFuncInfo->argtypes = NULL;
-            } else {
-                cachedFuncInfo->argtypes = static_cast<Oid*>(
-                    madlib_MemoryContextAlloc(cacheContext,
-                        cachedFuncInfo->nargs * sizeof(Oid)));
-                std::memcpy(cachedFuncInfo->argtypes,
-                    pgFunc->proargtypes.values,
-                    cachedFuncInfo->nargs * sizeof(Oid));
-            }
-
-            cachedFuncInfo->rettype = pgFunc->prorettype;
-
-            // If the return type is RECORDOID, we cannot yet determine the
-            // tuple description, even if the function is not polymorphic.
-            // For that, the expression parse tree is required.
-            // If the return type is composite but not RECORDOID, the tuple
-            // description will be stored with the type information, so no
-            // need to have it here.
-            cachedFuncInfo->tupdesc = NULL;
-            madlib_ReleaseSysCache(tup);
-        }
+        cachedFuncInfo->cxx_func = NULL;
+        cachedFuncInfo->callSiteCache = NULL;
+        cachedFuncInfo->statistics = NULL;
+        cachedFuncInfo->flinfo.fn_oid = InvalidOid;
+        cachedFuncInfo->nargs = entry->nargs;
+        cachedFuncInfo->argtypes = entry->argtypes;
+        cachedFuncInfo->polymorphic = entry->polymorphic;
+        cachedFuncInfo->isstrict = entry->isstrict;
+        cachedFuncInfo->secdef = entry->secdef;
+        cachedFuncInfo->rettype = entry->rettype;
+
+        // If the return type is RECORDOID, we cannot yet determine the
+        // tuple description, even if the function is not polymorphic.
+        // For that, the expression parse tree is required.
+        // If the return type is composite but not RECORDOID, the tuple
+        // description will be stored with the type information, so no
+        // need to have it here.
+        cachedFuncInfo->tupdesc = NULL;
+
+        cachedFuncInfo->varlenaArgs = 0;
+        for (uint16_t i = 0; i < cachedFuncInfo->nargs && i < 64; ++i)
+            if (typeInformation(cachedFuncInfo->argtypes[i])->getLen() == -1)
+                cachedFuncInfo->varlenaArgs |= uint64_t(1) << i;
     }
 
     return cachedFuncInfo;
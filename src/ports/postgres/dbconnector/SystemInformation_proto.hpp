@@ -67,6 +67,84 @@ struct TypeInformation {
     char getType();
 };
 
+/**
+ * @brief Per-backend cache of system-catalog information
+ *
+ * SystemInformation lives in \c fn_extra and is therefore rebuilt for every
+ * query (and every call site). Catalog information, however, only changes with
+ * DDL. We therefore keep it in a cache that lives as long as the backend and
+ * that is shared by all calls into the C++ AL. We register syscache callbacks
+ * for pg_type and pg_proc, which invalidate all entries when either catalog
+ * changes. Invalid entries are refreshed in-place when accessed next, so
+ * pointers into the cache stay valid.
+ *
+ * @note
+ *     This is a plain-old data (POD) type with static storage duration, so it
+ *     is zero-initialized before any code runs.
+ */
+struct CatalogCache {
+    /**
+     * @brief Information about a PostgreSQL function, from pg_proc
+     *
+     * @see FunctionInformation
+     */
+    struct FunctionEntry {
+        /**
+         * OID and hash key. Must be the first element.
+         */
+        Oid oid;
+        uint64_t generation;
+        uint16_t nargs;
+        Oid *argtypes;
+        bool polymorphic;
+        bool isstrict;
+        bool secdef;
+        Oid rettype;
+    };
+
+    /**
+     * @brief Information about a PostgreSQL type
+     */
+    struct TypeEntry {
+        /**
+         * Type information. Its first element (the OID) is the hash key.
+         */
+        TypeInformation info;
+        uint64_t generation;
+    };
+
+    /**
+     * Memory context (a child of \c CacheMemoryContext) for all entries
+     */
+    MemoryContext context;
+
+    HTAB *types;
+    HTAB *functions;
+
+    /**
+     * Incremented whenever pg_type or pg_proc change. Entries are only valid
+     * if they were filled in the current generation.
+     */
+    uint64_t generation;
+
+    /**
+     * Number of lookups answered from the cache, and number of lookups that
+     * required a syscache access, respectively
+     */
+    uint64_t numHits;
+    uint64_t numMisses;
+
+    static CatalogCache& get();
+    TypeInformation* typeInformation(Oid inTypeID);
+    const FunctionEntry* functionEntry(Oid inFuncID);
+
+#if PG_VERSION_NUM >= 90200
+    static void invalidate(Datum inArg, int inCacheID, uint32 inHashValue);
+#else
+    static void invalidate(Datum inArg, int inCacheID, ItemPointer inTuplePtr);
+#endif
+};
+
 /**
  * @brief Cached information about PostgreSQL functions
  *
@@ -161,6 +239,25 @@ struct FunctionInformation {
      */
     SystemInformation* mSysInfo;
 
+    /**
+     * Cache of the function for this call site, owned by the function itself.
+     * NULL until the function stores something. See UDF::callSiteCache().
+     */
+    void* callSiteCache;
+
+    /**
+     * Call counters of the function in the current backend. NULL until the
+     * first call via UDF::call(). See FunctionStatistics.
+     */
+    FunctionStatistics* statistics;
+
+    /**
+     * Bit \f$ i \f$ is set if the declared type of argument \f$ i < 64 \f$
+     * has variable length, i.e., if the argument may be toasted. See
+     * madlib_detoast_arguments().
+     */
+    uint64_t varlenaArgs;
+
     Oid getArgumentType(uint16_t inArgID, FmgrInfo* inFmgrInfo = NULL);
     Oid getReturnType(FunctionCallInfo fcinfo);
     TupleDesc getReturnTupleDesc(FunctionCallInfo fcinfo);
@@ -182,6 +279,8 @@ struct FunctionInformation {
  * the \c user_fctx field of struct \c FuncCallContext). As such, the cache only
  * lives till the end of the current query (see
  * <http://www.postgresql.org/docs/current/static/plhandler.html>).
+ * Information that does not depend on the call site is looked up in the
+ * per-backend CatalogCache instead, which survives the end of the query.
  *
  * @note
  *     In order to not leave defined C++ behavior, this must be a plain-old data
@@ -212,17 +311,28 @@ struct SystemInformation {
      */
     Oid collationOID;
 
-    /**
-     * Hash table containing information about all accessed types
-     */
-    HTAB *types;
-
     /**
      * Hash table containing information about all accessed functions
      * (starting from the function called by the backend).
      */
     HTAB *functions;
 
+    /**
+     * Number of arguments that had to be copied because they were accessed
+     * through a mutable handle, but were not the transition state in an
+     * aggregate context
+     */
+    uint64_t numMutableClones;
+
+    /**
+     * Number of read-only array arguments that were used without any copy,
+     * and number of arrays with a short (1-byte) header that were unpacked
+     * into the scratch arena instead of being copied with palloc(),
+     * respectively. See mapForReadOnlyAccess().
+     */
+    uint64_t numArraysMappedInPlace;
+    uint64_t numShortArraysUnpacked;
+
     static SystemInformation* get(FunctionCallInfo fcinfo);
     TypeInformation* typeInformation(Oid inTypeID);
     FunctionInformation* functionInformation(Oid inFuncID);
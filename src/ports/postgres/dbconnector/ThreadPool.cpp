@@ -0,0 +1,171 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ThreadPool.cpp
+ *
+ * @brief Worker threads for computations in the C++ AL
+ *
+ * PostgreSQL backends are single-threaded, and neither memory allocation nor
+ * error handling of the backend may be used from other threads. Worker
+ * threads are therefore only started for the duration of a parallelFor()
+ * call: No thread survives the UDF call that started it (which matters, e.g.,
+ * for elog(ERROR), whose longjmp must not leave threads behind, and for
+ * backends forked from a postmaster that preloaded this library). The
+ * allocator recognizes workers through isWorkerThread() and then uses the
+ * system allocator instead of palloc().
+ *
+ *//* ----------------------------------------------------------------------- */
+
+// We do not write #include "dbconnector.hpp" here because we want to rely on
+// the search paths, which might point to a port-specific dbconnector.hpp
+#include <dbconnector/dbconnector.hpp>
+
+#include <pthread.h>
+#include <signal.h>
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+__thread bool tIsWorkerThread = false;
+
+namespace {
+
+/**
+ * @brief Upper limit for setNumThreads()
+ */
+enum { kMaxNumThreads = 64 };
+
+/**
+ * @brief Number of threads (including the calling one) used by parallelFor()
+ *
+ * The default of 1 means that all work is done by the backend thread.
+ */
+int sNumThreads = 1;
+
+/**
+ * @brief Range of work of a single thread, and its outcome
+ *
+ * Error messages are copied into a fixed buffer because memory allocated by
+ * a worker must not outlive it.
+ */
+struct WorkerRange {
+    ParallelTask* task;
+    size_t begin;
+    size_t end;
+    bool failed;
+    char message[256];
+};
+
+void
+runRange(WorkerRange& ioRange) {
+    ioRange.failed = false;
+    try {
+        ioRange.task->run(ioRange.begin, ioRange.end);
+    } catch (const std::exception& e) {
+        ioRange.failed = true;
+        std::strncpy(ioRange.message, e.what(), sizeof(ioRange.message) - 1);
+        ioRange.message[sizeof(ioRange.message) - 1] = '\0';
+    } catch (...) {
+        ioRange.failed = true;
+        std::strncpy(ioRange.message, "Unknown exception.",
+            sizeof(ioRange.message));
+    }
+}
+
+extern "C" void*
+runWorker(void* inRange) {
+    tIsWorkerThread = true;
+    runRange(*static_cast<WorkerRange*>(inRange));
+    return NULL;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Return the number of threads used by parallelFor()
+ */
+int
+numThreads() {
+    return sNumThreads;
+}
+
+/**
+ * @brief Set the number of threads used by parallelFor()
+ *
+ * @return The previous number of threads
+ */
+int
+setNumThreads(int inNumThreads) {
+    if (inNumThreads < 1 || inNumThreads > kMaxNumThreads)
+        throw std::invalid_argument("Number of threads must be between 1 and "
+            "64.");
+
+    int previous = sNumThreads;
+    sNumThreads = inNumThreads;
+    return previous;
+}
+
+/**
+ * @brief Run a task on the range <tt>[0, inSize)</tt> with up to numThreads()
+ *     threads
+ *
+ * The range is split into contiguous parts of at least \c inMinRangeSize
+ * elements. The calling thread processes the first part itself. Worker
+ * threads block all signals, so signal handlers of the backend only ever run
+ * in the backend thread. If a worker cannot be started, the calling thread
+ * also processes its part. Nested calls (from within a worker) run
+ * sequentially.
+ */
+void
+parallelFor(ParallelTask& inTask, size_t inSize, size_t inMinRangeSize) {
+    if (inMinRangeSize < 1)
+        inMinRangeSize = 1;
+
+    size_t numRanges = std::min<size_t>(sNumThreads,
+        (inSize + inMinRangeSize - 1) / inMinRangeSize);
+    if (numRanges <= 1 || isWorkerThread()) {
+        inTask.run(0, inSize);
+        return;
+    }
+
+    std::vector<WorkerRange> ranges(numRanges);
+    for (size_t i = 0; i < numRanges; ++i) {
+        ranges[i].task = &inTask;
+        ranges[i].begin = inSize * i / numRanges;
+        ranges[i].end = inSize * (i + 1) / numRanges;
+        ranges[i].failed = false;
+    }
+
+    std::vector<pthread_t> threads(numRanges);
+    std::vector<char> started(numRanges, false);
+    sigset_t allSignals, previousSignals;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_SETMASK, &allSignals, &previousSignals);
+    for (size_t i = 1; i < numRanges; ++i)
+        started[i] = pthread_create(&threads[i], NULL, runWorker, &ranges[i])
+            == 0;
+    pthread_sigmask(SIG_SETMASK, &previousSignals, NULL);
+
+    // Workers must have finished before this function is left in any way,
+    // because they access the ranges on our stack
+    runRange(ranges[0]);
+    for (size_t i = 1; i < numRanges; ++i) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            runRange(ranges[i]);
+    }
+
+    for (size_t i = 0; i < numRanges; ++i)
+        if (ranges[i].failed)
+            throw std::runtime_error(std::string("Error in parallel "
+                "computation: ") + ranges[i].message);
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
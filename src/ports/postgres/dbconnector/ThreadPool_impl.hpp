@@ -0,0 +1,40 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ThreadPool_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_THREADPOOL_IMPL_HPP
+#define MADLIB_POSTGRES_THREADPOOL_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Whether the current thread is a worker started by parallelFor()
+ *
+ * Defined in ThreadPool.cpp. All other threads (i.e., the backend thread) see
+ * the initial value \c false.
+ */
+extern __thread bool tIsWorkerThread;
+
+/**
+ * @brief Return whether the current thread is a worker started by
+ *     parallelFor(), i.e., a thread that must not call into the backend
+ */
+inline
+bool
+isWorkerThread() {
+    return tIsWorkerThread;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_THREADPOOL_IMPL_HPP)
@@ -0,0 +1,51 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ThreadPool_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_THREADPOOL_PROTO_HPP
+#define MADLIB_POSTGRES_THREADPOOL_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief A task that can be split into independent ranges of work
+ *
+ * run() is called concurrently from several threads, each time with a
+ * disjoint range <tt>[inBegin, inEnd)</tt>. All threads but the calling one
+ * are not known to the backend, so implementations of run() must obey these
+ * rules:
+ * - No calls into the backend (e.g., no ereport(), no palloc(), no functions
+ *   in Backend.hpp, and no FunctionHandle calls)
+ * - Memory allocated in run() (e.g., by Eigen for temporaries) must also be
+ *   freed in run(). It is allocated with the system allocator.
+ * - Memory allocated by the calling thread must not be freed in run().
+ *
+ * Exceptions thrown by run() are caught and re-thrown by parallelFor() in
+ * the calling thread, as std::runtime_error.
+ */
+class ParallelTask {
+public:
+    virtual ~ParallelTask() { }
+    virtual void run(size_t inBegin, size_t inEnd) = 0;
+};
+
+void parallelFor(ParallelTask& inTask, size_t inSize,
+    size_t inMinRangeSize = 1);
+
+int numThreads();
+int setNumThreads(int inNumThreads);
+inline bool isWorkerThread();
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_THREADPOOL_PROTO_HPP)
@@ -44,6 +44,67 @@ private:
     const T& mOrig;
 };
 
+/**
+ * @brief Copy a pass-by-reference Datum that is about to be modified
+ *
+ * Arguments may only be modified in-place if they are the transition state in
+ * an aggregate context (see AnyType::operator[]()). In all other cases,
+ * mutable handles need a copy. Since copying a large state on every call is
+ * expensive, we count how often this happens.
+ */
+template <typename T>
+inline
+T*
+cloneForMutableAccess(T* (*inCopy)(Datum), Datum inDatum,
+    SystemInformation* inSysInfo) {
+
+    if (inSysInfo)
+        ++inSysInfo->numMutableClones;
+    return inCopy(inDatum);
+}
+
+/**
+ * @brief Get an array Datum that is only read
+ *
+ * Arrays that are neither compressed nor stored out-of-line are mapped in
+ * place. Small arrays stored in a table, however, typically have a short
+ * (1-byte) varlena header, which <tt>struct ArrayType</tt> cannot represent.
+ * PG_DETOAST_DATUM() would copy such an array with palloc() on every call.
+ * Instead, we unpack it into the scratch arena, which is reused by the next
+ * call. Since memory of the scratch arena must not be returned to the
+ * backend, UDF::call() copies a result that points into it.
+ */
+inline
+ArrayType*
+mapForReadOnlyAccess(Datum inDatum, SystemInformation* inSysInfo) {
+    varlena* ptr = reinterpret_cast<varlena*>(DatumGetPointer(inDatum));
+
+    if (!VARATT_IS_EXTENDED(ptr)) {
+        if (inSysInfo)
+            ++inSysInfo->numArraysMappedInPlace;
+        return reinterpret_cast<ArrayType*>(ptr);
+    }
+
+#if defined(VARATT_IS_SHORT)
+    // Short varlena headers have been added to PostgreSQL with commit
+    // 3e23b68d by Tom Lane <tgl@sss.pgh.pa.us>
+    // on Fri Apr 6 04:21:44 2007 UTC. First release: PG8.3.
+    if (VARATT_IS_SHORT(ptr) && !VARATT_IS_EXTERNAL(ptr)) {
+        size_t dataSize = VARSIZE_SHORT(ptr) - VARHDRSZ_SHORT;
+        varlena* unpacked = static_cast<varlena*>(
+            defaultAllocator().allocate<dbal::ScratchContext, dbal::DoNotZero,
+                dbal::ThrowBadAlloc>(dataSize + VARHDRSZ));
+        SET_VARSIZE(unpacked, dataSize + VARHDRSZ);
+        std::memcpy(VARDATA(unpacked), VARDATA_SHORT(ptr), dataSize);
+        if (inSysInfo)
+            ++inSysInfo->numShortArraysUnpacked;
+        return reinterpret_cast<ArrayType*>(unpacked);
+    }
+#endif
+
+    return madlib_DatumGetArrayTypeP(inDatum);
+}
+
 #define WITH_OID(_oid) enum { oid = _oid }
 
 /*
@@ -248,7 +309,8 @@ struct TypeTraits<MutableByteString> : public TypeTraitsBase<MutableByteString>
     WITH_TO_PG_CONVERSION( PointerGetDatum(value.byteString()) );
     WITH_TO_CXX_CONVERSION(
             needMutableClone
-          ? madlib_DatumGetByteaPCopy(value)
+          ? cloneForMutableAccess(
+                madlib_DatumGetByteaPCopy, value, sysInfo)
           : madlib_DatumGetByteaP(value)
     );
 };
@@ -266,6 +328,22 @@ struct TypeTraits<FunctionHandle> {
     WITH_TO_CXX_CONVERSION( FunctionHandle(sysInfo, DatumGetObjectId(value)) );
 };
 
+/*
+ * A state of type internal is only ever passed between the functions of one
+ * aggregate, which may modify it in place. Hence, no clone is needed.
+ */
+template <class T>
+struct TypeTraits<InternalState<T> > {
+    typedef InternalState<T> value_type;
+
+    WITH_OID( INTERNALOID );
+    WITH_TYPE_CLASS( dbal::SimpleType );
+    WITH_MUTABILITY( dbal::Mutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.ptr()) );
+    WITH_TO_CXX_CONVERSION( static_cast<T*>(DatumGetPointer(value)) );
+};
+
 template <>
 struct TypeTraits<ArrayHandle<double> > {
     typedef ArrayHandle<double> value_type;
@@ -275,7 +353,7 @@ struct TypeTraits<ArrayHandle<double> > {
     WITH_MUTABILITY( dbal::Immutable );
     WITH_DEFAULT_EXTENDED_TRAITS;
     WITH_TO_PG_CONVERSION( PointerGetDatum(value.array()) );
-    WITH_TO_CXX_CONVERSION( madlib_DatumGetArrayTypeP(value) );
+    WITH_TO_CXX_CONVERSION( mapForReadOnlyAccess(value, sysInfo) );
 };
 
 // Note: See the comment for PG_FREE_IF_COPY in fmgr.h. Essentially, when
@@ -292,7 +370,95 @@ struct TypeTraits<MutableArrayHandle<double> > {
     WITH_TO_PG_CONVERSION( PointerGetDatum(value.array()) );
     WITH_TO_CXX_CONVERSION(
         needMutableClone
-          ? madlib_DatumGetArrayTypePCopy(value)
+          ? cloneForMutableAccess(
+                madlib_DatumGetArrayTypePCopy, value, sysInfo)
+          : madlib_DatumGetArrayTypeP(value)
+    );
+};
+
+template <>
+struct TypeTraits<ArrayHandle<float> > {
+    typedef ArrayHandle<float> value_type;
+
+    WITH_OID( FLOAT4ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Immutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.array()) );
+    WITH_TO_CXX_CONVERSION( mapForReadOnlyAccess(value, sysInfo) );
+};
+
+template <>
+struct TypeTraits<MutableArrayHandle<float> > {
+    typedef MutableArrayHandle<float> value_type;
+
+    WITH_OID( FLOAT4ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Mutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.array()) );
+    WITH_TO_CXX_CONVERSION(
+        needMutableClone
+          ? cloneForMutableAccess(
+                madlib_DatumGetArrayTypePCopy, value, sysInfo)
+          : madlib_DatumGetArrayTypeP(value)
+    );
+};
+
+template <>
+struct TypeTraits<ArrayHandle<int32_t> > {
+    typedef ArrayHandle<int32_t> value_type;
+
+    WITH_OID( INT4ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Immutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.array()) );
+    WITH_TO_CXX_CONVERSION( mapForReadOnlyAccess(value, sysInfo) );
+};
+
+template <>
+struct TypeTraits<MutableArrayHandle<int32_t> > {
+    typedef MutableArrayHandle<int32_t> value_type;
+
+    WITH_OID( INT4ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Mutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.array()) );
+    WITH_TO_CXX_CONVERSION(
+        needMutableClone
+          ? cloneForMutableAccess(
+                madlib_DatumGetArrayTypePCopy, value, sysInfo)
+          : madlib_DatumGetArrayTypeP(value)
+    );
+};
+
+template <>
+struct TypeTraits<ArrayHandle<int64_t> > {
+    typedef ArrayHandle<int64_t> value_type;
+
+    WITH_OID( INT8ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Immutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.array()) );
+    WITH_TO_CXX_CONVERSION( mapForReadOnlyAccess(value, sysInfo) );
+};
+
+template <>
+struct TypeTraits<MutableArrayHandle<int64_t> > {
+    typedef MutableArrayHandle<int64_t> value_type;
+
+    WITH_OID( INT8ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Mutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.array()) );
+    WITH_TO_CXX_CONVERSION(
+        needMutableClone
+          ? cloneForMutableAccess(
+                madlib_DatumGetArrayTypePCopy, value, sysInfo)
           : madlib_DatumGetArrayTypeP(value)
     );
 };
@@ -314,7 +480,7 @@ struct TypeTraits<
     WITH_TO_PG_CONVERSION( PointerGetDatum(value.memoryHandle().array()) );
     WITH_TO_CXX_CONVERSION(
         ArrayHandle<double>(reinterpret_cast<ArrayType*>(
-            madlib_DatumGetArrayTypeP(value)))
+            mapForReadOnlyAccess(value, sysInfo)))
     );
 };
 
@@ -336,7 +502,54 @@ struct TypeTraits<
     WITH_TO_CXX_CONVERSION(
         MutableArrayHandle<double>(reinterpret_cast<ArrayType*>(
             needMutableClone
-                ? madlib_DatumGetArrayTypePCopy(value)
+                ? cloneForMutableAccess(
+                    madlib_DatumGetArrayTypePCopy, value, sysInfo)
+                : madlib_DatumGetArrayTypeP(value)
+        ))
+    );
+};
+
+template <>
+struct TypeTraits<
+    dbal::eigen_integration::HandleMap<
+        const dbal::eigen_integration::FloatColumnVector,
+        ArrayHandle<float> > > {
+
+    typedef dbal::eigen_integration::HandleMap<
+        const dbal::eigen_integration::FloatColumnVector,
+        ArrayHandle<float> > value_type;
+
+    WITH_OID( FLOAT4ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Immutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.memoryHandle().array()) );
+    WITH_TO_CXX_CONVERSION(
+        ArrayHandle<float>(reinterpret_cast<ArrayType*>(
+            mapForReadOnlyAccess(value, sysInfo)))
+    );
+};
+
+template <>
+struct TypeTraits<
+    dbal::eigen_integration::HandleMap<
+        dbal::eigen_integration::FloatColumnVector,
+        MutableArrayHandle<float> > > {
+
+    typedef dbal::eigen_integration::HandleMap<
+        dbal::eigen_integration::FloatColumnVector,
+        MutableArrayHandle<float> > value_type;
+
+    WITH_OID( FLOAT4ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Mutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.memoryHandle().array()) );
+    WITH_TO_CXX_CONVERSION(
+        MutableArrayHandle<float>(reinterpret_cast<ArrayType*>(
+            needMutableClone
+                ? cloneForMutableAccess(
+                    madlib_DatumGetArrayTypePCopy, value, sysInfo)
                 : madlib_DatumGetArrayTypeP(value)
         ))
     );
@@ -392,7 +605,8 @@ struct TypeTraits<
     WITH_TO_PG_CONVERSION( PointerGetDatum(value.memoryHandle().array()) );
     WITH_TO_CXX_CONVERSION(
         ArrayHandle<double>(
-            reinterpret_cast<ArrayType*>(madlib_DatumGetArrayTypeP(value))
+            reinterpret_cast<ArrayType*>(
+                mapForReadOnlyAccess(value, sysInfo))
         )
     );
 };
@@ -415,7 +629,56 @@ struct TypeTraits<
     WITH_TO_CXX_CONVERSION(
         MutableArrayHandle<double>(
             reinterpret_cast<ArrayType*>(needMutableClone
-                ? madlib_DatumGetArrayTypePCopy(value)
+                ? cloneForMutableAccess(
+                    madlib_DatumGetArrayTypePCopy, value, sysInfo)
+                : madlib_DatumGetArrayTypeP(value)
+        ))
+    );
+};
+
+template <>
+struct TypeTraits<
+    dbal::eigen_integration::HandleMap<
+        const dbal::eigen_integration::FloatMatrix,
+        ArrayHandle<float> > > {
+
+    typedef dbal::eigen_integration::HandleMap<
+        const dbal::eigen_integration::FloatMatrix,
+        ArrayHandle<float> > value_type;
+
+    WITH_OID( FLOAT4ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Immutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.memoryHandle().array()) );
+    WITH_TO_CXX_CONVERSION(
+        ArrayHandle<float>(
+            reinterpret_cast<ArrayType*>(
+                mapForReadOnlyAccess(value, sysInfo))
+        )
+    );
+};
+
+template <>
+struct TypeTraits<
+    dbal::eigen_integration::HandleMap<
+        dbal::eigen_integration::FloatMatrix,
+        MutableArrayHandle<float> > > {
+
+    typedef dbal::eigen_integration::HandleMap<
+        dbal::eigen_integration::FloatMatrix,
+        MutableArrayHandle<float> > value_type;
+
+    WITH_OID( FLOAT4ARRAYOID );
+    WITH_TYPE_CLASS( dbal::ArrayType );
+    WITH_MUTABILITY( dbal::Mutable );
+    WITH_DEFAULT_EXTENDED_TRAITS;
+    WITH_TO_PG_CONVERSION( PointerGetDatum(value.memoryHandle().array()) );
+    WITH_TO_CXX_CONVERSION(
+        MutableArrayHandle<float>(
+            reinterpret_cast<ArrayType*>(needMutableClone
+                ? cloneForMutableAccess(
+                    madlib_DatumGetArrayTypePCopy, value, sysInfo)
                 : madlib_DatumGetArrayTypeP(value)
         ))
     );
@@ -510,6 +773,39 @@ struct TypeTraits<dbal::eigen_integration::SparseColumnVector> {
     );
 };
 
+template <>
+struct TypeTraits<dbal::eigen_integration::MappedSparseMatrix> {
+    typedef dbal::eigen_integration::MappedSparseMatrix value_type;
+
+    WITHOUT_OID;
+    WITH_TYPE_NAME("bytea8");
+    WITH_TYPE_CLASS( dbal::SimpleType );
+    WITH_MUTABILITY( dbal::Immutable );
+    WITHOUT_SYSINFO;
+    WITH_TO_PG_CONVERSION(
+        PointerGetDatum(value.memoryHandle().byteString())
+    );
+    WITH_TO_CXX_CONVERSION(
+        value_type(ByteString(madlib_DatumGetByteaP(value)))
+    );
+};
+
+template <>
+struct TypeTraits<dbal::eigen_integration::SparseMatrix> {
+    typedef dbal::eigen_integration::SparseMatrix value_type;
+
+    WITHOUT_OID;
+    WITH_TYPE_NAME("bytea8");
+    WITH_TYPE_CLASS( dbal::SimpleType );
+    WITH_MUTABILITY( dbal::Immutable );
+    WITHOUT_SYSINFO;
+    WITH_TO_PG_CONVERSION(
+        PointerGetDatum(SparseMatrixToNativeByteString(value))
+    );
+    // No need to support retrieving this type from the backend. Use
+    // MappedSparseMatrix instead.
+};
+
 // Special cases
 
 template <>
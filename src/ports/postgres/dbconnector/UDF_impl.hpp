@@ -47,20 +47,75 @@ UDF::call(FunctionCallInfo fcinfo) {
     char msg[2048];
 
     try {
+        // Temporaries in dbal::ScratchContext are released when we return
+        ScratchArena::Scope scratchScope;
+
         // We want to store in the cache that this function is implemented on
         // top of the C++ AL. Should the same function be invoked again via a
         // FunctionHandle, it can be invoked directly.
-        SystemInformation::get(fcinfo)
-            ->functionInformation(fcinfo->flinfo->fn_oid)->cxx_func
-            = invoke<Function>;
+        SystemInformation* sysInfo = SystemInformation::get(fcinfo);
+        FunctionInformation* funcInfo
+            = sysInfo->functionInformation(fcinfo->flinfo->fn_oid);
+        funcInfo->cxx_func = invoke<Function>;
+
+        // Count the call, and time one in samplingInterval() calls
+        if (funcInfo->statistics == NULL)
+            funcInfo->statistics
+                = FunctionStatistics::get(fcinfo->flinfo->fn_oid);
+        bool isTimed = funcInfo->statistics->beginCall();
+        uint64_t startTime = isTimed ? FunctionStatistics::cpuClock() : 0;
+
+        uint64_t numMutableClones = sysInfo->numMutableClones;
+        uint64_t numCopiesAvoided = sysInfo->numArraysMappedInPlace
+            + sysInfo->numShortArraysUnpacked;
+        uint64_t numShortArraysUnpacked = sysInfo->numShortArraysUnpacked;
+        // Detoast all toasted arguments with a single PG_TRY block. Not for
+        // set-returning functions, which the backend calls repeatedly with
+        // the same arguments while it resets the memory of our copies.
+        if (funcInfo->varlenaArgs && !(fcinfo->resultinfo
+                && IsA(fcinfo->resultinfo, ReturnSetInfo)))
+            madlib_detoast_arguments(fcinfo, funcInfo->varlenaArgs);
 
         AnyType args(fcinfo);
         AnyType result = invoke<Function>(fcinfo, args);
+        if (isTimed)
+            funcInfo->statistics->endTimedCall(
+                FunctionStatistics::cpuClock() - startTime);
+
+        // Copying arguments for mutable access should be rare. In particular,
+        // the transition state of an aggregate is modified in-place. Report
+        // whenever the number of copies reaches a power of two.
+        if (sysInfo->numMutableClones != numMutableClones
+            && (sysInfo->numMutableClones
+                & (sysInfo->numMutableClones - 1)) == 0)
+            madlib_reportMutableClones(fcinfo->flinfo->fn_oid,
+                sysInfo->numMutableClones);
+
+        // Same for the array arguments that did not need a copy
+        uint64_t newNumCopiesAvoided = sysInfo->numArraysMappedInPlace
+            + sysInfo->numShortArraysUnpacked;
+        if (newNumCopiesAvoided != numCopiesAvoided
+            && (newNumCopiesAvoided & (newNumCopiesAvoided - 1)) == 0)
+            madlib_reportArrayCopiesAvoided(fcinfo->flinfo->fn_oid,
+                sysInfo->numArraysMappedInPlace,
+                sysInfo->numShortArraysUnpacked);
 
         if (result.isNull())
             PG_RETURN_NULL();
-        
-        return result.getAsDatum(fcinfo);
+
+        Datum datum = result.getAsDatum(fcinfo);
+
+        // Arguments unpacked into the scratch arena are only valid until we
+        // return. A function may return such an argument unchanged, though.
+        if (sysInfo->numShortArraysUnpacked != numShortArraysUnpacked
+            && !sysInfo->typeInformation(sysInfo->functionInformation(
+                    fcinfo->flinfo->fn_oid)->getReturnType(fcinfo))
+                ->isByValue()
+            && ScratchArena::get().contains(DatumGetPointer(datum)))
+            datum = PointerGetDatum(
+                madlib_DatumGetArrayTypePCopy(datum));
+
+        return datum;
     } catch (std::bad_alloc &) {
         sqlerrcode = ERRCODE_OUT_OF_MEMORY;
         strncpy(msg,
@@ -73,6 +128,8 @@ UDF::call(FunctionCallInfo fcinfo) {
         MADLIB_HANDLE_STANDARD_EXCEPTION(ERRCODE_INVALID_PARAMETER_VALUE);
     } catch (std::domain_error& exc) {
         MADLIB_HANDLE_STANDARD_EXCEPTION(ERRCODE_INVALID_PARAMETER_VALUE);
+    } catch (std::length_error& exc) {
+        MADLIB_HANDLE_STANDARD_EXCEPTION(ERRCODE_PROGRAM_LIMIT_EXCEEDED);
     } catch (std::range_error& exc) {
         MADLIB_HANDLE_STANDARD_EXCEPTION(ERRCODE_DATA_EXCEPTION);
     } catch (std::overflow_error& exc) {
@@ -111,6 +168,209 @@ UDF::call(FunctionCallInfo fcinfo) {
 
 #undef MADLIB_HANDLE_STANDARD_EXCEPTION
 
+/**
+ * @brief Return the cache pointer of this function at its call site
+ *
+ * The pointer is NULL at the first call from a call site (i.e., for a new
+ * struct FmgrInfo), and it keeps its value for all further calls from the same
+ * call site, i.e., typically until the end of the query. This allows a
+ * function to build expensive auxiliary data (say, from a large argument that
+ * is the same for all rows) only once. The cache must only point to memory
+ * obtained from allocateCallSiteCache(), and it must be plain-old data: There
+ * is no cleanup other than by the PostgreSQL garbage collector.
+ */
+inline
+void*&
+UDF::callSiteCache() const {
+    return SystemInformation::get(fcinfo)->functionInformation(
+        fcinfo->flinfo->fn_oid)->callSiteCache;
+}
+
+/**
+ * @brief Allocate zeroed memory that lives as long as the call-site cache
+ */
+inline
+void*
+UDF::allocateCallSiteCache(std::size_t inSize) const {
+    return madlib_MemoryContextAllocZero(
+        SystemInformation::get(fcinfo)->cacheContext, inSize);
+}
+
+/**
+ * @brief Free memory obtained from allocateCallSiteCache()
+ */
+inline
+void
+UDF::freeCallSiteCache(void* inPtr) const {
+    madlib_pfree(inPtr);
+}
+
+/**
+ * @brief Call-site copy of an array argument, see UDF::cachedArrayArgument()
+ *
+ * The struct is followed by the stored representation of the argument (e.g.,
+ * a TOAST pointer) and then by the detoasted array, in a single block of
+ * call-site memory.
+ */
+struct CachedArrayArgument {
+    size_t storedSize;
+    ArrayType* array;
+};
+
+/**
+ * @brief Return a DOUBLE PRECISION[] argument that is detoasted only when its
+ *     stored representation changes
+ *
+ * Arguments like the coefficients of a model are typically the same for all
+ * rows of a query, but detoasting them (e.g., fetching them from the TOAST
+ * table, or copying short arrays to align them) still costs a copy per row.
+ * Equal stored representations (i.e., the very same TOAST pointer, or the
+ * same bytes of compressed or short values) always denote equal arrays, so
+ * it suffices to keep a copy of the stored bytes and compare it with the
+ * next argument. The detoasted array is kept in the call-site cache, which
+ * is therefore no longer available for other purposes. Across queries, the
+ * detoasted arrays of recently used arguments are kept in the per-backend
+ * model cache (see findCachedModel()).
+ *
+ * Plain arrays that need no detoasting are returned directly.
+ */
+inline
+ArrayHandle<double>
+UDF::cachedArrayArgument(uint16_t inID) const {
+    if (inID >= static_cast<uint16_t>(PG_NARGS()))
+        throw std::out_of_range("Invalid type conversion. Access behind "
+            "end of argument list.");
+    if (PG_ARGISNULL(inID))
+        throw std::invalid_argument("Invalid type conversion. "
+            "Null where not expected.");
+    if (SystemInformation::get(fcinfo)->functionInformation(
+            fcinfo->flinfo->fn_oid)->getArgumentType(inID, fcinfo->flinfo)
+        != FLOAT8ARRAYOID)
+        throw std::invalid_argument("Invalid type conversion. "
+            "Expected DOUBLE PRECISION[].");
+
+    Datum datum = PG_GETARG_DATUM(inID);
+    const char* stored = static_cast<const char*>(DatumGetPointer(datum));
+    if (!VARATT_IS_EXTENDED(stored))
+        return ArrayHandle<double>(reinterpret_cast<const ArrayType*>(stored));
+
+#if defined(VARATT_IS_EXTERNAL_EXPANDED)
+    // Expanded objects may change without their pointer changing
+    if (VARATT_IS_EXTERNAL_EXPANDED(stored))
+        return ArrayHandle<double>(madlib_DatumGetArrayTypeP(datum));
+#endif
+
+    size_t storedSize = VARSIZE_ANY(stored);
+    void*& cache = callSiteCache();
+    CachedArrayArgument* cached = static_cast<CachedArrayArgument*>(cache);
+    if (cached == NULL || cached->storedSize != storedSize
+        || std::memcmp(cached + 1, stored, storedSize) != 0) {
+
+        // A new query with the same model (e.g., the next of many
+        // single-row scoring queries) finds it in the per-backend cache.
+        // Only values stored on disk or compressed are identified by their
+        // bytes across queries, pointers to memory are not.
+#if defined(VARATT_IS_EXTERNAL_ONDISK)
+        bool isCacheable = VARATT_IS_EXTERNAL_ONDISK(stored)
+            || VARATT_IS_COMPRESSED(stored);
+#else
+        bool isCacheable = true;
+#endif
+        const ArrayType* array = isCacheable
+            ? findCachedModel(stored, storedSize) : NULL;
+        if (array == NULL) {
+            ArrayType* detoasted = madlib_DatumGetArrayTypeP(datum);
+            if (isCacheable)
+                cacheModel(stored, storedSize, detoasted);
+            array = detoasted;
+        }
+        size_t arrayOffset = MAXALIGN(sizeof(CachedArrayArgument)
+            + storedSize);
+        if (cached != NULL) {
+            cache = NULL;
+            freeCallSiteCache(cached);
+        }
+        cached = static_cast<CachedArrayArgument*>(
+            allocateCallSiteCache(arrayOffset + VARSIZE(array)));
+        cached->storedSize = storedSize;
+        std::memcpy(cached + 1, stored, storedSize);
+        cached->array = reinterpret_cast<ArrayType*>(
+            reinterpret_cast<char*>(cached) + arrayOffset);
+        std::memcpy(cached->array, array, VARSIZE(array));
+        cache = cached;
+    }
+    return ArrayHandle<double>(cached->array);
+}
+
+/**
+ * @brief Call the row function once for each row of the block
+ */
+template <class RowFunction>
+inline
+AnyType
+BlockUDF<RowFunction>::run(AnyType &args) {
+    AnyType state = args[0];
+    uint16_t numColumns = static_cast<uint16_t>(args.numFields() - 1);
+    size_t numRows = 0;
+
+    std::vector<ArrayHandle<double> > columns;
+    std::vector<MutableArrayHandle<double> > rows;
+    for (uint16_t j = 0; j < numColumns; ++j) {
+        if (args[static_cast<uint16_t>(j + 1)].isNull())
+            throw std::invalid_argument("Invalid block of rows. "
+                "Null where not expected.");
+
+        ArrayHandle<double> column
+            = args[static_cast<uint16_t>(j + 1)].getAs<ArrayHandle<double> >();
+        if (column.dims() > 2)
+            throw std::invalid_argument("Invalid block of rows. "
+                "Expected one- or two-dimensional array.");
+
+        size_t columnRows = column.dims() == 0 ? 0 : column.sizeOfDim(0);
+        if (j == 0)
+            numRows = columnRows;
+        else if (columnRows != numRows)
+            throw std::invalid_argument("Invalid block of rows. "
+                "All arrays must contain the same number of rows.");
+
+        columns.push_back(column);
+        rows.push_back(column.dims() == 2
+            ? allocateArray<double, dbal::ScratchContext, dbal::DoZero,
+                dbal::ThrowBadAlloc>(column.sizeOfDim(1))
+            : MutableArrayHandle<double>(NULL));
+    }
+
+    // Only in an aggregate context are we allowed to modify the state
+    // in-place. The row function will return the same state object (or one it
+    // allocated itself), so we hand it on without cloning.
+    // BACKEND: AggCheckCallContext currently will never raise an exception
+    bool isMutable = AggCheckCallContext(fcinfo, NULL);
+    SystemInformation* sysInfo = SystemInformation::get(fcinfo);
+
+    for (size_t i = 0; i < numRows; ++i) {
+        AnyType rowArgs;
+        rowArgs << state;
+
+        for (uint16_t j = 0; j < numColumns; ++j) {
+            if (columns[j].dims() == 2) {
+                size_t width = rows[j].size();
+                std::copy(columns[j].ptr() + i * width,
+                    columns[j].ptr() + (i + 1) * width, rows[j].ptr());
+                rowArgs << rows[j];
+            } else {
+                rowArgs << columns[j][i];
+            }
+        }
+
+        AnyType result = RowFunction(fcinfo).run(rowArgs);
+        state = result.isNull() || result.isComposite()
+            ? result
+            : AnyType(sysInfo, result.mDatum, result.mTypeID, isMutable);
+    }
+
+    return state;
+}
+
 } // namespace postgres
 
 } // namespace dbconnector
@@ -34,6 +34,11 @@ private:
     OutputStreamBuffer<WARNING> mErrStreamBuffer;
 
 protected:
+    void*& callSiteCache() const;
+    void* allocateCallSiteCache(std::size_t inSize) const;
+    void freeCallSiteCache(void* inPtr) const;
+    ArrayHandle<double> cachedArrayArgument(uint16_t inID) const;
+
     /**
      * @brief Informational output stream
      */
@@ -45,6 +50,29 @@ protected:
     std::ostream dberr;
 };
 
+/**
+ * @brief Transition function that processes a block of rows per call
+ *
+ * A BlockUDF wraps the per-row transition function \c RowFunction. Its
+ * arguments are the transition state, followed by one DOUBLE PRECISION[] per
+ * argument of \c RowFunction (other than the state). Each of these holds the
+ * values of all rows in the block: A one-dimensional array holds one
+ * DOUBLE PRECISION per row, a two-dimensional array holds one row (of type
+ * DOUBLE PRECISION[]) per row of the block.
+ *
+ * The block is detoasted and the function-call overhead is paid only once per
+ * block. The state is passed from row to row without being copied. The
+ * individual rows are passed to \c RowFunction in a buffer that is reused for
+ * all rows, so \c RowFunction must not retain references to them.
+ */
+template <class RowFunction>
+class BlockUDF : public UDF {
+public:
+    BlockUDF(FunctionCallInfo inFCInfo) : UDF(inFCInfo) { }
+
+    AnyType run(AnyType &args);
+};
+
 } // namespace postgres
 
 } // namespace dbconnector
@@ -25,6 +25,7 @@ extern "C" {
     #include <utils/array.h>
     #include <utils/builtins.h>    // needed for format_procedure()
     #include <utils/datum.h>
+    #include <utils/inval.h>       // for CacheRegisterSyscacheCallback()
     #include <utils/lsyscache.h>   // for type lookup, e.g., type_is_rowtype
     #include <utils/memutils.h>
     #include <utils/syscache.h>    // for direct access to catalog, e.g., SearchSysCache()
@@ -70,13 +71,18 @@ extern "C" {
 // Note: If errors occur in the following include files, it could indicate that
 // new macros have been added to PostgreSQL header files.
 #include <boost/mpl/if.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/has_trivial_destructor.hpp>
 #include <boost/type_traits/is_const.hpp>
 #include <boost/type_traits/remove_cv.hpp>
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/utility/enable_if.hpp>
 #include <boost/tr1/array.hpp>
 #include <boost/tr1/tuple.hpp>
+#include <algorithm>
+#include <cstring>
 #include <limits>
+#include <new>
 #include <stdexcept>
 #include <vector>
 #include <fstream>
@@ -183,10 +189,15 @@ madlib ## _ ## _pgfunc _arglist { \
 #include "AnyType_proto.hpp"
 #include "ByteString_proto.hpp"
 #include "FunctionHandle_proto.hpp"
+#include "FunctionStatistics_proto.hpp"
+#include "InternalState_proto.hpp"
+#include "ModelCache_proto.hpp"
 #include "NativeRandomNumberGenerator_proto.hpp"
 #include "PGException_proto.hpp"
+#include "PhiloxRandomNumberGenerator_proto.hpp"
 #include "OutputStreamBuffer_proto.hpp"
 #include "SystemInformation_proto.hpp"
+#include "ThreadPool_proto.hpp"
 #include "TransparentHandle_proto.hpp"
 #include "TypeTraits_proto.hpp"
 #include "UDF_proto.hpp"
@@ -203,14 +214,19 @@ using dbconnector::postgres::AnyType;
 using dbconnector::postgres::ArrayHandle;
 using dbconnector::postgres::ByteString;
 using dbconnector::postgres::FunctionHandle;
+using dbconnector::postgres::InternalState;
 using dbconnector::postgres::MutableArrayHandle;
 using dbconnector::postgres::MutableByteString;
 using dbconnector::postgres::NativeRandomNumberGenerator;
+using dbconnector::postgres::ParallelTask;
+using dbconnector::postgres::PhiloxRandomNumberGenerator;
+using dbconnector::postgres::PreparedFunctionCall;
 using dbconnector::postgres::TransparentHandle;
 
 // Import MADlib functions into madlib namespace
 using dbconnector::postgres::defaultAllocator;
 using dbconnector::postgres::Null;
+using dbconnector::postgres::parallelFor;
 
 } // namespace madlib
 
@@ -226,8 +242,12 @@ using dbconnector::postgres::Null;
 #include "ByteString_impl.hpp"
 #include "EigenIntegration_impl.hpp"
 #include "FunctionHandle_impl.hpp"
+#include "FunctionStatistics_impl.hpp"
+#include "InternalState_impl.hpp"
 #include "NativeRandomNumberGenerator_impl.hpp"
 #include "OutputStreamBuffer_impl.hpp"
+#include "PhiloxRandomNumberGenerator_impl.hpp"
+#include "ThreadPool_impl.hpp"
 #include "TransparentHandle_impl.hpp"
 #include "TypeTraits_impl.hpp"
 #include "UDF_impl.hpp"
@@ -254,6 +274,59 @@ typedef dbal::DynamicStructRootContainer<
     } \
     }
 
+/**
+ * Declare a transition function that processes a block of rows per call by
+ * calling the transition function _rowfunction once per row.
+ *
+ * @see BlockUDF
+ */
+#define DECLARE_BLOCK_UDF(_module, _name, _rowfunction) \
+    namespace madlib { \
+    namespace modules { \
+    namespace _module { \
+    typedef dbconnector::postgres::BlockUDF<_rowfunction> _name; \
+    } \
+    } \
+    }
+
+#define DECLARE_BLOCK_UDF_EXTERNAL(_module, _name, _rowfunction) \
+    DECLARE_UDF_EXTERNAL(_module, _name)
+
+#if defined(MADLIB_CPU_DISPATCH)
+
+namespace madlib {
+namespace dbconnector {
+namespace postgres {
+
+PGFunction cpuVariantFunction(const char *inName);
+
+} // namespace postgres
+} // namespace dbconnector
+} // namespace madlib
+
+/**
+ * With runtime CPU dispatch, each entry point first forwards to the same
+ * function in the library variant that was selected for this CPU by
+ * _PG_init() (see main.cpp). Only if there is no such variant, the function is
+ * executed by the baseline code in this library.
+ */
+#define DECLARE_UDF_EXTERNAL(_module, _name) \
+    namespace external { \
+        extern "C" { \
+            PG_FUNCTION_INFO_V1(_name); \
+            Datum _name(PG_FUNCTION_ARGS) { \
+                static const PGFunction sVariant = \
+                    madlib::dbconnector::postgres::cpuVariantFunction(#_name); \
+                if (sVariant != NULL) \
+                    return sVariant(fcinfo); \
+                return madlib::dbconnector::postgres::UDF::call< \
+                    madlib::modules::_module::_name>(fcinfo); \
+            } \
+        } \
+    }
+
+#else // defined(MADLIB_CPU_DISPATCH)
+
 #define DECLARE_UDF_EXTERNAL(_module, _name) \
     namespace external { \
         extern "C" { \
@@ -265,4 +338,6 @@ typedef dbal::DynamicStructRootContainer<
         } \
     }
 
+#endif // defined(MADLIB_CPU_DISPATCH)
+
 #endif // defined(MADLIB_POSTGRES_DBCONNECTOR_HPP)
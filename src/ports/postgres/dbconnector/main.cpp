@@ -10,14 +10,132 @@
 // the search paths, which might point to a port-specific dbconnector.hpp
 #include <dbconnector/dbconnector.hpp>
 
+#if defined(MADLIB_CPU_DISPATCH)
+#include <dlfcn.h>
+#include <cstring>
+#include <string>
+#endif
+
 extern "C" {
     PG_MODULE_MAGIC;
 } // extern "C"
 
+#if defined(MADLIB_CPU_DISPATCH)
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+namespace {
+
+/**
+ * @brief Handle of the library variant compiled for the best instruction set
+ *     this CPU supports, or NULL if the baseline code in this library is used
+ */
+void *sCPUVariant = NULL;
+
+/**
+ * @brief Return the file-name suffix of the best library variant for this CPU
+ *
+ * The suffixes correspond to MADLIB_CPU_VARIANTS in the top-level
+ * CMakeLists.txt. Note that __builtin_cpu_supports() also verifies that the
+ * operating system saves the extended registers.
+ */
+const char *
+cpuVariantSuffix() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")
+        && __builtin_cpu_supports("avx512dq")
+        && __builtin_cpu_supports("avx512vl")
+        && __builtin_cpu_supports("avx512bw"))
+        return "_avx512";
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return "_avx2";
+    return NULL;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Return the entry point of a function in the selected library variant
+ *
+ * @return The function, or NULL if no variant has been loaded
+ */
+PGFunction
+cpuVariantFunction(const char *inName) {
+    if (sCPUVariant == NULL)
+        return NULL;
+
+    // ISO C++ does not allow casting object pointers to function pointers,
+    // but POSIX guarantees that dlsym() results can be used as such.
+    void *symbol = dlsym(sCPUVariant, inName);
+    PGFunction function;
+    std::memcpy(&function, &symbol, sizeof(function));
+    return function;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+extern "C" {
+
+/**
+ * @brief Load the library variant for the best instruction set of this CPU
+ *
+ * PostgreSQL calls this function once when it loads the library. The variants
+ * are installed next to this library, with the instruction set as a suffix of
+ * the file name (e.g., libmadlib_avx2.so next to libmadlib.so). If no variant
+ * is needed or it cannot be loaded, all functions run the baseline code.
+ */
+void
+_PG_init(void) {
+    using madlib::dbconnector::postgres::sCPUVariant;
+
+    const char *suffix = madlib::dbconnector::postgres::cpuVariantSuffix();
+    Dl_info info;
+    if (suffix == NULL || dladdr(&sCPUVariant, &info) == 0
+        || info.dli_fname == NULL)
+        return;
+
+    std::string path(info.dli_fname);
+    std::string::size_type slash = path.rfind('/');
+    std::string::size_type dot = path.rfind('.');
+    if (dot == std::string::npos
+        || (slash != std::string::npos && dot < slash))
+        dot = path.size();
+    path.insert(dot, suffix);
+
+    // The variants are linked with -Bsymbolic, so they call their own
+    // functions even though this library exports the same symbols.
+    sCPUVariant = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (sCPUVariant == NULL)
+        elog(DEBUG1, "Could not load MADlib library variant \"%s\": %s",
+            path.c_str(), dlerror());
+}
+
+} // extern "C"
+
+#endif // defined(MADLIB_CPU_DISPATCH)
+
+// A per-module library (see MADLIB_MODULE_LIBRARIES in the top-level
+// CMakeLists.txt) only exports the functions of its module
+#if defined(MADLIB_MODULE_HEADER)
+    #define MADLIB_DECLARATIONS MADLIB_MODULE_HEADER
+#else
+    #define MADLIB_DECLARATIONS <modules/declarations.hpp>
+#endif
+
 // Include declarations declarations
-#include <modules/declarations.hpp>
+#include MADLIB_DECLARATIONS
 
 // Now export the symbols
 #undef DECLARE_UDF
+#undef DECLARE_BLOCK_UDF
 #define DECLARE_UDF DECLARE_UDF_EXTERNAL
-#include <modules/declarations.hpp>
+#define DECLARE_BLOCK_UDF DECLARE_BLOCK_UDF_EXTERNAL
+#include MADLIB_DECLARATIONS
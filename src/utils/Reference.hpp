@@ -18,6 +18,11 @@ namespace utils {
  * to store an integer value (which might be the most efficient solution to
  * store a composite type of floating-point and integer values as a double
  * array).
+ *
+ * Integers stored as doubles are exact up to \f$ 2^{53} \f$, which is more
+ * than any row count we will see. Arithmetic through a MutableReference
+ * (e.g., <tt>++numRows</tt> or <tt>numRows += other.numRows</tt>) is done in
+ * type T, so only reading the value converts it to type U.
  */
 template <typename T, typename U = T>
 class Reference {
@@ -37,7 +42,7 @@ public:
      * @brief Return the value pointed to by the reference as type U
      */
     operator U() const {
-        return static_cast<U>(*mPtr);
+        return value();
     }
 
     const T* ptr() const {
@@ -49,6 +54,10 @@ public:
     }
 
 protected:
+    U value() const {
+        return static_cast<U>(*mPtr);
+    }
+
     /**
      * Defined but protected.
      */
@@ -99,7 +108,7 @@ public:
     }
 
     U operator++(int) {
-        U returnValue = static_cast<U>(*mPtr);
+        U returnValue = Base::value();
         *mPtr += static_cast<T>(1);
         return returnValue;
     }
@@ -121,6 +130,21 @@ protected:
     using Base::mPtr;
 };
 
+/**
+ * @brief Convert a double to uint64_t by way of int64_t
+ *
+ * Counters are read once per row in transition functions (e.g.,
+ * <tt>state.numRows == 0</tt>). The conversion from double to an unsigned
+ * 64-bit integer needs a comparison and a branch on x86-64, whereas the
+ * conversion to a signed one is a single instruction. Counters never reach
+ * \f$ 2^{63} \f$, so both give the same result.
+ */
+template <>
+inline
+uint64_t
+Reference<double, uint64_t>::value() const {
+    return static_cast<uint64_t>(static_cast<int64_t>(*mPtr));
+}
 
 } // namespace modules
 